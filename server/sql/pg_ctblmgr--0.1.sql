@@ -14,7 +14,8 @@ CREATE TABLE @extschema@.maintenance_group
 (
     maintenance_group   INTEGER PRIMARY KEY DEFAULT nextval( '@extschema@.sq_pk_maintenance_group' ),
     title               VARCHAR NOT NULL,
-    wal_level           CHAR() NOT NULL DEFAULT 'F'::CHAR
+    wal_level           CHAR() NOT NULL DEFAULT 'F'::CHAR,
+    freshness_target    INTERVAL CHECK( freshness_target > INTERVAL '0' ) -- how far behind the source its objects may be applied, NULL for no target
 );
 
 CREATE UNIQUE INDEX ix_unique_maintenance_group_title ON @extschema@.tb_maintenance_group( title );
@@ -39,7 +40,8 @@ CREATE TABLE @extschema@.tb_location
     location    INTEGER PRIMARY KEY DEFAULT nextval( '@extschema@.sq_pk_location' ),
     hostname    VARCHAR NOT NULL DEFAULT 'localhost',
     port        SMALLINT NOT NULL,
-    username    VARCHAR NOT NULL
+    username    VARCHAR NOT NULL,
+    dbname      VARCHAR NOT NULL DEFAULT current_database() -- database the targets are kept in
 );
 
 SELECT pg_catalog.pg_extension_config_dump( '@extschema@.sq_pk_location', '' );
@@ -55,9 +57,31 @@ CREATE TABLE @extschema@.maintenance_object
     namespace          VARCHAR NOT NULL DEFAULT 'public', -- schema / namespace
     name               VARCHAR NOT NULL, -- table_name
     driver             INTEGER NOT NULL REFERENCES @extschema@.tb_driver,
-    location           INTEGER NOT NULL REFERENCES @extschema@.tb_location
+    location           INTEGER NOT NULL REFERENCES @extschema@.tb_location,
+    freshness_target   INTERVAL CHECK( freshness_target > INTERVAL '0' ) -- overrides that of its group
 );
 
 CREATE UNIQUE INDEX ix_unique_maintenance_object_name ON @extschema@.tb_maintenance_object( namespace, name );
 SELECT pg_catalog.pg_extension_config_dump( '@extschema@.sq_pk_maintnenace_object', '' );
 SELECT pg_catalog.pg_extension_config_dump( '@extschema@.tb_maintnenace_object', '' );
+
+-- Locations each object is also maintained at, besides its own
+CREATE TABLE @extschema@.maintenance_object_location
+(
+    maintenance_object INTEGER NOT NULL REFERENCES @extschema@.maintenance_object ON DELETE CASCADE,
+    location           INTEGER NOT NULL REFERENCES @extschema@.tb_location,
+    PRIMARY KEY( maintenance_object, location )
+);
+
+SELECT pg_catalog.pg_extension_config_dump( '@extschema@.maintenance_object_location', '' );
+
+-- Position of the change stream up to which each object's target at each
+-- location is current. Written on the target, in the transaction that
+-- applies the changes, which need not have the catalog rows referred to
+CREATE TABLE @extschema@.maintenance_progress
+(
+    maintenance_object INTEGER NOT NULL,
+    location           INTEGER NOT NULL,
+    lsn                PG_LSN NOT NULL, -- end of the last transaction applied
+    PRIMARY KEY( maintenance_object, location )
+);
@@ -30,7 +30,9 @@ static void pg_ctblmgr_decode_startup(
     bool                     is_init
 )
 {
-    decode_data * data = NULL;
+    decode_data * data    = NULL;
+    ListCell *    option  = NULL;
+    DefElem *     element = NULL;
 
     data = ( decode_data * ) palloc0( sizeof( decode_data ) );
 
@@ -54,7 +56,51 @@ static void pg_ctblmgr_decode_startup(
         ALLOCSET_DEFAULT_MAXSIZE
     );
 
-    data->num_changes = 0;
+    data->num_changes   = 0;
+    data->binary_values = false;
+
+    /*
+     * binary_values makes the decoder emit each value in its type's binary
+     * send format (hex encoded, to survive the JSON framing) along with the
+     * type OIDs of the relation, so that values never pass through their
+     * type's output and input functions on the way to the target.
+     */
+    foreach( option, context->output_plugin_options )
+    {
+        element = ( DefElem * ) lfirst( option );
+
+        if( strcmp( element->defname, "binary_values" ) == 0 )
+        {
+            if( element->arg == NULL )
+            {
+                data->binary_values = true;
+            }
+            else if( !parse_bool( strVal( element->arg ), &data->binary_values ) )
+            {
+                ereport(
+                    ERROR,
+                    (
+                        errcode( ERRCODE_INVALID_PARAMETER_VALUE ),
+                        errmsg(
+                            "Could not parse value \"%s\" for parameter \"%s\"",
+                            strVal( element->arg ),
+                            element->defname
+                        )
+                    )
+                );
+            }
+        }
+        else
+        {
+            ereport(
+                ERROR,
+                (
+                    errcode( ERRCODE_INVALID_PARAMETER_VALUE ),
+                    errmsg( "Unknown option \"%s\"", element->defname )
+                )
+            );
+        }
+    }
 
     context->output_plugin_private = data;
     options->output_type           = OUTPUT_PLUGIN_TEXTUAL_OUTPUT;
@@ -105,7 +151,8 @@ static void pg_ctblmgr_decode_begin_tx(
         txn->xid,
         timestamptz_to_str(
             txn->commit_time
-        )
+        ),
+        ( int64 ) txn->commit_time
     );
 
     OutputPluginWrite( context, true );
@@ -125,7 +172,8 @@ static void pg_ctblmgr_decode_commit_tx(
         transaction_boundary,
         "COMMIT",
         txn->xid,
-        timestamptz_to_str( txn->commit_time )
+        timestamptz_to_str( txn->commit_time ),
+        ( int64 ) txn->commit_time
     );
 
     OutputPluginWrite( context, true );
@@ -214,6 +262,7 @@ static void pg_ctblmgr_decode_change(
 
     old_context = MemoryContextSwitchTo( data->context );
 
+    OutputPluginPrepareWrite( context, true );
     appendStringInfo(
         context->out,
         dml_preamble,
@@ -224,6 +273,11 @@ static void pg_ctblmgr_decode_change(
         table_name
     );
 
+    if( data->binary_values )
+    {
+        append_tuple_types( context->out, tuple_descriptor );
+    }
+
     if( change->data.tp.oldtuple != NULL )
     {
         old_tuple = &change->data.tp.oldtuple->tuple;
@@ -258,7 +312,7 @@ static void pg_ctblmgr_decode_change(
 
             appendStringInfo(
                 context->out,
-                "\"%s\"",
+                "\"%s\":",
                 NameStr( attribute_form->attname )
             );
 
@@ -266,7 +320,8 @@ static void pg_ctblmgr_decode_change(
                 context->out,
                 tuple_descriptor,
                 tuple,
-                j
+                j,
+                data->binary_values
             );
         }
 
@@ -283,7 +338,12 @@ static void pg_ctblmgr_decode_change(
     if( new_tuple != NULL )
     {
         appendStringInfoString( context->out, "\"new\":{" );
-        append_tuple( context->out, tuple_descriptor, new_tuple );
+        append_tuple(
+            context->out,
+            tuple_descriptor,
+            new_tuple,
+            data->binary_values
+        );
         appendStringInfoChar( context->out, '}' );
     }
 
@@ -295,7 +355,12 @@ static void pg_ctblmgr_decode_change(
         }
 
         appendStringInfoString( context->out, "\"old\":{" );
-        append_tuple( context->out, tuple_descriptor, old_tuple );
+        append_tuple(
+            context->out,
+            tuple_descriptor,
+            old_tuple,
+            data->binary_values
+        );
         appendStringInfoChar( context->out, '}' );
     }
 
@@ -308,11 +373,13 @@ static void pg_ctblmgr_decode_change(
     return;
 }
 
+// attribute_number is 1-based, as for fastgetattr()
 static void append_tuple_value(
     StringInfo   string,
     TupleDesc    tuple_descriptor,
     HeapTuple    tuple,
-    unsigned int index
+    unsigned int attribute_number,
+    bool         binary
 )
 {
     bool              type_is_variable_length = false;
@@ -323,21 +390,32 @@ static void append_tuple_value(
     Oid               type_id                 = {0};
     Datum             value                   = {0};
 
-    attribute_form = tuple_descriptor->attrs[index];
+    attribute_form = tuple_descriptor->attrs[attribute_number - 1];
     original_value = fastgetattr(
         tuple,
-        index,
+        attribute_number,
         tuple_descriptor,
         &is_null
     );
 
     type_id = attribute_form->atttypid;
 
-    getTypeOutputInfo(
-        type_id,
-        &type_output,
-        &type_is_variable_length
-    );
+    if( binary )
+    {
+        getTypeBinaryOutputInfo(
+            type_id,
+            &type_output,
+            &type_is_variable_length
+        );
+    }
+    else
+    {
+        getTypeOutputInfo(
+            type_id,
+            &type_output,
+            &type_is_variable_length
+        );
+    }
 
     if( is_null )
     {
@@ -350,6 +428,20 @@ static void append_tuple_value(
     {
         // May need to de-toast?
     }
+    else if( binary )
+    {
+        value = original_value;
+
+        if( type_is_variable_length )
+        {
+            value = PointerGetDatum( PG_DETOAST_DATUM( original_value ) );
+        }
+
+        append_binary_value(
+            string,
+            OidSendFunctionCall( type_output, value )
+        );
+    }
     else if( !type_is_variable_length )
     {
         append_literal_value(
@@ -452,10 +544,69 @@ static void append_literal_value(
     return;
 }
 
+// Hex encodes the output of a type's send function as a JSON string
+static void append_binary_value( StringInfo string, bytea * bytes )
+{
+    static const char * hex_digits = "0123456789abcdef";
+    unsigned char *     data       = NULL;
+    int                 length     = 0;
+    int                 i          = 0;
+
+    data   = ( unsigned char * ) VARDATA( bytes );
+    length = VARSIZE( bytes ) - VARHDRSZ;
+
+    enlargeStringInfo( string, length * 2 + 2 );
+    string->data[string->len++] = '"';
+
+    for( i = 0; i < length; i++ )
+    {
+        string->data[string->len++] = hex_digits[( data[i] >> 4 ) & 0x0f];
+        string->data[string->len++] = hex_digits[data[i] & 0x0f];
+    }
+
+    string->data[string->len++] = '"';
+    string->data[string->len]   = '\0';
+    return;
+}
+
+// Emits the type OID of each live attribute, used with binary_values
+static void append_tuple_types( StringInfo string, TupleDesc tuple_descriptor )
+{
+    unsigned int      i              = 0;
+    bool              first          = true;
+    Form_pg_attribute attribute_form = {0};
+
+    appendStringInfoString( string, ",\"types\":{" );
+
+    for( i = 0; i < tuple_descriptor->natts; i++ )
+    {
+        attribute_form = tuple_descriptor->attrs[i];
+
+        if( attribute_form->attisdropped || attribute_form->attnum < 0 )
+        {
+            continue;
+        }
+
+        appendStringInfo(
+            string,
+            "%s\"%s\":%u",
+            first ? "" : ",",
+            NameStr( attribute_form->attname ),
+            attribute_form->atttypid
+        );
+
+        first = false;
+    }
+
+    appendStringInfoChar( string, '}' );
+    return;
+}
+
 static void append_tuple(
     StringInfo string,
     TupleDesc  tuple_descriptor,
-    HeapTuple  tuple
+    HeapTuple  tuple,
+    bool       binary
 )
 {
     unsigned int      i              = 0;
@@ -481,7 +632,7 @@ static void append_tuple(
             )
         );
 
-        append_tuple_value( string, tuple_descriptor, tuple, i - 1 );
+        append_tuple_value( string, tuple_descriptor, tuple, i + 1, binary );
         
         if( i < tuple_descriptor->natts - 1 )
         {
@@ -10,6 +10,7 @@
 #include "catalog/pg_class.h"
 #include "catalog/pg_type.h"
 #include "nodes/parsenodes.h"
+#include "nodes/pg_list.h"
 #include "utils/typcache.h"
 #include "utils/relcache.h"
 #include "utils/syscache.h"
@@ -49,10 +50,12 @@ extern bool should_forward_guc_to_wal( const char * );
 extern void _PG_init( void );
 extern void PGDLLEXPORT _PG_output_plugin_init( OutputPluginCallbacks * );
 
+// commit_time is also given as microseconds since 2000-01-01, for the service to measure latency from
 const char * transaction_boundary = "{\
 \"type\":\"%s\",\
 \"xid\":\"%u\",\
-\"timestamp\":\"%s\"\
+\"timestamp\":\"%s\",\
+\"commit_time\":\"" INT64_FORMAT "\"\
 }";
 
 const char * dml_preamble = "{\
@@ -60,12 +63,13 @@ const char * dml_preamble = "{\
 \"xid\":\"%u\",\
 \"timestamp\":\"%s\",\
 \"schema_name\":\"%s\",\
-\"table_name\":\"%s\",";
+\"table_name\":\"%s\"";
 
 typedef struct {
     MemoryContext context;
     unsigned long num_changes;
     bool          wrote_tx_changes;
+    bool          binary_values; // emit values in their type's send format
 } decode_data;
 
 static void pg_ctblmgr_decode_startup(
@@ -108,9 +112,12 @@ static void append_tuple_value(
     StringInfo,
     TupleDesc,
     HeapTuple,
-    unsigned int
+    unsigned int,
+    bool
 );
 
 static void append_literal_value( StringInfo, Oid, char * );
-static void append_tuple( StringInfo, TupleDesc, HeapTuple );
+static void append_binary_value( StringInfo, bytea * );
+static void append_tuple( StringInfo, TupleDesc, HeapTuple, bool );
+static void append_tuple_types( StringInfo, TupleDesc );
 #endif // PG_CTBLMGR_DECODER_H
@@ -0,0 +1,478 @@
+#include "src/pg_ctblmgr.h"
+
+/*
+ * Compares accumulating aggregate deltas a row at a time against doing so a
+ * column at a time over change batches. Both run over the same generated
+ * stream of inserts, updates and deletes to
+ *
+ *   sales( id integer, region text, store integer, qty integer, amount double precision )
+ *
+ * grouped as
+ *
+ *   SELECT region, store, sum( qty ), sum( amount ), count(*)
+ *     FROM sales
+ *    WHERE qty > 0
+ * GROUP BY region, store
+ *
+ * and must end up with the same deltas, with values as text and in their
+ * binary send format. No database is needed.
+ */
+
+#define BENCH_CHANGES 1000000
+#define BENCH_TRANSACTION_CHANGES 100
+#define BENCH_REGIONS 64
+#define BENCH_STORES 16
+#define BENCH_ROUNDS 5
+#define BENCH_TEXT_OID 25
+#define BENCH_TUPLES 4096
+
+static char * relation_columns[] = { "id", "region", "store", "qty", "amount" };
+static char * relation_types[]   = { "integer", "text", "integer", "integer", "double precision" };
+
+/*
+ * Changes share a pool of tuples and names, as decoded changes are consumed
+ * while still in cache; a stream of distinct ones would time memory instead.
+ */
+static struct tuple * tuples[BENCH_TUPLES] = { NULL };
+static char           schema_name[]        = "public";
+static char           table_name[]         = "sales";
+
+static struct tuple * _make_tuple( unsigned int );
+static void _set_binary( struct tuple *, unsigned int, uint64_t, int, Oid );
+static struct change ** _make_changes( unsigned long * );
+static void _free_changes( struct change **, unsigned long );
+static struct aggregate_accumulator * _make_accumulator(
+    struct maintenance_object *,
+    struct ivm_relation *,
+    bool
+);
+static bool _same_deltas( struct aggregate_accumulator *, struct aggregate_accumulator * );
+static double _run( struct aggregate_accumulator *, struct change **, unsigned long );
+
+int main( int argc, char ** argv )
+{
+    struct maintenance_object      object        = {0};
+    struct ivm_relation            relation      = {0};
+    struct aggregate_accumulator * row_path      = NULL;
+    struct aggregate_accumulator * batch_path    = NULL;
+    struct change **               changes       = NULL;
+    unsigned long                  num_changes   = 0;
+    unsigned int                   mode          = 0;
+    unsigned int                   round         = 0;
+    double                         row_seconds   = 0;
+    double                         batch_seconds = 0;
+    double                         seconds       = 0;
+    bool                           filtered      = false;
+
+    object.qualified_name = "public.sales_by_store";
+    relation.schema_name  = "public";
+    relation.table_name   = "sales";
+    relation.name         = "sales";
+    relation.num_columns  = 5;
+    relation.columns      = relation_columns;
+    relation.column_types = relation_types;
+
+    // Text without and with the filter, then binary without and with it
+    for( mode = 0; mode < 4; mode++ )
+    {
+        filtered = mode % 2 == 1;
+
+        if( mode % 2 == 0 )
+        {
+            _free_changes( changes, num_changes );
+            binary_values = mode >= 2;
+            changes       = _make_changes( &num_changes );
+
+            if( changes == NULL )
+            {
+                return 1;
+            }
+
+            printf(
+                "%lu changes, %u groups, %s values, best of %u rounds\n",
+                num_changes,
+                BENCH_REGIONS * BENCH_STORES,
+                binary_values ? "binary" : "text",
+                BENCH_ROUNDS
+            );
+        }
+
+        row_path      = _make_accumulator( &object, &relation, filtered );
+        batch_path    = _make_accumulator( &object, &relation, filtered );
+        row_seconds   = 0;
+        batch_seconds = 0;
+
+        if( row_path == NULL || batch_path == NULL )
+        {
+            return 1;
+        }
+
+        for( round = 0; round < BENCH_ROUNDS; round++ )
+        {
+            accumulator_batch_rows = 0;
+            seconds                = _run( row_path, changes, num_changes );
+            row_seconds            = round == 0 || seconds < row_seconds ? seconds : row_seconds;
+
+            accumulator_batch_rows = DEFAULT_BATCH_ROWS;
+            seconds                = _run( batch_path, changes, num_changes );
+            batch_seconds          = round == 0 || seconds < batch_seconds ? seconds : batch_seconds;
+        }
+
+        if( !_same_deltas( row_path, batch_path ) )
+        {
+            printf( "row and batch paths disagree\n" );
+            return 1;
+        }
+
+        printf(
+            "  %-12s row: %7.1f ns/change  batch: %7.1f ns/change  speedup: %.2fx\n",
+            filtered ? "WHERE qty>0" : "no filter",
+            row_seconds * 1e9 / num_changes,
+            batch_seconds * 1e9 / num_changes,
+            row_seconds / batch_seconds
+        );
+
+        free_aggregate_accumulator( row_path );
+        free_aggregate_accumulator( batch_path );
+    }
+
+    _free_changes( changes, num_changes );
+    return 0;
+}
+
+static struct tuple * _make_tuple( unsigned int id )
+{
+    struct tuple * tuple      = NULL;
+    char           buffer[32] = {0};
+    unsigned int   i          = 0;
+    uint64_t       bits       = 0;
+    double         real       = 0;
+
+    tuple = new_tuple( 5 );
+
+    if( tuple == NULL )
+    {
+        return NULL;
+    }
+
+    tuple->num_columns = 5;
+
+    if( binary_values )
+    {
+        tuple->lengths = ( int * ) calloc( 5, sizeof( int ) );
+        tuple->types   = ( Oid * ) calloc( 5, sizeof( Oid ) );
+
+        if( tuple->lengths == NULL || tuple->types == NULL )
+        {
+            free_tuple( tuple );
+            return NULL;
+        }
+    }
+
+    for( i = 0; i < 5; i++ )
+    {
+        tuple->names[i] = strdup( relation_columns[i] );
+
+        switch( i )
+        {
+            case 0:
+                snprintf( buffer, sizeof( buffer ), "%u", id );
+                break;
+            case 1:
+                snprintf( buffer, sizeof( buffer ), "region_%u", ( id * 7919 ) % BENCH_REGIONS );
+                break;
+            case 2:
+                snprintf( buffer, sizeof( buffer ), "%u", ( id * 104729 ) % BENCH_STORES );
+                break;
+            case 3:
+                snprintf( buffer, sizeof( buffer ), "%d", ( int ) ( id % 23 ) - 3 );
+                break;
+            default:
+                snprintf( buffer, sizeof( buffer ), "%u.25", id % 1000 );
+                break;
+        }
+
+        // Every 50th row has no amount
+        if( i == 4 && id % 50 == 0 )
+        {
+            continue;
+        }
+
+        // Room for a send format number as well as the text
+        tuple->values[i] = ( char * ) calloc( 1, sizeof( buffer ) );
+
+        if( tuple->values[i] == NULL )
+        {
+            free_tuple( tuple );
+            return NULL;
+        }
+
+        memcpy( tuple->values[i], buffer, sizeof( buffer ) );
+
+        if( binary_values )
+        {
+            tuple->lengths[i] = ( int ) strlen( buffer );
+            tuple->types[i]   = BENCH_TEXT_OID;
+
+            if( i == 0 || i == 2 || i == 3 )
+            {
+                _set_binary( tuple, i, ( uint64_t ) strtoll( buffer, NULL, 10 ), 4, INT4_OID );
+            }
+            else if( i == 4 )
+            {
+                real = strtod( buffer, NULL );
+                memcpy( &bits, &real, sizeof( double ) );
+                _set_binary( tuple, i, bits, 8, FLOAT8_OID );
+            }
+        }
+    }
+
+    return tuple;
+}
+
+// Replaces value i of tuple by the length byte big endian send format of number
+static void _set_binary( struct tuple * tuple, unsigned int i, uint64_t number, int length, Oid type )
+{
+    int j = 0;
+
+    for( j = 0; j < length; j++ )
+    {
+        tuple->values[i][j] = ( char ) ( number >> ( 8 * ( length - 1 - j ) ) );
+    }
+
+    tuple->lengths[i] = length;
+    tuple->types[i]   = type;
+    return;
+}
+
+// Transactions of inserts, updates of earlier rows and deletes, in stream order
+static struct change ** _make_changes( unsigned long * num_changes )
+{
+    struct change ** changes = NULL;
+    struct change *  change  = NULL;
+    unsigned long    count   = 0;
+    unsigned long    i       = 0;
+    unsigned int     id      = 0;
+    uint64_t         lsn     = 0x1000;
+
+    changes = ( struct change ** ) calloc(
+        BENCH_CHANGES + 2 * ( BENCH_CHANGES / BENCH_TRANSACTION_CHANGES + 1 ),
+        sizeof( struct change * )
+    );
+
+    if( changes == NULL )
+    {
+        return NULL;
+    }
+
+    for( i = 0; i < BENCH_TUPLES; i++ )
+    {
+        tuples[i] = _make_tuple( ( unsigned int ) i );
+
+        if( tuples[i] == NULL )
+        {
+            return NULL;
+        }
+    }
+
+    for( i = 0; i < BENCH_CHANGES; i++ )
+    {
+        if( i % BENCH_TRANSACTION_CHANGES == 0 )
+        {
+            change           = new_change( CHANGE_TYPE_BEGIN );
+            change->lsn      = lsn++;
+            changes[count++] = change;
+        }
+
+        switch( i % 20 )
+        {
+            case 0: case 1: case 2: case 3: case 4:
+                change            = new_change( CHANGE_TYPE_UPDATE );
+                change->old_tuple = tuples[( id / 2 ) % BENCH_TUPLES];
+                change->new_tuple = tuples[( id / 2 + 1 ) % BENCH_TUPLES];
+                break;
+            case 5: case 6: case 7:
+                change            = new_change( CHANGE_TYPE_DELETE );
+                change->old_tuple = tuples[( id / 3 ) % BENCH_TUPLES];
+                break;
+            default:
+                change            = new_change( CHANGE_TYPE_INSERT );
+                change->new_tuple = tuples[id++ % BENCH_TUPLES];
+                break;
+        }
+
+        change->lsn         = lsn++;
+        change->schema_name = schema_name;
+        change->table_name  = table_name;
+        changes[count++]    = change;
+
+        if( i % BENCH_TRANSACTION_CHANGES == BENCH_TRANSACTION_CHANGES - 1 || i == BENCH_CHANGES - 1 )
+        {
+            change           = new_change( CHANGE_TYPE_COMMIT );
+            change->lsn      = lsn++;
+            changes[count++] = change;
+        }
+    }
+
+    *num_changes = count;
+    return changes;
+}
+
+static void _free_changes( struct change ** changes, unsigned long num_changes )
+{
+    unsigned long i = 0;
+
+    for( i = 0; changes != NULL && i < num_changes; i++ )
+    {
+        changes[i]->schema_name = NULL;
+        changes[i]->table_name  = NULL;
+        changes[i]->new_tuple   = NULL;
+        changes[i]->old_tuple   = NULL;
+        free_change( changes[i] );
+    }
+
+    for( i = 0; i < BENCH_TUPLES; i++ )
+    {
+        free_tuple( tuples[i] );
+        tuples[i] = NULL;
+    }
+
+    free( changes );
+    return;
+}
+
+// What new_aggregate_accumulator() would plan for the grouping above
+static struct aggregate_accumulator * _make_accumulator(
+    struct maintenance_object * object,
+    struct ivm_relation *       relation,
+    bool                        filtered
+)
+{
+    struct aggregate_accumulator * accumulator = NULL;
+
+    accumulator = ( struct aggregate_accumulator * ) calloc( 1, sizeof( struct aggregate_accumulator ) );
+
+    if( accumulator == NULL )
+    {
+        return NULL;
+    }
+
+    accumulator->object          = object;
+    accumulator->relation        = relation;
+    accumulator->num_keys        = 2;
+    accumulator->key_columns     = ( unsigned int * ) calloc( 2, sizeof( unsigned int ) );
+    accumulator->key_targets     = ( unsigned int * ) calloc( 2, sizeof( unsigned int ) );
+    accumulator->num_aggregates  = 3;
+    accumulator->kinds           = ( unsigned short * ) calloc( 3, sizeof( unsigned short ) );
+    accumulator->arguments       = ( int * ) calloc( 3, sizeof( int ) );
+    accumulator->targets         = ( unsigned int * ) calloc( 3, sizeof( unsigned int ) );
+    accumulator->is_real         = ( bool * ) calloc( 3, sizeof( bool ) );
+    accumulator->count_aggregate = 2;
+    accumulator->filters         = ( struct accumulator_filter * ) calloc( 1, sizeof( struct accumulator_filter ) );
+    accumulator->scratch         = new_string_buffer();
+
+    if(
+            accumulator->key_columns == NULL
+         || accumulator->key_targets == NULL
+         || accumulator->kinds == NULL
+         || accumulator->arguments == NULL
+         || accumulator->targets == NULL
+         || accumulator->is_real == NULL
+         || accumulator->filters == NULL
+         || accumulator->scratch == NULL
+      )
+    {
+        free_aggregate_accumulator( accumulator );
+        return NULL;
+    }
+
+    accumulator->key_columns[0] = 1;
+    accumulator->key_columns[1] = 2;
+    accumulator->key_targets[1] = 1;
+    accumulator->kinds[0]       = AGGREGATE_SUM;
+    accumulator->kinds[1]       = AGGREGATE_SUM;
+    accumulator->kinds[2]       = AGGREGATE_COUNT;
+    accumulator->arguments[0]   = 3;
+    accumulator->arguments[1]   = 4;
+    accumulator->arguments[2]   = -1;
+    accumulator->is_real[1]     = true;
+
+    if( filtered )
+    {
+        accumulator->num_filters          = 1;
+        accumulator->filters[0].column    = 3;
+        accumulator->filters[0].operation = BATCH_FILTER_GT;
+        accumulator->filters[0].integer   = 0;
+    }
+
+    return accumulator;
+}
+
+static bool _same_deltas( struct aggregate_accumulator * a, struct aggregate_accumulator * b )
+{
+    struct accumulator_group * group = NULL;
+    struct accumulator_group * other = NULL;
+    unsigned long              i     = 0;
+    unsigned long              slot  = 0;
+    unsigned int               j     = 0;
+
+    if( a->pending.num_groups != b->pending.num_groups )
+    {
+        return false;
+    }
+
+    for( i = 0; i < a->pending.num_groups; i++ )
+    {
+        group = &( a->pending.slots[a->pending.used[i]] );
+
+        for(
+                slot = group->hash & ( b->pending.num_slots - 1 );
+                b->pending.slots[slot].key != NULL;
+                slot = ( slot + 1 ) & ( b->pending.num_slots - 1 )
+           )
+        {
+            other = &( b->pending.slots[slot] );
+
+            if( other->key_length == group->key_length && memcmp( other->key, group->key, group->key_length ) == 0 )
+            {
+                break;
+            }
+        }
+
+        if( b->pending.slots[slot].key == NULL )
+        {
+            return false;
+        }
+
+        for( j = 0; j < a->num_aggregates; j++ )
+        {
+            if(
+                    group->deltas[j].rows != other->deltas[j].rows
+                 || group->deltas[j].integer_sum != other->deltas[j].integer_sum
+                 || fabs( group->deltas[j].real_sum - other->deltas[j].real_sum ) > 1e-6 * ( 1 + fabs( group->deltas[j].real_sum ) )
+              )
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static double _run( struct aggregate_accumulator * accumulator, struct change ** changes, unsigned long num_changes )
+{
+    struct timespec start = {0};
+    struct timespec end   = {0};
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+
+    if( !accumulate_changes( accumulator, changes, num_changes ) )
+    {
+        printf( "accumulate_changes() failed\n" );
+        exit( 1 );
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &end );
+    return ( double ) ( end.tv_sec - start.tv_sec ) + ( double ) ( end.tv_nsec - start.tv_nsec ) / 1e9;
+}
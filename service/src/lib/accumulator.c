@@ -0,0 +1,1740 @@
+#include "accumulator.h"
+#include "statement_cache.h"
+#include "replication.h"
+#include "progress.h"
+
+unsigned long accumulator_flush_changes = DEFAULT_ACCUMULATOR_FLUSH_CHANGES;
+unsigned long accumulator_flush_ms      = DEFAULT_ACCUMULATOR_FLUSH_MS;
+unsigned long accumulator_batch_rows    = DEFAULT_BATCH_ROWS;
+
+static bool _plan_accumulator( struct worker *, struct aggregate_accumulator * );
+static bool _build_statements( struct worker *, struct aggregate_accumulator * );
+static bool _plan_filters( struct aggregate_accumulator *, char * );
+static int _relation_column( struct ivm_relation *, char * );
+static bool _init_batch( struct aggregate_accumulator * );
+static bool _add_row( struct aggregate_accumulator *, struct tuple *, int64_t );
+static bool _drain_batch( struct aggregate_accumulator * );
+static bool _accumulate_row( struct aggregate_accumulator *, struct tuple *, int64_t );
+static bool _row_selected( struct aggregate_accumulator *, struct tuple *, bool * );
+static void _append_key_value( struct string_buffer *, char *, int32_t, Oid );
+static bool _init_table( struct accumulator_table *, unsigned long );
+static struct accumulator_group * _find_group(
+    struct aggregate_accumulator *,
+    struct accumulator_table *,
+    uint64_t,
+    char *,
+    size_t
+);
+static bool _grow_table( struct accumulator_table * );
+static bool _reserve_table( struct accumulator_table *, unsigned long );
+static void _place_group( struct accumulator_table *, struct accumulator_group * );
+static bool _merge_tables( struct aggregate_accumulator *, struct accumulator_table *, struct accumulator_table * );
+static void _reset_table( struct accumulator_table * );
+static void _free_group( struct accumulator_group * );
+
+/*
+ * Sets up accumulation of object's deltas. Returns NULL if object's
+ * definition cannot be accumulated, in which case it is maintained by
+ * maintain_changes() instead, or on errors.
+ */
+struct aggregate_accumulator * new_aggregate_accumulator(
+    struct worker *             me,
+    struct maintenance_object * object
+)
+{
+    struct aggregate_accumulator * accumulator = NULL;
+
+    if( me == NULL || object == NULL )
+    {
+        return NULL;
+    }
+
+    if( object->ivm == NULL )
+    {
+        object->ivm = plan_maintenance( me, object );
+
+        if( object->ivm == NULL )
+        {
+            return NULL;
+        }
+    }
+
+    accumulator = ( struct aggregate_accumulator * ) calloc( 1, sizeof( struct aggregate_accumulator ) );
+
+    if( accumulator == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate aggregate accumulator for %s",
+            object->qualified_name
+        );
+
+        return NULL;
+    }
+
+    accumulator->object  = object;
+    accumulator->scratch = new_string_buffer();
+
+    if(
+            accumulator->scratch == NULL
+         || !_plan_accumulator( me, accumulator )
+         || !_build_statements( me, accumulator )
+         || !read_object_progress( me, object )
+      )
+    {
+        free_aggregate_accumulator( accumulator );
+        return NULL;
+    }
+
+    accumulator->flushed_lsn = object->applied_lsn;
+    accumulator->pending_lsn = accumulator->flushed_lsn;
+    gettimeofday( &( accumulator->last_flush ), NULL );
+    return accumulator;
+}
+
+void free_aggregate_accumulator( struct aggregate_accumulator * accumulator )
+{
+    if( accumulator == NULL )
+    {
+        return;
+    }
+
+    _reset_table( &( accumulator->transaction ) );
+    _reset_table( &( accumulator->pending ) );
+    free( accumulator->transaction.slots );
+    free( accumulator->transaction.used );
+    free( accumulator->pending.slots );
+    free( accumulator->pending.used );
+    free_string_buffer( accumulator->scratch );
+    free( accumulator->key_columns );
+    free( accumulator->key_targets );
+    free( accumulator->kinds );
+    free( accumulator->arguments );
+    free( accumulator->targets );
+    free( accumulator->is_real );
+    free( accumulator->filters );
+    free_change_batch( accumulator->batch );
+    free( accumulator->batch_keys );
+    free( accumulator->batch_arguments );
+    free( accumulator->batch_groups );
+    free( accumulator->upsert_sql );
+    free( accumulator->prune_sql );
+    free( accumulator );
+    return;
+}
+
+/*
+ * Adds the deltas of changes to the accumulator. changes are expected in
+ * stream order, including the BEGIN and COMMIT records around them; changes
+ * to tables other than the one being aggregated are ignored.
+ */
+bool accumulate_changes(
+    struct aggregate_accumulator * accumulator,
+    struct change **               changes,
+    unsigned long                  num_changes
+)
+{
+    struct ivm_relation * relation = NULL;
+    struct change *       change   = NULL;
+    unsigned long         i        = 0;
+
+    if( accumulator == NULL || changes == NULL )
+    {
+        return false;
+    }
+
+    relation = accumulator->relation;
+
+    for( i = 0; i < num_changes; i++ )
+    {
+        change = changes[i];
+
+        if( change == NULL )
+        {
+            continue;
+        }
+
+        if( change->type == CHANGE_TYPE_COMMIT )
+        {
+            if( !_drain_batch( accumulator ) )
+            {
+                return false;
+            }
+
+            // A transaction replayed after a restart was flushed before it
+            if( change->lsn > accumulator->flushed_lsn )
+            {
+                if( !_merge_tables( accumulator, &( accumulator->transaction ), &( accumulator->pending ) ) )
+                {
+                    return false;
+                }
+
+                accumulator->pending_lsn = change->lsn;
+            }
+            else
+            {
+                _reset_table( &( accumulator->transaction ) );
+            }
+
+            continue;
+        }
+
+        if(
+                change->schema_name == NULL
+             || change->table_name == NULL
+             || strcmp( change->schema_name, relation->schema_name ) != 0
+             || strcmp( change->table_name, relation->table_name ) != 0
+          )
+        {
+            continue;
+        }
+
+        if( change->type == CHANGE_TYPE_UPDATE || change->type == CHANGE_TYPE_DELETE )
+        {
+            if( change->old_tuple == NULL )
+            {
+                _log(
+                    LOG_LEVEL_ERROR,
+                    "Change to %s.%s carries no old row, is its REPLICA IDENTITY still FULL?",
+                    relation->schema_name,
+                    relation->table_name
+                );
+
+                return false;
+            }
+
+            if( !_add_row( accumulator, change->old_tuple, -1 ) )
+            {
+                return false;
+            }
+        }
+
+        if( change->type == CHANGE_TYPE_INSERT || change->type == CHANGE_TYPE_UPDATE )
+        {
+            if( !_add_row( accumulator, change->new_tuple, 1 ) )
+            {
+                return false;
+            }
+        }
+
+        accumulator->num_changes++;
+    }
+
+    // The batch holds pointers into changes, which the caller may free after this
+    return _drain_batch( accumulator );
+}
+
+// Whether a flush is due, by accumulated changes or by time
+bool accumulator_flush_due( struct aggregate_accumulator * accumulator )
+{
+    struct timeval now     = {0};
+    unsigned long  elapsed = 0;
+
+    if( accumulator == NULL || accumulator->pending_lsn == accumulator->flushed_lsn )
+    {
+        return false;
+    }
+
+    if( accumulator->num_changes >= accumulator_flush_changes )
+    {
+        return true;
+    }
+
+    gettimeofday( &now, NULL );
+    elapsed = ( unsigned long ) (
+        ( now.tv_sec - accumulator->last_flush.tv_sec ) * 1000
+      + ( now.tv_usec - accumulator->last_flush.tv_usec ) / 1000
+    );
+
+    return elapsed >= accumulator_flush_ms;
+}
+
+/*
+ * Writes the merged deltas of all committed transactions accumulated so far
+ * to the target, one upsert per group, and records pending_lsn as the
+ * object's progress in the same transaction. Groups whose row count drops to
+ * zero are deleted. On failure the deltas are kept for the next attempt.
+ */
+bool flush_accumulator( struct worker * me, struct aggregate_accumulator * accumulator )
+{
+    struct accumulator_group *  group              = NULL;
+    struct aggregate_delta *    delta              = NULL;
+    struct pipeline_statement * statements         = NULL;
+    struct prepared_statement * upsert             = NULL;
+    struct prepared_statement * prune              = NULL;
+    struct prepared_statement * progress           = NULL;
+    struct string_buffer *      columns            = NULL;
+#ifndef LIBPQ_HAS_PIPELINING
+    PGresult *                  result             = NULL;
+#endif
+    char **                     params             = NULL;
+    int *                       lengths            = NULL;
+    int *                       formats            = NULL;
+    Oid *                       types              = NULL;
+    char *                      numbers            = NULL;
+    char *                      number             = NULL;
+    char *                      progress_params[3] = { NULL };
+    char                        object_id[16]      = {0};
+    char                        location[16]       = {0};
+    char                        lsn[32]            = {0};
+    unsigned int                num_params         = 0;
+    unsigned long               num_statements     = 0;
+    unsigned long               num_kept           = 0;
+    unsigned long               failed             = 0;
+    unsigned long               i                  = 0;
+    unsigned int                j                  = 0;
+    bool                        binary             = false;
+    bool                        own_transaction    = false;
+    bool                        success            = false;
+
+    if( me == NULL || accumulator == NULL )
+    {
+        return false;
+    }
+
+    if( accumulator->pending.num_groups == 0 )
+    {
+        // Nothing to write; the transactions in between changed nothing this object reads
+        accumulator->flushed_lsn = accumulator->pending_lsn;
+        accumulator->num_changes = 0;
+        gettimeofday( &( accumulator->last_flush ), NULL );
+        return true;
+    }
+
+    num_params = accumulator->num_keys + accumulator->num_aggregates;
+    columns    = new_string_buffer();
+    params     = ( char ** ) calloc( accumulator->pending.num_groups * num_params + 1, sizeof( char * ) );
+    lengths    = ( int * ) calloc( accumulator->pending.num_groups * num_params + 1, sizeof( int ) );
+    formats    = ( int * ) calloc( accumulator->pending.num_groups * num_params + 1, sizeof( int ) );
+    types      = ( Oid * ) calloc( num_params + 1, sizeof( Oid ) );
+    numbers    = ( char * ) calloc( accumulator->pending.num_groups * accumulator->num_aggregates + 1, 32 );
+    statements = ( struct pipeline_statement * ) calloc(
+        accumulator->pending.num_groups * 2 + 1,
+        sizeof( struct pipeline_statement )
+    );
+
+    if(
+            columns == NULL
+         || params == NULL
+         || lengths == NULL
+         || formats == NULL
+         || types == NULL
+         || numbers == NULL
+         || statements == NULL
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate flush of %s",
+            accumulator->object->qualified_name
+        );
+
+        goto cleanup;
+    }
+
+    /*
+     * Binary keys are sent with the source's type OIDs, so that the server
+     * reads them with the right receive function whatever the statements'
+     * casts would have it infer; text keys are read with the same types'
+     * input functions. The aggregates' deltas are always text, and their
+     * types inferred.
+     */
+    for( i = 0; i < accumulator->pending.num_groups; i++ )
+    {
+        group = &( accumulator->pending.slots[accumulator->pending.used[i]] );
+
+        for( j = 0; j < accumulator->num_keys; j++ )
+        {
+            if( group->types[j] != InvalidOid )
+            {
+                types[j] = group->types[j];
+                binary   = true;
+            }
+        }
+    }
+
+    // The binary types the statements are prepared with are part of their cache keys
+    string_buffer_append( columns, "%s:accumulator", accumulator->object->qualified_name );
+
+    for( j = 0; j < accumulator->num_keys; j++ )
+    {
+        string_buffer_append( columns, " %u", types[j] );
+    }
+
+    upsert   = get_prepared_statement(
+        me,
+        accumulator->object->maintenance_object,
+        ACCUMULATOR_STATEMENT_UPSERT,
+        columns->data,
+        accumulator->upsert_sql,
+        ( int ) num_params,
+        binary ? types : NULL
+    );
+    prune    = get_prepared_statement(
+        me,
+        accumulator->object->maintenance_object,
+        ACCUMULATOR_STATEMENT_PRUNE,
+        columns->data,
+        accumulator->prune_sql,
+        ( int ) accumulator->num_keys,
+        binary ? types : NULL
+    );
+    progress = get_progress_statement( me );
+
+    if( upsert == NULL || prune == NULL || progress == NULL )
+    {
+        goto cleanup;
+    }
+
+    for( i = 0; i < accumulator->pending.num_groups; i++ )
+    {
+        group = &( accumulator->pending.slots[accumulator->pending.used[i]] );
+
+        // Changes that cancelled out leave nothing to write
+        for( j = 0; j < accumulator->num_aggregates; j++ )
+        {
+            delta = &( group->deltas[j] );
+
+            if( delta->rows != 0 || delta->integer_sum != 0 || delta->real_sum != 0 )
+            {
+                break;
+            }
+        }
+
+        if( j == accumulator->num_aggregates )
+        {
+            continue;
+        }
+
+        for( j = 0; j < accumulator->num_keys; j++ )
+        {
+            params[num_params * ( num_statements / 2 ) + j]  = group->values[j];
+            lengths[num_params * ( num_statements / 2 ) + j] = group->lengths[j];
+            formats[num_params * ( num_statements / 2 ) + j] = group->types[j] != InvalidOid ? 1 : 0;
+        }
+
+        for( j = 0; j < accumulator->num_aggregates; j++ )
+        {
+            delta      = &( group->deltas[j] );
+            number     = numbers + 32 * ( ( num_statements / 2 ) * accumulator->num_aggregates + j );
+
+            if( accumulator->kinds[j] == AGGREGATE_COUNT )
+            {
+                snprintf( number, 32, "%lld", ( long long ) delta->rows );
+            }
+            else if( delta->rows == 0 && delta->integer_sum == 0 && delta->real_sum == 0 )
+            {
+                // Leaves the sum as it is, and a new group's sum of no values NULL
+                number = NULL;
+            }
+            else if( accumulator->is_real[j] )
+            {
+                snprintf( number, 32, "%.17g", delta->real_sum );
+            }
+            else
+            {
+                snprintf( number, 32, "%lld", ( long long ) delta->integer_sum );
+            }
+
+            params[num_params * ( num_statements / 2 ) + accumulator->num_keys + j]  = number;
+            lengths[num_params * ( num_statements / 2 ) + accumulator->num_keys + j] = -1;
+        }
+
+        statements[num_statements].prepared      = upsert;
+        statements[num_statements].params        = params + num_params * ( num_statements / 2 );
+        statements[num_statements].param_lengths = lengths + num_params * ( num_statements / 2 );
+        statements[num_statements].param_formats = formats + num_params * ( num_statements / 2 );
+        statements[num_statements].param_count   = num_params;
+
+        // Only a group that lost rows, or was created without any, can be empty
+        statements[num_statements + 1]             = statements[num_statements];
+        statements[num_statements + 1].prepared    = group->deltas[accumulator->count_aggregate].rows <= 0 ? prune : NULL;
+        statements[num_statements + 1].param_count = accumulator->num_keys;
+        num_statements += 2;
+    }
+
+    // Squeeze out the prune slots that went unused
+    for( i = 0; i < num_statements; i++ )
+    {
+        if( statements[i].prepared != NULL )
+        {
+            statements[num_kept++] = statements[i];
+        }
+    }
+
+    num_statements = num_kept;
+
+    snprintf( object_id, sizeof( object_id ), "%u", accumulator->object->maintenance_object );
+    snprintf( location, sizeof( location ), "%u", accumulator->object->location );
+    snprintf( lsn, sizeof( lsn ), LSN_FORMAT, LSN_FORMAT_ARGS( accumulator->pending_lsn ) );
+    progress_params[0] = object_id;
+    progress_params[1] = location;
+    progress_params[2] = lsn;
+
+    statements[num_statements].prepared    = progress;
+    statements[num_statements].params      = progress_params;
+    statements[num_statements].param_count = PROGRESS_STATEMENT_PARAMS;
+    num_statements++;
+
+    if( !( me->tx_in_progress ) )
+    {
+        if( !_begin_transaction( me ) )
+        {
+            goto cleanup;
+        }
+
+        own_transaction = true;
+    }
+
+    success = true;
+
+#ifdef LIBPQ_HAS_PIPELINING
+    if( !_execute_pipeline( me, statements, num_statements, &failed ) )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to flush %s, statement %lu of %lu (SQL state %s)",
+            accumulator->object->qualified_name,
+            failed + 1,
+            num_statements,
+            statements[failed].sql_state
+        );
+
+        success = false;
+    }
+#else
+    for( failed = 0; failed < num_statements && success; failed++ )
+    {
+        result = _execute_prepared(
+            me,
+            statements[failed].prepared,
+            statements[failed].params,
+            statements[failed].param_lengths,
+            statements[failed].param_formats
+        );
+
+        if( result == NULL )
+        {
+            success = false;
+        }
+
+        PQclear( result );
+    }
+#endif
+
+    if( own_transaction )
+    {
+        if( success )
+        {
+            success = _commit_transaction( me );
+        }
+        else if( me->tx_in_progress )
+        {
+            _rollback_transaction( me );
+        }
+    }
+
+    if( success )
+    {
+        _reset_table( &( accumulator->pending ) );
+        accumulator->flushed_lsn         = accumulator->pending_lsn;
+        accumulator->object->applied_lsn = accumulator->pending_lsn;
+        accumulator->num_changes         = 0;
+        gettimeofday( &( accumulator->last_flush ), NULL );
+    }
+
+cleanup:
+    free_string_buffer( columns );
+    free( params );
+    free( lengths );
+    free( formats );
+    free( types );
+    free( numbers );
+    free( statements );
+    return success;
+}
+
+/*
+ * Works out the grouping and aggregate columns of the accumulator's object,
+ * and checks that its definition is one that can be accumulated.
+ */
+static bool _plan_accumulator( struct worker * me, struct aggregate_accumulator * accumulator )
+{
+    struct maintenance_object * object     = NULL;
+    struct ivm_plan *           plan       = NULL;
+    struct definition *         definition = NULL;
+    struct definition_column *  entry      = NULL;
+    struct ivm_relation *       relation   = NULL;
+    char *                      expression = NULL;
+    char *                      end        = NULL;
+    char *                      type       = NULL;
+    unsigned int                ordinal    = 0;
+    unsigned int                i          = 0;
+    unsigned int                j          = 0;
+    int                         column     = -1;
+    int                         target     = -1;
+    bool                        has_count  = false;
+
+    object     = accumulator->object;
+    plan       = ( struct ivm_plan * ) object->ivm;
+    definition = plan->definition;
+
+    if(
+            plan->kind != IVM_KIND_AGGREGATE
+         || plan->num_relations != 1
+         || definition->having != NULL
+         || definition->num_group_keys == 0
+         || !( plan->relations[0].full_identity )
+         || object->num_key_columns != definition->num_group_keys
+      )
+    {
+        _log(
+            LOG_LEVEL_INFO,
+            "%s is not a grouping of a single REPLICA IDENTITY FULL relation by its key, without HAVING",
+            object->qualified_name
+        );
+
+        return false;
+    }
+
+    relation                 = &( plan->relations[0] );
+    accumulator->relation    = relation;
+    accumulator->key_columns = ( unsigned int * ) calloc( definition->num_columns + 1, sizeof( unsigned int ) );
+    accumulator->key_targets = ( unsigned int * ) calloc( definition->num_columns + 1, sizeof( unsigned int ) );
+    accumulator->kinds       = ( unsigned short * ) calloc( definition->num_columns + 1, sizeof( unsigned short ) );
+    accumulator->arguments   = ( int * ) calloc( definition->num_columns + 1, sizeof( int ) );
+    accumulator->targets     = ( unsigned int * ) calloc( definition->num_columns + 1, sizeof( unsigned int ) );
+    accumulator->is_real     = ( bool * ) calloc( definition->num_columns + 1, sizeof( bool ) );
+
+    if(
+            accumulator->key_columns == NULL
+         || accumulator->key_targets == NULL
+         || accumulator->kinds == NULL
+         || accumulator->arguments == NULL
+         || accumulator->targets == NULL
+         || accumulator->is_real == NULL
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate aggregate accumulator for %s",
+            object->qualified_name
+        );
+
+        return false;
+    }
+
+    for( i = 0; i < definition->num_group_keys; i++ )
+    {
+        expression = definition->group_keys[i];
+        ordinal    = ( unsigned int ) strtoul( expression, &end, 10 );
+
+        if( *end == '\0' && ordinal >= 1 && ordinal <= definition->num_columns )
+        {
+            expression = definition->columns[ordinal - 1].expression;
+        }
+
+        column = _relation_column( relation, expression );
+
+        if( column < 0 )
+        {
+            _log(
+                LOG_LEVEL_INFO,
+                "Grouping key %s of %s is not a column",
+                definition->group_keys[i],
+                object->qualified_name
+            );
+
+            return false;
+        }
+
+        accumulator->key_columns[accumulator->num_keys++] = ( unsigned int ) column;
+    }
+
+    for( i = 0; i < definition->num_columns; i++ )
+    {
+        entry  = &( definition->columns[i] );
+        target = -1;
+
+        for( j = 0; entry->name != NULL && j < object->num_columns; j++ )
+        {
+            if( strcmp( entry->name, object->columns[j] ) == 0 )
+            {
+                target = ( int ) j;
+            }
+        }
+
+        if( target < 0 )
+        {
+            _log(
+                LOG_LEVEL_INFO,
+                "%s has no column for %s",
+                object->qualified_name,
+                entry->expression
+            );
+
+            return false;
+        }
+
+        if( entry->aggregate == AGGREGATE_NONE )
+        {
+            // Anything else in the select list must be one of the grouping keys, and the target's key
+            column = _relation_column( relation, entry->expression );
+
+            for( j = 0; j < accumulator->num_keys && accumulator->key_columns[j] != ( unsigned int ) column; j++ );
+
+            if( column < 0 || j == accumulator->num_keys || !( object->is_key[target] ) )
+            {
+                _log(
+                    LOG_LEVEL_INFO,
+                    "%s of %s is neither a grouping key nor an aggregate",
+                    entry->expression,
+                    object->qualified_name
+                );
+
+                return false;
+            }
+
+            accumulator->key_targets[j] = ( unsigned int ) target;
+            continue;
+        }
+
+        if( entry->aggregate != AGGREGATE_SUM && entry->aggregate != AGGREGATE_COUNT )
+        {
+            _log(
+                LOG_LEVEL_INFO,
+                "%s of %s is not a SUM or COUNT",
+                entry->expression,
+                object->qualified_name
+            );
+
+            return false;
+        }
+
+        j = accumulator->num_aggregates++;
+
+        accumulator->kinds[j]   = entry->aggregate;
+        accumulator->targets[j] = ( unsigned int ) target;
+
+        if( entry->aggregate == AGGREGATE_COUNT && strcmp( entry->argument, "*" ) == 0 )
+        {
+            accumulator->arguments[j] = -1;
+
+            if( !has_count )
+            {
+                accumulator->count_aggregate = j;
+                has_count                    = true;
+            }
+
+            continue;
+        }
+
+        column = _relation_column( relation, entry->argument );
+        type   = column >= 0 ? relation->column_types[column] : NULL;
+
+        accumulator->arguments[j] = column;
+        accumulator->is_real[j]   = type != NULL && ( strcmp( type, "real" ) == 0 || strcmp( type, "double precision" ) == 0 );
+
+        if(
+                column < 0
+             || (
+                    entry->aggregate == AGGREGATE_SUM
+                 && !( accumulator->is_real[j] )
+                 && strcmp( type, "smallint" ) != 0
+                 && strcmp( type, "integer" ) != 0
+                 && strcmp( type, "bigint" ) != 0
+                )
+          )
+        {
+            _log(
+                LOG_LEVEL_INFO,
+                "%s of %s is not over an integer or floating point column",
+                entry->expression,
+                object->qualified_name
+            );
+
+            return false;
+        }
+    }
+
+    if( !has_count || accumulator->num_keys + accumulator->num_aggregates != object->num_columns )
+    {
+        _log(
+            LOG_LEVEL_INFO,
+            "%s needs a COUNT(*) and a column for each grouping key and aggregate",
+            object->qualified_name
+        );
+
+        return false;
+    }
+
+    return definition->where == NULL || _plan_filters( accumulator, definition->where );
+}
+
+/*
+ * Turns a WHERE clause into filters, if it ANDs comparisons of an integer or
+ * floating point column to a number and nothing else.
+ */
+static bool _plan_filters( struct aggregate_accumulator * accumulator, char * where )
+{
+    struct accumulator_filter * filter         = NULL;
+    struct ivm_relation *       relation       = NULL;
+    char **                     conditions     = NULL;
+    char *                      operation      = NULL;
+    char *                      constant       = NULL;
+    char *                      type           = NULL;
+    char *                      end            = NULL;
+    unsigned int                num_conditions = 0;
+    unsigned int                i              = 0;
+    size_t                      length         = 0;
+    int                         column         = -1;
+    bool                        success        = false;
+
+    relation = accumulator->relation;
+
+    if( !split_conjuncts( where, &conditions, &num_conditions ) )
+    {
+        _log(
+            LOG_LEVEL_INFO,
+            "WHERE clause of %s is not a conjunction",
+            accumulator->object->qualified_name
+        );
+
+        return false;
+    }
+
+    accumulator->filters = ( struct accumulator_filter * ) calloc(
+        num_conditions + 1,
+        sizeof( struct accumulator_filter )
+    );
+
+    if( accumulator->filters == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate filters for %s",
+            accumulator->object->qualified_name
+        );
+
+        goto cleanup;
+    }
+
+    for( i = 0; i < num_conditions; i++ )
+    {
+        filter    = &( accumulator->filters[i] );
+        operation = strpbrk( conditions[i], "<>=!" );
+
+        if( operation == NULL )
+        {
+            goto unsupported;
+        }
+
+        length   = strspn( operation, "<>=!" );
+        constant = operation + length;
+
+        if( length == 1 && *operation == '=' )
+        {
+            filter->operation = BATCH_FILTER_EQ;
+        }
+        else if( length == 2 && ( strncmp( operation, "<>", 2 ) == 0 || strncmp( operation, "!=", 2 ) == 0 ) )
+        {
+            filter->operation = BATCH_FILTER_NE;
+        }
+        else if( length == 1 && *operation == '<' )
+        {
+            filter->operation = BATCH_FILTER_LT;
+        }
+        else if( length == 2 && strncmp( operation, "<=", 2 ) == 0 )
+        {
+            filter->operation = BATCH_FILTER_LE;
+        }
+        else if( length == 1 && *operation == '>' )
+        {
+            filter->operation = BATCH_FILTER_GT;
+        }
+        else if( length == 2 && strncmp( operation, ">=", 2 ) == 0 )
+        {
+            filter->operation = BATCH_FILTER_GE;
+        }
+        else
+        {
+            goto unsupported;
+        }
+
+        *operation = '\0';
+        column     = _relation_column( relation, conditions[i] );
+        type       = column >= 0 ? relation->column_types[column] : NULL;
+
+        while( isspace( ( unsigned char ) *constant ) )
+        {
+            constant++;
+        }
+
+        // A number, not a column or anything strtod() would also take
+        if(
+                type == NULL
+             || !(
+                     isdigit( ( unsigned char ) constant[*constant == '-' ? 1 : 0] )
+                  || constant[*constant == '-' ? 1 : 0] == '.'
+                 )
+          )
+        {
+            goto unsupported;
+        }
+
+        filter->column  = ( unsigned int ) column;
+        filter->is_real = strcmp( type, "real" ) == 0 || strcmp( type, "double precision" ) == 0;
+
+        if( filter->is_real )
+        {
+            filter->real = strtod( constant, &end );
+        }
+        else if( strcmp( type, "smallint" ) == 0 || strcmp( type, "integer" ) == 0 || strcmp( type, "bigint" ) == 0 )
+        {
+            filter->integer = strtoll( constant, &end, 10 );
+        }
+        else
+        {
+            goto unsupported;
+        }
+
+        while( isspace( ( unsigned char ) *end ) )
+        {
+            end++;
+        }
+
+        if( *end != '\0' )
+        {
+            goto unsupported;
+        }
+
+        accumulator->num_filters++;
+    }
+
+    success = true;
+    goto cleanup;
+
+unsupported:
+    _log(
+        LOG_LEVEL_INFO,
+        "WHERE clause of %s compares other than numeric columns to numbers",
+        accumulator->object->qualified_name
+    );
+
+cleanup:
+    for( i = 0; i < num_conditions; i++ )
+    {
+        free( conditions[i] );
+    }
+
+    free( conditions );
+    return success;
+}
+
+// Builds the upsert and prune statements of a flush
+static bool _build_statements( struct worker * me, struct aggregate_accumulator * accumulator )
+{
+    struct maintenance_object * object   = NULL;
+    struct ivm_relation *       relation = NULL;
+    struct string_buffer *      upsert   = NULL;
+    struct string_buffer *      prune    = NULL;
+    char *                      column   = NULL;
+    unsigned int                i        = 0;
+    bool                        success  = false;
+
+    object   = accumulator->object;
+    relation = accumulator->relation;
+    upsert   = new_string_buffer();
+    prune    = new_string_buffer();
+
+    if( upsert == NULL || prune == NULL )
+    {
+        goto cleanup;
+    }
+
+    string_buffer_append( upsert, "INSERT INTO %s AS t ( ", object->qualified_name );
+    string_buffer_append( prune, "DELETE FROM %s WHERE ", object->qualified_name );
+
+    for( i = 0; i < accumulator->num_keys; i++ )
+    {
+        string_buffer_append( upsert, "%s, ", object->quoted_columns[accumulator->key_targets[i]] );
+        string_buffer_append(
+            prune,
+            "%s = $%u::%s AND ",
+            object->quoted_columns[accumulator->key_targets[i]],
+            i + 1,
+            relation->column_types[accumulator->key_columns[i]]
+        );
+    }
+
+    for( i = 0; i < accumulator->num_aggregates; i++ )
+    {
+        string_buffer_append(
+            upsert,
+            "%s%s",
+            i > 0 ? ", " : "",
+            object->quoted_columns[accumulator->targets[i]]
+        );
+    }
+
+    string_buffer_append(
+        prune,
+        "%s <= 0",
+        object->quoted_columns[accumulator->targets[accumulator->count_aggregate]]
+    );
+    string_buffer_append( upsert, " ) VALUES ( " );
+
+    for( i = 0; i < accumulator->num_keys; i++ )
+    {
+        string_buffer_append( upsert, "$%u::%s, ", i + 1, relation->column_types[accumulator->key_columns[i]] );
+    }
+
+    for( i = 0; i < accumulator->num_aggregates; i++ )
+    {
+        string_buffer_append(
+            upsert,
+            "%s$%u::%s",
+            i > 0 ? ", " : "",
+            accumulator->num_keys + i + 1,
+            object->column_types[accumulator->targets[i]]
+        );
+    }
+
+    string_buffer_append( upsert, " ) ON CONFLICT ( " );
+
+    for( i = 0; i < accumulator->num_keys; i++ )
+    {
+        string_buffer_append( upsert, "%s%s", i > 0 ? ", " : "", object->quoted_columns[accumulator->key_targets[i]] );
+    }
+
+    string_buffer_append( upsert, " ) DO UPDATE SET " );
+
+    for( i = 0; i < accumulator->num_aggregates; i++ )
+    {
+        column = object->quoted_columns[accumulator->targets[i]];
+
+        if( accumulator->kinds[i] == AGGREGATE_COUNT )
+        {
+            string_buffer_append( upsert, "%s%s = t.%s + EXCLUDED.%s", i > 0 ? ", " : "", column, column, column );
+        }
+        else
+        {
+            string_buffer_append(
+                upsert,
+                "%s%s = CASE WHEN EXCLUDED.%s IS NULL THEN t.%s ELSE COALESCE( t.%s, 0 ) + EXCLUDED.%s END",
+                i > 0 ? ", " : "",
+                column,
+                column,
+                column,
+                column,
+                column
+            );
+        }
+    }
+
+    accumulator->upsert_sql = strdup( upsert->data );
+    accumulator->prune_sql  = strdup( prune->data );
+    success = accumulator->upsert_sql != NULL && accumulator->prune_sql != NULL;
+
+cleanup:
+    free_string_buffer( upsert );
+    free_string_buffer( prune );
+    return success;
+}
+
+// The column of relation expression refers to, or -1
+static int _relation_column( struct ivm_relation * relation, char * expression )
+{
+    char *       qualifier = NULL;
+    char *       column    = NULL;
+    unsigned int i         = 0;
+    int          result    = -1;
+
+    if( !split_column_reference( expression, &qualifier, &column ) )
+    {
+        return -1;
+    }
+
+    for( i = 0; i < relation->num_columns && result < 0; i++ )
+    {
+        if(
+                strcmp( column, relation->columns[i] ) == 0
+             && ( qualifier == NULL || strcmp( qualifier, relation->name ) == 0 )
+          )
+        {
+            result = ( int ) i;
+        }
+    }
+
+    free( qualifier );
+    free( column );
+    return result;
+}
+
+// Adds the contribution of one row, with sign -1 for a removed one, to its group
+// Lays out the batch with one column per relation column the accumulator reads
+static bool _init_batch( struct aggregate_accumulator * accumulator )
+{
+    struct ivm_relation * relation    = NULL;
+    int *                 columns     = NULL;
+    unsigned int *        kinds       = NULL;
+    unsigned int          num_columns = 0;
+    unsigned int          i           = 0;
+    int                   column      = -1;
+    bool                  success     = false;
+
+    relation = accumulator->relation;
+    columns  = ( int * ) calloc( relation->num_columns + 1, sizeof( int ) );
+    kinds    = ( unsigned int * ) calloc( relation->num_columns + 1, sizeof( unsigned int ) );
+
+    accumulator->batch_keys      = ( unsigned int * ) calloc( accumulator->num_keys + 1, sizeof( unsigned int ) );
+    accumulator->batch_arguments = ( int * ) calloc( accumulator->num_aggregates + 1, sizeof( int ) );
+    accumulator->batch_groups    = ( struct accumulator_group ** ) calloc(
+        accumulator_batch_rows + 1,
+        sizeof( struct accumulator_group * )
+    );
+
+    if(
+            columns == NULL
+         || kinds == NULL
+         || accumulator->batch_keys == NULL
+         || accumulator->batch_arguments == NULL
+         || accumulator->batch_groups == NULL
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate change batch for %s",
+            accumulator->object->qualified_name
+        );
+
+        goto cleanup;
+    }
+
+    // Mark the columns read, and whether as numbers, then number them in relation order
+    for( i = 0; i < relation->num_columns; i++ )
+    {
+        columns[i] = -1;
+    }
+
+    for( i = 0; i < accumulator->num_keys; i++ )
+    {
+        columns[accumulator->key_columns[i]] = 0;
+    }
+
+    for( i = 0; i < accumulator->num_aggregates; i++ )
+    {
+        column = accumulator->arguments[i];
+
+        if( column >= 0 )
+        {
+            columns[column] = 0;
+
+            if( accumulator->kinds[i] == AGGREGATE_SUM )
+            {
+                kinds[column] = accumulator->is_real[i] ? BATCH_COLUMN_REAL : BATCH_COLUMN_INTEGER;
+            }
+        }
+    }
+
+    for( i = 0; i < accumulator->num_filters; i++ )
+    {
+        column          = ( int ) accumulator->filters[i].column;
+        columns[column] = 0;
+        kinds[column]   = accumulator->filters[i].is_real ? BATCH_COLUMN_REAL : BATCH_COLUMN_INTEGER;
+    }
+
+    for( i = 0; i < relation->num_columns; i++ )
+    {
+        if( columns[i] >= 0 )
+        {
+            columns[i] = ( int ) num_columns++;
+        }
+    }
+
+    accumulator->batch = new_change_batch( num_columns, accumulator_batch_rows );
+
+    if( accumulator->batch == NULL )
+    {
+        goto cleanup;
+    }
+
+    for( i = 0; i < relation->num_columns; i++ )
+    {
+        if( columns[i] >= 0 && !set_batch_column( accumulator->batch, ( unsigned int ) columns[i], relation->columns[i], kinds[i] ) )
+        {
+            goto cleanup;
+        }
+    }
+
+    for( i = 0; i < accumulator->num_keys; i++ )
+    {
+        accumulator->batch_keys[i] = ( unsigned int ) columns[accumulator->key_columns[i]];
+    }
+
+    for( i = 0; i < accumulator->num_aggregates; i++ )
+    {
+        column = accumulator->arguments[i];
+
+        accumulator->batch_arguments[i] = column >= 0 ? columns[column] : -1;
+    }
+
+    for( i = 0; i < accumulator->num_filters; i++ )
+    {
+        accumulator->filters[i].batch_column = ( unsigned int ) columns[accumulator->filters[i].column];
+    }
+
+    success = true;
+
+cleanup:
+    if( !success )
+    {
+        free_change_batch( accumulator->batch );
+        accumulator->batch = NULL;
+    }
+
+    free( columns );
+    free( kinds );
+    return success;
+}
+
+// Adds a row to the batch, or straight to the transaction's groups when batching is off
+static bool _add_row( struct aggregate_accumulator * accumulator, struct tuple * tuple, int64_t sign )
+{
+    if( accumulator->batch == NULL && accumulator_batch_rows == 0 )
+    {
+        return _accumulate_row( accumulator, tuple, sign );
+    }
+
+    if( accumulator->batch == NULL && !_init_batch( accumulator ) )
+    {
+        return false;
+    }
+
+    if( accumulator->batch->num_rows >= accumulator->batch->max_rows && !_drain_batch( accumulator ) )
+    {
+        return false;
+    }
+
+    return batch_append_tuple( accumulator->batch, tuple, sign );
+}
+
+/*
+ * Adds the deltas of the batched rows to the transaction's groups: filters,
+ * hashes and per-aggregate contributions are computed a column at a time,
+ * leaving only the group lookup and the final additions row by row.
+ */
+static bool _drain_batch( struct aggregate_accumulator * accumulator )
+{
+    struct change_batch *       batch   = NULL;
+    struct accumulator_group ** groups  = NULL;
+    struct accumulator_filter * filter  = NULL;
+    struct aggregate_delta *    delta   = NULL;
+    struct batch_column *       column  = NULL;
+    struct string_buffer *      key     = NULL;
+    unsigned long               row     = 0;
+    unsigned int                i       = 0;
+    unsigned int                j       = 0;
+    bool                        success = false;
+
+    batch = accumulator->batch;
+
+    if( batch == NULL || batch->num_rows == 0 )
+    {
+        return true;
+    }
+
+    groups = accumulator->batch_groups;
+    key    = accumulator->scratch;
+
+    for( i = 0; i < accumulator->num_filters; i++ )
+    {
+        filter = &( accumulator->filters[i] );
+        batch_filter( batch, filter->batch_column, filter->operation, filter->integer, filter->real );
+    }
+
+    batch_hash_keys( batch, accumulator->batch_keys, accumulator->num_keys );
+
+    // Adding groups must not move the ones already found
+    if( !_reserve_table( &( accumulator->transaction ), batch->num_rows ) )
+    {
+        goto cleanup;
+    }
+
+    for( row = 0; row < batch->num_rows; row++ )
+    {
+        groups[row] = NULL;
+
+        if( !batch->selected[row] )
+        {
+            continue;
+        }
+
+        string_buffer_reset( key );
+
+        for( j = 0; j < accumulator->num_keys; j++ )
+        {
+            column = &( batch->columns[accumulator->batch_keys[j]] );
+            _append_key_value( key, column->values[row], column->lengths[row], column->types[row] );
+        }
+
+        groups[row] = _find_group( accumulator, &( accumulator->transaction ), batch->hashes[row], key->data, key->length );
+
+        if( groups[row] == NULL )
+        {
+            goto cleanup;
+        }
+    }
+
+    for( i = 0; i < accumulator->num_aggregates; i++ )
+    {
+        batch_deltas( batch, accumulator->batch_arguments[i] );
+
+        for( row = 0; row < batch->num_rows; row++ )
+        {
+            if( groups[row] == NULL )
+            {
+                continue;
+            }
+
+            delta        = &( groups[row]->deltas[i] );
+            delta->rows += batch->delta_rows[row];
+
+            if( accumulator->kinds[i] != AGGREGATE_SUM )
+            {
+                continue;
+            }
+
+            if( accumulator->is_real[i] )
+            {
+                delta->real_sum += batch->delta_reals[row];
+            }
+            else
+            {
+                delta->integer_sum += batch->delta_integers[row];
+            }
+        }
+    }
+
+    success = true;
+
+cleanup:
+    reset_change_batch( batch );
+    return success;
+}
+
+static bool _accumulate_row( struct aggregate_accumulator * accumulator, struct tuple * tuple, int64_t sign )
+{
+    struct accumulator_group * group    = NULL;
+    struct aggregate_delta *   delta    = NULL;
+    struct string_buffer *     key      = NULL;
+    char *                     value    = NULL;
+    uint64_t                   hash     = BATCH_HASH_SEED;
+    int64_t                    number   = 0;
+    double                     real     = 0;
+    int32_t                    length   = 0;
+    Oid                        type     = InvalidOid;
+    unsigned int               i        = 0;
+    int                        index    = -1;
+    bool                       selected = false;
+
+    if( tuple == NULL || !_row_selected( accumulator, tuple, &selected ) )
+    {
+        return false;
+    }
+
+    if( !selected )
+    {
+        return true;
+    }
+
+    key = accumulator->scratch;
+    string_buffer_reset( key );
+
+    for( i = 0; i < accumulator->num_keys; i++ )
+    {
+        index  = find_tuple_column( tuple, accumulator->relation->columns[accumulator->key_columns[i]] );
+        value  = NULL;
+        length = -1;
+        type   = InvalidOid;
+
+        if( index >= 0 && tuple->values[index] != NULL )
+        {
+            value  = tuple->values[index];
+            length = tuple->lengths != NULL ? tuple->lengths[index] : ( int32_t ) strlen( value );
+            type   = tuple->types != NULL ? tuple->types[index] : InvalidOid;
+        }
+
+        _append_key_value( key, value, length, type );
+        hash = ( hash ^ hash_value( value, length ) ) * BATCH_HASH_PRIME;
+    }
+
+    group = _find_group( accumulator, &( accumulator->transaction ), hash, key->data, key->length );
+
+    if( group == NULL )
+    {
+        return false;
+    }
+
+    for( i = 0; i < accumulator->num_aggregates; i++ )
+    {
+        delta = &( group->deltas[i] );
+
+        if( accumulator->arguments[i] < 0 )
+        {
+            delta->rows += sign;
+            continue;
+        }
+
+        index = find_tuple_column( tuple, accumulator->relation->columns[accumulator->arguments[i]] );
+
+        if( index < 0 || tuple->values[index] == NULL )
+        {
+            continue;
+        }
+
+        delta->rows += sign;
+
+        if( accumulator->kinds[i] != AGGREGATE_SUM )
+        {
+            continue;
+        }
+
+        if( !read_tuple_number( tuple, ( unsigned int ) index, accumulator->is_real[i], &number, &real ) )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to read %s of %s.%s as a number",
+                accumulator->relation->columns[accumulator->arguments[i]],
+                accumulator->relation->schema_name,
+                accumulator->relation->table_name
+            );
+
+            return false;
+        }
+
+        delta->integer_sum += sign * number;
+        delta->real_sum    += ( double ) sign * real;
+    }
+
+    return true;
+}
+
+// Whether tuple passes the accumulator's filters, as batch_filter() would decide
+static bool _row_selected( struct aggregate_accumulator * accumulator, struct tuple * tuple, bool * selected )
+{
+    struct accumulator_filter * filter     = NULL;
+    int64_t                     number     = 0;
+    double                      real       = 0;
+    unsigned int                i          = 0;
+    int                         index      = -1;
+    int                         comparison = 0;
+
+    *selected = true;
+
+    for( i = 0; i < accumulator->num_filters && *selected; i++ )
+    {
+        filter = &( accumulator->filters[i] );
+        index  = find_tuple_column( tuple, accumulator->relation->columns[filter->column] );
+
+        if( index < 0 || tuple->values[index] == NULL )
+        {
+            *selected = false;
+            continue;
+        }
+
+        if( !read_tuple_number( tuple, ( unsigned int ) index, filter->is_real, &number, &real ) )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to read %s of %s.%s as a number",
+                accumulator->relation->columns[filter->column],
+                accumulator->relation->schema_name,
+                accumulator->relation->table_name
+            );
+
+            return false;
+        }
+
+        // NaN compares unequal to everything
+        if( filter->is_real && real != real )
+        {
+            *selected = filter->operation == BATCH_FILTER_NE;
+            continue;
+        }
+
+        if( filter->is_real )
+        {
+            comparison = ( real > filter->real ) - ( real < filter->real );
+        }
+        else
+        {
+            comparison = ( number > filter->integer ) - ( number < filter->integer );
+        }
+
+        switch( filter->operation )
+        {
+            case BATCH_FILTER_EQ:
+                *selected = comparison == 0;
+                break;
+            case BATCH_FILTER_NE:
+                *selected = comparison != 0;
+                break;
+            case BATCH_FILTER_LT:
+                *selected = comparison < 0;
+                break;
+            case BATCH_FILTER_LE:
+                *selected = comparison <= 0;
+                break;
+            case BATCH_FILTER_GT:
+                *selected = comparison > 0;
+                break;
+            default:
+                *selected = comparison >= 0;
+                break;
+        }
+    }
+
+    return true;
+}
+
+// Serializes one key value as a group key holds it
+static void _append_key_value( struct string_buffer * key, char * value, int32_t length, Oid type )
+{
+    string_buffer_append_bytes( key, ( char * ) &type, sizeof( Oid ) );
+    string_buffer_append_bytes( key, ( char * ) &length, sizeof( int32_t ) );
+
+    if( length >= 0 )
+    {
+        string_buffer_append_bytes( key, value, ( size_t ) length );
+        string_buffer_append_bytes( key, "", 1 );
+    }
+
+    return;
+}
+
+static bool _init_table( struct accumulator_table * table, unsigned long num_slots )
+{
+    table->slots = ( struct accumulator_group * ) calloc( num_slots, sizeof( struct accumulator_group ) );
+    table->used  = ( unsigned long * ) calloc( num_slots, sizeof( unsigned long ) );
+
+    if( table->slots == NULL || table->used == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate %lu accumulator slots",
+            num_slots
+        );
+
+        free( table->slots );
+        free( table->used );
+        table->slots = NULL;
+        table->used  = NULL;
+        return false;
+    }
+
+    table->num_slots  = num_slots;
+    table->num_groups = 0;
+    return true;
+}
+
+/*
+ * Finds the group with the given serialized key in table, adding an empty
+ * one if there is none.
+ */
+static struct accumulator_group * _find_group(
+    struct aggregate_accumulator * accumulator,
+    struct accumulator_table *     table,
+    uint64_t                       hash,
+    char *                         key,
+    size_t                         key_length
+)
+{
+    struct accumulator_group * group  = NULL;
+    struct accumulator_group   added  = {0};
+    unsigned long              slot   = 0;
+    unsigned int               i      = 0;
+    size_t                     offset = 0;
+    int32_t                    length = 0;
+
+    if( table->slots == NULL && !_init_table( table, DEFAULT_ACCUMULATOR_SLOTS ) )
+    {
+        return NULL;
+    }
+
+    for( slot = hash & ( table->num_slots - 1 ); table->slots[slot].key != NULL; slot = ( slot + 1 ) & ( table->num_slots - 1 ) )
+    {
+        group = &( table->slots[slot] );
+
+        if( group->hash == hash && group->key_length == key_length && memcmp( group->key, key, key_length ) == 0 )
+        {
+            return group;
+        }
+    }
+
+    // One allocation per group: deltas, then values, lengths, types and the key
+    added.deltas = ( struct aggregate_delta * ) calloc(
+        1,
+        sizeof( struct aggregate_delta ) * accumulator->num_aggregates
+      + ( sizeof( char * ) + sizeof( int ) + sizeof( Oid ) ) * accumulator->num_keys
+      + key_length + 1
+    );
+
+    if( added.deltas == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate accumulator group"
+        );
+
+        return NULL;
+    }
+
+    added.hash       = hash;
+    added.key_length = key_length;
+    added.values     = ( char ** ) ( added.deltas + accumulator->num_aggregates );
+    added.lengths    = ( int * ) ( added.values + accumulator->num_keys );
+    added.types      = ( Oid * ) ( added.lengths + accumulator->num_keys );
+    added.key        = ( char * ) ( added.types + accumulator->num_keys );
+
+    memcpy( added.key, key, key_length );
+
+    for( i = 0; i < accumulator->num_keys; i++ )
+    {
+        memcpy( &( added.types[i] ), added.key + offset, sizeof( Oid ) );
+        offset += sizeof( Oid );
+        memcpy( &length, added.key + offset, sizeof( int32_t ) );
+        offset += sizeof( int32_t );
+
+        added.values[i]  = length >= 0 ? added.key + offset : NULL;
+        added.lengths[i] = added.types[i] != InvalidOid ? length : -1;
+        offset          += length >= 0 ? ( size_t ) length + 1 : 0;
+    }
+
+    if( ( table->num_groups + 1 ) * 4 > table->num_slots * 3 && !_grow_table( table ) )
+    {
+        _free_group( &added );
+        return NULL;
+    }
+
+    _place_group( table, &added );
+    return &( table->slots[table->used[table->num_groups - 1]] );
+}
+
+// Doubles table's slots, keeping its load factor under 3/4
+static bool _grow_table( struct accumulator_table * table )
+{
+    struct accumulator_group * slots      = NULL;
+    unsigned long *            used       = NULL;
+    unsigned long              num_slots  = 0;
+    unsigned long              num_groups = 0;
+    unsigned long              i          = 0;
+
+    slots      = table->slots;
+    used       = table->used;
+    num_slots  = table->num_slots;
+    num_groups = table->num_groups;
+
+    if( !_init_table( table, num_slots * 2 ) )
+    {
+        table->slots      = slots;
+        table->used       = used;
+        table->num_slots  = num_slots;
+        table->num_groups = num_groups;
+        return false;
+    }
+
+    for( i = 0; i < num_groups; i++ )
+    {
+        _place_group( table, &( slots[used[i]] ) );
+    }
+
+    free( slots );
+    free( used );
+    return true;
+}
+
+// Grows table until extra more groups fit without growing it again
+static bool _reserve_table( struct accumulator_table * table, unsigned long extra )
+{
+    if( table->slots == NULL && !_init_table( table, DEFAULT_ACCUMULATOR_SLOTS ) )
+    {
+        return false;
+    }
+
+    while( ( table->num_groups + extra ) * 4 > table->num_slots * 3 )
+    {
+        if( !_grow_table( table ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Moves group into the first free slot of its probe sequence, and counts it
+static void _place_group( struct accumulator_table * table, struct accumulator_group * group )
+{
+    unsigned long slot = 0;
+
+    for( slot = group->hash & ( table->num_slots - 1 ); table->slots[slot].key != NULL; slot = ( slot + 1 ) & ( table->num_slots - 1 ) );
+
+    table->slots[slot]               = *group;
+    table->used[table->num_groups++] = slot;
+    return;
+}
+
+// Adds from's deltas into into's, and empties from
+static bool _merge_tables(
+    struct aggregate_accumulator * accumulator,
+    struct accumulator_table *     from,
+    struct accumulator_table *     into
+)
+{
+    struct accumulator_group * source = NULL;
+    struct accumulator_group * target = NULL;
+    unsigned long              i      = 0;
+    unsigned int               j      = 0;
+
+    for( i = 0; i < from->num_groups; i++ )
+    {
+        source = &( from->slots[from->used[i]] );
+        target = _find_group( accumulator, into, source->hash, source->key, source->key_length );
+
+        if( target == NULL )
+        {
+            return false;
+        }
+
+        for( j = 0; j < accumulator->num_aggregates; j++ )
+        {
+            target->deltas[j].rows        += source->deltas[j].rows;
+            target->deltas[j].integer_sum += source->deltas[j].integer_sum;
+            target->deltas[j].real_sum    += source->deltas[j].real_sum;
+        }
+    }
+
+    _reset_table( from );
+    return true;
+}
+
+static void _reset_table( struct accumulator_table * table )
+{
+    unsigned long i = 0;
+
+    for( i = 0; i < table->num_groups; i++ )
+    {
+        _free_group( &( table->slots[table->used[i]] ) );
+        memset( &( table->slots[table->used[i]] ), 0, sizeof( struct accumulator_group ) );
+    }
+
+    table->num_groups = 0;
+    return;
+}
+
+static void _free_group( struct accumulator_group * group )
+{
+    free( group->deltas );
+    return;
+}
@@ -0,0 +1,140 @@
+#ifndef ACCUMULATOR_H
+#define ACCUMULATOR_H
+
+#include "util.h"
+#include "query.h"
+#include "change.h"
+#include "object.h"
+#include "definition.h"
+#include "ivm.h"
+#include "batch.h"
+#include <stdint.h>
+
+#define DEFAULT_ACCUMULATOR_SLOTS 1024
+#define DEFAULT_ACCUMULATOR_FLUSH_CHANGES 65536
+#define DEFAULT_ACCUMULATOR_FLUSH_MS 1000
+
+// Operations of flush statements in the statement cache, clear of those of ivm.h and progress.h
+#define ACCUMULATOR_STATEMENT_UPSERT 24
+#define ACCUMULATOR_STATEMENT_PRUNE 25
+
+extern unsigned long accumulator_flush_changes;
+extern unsigned long accumulator_flush_ms;
+extern unsigned long accumulator_batch_rows;
+
+/*
+ * The running change to one aggregate of one group: in the number of rows
+ * (for COUNT(*)) or non-NULL values it covers, and in their sum.
+ */
+struct aggregate_delta {
+    int64_t rows;
+    int64_t integer_sum;
+    double  real_sum;
+};
+
+/*
+ * A slot of an accumulator_table. key is the group's key values serialized,
+ * each as the type OID of a binary value (InvalidOid for text), a 4 byte
+ * length (-1 for NULL), the value and a terminating NUL; values points at
+ * them within key, and types and lengths, which is -1 for text, are read
+ * from it. deltas heads a single allocation that also holds values,
+ * lengths, types and key. An empty slot has a NULL key.
+ */
+struct accumulator_group {
+    uint64_t                 hash;
+    char *                   key;
+    size_t                   key_length;
+    char **                  values;
+    int *                    lengths;
+    Oid *                    types;
+    struct aggregate_delta * deltas;
+};
+
+/*
+ * Open addressing, linear probing; num_slots is a power of two. used lists
+ * the occupied slots in the order their groups were added, so that merging
+ * and emptying a table cost as much as its groups rather than its slots.
+ * slots are allocated when the first group is added.
+ */
+struct accumulator_table {
+    struct accumulator_group * slots;
+    unsigned long *            used;
+    unsigned long              num_slots;
+    unsigned long              num_groups;
+};
+
+// One condition of an accumulated grouping's WHERE clause: column operation constant
+struct accumulator_filter {
+    unsigned int   column;
+    unsigned int   batch_column;
+    unsigned short operation;
+    bool           is_real;
+    int64_t        integer;
+    double         real;
+};
+
+/*
+ * Deltas of a grouping maintenance_object accumulated in memory, to be
+ * written to the target in one batch per flush rather than one statement per
+ * change. Only groupings of a single relation with REPLICA IDENTITY FULL, no
+ * HAVING, a WHERE clause (if any) that ANDs comparisons of its integer and
+ * floating point columns to numbers, and nothing but SUM and COUNT of those
+ * columns (including a COUNT(*), which tells when a group empties) can be
+ * accumulated.
+ *
+ * Rows are gathered into batch, accumulator_batch_rows at a time, and their
+ * deltas computed column by column; batch_keys, batch_arguments and the
+ * filters' batch_column give the batch column each is read from. With
+ * accumulator_batch_rows set to 0 rows are accumulated one at a time.
+ *
+ * Deltas of the transaction being decoded are kept apart in transaction
+ * until its COMMIT, when they are merged into pending, and pending_lsn
+ * advances to the COMMIT's LSN. A flush writes pending together with
+ * pending_lsn as the object's maintenance_progress in one transaction;
+ * transactions that end at or before flushed_lsn are therefore already in
+ * the target, and are dropped when the stream replays them after a restart.
+ * The slot must not be confirmed past flushed_lsn for the object.
+ */
+struct aggregate_accumulator {
+    struct maintenance_object * object;
+    struct ivm_relation *       relation;
+    unsigned int                num_keys;
+    unsigned int *              key_columns;
+    unsigned int *              key_targets;
+    unsigned int                num_aggregates;
+    unsigned short *            kinds;
+    int *                       arguments;
+    unsigned int *              targets;
+    bool *                      is_real;
+    unsigned int                count_aggregate;
+    struct accumulator_filter * filters;
+    unsigned int                num_filters;
+    struct change_batch *       batch;
+    unsigned int *              batch_keys;
+    int *                       batch_arguments;
+    struct accumulator_group ** batch_groups;
+    struct accumulator_table    transaction;
+    struct accumulator_table    pending;
+    struct string_buffer *      scratch;
+    uint64_t                    pending_lsn;
+    uint64_t                    flushed_lsn;
+    unsigned long               num_changes;
+    struct timeval              last_flush;
+    char *                      upsert_sql;
+    char *                      prune_sql;
+};
+
+extern struct aggregate_accumulator * new_aggregate_accumulator(
+    struct worker *,
+    struct maintenance_object *
+);
+extern void free_aggregate_accumulator( struct aggregate_accumulator * );
+extern bool accumulate_changes(
+    struct aggregate_accumulator *,
+    struct change **,
+    unsigned long
+);
+extern bool accumulator_flush_due( struct aggregate_accumulator * );
+extern bool flush_accumulator( struct worker *, struct aggregate_accumulator * );
+
+#endif // ACCUMULATOR_H
@@ -0,0 +1,1351 @@
+#include "apply.h"
+#include "statement_cache.h"
+
+unsigned long batch_apply_threshold = DEFAULT_BATCH_APPLY_THRESHOLD;
+
+static bool _apply_through_driver(
+    struct worker *,
+    struct maintenance_object *,
+    struct change **,
+    unsigned long
+);
+static bool _apply_rows(
+    struct worker *,
+    struct maintenance_object *,
+    struct change **,
+    unsigned long
+);
+static bool _apply_batch(
+    struct worker *,
+    struct maintenance_object *,
+    struct change **,
+    unsigned long
+);
+static unsigned long _split_moved_keys(
+    struct maintenance_object *,
+    struct change **,
+    unsigned long,
+    struct change ***,
+    struct change **
+);
+static char * _stage_name( struct worker *, struct maintenance_object * );
+static bool _prepare_stage( struct worker *, struct maintenance_object *, char * );
+static bool _execute_command( struct worker *, char * );
+static int _batch_copy_format( struct maintenance_object *, struct change **, unsigned long );
+static void _append_copy_value( struct string_buffer *, char * );
+static void _append_network_integer( struct string_buffer *, uint64_t, unsigned int );
+static void _append_binary_copy_value( struct string_buffer *, char *, int );
+static void _append_key_join( struct string_buffer *, struct maintenance_object *, char *, char * );
+static void * _open_postgresql( struct worker *, struct maintenance_object * );
+static bool _begin_postgresql_batch( void *, struct worker *, struct maintenance_object * );
+static bool _apply_postgresql_batch(
+    void *,
+    struct worker *,
+    struct maintenance_object *,
+    struct change **,
+    unsigned long
+);
+static bool _commit_postgresql_batch( void *, struct worker *, struct maintenance_object *, bool );
+static void _close_postgresql( void * );
+
+/*
+ * Tables in the database the service is connected to, written through the
+ * worker's own connection. Objects the member path maintains incrementally
+ * run maintain_changes() between begin_batch and commit_batch in place of
+ * apply_batch, as their changes are to the relations they read rather than
+ * to the target, see _maintain_object().
+ */
+struct target_driver postgresql_driver = {
+    TARGET_DRIVER_API_VERSION,
+    "postgresql",
+    _open_postgresql,
+    _begin_postgresql_batch,
+    _apply_postgresql_batch,
+    _commit_postgresql_batch,
+    NULL,
+    NULL,
+    NULL,
+    _close_postgresql
+};
+
+/*
+ * Applies a set of changes to object's target, as one batch through its
+ * driver, which is kept only if all of it applied. A batch that failed
+ * because the target's layout changed under its statements is retried once
+ * against the new layout, see redescribe_after_failure().
+ */
+bool apply_changes(
+    struct worker *             me,
+    struct maintenance_object * object,
+    struct change **            changes,
+    unsigned long               num_changes
+)
+{
+    if( me == NULL || object == NULL || changes == NULL )
+    {
+        return false;
+    }
+
+    if( num_changes == 0 )
+    {
+        return true;
+    }
+
+    me->sql_state[0] = '\0';
+
+    if( _apply_through_driver( me, object, changes, num_changes ) )
+    {
+        return true;
+    }
+
+    return redescribe_after_failure( me, object )
+        && _apply_through_driver( me, object, changes, num_changes );
+}
+
+static bool _apply_through_driver(
+    struct worker *             me,
+    struct maintenance_object * object,
+    struct change **            changes,
+    unsigned long               num_changes
+)
+{
+    struct target_driver * driver  = NULL;
+    bool                   success = false;
+
+    if( !open_target( me, object ) )
+    {
+        return false;
+    }
+
+    driver = ( struct target_driver * ) object->target_driver;
+
+    if( !driver->begin_batch( object->target, me, object ) )
+    {
+        return false;
+    }
+
+    success = driver->apply_batch( object->target, me, object, changes, num_changes );
+
+    if( !driver->commit_batch( object->target, me, object, success ) )
+    {
+        success = false;
+    }
+
+    return success;
+}
+
+/*
+ * Describes object's table on the target me is connected to, if that has not
+ * been done, and opens a transaction for the batch if the caller has not.
+ */
+static bool _begin_postgresql_batch( void * target, struct worker * me, struct maintenance_object * object )
+{
+    struct postgresql_target * handle = NULL;
+
+    handle = ( struct postgresql_target * ) target;
+    handle->own_transaction = false;
+
+    if( object->num_columns == 0 && !describe_maintenance_object( me, object ) )
+    {
+        return false;
+    }
+
+    if( !( me->tx_in_progress ) )
+    {
+        if( !_begin_transaction( me ) )
+        {
+            return false;
+        }
+
+        handle->own_transaction = true;
+    }
+
+    return true;
+}
+
+/*
+ * Small sets are applied a row at a time, sets of batch_apply_threshold rows
+ * or more are streamed into a staging table with COPY and folded into the
+ * target with a single statement. Members apply their batches this way to
+ * remote targets, whose rows are evaluated against the source; targets in
+ * the source database itself are maintained in place by maintain_changes(),
+ * which has no rows to stream, see _maintain_object() in dependency.c.
+ */
+static bool _apply_postgresql_batch(
+    void *                      target,
+    struct worker *             me,
+    struct maintenance_object * object,
+    struct change **            changes,
+    unsigned long               num_changes
+)
+{
+    struct change ** split     = NULL;
+    struct change *  deletes   = NULL;
+    unsigned long    num_split = 0;
+    bool             success   = false;
+
+    // A rebuild in progress replays these onto its copy before swapping it in
+    if( object->shadow != NULL && !buffer_shadow_changes( object, changes, num_changes ) )
+    {
+        return false;
+    }
+
+    num_split = _split_moved_keys( object, changes, num_changes, &split, &deletes );
+
+    if( num_split > num_changes )
+    {
+        changes     = split;
+        num_changes = num_split;
+    }
+    else if( num_split < num_changes )
+    {
+        return false;
+    }
+
+    if( num_changes >= batch_apply_threshold )
+    {
+        success = _apply_batch( me, object, changes, num_changes );
+    }
+    else
+    {
+        success = _apply_rows( me, object, changes, num_changes );
+    }
+
+    if( !success )
+    {
+        // The staging table may have been created in the failed transaction
+        object->stage_connection = 0;
+    }
+
+    free( split );
+    free( deletes );
+    return success;
+}
+
+/*
+ * Whether change is an UPDATE of one of object's key columns. The change's
+ * key is that of its new tuple, so the old values are those of its old
+ * tuple, which is only there when the key changed, or the source table
+ * replicates whole rows; see _key_changed() in coalesce.c.
+ */
+bool change_moves_key( struct maintenance_object * object, struct change * change )
+{
+    int          old_index = -1;
+    int          new_index = -1;
+    unsigned int i         = 0;
+
+    if( change == NULL || change->type != CHANGE_TYPE_UPDATE || change->old_tuple == NULL )
+    {
+        return false;
+    }
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        if( !object->is_key[i] )
+        {
+            continue;
+        }
+
+        old_index = find_tuple_column( change->old_tuple, object->columns[i] );
+        new_index = find_tuple_column( change->new_tuple, object->columns[i] );
+
+        if(
+                old_index >= 0
+             && new_index >= 0
+             && !tuple_value_equals(
+                    change->old_tuple,
+                    ( unsigned int ) old_index,
+                    change->new_tuple,
+                    ( unsigned int ) new_index
+                )
+          )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * An UPDATE that moves a row to another key upserts the new key, which
+ * leaves the row under the old one behind. Each such UPDATE is preceded in
+ * split by a DELETE of its old key, one of deletes, which borrow the
+ * UPDATE's old tuple; not its key, which is the new one. Returns the number
+ * of changes in split, which is left NULL, and num_changes returned, if no
+ * UPDATE moves a key, or less than num_changes if allocating them failed.
+ */
+static unsigned long _split_moved_keys(
+    struct maintenance_object * object,
+    struct change **            changes,
+    unsigned long               num_changes,
+    struct change ***           split,
+    struct change **            deletes
+)
+{
+    unsigned long i         = 0;
+    unsigned long num_moved = 0;
+    unsigned long num_split = 0;
+
+    for( i = 0; i < num_changes; i++ )
+    {
+        if( change_moves_key( object, changes[i] ) )
+        {
+            num_moved++;
+        }
+    }
+
+    if( num_moved == 0 )
+    {
+        return num_changes;
+    }
+
+    *split   = ( struct change ** ) calloc( num_changes + num_moved, sizeof( struct change * ) );
+    *deletes = ( struct change * ) calloc( num_moved, sizeof( struct change ) );
+
+    if( *split == NULL || *deletes == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate key changes to %s",
+            object->qualified_name
+        );
+
+        free( *split );
+        free( *deletes );
+        *split   = NULL;
+        *deletes = NULL;
+        return 0;
+    }
+
+    for( i = 0, num_moved = 0; i < num_changes; i++ )
+    {
+        if( change_moves_key( object, changes[i] ) )
+        {
+            ( *deletes )[num_moved]           = *( changes[i] );
+            ( *deletes )[num_moved].type      = CHANGE_TYPE_DELETE;
+            ( *deletes )[num_moved].new_tuple = NULL;
+            ( *deletes )[num_moved].key       = NULL;
+            ( *split )[num_split++]           = &( ( *deletes )[num_moved++] );
+        }
+
+        ( *split )[num_split++] = changes[i];
+    }
+
+    return num_split;
+}
+
+// Ends the transaction begun for the batch, if any; the caller's is left to it
+static bool _commit_postgresql_batch(
+    void *                      target,
+    struct worker *             me,
+    struct maintenance_object * object,
+    bool                        commit
+)
+{
+    struct postgresql_target * handle = NULL;
+
+    handle = ( struct postgresql_target * ) target;
+
+    if( !( handle->own_transaction ) )
+    {
+        return commit;
+    }
+
+    handle->own_transaction = false;
+
+    if( commit )
+    {
+        return _commit_transaction( me );
+    }
+
+    if( me->tx_in_progress )
+    {
+        _rollback_transaction( me );
+    }
+
+    return true;
+}
+
+static void * _open_postgresql( struct worker * me, struct maintenance_object * object )
+{
+    return calloc( 1, sizeof( struct postgresql_target ) );
+}
+
+static void _close_postgresql( void * target )
+{
+    free( target );
+    return;
+}
+
+char * build_upsert_sql( struct maintenance_object * object )
+{
+    struct string_buffer * sql    = NULL;
+    char *                 result = NULL;
+    unsigned int           i      = 0;
+
+    sql = new_string_buffer();
+
+    if( sql == NULL )
+    {
+        return NULL;
+    }
+
+    string_buffer_append( sql, "INSERT INTO %s ( ", object->qualified_name );
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        string_buffer_append( sql, "%s%s", i > 0 ? ", " : "", object->quoted_columns[i] );
+    }
+
+    string_buffer_append( sql, " ) VALUES ( " );
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        string_buffer_append( sql, "%s$%u", i > 0 ? ", " : "", i + 1 );
+    }
+
+    string_buffer_append( sql, " ) " );
+    append_upsert_conflict( sql, object );
+
+    result = strdup( sql->data );
+    free_string_buffer( sql );
+    return result;
+}
+
+/*
+ * Appends the ON CONFLICT clause that makes an INSERT into object's table an
+ * upsert on its key.
+ */
+void append_upsert_conflict( struct string_buffer * sql, struct maintenance_object * object )
+{
+    unsigned int i     = 0;
+    unsigned int count = 0;
+
+    string_buffer_append( sql, "ON CONFLICT ( " );
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        if( object->is_key[i] )
+        {
+            string_buffer_append( sql, "%s%s", count++ > 0 ? ", " : "", object->quoted_columns[i] );
+        }
+    }
+
+    if( object->num_key_columns == object->num_columns )
+    {
+        string_buffer_append( sql, " ) DO NOTHING" );
+    }
+    else
+    {
+        string_buffer_append( sql, " ) DO UPDATE SET " );
+        count = 0;
+
+        for( i = 0; i < object->num_columns; i++ )
+        {
+            if( !object->is_key[i] )
+            {
+                string_buffer_append(
+                    sql,
+                    "%s%s = EXCLUDED.%s",
+                    count++ > 0 ? ", " : "",
+                    object->quoted_columns[i],
+                    object->quoted_columns[i]
+                );
+            }
+        }
+    }
+
+    return;
+}
+
+// DELETE for object, parameterized by its key columns in column order
+char * build_delete_sql( struct maintenance_object * object )
+{
+    struct string_buffer * sql    = NULL;
+    char *                 result = NULL;
+    unsigned int           i      = 0;
+    unsigned int           count  = 0;
+
+    sql = new_string_buffer();
+
+    if( sql == NULL )
+    {
+        return NULL;
+    }
+
+    string_buffer_append( sql, "DELETE FROM %s WHERE ", object->qualified_name );
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        if( object->is_key[i] )
+        {
+            count++;
+            string_buffer_append(
+                sql,
+                "%s%s = $%u",
+                count > 1 ? " AND " : "",
+                object->quoted_columns[i],
+                count
+            );
+        }
+    }
+
+    result = strdup( sql->data );
+    free_string_buffer( sql );
+    return result;
+}
+
+/*
+ * The value of object's column for change. For DELETEs only the key is
+ * meaningful, which is taken from the change's key, or its old tuple. If the
+ * value is binary, length and type are set to its length and type OID,
+ * otherwise length is set to -1.
+ */
+char * get_change_value(
+    struct maintenance_object * object,
+    struct change *             change,
+    unsigned int                column,
+    int *                       length,
+    Oid *                       type
+)
+{
+    struct tuple * tuple = NULL;
+    int            index = -1;
+
+    if( change->type == CHANGE_TYPE_DELETE )
+    {
+        tuple = change->key;
+        index = find_tuple_column( tuple, object->columns[column] );
+
+        if( index < 0 )
+        {
+            tuple = change->old_tuple;
+            index = find_tuple_column( tuple, object->columns[column] );
+        }
+    }
+    else
+    {
+        tuple = change->new_tuple;
+        index = find_tuple_column( tuple, object->columns[column] );
+    }
+
+    if( length != NULL )
+    {
+        *length = -1;
+    }
+
+    if( type != NULL )
+    {
+        *type = InvalidOid;
+    }
+
+    if( index < 0 )
+    {
+        return NULL;
+    }
+
+    if( tuple->lengths != NULL )
+    {
+        if( length != NULL && tuple->values[index] != NULL )
+        {
+            *length = tuple->lengths[index];
+        }
+
+        if( type != NULL )
+        {
+            *type = tuple->types[index];
+        }
+    }
+
+    return tuple->values[index];
+}
+
+/*
+ * Applies changes one statement per row, using statements prepared once per
+ * connection from the worker's statement cache. Where libpq supports it the
+ * statements are pipelined, so the whole set costs a round trip per
+ * MAX_PIPELINE_DEPTH rows instead of one per row.
+ */
+static bool _apply_rows(
+    struct worker *             me,
+    struct maintenance_object * object,
+    struct change **            changes,
+    unsigned long               num_changes
+)
+{
+    struct pipeline_statement * statements     = NULL;
+    struct prepared_statement * upsert         = NULL;
+    struct prepared_statement * delete         = NULL;
+    struct string_buffer *      columns        = NULL;
+    struct string_buffer *      key_columns    = NULL;
+#ifndef LIBPQ_HAS_PIPELINING
+    PGresult *                  result         = NULL;
+#endif
+    char *                      upsert_sql     = NULL;
+    char *                      delete_sql     = NULL;
+    char **                     params         = NULL;
+    char **                     row_params     = NULL;
+    int *                       lengths        = NULL;
+    int *                       formats        = NULL;
+    Oid *                       upsert_types   = NULL;
+    Oid *                       delete_types   = NULL;
+    Oid                         type           = InvalidOid;
+    unsigned int                offset         = 0;
+    unsigned int                count          = 0;
+    unsigned long               num_statements = 0;
+    unsigned long               failed         = 0;
+    unsigned long               j              = 0;
+    unsigned int                i              = 0;
+    bool                        success        = true;
+    bool                        binary         = false;
+
+    columns      = new_string_buffer();
+    key_columns  = new_string_buffer();
+    upsert_types = ( Oid * ) calloc( object->num_columns + 1, sizeof( Oid ) );
+    delete_types = ( Oid * ) calloc( object->num_columns + 1, sizeof( Oid ) );
+
+    if( columns == NULL || key_columns == NULL || upsert_types == NULL || delete_types == NULL )
+    {
+        free_string_buffer( columns );
+        free_string_buffer( key_columns );
+        free( upsert_types );
+        free( delete_types );
+        return false;
+    }
+
+    /*
+     * Binary values are sent with the source's type OIDs so that the server
+     * reads them with the right receive function, and casts them to the
+     * target's types where those differ. Which columns are binary is decided
+     * column by column, as any of them may be sent either way.
+     */
+    for( j = 0; j < num_changes; j++ )
+    {
+        if( changes[j] == NULL )
+        {
+            continue;
+        }
+
+        for( i = 0, count = 0; i < object->num_columns; i++ )
+        {
+            if( changes[j]->type == CHANGE_TYPE_DELETE && object->is_key[i] )
+            {
+                get_change_value( object, changes[j], i, NULL, &type );
+
+                if( type != InvalidOid )
+                {
+                    delete_types[count] = type;
+                    binary              = true;
+                }
+
+                count++;
+            }
+            else if( changes[j]->type != CHANGE_TYPE_DELETE )
+            {
+                get_change_value( object, changes[j], i, NULL, &type );
+
+                if( type != InvalidOid )
+                {
+                    upsert_types[i] = type;
+                    binary          = true;
+                }
+            }
+        }
+    }
+
+    // The table, column sets and binary types the statements cover are part of their cache keys
+    string_buffer_append( columns, "%s:", object->qualified_name );
+    string_buffer_append( key_columns, "%s:", object->qualified_name );
+
+    for( i = 0, count = 0; i < object->num_columns; i++ )
+    {
+        string_buffer_append( columns, "%s %u,", object->quoted_columns[i], upsert_types[i] );
+
+        if( object->is_key[i] )
+        {
+            string_buffer_append( key_columns, "%s %u,", object->quoted_columns[i], delete_types[count++] );
+        }
+    }
+
+    upsert_sql = build_upsert_sql( object );
+    delete_sql = build_delete_sql( object );
+
+    if( upsert_sql != NULL && delete_sql != NULL )
+    {
+        upsert = get_prepared_statement(
+            me,
+            object->maintenance_object,
+            CHANGE_TYPE_INSERT,
+            columns->data,
+            upsert_sql,
+            ( int ) object->num_columns,
+            binary ? upsert_types : NULL
+        );
+        delete = get_prepared_statement(
+            me,
+            object->maintenance_object,
+            CHANGE_TYPE_DELETE,
+            key_columns->data,
+            delete_sql,
+            ( int ) object->num_key_columns,
+            binary ? delete_types : NULL
+        );
+    }
+
+    free( upsert_sql );
+    free( delete_sql );
+    free( upsert_types );
+    free( delete_types );
+    free_string_buffer( columns );
+    free_string_buffer( key_columns );
+
+    params     = ( char ** ) calloc(
+        num_changes * object->num_columns + 1,
+        sizeof( char * )
+    );
+    lengths    = ( int * ) calloc(
+        num_changes * object->num_columns + 1,
+        sizeof( int )
+    );
+    formats    = ( int * ) calloc(
+        num_changes * object->num_columns + 1,
+        sizeof( int )
+    );
+    statements = ( struct pipeline_statement * ) calloc(
+        num_changes + 1,
+        sizeof( struct pipeline_statement )
+    );
+
+    if(
+            upsert == NULL
+         || delete == NULL
+         || params == NULL
+         || lengths == NULL
+         || formats == NULL
+         || statements == NULL
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to build apply statements for %s",
+            object->qualified_name
+        );
+
+        free( params );
+        free( lengths );
+        free( formats );
+        free( statements );
+        return false;
+    }
+
+    for( j = 0; j < num_changes; j++ )
+    {
+        if( changes[j] == NULL )
+        {
+            continue;
+        }
+
+        offset     = ( unsigned int ) ( num_statements * object->num_columns );
+        row_params = params + offset;
+
+        if( changes[j]->type == CHANGE_TYPE_DELETE )
+        {
+            statements[num_statements].prepared = delete;
+        }
+        else if(
+                    changes[j]->type == CHANGE_TYPE_INSERT
+                 || changes[j]->type == CHANGE_TYPE_UPDATE
+               )
+        {
+            statements[num_statements].prepared = upsert;
+        }
+        else
+        {
+            continue;
+        }
+
+        for( i = 0; i < object->num_columns; i++ )
+        {
+            if( changes[j]->type == CHANGE_TYPE_DELETE && !object->is_key[i] )
+            {
+                continue;
+            }
+
+            count = statements[num_statements].param_count++;
+
+            row_params[count] = get_change_value(
+                object,
+                changes[j],
+                i,
+                &( lengths[offset + count] ),
+                NULL
+            );
+
+            formats[offset + count] = lengths[offset + count] >= 0 ? 1 : 0;
+        }
+
+        statements[num_statements].params        = row_params;
+        statements[num_statements].param_lengths = lengths + offset;
+        statements[num_statements].param_formats = formats + offset;
+        num_statements++;
+    }
+
+#ifdef LIBPQ_HAS_PIPELINING
+    if( !_execute_pipeline( me, statements, num_statements, &failed ) )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to apply row %lu of %lu to %s (SQL state %s)",
+            failed + 1,
+            num_statements,
+            object->qualified_name,
+            statements[failed].sql_state
+        );
+
+        success = false;
+    }
+#else
+    for( failed = 0; failed < num_statements && success; failed++ )
+    {
+        result = _execute_prepared(
+            me,
+            statements[failed].prepared,
+            statements[failed].params,
+            statements[failed].param_lengths,
+            statements[failed].param_formats
+        );
+
+        if( result == NULL )
+        {
+            success = false;
+        }
+
+        PQclear( result );
+    }
+#endif
+
+    free( params );
+    free( lengths );
+    free( formats );
+    free( statements );
+    return success;
+}
+
+/*
+ * Streams changes into object's temporary staging table, then folds the last
+ * change per key into the target with one statement: keys whose last change
+ * is a DELETE are removed, and the rest are upserted. Binary values are
+ * streamed with binary COPY, which requires their types to match the target's
+ * exactly; if they do not, the changes are applied a row at a time instead,
+ * where the server casts each parameter.
+ */
+static bool _apply_batch(
+    struct worker *             me,
+    struct maintenance_object * object,
+    struct change **            changes,
+    unsigned long               num_changes
+)
+{
+    struct string_buffer * data       = NULL;
+    struct string_buffer * sql        = NULL;
+    char *                 stage      = NULL;
+    char *                 value      = NULL;
+    char                   operation  = '\0';
+    int                    format     = 0;
+    int                    length     = -1;
+    unsigned int           i          = 0;
+    unsigned int           count      = 0;
+    unsigned long          j          = 0;
+    unsigned long          num_rows   = 0;
+    bool                   success    = false;
+
+    format = _batch_copy_format( object, changes, num_changes );
+
+    if( format < 0 )
+    {
+        return _apply_rows( me, object, changes, num_changes );
+    }
+
+    stage = _stage_name( me, object );
+    data  = new_string_buffer();
+    sql   = new_string_buffer();
+
+    if( stage == NULL || data == NULL || sql == NULL )
+    {
+        goto cleanup;
+    }
+
+    if( !_prepare_stage( me, object, stage ) )
+    {
+        goto cleanup;
+    }
+
+    if( format == 1 )
+    {
+        // Signature, flags and header extension length
+        string_buffer_append_bytes( data, "PGCOPY\n\377\r\n\0", 11 );
+        _append_network_integer( data, 0, 4 );
+        _append_network_integer( data, 0, 4 );
+    }
+
+    for( j = 0; j < num_changes; j++ )
+    {
+        if( changes[j] == NULL )
+        {
+            continue;
+        }
+
+        if(      changes[j]->type == CHANGE_TYPE_INSERT ) { operation = 'I'; }
+        else if( changes[j]->type == CHANGE_TYPE_UPDATE ) { operation = 'U'; }
+        else if( changes[j]->type == CHANGE_TYPE_DELETE ) { operation = 'D'; }
+        else                                              { continue;        }
+
+        if( format == 1 )
+        {
+            _append_network_integer( data, object->num_columns + 2, 2 );
+        }
+
+        for( i = 0; i < object->num_columns; i++ )
+        {
+            value  = NULL;
+            length = -1;
+
+            if( operation != 'D' || object->is_key[i] )
+            {
+                value = get_change_value( object, changes[j], i, &length, NULL );
+            }
+
+            if( format == 1 )
+            {
+                _append_binary_copy_value( data, value, length );
+            }
+            else
+            {
+                _append_copy_value( data, value );
+                string_buffer_append_bytes( data, "\t", 1 );
+            }
+        }
+
+        if( format == 1 )
+        {
+            // int8 sequence, "char" operation
+            _append_network_integer( data, 8, 4 );
+            _append_network_integer( data, num_rows++, 8 );
+            _append_network_integer( data, 1, 4 );
+            string_buffer_append_bytes( data, &operation, 1 );
+        }
+        else
+        {
+            string_buffer_append( data, "%lu\t%c\n", num_rows++, operation );
+        }
+    }
+
+    if( num_rows == 0 )
+    {
+        success = true;
+        goto cleanup;
+    }
+
+    if( format == 1 )
+    {
+        _append_network_integer( data, 0xFFFF, 2 );
+    }
+
+    string_buffer_append( sql, "COPY %s ( ", stage );
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        string_buffer_append( sql, "%s, ", object->quoted_columns[i] );
+    }
+
+    string_buffer_append(
+        sql,
+        STAGE_COLUMN_SEQUENCE ", " STAGE_COLUMN_OPERATION " ) FROM STDIN%s",
+        format == 1 ? " ( FORMAT binary )" : ""
+    );
+
+    if( !_copy_in( me, sql->data, data->data, data->length ) )
+    {
+        goto cleanup;
+    }
+
+    string_buffer_reset( sql );
+    string_buffer_append( sql, "WITH s AS ( SELECT DISTINCT ON ( " );
+
+    for( i = 0, count = 0; i < object->num_columns; i++ )
+    {
+        if( object->is_key[i] )
+        {
+            string_buffer_append( sql, "%s%s", count++ > 0 ? ", " : "", object->quoted_columns[i] );
+        }
+    }
+
+    string_buffer_append( sql, " ) * FROM %s ORDER BY ", stage );
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        if( object->is_key[i] )
+        {
+            string_buffer_append( sql, "%s, ", object->quoted_columns[i] );
+        }
+    }
+
+    string_buffer_append(
+        sql,
+        STAGE_COLUMN_SEQUENCE " DESC ), d AS ( DELETE FROM %s t USING s WHERE s."
+        STAGE_COLUMN_OPERATION " = 'D' AND ",
+        object->qualified_name
+    );
+
+    _append_key_join( sql, object, "t", "s" );
+    string_buffer_append( sql, " ) INSERT INTO %s ( ", object->qualified_name );
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        string_buffer_append( sql, "%s%s", i > 0 ? ", " : "", object->quoted_columns[i] );
+    }
+
+    string_buffer_append( sql, " ) SELECT " );
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        string_buffer_append( sql, "%s%s", i > 0 ? ", " : "", object->quoted_columns[i] );
+    }
+
+    string_buffer_append(
+        sql,
+        " FROM s WHERE s." STAGE_COLUMN_OPERATION " <> 'D' ON CONFLICT ( "
+    );
+
+    for( i = 0, count = 0; i < object->num_columns; i++ )
+    {
+        if( object->is_key[i] )
+        {
+            string_buffer_append( sql, "%s%s", count++ > 0 ? ", " : "", object->quoted_columns[i] );
+        }
+    }
+
+    if( object->num_key_columns == object->num_columns )
+    {
+        string_buffer_append( sql, " ) DO NOTHING" );
+    }
+    else
+    {
+        string_buffer_append( sql, " ) DO UPDATE SET " );
+
+        for( i = 0, count = 0; i < object->num_columns; i++ )
+        {
+            if( !object->is_key[i] )
+            {
+                string_buffer_append(
+                    sql,
+                    "%s%s = EXCLUDED.%s",
+                    count++ > 0 ? ", " : "",
+                    object->quoted_columns[i],
+                    object->quoted_columns[i]
+                );
+            }
+        }
+    }
+
+    success = _execute_command( me, sql->data );
+
+    if( success )
+    {
+        _log(
+            LOG_LEVEL_DEBUG,
+            "Applied batch of %lu rows to %s",
+            num_rows,
+            object->qualified_name
+        );
+    }
+
+cleanup:
+    free( stage );
+    free_string_buffer( data );
+    free_string_buffer( sql );
+    return success;
+}
+
+static char * _stage_name( struct worker * me, struct maintenance_object * object )
+{
+    struct string_buffer * name   = NULL;
+    char *                 table  = NULL;
+    char *                 result = NULL;
+
+    name = new_string_buffer();
+
+    if( name == NULL )
+    {
+        return NULL;
+    }
+
+    string_buffer_append( name, STAGE_TABLE_PREFIX "%u", object->maintenance_object );
+
+    table = quote_identifier( me, name->data );
+
+    if( table != NULL )
+    {
+        string_buffer_reset( name );
+        string_buffer_append( name, "pg_temp.%s", table );
+        result = strdup( name->data );
+    }
+
+    free( table );
+    free_string_buffer( name );
+    return result;
+}
+
+/*
+ * (Re)creates the staging table when object's layout has been (re)read or
+ * me has connected since it was made. It is a temporary table of the
+ * session whose rows go at each commit, so it is almost always empty; it is
+ * emptied with a DELETE, for a batch applied earlier in the caller's
+ * transaction, rather than with TRUNCATE, which would take an ACCESS
+ * EXCLUSIVE lock and a new relfilenode every batch. The staging table
+ * carries no constraints so that DELETEs can be staged with only their key
+ * columns set.
+ */
+static bool _prepare_stage(
+    struct worker *             me,
+    struct maintenance_object * object,
+    char *                      stage
+)
+{
+    struct string_buffer * sql     = NULL;
+    unsigned int           i       = 0;
+    bool                   success = false;
+
+    sql = new_string_buffer();
+
+    if( sql == NULL )
+    {
+        return false;
+    }
+
+    if( object->stage_connection != 0 && object->stage_connection == me->connection_id )
+    {
+        string_buffer_append( sql, "DELETE FROM %s", stage );
+        success = _execute_command( me, sql->data );
+        free_string_buffer( sql );
+        return success;
+    }
+
+    string_buffer_append( sql, "DROP TABLE IF EXISTS %s", stage );
+
+    if( !_execute_command( me, sql->data ) )
+    {
+        free_string_buffer( sql );
+        return false;
+    }
+
+    string_buffer_reset( sql );
+    string_buffer_append( sql, "CREATE TEMPORARY TABLE %s ( ", stage );
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        string_buffer_append(
+            sql,
+            "%s %s, ",
+            object->quoted_columns[i],
+            object->column_types[i]
+        );
+    }
+
+    string_buffer_append(
+        sql,
+        STAGE_COLUMN_SEQUENCE " BIGINT NOT NULL, "
+        STAGE_COLUMN_OPERATION " \"char\" NOT NULL ) ON COMMIT DELETE ROWS"
+    );
+
+    success = _execute_command( me, sql->data );
+    free_string_buffer( sql );
+
+    object->stage_connection = success ? me->connection_id : 0;
+    return success;
+}
+
+static bool _execute_command( struct worker * me, char * sql )
+{
+    PGresult * result = NULL;
+
+    result = _execute_query( me, sql, NULL, 0 );
+
+    if( result == NULL )
+    {
+        return false;
+    }
+
+    PQclear( result );
+    return true;
+}
+
+// Escapes value for COPY's text format, \N is NULL
+static void _append_copy_value( struct string_buffer * data, char * value )
+{
+    char * character = NULL;
+    char * start     = NULL;
+
+    if( value == NULL )
+    {
+        string_buffer_append_bytes( data, "\\N", 2 );
+        return;
+    }
+
+    start = value;
+
+    for( character = value; *character; character++ )
+    {
+        if(
+                *character != '\\'
+             && *character != '\t'
+             && *character != '\n'
+             && *character != '\r'
+          )
+        {
+            continue;
+        }
+
+        string_buffer_append_bytes( data, start, character - start );
+
+        if(      *character == '\\' ) { string_buffer_append_bytes( data, "\\\\", 2 ); }
+        else if( *character == '\t' ) { string_buffer_append_bytes( data, "\\t", 2 );  }
+        else if( *character == '\n' ) { string_buffer_append_bytes( data, "\\n", 2 );  }
+        else                          { string_buffer_append_bytes( data, "\\r", 2 );  }
+
+        start = character + 1;
+    }
+
+    string_buffer_append_bytes( data, start, character - start );
+    return;
+}
+
+/*
+ * The COPY format a batch can be streamed in: 0 for text, 1 for binary, or -1
+ * if it mixes text and binary values, or carries binary values whose types
+ * differ from the target's columns.
+ */
+static int _batch_copy_format(
+    struct maintenance_object * object,
+    struct change **            changes,
+    unsigned long               num_changes
+)
+{
+    struct tuple * tuple  = NULL;
+    unsigned long  j      = 0;
+    unsigned int   i      = 0;
+    int            length = -1;
+    int            format = -1;
+    Oid            type   = InvalidOid;
+    bool           binary = false;
+
+    for( j = 0; j < num_changes; j++ )
+    {
+        if( changes[j] == NULL || changes[j]->type == CHANGE_TYPE_NONE )
+        {
+            continue;
+        }
+
+        tuple  = ( changes[j]->type == CHANGE_TYPE_DELETE )
+               ? ( changes[j]->key != NULL ? changes[j]->key : changes[j]->old_tuple )
+               : changes[j]->new_tuple;
+        binary = tuple != NULL && tuple->lengths != NULL;
+
+        if( format >= 0 && format != ( binary ? 1 : 0 ) )
+        {
+            return -1;
+        }
+
+        format = binary ? 1 : 0;
+
+        if( !binary )
+        {
+            continue;
+        }
+
+        for( i = 0; i < object->num_columns; i++ )
+        {
+            if( changes[j]->type == CHANGE_TYPE_DELETE && !object->is_key[i] )
+            {
+                continue;
+            }
+
+            if(
+                    get_change_value( object, changes[j], i, &length, &type ) != NULL
+                 && type != object->column_type_oids[i]
+              )
+            {
+                return -1;
+            }
+        }
+    }
+
+    return format < 0 ? 0 : format;
+}
+
+// Appends the low bytes of value in network byte order
+static void _append_network_integer(
+    struct string_buffer * data,
+    uint64_t               value,
+    unsigned int           bytes
+)
+{
+    char         buffer[8] = {0};
+    unsigned int i         = 0;
+
+    for( i = 0; i < bytes && i < sizeof( buffer ); i++ )
+    {
+        buffer[i] = ( char ) ( ( value >> ( 8 * ( bytes - i - 1 ) ) ) & 0xFF );
+    }
+
+    string_buffer_append_bytes( data, buffer, i );
+    return;
+}
+
+// Appends a field in COPY's binary format, a length of -1 is NULL
+static void _append_binary_copy_value(
+    struct string_buffer * data,
+    char *                 value,
+    int                    length
+)
+{
+    if( value == NULL || length < 0 )
+    {
+        _append_network_integer( data, 0xFFFFFFFF, 4 );
+        return;
+    }
+
+    _append_network_integer( data, ( uint64_t ) length, 4 );
+    string_buffer_append_bytes( data, value, ( size_t ) length );
+    return;
+}
+
+static void _append_key_join(
+    struct string_buffer *      sql,
+    struct maintenance_object * object,
+    char *                      left,
+    char *                      right
+)
+{
+    unsigned int i     = 0;
+    unsigned int count = 0;
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        if( object->is_key[i] )
+        {
+            string_buffer_append(
+                sql,
+                "%s%s.%s = %s.%s",
+                count++ > 0 ? " AND " : "",
+                left,
+                object->quoted_columns[i],
+                right,
+                object->quoted_columns[i]
+            );
+        }
+    }
+
+    return;
+}
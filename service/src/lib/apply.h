@@ -0,0 +1,45 @@
+#ifndef APPLY_H
+#define APPLY_H
+
+#include "util.h"
+#include "query.h"
+#include "change.h"
+#include "object.h"
+#include "refresh.h"
+#include "driver.h"
+
+#define DEFAULT_BATCH_APPLY_THRESHOLD 64
+
+#define STAGE_TABLE_PREFIX "__pg_ctblmgr_stage_"
+#define STAGE_COLUMN_SEQUENCE "__pg_ctblmgr_seq"
+#define STAGE_COLUMN_OPERATION "__pg_ctblmgr_op"
+
+extern unsigned long batch_apply_threshold;
+
+// The handle of postgresql_driver: whether the batch in progress opened its transaction
+struct postgresql_target {
+    bool own_transaction;
+};
+
+extern struct target_driver postgresql_driver;
+
+extern bool apply_changes(
+    struct worker *,
+    struct maintenance_object *,
+    struct change **,
+    unsigned long
+);
+
+extern char * build_upsert_sql( struct maintenance_object * );
+extern char * build_delete_sql( struct maintenance_object * );
+extern void append_upsert_conflict( struct string_buffer *, struct maintenance_object * );
+extern bool change_moves_key( struct maintenance_object *, struct change * );
+extern char * get_change_value(
+    struct maintenance_object *,
+    struct change *,
+    unsigned int,
+    int *,
+    Oid *
+);
+
+#endif // APPLY_H
@@ -0,0 +1,818 @@
+#include "batch.h"
+
+/*
+ * The AVX2 kernels are built for x86-64 whatever the target flags, and only
+ * used where the CPU running them has AVX2, see _has_avx2(); the scalar loops
+ * after each take the rest of the rows, or all of them elsewhere.
+ */
+#if defined( __x86_64__ ) && defined( __GNUC__ )
+#define BATCH_AVX2
+#include <immintrin.h>
+#endif
+
+#define IS_NULL( column, row ) ( ( ( column )->nulls[( row ) >> 6] >> ( ( row ) & 63 ) ) & 1 )
+
+static bool _read_integer( char *, int64_t * );
+static void _filter_integers( struct change_batch *, struct batch_column *, unsigned short, int64_t );
+static void _filter_reals( struct change_batch *, struct batch_column *, unsigned short, double );
+#ifdef BATCH_AVX2
+static bool _has_avx2( void );
+static unsigned long _deltas_integers_avx2( int64_t *, int64_t *, int64_t *, int64_t *, unsigned long );
+static unsigned long _deltas_reals_avx2( double *, double *, int64_t *, int64_t *, unsigned long );
+static unsigned long _filter_integers_avx2( uint8_t *, int64_t *, unsigned long, unsigned short, int64_t );
+static unsigned long _filter_reals_avx2( uint8_t *, double *, unsigned long, unsigned short, double );
+#endif
+
+struct change_batch * new_change_batch( unsigned int num_columns, unsigned long max_rows )
+{
+    struct change_batch * batch = NULL;
+
+    batch = ( struct change_batch * ) calloc( 1, sizeof( struct change_batch ) );
+
+    if( batch == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate change batch"
+        );
+
+        return NULL;
+    }
+
+    batch->max_rows       = max_rows;
+    batch->num_columns    = num_columns;
+    batch->columns        = ( struct batch_column * ) calloc( num_columns + 1, sizeof( struct batch_column ) );
+    batch->signs          = ( int64_t * ) calloc( max_rows + 1, sizeof( int64_t ) );
+    batch->selected       = ( uint8_t * ) calloc( max_rows + 1, sizeof( uint8_t ) );
+    batch->hashes         = ( uint64_t * ) calloc( max_rows + 1, sizeof( uint64_t ) );
+    batch->delta_rows     = ( int64_t * ) calloc( max_rows + 1, sizeof( int64_t ) );
+    batch->delta_integers = ( int64_t * ) calloc( max_rows + 1, sizeof( int64_t ) );
+    batch->delta_reals    = ( double * ) calloc( max_rows + 1, sizeof( double ) );
+
+    if(
+            batch->columns == NULL
+         || batch->signs == NULL
+         || batch->selected == NULL
+         || batch->hashes == NULL
+         || batch->delta_rows == NULL
+         || batch->delta_integers == NULL
+         || batch->delta_reals == NULL
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate change batch of %lu rows",
+            max_rows
+        );
+
+        free_change_batch( batch );
+        return NULL;
+    }
+
+    return batch;
+}
+
+void free_change_batch( struct change_batch * batch )
+{
+    unsigned int i = 0;
+
+    if( batch == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; batch->columns != NULL && i < batch->num_columns; i++ )
+    {
+        free( batch->columns[i].name );
+        free( batch->columns[i].nulls );
+        free( batch->columns[i].values );
+        free( batch->columns[i].lengths );
+        free( batch->columns[i].types );
+        free( batch->columns[i].integers );
+        free( batch->columns[i].reals );
+    }
+
+    free( batch->columns );
+    free( batch->signs );
+    free( batch->selected );
+    free( batch->hashes );
+    free( batch->delta_rows );
+    free( batch->delta_integers );
+    free( batch->delta_reals );
+    free( batch );
+    return;
+}
+
+// Sets up column index of batch to hold the tuple column named name
+bool set_batch_column( struct change_batch * batch, unsigned int index, char * name, unsigned int kind )
+{
+    struct batch_column * column = NULL;
+
+    column             = &( batch->columns[index] );
+    column->name       = strdup( name );
+    column->kind       = kind;
+    column->last_index = -1;
+    column->nulls      = ( uint64_t * ) calloc( batch->max_rows / 64 + 1, sizeof( uint64_t ) );
+    column->values     = ( char ** ) calloc( batch->max_rows + 1, sizeof( char * ) );
+    column->lengths    = ( int * ) calloc( batch->max_rows + 1, sizeof( int ) );
+    column->types      = ( Oid * ) calloc( batch->max_rows + 1, sizeof( Oid ) );
+
+    if( kind == BATCH_COLUMN_INTEGER )
+    {
+        column->integers = ( int64_t * ) calloc( batch->max_rows + 1, sizeof( int64_t ) );
+    }
+    else if( kind == BATCH_COLUMN_REAL )
+    {
+        column->reals = ( double * ) calloc( batch->max_rows + 1, sizeof( double ) );
+    }
+
+    if(
+            column->name == NULL
+         || column->nulls == NULL
+         || column->values == NULL
+         || column->lengths == NULL
+         || column->types == NULL
+         || ( kind == BATCH_COLUMN_INTEGER && column->integers == NULL )
+         || ( kind == BATCH_COLUMN_REAL && column->reals == NULL )
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate batch column %s",
+            name
+        );
+
+        return false;
+    }
+
+    return true;
+}
+
+void reset_change_batch( struct change_batch * batch )
+{
+    unsigned int i = 0;
+
+    for( i = 0; i < batch->num_columns; i++ )
+    {
+        memset( batch->columns[i].nulls, 0, ( batch->num_rows / 64 + 1 ) * sizeof( uint64_t ) );
+    }
+
+    batch->num_rows = 0;
+    return;
+}
+
+/*
+ * Appends tuple to batch as a row with the given sign. The tuple must outlive
+ * the row, as only its values are read into the batch's number columns.
+ */
+bool batch_append_tuple( struct change_batch * batch, struct tuple * tuple, int64_t sign )
+{
+    struct batch_column * column = NULL;
+    unsigned long         row    = 0;
+    unsigned int          i      = 0;
+    int                   index  = -1;
+    int64_t               number = 0;
+    double                real   = 0;
+
+    if( tuple == NULL || batch->num_rows >= batch->max_rows )
+    {
+        return false;
+    }
+
+    row = batch->num_rows;
+
+    for( i = 0; i < batch->num_columns; i++ )
+    {
+        column = &( batch->columns[i] );
+        index  = column->last_index;
+
+        // Rows of a relation mostly share a layout, so the last position is tried first
+        if(
+                index < 0
+             || ( unsigned int ) index >= tuple->num_columns
+             || strcmp( tuple->names[index], column->name ) != 0
+          )
+        {
+            index              = find_tuple_column( tuple, column->name );
+            column->last_index = index;
+        }
+
+        if( index < 0 || tuple->values[index] == NULL )
+        {
+            column->nulls[row >> 6] |= ( uint64_t ) 1 << ( row & 63 );
+            column->values[row]      = NULL;
+            column->lengths[row]     = -1;
+            column->types[row]       = InvalidOid;
+
+            if( column->kind == BATCH_COLUMN_INTEGER )
+            {
+                column->integers[row] = 0;
+            }
+            else if( column->kind == BATCH_COLUMN_REAL )
+            {
+                column->reals[row] = 0;
+            }
+
+            continue;
+        }
+
+        column->values[row]  = tuple->values[index];
+        column->lengths[row] = tuple->lengths != NULL ? tuple->lengths[index] : ( int ) strlen( tuple->values[index] );
+        column->types[row]   = tuple->types != NULL ? tuple->types[index] : InvalidOid;
+
+        if( column->kind == BATCH_COLUMN_VALUE )
+        {
+            continue;
+        }
+
+        if( !read_tuple_number( tuple, ( unsigned int ) index, column->kind == BATCH_COLUMN_REAL, &number, &real ) )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to read %s as a number",
+                column->name
+            );
+
+            return false;
+        }
+
+        if( column->kind == BATCH_COLUMN_INTEGER )
+        {
+            column->integers[row] = number;
+        }
+        else
+        {
+            column->reals[row] = real;
+        }
+    }
+
+    batch->signs[row]    = sign;
+    batch->selected[row] = 1;
+    batch->num_rows++;
+    return true;
+}
+
+/*
+ * Sets hashes to the hash of each row's values of the given columns. A row's
+ * hash is the same as combining hash_value() of its values in column order.
+ */
+void batch_hash_keys( struct change_batch * batch, unsigned int * columns, unsigned int num_columns )
+{
+    struct batch_column * column = NULL;
+    unsigned long         row    = 0;
+    unsigned int          i      = 0;
+
+    for( row = 0; row < batch->num_rows; row++ )
+    {
+        batch->hashes[row] = BATCH_HASH_SEED;
+    }
+
+    for( i = 0; i < num_columns; i++ )
+    {
+        column = &( batch->columns[columns[i]] );
+
+        for( row = 0; row < batch->num_rows; row++ )
+        {
+            batch->hashes[row] = ( batch->hashes[row] ^ hash_value( column->values[row], column->lengths[row] ) )
+                               * BATCH_HASH_PRIME;
+        }
+    }
+
+    return;
+}
+
+/*
+ * Clears selected for rows whose value of column does not compare to
+ * constant by operation, the way a WHERE clause would: NULLs never pass.
+ * INTEGER columns are compared to integer and REAL ones to real.
+ */
+void batch_filter(
+    struct change_batch * batch,
+    unsigned int          index,
+    unsigned short        operation,
+    int64_t               integer,
+    double                real
+)
+{
+    struct batch_column * column = NULL;
+    unsigned long         row    = 0;
+
+    column = &( batch->columns[index] );
+
+    if( column->kind == BATCH_COLUMN_INTEGER )
+    {
+        _filter_integers( batch, column, operation, integer );
+    }
+    else if( column->kind == BATCH_COLUMN_REAL )
+    {
+        _filter_reals( batch, column, operation, real );
+    }
+
+    for( row = 0; row < batch->num_rows; row++ )
+    {
+        batch->selected[row] &= ( uint8_t ) !IS_NULL( column, row );
+    }
+
+    return;
+}
+
+/*
+ * Computes each row's contribution to an aggregate over column, or to
+ * COUNT(*) when column is -1: delta_rows is the row's sign where it is
+ * selected and its value not NULL, and 0 otherwise, and delta_integers or
+ * delta_reals (by the column's kind) its value times that.
+ */
+void batch_deltas( struct change_batch * batch, int index )
+{
+    struct batch_column * column = NULL;
+    int64_t *             mask   = NULL;
+    int64_t *             signs  = NULL;
+    int64_t *             values = NULL;
+    double *              reals  = NULL;
+    unsigned long         row    = 0;
+    unsigned long         count  = 0;
+    int64_t               negate = 0;
+
+    // delta_rows holds each row's mask (all ones or zero) until the end
+    mask   = batch->delta_rows;
+    signs  = batch->signs;
+    count  = batch->num_rows;
+    column = index >= 0 ? &( batch->columns[index] ) : NULL;
+
+    for( row = 0; row < count; row++ )
+    {
+        mask[row] = -( int64_t ) batch->selected[row];
+    }
+
+    if( column != NULL )
+    {
+        for( row = 0; row < count; row++ )
+        {
+            mask[row] &= ( int64_t ) IS_NULL( column, row ) - 1;
+        }
+    }
+
+    row = 0;
+
+    if( column != NULL && column->kind == BATCH_COLUMN_INTEGER )
+    {
+        values = column->integers;
+#ifdef BATCH_AVX2
+        if( _has_avx2() )
+        {
+            row = _deltas_integers_avx2( batch->delta_integers, values, signs, mask, count );
+        }
+#endif
+        // Signs are +1 or -1, so negation is a conditional two's complement
+        for( ; row < count; row++ )
+        {
+            negate                     = signs[row] >> 63;
+            batch->delta_integers[row] = ( ( values[row] ^ negate ) - negate ) & mask[row];
+        }
+    }
+    else if( column != NULL && column->kind == BATCH_COLUMN_REAL )
+    {
+        reals = column->reals;
+#ifdef BATCH_AVX2
+        if( _has_avx2() )
+        {
+            row = _deltas_reals_avx2( batch->delta_reals, reals, signs, mask, count );
+        }
+#endif
+        for( ; row < count; row++ )
+        {
+            batch->delta_reals[row] = mask[row] != 0 ? ( double ) signs[row] * reals[row] : 0.0;
+        }
+    }
+
+    for( row = 0; row < count; row++ )
+    {
+        mask[row] &= signs[row];
+    }
+
+    return;
+}
+
+// FNV-1a of a value of length bytes, or a constant for NULL
+uint64_t hash_value( char * value, int length )
+{
+    uint64_t hash = BATCH_HASH_SEED;
+    int      i    = 0;
+
+    if( value == NULL || length < 0 )
+    {
+        return BATCH_HASH_NULL;
+    }
+
+    for( i = 0; i < length; i++ )
+    {
+        hash ^= ( unsigned char ) value[i];
+        hash *= BATCH_HASH_PRIME;
+    }
+
+    return hash;
+}
+
+// Reads a value in text or in the send format of an integer or floating point type
+bool read_tuple_number( struct tuple * tuple, unsigned int index, bool is_real, int64_t * number, double * real )
+{
+    unsigned char * data   = NULL;
+    char *          end    = NULL;
+    uint64_t        bits   = 0;
+    uint32_t        bits32 = 0;
+    float           single = 0;
+    int             length = 0;
+    int             i      = 0;
+
+    *number = 0;
+    *real   = 0;
+
+    if( tuple->lengths == NULL )
+    {
+        if( is_real )
+        {
+            *real = strtod( tuple->values[index], &end );
+        }
+        else if( _read_integer( tuple->values[index], number ) )
+        {
+            return true;
+        }
+        else
+        {
+            *number = strtoll( tuple->values[index], &end, 10 );
+        }
+
+        return end != tuple->values[index] && *end == '\0';
+    }
+
+    data   = ( unsigned char * ) tuple->values[index];
+    length = tuple->lengths[index];
+
+    for( i = 0; i < length && i < 8; i++ )
+    {
+        bits = ( bits << 8 ) | data[i];
+    }
+
+    switch( tuple->types[index] )
+    {
+        case INT2_OID:
+            *number = ( int16_t ) bits;
+            return length == 2;
+        case INT4_OID:
+            *number = ( int32_t ) bits;
+            return length == 4;
+        case INT8_OID:
+            *number = ( int64_t ) bits;
+            return length == 8;
+        case FLOAT4_OID:
+            bits32 = ( uint32_t ) bits;
+            memcpy( &single, &bits32, sizeof( float ) );
+            *real = single;
+            return length == 4;
+        case FLOAT8_OID:
+            memcpy( real, &bits, sizeof( double ) );
+            return length == 8;
+        default:
+            return false;
+    }
+}
+
+// Reads the plain decimal integers the server outputs, leaving anything else to strtoll()
+static bool _read_integer( char * text, int64_t * number )
+{
+    char *   cursor   = NULL;
+    uint64_t value    = 0;
+    bool     negative = false;
+
+    cursor   = text;
+    negative = *cursor == '-';
+    cursor  += negative ? 1 : 0;
+
+    // 18 digits cannot overflow
+    while( *cursor >= '0' && *cursor <= '9' && cursor - text < 19 )
+    {
+        value = value * 10 + ( uint64_t ) ( *cursor - '0' );
+        cursor++;
+    }
+
+    if( *cursor != '\0' || cursor == text + ( negative ? 1 : 0 ) || cursor - text >= 19 )
+    {
+        return false;
+    }
+
+    *number = negative ? -( int64_t ) value : ( int64_t ) value;
+    return true;
+}
+
+static void _filter_integers(
+    struct change_batch * batch,
+    struct batch_column * column,
+    unsigned short        operation,
+    int64_t               constant
+)
+{
+    int64_t *     values   = NULL;
+    uint8_t *     selected = NULL;
+    unsigned long count    = 0;
+    unsigned long row      = 0;
+
+    values   = column->integers;
+    selected = batch->selected;
+    count    = batch->num_rows;
+
+#ifdef BATCH_AVX2
+    if( _has_avx2() )
+    {
+        row = _filter_integers_avx2( selected, values, count, operation, constant );
+    }
+#endif
+
+    switch( operation )
+    {
+        case BATCH_FILTER_EQ:
+            for( ; row < count; row++ )
+            {
+                selected[row] &= values[row] == constant;
+            }
+            break;
+        case BATCH_FILTER_NE:
+            for( ; row < count; row++ )
+            {
+                selected[row] &= values[row] != constant;
+            }
+            break;
+        case BATCH_FILTER_LT:
+            for( ; row < count; row++ )
+            {
+                selected[row] &= values[row] < constant;
+            }
+            break;
+        case BATCH_FILTER_LE:
+            for( ; row < count; row++ )
+            {
+                selected[row] &= values[row] <= constant;
+            }
+            break;
+        case BATCH_FILTER_GT:
+            for( ; row < count; row++ )
+            {
+                selected[row] &= values[row] > constant;
+            }
+            break;
+        case BATCH_FILTER_GE:
+            for( ; row < count; row++ )
+            {
+                selected[row] &= values[row] >= constant;
+            }
+            break;
+        default:
+            break;
+    }
+
+    return;
+}
+
+static void _filter_reals(
+    struct change_batch * batch,
+    struct batch_column * column,
+    unsigned short        operation,
+    double                constant
+)
+{
+    double *      values   = NULL;
+    uint8_t *     selected = NULL;
+    unsigned long count    = 0;
+    unsigned long row      = 0;
+
+    values   = column->reals;
+    selected = batch->selected;
+    count    = batch->num_rows;
+
+#ifdef BATCH_AVX2
+    if( _has_avx2() )
+    {
+        row = _filter_reals_avx2( selected, values, count, operation, constant );
+    }
+#endif
+
+    switch( operation )
+    {
+        case BATCH_FILTER_EQ:
+            for( ; row < count; row++ )
+            {
+                selected[row] &= values[row] == constant;
+            }
+            break;
+        case BATCH_FILTER_NE:
+            for( ; row < count; row++ )
+            {
+                selected[row] &= values[row] != constant;
+            }
+            break;
+        case BATCH_FILTER_LT:
+            for( ; row < count; row++ )
+            {
+                selected[row] &= values[row] < constant;
+            }
+            break;
+        case BATCH_FILTER_LE:
+            for( ; row < count; row++ )
+            {
+                selected[row] &= values[row] <= constant;
+            }
+            break;
+        case BATCH_FILTER_GT:
+            for( ; row < count; row++ )
+            {
+                selected[row] &= values[row] > constant;
+            }
+            break;
+        case BATCH_FILTER_GE:
+            for( ; row < count; row++ )
+            {
+                selected[row] &= values[row] >= constant;
+            }
+            break;
+        default:
+            break;
+    }
+
+    return;
+}
+
+#ifdef BATCH_AVX2
+// Whether the CPU has AVX2, asked once
+static bool _has_avx2( void )
+{
+    static int has_avx2 = -1;
+
+    if( has_avx2 < 0 )
+    {
+        __builtin_cpu_init();
+        has_avx2 = __builtin_cpu_supports( "avx2" ) ? 1 : 0;
+    }
+
+    return has_avx2 == 1;
+}
+
+// batch_deltas() of an integer column four rows at a time, returning the first row left
+__attribute__(( target( "avx2" ) ))
+static unsigned long _deltas_integers_avx2(
+    int64_t *     deltas,
+    int64_t *     values,
+    int64_t *     signs,
+    int64_t *     mask,
+    unsigned long count
+)
+{
+    __m256i       vector = _mm256_setzero_si256();
+    __m256i       lanes  = _mm256_setzero_si256();
+    __m256i       zero   = _mm256_setzero_si256();
+    unsigned long row    = 0;
+
+    for( ; row + 4 <= count; row += 4 )
+    {
+        lanes  = _mm256_cmpgt_epi64( zero, _mm256_loadu_si256( ( __m256i * ) ( signs + row ) ) );
+        vector = _mm256_loadu_si256( ( __m256i * ) ( values + row ) );
+        vector = _mm256_sub_epi64( _mm256_xor_si256( vector, lanes ), lanes );
+        vector = _mm256_and_si256( vector, _mm256_loadu_si256( ( __m256i * ) ( mask + row ) ) );
+        _mm256_storeu_si256( ( __m256i * ) ( deltas + row ), vector );
+    }
+
+    return row;
+}
+
+// batch_deltas() of a real column four rows at a time, flipping the sign bit where the row's sign is -1
+__attribute__(( target( "avx2" ) ))
+static unsigned long _deltas_reals_avx2(
+    double *      deltas,
+    double *      reals,
+    int64_t *     signs,
+    int64_t *     mask,
+    unsigned long count
+)
+{
+    __m256i       vector = _mm256_setzero_si256();
+    __m256i       lanes  = _mm256_setzero_si256();
+    __m256i       zero   = _mm256_setzero_si256();
+    __m256i       bit    = _mm256_set1_epi64x( INT64_MIN );
+    unsigned long row    = 0;
+
+    for( ; row + 4 <= count; row += 4 )
+    {
+        lanes  = _mm256_and_si256( _mm256_cmpgt_epi64( zero, _mm256_loadu_si256( ( __m256i * ) ( signs + row ) ) ), bit );
+        vector = _mm256_castpd_si256( _mm256_loadu_pd( reals + row ) );
+        vector = _mm256_and_si256( _mm256_xor_si256( vector, lanes ), _mm256_loadu_si256( ( __m256i * ) ( mask + row ) ) );
+        _mm256_storeu_pd( deltas + row, _mm256_castsi256_pd( vector ) );
+    }
+
+    return row;
+}
+
+// _filter_integers() four rows at a time, returning the first row left
+__attribute__(( target( "avx2" ) ))
+static unsigned long _filter_integers_avx2(
+    uint8_t *      selected,
+    int64_t *      values,
+    unsigned long  count,
+    unsigned short operation,
+    int64_t        constant
+)
+{
+    __m256i       operand = _mm256_set1_epi64x( constant );
+    __m256i       vector  = _mm256_setzero_si256();
+    __m256i       result  = _mm256_setzero_si256();
+    unsigned long row     = 0;
+    int           bits    = 0;
+    int           lane    = 0;
+
+    for( ; row + 4 <= count; row += 4 )
+    {
+        vector = _mm256_loadu_si256( ( __m256i * ) ( values + row ) );
+
+        switch( operation )
+        {
+            case BATCH_FILTER_EQ:
+            case BATCH_FILTER_NE:
+                result = _mm256_cmpeq_epi64( vector, operand );
+                break;
+            case BATCH_FILTER_GT:
+            case BATCH_FILTER_LE:
+                result = _mm256_cmpgt_epi64( vector, operand );
+                break;
+            default:
+                result = _mm256_cmpgt_epi64( operand, vector );
+                break;
+        }
+
+        bits = _mm256_movemask_pd( _mm256_castsi256_pd( result ) );
+
+        // NE, LE and GE are the complements of EQ, GT and LT
+        if( operation == BATCH_FILTER_NE || operation == BATCH_FILTER_LE || operation == BATCH_FILTER_GE )
+        {
+            bits = ~bits;
+        }
+
+        for( lane = 0; lane < 4; lane++ )
+        {
+            selected[row + lane] &= ( uint8_t ) ( ( bits >> lane ) & 1 );
+        }
+    }
+
+    return row;
+}
+
+// _filter_reals() four rows at a time, returning the first row left
+__attribute__(( target( "avx2" ) ))
+static unsigned long _filter_reals_avx2(
+    uint8_t *      selected,
+    double *       values,
+    unsigned long  count,
+    unsigned short operation,
+    double         constant
+)
+{
+    __m256d       operand = _mm256_set1_pd( constant );
+    __m256d       vector  = _mm256_setzero_pd();
+    __m256d       result  = _mm256_setzero_pd();
+    unsigned long row     = 0;
+    int           bits    = 0;
+    int           lane    = 0;
+
+    for( ; row + 4 <= count; row += 4 )
+    {
+        vector = _mm256_loadu_pd( values + row );
+
+        switch( operation )
+        {
+            case BATCH_FILTER_EQ:
+                result = _mm256_cmp_pd( vector, operand, _CMP_EQ_OQ );
+                break;
+            case BATCH_FILTER_NE:
+                result = _mm256_cmp_pd( vector, operand, _CMP_NEQ_UQ );
+                break;
+            case BATCH_FILTER_LT:
+                result = _mm256_cmp_pd( vector, operand, _CMP_LT_OQ );
+                break;
+            case BATCH_FILTER_LE:
+                result = _mm256_cmp_pd( vector, operand, _CMP_LE_OQ );
+                break;
+            case BATCH_FILTER_GT:
+                result = _mm256_cmp_pd( vector, operand, _CMP_GT_OQ );
+                break;
+            default:
+                result = _mm256_cmp_pd( vector, operand, _CMP_GE_OQ );
+                break;
+        }
+
+        bits = _mm256_movemask_pd( result );
+
+        for( lane = 0; lane < 4; lane++ )
+        {
+            selected[row + lane] &= ( uint8_t ) ( ( bits >> lane ) & 1 );
+        }
+    }
+
+    return row;
+}
+#endif
@@ -0,0 +1,86 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "util.h"
+#include "change.h"
+#include <stdint.h>
+
+#define DEFAULT_BATCH_ROWS 1024
+
+// Type OIDs of the binary values numbers are read from
+#define INT2_OID 21
+#define INT4_OID 23
+#define INT8_OID 20
+#define FLOAT4_OID 700
+#define FLOAT8_OID 701
+
+// How a batch_column holds its values
+#define BATCH_COLUMN_VALUE 0
+#define BATCH_COLUMN_INTEGER 1
+#define BATCH_COLUMN_REAL 2
+
+// Comparisons of a column to a constant, for batch_filter()
+#define BATCH_FILTER_EQ 1
+#define BATCH_FILTER_NE 2
+#define BATCH_FILTER_LT 3
+#define BATCH_FILTER_LE 4
+#define BATCH_FILTER_GT 5
+#define BATCH_FILTER_GE 6
+
+// Key hashes are FNV-1a of each value, combined across columns the same way
+#define BATCH_HASH_SEED 14695981039346656037UL
+#define BATCH_HASH_PRIME 1099511628211UL
+#define BATCH_HASH_NULL 0x9e3779b97f4a7c15UL
+
+/*
+ * One column of a change_batch. values and lengths point at each row's value
+ * as the decoder left it in its tuple, and types holds the type OID of those
+ * it left binary (InvalidOid otherwise); columns of BATCH_COLUMN_INTEGER and
+ * BATCH_COLUMN_REAL also have it read into integers or reals. Bit r of nulls
+ * is set when row r is NULL, in which case its number is 0.
+ */
+struct batch_column {
+    char *       name;
+    unsigned int kind;
+    int          last_index;
+    uint64_t *   nulls;
+    char **      values;
+    int *        lengths;
+    Oid *        types;
+    int64_t *    integers;
+    double *     reals;
+};
+
+/*
+ * Rows of decoded changes to one relation, held column by column so that
+ * hashing, filtering and delta computation run as one loop per column over
+ * contiguous arrays rather than one call per row. sign is +1 for a row a
+ * change added and -1 for one it removed. selected starts out 1 for each row
+ * and is cleared by batch_filter(). The delta_* arrays receive each row's
+ * contribution to an aggregate from batch_deltas().
+ */
+struct change_batch {
+    unsigned long         num_rows;
+    unsigned long         max_rows;
+    unsigned int          num_columns;
+    struct batch_column * columns;
+    int64_t *             signs;
+    uint8_t *             selected;
+    uint64_t *            hashes;
+    int64_t *             delta_rows;
+    int64_t *             delta_integers;
+    double *              delta_reals;
+};
+
+extern struct change_batch * new_change_batch( unsigned int, unsigned long );
+extern void free_change_batch( struct change_batch * );
+extern bool set_batch_column( struct change_batch *, unsigned int, char *, unsigned int );
+extern void reset_change_batch( struct change_batch * );
+extern bool batch_append_tuple( struct change_batch *, struct tuple *, int64_t );
+extern void batch_hash_keys( struct change_batch *, unsigned int *, unsigned int );
+extern void batch_filter( struct change_batch *, unsigned int, unsigned short, int64_t, double );
+extern void batch_deltas( struct change_batch *, int );
+extern uint64_t hash_value( char *, int );
+extern bool read_tuple_number( struct tuple *, unsigned int, bool, int64_t *, double * );
+
+#endif // BATCH_H
@@ -0,0 +1,82 @@
+#include "batch_controller.h"
+
+unsigned long batch_target_ms = DEFAULT_BATCH_TARGET_MS;
+
+// Starts controller afresh for objects whose tightest freshness target is freshness_ms, 0 for none
+void reset_batch_controller( struct batch_controller * controller, uint64_t freshness_ms )
+{
+    controller->target_ms = batch_target_ms;
+
+    if( batch_target_ms > 0 && freshness_ms > 0 && freshness_ms < batch_target_ms )
+    {
+        controller->target_ms = ( unsigned long ) freshness_ms;
+    }
+
+    controller->rows     = BATCH_CONTROLLER_START_ROWS;
+    controller->flush_ms = controller->target_ms;
+    controller->apply_ms = 0.0;
+    return;
+}
+
+/*
+ * Whether a batch of changes committed changes, the first of which has
+ * waited waited_ms, is to be applied, with backlog bytes queued behind it
+ */
+bool batch_due(
+    struct batch_controller * controller,
+    unsigned long             changes,
+    unsigned long             waited_ms,
+    size_t                    backlog
+)
+{
+    return controller->target_ms == 0
+        || backlog == 0
+        || changes >= controller->rows
+        || waited_ms >= controller->flush_ms;
+}
+
+// Adjusts the controller to a batch of changes that took apply_us to apply, with backlog bytes queued behind it
+void batch_applied(
+    struct batch_controller * controller,
+    unsigned long             changes,
+    uint64_t                  apply_us,
+    size_t                    backlog
+)
+{
+    double apply_ms = 0.0;
+
+    if( controller->target_ms == 0 )
+    {
+        return;
+    }
+
+    apply_ms = ( double ) apply_us / 1000.0;
+
+    controller->apply_ms = controller->apply_ms == 0.0
+                         ? apply_ms
+                         : controller->apply_ms + BATCH_CONTROLLER_SMOOTHING * ( apply_ms - controller->apply_ms );
+
+    if( apply_ms > ( double ) controller->target_ms )
+    {
+        controller->rows /= 2;
+
+        if( controller->rows < BATCH_CONTROLLER_MIN_ROWS )
+        {
+            controller->rows = BATCH_CONTROLLER_MIN_ROWS;
+        }
+    }
+    else if( backlog > 0 && changes >= controller->rows )
+    {
+        controller->rows += BATCH_CONTROLLER_ROWS_STEP;
+
+        if( controller->rows > BATCH_CONTROLLER_MAX_ROWS )
+        {
+            controller->rows = BATCH_CONTROLLER_MAX_ROWS;
+        }
+    }
+
+    controller->flush_ms = controller->apply_ms < ( double ) controller->target_ms
+                         ? ( unsigned long ) ( ( double ) controller->target_ms - controller->apply_ms )
+                         : 0;
+    return;
+}
@@ -0,0 +1,49 @@
+#ifndef BATCH_CONTROLLER_H
+#define BATCH_CONTROLLER_H
+
+#include "util.h"
+#include <stdint.h>
+
+// Milliseconds a batch should take to apply, 0 to apply each transaction on its own
+#define DEFAULT_BATCH_TARGET_MS 100
+
+// Bounds of the changes a batch is applied at, where it starts, and how far it grows at a time
+#define BATCH_CONTROLLER_MIN_ROWS 16
+#define BATCH_CONTROLLER_MAX_ROWS 65536
+#define BATCH_CONTROLLER_START_ROWS 256
+#define BATCH_CONTROLLER_ROWS_STEP 64
+
+// Weight of the latest batch in the running average of apply time
+#define BATCH_CONTROLLER_SMOOTHING 0.25
+
+extern unsigned long batch_target_ms;
+
+/*
+ * Paces the batches a member applies to its location, from how long they
+ * take to apply and how much is queued behind them. A batch is applied once
+ * nothing more is queued, so that a member that keeps up applies each
+ * transaction as it arrives, or once it holds rows changes, or once its
+ * first transaction has waited flush_ms.
+ *
+ * target_ms is batch_target_ms, or the tightest freshness target of the
+ * objects batches are applied to if that is shorter, so that they are not
+ * held up by batches sized for objects that can afford to wait.
+ *
+ * rows is tuned AIMD: halved whenever a batch takes longer than target_ms
+ * to apply, and grown by BATCH_CONTROLLER_ROWS_STEP when a batch filled up
+ * with more queued behind it and still applied in time. flush_ms is what
+ * of target_ms the running average of apply time, apply_ms, leaves for a
+ * transaction to wait in a batch.
+ */
+struct batch_controller {
+    unsigned long target_ms;
+    unsigned long rows;
+    unsigned long flush_ms;
+    double        apply_ms;
+};
+
+extern void reset_batch_controller( struct batch_controller *, uint64_t );
+extern bool batch_due( struct batch_controller *, unsigned long, unsigned long, size_t );
+extern void batch_applied( struct batch_controller *, unsigned long, uint64_t, size_t );
+
+#endif // BATCH_CONTROLLER_H
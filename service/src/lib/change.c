@@ -0,0 +1,1009 @@
+#include "change.h"
+
+// Whether the decoder is asked to emit values in binary send format
+bool binary_values = false;
+
+static void _json_skip_whitespace( char ** );
+static char * _json_parse_string( char ** );
+static char * _json_parse_scalar( char **, bool * );
+static bool _json_skip_value( char ** );
+static struct tuple * _json_parse_tuple( char ** );
+static bool _tuple_append( struct tuple *, char *, char * );
+static bool _tuple_decode_binary( struct tuple *, struct tuple * );
+static unsigned int _hex_value( char );
+static char * _copy_value( struct tuple *, unsigned int );
+
+struct change * new_change( unsigned short type )
+{
+    struct change * change = NULL;
+
+    change = ( struct change * ) calloc( 1, sizeof( struct change ) );
+
+    if( change == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for change"
+        );
+
+        return NULL;
+    }
+
+    change->type = type;
+    return change;
+}
+
+void free_change( struct change * change )
+{
+    if( change == NULL )
+    {
+        return;
+    }
+
+    free( change->timestamp );
+    free( change->schema_name );
+    free( change->table_name );
+    free( change->key_text );
+    free_tuple( change->key );
+    free_tuple( change->new_tuple );
+    free_tuple( change->old_tuple );
+    free( change );
+    return;
+}
+
+struct change * copy_change( struct change * change )
+{
+    struct change * result = NULL;
+
+    if( change == NULL )
+    {
+        return NULL;
+    }
+
+    result = new_change( change->type );
+
+    if( result == NULL )
+    {
+        return NULL;
+    }
+
+    result->xid         = change->xid;
+    result->lsn         = change->lsn;
+    result->timestamp   = change->timestamp != NULL ? strdup( change->timestamp ) : NULL;
+    result->commit_time = change->commit_time;
+    result->schema_name = change->schema_name != NULL ? strdup( change->schema_name ) : NULL;
+    result->table_name  = change->table_name != NULL ? strdup( change->table_name ) : NULL;
+    result->key_text    = change->key_text != NULL ? strdup( change->key_text ) : NULL;
+    result->key         = copy_tuple( change->key );
+    result->new_tuple   = copy_tuple( change->new_tuple );
+    result->old_tuple   = copy_tuple( change->old_tuple );
+
+    if(
+            ( change->timestamp != NULL && result->timestamp == NULL )
+         || ( change->schema_name != NULL && result->schema_name == NULL )
+         || ( change->table_name != NULL && result->table_name == NULL )
+         || ( change->key_text != NULL && result->key_text == NULL )
+         || ( change->key != NULL && result->key == NULL )
+         || ( change->new_tuple != NULL && result->new_tuple == NULL )
+         || ( change->old_tuple != NULL && result->old_tuple == NULL )
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for copy of change"
+        );
+
+        free_change( result );
+        return NULL;
+    }
+
+    return result;
+}
+
+struct tuple * new_tuple( unsigned int size )
+{
+    struct tuple * tuple = NULL;
+
+    tuple = ( struct tuple * ) calloc( 1, sizeof( struct tuple ) );
+
+    if( tuple == NULL )
+    {
+        return NULL;
+    }
+
+    if( size == 0 )
+    {
+        return tuple;
+    }
+
+    tuple->names  = ( char ** ) calloc( size, sizeof( char * ) );
+    tuple->values = ( char ** ) calloc( size, sizeof( char * ) );
+
+    if( tuple->names == NULL || tuple->values == NULL )
+    {
+        free( tuple->names );
+        free( tuple->values );
+        free( tuple );
+        return NULL;
+    }
+
+    return tuple;
+}
+
+struct tuple * copy_tuple( struct tuple * tuple )
+{
+    struct tuple * result = NULL;
+    unsigned int   i      = 0;
+
+    if( tuple == NULL )
+    {
+        return NULL;
+    }
+
+    result = new_tuple( tuple->num_columns );
+
+    if( result == NULL )
+    {
+        return NULL;
+    }
+
+    if( tuple->lengths != NULL )
+    {
+        result->lengths = ( int * ) calloc( tuple->num_columns + 1, sizeof( int ) );
+        result->types   = ( Oid * ) calloc( tuple->num_columns + 1, sizeof( Oid ) );
+
+        if( result->lengths == NULL || result->types == NULL )
+        {
+            free_tuple( result );
+            return NULL;
+        }
+
+        memcpy( result->lengths, tuple->lengths, sizeof( int ) * tuple->num_columns );
+        memcpy( result->types, tuple->types, sizeof( Oid ) * tuple->num_columns );
+    }
+
+    for( i = 0; i < tuple->num_columns; i++ )
+    {
+        result->names[i]  = strdup( tuple->names[i] );
+        result->values[i] = _copy_value( tuple, i );
+        result->num_columns++;
+    }
+
+    return result;
+}
+
+/*
+ * A new tuple holding the columns named in columns, with their values taken
+ * from source. Columns missing from source are NULL.
+ */
+struct tuple * project_tuple( struct tuple * source, struct tuple * columns )
+{
+    struct tuple * result = NULL;
+    unsigned int   i      = 0;
+    int            index  = 0;
+
+    if( source == NULL || columns == NULL )
+    {
+        return NULL;
+    }
+
+    result = new_tuple( columns->num_columns );
+
+    if( result == NULL )
+    {
+        return NULL;
+    }
+
+    if( source->lengths != NULL )
+    {
+        result->lengths = ( int * ) calloc( columns->num_columns + 1, sizeof( int ) );
+        result->types   = ( Oid * ) calloc( columns->num_columns + 1, sizeof( Oid ) );
+
+        if( result->lengths == NULL || result->types == NULL )
+        {
+            free_tuple( result );
+            return NULL;
+        }
+    }
+
+    for( i = 0; i < columns->num_columns; i++ )
+    {
+        index = find_tuple_column( source, columns->names[i] );
+
+        result->names[i] = strdup( columns->names[i] );
+
+        if( index >= 0 )
+        {
+            result->values[i] = _copy_value( source, ( unsigned int ) index );
+
+            if( source->lengths != NULL )
+            {
+                result->lengths[i] = source->lengths[index];
+                result->types[i]   = source->types[index];
+            }
+        }
+
+        result->num_columns++;
+    }
+
+    return result;
+}
+
+void free_tuple( struct tuple * tuple )
+{
+    unsigned int i = 0;
+
+    if( tuple == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < tuple->num_columns; i++ )
+    {
+        free( tuple->names[i] );
+        free( tuple->values[i] );
+    }
+
+    free( tuple->names );
+    free( tuple->values );
+    free( tuple->lengths );
+    free( tuple->types );
+    free( tuple );
+    return;
+}
+
+char * get_tuple_value( struct tuple * tuple, char * name, bool * found )
+{
+    unsigned int i = 0;
+
+    if( found != NULL )
+    {
+        *found = false;
+    }
+
+    if( tuple == NULL || name == NULL )
+    {
+        return NULL;
+    }
+
+    for( i = 0; i < tuple->num_columns; i++ )
+    {
+        if( strcmp( tuple->names[i], name ) == 0 )
+        {
+            if( found != NULL )
+            {
+                *found = true;
+            }
+
+            return tuple->values[i];
+        }
+    }
+
+    return NULL;
+}
+
+int find_tuple_column( struct tuple * tuple, char * name )
+{
+    unsigned int i = 0;
+
+    if( tuple == NULL || name == NULL )
+    {
+        return -1;
+    }
+
+    for( i = 0; i < tuple->num_columns; i++ )
+    {
+        if( strcmp( tuple->names[i], name ) == 0 )
+        {
+            return ( int ) i;
+        }
+    }
+
+    return -1;
+}
+
+// Compares two values, either of which may be NULL, text or binary
+bool tuple_value_equals(
+    struct tuple * a,
+    unsigned int   i,
+    struct tuple * b,
+    unsigned int   j
+)
+{
+    if( a->values[i] == NULL || b->values[j] == NULL )
+    {
+        return a->values[i] == b->values[j];
+    }
+
+    if( a->lengths != NULL && b->lengths != NULL )
+    {
+        return a->lengths[i] == b->lengths[j]
+            && memcmp( a->values[i], b->values[j], a->lengths[i] ) == 0;
+    }
+
+    if( a->lengths != NULL || b->lengths != NULL )
+    {
+        return false;
+    }
+
+    return strcmp( a->values[i], b->values[j] ) == 0;
+}
+
+/*
+ * Parses a single record emitted by pg_ctblmgr_decoder. The decoder's output
+ * is a restricted form of JSON: a flat top-level object whose "key" member is
+ * a flat object, and whose "data" member contains up to two flat objects,
+ * "new" and "old". With binary_values the record also carries a "types"
+ * object and each value is hex encoded send output, which is decoded here.
+ * lsn is the WAL position the record was received at.
+ */
+struct change * parse_change( char * record, uint64_t lsn )
+{
+    struct change * change     = NULL;
+    char *          cursor     = NULL;
+    char *          field      = NULL;
+    char *          value      = NULL;
+    char *          key_start  = NULL;
+    char *          data_field = NULL;
+    struct tuple *  types      = NULL;
+    bool            is_null    = false;
+
+    if( record == NULL )
+    {
+        return NULL;
+    }
+
+    change = new_change( CHANGE_TYPE_NONE );
+
+    if( change == NULL )
+    {
+        return NULL;
+    }
+
+    change->lsn = lsn;
+    cursor      = record;
+
+    _json_skip_whitespace( &cursor );
+
+    if( *cursor != '{' )
+    {
+        goto parse_error;
+    }
+
+    cursor++;
+
+    while( true )
+    {
+        _json_skip_whitespace( &cursor );
+
+        if( *cursor == '}' )
+        {
+            break;
+        }
+
+        field = _json_parse_string( &cursor );
+
+        if( field == NULL )
+        {
+            goto parse_error;
+        }
+
+        _json_skip_whitespace( &cursor );
+
+        if( *cursor != ':' )
+        {
+            goto parse_error;
+        }
+
+        cursor++;
+        _json_skip_whitespace( &cursor );
+
+        if( strcmp( field, "key" ) == 0 )
+        {
+            key_start   = cursor;
+            change->key = _json_parse_tuple( &cursor );
+
+            if( change->key == NULL )
+            {
+                goto parse_error;
+            }
+
+            change->key_text = strndup( key_start, cursor - key_start );
+        }
+        else if( strcmp( field, "types" ) == 0 )
+        {
+            types = _json_parse_tuple( &cursor );
+
+            if( types == NULL )
+            {
+                goto parse_error;
+            }
+        }
+        else if( strcmp( field, "data" ) == 0 )
+        {
+            if( *cursor != '{' )
+            {
+                goto parse_error;
+            }
+
+            cursor++;
+
+            while( true )
+            {
+                _json_skip_whitespace( &cursor );
+
+                if( *cursor == '}' )
+                {
+                    cursor++;
+                    break;
+                }
+
+                data_field = _json_parse_string( &cursor );
+
+                if( data_field == NULL )
+                {
+                    goto parse_error;
+                }
+
+                _json_skip_whitespace( &cursor );
+
+                if( *cursor != ':' )
+                {
+                    free( data_field );
+                    goto parse_error;
+                }
+
+                cursor++;
+                _json_skip_whitespace( &cursor );
+
+                if( strcmp( data_field, "new" ) == 0 )
+                {
+                    change->new_tuple = _json_parse_tuple( &cursor );
+                }
+                else if( strcmp( data_field, "old" ) == 0 )
+                {
+                    change->old_tuple = _json_parse_tuple( &cursor );
+                }
+                else if( !_json_skip_value( &cursor ) )
+                {
+                    free( data_field );
+                    goto parse_error;
+                }
+
+                free( data_field );
+                data_field = NULL;
+                _json_skip_whitespace( &cursor );
+
+                if( *cursor == ',' )
+                {
+                    cursor++;
+                }
+            }
+        }
+        else
+        {
+            value = _json_parse_scalar( &cursor, &is_null );
+
+            if( value == NULL && !is_null )
+            {
+                goto parse_error;
+            }
+
+            if( strcmp( field, "type" ) == 0 && value != NULL )
+            {
+                if(      strcmp( value, "INSERT" ) == 0 ) { change->type = CHANGE_TYPE_INSERT; }
+                else if( strcmp( value, "UPDATE" ) == 0 ) { change->type = CHANGE_TYPE_UPDATE; }
+                else if( strcmp( value, "DELETE" ) == 0 ) { change->type = CHANGE_TYPE_DELETE; }
+                else if( strcmp( value, "BEGIN"  ) == 0 ) { change->type = CHANGE_TYPE_BEGIN;  }
+                else if( strcmp( value, "COMMIT" ) == 0 ) { change->type = CHANGE_TYPE_COMMIT; }
+
+                free( value );
+            }
+            else if( strcmp( field, "xid" ) == 0 && value != NULL )
+            {
+                change->xid = ( unsigned int ) strtoul( value, NULL, 10 );
+                free( value );
+            }
+            else if( strcmp( field, "timestamp" ) == 0 )
+            {
+                change->timestamp = value;
+            }
+            else if( strcmp( field, "commit_time" ) == 0 && value != NULL )
+            {
+                change->commit_time = strtoll( value, NULL, 10 );
+                free( value );
+            }
+            else if( strcmp( field, "schema_name" ) == 0 )
+            {
+                change->schema_name = value;
+            }
+            else if( strcmp( field, "table_name" ) == 0 )
+            {
+                change->table_name = value;
+            }
+            else
+            {
+                free( value );
+            }
+
+            value = NULL;
+        }
+
+        free( field );
+        field = NULL;
+
+        _json_skip_whitespace( &cursor );
+
+        if( *cursor == ',' )
+        {
+            cursor++;
+        }
+        else if( *cursor != '}' )
+        {
+            goto parse_error;
+        }
+    }
+
+    if( change->type == CHANGE_TYPE_NONE )
+    {
+        goto parse_error;
+    }
+
+    // Values are hex encoded send output when the record carries types
+    if(
+            types != NULL
+         && (
+                !_tuple_decode_binary( change->key, types )
+             || !_tuple_decode_binary( change->new_tuple, types )
+             || !_tuple_decode_binary( change->old_tuple, types )
+            )
+      )
+    {
+        goto parse_error;
+    }
+
+    free_tuple( types );
+    return change;
+
+parse_error:
+    _log(
+        LOG_LEVEL_ERROR,
+        "Failed to parse decoder record at offset %ld: '%s'",
+        ( long ) ( cursor - record ),
+        record
+    );
+
+    free( field );
+    free_tuple( types );
+    free_change( change );
+    return NULL;
+}
+
+/*
+ * Whether record is a COMMIT, without parsing it. The decoder writes
+ * transaction boundaries with their type first and without whitespace.
+ */
+bool is_commit_record( char * record )
+{
+    return record != NULL && strncmp( record, COMMIT_RECORD_PREFIX, strlen( COMMIT_RECORD_PREFIX ) ) == 0;
+}
+
+static void _json_skip_whitespace( char ** cursor )
+{
+    while(
+            **cursor == ' '
+         || **cursor == '\t'
+         || **cursor == '\n'
+         || **cursor == '\r'
+         )
+    {
+        ( *cursor )++;
+    }
+
+    return;
+}
+
+static char * _json_parse_string( char ** cursor )
+{
+    char *       result    = NULL;
+    char *       start     = NULL;
+    unsigned int length    = 0;
+    unsigned int code      = 0;
+
+    if( **cursor != '"' )
+    {
+        return NULL;
+    }
+
+    ( *cursor )++;
+    start = *cursor;
+
+    // The unescaped string is never longer than the escaped one
+    while( **cursor != '"' && **cursor != '\0' )
+    {
+        if( **cursor == '\\' && *( *cursor + 1 ) != '\0' )
+        {
+            ( *cursor )++;
+        }
+
+        ( *cursor )++;
+    }
+
+    if( **cursor != '"' )
+    {
+        return NULL;
+    }
+
+    result = ( char * ) calloc( sizeof( char ), ( *cursor - start ) + 1 );
+
+    if( result == NULL )
+    {
+        return NULL;
+    }
+
+    *cursor = start;
+
+    while( **cursor != '"' )
+    {
+        if( **cursor != '\\' )
+        {
+            result[length++] = **cursor;
+            ( *cursor )++;
+            continue;
+        }
+
+        ( *cursor )++;
+
+        switch( **cursor )
+        {
+            case 'n':
+                result[length++] = '\n';
+                break;
+            case 'r':
+                result[length++] = '\r';
+                break;
+            case 't':
+                result[length++] = '\t';
+                break;
+            case 'b':
+                result[length++] = '\b';
+                break;
+            case 'f':
+                result[length++] = '\f';
+                break;
+            case 'u':
+                // Only the single byte range is emitted by the decoder
+                if( sscanf( *cursor + 1, "%4x", &code ) == 1 && code < 0x80 )
+                {
+                    result[length++] = ( char ) code;
+                    *cursor += 4;
+                }
+                else
+                {
+                    result[length++] = 'u';
+                }
+
+                break;
+            default:
+                result[length++] = **cursor;
+                break;
+        }
+
+        ( *cursor )++;
+    }
+
+    ( *cursor )++;
+    return result;
+}
+
+static char * _json_parse_scalar( char ** cursor, bool * is_null )
+{
+    char * start = NULL;
+
+    *is_null = false;
+
+    if( **cursor == '"' )
+    {
+        return _json_parse_string( cursor );
+    }
+
+    start = *cursor;
+
+    while(
+            **cursor != ','
+         && **cursor != '}'
+         && **cursor != ']'
+         && **cursor != ' '
+         && **cursor != '\0'
+         )
+    {
+        ( *cursor )++;
+    }
+
+    if( *cursor == start )
+    {
+        return NULL;
+    }
+
+    if( ( *cursor - start ) == 4 && strncmp( start, "null", 4 ) == 0 )
+    {
+        *is_null = true;
+        return NULL;
+    }
+
+    return strndup( start, *cursor - start );
+}
+
+static bool _json_skip_value( char ** cursor )
+{
+    unsigned int depth  = 0;
+    char *       string = NULL;
+    bool         ignore = false;
+
+    do
+    {
+        _json_skip_whitespace( cursor );
+
+        if( **cursor == '"' )
+        {
+            string = _json_parse_string( cursor );
+
+            if( string == NULL )
+            {
+                return false;
+            }
+
+            free( string );
+        }
+        else if( **cursor == '{' || **cursor == '[' )
+        {
+            depth++;
+            ( *cursor )++;
+        }
+        else if( **cursor == '}' || **cursor == ']' )
+        {
+            if( depth == 0 )
+            {
+                return false;
+            }
+
+            depth--;
+            ( *cursor )++;
+        }
+        else if( **cursor == ',' || **cursor == ':' )
+        {
+            ( *cursor )++;
+        }
+        else if( **cursor == '\0' )
+        {
+            return false;
+        }
+        else
+        {
+            free( _json_parse_scalar( cursor, &ignore ) );
+        }
+    } while( depth > 0 );
+
+    return true;
+}
+
+static struct tuple * _json_parse_tuple( char ** cursor )
+{
+    struct tuple * tuple   = NULL;
+    char *         name    = NULL;
+    char *         value   = NULL;
+    bool           is_null = false;
+
+    if( **cursor != '{' )
+    {
+        return NULL;
+    }
+
+    tuple = new_tuple( 0 );
+
+    if( tuple == NULL )
+    {
+        return NULL;
+    }
+
+    ( *cursor )++;
+
+    while( true )
+    {
+        _json_skip_whitespace( cursor );
+
+        if( **cursor == '}' )
+        {
+            ( *cursor )++;
+            return tuple;
+        }
+
+        name = _json_parse_string( cursor );
+
+        if( name == NULL )
+        {
+            break;
+        }
+
+        _json_skip_whitespace( cursor );
+
+        if( **cursor != ':' )
+        {
+            free( name );
+            break;
+        }
+
+        ( *cursor )++;
+        _json_skip_whitespace( cursor );
+
+        value = _json_parse_scalar( cursor, &is_null );
+
+        if( ( value == NULL && !is_null ) || !_tuple_append( tuple, name, value ) )
+        {
+            free( name );
+            free( value );
+            break;
+        }
+
+        _json_skip_whitespace( cursor );
+
+        // Tolerate the trailing comma left behind by dropped columns
+        if( **cursor == ',' )
+        {
+            ( *cursor )++;
+        }
+    }
+
+    free_tuple( tuple );
+    return NULL;
+}
+
+static bool _tuple_append( struct tuple * tuple, char * name, char * value )
+{
+    char ** names  = NULL;
+    char ** values = NULL;
+
+    names = ( char ** ) realloc(
+        tuple->names,
+        sizeof( char * ) * ( tuple->num_columns + 1 )
+    );
+
+    if( names == NULL )
+    {
+        return false;
+    }
+
+    tuple->names = names;
+
+    values = ( char ** ) realloc(
+        tuple->values,
+        sizeof( char * ) * ( tuple->num_columns + 1 )
+    );
+
+    if( values == NULL )
+    {
+        return false;
+    }
+
+    tuple->values = values;
+
+    tuple->names[tuple->num_columns]  = name;
+    tuple->values[tuple->num_columns] = value;
+    tuple->num_columns++;
+
+    return true;
+}
+
+/*
+ * Decodes tuple's hex encoded values in place, and records the type of each
+ * value from types, the record's column name to type OID mapping.
+ */
+static bool _tuple_decode_binary( struct tuple * tuple, struct tuple * types )
+{
+    unsigned int i         = 0;
+    unsigned int j         = 0;
+    unsigned int high      = 0;
+    unsigned int low       = 0;
+    size_t       length    = 0;
+    char *       type      = NULL;
+    char *       value     = NULL;
+
+    if( tuple == NULL )
+    {
+        return true;
+    }
+
+    tuple->lengths = ( int * ) calloc( tuple->num_columns + 1, sizeof( int ) );
+    tuple->types   = ( Oid * ) calloc( tuple->num_columns + 1, sizeof( Oid ) );
+
+    if( tuple->lengths == NULL || tuple->types == NULL )
+    {
+        return false;
+    }
+
+    for( i = 0; i < tuple->num_columns; i++ )
+    {
+        type = get_tuple_value( types, tuple->names[i], NULL );
+
+        if( type != NULL )
+        {
+            tuple->types[i] = ( Oid ) strtoul( type, NULL, 10 );
+        }
+
+        value = tuple->values[i];
+
+        if( value == NULL )
+        {
+            continue;
+        }
+
+        length = strlen( value );
+
+        if( length % 2 != 0 )
+        {
+            return false;
+        }
+
+        for( j = 0; j < length / 2; j++ )
+        {
+            high = _hex_value( value[j * 2] );
+            low  = _hex_value( value[( j * 2 ) + 1] );
+
+            if( high > 0x0f || low > 0x0f )
+            {
+                return false;
+            }
+
+            value[j] = ( char ) ( ( high << 4 ) | low );
+        }
+
+        tuple->lengths[i] = ( int ) ( length / 2 );
+    }
+
+    return true;
+}
+
+static unsigned int _hex_value( char character )
+{
+    if( character >= '0' && character <= '9' )
+    {
+        return ( unsigned int ) ( character - '0' );
+    }
+
+    if( character >= 'a' && character <= 'f' )
+    {
+        return ( unsigned int ) ( character - 'a' + 10 );
+    }
+
+    if( character >= 'A' && character <= 'F' )
+    {
+        return ( unsigned int ) ( character - 'A' + 10 );
+    }
+
+    return 0xff;
+}
+
+static char * _copy_value( struct tuple * tuple, unsigned int i )
+{
+    char * result = NULL;
+
+    if( tuple->values[i] == NULL )
+    {
+        return NULL;
+    }
+
+    if( tuple->lengths == NULL )
+    {
+        return strdup( tuple->values[i] );
+    }
+
+    result = ( char * ) malloc( tuple->lengths[i] + 1 );
+
+    if( result != NULL )
+    {
+        memcpy( result, tuple->values[i], tuple->lengths[i] );
+        result[tuple->lengths[i]] = '\0';
+    }
+
+    return result;
+}
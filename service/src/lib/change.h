@@ -0,0 +1,68 @@
+#ifndef CHANGE_H
+#define CHANGE_H
+
+#include "util.h"
+#include <stdint.h>
+
+#define CHANGE_TYPE_NONE 0
+#define CHANGE_TYPE_INSERT 1
+#define CHANGE_TYPE_UPDATE 2
+#define CHANGE_TYPE_DELETE 3
+#define CHANGE_TYPE_BEGIN 4
+#define CHANGE_TYPE_COMMIT 5
+
+// How the decoder's COMMIT records start, see transaction_boundary
+#define COMMIT_RECORD_PREFIX "{\"type\":\"COMMIT\""
+
+/*
+ * A flat set of column name / value pairs as emitted by the decoder for the
+ * "key", "new" and "old" objects. A NULL entry in values represents an SQL
+ * NULL. When the decoder runs with binary_values, lengths and types are set
+ * and each value holds lengths[i] bytes of the type's send format rather than
+ * a NUL terminated string.
+ */
+struct tuple {
+    unsigned int num_columns;
+    char **      names;
+    char **      values;
+    int *        lengths;
+    Oid *        types;
+};
+
+/*
+ * One decoded record from pg_ctblmgr_decoder. key holds the replica identity
+ * columns in index order, key_text the raw JSON they were parsed from.
+ * commit_time is that of BEGIN and COMMIT records, in microseconds since
+ * 2000-01-01, or 0 if the decoder does not give it.
+ */
+struct change {
+    unsigned short type;
+    unsigned int   xid;
+    uint64_t       lsn;
+    char *         timestamp;
+    int64_t        commit_time;
+    char *         schema_name;
+    char *         table_name;
+    char *         key_text;
+    struct tuple * key;
+    struct tuple * new_tuple;
+    struct tuple * old_tuple;
+};
+
+extern struct change * parse_change( char *, uint64_t );
+extern bool is_commit_record( char * );
+extern struct change * new_change( unsigned short );
+extern struct change * copy_change( struct change * );
+extern void free_change( struct change * );
+
+extern struct tuple * new_tuple( unsigned int );
+extern struct tuple * copy_tuple( struct tuple * );
+extern void free_tuple( struct tuple * );
+extern char * get_tuple_value( struct tuple *, char *, bool * );
+extern int find_tuple_column( struct tuple *, char * );
+extern bool tuple_value_equals( struct tuple *, unsigned int, struct tuple *, unsigned int );
+extern struct tuple * project_tuple( struct tuple *, struct tuple * );
+
+extern bool binary_values;
+
+#endif // CHANGE_H
@@ -0,0 +1,618 @@
+#include "coalesce.h"
+
+unsigned long coalesce_window_changes = DEFAULT_COALESCE_WINDOW_CHANGES;
+unsigned long coalesce_window_ms      = DEFAULT_COALESCE_WINDOW_MS;
+
+static unsigned long _hash_change( struct change * );
+static bool _same_row( struct change *, struct change * );
+static bool _key_changed( struct change * );
+static struct change * _split_key_change( struct change * );
+static void _merge_change( struct coalesce_table *, struct change *, struct change * );
+static bool _insert_entry( struct coalesce_table *, unsigned long, struct change * );
+static bool _resize_buckets( struct coalesce_table *, unsigned long );
+static void _reset_table( struct coalesce_table * );
+
+struct coalesce_table * new_coalesce_table( unsigned long num_buckets )
+{
+    struct coalesce_table * table = NULL;
+    unsigned long           size  = 1;
+
+    // Round up to a power of two so the hash can be masked
+    while( size < num_buckets )
+    {
+        size <<= 1;
+    }
+
+    table = ( struct coalesce_table * ) calloc(
+        1,
+        sizeof( struct coalesce_table )
+    );
+
+    if( table == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate coalesce table"
+        );
+
+        return NULL;
+    }
+
+    table->num_buckets = size;
+    table->min_buckets = size;
+    table->buckets     = ( struct coalesce_entry ** ) calloc(
+        size,
+        sizeof( struct coalesce_entry * )
+    );
+    table->order_size  = DEFAULT_BUFFER_SIZE;
+    table->order       = ( struct coalesce_entry ** ) calloc(
+        table->order_size,
+        sizeof( struct coalesce_entry * )
+    );
+
+    if( table->buckets == NULL || table->order == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate coalesce table buckets"
+        );
+
+        free( table->buckets );
+        free( table->order );
+        free( table );
+        return NULL;
+    }
+
+    gettimeofday( &( table->window_start ), NULL );
+    return table;
+}
+
+void free_coalesce_table( struct coalesce_table * table )
+{
+    unsigned long i = 0;
+
+    if( table == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < table->num_entries; i++ )
+    {
+        free_change( table->order[i]->change );
+        free( table->order[i] );
+    }
+
+    free( table->buckets );
+    free( table->order );
+    free( table );
+    return;
+}
+
+/*
+ * Absorbs change into the table, taking ownership of it. The net effect of two
+ * changes to the same row is:
+ *
+ *   INSERT + UPDATE -> INSERT of the newest tuple
+ *   INSERT + DELETE -> nothing, or DELETE if the table has keep_deletes set
+ *   UPDATE + UPDATE -> UPDATE from the oldest old tuple to the newest new tuple
+ *   UPDATE + DELETE -> DELETE
+ *   DELETE + INSERT -> UPDATE
+ *
+ * An UPDATE that changes the key is split into a DELETE of the old key and an
+ * INSERT of the new key first, as those are two different rows downstream.
+ */
+bool coalesce_change( struct coalesce_table * table, struct change * change )
+{
+    struct coalesce_entry * entry = NULL;
+    struct change *         split = NULL;
+    unsigned long           hash  = 0;
+
+    if( table == NULL || change == NULL )
+    {
+        return false;
+    }
+
+    if(
+            change->type != CHANGE_TYPE_INSERT
+         && change->type != CHANGE_TYPE_UPDATE
+         && change->type != CHANGE_TYPE_DELETE
+      )
+    {
+        // Transaction boundaries are not row changes
+        free_change( change );
+        return true;
+    }
+
+    if( change->schema_name == NULL || change->table_name == NULL || change->key == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Cannot coalesce a change without a relation and key"
+        );
+
+        free_change( change );
+        return false;
+    }
+
+    if( change->type == CHANGE_TYPE_UPDATE && _key_changed( change ) )
+    {
+        split = _split_key_change( change );
+
+        if( split == NULL || !coalesce_change( table, split ) )
+        {
+            free_change( change );
+            return false;
+        }
+
+        change->type = CHANGE_TYPE_INSERT;
+        free_tuple( change->old_tuple );
+        change->old_tuple = NULL;
+    }
+
+    if( table->num_changes == 0 && table->num_entries == 0 )
+    {
+        gettimeofday( &( table->window_start ), NULL );
+    }
+
+    table->num_changes++;
+
+    if( change->lsn > table->max_lsn )
+    {
+        table->max_lsn = change->lsn;
+    }
+
+    hash  = _hash_change( change );
+    entry = table->buckets[hash & ( table->num_buckets - 1 )];
+
+    while( entry != NULL )
+    {
+        if( entry->hash == hash && _same_row( entry->change, change ) )
+        {
+            _merge_change( table, entry->change, change );
+            return true;
+        }
+
+        entry = entry->next;
+    }
+
+    return _insert_entry( table, hash, change );
+}
+
+// Whether the configured window, by count or by time, has been exceeded
+bool coalesce_window_elapsed( struct coalesce_table * table )
+{
+    struct timeval now     = {0};
+    unsigned long  elapsed = 0;
+
+    if( table == NULL || table->num_entries == 0 )
+    {
+        return false;
+    }
+
+    if( table->num_changes >= coalesce_window_changes )
+    {
+        return true;
+    }
+
+    gettimeofday( &now, NULL );
+    elapsed = ( unsigned long ) (
+        ( now.tv_sec - table->window_start.tv_sec ) * 1000
+      + ( now.tv_usec - table->window_start.tv_usec ) / 1000
+    );
+
+    return elapsed >= coalesce_window_ms;
+}
+
+/*
+ * Hands the net changes to the caller in arrival order and resets the table.
+ * The caller owns both the array and the changes in it. This should only be
+ * called on a transaction boundary so that no source transaction is split
+ * across two target transactions.
+ */
+bool coalesce_drain(
+    struct coalesce_table * table,
+    struct change ***       changes,
+    unsigned long *         num_changes
+)
+{
+    struct change ** result = NULL;
+    unsigned long    i      = 0;
+    unsigned long    count  = 0;
+
+    if( table == NULL || changes == NULL || num_changes == NULL )
+    {
+        return false;
+    }
+
+    *changes     = NULL;
+    *num_changes = 0;
+
+    if( table->num_entries == 0 )
+    {
+        _reset_table( table );
+        return true;
+    }
+
+    result = ( struct change ** ) calloc(
+        table->num_entries,
+        sizeof( struct change * )
+    );
+
+    if( result == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for coalesced changes"
+        );
+
+        return false;
+    }
+
+    for( i = 0; i < table->num_entries; i++ )
+    {
+        if( table->order[i]->change->type == CHANGE_TYPE_NONE )
+        {
+            free_change( table->order[i]->change );
+        }
+        else
+        {
+            result[count++] = table->order[i]->change;
+        }
+
+        free( table->order[i] );
+    }
+
+    _log(
+        LOG_LEVEL_DEBUG,
+        "Coalesced %lu changes into %lu",
+        table->num_changes,
+        count
+    );
+
+    table->num_entries = 0;
+    _reset_table( table );
+
+    *changes     = result;
+    *num_changes = count;
+    return true;
+}
+
+// FNV-1a over schema, table and the key's values
+static unsigned long _hash_bytes( unsigned long hash, char * data, size_t length )
+{
+    size_t i = 0;
+
+    for( i = 0; i < length; i++ )
+    {
+        hash ^= ( unsigned char ) data[i];
+        hash *= 1099511628211UL;
+    }
+
+    hash ^= 0xff;
+    hash *= 1099511628211UL;
+    return hash;
+}
+
+static unsigned long _hash_change( struct change * change )
+{
+    unsigned long  hash   = 14695981039346656037UL;
+    struct tuple * key    = NULL;
+    unsigned int   i      = 0;
+    size_t         length = 0;
+
+    key  = change->key;
+    hash = _hash_bytes( hash, change->schema_name, strlen( change->schema_name ) );
+    hash = _hash_bytes( hash, change->table_name, strlen( change->table_name ) );
+
+    for( i = 0; key != NULL && i < key->num_columns; i++ )
+    {
+        if( key->values[i] == NULL )
+        {
+            length = 0;
+        }
+        else if( key->lengths != NULL )
+        {
+            length = ( size_t ) key->lengths[i];
+        }
+        else
+        {
+            length = strlen( key->values[i] );
+        }
+
+        hash = _hash_bytes( hash, key->values[i], length );
+    }
+
+    return hash;
+}
+
+static bool _same_row( struct change * a, struct change * b )
+{
+    unsigned int i = 0;
+
+    if(
+            a->key == NULL
+         || b->key == NULL
+         || a->key->num_columns != b->key->num_columns
+      )
+    {
+        return false;
+    }
+
+    if(
+            strcmp( a->table_name, b->table_name ) != 0
+         || strcmp( a->schema_name, b->schema_name ) != 0
+      )
+    {
+        return false;
+    }
+
+    for( i = 0; i < a->key->num_columns; i++ )
+    {
+        if( !tuple_value_equals( a->key, i, b->key, i ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * The decoder builds the key from the new tuple, an old tuple is only present
+ * when the replica identity changed or the table is REPLICA IDENTITY FULL.
+ */
+static bool _key_changed( struct change * change )
+{
+    unsigned int i     = 0;
+    int          index = 0;
+
+    if( change->old_tuple == NULL || change->key == NULL )
+    {
+        return false;
+    }
+
+    for( i = 0; i < change->key->num_columns; i++ )
+    {
+        index = find_tuple_column( change->old_tuple, change->key->names[i] );
+
+        if(
+                index >= 0
+             && !tuple_value_equals( change->old_tuple, ( unsigned int ) index, change->key, i )
+          )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Builds the DELETE half of a key changing UPDATE
+static struct change * _split_key_change( struct change * change )
+{
+    struct change * result = NULL;
+
+    result = new_change( CHANGE_TYPE_DELETE );
+
+    if( result == NULL )
+    {
+        return NULL;
+    }
+
+    result->xid         = change->xid;
+    result->lsn         = change->lsn;
+    result->timestamp   = change->timestamp ? strdup( change->timestamp ) : NULL;
+    result->schema_name = strdup( change->schema_name );
+    result->table_name  = strdup( change->table_name );
+    result->old_tuple   = copy_tuple( change->old_tuple );
+    result->key         = project_tuple( change->old_tuple, change->key );
+
+    if( result->key == NULL || result->old_tuple == NULL )
+    {
+        free_change( result );
+        return NULL;
+    }
+
+    return result;
+}
+
+/*
+ * Folds next into the net change prev. next is consumed: any tuples it
+ * carries are moved into prev, and it is freed.
+ */
+static void _merge_change(
+    struct coalesce_table * table,
+    struct change *         prev,
+    struct change *         next
+)
+{
+    struct tuple * temp = NULL;
+
+    switch( prev->type )
+    {
+        case CHANGE_TYPE_INSERT:
+            if( next->type == CHANGE_TYPE_DELETE )
+            {
+                prev->type = table->keep_deletes ? CHANGE_TYPE_DELETE : CHANGE_TYPE_NONE;
+                free_tuple( prev->new_tuple );
+                prev->new_tuple = NULL;
+            }
+            else
+            {
+                temp            = prev->new_tuple;
+                prev->new_tuple = next->new_tuple;
+                next->new_tuple = temp;
+            }
+
+            break;
+        case CHANGE_TYPE_UPDATE:
+            if( next->type == CHANGE_TYPE_DELETE )
+            {
+                prev->type = CHANGE_TYPE_DELETE;
+                free_tuple( prev->new_tuple );
+                prev->new_tuple = NULL;
+            }
+            else
+            {
+                temp            = prev->new_tuple;
+                prev->new_tuple = next->new_tuple;
+                next->new_tuple = temp;
+            }
+
+            break;
+        case CHANGE_TYPE_DELETE:
+            if( next->type == CHANGE_TYPE_DELETE )
+            {
+                break;
+            }
+
+            prev->type      = CHANGE_TYPE_UPDATE;
+            prev->new_tuple = next->new_tuple;
+            next->new_tuple = NULL;
+            break;
+        default:
+            // The row was inserted and deleted inside the window
+            prev->type      = next->type;
+            prev->new_tuple = next->new_tuple;
+            next->new_tuple = NULL;
+            break;
+    }
+
+    if( prev->old_tuple == NULL && next->old_tuple != NULL )
+    {
+        prev->old_tuple = next->old_tuple;
+        next->old_tuple = NULL;
+    }
+
+    prev->xid = next->xid;
+    prev->lsn = next->lsn;
+
+    if( next->timestamp != NULL )
+    {
+        free( prev->timestamp );
+        prev->timestamp = next->timestamp;
+        next->timestamp = NULL;
+    }
+
+    free_change( next );
+    return;
+}
+
+static bool _insert_entry(
+    struct coalesce_table * table,
+    unsigned long           hash,
+    struct change *         change
+)
+{
+    struct coalesce_entry *  entry  = NULL;
+    struct coalesce_entry ** order  = NULL;
+    unsigned long            bucket = 0;
+
+    // Past a load factor of 3/4 chains grow long, so a large transaction would be quadratic
+    if(
+            ( table->num_entries + 1 ) * 4 > table->num_buckets * 3
+         && !_resize_buckets( table, table->num_buckets * 2 )
+      )
+    {
+        _log(
+            LOG_LEVEL_WARNING,
+            "Failed to grow coalesce table past %lu buckets",
+            table->num_buckets
+        );
+    }
+
+    if( table->num_entries >= table->order_size )
+    {
+        order = ( struct coalesce_entry ** ) realloc(
+            table->order,
+            sizeof( struct coalesce_entry * ) * table->order_size * 2
+        );
+
+        if( order == NULL )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to grow coalesce table"
+            );
+
+            free_change( change );
+            return false;
+        }
+
+        table->order       = order;
+        table->order_size *= 2;
+    }
+
+    entry = ( struct coalesce_entry * ) calloc(
+        1,
+        sizeof( struct coalesce_entry )
+    );
+
+    if( entry == NULL )
+    {
+        free_change( change );
+        return false;
+    }
+
+    bucket        = hash & ( table->num_buckets - 1 );
+    entry->hash   = hash;
+    entry->change = change;
+    entry->next   = table->buckets[bucket];
+
+    table->buckets[bucket]               = entry;
+    table->order[table->num_entries++]   = entry;
+    return true;
+}
+
+/*
+ * Replaces table's buckets with num_buckets of them, a power of two, and
+ * chains its entries off of those. On failure the old buckets are kept.
+ */
+static bool _resize_buckets( struct coalesce_table * table, unsigned long num_buckets )
+{
+    struct coalesce_entry ** buckets = NULL;
+    struct coalesce_entry *  entry   = NULL;
+    unsigned long            bucket  = 0;
+    unsigned long            i       = 0;
+
+    buckets = ( struct coalesce_entry ** ) calloc(
+        num_buckets,
+        sizeof( struct coalesce_entry * )
+    );
+
+    if( buckets == NULL )
+    {
+        return false;
+    }
+
+    for( i = 0; i < table->num_entries; i++ )
+    {
+        entry           = table->order[i];
+        bucket          = entry->hash & ( num_buckets - 1 );
+        entry->next     = buckets[bucket];
+        buckets[bucket] = entry;
+    }
+
+    free( table->buckets );
+    table->buckets     = buckets;
+    table->num_buckets = num_buckets;
+    return true;
+}
+
+// Empties the buckets, going back to as many as the table started with after a large window
+static void _reset_table( struct coalesce_table * table )
+{
+    if( table->num_buckets <= table->min_buckets || !_resize_buckets( table, table->min_buckets ) )
+    {
+        memset(
+            table->buckets,
+            0,
+            sizeof( struct coalesce_entry * ) * table->num_buckets
+        );
+    }
+
+    table->num_changes = 0;
+    table->max_lsn     = 0;
+    gettimeofday( &( table->window_start ), NULL );
+    return;
+}
@@ -0,0 +1,48 @@
+#ifndef COALESCE_H
+#define COALESCE_H
+
+#include "util.h"
+#include "change.h"
+
+#define DEFAULT_COALESCE_BUCKETS 1024
+#define DEFAULT_COALESCE_WINDOW_CHANGES 4096
+#define DEFAULT_COALESCE_WINDOW_MS 250
+
+extern unsigned long coalesce_window_changes;
+extern unsigned long coalesce_window_ms;
+
+struct coalesce_entry {
+    unsigned long           hash;
+    struct change *         change; // net change, type NONE if it cancelled out
+    struct coalesce_entry * next;
+};
+
+/*
+ * Collapses changes to the same (object, key) into their net effect. Entries
+ * are chained off of buckets for lookup, and also kept in arrival order so
+ * that draining the table replays rows in the order they were first touched.
+ * keep_deletes is set for tables replayed onto a copy that may already hold
+ * rows inserted within the window. The buckets double once there are more
+ * than three entries for every four of them, and go back to min_buckets as
+ * the table is drained.
+ */
+struct coalesce_table {
+    unsigned long            num_buckets;
+    unsigned long            min_buckets;
+    struct coalesce_entry ** buckets;
+    struct coalesce_entry ** order;
+    unsigned long            order_size;
+    unsigned long            num_entries;
+    unsigned long            num_changes;
+    uint64_t                 max_lsn;
+    struct timeval           window_start;
+    bool                     keep_deletes;
+};
+
+extern struct coalesce_table * new_coalesce_table( unsigned long );
+extern void free_coalesce_table( struct coalesce_table * );
+extern bool coalesce_change( struct coalesce_table *, struct change * );
+extern bool coalesce_window_elapsed( struct coalesce_table * );
+extern bool coalesce_drain( struct coalesce_table *, struct change ***, unsigned long * );
+
+#endif // COALESCE_H
@@ -0,0 +1,501 @@
+#include "connection_pool.h"
+#include "metrics.h"
+
+unsigned int connection_spares = DEFAULT_CONNECTION_SPARES;
+
+static bool _poll_slots( struct connection_pool *, unsigned int, int );
+static void _start_connection( struct connection_pool *, struct pooled_connection * );
+static void _discard_connection( struct connection_pool *, struct pooled_connection *, bool );
+static bool _is_alive( PGconn * );
+static long _ms_until( struct timeval * );
+static void _set_ms_from_now( struct timeval *, unsigned int );
+
+/*
+ * Creates a pool of spares connections to the server described by conninfo,
+ * and starts establishing them.
+ */
+struct connection_pool * new_connection_pool( char * conninfo, unsigned int spares )
+{
+    struct connection_pool * pool        = NULL;
+    PQconninfoOption *       options     = NULL;
+    PQconninfoOption *       option      = NULL;
+    char *                   error       = NULL;
+    unsigned int             num_options = 0;
+    unsigned int             i           = 0;
+
+    if( conninfo == NULL )
+    {
+        return NULL;
+    }
+
+    options = PQconninfoParse( conninfo, &error );
+
+    if( options == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to parse connection string: %s",
+            error != NULL ? error : "out of memory"
+        );
+
+        PQfreemem( error );
+        return NULL;
+    }
+
+    for( option = options; option->keyword != NULL; option++ )
+    {
+        if( option->val != NULL )
+        {
+            num_options++;
+        }
+    }
+
+    pool = ( struct connection_pool * ) calloc( 1, sizeof( struct connection_pool ) );
+
+    if( pool == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate connection pool"
+        );
+
+        PQconninfoFree( options );
+        return NULL;
+    }
+
+    pool->num_spares = spares;
+    pool->num_slots  = spares > 0 ? spares : 1;
+    pool->retry_ms   = CONNECTION_RETRY_MIN_MS;
+    pool->keywords   = ( char ** ) calloc( num_options + 1, sizeof( char * ) );
+    pool->values     = ( char ** ) calloc( num_options + 1, sizeof( char * ) );
+    pool->slots      = ( struct pooled_connection * ) calloc(
+        pool->num_slots,
+        sizeof( struct pooled_connection )
+    );
+
+    if( pool->keywords == NULL || pool->values == NULL || pool->slots == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate connection pool"
+        );
+
+        PQconninfoFree( options );
+        free_connection_pool( pool );
+        return NULL;
+    }
+
+    for( option = options; option->keyword != NULL; option++ )
+    {
+        if( option->val == NULL )
+        {
+            continue;
+        }
+
+        pool->keywords[i] = strdup( option->keyword );
+        pool->values[i]   = strdup( option->val );
+
+        if( pool->keywords[i++] == NULL || pool->values[i - 1] == NULL )
+        {
+            PQconninfoFree( options );
+            free_connection_pool( pool );
+            return NULL;
+        }
+    }
+
+    PQconninfoFree( options );
+
+    for( i = 0; i < pool->num_spares; i++ )
+    {
+        _start_connection( pool, &( pool->slots[i] ) );
+    }
+
+    return pool;
+}
+
+/*
+ * Hands over an established, idle connection, which is the caller's from
+ * then on, and starts connecting its replacement. Spares the server has
+ * closed since they were established, as after a failover, are dropped on
+ * the way. Waits up to timeout milliseconds for a connection to come up if
+ * none is ready, and returns NULL if none does.
+ */
+PGconn * acquire_connection( struct connection_pool * pool, unsigned int timeout )
+{
+    struct pooled_connection * slot      = NULL;
+    PGconn *                   conn      = NULL;
+    struct timeval             deadline  = {0};
+    long                       remaining = 0;
+    unsigned int               i         = 0;
+
+    if( pool == NULL )
+    {
+        return NULL;
+    }
+
+    _set_ms_from_now( &deadline, timeout );
+
+    while( true )
+    {
+        for( i = 0; i < pool->num_slots; i++ )
+        {
+            slot = &( pool->slots[i] );
+
+            if( slot->state != POOL_SLOT_READY )
+            {
+                continue;
+            }
+
+            if( !_is_alive( slot->conn ) )
+            {
+                _discard_connection( pool, slot, false );
+                continue;
+            }
+
+            conn        = slot->conn;
+            slot->conn  = NULL;
+            slot->state = POOL_SLOT_EMPTY;
+
+            if( i < pool->num_spares )
+            {
+                _start_connection( pool, slot );
+            }
+
+            return conn;
+        }
+
+        remaining = _ms_until( &deadline );
+
+        if( remaining <= 0 )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to connect within %u ms",
+                timeout
+            );
+
+            return NULL;
+        }
+
+        if( !_poll_slots( pool, pool->num_slots, ( int ) remaining ) )
+        {
+            return NULL;
+        }
+    }
+}
+
+/*
+ * Moves the spares along without waiting longer than timeout milliseconds:
+ * advances those being established, checks idle ones the server may have
+ * closed, and restarts failed ones once their back-off has passed. For a
+ * worker with nothing else to do, as often as it likes.
+ */
+bool poll_connection_pool( struct connection_pool * pool, int timeout )
+{
+    if( pool == NULL )
+    {
+        return false;
+    }
+
+    return _poll_slots( pool, pool->num_spares, timeout );
+}
+
+void free_connection_pool( struct connection_pool * pool )
+{
+    unsigned int i = 0;
+
+    if( pool == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; pool->slots != NULL && i < pool->num_slots; i++ )
+    {
+        if( pool->slots[i].conn != NULL )
+        {
+            PQfinish( pool->slots[i].conn );
+        }
+    }
+
+    for( i = 0; pool->keywords != NULL && pool->keywords[i] != NULL; i++ )
+    {
+        free( pool->keywords[i] );
+    }
+
+    for( i = 0; pool->values != NULL && pool->values[i] != NULL; i++ )
+    {
+        free( pool->values[i] );
+    }
+
+    free( pool->keywords );
+    free( pool->values );
+    free( pool->slots );
+    free( pool );
+    return;
+}
+
+/*
+ * Waits delay milliseconds before a retry, and doubles delay for the next
+ * one, up to CONNECTION_RETRY_MAX_MS. delay starts at 0 for the shortest.
+ */
+void connection_backoff( unsigned int * delay )
+{
+    struct timespec wait = {0};
+
+    if( *delay < CONNECTION_RETRY_MIN_MS )
+    {
+        *delay = CONNECTION_RETRY_MIN_MS;
+    }
+
+    wait.tv_sec  = ( time_t ) ( *delay / 1000 );
+    wait.tv_nsec = ( long ) ( *delay % 1000 ) * 1000000L;
+
+    while( nanosleep( &wait, &wait ) != 0 && errno == EINTR );
+    metrics_count( METRIC_CONNECTION_RETRIES, 1 );
+
+    *delay *= 2;
+
+    if( *delay > CONNECTION_RETRY_MAX_MS )
+    {
+        *delay = CONNECTION_RETRY_MAX_MS;
+    }
+
+    return;
+}
+
+/*
+ * Keeps wanted slots established or being established, then waits up to
+ * timeout milliseconds for those being established to make progress, or for
+ * the next retry to come due.
+ */
+static bool _poll_slots( struct connection_pool * pool, unsigned int wanted, int timeout )
+{
+    struct pooled_connection * slot     = NULL;
+    struct pollfd *            fds      = NULL;
+    struct timeval             now      = {0};
+    unsigned int *             waiting  = NULL;
+    unsigned int               num_live = 0;
+    unsigned int               num_fds  = 0;
+    unsigned int               i        = 0;
+    long                       due      = 0;
+    int                        ready    = 0;
+
+    gettimeofday( &now, NULL );
+
+    for( i = 0; i < pool->num_slots; i++ )
+    {
+        slot = &( pool->slots[i] );
+
+        if(
+                slot->state == POOL_SLOT_READY
+             && ( now.tv_sec - slot->checked_at.tv_sec ) * 1000
+              + ( now.tv_usec - slot->checked_at.tv_usec ) / 1000 >= CONNECTION_CHECK_MS
+          )
+        {
+            if( _is_alive( slot->conn ) )
+            {
+                slot->checked_at = now;
+            }
+            else
+            {
+                _discard_connection( pool, slot, false );
+            }
+        }
+
+        if( slot->state != POOL_SLOT_EMPTY )
+        {
+            num_live++;
+        }
+    }
+
+    for( i = 0; i < pool->num_slots && num_live < wanted; i++ )
+    {
+        slot = &( pool->slots[i] );
+
+        if( slot->state != POOL_SLOT_EMPTY )
+        {
+            continue;
+        }
+
+        due = _ms_until( &( slot->retry_at ) );
+
+        if( due <= 0 )
+        {
+            _start_connection( pool, slot );
+
+            if( slot->state != POOL_SLOT_EMPTY )
+            {
+                num_live++;
+                continue;
+            }
+
+            due = _ms_until( &( slot->retry_at ) );
+        }
+
+        // Wake up in time to retry
+        if( due < timeout )
+        {
+            timeout = ( int ) due;
+        }
+    }
+
+    fds     = ( struct pollfd * ) calloc( pool->num_slots, sizeof( struct pollfd ) );
+    waiting = ( unsigned int * ) calloc( pool->num_slots, sizeof( unsigned int ) );
+
+    if( fds == NULL || waiting == NULL )
+    {
+        free( fds );
+        free( waiting );
+        return false;
+    }
+
+    for( i = 0; i < pool->num_slots; i++ )
+    {
+        slot = &( pool->slots[i] );
+
+        if( slot->state != POOL_SLOT_CONNECTING )
+        {
+            continue;
+        }
+
+        fds[num_fds].fd     = PQsocket( slot->conn );
+        fds[num_fds].events = slot->polling == PGRES_POLLING_READING ? POLLIN : POLLOUT;
+        waiting[num_fds++]  = i;
+    }
+
+    ready = poll( num_fds > 0 ? fds : NULL, num_fds, timeout > 0 ? timeout : 0 );
+
+    if( ready < 0 && errno != EINTR )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to wait for connections: %s",
+            strerror( errno )
+        );
+
+        free( fds );
+        free( waiting );
+        return false;
+    }
+
+    for( i = 0; ready > 0 && i < num_fds; i++ )
+    {
+        if( fds[i].revents == 0 )
+        {
+            continue;
+        }
+
+        slot          = &( pool->slots[waiting[i]] );
+        slot->polling = PQconnectPoll( slot->conn );
+
+        if( slot->polling == PGRES_POLLING_OK )
+        {
+            slot->state    = POOL_SLOT_READY;
+            pool->retry_ms = CONNECTION_RETRY_MIN_MS;
+            gettimeofday( &( slot->checked_at ), NULL );
+        }
+        else if( slot->polling == PGRES_POLLING_FAILED )
+        {
+            _discard_connection( pool, slot, true );
+        }
+    }
+
+    free( fds );
+    free( waiting );
+    return true;
+}
+
+static void _start_connection( struct connection_pool * pool, struct pooled_connection * slot )
+{
+    slot->conn = PQconnectStartParams(
+        ( const char * const * ) pool->keywords,
+        ( const char * const * ) pool->values,
+        0
+    );
+
+    if( slot->conn == NULL || PQstatus( slot->conn ) == CONNECTION_BAD )
+    {
+        _discard_connection( pool, slot, true );
+        return;
+    }
+
+    slot->state   = POOL_SLOT_CONNECTING;
+    slot->polling = PGRES_POLLING_WRITING;
+    return;
+}
+
+/*
+ * Empties slot. A connection that failed to be established backs off before
+ * the next attempt; a spare that was lost is replaced straight away.
+ */
+static void _discard_connection( struct connection_pool * pool, struct pooled_connection * slot, bool failed )
+{
+    if( failed )
+    {
+        _log(
+            LOG_LEVEL_WARNING,
+            "Failed to connect to DB server (%s), retrying in %u ms",
+            slot->conn != NULL ? PQerrorMessage( slot->conn ) : "out of memory",
+            pool->retry_ms
+        );
+    }
+
+    if( slot->conn != NULL )
+    {
+        PQfinish( slot->conn );
+    }
+
+    slot->conn  = NULL;
+    slot->state = POOL_SLOT_EMPTY;
+    _set_ms_from_now( &( slot->retry_at ), failed ? pool->retry_ms : 0 );
+
+    if( failed )
+    {
+        pool->retry_ms *= 2;
+
+        if( pool->retry_ms > CONNECTION_RETRY_MAX_MS )
+        {
+            pool->retry_ms = CONNECTION_RETRY_MAX_MS;
+        }
+    }
+
+    return;
+}
+
+/*
+ * Whether an idle connection is still usable. Reading what the server has
+ * sent since is enough to see it closed the connection, as it does when it
+ * shuts down.
+ */
+static bool _is_alive( PGconn * conn )
+{
+    return PQconsumeInput( conn ) != 0
+        && PQstatus( conn ) == CONNECTION_OK
+        && PQtransactionStatus( conn ) == PQTRANS_IDLE;
+}
+
+// Milliseconds from now until when, negative once it has passed
+static long _ms_until( struct timeval * when )
+{
+    struct timeval now = {0};
+
+    gettimeofday( &now, NULL );
+
+    return ( when->tv_sec - now.tv_sec ) * 1000L + ( when->tv_usec - now.tv_usec ) / 1000L;
+}
+
+static void _set_ms_from_now( struct timeval * when, unsigned int ms )
+{
+    gettimeofday( when, NULL );
+
+    when->tv_sec  += ( time_t ) ( ms / 1000 );
+    when->tv_usec += ( suseconds_t ) ( ms % 1000 ) * 1000;
+
+    if( when->tv_usec >= 1000000 )
+    {
+        when->tv_sec++;
+        when->tv_usec -= 1000000;
+    }
+
+    return;
+}
@@ -0,0 +1,62 @@
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include "util.h"
+#include <poll.h>
+
+#define DEFAULT_CONNECTION_SPARES 1
+
+// How long acquire_connection() keeps trying before giving up
+#define CONNECTION_TIMEOUT_MS 30000
+
+// Back-off between failed attempts, doubling from the first to the last
+#define CONNECTION_RETRY_MIN_MS 10
+#define CONNECTION_RETRY_MAX_MS 1000
+
+// How often an idle spare is checked for having been closed by the server
+#define CONNECTION_CHECK_MS 5000
+
+#define POOL_SLOT_EMPTY 0
+#define POOL_SLOT_CONNECTING 1
+#define POOL_SLOT_READY 2
+
+extern unsigned int connection_spares;
+
+/*
+ * A spare connection, or a slot for one. A CONNECTING slot is being
+ * established with PQconnectPoll(), which last asked to wait for polling; an
+ * EMPTY one starts again at retry_at. checked_at is when a READY one was last
+ * found alive.
+ */
+struct pooled_connection {
+    PGconn *                  conn;
+    unsigned short            state;
+    PostgresPollingStatusType polling;
+    struct timeval            retry_at;
+    struct timeval            checked_at;
+};
+
+/*
+ * Spare connections to one location, num_spares of which are kept
+ * established in the background, so that a worker whose connection fails can
+ * take one over at once instead of connecting from scratch. With no spares
+ * the one slot is only filled on demand. Connections are started with
+ * PQconnectStartParams() from keywords and values and never block on the
+ * server; retry_ms is the back-off after the latest consecutive failure.
+ */
+struct connection_pool {
+    char **                    keywords;
+    char **                    values;
+    struct pooled_connection * slots;
+    unsigned int               num_slots;
+    unsigned int               num_spares;
+    unsigned int               retry_ms;
+};
+
+extern struct connection_pool * new_connection_pool( char *, unsigned int );
+extern PGconn * acquire_connection( struct connection_pool *, unsigned int );
+extern bool poll_connection_pool( struct connection_pool *, int );
+extern void free_connection_pool( struct connection_pool * );
+extern void connection_backoff( unsigned int * );
+
+#endif // CONNECTION_POOL_H
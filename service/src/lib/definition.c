@@ -0,0 +1,1143 @@
+#include "definition.h"
+
+// Top-level clauses that end the parts of a definition that are taken apart
+static const char * tail_clauses[] = {
+    "ORDER",
+    "LIMIT",
+    "OFFSET",
+    "WINDOW",
+    "UNION",
+    "INTERSECT",
+    "EXCEPT",
+    "FETCH",
+    "FOR",
+    NULL
+};
+
+// Words that end a FROM clause entry rather than alias its relation
+static const char * join_keywords[] = {
+    "JOIN",
+    "INNER",
+    "CROSS",
+    "LEFT",
+    "RIGHT",
+    "FULL",
+    "NATURAL",
+    "ON",
+    "USING",
+    NULL
+};
+
+/*
+ * Aggregates recognized in select lists. The first four are, in order, the
+ * AGGREGATE_SUM through AGGREGATE_MAX kinds; calls to any function not listed
+ * are taken to be calls to plain functions.
+ */
+static const char * aggregate_functions[] = {
+    "SUM",
+    "COUNT",
+    "MIN",
+    "MAX",
+    "AVG",
+    "ARRAY_AGG",
+    "BIT_AND",
+    "BIT_OR",
+    "BOOL_AND",
+    "BOOL_OR",
+    "EVERY",
+    "JSON_AGG",
+    "JSONB_AGG",
+    "JSON_OBJECT_AGG",
+    "JSONB_OBJECT_AGG",
+    "STRING_AGG",
+    "STDDEV",
+    "STDDEV_POP",
+    "STDDEV_SAMP",
+    "VARIANCE",
+    "VAR_POP",
+    "VAR_SAMP",
+    NULL
+};
+
+static bool _parse_select_list( struct definition * );
+static bool _parse_from_clause( struct definition * );
+static void _free_relations( struct definition * );
+static bool _split_list( char *, char ***, unsigned int * );
+static void _classify_aggregate( struct definition_column * );
+static int _find_aggregate( char *, char * );
+static bool _calls_aggregate( char * );
+static char * _find_keyword( char *, char *, const char * );
+static char * _find_top_level( char *, char *, char );
+static char * _find_closing( char * );
+static char * _clause_end( char *, char *, char ** );
+static char * _skip_token( char *, char * );
+static char * _skip_space( char * );
+static char * _copy_trimmed( char *, char * );
+static bool _keyword_at( char *, const char *, size_t );
+static bool _word_at( char *, const char * );
+static bool _is_word_character( char );
+
+struct definition * parse_definition( char * text )
+{
+    struct definition * definition    = NULL;
+    char *              end           = NULL;
+    char *              select        = NULL;
+    char *              from          = NULL;
+    char *              where         = NULL;
+    char *              group         = NULL;
+    char *              having        = NULL;
+    char *              tail          = NULL;
+    char *              token         = NULL;
+    char *              boundaries[4] = {NULL};
+    unsigned int        i             = 0;
+
+    if( text == NULL )
+    {
+        return NULL;
+    }
+
+    definition = ( struct definition * ) calloc( 1, sizeof( struct definition ) );
+
+    if( definition == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate definition"
+        );
+
+        return NULL;
+    }
+
+    definition->text = strdup( text );
+
+    if( definition->text == NULL )
+    {
+        free( definition );
+        return NULL;
+    }
+
+    // A trailing semicolon would break the definition's use as a subquery
+    end = definition->text + strlen( definition->text );
+
+    while( end > definition->text && ( isspace( ( unsigned char ) end[-1] ) || end[-1] == ';' ) )
+    {
+        end--;
+    }
+
+    *end = '\0';
+
+    select = _find_keyword( definition->text, end, "SELECT" );
+    from   = _find_keyword( definition->text, end, "FROM" );
+
+    if( select == NULL || from == NULL )
+    {
+        return definition;
+    }
+
+    // Anything ahead of SELECT (a WITH clause) is not taken apart
+    token = _copy_trimmed( definition->text, select );
+
+    if( token == NULL || strlen( token ) > 0 )
+    {
+        free( token );
+        return definition;
+    }
+
+    free( token );
+    where  = _find_keyword( from, end, "WHERE" );
+    group  = _find_keyword( from, end, "GROUP" );
+    having = _find_keyword( from, end, "HAVING" );
+
+    for( i = 0; tail_clauses[i] != NULL; i++ )
+    {
+        token = _find_keyword( from, end, tail_clauses[i] );
+
+        if( token != NULL && ( tail == NULL || token < tail ) )
+        {
+            tail = token;
+        }
+    }
+
+    boundaries[0] = where;
+    boundaries[1] = group;
+    boundaries[2] = having;
+    boundaries[3] = tail;
+
+    definition->select_list = _copy_trimmed( select + strlen( "SELECT" ), from );
+    definition->from_clause = _copy_trimmed( from + strlen( "FROM" ), _clause_end( from, end, boundaries ) );
+
+    if( where != NULL )
+    {
+        definition->where = _copy_trimmed( where + strlen( "WHERE" ), _clause_end( where, end, boundaries ) );
+    }
+
+    if( group != NULL )
+    {
+        token = _skip_space( group + strlen( "GROUP" ) );
+
+        if( _word_at( token, "BY" ) )
+        {
+            definition->group_by = _copy_trimmed( token + strlen( "BY" ), _clause_end( group, end, boundaries ) );
+        }
+    }
+
+    if( having != NULL )
+    {
+        definition->having = _copy_trimmed( having + strlen( "HAVING" ), _clause_end( having, end, boundaries ) );
+    }
+
+    if( definition->select_list == NULL || definition->from_clause == NULL )
+    {
+        return definition;
+    }
+
+    definition->is_distinct = _find_keyword(
+        definition->select_list,
+        definition->select_list + strlen( definition->select_list ),
+        "DISTINCT"
+    ) != NULL;
+
+    // Window functions are not aggregates, but cannot be evaluated a row at a time either
+    definition->is_select = tail == NULL
+                         && ( group == NULL || definition->group_by != NULL )
+                         && ( where == NULL || group == NULL || where < group )
+                         && ( having == NULL || ( ( where == NULL || where < having ) && ( group == NULL || group < having ) ) )
+                         && _find_keyword(
+                                definition->select_list,
+                                definition->select_list + strlen( definition->select_list ),
+                                "OVER"
+                            ) == NULL;
+
+    if( !_parse_select_list( definition ) )
+    {
+        return definition;
+    }
+
+    if(
+            definition->group_by != NULL
+         && !_split_list( definition->group_by, &( definition->group_keys ), &( definition->num_group_keys ) )
+      )
+    {
+        return definition;
+    }
+
+    if( !_parse_from_clause( definition ) )
+    {
+        return definition;
+    }
+
+    if( definition->num_relations == 1 )
+    {
+        definition->relation = strdup( definition->relations[0].relation );
+
+        if( definition->relations[0].alias != NULL )
+        {
+            definition->alias = strdup( definition->relations[0].alias );
+        }
+    }
+
+    definition->is_simple = definition->is_select
+                         && definition->relation != NULL
+                         && definition->group_by == NULL
+                         && definition->having == NULL
+                         && !( definition->is_distinct )
+                         && !( definition->has_aggregates );
+    return definition;
+}
+
+void free_definition( struct definition * definition )
+{
+    unsigned int i = 0;
+
+    if( definition == NULL )
+    {
+        return;
+    }
+
+    if( definition->columns != NULL )
+    {
+        for( i = 0; i < definition->num_columns; i++ )
+        {
+            free( definition->columns[i].expression );
+            free( definition->columns[i].name );
+            free( definition->columns[i].argument );
+        }
+    }
+
+    if( definition->group_keys != NULL )
+    {
+        for( i = 0; i < definition->num_group_keys; i++ )
+        {
+            free( definition->group_keys[i] );
+        }
+    }
+
+    _free_relations( definition );
+    free( definition->text );
+    free( definition->select_list );
+    free( definition->from_clause );
+    free( definition->relation );
+    free( definition->alias );
+    free( definition->where );
+    free( definition->group_by );
+    free( definition->having );
+    free( definition->columns );
+    free( definition->group_keys );
+    free( definition );
+    return;
+}
+
+/*
+ * Splits a plain column reference, optionally qualified by a relation name or
+ * alias, into its parts, each normalized as by normalize_identifier(). Returns
+ * false if expression is anything other than a column reference. Either of
+ * qualifier and column may be NULL if the caller is not interested in it.
+ */
+bool split_column_reference( char * expression, char ** qualifier, char ** column )
+{
+    char * start      = NULL;
+    char * end        = NULL;
+    char * part       = NULL;
+    char * last_part  = NULL;
+    char * prior_part = NULL;
+    char * cursor     = NULL;
+
+    if( expression == NULL )
+    {
+        return false;
+    }
+
+    start = _skip_space( expression );
+    end   = _skip_token( start, NULL );
+
+    if( end == start || *_skip_space( end ) != '\0' )
+    {
+        return false;
+    }
+
+    // Each dot separated part must be an identifier, which rules out numbers
+    for( part = start, cursor = start; cursor <= end; cursor++ )
+    {
+        if( *cursor == '"' )
+        {
+            cursor = strchr( cursor + 1, '"' );
+
+            if( cursor == NULL || cursor >= end )
+            {
+                return false;
+            }
+        }
+        else if( cursor == end || *cursor == '.' )
+        {
+            if( cursor == part || isdigit( ( unsigned char ) *part ) )
+            {
+                return false;
+            }
+
+            prior_part = last_part;
+            last_part  = part;
+            part       = cursor + 1;
+        }
+    }
+
+    if( qualifier != NULL )
+    {
+        *qualifier = NULL;
+
+        if( prior_part != NULL )
+        {
+            *qualifier = normalize_identifier( prior_part, last_part - 1 );
+
+            if( *qualifier == NULL )
+            {
+                return false;
+            }
+        }
+    }
+
+    if( column != NULL )
+    {
+        *column = normalize_identifier( last_part, end );
+
+        if( *column == NULL )
+        {
+            if( qualifier != NULL )
+            {
+                free( *qualifier );
+                *qualifier = NULL;
+            }
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Splits a WHERE clause into the conditions it ANDs together, each trimmed
+ * and malloc()'d. Fails if the clause ORs or uses BETWEEN at the top level,
+ * where an AND does not separate conditions.
+ */
+bool split_conjuncts( char * where, char *** items, unsigned int * num_items )
+{
+    char **      list  = NULL;
+    char *       start = NULL;
+    char *       end   = NULL;
+    char *       and   = NULL;
+    unsigned int count = 1;
+    unsigned int i     = 0;
+
+    end = where + strlen( where );
+
+    if( _find_keyword( where, end, "OR" ) != NULL || _find_keyword( where, end, "BETWEEN" ) != NULL )
+    {
+        return false;
+    }
+
+    for( and = _find_keyword( where, end, "AND" ); and != NULL; and = _find_keyword( and + 3, end, "AND" ) )
+    {
+        count++;
+    }
+
+    list = ( char ** ) calloc( count, sizeof( char * ) );
+
+    if( list == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate definition list"
+        );
+
+        return false;
+    }
+
+    for( i = 0, start = where; i < count; i++ )
+    {
+        and     = _find_keyword( start, end, "AND" );
+        list[i] = _copy_trimmed( start, and != NULL ? and : end );
+
+        if( list[i] == NULL || strlen( list[i] ) == 0 )
+        {
+            for( count = 0; count <= i; count++ )
+            {
+                free( list[count] );
+            }
+
+            free( list );
+            return false;
+        }
+
+        start = and != NULL ? and + 3 : end;
+    }
+
+    *items     = list;
+    *num_items = count;
+    return true;
+}
+
+/*
+ * Returns a malloc()'d copy of the identifier in [start, end) as the server
+ * would name it: quoted identifiers lose their quotes, anything else is folded
+ * to lower case. end may be NULL for a NUL terminated string.
+ */
+char * normalize_identifier( char * start, char * end )
+{
+    char * result = NULL;
+    char * output = NULL;
+    char * cursor = NULL;
+
+    if( end == NULL )
+    {
+        end = start + strlen( start );
+    }
+
+    result = _copy_trimmed( start, end );
+
+    if( result == NULL )
+    {
+        return NULL;
+    }
+
+    if( result[0] == '"' && strlen( result ) > 1 && result[strlen( result ) - 1] == '"' )
+    {
+        result[strlen( result ) - 1] = '\0';
+
+        for( cursor = result + 1, output = result; *cursor != '\0'; cursor++ )
+        {
+            *output++ = *cursor;
+
+            if( cursor[0] == '"' && cursor[1] == '"' )
+            {
+                cursor++;
+            }
+        }
+
+        *output = '\0';
+        return result;
+    }
+
+    for( cursor = result; *cursor != '\0'; cursor++ )
+    {
+        *cursor = ( char ) tolower( ( unsigned char ) *cursor );
+    }
+
+    return result;
+}
+
+// Fills in definition->columns from the select list
+static bool _parse_select_list( struct definition * definition )
+{
+    struct definition_column * column    = NULL;
+    char **                    items     = NULL;
+    char *                     as        = NULL;
+    unsigned int               num_items = 0;
+    unsigned int               i         = 0;
+    bool                       success   = true;
+
+    if( !_split_list( definition->select_list, &items, &num_items ) )
+    {
+        return false;
+    }
+
+    definition->columns = ( struct definition_column * ) calloc(
+        num_items + 1,
+        sizeof( struct definition_column )
+    );
+
+    if( definition->columns == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate definition columns"
+        );
+
+        success = false;
+        num_items = 0;
+    }
+
+    definition->num_columns = num_items;
+
+    for( i = 0; i < num_items; i++ )
+    {
+        column = &( definition->columns[i] );
+        as     = _find_keyword( items[i], items[i] + strlen( items[i] ), "AS" );
+
+        if( as != NULL )
+        {
+            column->expression = _copy_trimmed( items[i], as );
+            column->name       = normalize_identifier( as + strlen( "AS" ), NULL );
+        }
+        else
+        {
+            column->expression = strdup( items[i] );
+            split_column_reference( items[i], NULL, &( column->name ) );
+        }
+
+        if( column->expression == NULL )
+        {
+            success = false;
+            continue;
+        }
+
+        _classify_aggregate( column );
+
+        if( column->aggregate != AGGREGATE_NONE )
+        {
+            definition->has_aggregates = true;
+        }
+    }
+
+    for( i = 0; items != NULL && i < num_items; i++ )
+    {
+        free( items[i] );
+    }
+
+    free( items );
+    return success;
+}
+
+/*
+ * Fills in definition->relations from a FROM clause of relations separated by
+ * commas, [ INNER ] JOIN ... ON / USING, or CROSS JOIN. Anything else - outer
+ * joins, subqueries, functions - leaves relations empty.
+ */
+static bool _parse_from_clause( struct definition * definition )
+{
+    struct definition_relation * relations        = NULL;
+    struct definition_relation * relation         = NULL;
+    char *                       cursor           = NULL;
+    char *                       token            = NULL;
+    char *                       next             = NULL;
+    unsigned int                 i                = 0;
+    bool                         expect_condition = false;
+
+    cursor = definition->from_clause;
+
+    while( true )
+    {
+        cursor = _skip_space( cursor );
+
+        if( *cursor == '(' || _word_at( cursor, "LATERAL" ) || _word_at( cursor, "ONLY" ) )
+        {
+            break;
+        }
+
+        token = _skip_token( cursor, NULL );
+
+        // A function in FROM is followed by its arguments
+        if( token == cursor || *_skip_space( token ) == '(' )
+        {
+            break;
+        }
+
+        relations = ( struct definition_relation * ) realloc(
+            definition->relations,
+            sizeof( struct definition_relation ) * ( definition->num_relations + 1 )
+        );
+
+        if( relations == NULL )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to allocate definition relations"
+            );
+
+            break;
+        }
+
+        definition->relations = relations;
+        relation              = &( relations[definition->num_relations++] );
+        relation->relation    = _copy_trimmed( cursor, token );
+        relation->alias       = NULL;
+        relation->offset      = ( size_t ) ( cursor - definition->from_clause );
+        relation->length      = ( size_t ) ( token - cursor );
+        cursor                = _skip_space( token );
+
+        if( relation->relation == NULL )
+        {
+            break;
+        }
+
+        if( _word_at( cursor, "AS" ) )
+        {
+            cursor = _skip_space( cursor + strlen( "AS" ) );
+        }
+
+        for( i = 0; join_keywords[i] != NULL && !_word_at( cursor, join_keywords[i] ); i++ );
+
+        if( *cursor != '\0' && *cursor != ',' && join_keywords[i] == NULL )
+        {
+            token = _skip_token( cursor, NULL );
+
+            if( token == cursor )
+            {
+                break;
+            }
+
+            relation->alias = _copy_trimmed( cursor, token );
+            cursor          = _skip_space( token );
+
+            // Column aliases would rename the relation's columns
+            if( relation->alias == NULL || *cursor == '(' )
+            {
+                break;
+            }
+        }
+
+        if( expect_condition && _word_at( cursor, "ON" ) )
+        {
+            // The condition runs up to the next join or comma
+            cursor += strlen( "ON" );
+            next    = _find_top_level( cursor, cursor + strlen( cursor ), ',' );
+
+            for( i = 0; join_keywords[i] != NULL && strcmp( join_keywords[i], "ON" ) != 0; i++ )
+            {
+                token = _find_keyword( cursor, cursor + strlen( cursor ), join_keywords[i] );
+
+                if( token != NULL && ( next == NULL || token < next ) )
+                {
+                    next = token;
+                }
+            }
+
+            cursor = next != NULL ? next : cursor + strlen( cursor );
+        }
+        else if( expect_condition && _word_at( cursor, "USING" ) )
+        {
+            cursor = _skip_space( cursor + strlen( "USING" ) );
+            token  = *cursor == '(' ? _find_closing( cursor ) : NULL;
+
+            if( token == NULL )
+            {
+                break;
+            }
+
+            cursor = _skip_space( token + 1 );
+        }
+        else if( expect_condition )
+        {
+            break;
+        }
+
+        if( *cursor == '\0' )
+        {
+            return true;
+        }
+
+        expect_condition = true;
+
+        if( *cursor == ',' )
+        {
+            cursor++;
+            expect_condition = false;
+            continue;
+        }
+
+        if( _word_at( cursor, "INNER" ) )
+        {
+            cursor = _skip_space( cursor + strlen( "INNER" ) );
+        }
+        else if( _word_at( cursor, "CROSS" ) )
+        {
+            cursor           = _skip_space( cursor + strlen( "CROSS" ) );
+            expect_condition = false;
+        }
+
+        if( !_word_at( cursor, "JOIN" ) )
+        {
+            break;
+        }
+
+        cursor += strlen( "JOIN" );
+    }
+
+    _free_relations( definition );
+    return false;
+}
+
+static void _free_relations( struct definition * definition )
+{
+    unsigned int i = 0;
+
+    if( definition->relations != NULL )
+    {
+        for( i = 0; i < definition->num_relations; i++ )
+        {
+            free( definition->relations[i].relation );
+            free( definition->relations[i].alias );
+        }
+    }
+
+    free( definition->relations );
+    definition->relations     = NULL;
+    definition->num_relations = 0;
+    return;
+}
+
+// Splits text on its top-level commas into malloc()'d, trimmed items
+static bool _split_list( char * text, char *** items, unsigned int * num_items )
+{
+    char **      list   = NULL;
+    char *       start  = NULL;
+    char *       end    = NULL;
+    char *       comma  = NULL;
+    unsigned int count  = 1;
+    unsigned int i      = 0;
+
+    end = text + strlen( text );
+
+    for( comma = _find_top_level( text, end, ',' ); comma != NULL; comma = _find_top_level( comma + 1, end, ',' ) )
+    {
+        count++;
+    }
+
+    list = ( char ** ) calloc( count, sizeof( char * ) );
+
+    if( list == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate definition list"
+        );
+
+        return false;
+    }
+
+    for( i = 0, start = text; i < count; i++ )
+    {
+        comma   = _find_top_level( start, end, ',' );
+        list[i] = _copy_trimmed( start, comma != NULL ? comma : end );
+
+        if( list[i] == NULL || strlen( list[i] ) == 0 )
+        {
+            for( count = 0; count <= i; count++ )
+            {
+                free( list[count] );
+            }
+
+            free( list );
+            return false;
+        }
+
+        start = comma != NULL ? comma + 1 : end;
+    }
+
+    *items     = list;
+    *num_items = count;
+    return true;
+}
+
+/*
+ * Sets column's aggregate kind. Only an expression that is a single call to
+ * one of the listed aggregates, without DISTINCT, ORDER BY or FILTER, is
+ * given the kind of that aggregate; any other expression that calls an
+ * aggregate is AGGREGATE_OTHER.
+ */
+static void _classify_aggregate( struct definition_column * column )
+{
+    char * name  = NULL;
+    char * open  = NULL;
+    char * close = NULL;
+    int    index = -1;
+
+    name  = _skip_space( column->expression );
+    open  = _skip_token( name, NULL );
+    index = _find_aggregate( name, open );
+    open  = _skip_space( open );
+
+    if( index >= 0 && index < AGGREGATE_OTHER - 1 && *open == '(' )
+    {
+        close = _find_closing( open );
+
+        if( close != NULL && *_skip_space( close + 1 ) == '\0' )
+        {
+            column->argument = _copy_trimmed( open + 1, close );
+
+            if(
+                    column->argument != NULL
+                 && _find_keyword( column->argument, column->argument + strlen( column->argument ), "DISTINCT" ) == NULL
+                 && _find_keyword( column->argument, column->argument + strlen( column->argument ), "ORDER" ) == NULL
+              )
+            {
+                column->aggregate = ( unsigned short ) ( index + 1 );
+                return;
+            }
+
+            free( column->argument );
+            column->argument = NULL;
+        }
+    }
+
+    column->aggregate = _calls_aggregate( column->expression ) ? AGGREGATE_OTHER : AGGREGATE_NONE;
+    return;
+}
+
+// The index in aggregate_functions of the name in [start, end), or -1
+static int _find_aggregate( char * start, char * end )
+{
+    int i = 0;
+
+    for( i = 0; aggregate_functions[i] != NULL; i++ )
+    {
+        if(
+                strlen( aggregate_functions[i] ) == ( size_t ) ( end - start )
+             && _keyword_at( start, aggregate_functions[i], ( size_t ) ( end - start ) )
+          )
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Whether expression calls an aggregate anywhere, including within parentheses
+static bool _calls_aggregate( char * expression )
+{
+    char * cursor = NULL;
+    char * token  = NULL;
+    char   quote  = '\0';
+
+    for( cursor = expression; *cursor != '\0'; cursor++ )
+    {
+        if( quote != '\0' )
+        {
+            if( *cursor == quote )
+            {
+                quote = '\0';
+            }
+        }
+        else if( *cursor == '\'' || *cursor == '"' )
+        {
+            quote = *cursor;
+        }
+        else if(
+                    _is_word_character( *cursor )
+                 && ( cursor == expression || !( _is_word_character( cursor[-1] ) || cursor[-1] == '.' ) )
+               )
+        {
+            for( token = cursor; _is_word_character( *token ); token++ );
+
+            if( *_skip_space( token ) == '(' && _find_aggregate( cursor, token ) >= 0 )
+            {
+                return true;
+            }
+
+            cursor = token - 1;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Finds the first occurrence of keyword, as a whole word, between start and
+ * end that is not within parentheses, a string literal or a quoted
+ * identifier.
+ */
+static char * _find_keyword( char * start, char * end, const char * keyword )
+{
+    char *       cursor = NULL;
+    size_t       length = 0;
+    unsigned int depth  = 0;
+    char         quote  = '\0';
+
+    length = strlen( keyword );
+
+    for( cursor = start; cursor < end; cursor++ )
+    {
+        if( quote != '\0' )
+        {
+            if( *cursor == quote )
+            {
+                quote = '\0';
+            }
+
+            continue;
+        }
+
+        if( *cursor == '\'' || *cursor == '"' )
+        {
+            quote = *cursor;
+        }
+        else if( *cursor == '(' )
+        {
+            depth++;
+        }
+        else if( *cursor == ')' && depth > 0 )
+        {
+            depth--;
+        }
+        else if(
+                    depth == 0
+                 && ( size_t ) ( end - cursor ) >= length
+                 && _keyword_at( cursor, keyword, length )
+                 && ( cursor == start || !_is_word_character( cursor[-1] ) )
+                 && ( cursor + length == end || !_is_word_character( cursor[length] ) )
+               )
+        {
+            return cursor;
+        }
+    }
+
+    return NULL;
+}
+
+// Finds the first character between start and end that is not nested or quoted
+static char * _find_top_level( char * start, char * end, char character )
+{
+    char *       cursor = NULL;
+    unsigned int depth  = 0;
+    char         quote  = '\0';
+
+    for( cursor = start; cursor < end; cursor++ )
+    {
+        if( quote != '\0' )
+        {
+            if( *cursor == quote )
+            {
+                quote = '\0';
+            }
+        }
+        else if( *cursor == '\'' || *cursor == '"' )
+        {
+            quote = *cursor;
+        }
+        else if( *cursor == character && depth == 0 )
+        {
+            return cursor;
+        }
+        else if( *cursor == '(' )
+        {
+            depth++;
+        }
+        else if( *cursor == ')' && depth > 0 )
+        {
+            depth--;
+        }
+    }
+
+    return NULL;
+}
+
+// Finds the parenthesis closing the one at open
+static char * _find_closing( char * open )
+{
+    char *       cursor = NULL;
+    unsigned int depth  = 0;
+    char         quote  = '\0';
+
+    for( cursor = open; *cursor != '\0'; cursor++ )
+    {
+        if( quote != '\0' )
+        {
+            if( *cursor == quote )
+            {
+                quote = '\0';
+            }
+        }
+        else if( *cursor == '\'' || *cursor == '"' )
+        {
+            quote = *cursor;
+        }
+        else if( *cursor == '(' )
+        {
+            depth++;
+        }
+        else if( *cursor == ')' && --depth == 0 )
+        {
+            return cursor;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * The first of boundaries - the positions of WHERE, GROUP, HAVING and the
+ * first trailing clause, any of which may be NULL - after clause, or end.
+ */
+static char * _clause_end( char * clause, char * end, char ** boundaries )
+{
+    char *       result = NULL;
+    unsigned int i      = 0;
+
+    result = end;
+
+    for( i = 0; i < 4; i++ )
+    {
+        if( boundaries[i] != NULL && boundaries[i] > clause && boundaries[i] < result )
+        {
+            result = boundaries[i];
+        }
+    }
+
+    return result;
+}
+/*
+ * Returns the end of the (possibly schema qualified, possibly quoted) name
+ * starting at start. end may be NULL for a NUL terminated string.
+ */
+static char * _skip_token( char * start, char * end )
+{
+    char * cursor = NULL;
+
+    cursor = start;
+
+    while( ( end == NULL || cursor < end ) && *cursor != '\0' )
+    {
+        if( *cursor == '"' )
+        {
+            cursor++;
+
+            while( ( end == NULL || cursor < end ) && *cursor != '\0' && *cursor != '"' )
+            {
+                cursor++;
+            }
+
+            if( *cursor == '"' )
+            {
+                cursor++;
+            }
+        }
+        else if( _is_word_character( *cursor ) || *cursor == '.' )
+        {
+            cursor++;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return cursor;
+}
+
+// Returns a malloc()'d copy of [start, end) without surrounding whitespace
+static char * _copy_trimmed( char * start, char * end )
+{
+    char * result = NULL;
+
+    while( start < end && isspace( ( unsigned char ) *start ) )
+    {
+        start++;
+    }
+
+    while( end > start && isspace( ( unsigned char ) end[-1] ) )
+    {
+        end--;
+    }
+
+    result = ( char * ) calloc( ( size_t ) ( end - start ) + 1, sizeof( char ) );
+
+    if( result == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate definition clause"
+        );
+
+        return NULL;
+    }
+
+    memcpy( result, start, ( size_t ) ( end - start ) );
+    return result;
+}
+
+static bool _keyword_at( char * cursor, const char * keyword, size_t length )
+{
+    size_t i = 0;
+
+    for( i = 0; i < length; i++ )
+    {
+        if( toupper( ( unsigned char ) cursor[i] ) != keyword[i] )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Whether the whole word at cursor is keyword
+static bool _word_at( char * cursor, const char * keyword )
+{
+    return _keyword_at( cursor, keyword, strlen( keyword ) )
+        && !_is_word_character( cursor[strlen( keyword )] );
+}
+
+static char * _skip_space( char * cursor )
+{
+    while( isspace( ( unsigned char ) *cursor ) )
+    {
+        cursor++;
+    }
+
+    return cursor;
+}
+
+static bool _is_word_character( char character )
+{
+    return isalnum( ( unsigned char ) character ) || character == '_' || character == '$';
+}
@@ -0,0 +1,76 @@
+#ifndef DEFINITION_H
+#define DEFINITION_H
+
+#include "util.h"
+
+#define AGGREGATE_NONE 0
+#define AGGREGATE_SUM 1
+#define AGGREGATE_COUNT 2
+#define AGGREGATE_MIN 3
+#define AGGREGATE_MAX 4
+#define AGGREGATE_OTHER 5
+
+/*
+ * One entry of a definition's FROM clause. offset and length locate the
+ * relation's name within from_clause, so that it can be replaced by a row
+ * source of the caller's choosing.
+ */
+struct definition_relation {
+    char * relation;
+    char * alias;
+    size_t offset;
+    size_t length;
+};
+
+/*
+ * One entry of a definition's select list. name is the output column's name,
+ * or NULL where it would be chosen by the server. If the entry is a single
+ * call to an aggregate, aggregate is its AGGREGATE_* kind and argument the
+ * text between its parentheses.
+ */
+struct definition_column {
+    char *         expression;
+    char *         name;
+    unsigned short aggregate;
+    char *         argument;
+};
+
+/*
+ * The parts of a maintenance_object's definition the service can reason
+ * about. Only top-level clauses are split out; anything nested in
+ * parentheses, string literals or quoted identifiers is left as written.
+ *
+ * is_select is set when the definition is a single SELECT ... FROM with at
+ * most WHERE, GROUP BY and HAVING clauses, and relations is filled in when
+ * its FROM clause is relations combined only by inner joins. is_simple is set
+ * when the definition is a projection and filter over a single relation,
+ * which allows it to be scanned in ctid ranges.
+ */
+struct definition {
+    char *                       text;
+    char *                       select_list;
+    char *                       from_clause;
+    char *                       relation;
+    char *                       alias;
+    char *                       where;
+    char *                       group_by;
+    char *                       having;
+    struct definition_column *   columns;
+    unsigned int                 num_columns;
+    struct definition_relation * relations;
+    unsigned int                 num_relations;
+    char **                      group_keys;
+    unsigned int                 num_group_keys;
+    bool                         is_select;
+    bool                         is_distinct;
+    bool                         has_aggregates;
+    bool                         is_simple;
+};
+
+extern struct definition * parse_definition( char * );
+extern void free_definition( struct definition * );
+extern bool split_column_reference( char *, char **, char ** );
+extern bool split_conjuncts( char *, char ***, unsigned int * );
+extern char * normalize_identifier( char *, char * );
+
+#endif // DEFINITION_H
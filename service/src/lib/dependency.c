@@ -0,0 +1,1208 @@
+#include "dependency.h"
+#include "progress.h"
+#include "apply.h"
+
+/*
+ * The components apply_dependency_graph() brings up to date, and the changes
+ * to base tables (those that are not the target of an object in the graph)
+ * they are brought up to date with, and the LSN of the COMMIT among them, if
+ * any.
+ */
+struct component_task {
+    struct dependency_graph * graph;
+    unsigned int *            components;
+    unsigned int              num_components;
+    struct change **          changes;
+    unsigned long             num_changes;
+    uint64_t                  commit_lsn;
+};
+
+static bool _add_edge( unsigned int **, unsigned int *, unsigned int, unsigned int );
+static bool _sort_graph( struct dependency_graph * );
+static bool _find_components( struct dependency_graph * );
+static unsigned int _find_root( unsigned int *, unsigned int );
+static bool _reads_changes( struct maintenance_object *, struct change **, unsigned long );
+static bool _apply_component(
+    struct worker *,
+    struct dependency_graph *,
+    unsigned int,
+    struct change **,
+    unsigned long,
+    uint64_t
+);
+static bool _maintain_object(
+    struct worker *,
+    struct maintenance_object *,
+    struct change **,
+    unsigned long,
+    struct change ***,
+    unsigned long *,
+    uint64_t
+);
+static bool _write_through_driver(
+    struct worker *,
+    struct maintenance_object *,
+    struct change **,
+    unsigned long,
+    struct change ***,
+    unsigned long *,
+    uint64_t
+);
+
+/*
+ * Works out which of objects are defined over the targets of others, from
+ * the relations their maintenance plans read, and orders them topologically.
+ * Objects are planned here if they have not been already, so that children
+ * forked to apply changes inherit the plans. Fails if the definitions form a
+ * cycle. objects remains the caller's and must outlive the graph.
+ */
+struct dependency_graph * build_dependency_graph(
+    struct worker *              me,
+    struct maintenance_object ** objects,
+    unsigned int                 num_objects
+)
+{
+    struct dependency_graph * graph = NULL;
+    struct ivm_plan *         plan  = NULL;
+    unsigned int              i     = 0;
+    unsigned int              j     = 0;
+    unsigned int              k     = 0;
+    unsigned int              l     = 0;
+
+    if( me == NULL || ( objects == NULL && num_objects > 0 ) )
+    {
+        return NULL;
+    }
+
+    graph = ( struct dependency_graph * ) calloc( 1, sizeof( struct dependency_graph ) );
+
+    if( graph == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate dependency graph"
+        );
+
+        return NULL;
+    }
+
+    graph->objects          = objects;
+    graph->num_objects      = num_objects;
+    graph->dependents       = ( unsigned int ** ) calloc( num_objects + 1, sizeof( unsigned int * ) );
+    graph->num_dependents   = ( unsigned int * ) calloc( num_objects + 1, sizeof( unsigned int ) );
+    graph->dependencies     = ( unsigned int ** ) calloc( num_objects + 1, sizeof( unsigned int * ) );
+    graph->num_dependencies = ( unsigned int * ) calloc( num_objects + 1, sizeof( unsigned int ) );
+    graph->order            = ( unsigned int * ) calloc( num_objects + 1, sizeof( unsigned int ) );
+    graph->levels           = ( unsigned int * ) calloc( num_objects + 1, sizeof( unsigned int ) );
+    graph->components       = ( unsigned int * ) calloc( num_objects + 1, sizeof( unsigned int ) );
+
+    if(
+            graph->dependents == NULL
+         || graph->num_dependents == NULL
+         || graph->dependencies == NULL
+         || graph->num_dependencies == NULL
+         || graph->order == NULL
+         || graph->levels == NULL
+         || graph->components == NULL
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate dependency graph"
+        );
+
+        goto failed;
+    }
+
+    for( i = 0; i < num_objects; i++ )
+    {
+        if( objects[i]->ivm == NULL )
+        {
+            objects[i]->ivm = plan_maintenance( me, objects[i] );
+
+            if( objects[i]->ivm == NULL )
+            {
+                goto failed;
+            }
+        }
+    }
+
+    for( i = 0; i < num_objects; i++ )
+    {
+        plan = ( struct ivm_plan * ) objects[i]->ivm;
+
+        for( j = 0; j < plan->num_relations; j++ )
+        {
+            for( k = 0; k < num_objects; k++ )
+            {
+                if(
+                        strcmp( objects[k]->namespace, plan->relations[j].schema_name ) != 0
+                     || strcmp( objects[k]->name, plan->relations[j].table_name ) != 0
+                  )
+                {
+                    continue;
+                }
+
+                // A target read more than once, as by a self join, is one edge
+                for( l = 0; l < graph->num_dependencies[i]; l++ )
+                {
+                    if( graph->dependencies[i][l] == k )
+                    {
+                        break;
+                    }
+                }
+
+                if( l < graph->num_dependencies[i] )
+                {
+                    continue;
+                }
+
+                if(
+                        !_add_edge( graph->dependents, graph->num_dependents, k, i )
+                     || !_add_edge( graph->dependencies, graph->num_dependencies, i, k )
+                  )
+                {
+                    goto failed;
+                }
+            }
+        }
+    }
+
+    if( !_sort_graph( graph ) || !_find_components( graph ) )
+    {
+        goto failed;
+    }
+
+    _log(
+        LOG_LEVEL_DEBUG,
+        "Dependency graph of %u objects has %u components",
+        graph->num_objects,
+        graph->num_components
+    );
+
+    return graph;
+
+failed:
+    free_dependency_graph( graph );
+    return NULL;
+}
+
+void free_dependency_graph( struct dependency_graph * graph )
+{
+    unsigned int i = 0;
+
+    if( graph == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < graph->num_objects; i++ )
+    {
+        if( graph->dependents != NULL )
+        {
+            free( graph->dependents[i] );
+        }
+
+        if( graph->dependencies != NULL )
+        {
+            free( graph->dependencies[i] );
+        }
+    }
+
+    free( graph->dependents );
+    free( graph->num_dependents );
+    free( graph->dependencies );
+    free( graph->num_dependencies );
+    free( graph->order );
+    free( graph->levels );
+    free( graph->components );
+    for( i = 0; graph->accumulators != NULL && i < graph->num_objects; i++ )
+    {
+        free_aggregate_accumulator( graph->accumulators[i] );
+    }
+
+    free( graph->freshness );
+    free( graph->accumulators );
+    free( graph );
+    return;
+}
+
+// Whether schema_name.table_name is the target of an object in graph
+bool is_derived_relation( struct dependency_graph * graph, char * schema_name, char * table_name )
+{
+    unsigned int i = 0;
+
+    if( graph == NULL || schema_name == NULL || table_name == NULL )
+    {
+        return false;
+    }
+
+    for( i = 0; i < graph->num_objects; i++ )
+    {
+        if(
+                strcmp( graph->objects[i]->namespace, schema_name ) == 0
+             && strcmp( graph->objects[i]->name, table_name ) == 0
+          )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Sets changed, which is indexed like graph's objects, for each object that
+ * changes bring up to date: those that read them and those that depend on
+ * one that does. Changes to the objects' own targets are passed over, as
+ * apply_dependency_graph() drops them.
+ */
+void find_changed_objects(
+    struct dependency_graph * graph,
+    struct change **          changes,
+    unsigned long             num_changes,
+    bool *                    changed
+)
+{
+    unsigned long i = 0;
+    unsigned int  j = 0;
+    unsigned int  k = 0;
+
+    if( graph == NULL || changed == NULL )
+    {
+        return;
+    }
+
+    memset( changed, 0, graph->num_objects * sizeof( bool ) );
+
+    for( j = 0; j < graph->num_objects; j++ )
+    {
+        k = graph->order[j];
+
+        for( i = 0; i < graph->num_dependencies[k] && !changed[k]; i++ )
+        {
+            changed[k] = changed[graph->dependencies[k][i]];
+        }
+
+        for( i = 0; i < num_changes && !changed[k]; i++ )
+        {
+            changed[k] = changes[i] != NULL
+                      && changes[i]->schema_name != NULL
+                      && changes[i]->table_name != NULL
+                      && !is_derived_relation( graph, changes[i]->schema_name, changes[i]->table_name )
+                      && _reads_changes( graph->objects[k], changes + i, 1 );
+        }
+    }
+
+    return;
+}
+
+/*
+ * Brings the objects in graph up to date with changes. Within a component,
+ * objects are maintained in topological order with maintain_changes(), or
+ * for targets of other drivers, written through the driver with the rows
+ * evaluate_changes() finds, and the rows each one removes from and adds to
+ * its target are passed straight
+ * on to its dependents as changes to that target, without a round trip
+ * through the stream. Each object commits before its dependents run, so they
+ * read its target as updated. An object that is refreshed rather than
+ * maintained has no such rows to pass on, so its dependents are refreshed
+ * after it.
+ *
+ * Changes to the objects' own targets are therefore dropped here: their
+ * effect has already been applied from the deltas, and the slot can be
+ * confirmed past them.
+ *
+ * Components with changes to apply are independent of each other, and are
+ * applied in turn over me's connection. Forking children to apply them in
+ * parallel would cost a process and a connection per batch, which on a busy
+ * stream outweighs the apply itself; a location's components are instead
+ * spread over the members of its pool, see new_fanout(), which apply them
+ * in parallel over connections they keep. They are taken earliest deadline
+ * first, see schedule_components(), so that a large object without a
+ * freshness target does not hold up small ones with a tight one.
+ *
+ * When changes end in a COMMIT, each object records its LSN as its progress,
+ * see write_object_progress(), and objects whose applied_lsn has already
+ * reached it are passed over, so a transaction streamed again after a
+ * restart is applied once.
+ *
+ * Objects with an accumulator are passed over too, as they take their
+ * changes a transaction at a time from accumulate_dependency_graph().
+ */
+bool apply_dependency_graph(
+    struct worker *           me,
+    struct dependency_graph * graph,
+    struct change **          changes,
+    unsigned long             num_changes
+)
+{
+    struct component_task task;
+    bool *                touched = NULL;
+    unsigned long         i       = 0;
+    unsigned int          j       = 0;
+    bool                  success = false;
+
+    if( me == NULL || graph == NULL || ( changes == NULL && num_changes > 0 ) )
+    {
+        return false;
+    }
+
+    memset( &task, 0, sizeof( struct component_task ) );
+
+    task.graph      = graph;
+    task.changes    = ( struct change ** ) calloc( num_changes + 1, sizeof( struct change * ) );
+    task.components = ( unsigned int * ) calloc( graph->num_components + 1, sizeof( unsigned int ) );
+    touched         = ( bool * ) calloc( graph->num_components + 1, sizeof( bool ) );
+
+    if( task.changes == NULL || task.components == NULL || touched == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate dependency graph changes"
+        );
+
+        goto cleanup;
+    }
+
+    for( i = 0; i < num_changes; i++ )
+    {
+        if( changes[i] != NULL && changes[i]->type == CHANGE_TYPE_COMMIT )
+        {
+            task.commit_lsn = changes[i]->lsn;
+        }
+
+        if(
+                changes[i] != NULL
+             && changes[i]->schema_name != NULL
+             && changes[i]->table_name != NULL
+             && !is_derived_relation( graph, changes[i]->schema_name, changes[i]->table_name )
+          )
+        {
+            task.changes[task.num_changes++] = changes[i];
+        }
+    }
+
+    for( j = 0; j < graph->num_objects && task.num_changes > 0; j++ )
+    {
+        if(
+                !touched[graph->components[j]]
+             && ( graph->accumulators == NULL || graph->accumulators[j] == NULL )
+             && _reads_changes( graph->objects[j], task.changes, task.num_changes )
+          )
+        {
+            touched[graph->components[j]] = true;
+        }
+    }
+
+    for( j = 0; j < graph->num_components; j++ )
+    {
+        if( touched[j] )
+        {
+            task.components[task.num_components++] = j;
+        }
+    }
+
+    schedule_components( graph, task.components, task.num_components );
+
+    for( j = 0; j < task.num_components; j++ )
+    {
+        if(
+                !_apply_component(
+                    me,
+                    graph,
+                    task.components[j],
+                    task.changes,
+                    task.num_changes,
+                    task.commit_lsn
+                )
+          )
+        {
+            goto cleanup;
+        }
+    }
+
+    success = true;
+
+cleanup:
+    free( task.changes );
+    free( task.components );
+    free( touched );
+    return success;
+}
+
+/*
+ * Sets up an accumulator, see new_aggregate_accumulator(), for each object of
+ * graph that can have its deltas kept in memory and flushed now and then: a
+ * grouping kept by the postgresql driver that reads no other object's target
+ * and that no other object reads, as its flushes have no deltas to pass on.
+ * Objects that cannot be accumulated are left to apply_dependency_graph().
+ */
+bool add_graph_accumulators( struct worker * me, struct dependency_graph * graph )
+{
+    struct maintenance_object * object = NULL;
+    unsigned int                i      = 0;
+
+    if( me == NULL || graph == NULL )
+    {
+        return false;
+    }
+
+    graph->accumulators = ( struct aggregate_accumulator ** ) calloc(
+        graph->num_objects + 1,
+        sizeof( struct aggregate_accumulator * )
+    );
+
+    if( graph->accumulators == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate dependency graph accumulators"
+        );
+
+        return false;
+    }
+
+    for( i = 0; i < graph->num_objects; i++ )
+    {
+        object = graph->objects[i];
+
+        if(
+                object->driver != DRIVER_POSTGRESQL
+             || ( ( struct ivm_plan * ) object->ivm )->kind != IVM_KIND_AGGREGATE
+             || graph->num_dependencies[i] > 0
+             || graph->num_dependents[i] > 0
+          )
+        {
+            continue;
+        }
+
+        graph->accumulators[i] = new_aggregate_accumulator( me, object );
+
+        if( graph->accumulators[i] != NULL )
+        {
+            _log(
+                LOG_LEVEL_INFO,
+                "Accumulating deltas of %s in memory",
+                object->qualified_name
+            );
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Adds a transaction's changes, including its COMMIT, to the accumulators of
+ * graph. They are taken as decoded, before they are coalesced, so that every
+ * row a transaction removed and added is counted, see accumulate_changes().
+ */
+bool accumulate_dependency_graph( struct dependency_graph * graph, struct change ** changes, unsigned long num_changes )
+{
+    unsigned int i = 0;
+
+    if( graph == NULL )
+    {
+        return false;
+    }
+
+    for( i = 0; graph->accumulators != NULL && i < graph->num_objects; i++ )
+    {
+        if( graph->accumulators[i] != NULL && !accumulate_changes( graph->accumulators[i], changes, num_changes ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Flushes the accumulators of graph that are due, see accumulator_flush_due(),
+ * or with force, all those with committed deltas.
+ */
+bool flush_dependency_graph( struct worker * me, struct dependency_graph * graph, bool force )
+{
+    struct aggregate_accumulator * accumulator = NULL;
+    unsigned int                   i           = 0;
+
+    if( me == NULL || graph == NULL )
+    {
+        return false;
+    }
+
+    for( i = 0; graph->accumulators != NULL && i < graph->num_objects; i++ )
+    {
+        accumulator = graph->accumulators[i];
+
+        if(
+                accumulator != NULL
+             && ( force ? accumulator->pending_lsn != accumulator->flushed_lsn : accumulator_flush_due( accumulator ) )
+             && !flush_accumulator( me, accumulator )
+          )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * How far the slot may be confirmed once changes up to lsn are applied: no
+ * further than the last flush of an accumulator that holds deltas it has not
+ * flushed, as those would be lost with the process.
+ */
+uint64_t dependency_graph_flushed_lsn( struct dependency_graph * graph, uint64_t lsn )
+{
+    struct aggregate_accumulator * accumulator = NULL;
+    unsigned int                   i           = 0;
+
+    for( i = 0; graph != NULL && graph->accumulators != NULL && i < graph->num_objects; i++ )
+    {
+        accumulator = graph->accumulators[i];
+
+        if(
+                accumulator != NULL
+             && accumulator->pending_lsn != accumulator->flushed_lsn
+             && accumulator->flushed_lsn < lsn
+          )
+        {
+            lsn = accumulator->flushed_lsn;
+        }
+    }
+
+    return lsn;
+}
+
+static bool _add_edge( unsigned int ** lists, unsigned int * counts, unsigned int from, unsigned int to )
+{
+    unsigned int * grown = NULL;
+
+    grown = ( unsigned int * ) realloc( lists[from], ( counts[from] + 1 ) * sizeof( unsigned int ) );
+
+    if( grown == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate dependency graph edge"
+        );
+
+        return false;
+    }
+
+    lists[from]                 = grown;
+    lists[from][counts[from]++] = to;
+    return true;
+}
+
+/*
+ * Kahn's algorithm: objects are appended to order once everything they
+ * depend on is, starting with those that depend on nothing. Whatever is left
+ * over lies on or downstream of a cycle.
+ */
+static bool _sort_graph( struct dependency_graph * graph )
+{
+    unsigned int * pending = NULL;
+    unsigned int   head    = 0;
+    unsigned int   tail    = 0;
+    unsigned int   object  = 0;
+    unsigned int   i       = 0;
+    unsigned int   j       = 0;
+
+    pending = ( unsigned int * ) calloc( graph->num_objects + 1, sizeof( unsigned int ) );
+
+    if( pending == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate dependency graph order"
+        );
+
+        return false;
+    }
+
+    for( i = 0; i < graph->num_objects; i++ )
+    {
+        pending[i] = graph->num_dependencies[i];
+
+        if( pending[i] == 0 )
+        {
+            graph->order[tail++] = i;
+        }
+    }
+
+    for( head = 0; head < tail; head++ )
+    {
+        object = graph->order[head];
+
+        for( j = 0; j < graph->num_dependents[object]; j++ )
+        {
+            i = graph->dependents[object][j];
+
+            if( graph->levels[i] < graph->levels[object] + 1 )
+            {
+                graph->levels[i] = graph->levels[object] + 1;
+            }
+
+            if( --pending[i] == 0 )
+            {
+                graph->order[tail++] = i;
+            }
+        }
+    }
+
+    for( i = 0; tail < graph->num_objects && i < graph->num_objects; i++ )
+    {
+        if( pending[i] > 0 )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "%s depends on itself through its definition",
+                graph->objects[i]->qualified_name
+            );
+        }
+    }
+
+    free( pending );
+    return tail == graph->num_objects;
+}
+
+/*
+ * Union-find over the edges, then numbers the roots and works out each
+ * component's freshness
+ */
+static bool _find_components( struct dependency_graph * graph )
+{
+    unsigned int * parents = NULL;
+    unsigned int   left    = 0;
+    unsigned int   right   = 0;
+    unsigned int   i       = 0;
+    unsigned int   j       = 0;
+
+    parents = ( unsigned int * ) calloc( graph->num_objects + 1, sizeof( unsigned int ) );
+
+    if( parents == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate dependency graph components"
+        );
+
+        return false;
+    }
+
+    for( i = 0; i < graph->num_objects; i++ )
+    {
+        parents[i] = i;
+    }
+
+    for( i = 0; i < graph->num_objects; i++ )
+    {
+        for( j = 0; j < graph->num_dependents[i]; j++ )
+        {
+            left  = _find_root( parents, i );
+            right = _find_root( parents, graph->dependents[i][j] );
+
+            if( left != right )
+            {
+                parents[right] = left;
+            }
+        }
+    }
+
+    graph->num_components = 0;
+
+    for( i = 0; i < graph->num_objects; i++ )
+    {
+        if( parents[i] == i )
+        {
+            graph->components[i] = graph->num_components++;
+        }
+    }
+
+    for( i = 0; i < graph->num_objects; i++ )
+    {
+        graph->components[i] = graph->components[_find_root( parents, i )];
+    }
+
+    free( parents );
+
+    graph->freshness = ( uint64_t * ) calloc( graph->num_components + 1, sizeof( uint64_t ) );
+
+    if( graph->freshness == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate dependency graph components"
+        );
+
+        return false;
+    }
+
+    for( i = 0; i < graph->num_objects; i++ )
+    {
+        j = graph->components[i];
+
+        if(
+                graph->objects[i]->freshness_ms > 0
+             && ( graph->freshness[j] == 0 || graph->objects[i]->freshness_ms < graph->freshness[j] )
+          )
+        {
+            graph->freshness[j] = graph->objects[i]->freshness_ms;
+        }
+    }
+
+    return true;
+}
+
+static unsigned int _find_root( unsigned int * parents, unsigned int index )
+{
+    while( parents[index] != index )
+    {
+        parents[index] = parents[parents[index]];
+        index          = parents[index];
+    }
+
+    return index;
+}
+
+/*
+ * Orders components earliest deadline first. The changes to apply have
+ * been waiting since the same COMMIT for every one of them, so their
+ * deadlines fall in the order of their freshness; those without one come
+ * last, each group in the order of the graph. Insertion sort, as there
+ * are seldom more than a handful.
+ */
+void schedule_components( struct dependency_graph * graph, unsigned int * components, unsigned int num_components )
+{
+    unsigned int component = 0;
+    uint64_t     deadline  = 0;
+    unsigned int i         = 0;
+    unsigned int j         = 0;
+
+    for( i = 1; i < num_components; i++ )
+    {
+        component = components[i];
+        deadline  = graph->freshness[component] > 0 ? graph->freshness[component] : UINT64_MAX;
+
+        for( j = i; j > 0; j-- )
+        {
+            if(
+                    ( graph->freshness[components[j - 1]] > 0 ? graph->freshness[components[j - 1]] : UINT64_MAX )
+                 <= deadline
+              )
+            {
+                break;
+            }
+
+            components[j] = components[j - 1];
+        }
+
+        components[j] = component;
+    }
+
+    return;
+}
+
+// Whether maintain_changes() would do anything for object with changes
+static bool _reads_changes( struct maintenance_object * object, struct change ** changes, unsigned long num_changes )
+{
+    struct ivm_plan * plan = NULL;
+    unsigned long     i    = 0;
+    unsigned int      j    = 0;
+
+    plan = ( struct ivm_plan * ) object->ivm;
+
+    for( i = 0; i < num_changes; i++ )
+    {
+        if( changes[i] == NULL || changes[i]->schema_name == NULL || changes[i]->table_name == NULL )
+        {
+            continue;
+        }
+
+        // Unsupported definitions whose relations are unknown are refreshed on any change
+        if( plan->num_relations == 0 )
+        {
+            return true;
+        }
+
+        for( j = 0; j < plan->num_relations; j++ )
+        {
+            if(
+                    strcmp( changes[i]->schema_name, plan->relations[j].schema_name ) == 0
+                 && strcmp( changes[i]->table_name, plan->relations[j].table_name ) == 0
+              )
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Maintains the objects of one component in topological order. Each is given
+ * the base table changes followed by the deltas of the objects it depends
+ * on, which are kept until the component is done. Objects nothing depends on
+ * do not collect deltas.
+ *
+ * With a commit_lsn, an object is maintained and its progress recorded in
+ * one transaction, so the target holds the changes exactly when it holds the
+ * progress. A refresh commits on its own, and its progress is recorded after
+ * it; applying the transaction again after a crash in between refreshes from
+ * the same tables again, to the same rows. An object that was already
+ * applied is skipped and has no deltas to pass on. Its dependents that are
+ * not yet applied only miss them if it would have had some, because what it
+ * reads changed; only then are they refreshed, as after a refresh.
+ */
+static bool _apply_component(
+    struct worker *           me,
+    struct dependency_graph * graph,
+    unsigned int              component,
+    struct change **          changes,
+    unsigned long             num_changes,
+    uint64_t                  commit_lsn
+)
+{
+    struct change ***           deltas     = NULL;
+    unsigned long *             num_deltas = NULL;
+    bool *                      refreshed  = NULL;
+    bool *                      skipped    = NULL;
+    struct change **            input      = NULL;
+    struct change **            grown      = NULL;
+    struct maintenance_object * object     = NULL;
+    unsigned long               num_input  = 0;
+    unsigned long               i          = 0;
+    unsigned int                j          = 0;
+    unsigned int                k          = 0;
+    unsigned int                dependency = 0;
+    bool                        refresh    = false;
+    bool                        success    = false;
+
+    deltas     = ( struct change *** ) calloc( graph->num_objects + 1, sizeof( struct change ** ) );
+    num_deltas = ( unsigned long * ) calloc( graph->num_objects + 1, sizeof( unsigned long ) );
+    refreshed  = ( bool * ) calloc( graph->num_objects + 1, sizeof( bool ) );
+    skipped    = ( bool * ) calloc( graph->num_objects + 1, sizeof( bool ) );
+
+    if( deltas == NULL || num_deltas == NULL || refreshed == NULL || skipped == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate deltas of dependency graph component %u",
+            component
+        );
+
+        goto cleanup;
+    }
+
+    for( j = 0; j < graph->num_objects; j++ )
+    {
+        k = graph->order[j];
+
+        // Accumulated objects have taken their changes already, see accumulate_dependency_graph()
+        if(
+                graph->components[k] != component
+             || ( graph->accumulators != NULL && graph->accumulators[k] != NULL )
+          )
+        {
+            continue;
+        }
+
+        object    = graph->objects[k];
+        refresh   = false;
+        num_input = num_changes;
+
+        // Set only if it would have had deltas, see above
+        if( commit_lsn > 0 && object->applied_lsn >= commit_lsn )
+        {
+            skipped[k] = _reads_changes( object, changes, num_changes );
+
+            for( i = 0; i < graph->num_dependencies[k] && !skipped[k]; i++ )
+            {
+                dependency = graph->dependencies[k][i];
+                skipped[k] = refreshed[dependency] || skipped[dependency] || num_deltas[dependency] > 0;
+            }
+
+            _log(
+                LOG_LEVEL_DEBUG,
+                "Skipping %s, already applied up to " LSN_FORMAT,
+                object->qualified_name,
+                LSN_FORMAT_ARGS( object->applied_lsn )
+            );
+
+            continue;
+        }
+
+        for( i = 0; i < graph->num_dependencies[k]; i++ )
+        {
+            num_input += num_deltas[graph->dependencies[k][i]];
+        }
+
+        grown = ( struct change ** ) realloc( input, ( num_input + 1 ) * sizeof( struct change * ) );
+
+        if( grown == NULL )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to allocate changes to %s",
+                object->qualified_name
+            );
+
+            goto cleanup;
+        }
+
+        input     = grown;
+        num_input = num_changes;
+
+        if( num_changes > 0 )
+        {
+            memcpy( input, changes, num_changes * sizeof( struct change * ) );
+        }
+
+        for( i = 0; i < graph->num_dependencies[k]; i++ )
+        {
+            dependency = graph->dependencies[k][i];
+
+            if( refreshed[dependency] || skipped[dependency] )
+            {
+                refresh = true;
+            }
+
+            if( num_deltas[dependency] > 0 )
+            {
+                memcpy(
+                    input + num_input,
+                    deltas[dependency],
+                    num_deltas[dependency] * sizeof( struct change * )
+                );
+                num_input += num_deltas[dependency];
+            }
+        }
+
+        if( refresh || ( ( struct ivm_plan * ) object->ivm )->kind == IVM_KIND_UNSUPPORTED )
+        {
+            if( refresh || _reads_changes( object, input, num_input ) )
+            {
+                if( !refresh_maintenance_object( me, object, NULL ) )
+                {
+                    goto cleanup;
+                }
+
+                if( commit_lsn > 0 )
+                {
+                    if( !write_object_progress( me, object, commit_lsn ) )
+                    {
+                        goto cleanup;
+                    }
+
+                    object->applied_lsn = commit_lsn;
+                }
+
+                refreshed[k] = true;
+            }
+
+            continue;
+        }
+
+        // Nothing to maintain, nor any progress worth a round trip to record
+        if( !_reads_changes( object, input, num_input ) )
+        {
+            continue;
+        }
+
+        me->sql_state[0] = '\0';
+
+        // A target whose layout changed under its statements is described again, and maintained once more
+        if(
+                !_maintain_object(
+                    me,
+                    object,
+                    input,
+                    num_input,
+                    graph->num_dependents[k] > 0 ? &( deltas[k] ) : NULL,
+                    &( num_deltas[k] ),
+                    commit_lsn
+                )
+             && !(
+                     redescribe_after_failure( me, object )
+                  && _maintain_object(
+                         me,
+                         object,
+                         input,
+                         num_input,
+                         graph->num_dependents[k] > 0 ? &( deltas[k] ) : NULL,
+                         &( num_deltas[k] ),
+                         commit_lsn
+                     )
+                 )
+          )
+        {
+            goto cleanup;
+        }
+
+        if( commit_lsn > 0 )
+        {
+            object->applied_lsn = commit_lsn;
+        }
+
+        _log(
+            LOG_LEVEL_DEBUG,
+            "Maintained %s (level %u), passing %lu deltas to %u dependents",
+            object->qualified_name,
+            graph->levels[k],
+            num_deltas[k],
+            graph->num_dependents[k]
+        );
+    }
+
+    success = true;
+
+cleanup:
+    for( j = 0; deltas != NULL && num_deltas != NULL && j < graph->num_objects; j++ )
+    {
+        for( i = 0; i < num_deltas[j]; i++ )
+        {
+            free_change( deltas[j][i] );
+        }
+
+        free( deltas[j] );
+    }
+
+    free( deltas );
+    free( num_deltas );
+    free( refreshed );
+    free( skipped );
+    free( input );
+    return success;
+}
+
+/*
+ * Maintains object with changes and, given a commit_lsn, records it as the
+ * object's progress in the same transaction. The transaction is that of a
+ * batch of the postgresql driver, which begins one unless the caller has one
+ * open, and maintain_changes() runs in place of its apply_batch. Deltas are
+ * appended as by maintain_changes(); on failure those appended here are
+ * dropped, and the batch rolled back. Targets of drivers other than
+ * postgresql, and remote ones, whose definitions cannot be run where they
+ * are written, are written through their driver instead, see
+ * _write_through_driver().
+ */
+static bool _maintain_object(
+    struct worker *             me,
+    struct maintenance_object * object,
+    struct change **            changes,
+    unsigned long               num_changes,
+    struct change ***           deltas,
+    unsigned long *             num_deltas,
+    uint64_t                    commit_lsn
+)
+{
+    struct target_driver * driver      = NULL;
+    unsigned long          i           = 0;
+    unsigned long          first_delta = 0;
+    bool                   success     = false;
+
+    if( object->driver != DRIVER_POSTGRESQL || object->remote )
+    {
+        return _write_through_driver( me, object, changes, num_changes, deltas, num_deltas, commit_lsn );
+    }
+
+    if( !open_target( me, object ) )
+    {
+        return false;
+    }
+
+    driver      = ( struct target_driver * ) object->target_driver;
+    first_delta = *num_deltas;
+
+    if( !driver->begin_batch( object->target, me, object ) )
+    {
+        return false;
+    }
+
+    success = maintain_changes( me, object, changes, num_changes, deltas, num_deltas )
+           && ( commit_lsn == 0 || write_object_progress( me, object, commit_lsn ) );
+
+    if( !driver->commit_batch( object->target, me, object, success ) )
+    {
+        success = false;
+    }
+
+    if( !success && deltas != NULL )
+    {
+        for( i = first_delta; i < *num_deltas; i++ )
+        {
+            free_change( ( *deltas )[i] );
+        }
+
+        *num_deltas = first_delta;
+    }
+
+    return success;
+}
+
+/*
+ * Evaluates the rows of object's definition that changes affect on the
+ * connection to the source, me's own unless it has a separate one, see
+ * struct worker and evaluate_changes(), and writes them to its target as one
+ * batch through its driver, see apply_changes(). They are also appended to
+ * deltas, if given, for the object's dependents.
+ *
+ * Given a commit_lsn, it is recorded as the object's progress on me's
+ * connection once the batch is written. The target takes no part in that
+ * transaction, so after a crash in between the batch is written again,
+ * which sets and deletes the same entries.
+ */
+static bool _write_through_driver(
+    struct worker *             me,
+    struct maintenance_object * object,
+    struct change **            changes,
+    unsigned long               num_changes,
+    struct change ***           deltas,
+    unsigned long *             num_deltas,
+    uint64_t                    commit_lsn
+)
+{
+    struct change ** rows     = NULL;
+    struct change ** grown    = NULL;
+    unsigned long    num_rows = 0;
+    unsigned long    i        = 0;
+    bool             success  = false;
+
+    success = evaluate_changes( me->source != NULL ? me->source : me, object, changes, num_changes, &rows, &num_rows )
+           && ( num_rows == 0 || apply_changes( me, object, rows, num_rows ) )
+           && ( commit_lsn == 0 || write_object_progress( me, object, commit_lsn ) );
+
+    if( success && deltas != NULL && num_rows > 0 )
+    {
+        grown = ( struct change ** ) realloc( *deltas, ( *num_deltas + num_rows ) * sizeof( struct change * ) );
+
+        if( grown == NULL )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to allocate deltas of %s",
+                object->qualified_name
+            );
+
+            success = false;
+        }
+        else
+        {
+            memcpy( grown + *num_deltas, rows, num_rows * sizeof( struct change * ) );
+            *deltas      = grown;
+            *num_deltas += num_rows;
+            num_rows     = 0;
+        }
+    }
+
+    for( i = 0; i < num_rows; i++ )
+    {
+        free_change( rows[i] );
+    }
+
+    free( rows );
+    return success;
+}
@@ -0,0 +1,65 @@
+#ifndef DEPENDENCY_H
+#define DEPENDENCY_H
+
+#include "util.h"
+#include "query.h"
+#include "change.h"
+#include "object.h"
+#include "ivm.h"
+#include "refresh.h"
+#include "accumulator.h"
+
+/*
+ * Which maintenance_objects are defined over the targets of others. An edge
+ * runs from an object to each of its dependents, the objects whose
+ * definitions read its target. order lists the objects so that every object
+ * comes after those it depends on, and level is the length of the longest
+ * path to an object from one that depends on nothing. Objects connected by
+ * edges in either direction share a component; objects in different
+ * components never read each other's targets. freshness is the tightest
+ * freshness_ms of each component's objects, 0 if none of them has one.
+ * accumulators is set up by add_graph_accumulators() in the process that
+ * applies changes, and holds the accumulator of each object whose deltas
+ * are kept in memory, NULL for the others.
+ */
+struct dependency_graph {
+    struct maintenance_object **    objects;
+    unsigned int                    num_objects;
+    unsigned int **                 dependents;
+    unsigned int *                  num_dependents;
+    unsigned int **                 dependencies;
+    unsigned int *                  num_dependencies;
+    unsigned int *                  order;
+    unsigned int *                  levels;
+    unsigned int *                  components;
+    unsigned int                    num_components;
+    uint64_t *                      freshness;
+    struct aggregate_accumulator ** accumulators;
+};
+
+extern struct dependency_graph * build_dependency_graph(
+    struct worker *,
+    struct maintenance_object **,
+    unsigned int
+);
+extern void free_dependency_graph( struct dependency_graph * );
+extern bool is_derived_relation( struct dependency_graph *, char *, char * );
+extern void find_changed_objects(
+    struct dependency_graph *,
+    struct change **,
+    unsigned long,
+    bool *
+);
+extern void schedule_components( struct dependency_graph *, unsigned int *, unsigned int );
+extern bool apply_dependency_graph(
+    struct worker *,
+    struct dependency_graph *,
+    struct change **,
+    unsigned long
+);
+extern bool add_graph_accumulators( struct worker *, struct dependency_graph * );
+extern bool accumulate_dependency_graph( struct dependency_graph *, struct change **, unsigned long );
+extern bool flush_dependency_graph( struct worker *, struct dependency_graph *, bool );
+extern uint64_t dependency_graph_flushed_lsn( struct dependency_graph *, uint64_t );
+
+#endif // DEPENDENCY_H
@@ -0,0 +1,381 @@
+#include "driver.h"
+#include "apply.h"
+#include "memcached.h"
+
+char * driver_directory = NULL;
+
+static const char * driver_query = "\
+    SELECT name \
+      FROM %s.tb_driver \
+     WHERE driver = $1::INTEGER";
+
+// Registered drivers, and those tb_driver rows have been resolved to
+static struct target_driver * drivers[MAX_TARGET_DRIVERS]       = { NULL };
+static struct target_driver * bound_drivers[MAX_TARGET_DRIVERS] = { NULL };
+static unsigned int           bound_ids[MAX_TARGET_DRIVERS]     = { 0 };
+static unsigned int           num_drivers                       = 0;
+static unsigned int           num_bound                         = 0;
+static bool                   drivers_loaded                    = false;
+
+static void _load_drivers( void );
+
+/*
+ * Adds driver to those objects can be maintained through. Its name must be
+ * unique, it must be built against this TARGET_DRIVER_API_VERSION, and it
+ * must provide either all of the refresh hooks or none.
+ */
+bool register_target_driver( struct target_driver * driver )
+{
+    unsigned int i = 0;
+
+    if( driver == NULL || driver->name == NULL )
+    {
+        return false;
+    }
+
+    if( driver->api_version != TARGET_DRIVER_API_VERSION )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Driver %s was built for driver API version %u, not %u",
+            driver->name,
+            driver->api_version,
+            TARGET_DRIVER_API_VERSION
+        );
+
+        return false;
+    }
+
+    if(
+            driver->open == NULL
+         || driver->begin_batch == NULL
+         || driver->apply_batch == NULL
+         || driver->commit_batch == NULL
+         || driver->close == NULL
+         || ( driver->refresh_begin == NULL ) != ( driver->refresh_chunk == NULL )
+         || ( driver->refresh_begin == NULL ) != ( driver->refresh_end == NULL )
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Driver %s does not implement the driver API",
+            driver->name
+        );
+
+        return false;
+    }
+
+    for( i = 0; i < num_drivers; i++ )
+    {
+        if( strcmp( drivers[i]->name, driver->name ) == 0 )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "A driver named %s is already registered",
+                driver->name
+            );
+
+            return false;
+        }
+    }
+
+    if( num_drivers == MAX_TARGET_DRIVERS )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Cannot register driver %s, %d are already registered",
+            driver->name,
+            MAX_TARGET_DRIVERS
+        );
+
+        return false;
+    }
+
+    drivers[num_drivers++] = driver;
+
+    _log(
+        LOG_LEVEL_DEBUG,
+        "Registered target driver %s",
+        driver->name
+    );
+
+    return true;
+}
+
+/*
+ * Loads and registers the driver exported by each TARGET_DRIVER_SUFFIX file
+ * in directory. The libraries stay loaded for the life of the process. The
+ * service's own functions, such as _log(), are resolved against the
+ * executable, which exports them for this. Returns false if any of the files
+ * could not be loaded.
+ */
+bool load_target_drivers( char * directory )
+{
+    DIR *                  dir     = NULL;
+    struct dirent *        entry   = NULL;
+    struct string_buffer * path    = NULL;
+    struct target_driver * driver  = NULL;
+    void *                 library = NULL;
+    size_t                 length  = 0;
+    size_t                 suffix  = 0;
+    bool                   success = true;
+
+    if( directory == NULL )
+    {
+        return false;
+    }
+
+    dir  = opendir( directory );
+    path = new_string_buffer();
+
+    if( dir == NULL || path == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to open driver directory %s: %s",
+            directory,
+            dir == NULL ? strerror( errno ) : "out of memory"
+        );
+
+        if( dir != NULL )
+        {
+            closedir( dir );
+        }
+
+        free_string_buffer( path );
+        return false;
+    }
+
+    suffix = strlen( TARGET_DRIVER_SUFFIX );
+
+    while( ( entry = readdir( dir ) ) != NULL )
+    {
+        length = strlen( entry->d_name );
+
+        if( length <= suffix || strcmp( entry->d_name + length - suffix, TARGET_DRIVER_SUFFIX ) != 0 )
+        {
+            continue;
+        }
+
+        string_buffer_reset( path );
+        string_buffer_append( path, "%s/%s", directory, entry->d_name );
+
+        library = dlopen( path->data, RTLD_NOW | RTLD_LOCAL );
+
+        if( library == NULL )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to load driver %s: %s",
+                path->data,
+                dlerror()
+            );
+
+            success = false;
+            continue;
+        }
+
+        driver = ( struct target_driver * ) dlsym( library, TARGET_DRIVER_SYMBOL );
+
+        if( driver == NULL || !register_target_driver( driver ) )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "%s does not export a usable %s",
+                path->data,
+                TARGET_DRIVER_SYMBOL
+            );
+
+            dlclose( library );
+            success = false;
+            continue;
+        }
+
+        _log(
+            LOG_LEVEL_INFO,
+            "Loaded target driver %s from %s",
+            driver->name,
+            path->data
+        );
+    }
+
+    closedir( dir );
+    free_string_buffer( path );
+    return success;
+}
+
+/*
+ * The driver the tb_driver row numbered driver names. Drivers are registered
+ * on first use, the built in ones and then any in driver_directory.
+ */
+struct target_driver * find_target_driver( struct worker * me, unsigned int driver )
+{
+    struct target_driver * result    = NULL;
+    struct string_buffer * query     = NULL;
+    PGresult *             rows      = NULL;
+    char *                 schema    = NULL;
+    char *                 params[1] = { NULL };
+    char                   id[16];
+    unsigned int           i         = 0;
+
+    if( me == NULL )
+    {
+        return NULL;
+    }
+
+    if( !drivers_loaded )
+    {
+        _load_drivers();
+    }
+
+    for( i = 0; i < num_bound; i++ )
+    {
+        if( bound_ids[i] == driver )
+        {
+            return bound_drivers[i];
+        }
+    }
+
+    schema = get_extension_schema( me );
+    query  = new_string_buffer();
+
+    if( schema == NULL || query == NULL )
+    {
+        free_string_buffer( query );
+        return NULL;
+    }
+
+    snprintf( id, sizeof( id ), "%u", driver );
+    params[0] = id;
+    string_buffer_append( query, driver_query, schema );
+
+    rows = _execute_query( me, query->data, params, 1 );
+    free_string_buffer( query );
+
+    if( rows == NULL )
+    {
+        return NULL;
+    }
+
+    if( PQntuples( rows ) != 1 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Driver %u is not in tb_driver",
+            driver
+        );
+
+        PQclear( rows );
+        return NULL;
+    }
+
+    for( i = 0; i < num_drivers && result == NULL; i++ )
+    {
+        if( strcmp( drivers[i]->name, PQgetvalue( rows, 0, 0 ) ) == 0 )
+        {
+            result = drivers[i];
+        }
+    }
+
+    if( result == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "No driver named %s (tb_driver %u) is loaded",
+            PQgetvalue( rows, 0, 0 ),
+            driver
+        );
+    }
+    else if( num_bound < MAX_TARGET_DRIVERS )
+    {
+        bound_ids[num_bound]     = driver;
+        bound_drivers[num_bound] = result;
+        num_bound++;
+    }
+
+    PQclear( rows );
+    return result;
+}
+
+/*
+ * Opens object's target through its driver, unless it is already open in
+ * this process. A handle inherited from the parent of a forked child is left
+ * to the parent rather than closed, as closing it could act on the parent's
+ * connection.
+ */
+bool open_target( struct worker * me, struct maintenance_object * object )
+{
+    struct target_driver * driver = NULL;
+    void *                 target = NULL;
+
+    if( me == NULL || object == NULL )
+    {
+        return false;
+    }
+
+    if( object->target != NULL && object->target_pid == getpid() )
+    {
+        return true;
+    }
+
+    object->target        = NULL;
+    object->target_driver = NULL;
+    driver                = find_target_driver( me, object->driver );
+
+    if( driver == NULL )
+    {
+        return false;
+    }
+
+    target = driver->open( me, object );
+
+    if( target == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to open %s.%s through driver %s",
+            object->namespace,
+            object->name,
+            driver->name
+        );
+
+        return false;
+    }
+
+    object->target        = target;
+    object->target_driver = driver;
+    object->target_pid    = getpid();
+    return true;
+}
+
+void close_target( struct maintenance_object * object )
+{
+    if( object == NULL || object->target == NULL || object->target_driver == NULL )
+    {
+        return;
+    }
+
+    if( object->target_pid == getpid() )
+    {
+        ( ( struct target_driver * ) object->target_driver )->close( object->target );
+    }
+
+    object->target        = NULL;
+    object->target_driver = NULL;
+    return;
+}
+
+static void _load_drivers( void )
+{
+    drivers_loaded = true;
+
+    register_target_driver( &postgresql_driver );
+    register_target_driver( &memcached_driver );
+
+    if( driver_directory != NULL )
+    {
+        load_target_drivers( driver_directory );
+    }
+
+    return;
+}
@@ -0,0 +1,64 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include "util.h"
+#include "query.h"
+#include "change.h"
+#include "object.h"
+#include <dlfcn.h>
+
+#define TARGET_DRIVER_API_VERSION 1
+#define TARGET_DRIVER_SYMBOL "pg_ctblmgr_target_driver"
+#define TARGET_DRIVER_SUFFIX ".so"
+#define MAX_TARGET_DRIVERS 32
+
+extern char * driver_directory;
+
+/*
+ * A kind of target objects are maintained into, named as in tb_driver. A
+ * driver is either built in or loaded from driver_directory, where each
+ * shared object exports one of these as TARGET_DRIVER_SYMBOL.
+ *
+ * open returns the handle every other call receives along with the object
+ * and the worker calling, or NULL on failure; the handle is kept in the
+ * object's target until close. Each forked child opens its own.
+ *
+ * Changes reach a driver a batch at a time: begin_batch, then apply_batch
+ * with the batch's changes to the object's relation, in stream order, then
+ * commit_batch, which is told whether the batch is to be kept. A driver that
+ * cannot take a batch back should make apply_batch safe to repeat, as the
+ * batch will be delivered again.
+ *
+ * A refresh is refresh_begin, then refresh_chunk with rows of the object's
+ * definition in COPY text format from any number of children at once (each
+ * through its own handle), then refresh_end, told whether all chunks were
+ * delivered. Drivers that leave these NULL cannot be refreshed. postgresql
+ * does, as refresh_maintenance_object() rebuilds its targets itself, copying
+ * between the connections directly or swapping in a shadow table.
+ */
+struct target_driver {
+    unsigned int api_version;
+    const char * name;
+    void *       ( * open )( struct worker *, struct maintenance_object * );
+    bool         ( * begin_batch )( void *, struct worker *, struct maintenance_object * );
+    bool         ( * apply_batch )(
+        void *,
+        struct worker *,
+        struct maintenance_object *,
+        struct change **,
+        unsigned long
+    );
+    bool         ( * commit_batch )( void *, struct worker *, struct maintenance_object *, bool );
+    bool         ( * refresh_begin )( void *, struct worker *, struct maintenance_object * );
+    bool         ( * refresh_chunk )( void *, struct worker *, struct maintenance_object *, char *, size_t );
+    bool         ( * refresh_end )( void *, struct worker *, struct maintenance_object *, bool );
+    void         ( * close )( void * );
+};
+
+extern bool register_target_driver( struct target_driver * );
+extern bool load_target_drivers( char * );
+extern struct target_driver * find_target_driver( struct worker *, unsigned int );
+extern bool open_target( struct worker *, struct maintenance_object * );
+extern void close_target( struct maintenance_object * );
+
+#endif // DRIVER_H
@@ -0,0 +1,511 @@
+#include "event.h"
+
+static struct event_handler * _set_handler( struct event_loop *, int, event_callback, void *, bool );
+static bool _dispatch( struct event_loop *, struct event_handler *, uint32_t );
+static bool _read_signals( struct event_loop * );
+
+struct event_loop * new_event_loop( void )
+{
+    struct event_loop * loop = NULL;
+
+    loop = ( struct event_loop * ) calloc( 1, sizeof( struct event_loop ) );
+
+    if( loop == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate event loop"
+        );
+
+        return NULL;
+    }
+
+    loop->signal_fd = -1;
+    loop->epoll_fd  = epoll_create1( EPOLL_CLOEXEC );
+
+    if( loop->epoll_fd < 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to create event loop: %s",
+            strerror( errno )
+        );
+
+        free( loop );
+        return NULL;
+    }
+
+    sigemptyset( &( loop->signals ) );
+    return loop;
+}
+
+/*
+ * Calls callback with argument whenever fd is ready for any of events, which
+ * are those of epoll_ctl(2) and may include EPOLLET.
+ */
+bool add_event( struct event_loop * loop, int fd, uint32_t events, event_callback callback, void * argument )
+{
+    struct epoll_event event = {0};
+
+    if( loop == NULL || fd < 0 || callback == NULL )
+    {
+        return false;
+    }
+
+    if( _set_handler( loop, fd, callback, argument, false ) == NULL )
+    {
+        return false;
+    }
+
+    event.events  = events;
+    event.data.fd = fd;
+
+    if( epoll_ctl( loop->epoll_fd, EPOLL_CTL_ADD, fd, &event ) != 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to watch descriptor %d: %s",
+            fd,
+            strerror( errno )
+        );
+
+        free( loop->handlers[fd] );
+        loop->handlers[fd] = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+// Changes the events fd is watched for
+bool modify_event( struct event_loop * loop, int fd, uint32_t events )
+{
+    struct epoll_event event = {0};
+
+    if( loop == NULL || fd < 0 || fd >= loop->num_handlers || loop->handlers[fd] == NULL )
+    {
+        return false;
+    }
+
+    event.events  = events;
+    event.data.fd = fd;
+
+    if( epoll_ctl( loop->epoll_fd, EPOLL_CTL_MOD, fd, &event ) != 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to change events of descriptor %d: %s",
+            fd,
+            strerror( errno )
+        );
+
+        return false;
+    }
+
+    return true;
+}
+
+// Stops watching fd. A timer is closed as well.
+void remove_event( struct event_loop * loop, int fd )
+{
+    if( loop == NULL || fd < 0 || fd >= loop->num_handlers || loop->handlers[fd] == NULL )
+    {
+        return;
+    }
+
+    epoll_ctl( loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL );
+
+    if( loop->handlers[fd]->is_timer )
+    {
+        close( fd );
+    }
+
+    free( loop->handlers[fd] );
+    loop->handlers[fd] = NULL;
+    return;
+}
+
+/*
+ * Creates a timer calling callback with argument, firing every interval
+ * milliseconds, or not at all until armed when interval is 0. Returns its
+ * descriptor, or -1.
+ */
+int add_timer( struct event_loop * loop, unsigned long interval, event_callback callback, void * argument )
+{
+    struct epoll_event event = {0};
+    int                fd    = -1;
+
+    if( loop == NULL || callback == NULL )
+    {
+        return -1;
+    }
+
+    fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+
+    if( fd < 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to create timer: %s",
+            strerror( errno )
+        );
+
+        return -1;
+    }
+
+    if( _set_handler( loop, fd, callback, argument, true ) == NULL )
+    {
+        close( fd );
+        return -1;
+    }
+
+    event.events  = EPOLLIN;
+    event.data.fd = fd;
+
+    if(
+            epoll_ctl( loop->epoll_fd, EPOLL_CTL_ADD, fd, &event ) != 0
+         || ( interval > 0 && !arm_timer( loop, fd, interval, interval ) )
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to watch timer: %s",
+            strerror( errno )
+        );
+
+        remove_event( loop, fd );
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+ * Makes timer fd fire after delay milliseconds, then every interval
+ * milliseconds if that is not 0. A delay of 0 disarms it.
+ */
+bool arm_timer( struct event_loop * loop, int fd, unsigned long delay, unsigned long interval )
+{
+    struct itimerspec spec = {{0}};
+
+    if( loop == NULL || fd < 0 )
+    {
+        return false;
+    }
+
+    spec.it_value.tv_sec     = ( time_t ) ( delay / 1000 );
+    spec.it_value.tv_nsec    = ( long ) ( delay % 1000 ) * 1000000L;
+    spec.it_interval.tv_sec  = ( time_t ) ( interval / 1000 );
+    spec.it_interval.tv_nsec = ( long ) ( interval % 1000 ) * 1000000L;
+
+    if( timerfd_settime( fd, 0, &spec, NULL ) != 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to arm timer: %s",
+            strerror( errno )
+        );
+
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Blocks the num_signals signals in signals and has the loop pass them to
+ * callback with argument as they arrive, in place of signal handlers.
+ * Processes forked afterwards inherit the blocked mask, see reset_signals().
+ */
+bool add_signals(
+    struct event_loop * loop,
+    int *               signals,
+    unsigned int        num_signals,
+    signal_callback     callback,
+    void *              argument
+)
+{
+    struct epoll_event event = {0};
+    unsigned int       i     = 0;
+
+    if( loop == NULL || signals == NULL || callback == NULL || loop->signal_fd >= 0 )
+    {
+        return false;
+    }
+
+    for( i = 0; i < num_signals; i++ )
+    {
+        sigaddset( &( loop->signals ), signals[i] );
+    }
+
+    if( sigprocmask( SIG_BLOCK, &( loop->signals ), NULL ) != 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to block signals: %s",
+            strerror( errno )
+        );
+
+        return false;
+    }
+
+    loop->signal_fd = signalfd( -1, &( loop->signals ), SFD_NONBLOCK | SFD_CLOEXEC );
+
+    if( loop->signal_fd < 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to create signal descriptor: %s",
+            strerror( errno )
+        );
+
+        sigprocmask( SIG_UNBLOCK, &( loop->signals ), NULL );
+        return false;
+    }
+
+    event.events  = EPOLLIN;
+    event.data.fd = loop->signal_fd;
+
+    if( epoll_ctl( loop->epoll_fd, EPOLL_CTL_ADD, loop->signal_fd, &event ) != 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to watch signal descriptor: %s",
+            strerror( errno )
+        );
+
+        close( loop->signal_fd );
+        loop->signal_fd = -1;
+        sigprocmask( SIG_UNBLOCK, &( loop->signals ), NULL );
+        return false;
+    }
+
+    loop->on_signal       = callback;
+    loop->signal_argument = argument;
+    return true;
+}
+
+// Unblocks every signal, for a child forked from a process running a loop
+void reset_signals( void )
+{
+    sigset_t none;
+
+    sigemptyset( &none );
+    sigprocmask( SIG_SETMASK, &none, NULL );
+    return;
+}
+
+/*
+ * Waits for events and dispatches them until stop_event_loop() is called or
+ * a callback fails. Returns whether it was stopped rather than failed.
+ */
+bool run_event_loop( struct event_loop * loop )
+{
+    struct epoll_event events[EVENT_MAX_EVENTS];
+    int                ready = 0;
+    int                fd    = 0;
+    int                i     = 0;
+
+    if( loop == NULL )
+    {
+        return false;
+    }
+
+    loop->stopped = false;
+
+    while( !( loop->stopped ) )
+    {
+        ready = epoll_wait( loop->epoll_fd, events, EVENT_MAX_EVENTS, -1 );
+
+        if( ready < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to wait for events: %s",
+                strerror( errno )
+            );
+
+            return false;
+        }
+
+        for( i = 0; i < ready && !( loop->stopped ); i++ )
+        {
+            fd = events[i].data.fd;
+
+            if( fd == loop->signal_fd )
+            {
+                if( !_read_signals( loop ) )
+                {
+                    return false;
+                }
+
+                continue;
+            }
+
+            // Removed by an earlier callback in this round
+            if( fd >= loop->num_handlers || loop->handlers[fd] == NULL )
+            {
+                continue;
+            }
+
+            if( !_dispatch( loop, loop->handlers[fd], events[i].events ) )
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Has run_event_loop() return once the current callback does
+void stop_event_loop( struct event_loop * loop )
+{
+    if( loop != NULL )
+    {
+        loop->stopped = true;
+    }
+
+    return;
+}
+
+/*
+ * Closes the loop's own descriptors and unblocks its signals. Descriptors
+ * added with add_event() are left open.
+ */
+void free_event_loop( struct event_loop * loop )
+{
+    int i = 0;
+
+    if( loop == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < loop->num_handlers; i++ )
+    {
+        if( loop->handlers[i] != NULL && loop->handlers[i]->is_timer )
+        {
+            close( i );
+        }
+
+        free( loop->handlers[i] );
+    }
+
+    if( loop->signal_fd >= 0 )
+    {
+        close( loop->signal_fd );
+        sigprocmask( SIG_UNBLOCK, &( loop->signals ), NULL );
+    }
+
+    close( loop->epoll_fd );
+    free( loop->handlers );
+    free( loop );
+    return;
+}
+
+static struct event_handler * _set_handler(
+    struct event_loop * loop,
+    int                 fd,
+    event_callback      callback,
+    void *              argument,
+    bool                is_timer
+)
+{
+    struct event_handler ** grown = NULL;
+    int                     size  = 0;
+
+    if( fd >= loop->num_handlers )
+    {
+        size  = loop->num_handlers == 0 ? 64 : loop->num_handlers;
+
+        while( size <= fd )
+        {
+            size *= 2;
+        }
+
+        grown = ( struct event_handler ** ) realloc( loop->handlers, size * sizeof( struct event_handler * ) );
+
+        if( grown == NULL )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to allocate event handlers"
+            );
+
+            return NULL;
+        }
+
+        memset( grown + loop->num_handlers, 0, ( size - loop->num_handlers ) * sizeof( struct event_handler * ) );
+        loop->handlers     = grown;
+        loop->num_handlers = size;
+    }
+
+    // The descriptor was closed without being removed, and its number reused
+    if( loop->handlers[fd] == NULL )
+    {
+        loop->handlers[fd] = ( struct event_handler * ) calloc( 1, sizeof( struct event_handler ) );
+
+        if( loop->handlers[fd] == NULL )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to allocate event handler"
+            );
+
+            return NULL;
+        }
+    }
+
+    loop->handlers[fd]->fd       = fd;
+    loop->handlers[fd]->callback = callback;
+    loop->handlers[fd]->argument = argument;
+    loop->handlers[fd]->is_timer = is_timer;
+    return loop->handlers[fd];
+}
+
+static bool _dispatch( struct event_loop * loop, struct event_handler * handler, uint32_t events )
+{
+    uint64_t expirations = 0;
+
+    if( handler->is_timer )
+    {
+        if( read( handler->fd, &expirations, sizeof( uint64_t ) ) != sizeof( uint64_t ) )
+        {
+            // Read by an earlier round, or disarmed since
+            return errno == EAGAIN || errno == EINTR;
+        }
+
+        events = ( uint32_t ) expirations;
+    }
+
+    return handler->callback( loop, handler->fd, events, handler->argument );
+}
+
+static bool _read_signals( struct event_loop * loop )
+{
+    struct signalfd_siginfo info;
+    ssize_t                 received = 0;
+
+    while( !( loop->stopped ) )
+    {
+        received = read( loop->signal_fd, &info, sizeof( struct signalfd_siginfo ) );
+
+        if( received != sizeof( struct signalfd_siginfo ) )
+        {
+            return received < 0 && ( errno == EAGAIN || errno == EINTR );
+        }
+
+        if( !loop->on_signal( loop, ( int ) info.ssi_signo, loop->signal_argument ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
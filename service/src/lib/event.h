@@ -0,0 +1,65 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include "util.h"
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#define EVENT_MAX_EVENTS 64
+
+struct event_loop;
+
+/*
+ * Called with the epoll events that fired on fd. Returning false stops the
+ * loop, and run_event_loop() fails. For a timer the expirations have already
+ * been read, and events is their number.
+ */
+typedef bool ( * event_callback )( struct event_loop *, int, uint32_t, void * );
+
+// Called with the number of a signal that was delivered
+typedef bool ( * signal_callback )( struct event_loop *, int, void * );
+
+/*
+ * What to do when fd is ready. Timers and the signal descriptor belong to
+ * the loop and are closed with it; other descriptors remain the caller's.
+ */
+struct event_handler {
+    int            fd;
+    event_callback callback;
+    void *         argument;
+    bool           is_timer;
+};
+
+/*
+ * A single-threaded epoll loop. Handlers are indexed by descriptor, so a
+ * descriptor closed without remove_event() (which drops it from the epoll
+ * set) simply has its slot taken by the next handler added for the same
+ * number. Signals handled by the loop are blocked and read from signal_fd
+ * instead of interrupting whatever is running.
+ */
+struct event_loop {
+    int                     epoll_fd;
+    struct event_handler ** handlers;
+    int                     num_handlers;
+    int                     signal_fd;
+    sigset_t                signals;
+    signal_callback         on_signal;
+    void *                  signal_argument;
+    bool                    stopped;
+};
+
+extern struct event_loop * new_event_loop( void );
+extern bool add_event( struct event_loop *, int, uint32_t, event_callback, void * );
+extern bool modify_event( struct event_loop *, int, uint32_t );
+extern void remove_event( struct event_loop *, int );
+extern int add_timer( struct event_loop *, unsigned long, event_callback, void * );
+extern bool arm_timer( struct event_loop *, int, unsigned long, unsigned long );
+extern bool add_signals( struct event_loop *, int *, unsigned int, signal_callback, void * );
+extern void reset_signals( void );
+extern bool run_event_loop( struct event_loop * );
+extern void stop_event_loop( struct event_loop * );
+extern void free_event_loop( struct event_loop * );
+
+#endif // EVENT_H
@@ -0,0 +1,1909 @@
+#include "fanout.h"
+#include "progress.h"
+#include "event.h"
+#include "metrics.h"
+
+unsigned int fanout_pool_size    = DEFAULT_FANOUT_POOL_SIZE;
+unsigned int fanout_worker_limit = DEFAULT_FANOUT_WORKER_LIMIT;
+uint64_t     fanout_lag_budget   = DEFAULT_FANOUT_LAG_BUDGET;
+uint64_t     fanout_high_water   = DEFAULT_FANOUT_HIGH_WATER;
+
+// Members running, and waiting to, across the fan-outs of every source
+static unsigned int num_workers = 0;
+static unsigned int num_waiting = 0;
+
+static const char * location_query = "\
+    SELECT p.maintenance_object, \
+           l.location, \
+           l.hostname, \
+           l.port, \
+           l.username, \
+           l.dbname \
+      FROM ( \
+               SELECT maintenance_object, \
+                      location \
+                 FROM %s.maintenance_object \
+                UNION \
+               SELECT maintenance_object, \
+                      location \
+                 FROM %s.maintenance_object_location \
+           ) p \
+      JOIN %s.tb_location l \
+        ON l.location = p.location \
+  ORDER BY l.location, p.maintenance_object";
+
+static bool _add_location( struct worker *, struct fanout *, PGresult *, int, int, struct maintenance_object **, unsigned int );
+static bool _describe_remote( struct fanout_location * );
+static bool _partition_location( struct worker *, struct fanout *, struct fanout_location * );
+static bool _start_member( struct fanout *, struct fanout_location *, struct fanout_member * );
+static void _tend_members( struct fanout * );
+static bool _end_member( struct fanout_member * );
+static bool _run_member( struct worker *, struct fanout_member * );
+static bool _take_change( struct worker *, struct fanout_member *, struct member_batch *, struct change *, size_t );
+static bool _apply_batch( struct worker *, struct fanout_member *, struct member_batch *, size_t );
+static bool _wait_for_changes( struct worker *, struct fanout_member *, struct member_batch * );
+static bool _report_applied( struct worker *, struct fanout_member *, struct member_batch *, bool );
+static bool _send_queue( struct fanout_member * );
+static bool _read_acks( struct fanout_member * );
+static void _detach_location( struct fanout_location *, const char * );
+static bool _all_throttled( struct fanout * );
+static bool _drained( struct fanout_location * );
+static void _append_conninfo_value( struct string_buffer *, char * );
+static int64_t _microseconds_between( struct timespec *, struct timespec * );
+static size_t _queued_bytes( int );
+
+/*
+ * Starts applying the stream to every location objects are maintained at,
+ * per maintenance_object and maintenance_object_location. Each location gets
+ * up to fanout_pool_size members, between which the components of its
+ * objects' dependency graph are divided. name, if any, tells apart the
+ * queues of fan-outs of different source databases. Members are only
+ * started once there is something queued for them, and end once they have
+ * gone FANOUT_RETIRE_MS without anything to apply, see _tend_members(), so
+ * that a source that is not written to keeps no members or connections to
+ * its locations. watch, if given, is called with the socket of each member
+ * as it starts, for an event loop to watch instead of poll_fanout().
+ */
+struct fanout * new_fanout(
+    struct worker *              me,
+    char *                       name,
+    struct maintenance_object ** objects,
+    unsigned int                 num_objects,
+    fanout_watch                 watch,
+    void *                       watch_argument
+)
+{
+    struct fanout *        fanout = NULL;
+    struct string_buffer * query  = NULL;
+    PGresult *             result = NULL;
+    char *                 schema = NULL;
+    int                    first  = 0;
+    int                    i      = 0;
+    unsigned int           j      = 0;
+
+    if( me == NULL || ( objects == NULL && num_objects > 0 ) )
+    {
+        return NULL;
+    }
+
+    schema = get_extension_schema( me );
+    query  = new_string_buffer();
+
+    if( schema == NULL || query == NULL )
+    {
+        free_string_buffer( query );
+        return NULL;
+    }
+
+    string_buffer_append( query, location_query, schema, schema, schema );
+    result = _execute_query( me, query->data, NULL, 0 );
+    free_string_buffer( query );
+
+    if( result == NULL )
+    {
+        return NULL;
+    }
+
+    fanout = ( struct fanout * ) calloc( 1, sizeof( struct fanout ) );
+
+    if( fanout != NULL )
+    {
+        // Rows are ordered by location, at most one location per row
+        fanout->locations = ( struct fanout_location * ) calloc(
+            PQntuples( result ) + 1,
+            sizeof( struct fanout_location )
+        );
+    }
+
+    if( fanout == NULL || fanout->locations == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate fan-out"
+        );
+
+        free( fanout );
+        PQclear( result );
+        return NULL;
+    }
+
+    if( name != NULL )
+    {
+        strncpy( fanout->name, name, FANOUT_NAME_LENGTH );
+    }
+
+    fanout->watch          = watch;
+    fanout->watch_argument = watch_argument;
+
+    for( i = 1, first = 0; i <= PQntuples( result ); i++ )
+    {
+        if(
+                i < PQntuples( result )
+             && strcmp( PQgetvalue( result, i, 1 ), PQgetvalue( result, first, 1 ) ) == 0
+          )
+        {
+            continue;
+        }
+
+        if( !_add_location( me, fanout, result, first, i, objects, num_objects ) )
+        {
+            PQclear( result );
+            free_fanout( fanout );
+            return NULL;
+        }
+
+        first = i;
+    }
+
+    PQclear( result );
+
+    for( j = 0; j < fanout->num_locations; j++ )
+    {
+        _log(
+            LOG_LEVEL_INFO,
+            "Applying %u objects to location %u with up to %u workers",
+            fanout->locations[j].num_objects,
+            fanout->locations[j].location,
+            fanout->locations[j].num_members
+        );
+    }
+
+    update_fanout( fanout );
+    return fanout;
+}
+
+/*
+ * Queues a record of the decoder at lsn for every attached location, and
+ * sends what the members will take without blocking. is_commit marks the
+ * COMMIT of a transaction.
+ */
+bool fanout_record( struct fanout * fanout, char * record, uint64_t lsn, bool is_commit )
+{
+    struct fanout_location * location = NULL;
+    struct fanout_member *   member   = NULL;
+    uint32_t                 length   = 0;
+    unsigned int             i        = 0;
+    unsigned int             j        = 0;
+
+    if( fanout == NULL || record == NULL )
+    {
+        return false;
+    }
+
+    length = ( uint32_t ) strlen( record ) + 1;
+
+    for( i = 0; i < fanout->num_locations; i++ )
+    {
+        location = &( fanout->locations[i] );
+
+        for( j = 0; j < location->num_members && !( location->detached ); j++ )
+        {
+            member = &( location->members[j] );
+
+            if( !spill_queue_push( member->queue, lsn, record, length, is_commit ) )
+            {
+                _detach_location( location, "its queue could not be extended" );
+                break;
+            }
+
+            clock_gettime( CLOCK_MONOTONIC, &( member->queued ) );
+
+            // A member that is not running is started, as soon as the pool has room for it
+            if( member->pid == 0 && !( member->waiting ) && !_start_member( fanout, location, member ) )
+            {
+                _detach_location( location, "a worker could not be started" );
+                break;
+            }
+
+            if( member->socket >= 0 && !( member->retiring ) && !_send_queue( member ) )
+            {
+                _detach_location( location, "a worker stopped taking changes" );
+                break;
+            }
+
+            if( fanout_high_water > 0 && !( location->throttled ) && spill_queue_length( member->queue ) > fanout_high_water )
+            {
+                _log(
+                    LOG_LEVEL_DEBUG,
+                    "Location %u is %lu bytes behind",
+                    location->location,
+                    spill_queue_length( member->queue )
+                );
+
+                location->throttled = true;
+            }
+        }
+
+        if( location->throttled && _drained( location ) )
+        {
+            location->throttled = false;
+        }
+    }
+
+    if( !( fanout->throttled ) && _all_throttled( fanout ) )
+    {
+        _log(
+            LOG_LEVEL_DEBUG,
+            "Every location is behind, pausing the stream"
+        );
+
+        fanout->throttled = true;
+    }
+
+    if( fanout->start_lsn == 0 )
+    {
+        fanout->start_lsn = lsn;
+    }
+
+    fanout->queued_lsn = lsn;
+    fanout->open       = !is_commit;
+    return true;
+}
+
+/*
+ * Whether the source should not be read for now, see struct fanout. Checked
+ * as the members take what is queued for them, to clear the throttled flags
+ * of the locations whose members are down to FANOUT_LOW_WATER, and so the
+ * fan-out's again.
+ */
+bool fanout_throttled( struct fanout * fanout )
+{
+    struct fanout_location * location = NULL;
+    unsigned int             i        = 0;
+
+    if( fanout == NULL || !( fanout->throttled ) )
+    {
+        return false;
+    }
+
+    for( i = 0; i < fanout->num_locations; i++ )
+    {
+        location = &( fanout->locations[i] );
+
+        if( location->throttled && _drained( location ) )
+        {
+            location->throttled = false;
+        }
+    }
+
+    if( _all_throttled( fanout ) )
+    {
+        return true;
+    }
+
+    _log(
+        LOG_LEVEL_DEBUG,
+        "A location caught up, resuming the stream"
+    );
+
+    fanout->throttled = false;
+    return false;
+}
+
+/*
+ * Whether every attached location of fanout is throttled, and there is at
+ * least one: only then is none of them held back by pausing the stream.
+ */
+static bool _all_throttled( struct fanout * fanout )
+{
+    unsigned int i        = 0;
+    bool         attached = false;
+
+    for( i = 0; i < fanout->num_locations; i++ )
+    {
+        if( fanout->locations[i].detached )
+        {
+            continue;
+        }
+
+        if( !( fanout->locations[i].throttled ) )
+        {
+            return false;
+        }
+
+        attached = true;
+    }
+
+    return attached;
+}
+
+// Whether every member of location is down to FANOUT_LOW_WATER
+static bool _drained( struct fanout_location * location )
+{
+    unsigned int i = 0;
+
+    for( i = 0; i < location->num_members; i++ )
+    {
+        if( spill_queue_length( location->members[i].queue ) > FANOUT_LOW_WATER( fanout_high_water ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Waits up to timeout milliseconds for the members to take queued records or
+ * report progress, then detaches locations that have fallen too far behind
+ * and updates confirmed_lsn. Returns false only if the wait itself failed.
+ */
+bool poll_fanout( struct fanout * fanout, int timeout )
+{
+    struct fanout_location * location = NULL;
+    struct fanout_member *   member   = NULL;
+    struct pollfd *          fds      = NULL;
+    char *                   data     = NULL;
+    size_t                   length   = 0;
+    unsigned int             num_fds  = 0;
+    unsigned int             i        = 0;
+    unsigned int             j        = 0;
+    unsigned int             k        = 0;
+    int                      ready    = 0;
+
+    if( fanout == NULL )
+    {
+        return false;
+    }
+
+    for( i = 0; i < fanout->num_locations; i++ )
+    {
+        num_fds += fanout->locations[i].num_members;
+    }
+
+    fds = ( struct pollfd * ) calloc( num_fds + 1, sizeof( struct pollfd ) );
+
+    if( fds == NULL )
+    {
+        return false;
+    }
+
+    for( i = 0, k = 0; i < fanout->num_locations; i++ )
+    {
+        location = &( fanout->locations[i] );
+
+        for( j = 0; j < location->num_members; j++, k++ )
+        {
+            member = &( location->members[j] );
+
+            // Negative descriptors are ignored by poll()
+            fds[k].fd     = location->detached ? -1 : member->socket;
+            fds[k].events = POLLIN;
+
+            if( !( location->detached ) && !( member->retiring ) && spill_queue_peek( member->queue, &data, &length ) )
+            {
+                fds[k].events |= POLLOUT;
+            }
+        }
+    }
+
+    ready = poll( fds, num_fds, timeout );
+
+    if( ready < 0 )
+    {
+        free( fds );
+
+        if( errno == EINTR )
+        {
+            return true;
+        }
+
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to wait for fan-out workers: %s",
+            strerror( errno )
+        );
+
+        return false;
+    }
+
+    for( k = 0; k < num_fds; k++ )
+    {
+        if( fds[k].fd >= 0 && fds[k].revents != 0 )
+        {
+            fanout_socket_ready(
+                fanout,
+                fds[k].fd,
+                ( fds[k].revents & ( POLLIN | POLLHUP | POLLERR ) ) != 0,
+                ( fds[k].revents & POLLOUT ) != 0
+            );
+        }
+    }
+
+    free( fds );
+    update_fanout( fanout );
+    return true;
+}
+
+/*
+ * Handles the member on socket being readable, which includes having gone
+ * away, or writable: reads the LSNs it has reported, or sends it what it
+ * will take of its queue. Its location is detached if it has failed. A
+ * member that has been told to end, see _tend_members(), goes away once it
+ * has reported what it applied last, and is ended here, closing socket. For
+ * an event loop watching the sockets instead of poll_fanout(), with
+ * update_fanout() called once the events have been handled. Returns false
+ * if socket is not, or is no longer, that of an attached member.
+ */
+bool fanout_socket_ready( struct fanout * fanout, int socket, bool readable, bool writable )
+{
+    struct fanout_location * location = NULL;
+    struct fanout_member *   member   = NULL;
+    unsigned int             i        = 0;
+    unsigned int             j        = 0;
+
+    if( fanout == NULL || socket < 0 )
+    {
+        return false;
+    }
+
+    for( i = 0; i < fanout->num_locations && member == NULL; i++ )
+    {
+        location = &( fanout->locations[i] );
+
+        for( j = 0; j < location->num_members && !( location->detached ); j++ )
+        {
+            if( location->members[j].socket == socket )
+            {
+                member = &( location->members[j] );
+                break;
+            }
+        }
+    }
+
+    if( member == NULL )
+    {
+        return false;
+    }
+
+    if( readable && !_read_acks( member ) )
+    {
+        if( member->retiring && _end_member( member ) )
+        {
+            return false;
+        }
+
+        _detach_location( location, "a worker failed" );
+    }
+    else if( writable && !( member->retiring ) && !_send_queue( member ) )
+    {
+        _detach_location( location, "a worker stopped taking changes" );
+    }
+
+    return true;
+}
+
+/*
+ * Syncs the members' spilled records, works out how far each location has
+ * got, detaches those that have fallen too far behind, and moves
+ * confirmed_lsn up to the least position of all of them. A detached
+ * location holds it where it was detached, so that nothing it has not
+ * applied is confirmed, see fanout_detached().
+ */
+void update_fanout( struct fanout * fanout )
+{
+    struct fanout_location * location  = NULL;
+    struct fanout_member *   member    = NULL;
+    uint64_t                 confirmed = 0;
+    uint64_t                 position  = 0;
+    bool                     attached  = false;
+    unsigned int             i         = 0;
+    unsigned int             j         = 0;
+
+    if( fanout == NULL )
+    {
+        return;
+    }
+
+    _tend_members( fanout );
+
+    for( i = 0; i < fanout->num_locations; i++ )
+    {
+        location = &( fanout->locations[i] );
+
+        for( j = 0; j < location->num_members && !( location->detached ); j++ )
+        {
+            member = &( location->members[j] );
+
+            if( !spill_queue_sync( member->queue ) )
+            {
+                _detach_location( location, "its queue could not be synced" );
+                break;
+            }
+
+            member->safe_lsn = spill_queue_safe_lsn( member->queue );
+
+            if( j == 0 || member->applied_lsn < location->applied_lsn )
+            {
+                location->applied_lsn = member->applied_lsn;
+            }
+
+            if( j == 0 || member->safe_lsn < location->safe_lsn )
+            {
+                location->safe_lsn = member->safe_lsn;
+            }
+        }
+
+        if( location->detached )
+        {
+            continue;
+        }
+
+        position = location->safe_lsn > fanout->start_lsn ? location->safe_lsn : fanout->start_lsn;
+
+        if( fanout->queued_lsn > position && fanout->queued_lsn - position > fanout_lag_budget )
+        {
+            _detach_location( location, "it fell behind by more than the lag budget" );
+            continue;
+        }
+
+        if( !attached || location->safe_lsn < confirmed )
+        {
+            confirmed = location->safe_lsn;
+        }
+
+        attached = true;
+    }
+
+    // What a detached location has not applied is streamed to it again once the fan-out is restarted
+    for( i = 0; i < fanout->num_locations; i++ )
+    {
+        location = &( fanout->locations[i] );
+
+        if( location->detached && ( !attached || location->safe_lsn < confirmed ) )
+        {
+            confirmed = location->safe_lsn;
+            attached  = true;
+        }
+    }
+
+    if( confirmed > fanout->confirmed_lsn )
+    {
+        fanout->confirmed_lsn = confirmed;
+    }
+
+    // A throttled location detached here no longer keeps the stream paused
+    fanout->throttled = fanout->throttled && _all_throttled( fanout );
+    return;
+}
+
+/*
+ * Whether a location of fanout has been detached. The slot is not confirmed
+ * past what it has applied, so stopping the fan-out and streaming the slot
+ * again into a new one brings it back up to date: its objects skip what
+ * their progress says they already hold, see _run_member().
+ */
+bool fanout_detached( struct fanout * fanout )
+{
+    unsigned int i = 0;
+
+    for( i = 0; fanout != NULL && i < fanout->num_locations; i++ )
+    {
+        if( fanout->locations[i].detached )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void free_fanout( struct fanout * fanout )
+{
+    struct fanout_location * location = NULL;
+    unsigned int             i        = 0;
+    unsigned int             j        = 0;
+
+    if( fanout == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; fanout->locations != NULL && i < fanout->num_locations; i++ )
+    {
+        location = &( fanout->locations[i] );
+
+        /*
+         * Closing the sockets ends the members once they have applied what
+         * they have already taken
+         */
+        if( !( location->detached ) )
+        {
+            for( j = 0; j < location->num_members; j++ )
+            {
+                _end_member( &( location->members[j] ) );
+            }
+        }
+
+        for( j = 0; j < location->num_members; j++ )
+        {
+            free_spill_queue( location->members[j].queue, false );
+            free( location->members[j].objects );
+        }
+
+        for( j = 0; j < location->num_objects; j++ )
+        {
+            free_maintenance_object( location->objects[j] );
+        }
+
+        free( location->members );
+        free( location->objects );
+        free( location->conninfo );
+        free( location->source_conninfo );
+    }
+
+    free( fanout->locations );
+    free( fanout );
+    return;
+}
+
+/*
+ * Adds the location of rows first up to last of a location_query result,
+ * with copies of those of objects maintained there.
+ */
+static bool _add_location(
+    struct worker *              me,
+    struct fanout *              fanout,
+    PGresult *                   result,
+    int                          first,
+    int                          last,
+    struct maintenance_object ** objects,
+    unsigned int                 num_objects
+)
+{
+    struct fanout_location * location    = NULL;
+    struct string_buffer *   conninfo    = NULL;
+    unsigned int             id          = 0;
+    unsigned int             j           = 0;
+    bool                     is_postgres = false;
+    int                      i           = 0;
+
+    location = &( fanout->locations[fanout->num_locations] );
+    id       = ( unsigned int ) strtoul( PQgetvalue( result, first, 1 ), NULL, 10 );
+
+    location->location = id;
+    location->objects  = ( struct maintenance_object ** ) calloc(
+        ( size_t ) ( last - first ) + 1,
+        sizeof( struct maintenance_object * )
+    );
+
+    if( location->objects == NULL )
+    {
+        return false;
+    }
+
+    fanout->num_locations++;
+
+    for( i = first; i < last; i++ )
+    {
+        for( j = 0; j < num_objects; j++ )
+        {
+            if( objects[j]->maintenance_object == ( unsigned int ) strtoul( PQgetvalue( result, i, 0 ), NULL, 10 ) )
+            {
+                break;
+            }
+        }
+
+        // Objects not given are not maintained here
+        if( j == num_objects )
+        {
+            continue;
+        }
+
+        location->objects[location->num_objects] = copy_maintenance_object( objects[j] );
+
+        if( location->objects[location->num_objects] == NULL )
+        {
+            return false;
+        }
+
+        location->objects[location->num_objects]->location = id;
+        is_postgres = is_postgres || objects[j]->driver == DRIVER_POSTGRESQL;
+        location->num_objects++;
+    }
+
+    if( location->num_objects == 0 )
+    {
+        free( location->objects );
+        memset( location, 0, sizeof( struct fanout_location ) );
+        fanout->num_locations--;
+        return true;
+    }
+
+    if( is_postgres )
+    {
+        conninfo = new_string_buffer();
+
+        if( conninfo == NULL || !db_connect( me ) )
+        {
+            free_string_buffer( conninfo );
+            return false;
+        }
+
+        string_buffer_append( conninfo, "host=" );
+        _append_conninfo_value( conninfo, PQgetvalue( result, first, 2 ) );
+        string_buffer_append( conninfo, " port=" );
+        _append_conninfo_value( conninfo, PQgetvalue( result, first, 3 ) );
+        string_buffer_append( conninfo, " user=" );
+        _append_conninfo_value( conninfo, PQgetvalue( result, first, 4 ) );
+        string_buffer_append( conninfo, " dbname=" );
+        _append_conninfo_value( conninfo, PQgetvalue( result, first, 5 ) );
+
+        location->conninfo = strdup( conninfo->data );
+        free_string_buffer( conninfo );
+
+        if( location->conninfo == NULL )
+        {
+            return false;
+        }
+
+        // Anywhere but the source database itself, as far as can be told
+        location->remote = strcmp( PQgetvalue( result, first, 2 ), PQhost( me->conn ) ) != 0
+                        || strcmp( PQgetvalue( result, first, 3 ), PQport( me->conn ) ) != 0
+                        || strcmp( PQgetvalue( result, first, 5 ), PQdb( me->conn ) ) != 0;
+
+        if( location->remote )
+        {
+            location->source_conninfo = me->conninfo != NULL ? strdup( me->conninfo ) : NULL;
+
+            if( ( me->conninfo != NULL && location->source_conninfo == NULL ) || !_describe_remote( location ) )
+            {
+                return false;
+            }
+        }
+    }
+    else if( me->conninfo != NULL )
+    {
+        // Other drivers' definitions are evaluated against the source, see evaluate_changes()
+        location->conninfo = strdup( me->conninfo );
+
+        if( location->conninfo == NULL )
+        {
+            return false;
+        }
+    }
+
+    return _partition_location( me, fanout, location );
+}
+
+/*
+ * Describes the postgresql objects of a remote location against their
+ * targets there, which the source database need not have, and marks them
+ * remote, so that they are planned to be evaluated against the source.
+ */
+static bool _describe_remote( struct fanout_location * location )
+{
+    struct worker * target  = NULL;
+    unsigned int    i       = 0;
+    bool            success = true;
+
+    target = new_worker( WORKER_TYPE_CHILD, 0, NULL, NULL );
+
+    if( target == NULL )
+    {
+        return false;
+    }
+
+    target->conninfo = location->conninfo;
+
+    for( i = 0; success && i < location->num_objects; i++ )
+    {
+        if( location->objects[i]->driver != DRIVER_POSTGRESQL )
+        {
+            continue;
+        }
+
+        location->objects[i]->remote = true;
+        success = describe_maintenance_object( target, location->objects[i] );
+    }
+
+    free_worker( target );
+    return success;
+}
+
+/*
+ * Deals the components of location's dependency graph out to its members.
+ * Objects that depend on one another stay with one member, which applies
+ * them in order.
+ */
+static bool _partition_location( struct worker * me, struct fanout * fanout, struct fanout_location * location )
+{
+    struct dependency_graph * graph  = NULL;
+    struct fanout_member *    member = NULL;
+    char                      name[FANOUT_NAME_LENGTH + 32];
+    unsigned int              i      = 0;
+
+    graph = build_dependency_graph( me, location->objects, location->num_objects );
+
+    if( graph == NULL )
+    {
+        return false;
+    }
+
+    location->num_members = fanout_pool_size > 0 ? fanout_pool_size : 1;
+
+    if( location->num_members > graph->num_components )
+    {
+        location->num_members = graph->num_components > 0 ? graph->num_components : 1;
+    }
+
+    location->members = ( struct fanout_member * ) calloc(
+        location->num_members + 1,
+        sizeof( struct fanout_member )
+    );
+
+    if( location->members == NULL )
+    {
+        location->num_members = 0;
+        free_dependency_graph( graph );
+        return false;
+    }
+
+    for( i = 0; i < location->num_members; i++ )
+    {
+        member = &( location->members[i] );
+
+        // What a previous run left queued for this member is picked up again
+        if( fanout->name[0] != '\0' )
+        {
+            snprintf( name, sizeof( name ), "%s.location%u.%u", fanout->name, location->location, i );
+        }
+        else
+        {
+            snprintf( name, sizeof( name ), "location%u.%u", location->location, i );
+        }
+
+        member->socket  = -1;
+        member->queue   = new_spill_queue( name );
+        member->objects = ( struct maintenance_object ** ) calloc(
+            location->num_objects + 1,
+            sizeof( struct maintenance_object * )
+        );
+
+        if( member->queue == NULL || member->objects == NULL )
+        {
+            free_dependency_graph( graph );
+            return false;
+        }
+
+        member->applied_lsn = member->queue->confirmed_lsn;
+    }
+
+    for( i = 0; i < location->num_objects; i++ )
+    {
+        member = &( location->members[graph->components[i] % location->num_members] );
+        member->objects[member->num_objects++] = location->objects[i];
+    }
+
+    free_dependency_graph( graph );
+    return true;
+}
+
+/*
+ * Forks member of location, connected to the parent by a socket of its own,
+ * of which it only keeps its own end, unless fanout_worker_limit members of
+ * the fan-outs of every source are running already: then it waits, its
+ * queue filling, until _tend_members() finds room for it. Returns false if
+ * it could not be started.
+ */
+static bool _start_member( struct fanout * fanout, struct fanout_location * location, struct fanout_member * member )
+{
+    struct worker * child   = NULL;
+    int             ends[2] = { -1, -1 };
+    bool            success = false;
+
+    if( fanout_worker_limit > 0 && num_workers >= fanout_worker_limit )
+    {
+        if( !( member->waiting ) )
+        {
+            member->waiting = true;
+            num_waiting++;
+        }
+
+        return true;
+    }
+
+    if( member->waiting )
+    {
+        member->waiting = false;
+        num_waiting--;
+    }
+
+    if( socketpair( AF_UNIX, SOCK_STREAM, 0, ends ) != 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to create fan-out socket: %s",
+            strerror( errno )
+        );
+
+        return false;
+    }
+
+    member->pid = fork();
+
+    if( member->pid < 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to fork fan-out worker: %s",
+            strerror( errno )
+        );
+
+        close( ends[0] );
+        close( ends[1] );
+        member->pid = 0;
+        return false;
+    }
+
+    if( member->pid == 0 )
+    {
+        /*
+         * Not only other members' sockets: a walsender connection held
+         * open here would keep its slot active after the parent closes it
+         */
+        close_inherited_sockets( ends[1] );
+        reset_signals();
+
+        member->socket = ends[1];
+        child          = new_worker( WORKER_TYPE_CHILD, 0, NULL, NULL );
+
+        if( child != NULL )
+        {
+            child->type     = WORKER_TYPE_CHILD;
+            child->status   = WORKER_STATUS_STARTUP;
+            child->pid      = getpid();
+            child->conninfo = location->conninfo;
+
+            // What a remote location maintains is evaluated against the source
+            if( location->remote )
+            {
+                child->source = new_worker( WORKER_TYPE_CHILD, 0, NULL, NULL );
+
+                if( child->source != NULL )
+                {
+                    child->source->conninfo = location->source_conninfo;
+                }
+            }
+
+            claim_metrics( "member", fanout->name, location->location );
+            success = ( !location->remote || child->source != NULL ) && _run_member( child, member );
+
+            free_worker( child->source );
+            free_worker( child );
+        }
+
+        exit( success ? 0 : 1 );
+    }
+
+    num_workers++;
+    close( ends[1] );
+    member->socket   = ends[0];
+    member->retiring = false;
+    clock_gettime( CLOCK_MONOTONIC, &( member->queued ) );
+
+    _log(
+        LOG_LEVEL_DEBUG,
+        "Started worker %d for location %u",
+        ( int ) member->pid,
+        location->location
+    );
+
+    if( fcntl( member->socket, F_SETFL, fcntl( member->socket, F_GETFL ) | O_NONBLOCK ) != 0 )
+    {
+        return false;
+    }
+
+    return fanout->watch == NULL || fanout->watch( fanout, member->socket, fanout->watch_argument );
+}
+
+/*
+ * Starts the members of attached locations that have something queued and
+ * are not running, as far as fanout_worker_limit allows, and tells those
+ * that have had nothing queued for FANOUT_RETIRE_MS to end, by shutting down
+ * the parent's side of their sockets. They do so once they have applied
+ * what they have taken, see _run_member(), which frees their processes and
+ * connections, and are started again once something is queued for them.
+ * While members of any source wait for room, members end once they have had
+ * nothing queued for FANOUT_IDLE_MS, so that a busy source borrows what
+ * idle ones do not use. A member only ends between transactions, as one
+ * started again could not tell the rest of a transaction from a whole one.
+ */
+static void _tend_members( struct fanout * fanout )
+{
+    struct fanout_location * location = NULL;
+    struct fanout_member *   member   = NULL;
+    struct timespec          now      = {0};
+    int64_t                  idle_ms  = 0;
+    unsigned int             i        = 0;
+    unsigned int             j        = 0;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    idle_ms = num_waiting > 0 ? FANOUT_IDLE_MS : FANOUT_RETIRE_MS;
+
+    for( i = 0; i < fanout->num_locations; i++ )
+    {
+        location = &( fanout->locations[i] );
+
+        for( j = 0; j < location->num_members && !( location->detached ); j++ )
+        {
+            member = &( location->members[j] );
+
+            if( member->pid == 0 )
+            {
+                if( spill_queue_length( member->queue ) == 0 )
+                {
+                    continue;
+                }
+
+                if( !_start_member( fanout, location, member ) )
+                {
+                    _detach_location( location, "a worker could not be started" );
+                }
+                else if( member->socket >= 0 && !_send_queue( member ) )
+                {
+                    _detach_location( location, "a worker stopped taking changes" );
+                }
+
+                continue;
+            }
+
+            if(
+                    member->retiring
+                 || fanout->open
+                 || spill_queue_length( member->queue ) > 0
+                 || _microseconds_between( &( member->queued ), &now ) < idle_ms * 1000L
+              )
+            {
+                continue;
+            }
+
+            if( shutdown( member->socket, SHUT_WR ) != 0 )
+            {
+                _detach_location( location, "a worker could not be ended" );
+                continue;
+            }
+
+            _log(
+                LOG_LEVEL_DEBUG,
+                "Ending idle worker %d of location %u",
+                ( int ) member->pid,
+                location->location
+            );
+
+            member->retiring = true;
+        }
+    }
+
+    return;
+}
+
+/*
+ * Waits for member's process to exit, once its socket has been closed or
+ * it has gone away, and frees its place in the pool, or stops it waiting
+ * for one. Returns whether it ended cleanly, or was not running.
+ */
+static bool _end_member( struct fanout_member * member )
+{
+    int status = 0;
+
+    if( member->waiting )
+    {
+        member->waiting = false;
+        num_waiting--;
+    }
+
+    if( member->pid <= 0 )
+    {
+        return true;
+    }
+
+    if( member->socket >= 0 )
+    {
+        close( member->socket );
+        member->socket = -1;
+    }
+
+    if( reap_child( member->pid, &status, 0 ) != member->pid )
+    {
+        status = -1;
+    }
+
+    num_workers--;
+    member->pid        = 0;
+    member->retiring   = false;
+    member->ack_length = 0;
+
+    return status == 0;
+}
+
+/*
+ * A member's loop: reads records off its socket, gathers the transactions
+ * they make up into batches, see struct member_batch, and applies each batch
+ * to its objects, then reports the LSN of its last COMMIT. Transactions that
+ * COMMIT at or before the last one applied were queued before a restart and
+ * streamed again, and are dropped, as are the records of a transaction cut
+ * short by one. The last one applied is at least the progress every object
+ * has recorded on the target, so after a crash the stream resumes past what
+ * all of them hold without applying anything; objects that are further
+ * ahead than others skip the transactions they already hold, see
+ * apply_dependency_graph(). Objects whose deltas are accumulated in memory,
+ * see add_graph_accumulators(), hold back what it reports until they are
+ * flushed. Ends, once what it has taken is applied, when the parent closes
+ * the socket.
+ */
+static bool _run_member( struct worker * me, struct fanout_member * member )
+{
+    struct member_batch    batch     = {0};
+    struct string_buffer * input     = NULL;
+    struct change *        change    = NULL;
+    unsigned long          i         = 0;
+    size_t                 offset    = 0;
+    ssize_t                received  = 0;
+    uint64_t               lsn       = 0;
+    uint64_t               freshness = 0;
+    uint32_t               length    = 0;
+    char                   chunk[FANOUT_READ_BYTES];
+    bool                   success   = false;
+
+    batch.graph        = build_dependency_graph( me, member->objects, member->num_objects );
+    batch.reported     = ( struct object_metrics ** ) calloc( member->num_objects, sizeof( struct object_metrics * ) );
+    batch.changed      = ( bool * ) calloc( member->num_objects + 1, sizeof( bool ) );
+    batch.commit_times = ( int64_t * ) calloc( member->num_objects + 1, sizeof( int64_t ) );
+    batch.coalesced    = new_coalesce_table( DEFAULT_COALESCE_BUCKETS );
+    input              = new_string_buffer();
+
+    if(
+            batch.graph == NULL
+         || batch.reported == NULL
+         || batch.changed == NULL
+         || batch.commit_times == NULL
+         || batch.coalesced == NULL
+         || input == NULL
+      )
+    {
+        goto cleanup;
+    }
+
+    /*
+     * A row inserted and deleted within a batch may still have target rows,
+     * as an earlier batch evaluated the definition against the source as it
+     * was by then, which may already have included the row
+     */
+    batch.coalesced->keep_deletes = true;
+
+    if( !add_graph_accumulators( me, batch.graph ) )
+    {
+        goto cleanup;
+    }
+
+    for( i = 0; i < member->num_objects; i++ )
+    {
+        if( !read_object_progress( me, member->objects[i] ) )
+        {
+            goto cleanup;
+        }
+
+        batch.reported[i] = claim_object_metrics(
+            member->objects[i]->maintenance_object,
+            member->objects[i]->location
+        );
+
+        metrics_object_applied( batch.reported[i], member->objects[i]->applied_lsn );
+
+        if( i == 0 || member->objects[i]->applied_lsn < lsn )
+        {
+            lsn = member->objects[i]->applied_lsn;
+        }
+
+        if( member->objects[i]->applied_lsn > batch.resume_lsn )
+        {
+            batch.resume_lsn = member->objects[i]->applied_lsn;
+        }
+
+        if(
+                member->objects[i]->freshness_ms > 0
+             && ( freshness == 0 || member->objects[i]->freshness_ms < freshness )
+          )
+        {
+            freshness = member->objects[i]->freshness_ms;
+        }
+    }
+
+    if( lsn > member->applied_lsn )
+    {
+        _log(
+            LOG_LEVEL_INFO,
+            "Resuming location %u past " LSN_FORMAT ", recorded as applied",
+            member->objects[0]->location,
+            LSN_FORMAT_ARGS( lsn )
+        );
+
+        member->applied_lsn = lsn;
+    }
+
+    batch.reported_lsn = member->applied_lsn;
+    reset_batch_controller( &( batch.controller ), freshness );
+    metrics_gauge( METRIC_APPLIED_LSN, member->applied_lsn );
+    set_worker_status( me, WORKER_STATUS_IDLE );
+    clock_gettime( CLOCK_MONOTONIC, &( batch.summarized ) );
+
+    while( true )
+    {
+        if( !_wait_for_changes( me, member, &batch ) )
+        {
+            goto cleanup;
+        }
+
+        received = recv( member->socket, chunk, sizeof( chunk ), 0 );
+
+        if( received == 0 )
+        {
+            break;
+        }
+
+        if( received < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to read changes: %s",
+                strerror( errno )
+            );
+
+            goto cleanup;
+        }
+
+        if( !string_buffer_append_bytes( input, chunk, ( size_t ) received ) )
+        {
+            goto cleanup;
+        }
+
+        for( offset = 0; input->length - offset >= SPILL_FRAME_HEADER_LENGTH; )
+        {
+            memcpy( &lsn, input->data + offset, sizeof( uint64_t ) );
+            memcpy( &length, input->data + offset + sizeof( uint64_t ), sizeof( uint32_t ) );
+
+            if( input->length - offset - SPILL_FRAME_HEADER_LENGTH < length )
+            {
+                break;
+            }
+
+            change  = parse_change( input->data + offset + SPILL_FRAME_HEADER_LENGTH, lsn );
+            offset += SPILL_FRAME_HEADER_LENGTH + length;
+
+            metrics_gauge( METRIC_RECEIVED_LSN, lsn );
+
+            if( change == NULL )
+            {
+                _log(
+                    LOG_LEVEL_ERROR,
+                    "Failed to parse change at " LSN_FORMAT,
+                    LSN_FORMAT_ARGS( lsn )
+                );
+
+                goto cleanup;
+            }
+
+            if( !_take_change( me, member, &batch, change, input->length - offset ) )
+            {
+                goto cleanup;
+            }
+        }
+
+        memmove( input->data, input->data + offset, input->length - offset );
+        input->length -= offset;
+
+        // A transaction still arriving does not hold back those committed before it
+        if( batch.num_committed > 0 && _queued_bytes( member->socket ) == 0 && !_apply_batch( me, member, &batch, 0 ) )
+        {
+            goto cleanup;
+        }
+    }
+
+    // What was taken is applied, and what was accumulated flushed, before the member exits
+    success = ( batch.num_committed == 0 || _apply_batch( me, member, &batch, 0 ) )
+           && _report_applied( me, member, &batch, true );
+
+cleanup:
+    for( i = 0; i < batch.num_changes; i++ )
+    {
+        free_change( batch.changes[i] );
+    }
+
+    free( batch.changes );
+    free( batch.reported );
+    free( batch.changed );
+    free( batch.commit_times );
+    free_coalesce_table( batch.coalesced );
+    free_string_buffer( input );
+    free_dependency_graph( batch.graph );
+    close( member->socket );
+    return success;
+}
+
+/*
+ * Adds change to batch, and applies the batch if change completes a
+ * transaction and the controller says it is due, or the coalescing window is
+ * full. A completed transaction's row changes are coalesced into those of
+ * the batch's earlier ones. unread is how much has been read off the socket
+ * after change; with what is still queued on it, it is the backlog the
+ * controller paces by.
+ */
+static bool _take_change(
+    struct worker *        me,
+    struct fanout_member * member,
+    struct member_batch *  batch,
+    struct change *        change,
+    size_t                 unread
+)
+{
+    struct change ** temp    = NULL;
+    struct change *  row     = NULL;
+    struct timespec  now     = {0};
+    unsigned long    i       = 0;
+    unsigned long    kept    = 0;
+    unsigned int     j       = 0;
+    size_t           backlog = 0;
+
+    if( batch->num_changes == batch->size )
+    {
+        batch->size = batch->size == 0 ? 64 : batch->size * 2;
+        temp        = ( struct change ** ) realloc( batch->changes, sizeof( struct change * ) * batch->size );
+
+        if( temp == NULL )
+        {
+            free_change( change );
+            return false;
+        }
+
+        batch->changes = temp;
+    }
+
+    // A transaction cut short by a restart is never completed, the stream resends it whole
+    if( change->type == CHANGE_TYPE_BEGIN )
+    {
+        for( i = batch->num_committed; i < batch->num_changes; i++ )
+        {
+            free_change( batch->changes[i] );
+        }
+
+        batch->num_changes = batch->num_committed;
+    }
+
+    batch->changes[batch->num_changes++] = change;
+
+    if( change->type != CHANGE_TYPE_COMMIT )
+    {
+        return true;
+    }
+
+    if( change->lsn <= member->applied_lsn || change->lsn <= batch->commit_lsn )
+    {
+        _log(
+            LOG_LEVEL_DEBUG,
+            "Skipping transaction ending at " LSN_FORMAT ", already applied",
+            LSN_FORMAT_ARGS( change->lsn )
+        );
+
+        metrics_count( METRIC_TRANSACTIONS_SKIPPED, 1 );
+
+        for( i = batch->num_committed; i < batch->num_changes; i++ )
+        {
+            free_change( batch->changes[i] );
+        }
+
+        batch->num_changes = batch->num_committed;
+        return true;
+    }
+
+    if(
+            !accumulate_dependency_graph(
+                batch->graph,
+                batch->changes + batch->num_committed,
+                batch->num_changes - batch->num_committed
+            )
+      )
+    {
+        return false;
+    }
+
+    // Which objects the transaction changed can only be told before its rows are coalesced
+    if( change->commit_time != 0 )
+    {
+        find_changed_objects(
+            batch->graph,
+            batch->changes + batch->num_committed,
+            batch->num_changes - batch->num_committed,
+            batch->changed
+        );
+
+        for( j = 0; j < member->num_objects; j++ )
+        {
+            if( batch->changed[j] && batch->commit_times[j] == 0 )
+            {
+                batch->commit_times[j] = change->commit_time;
+            }
+        }
+    }
+
+    for( i = batch->num_committed; i < batch->num_changes; i++ )
+    {
+        row = batch->changes[i];
+
+        if(
+                (
+                    row->type == CHANGE_TYPE_INSERT
+                 || row->type == CHANGE_TYPE_UPDATE
+                 || row->type == CHANGE_TYPE_DELETE
+                )
+             && row->schema_name != NULL
+             && row->table_name != NULL
+             && row->key != NULL
+          )
+        {
+            // The table takes the change, even when it fails
+            batch->changes[i] = NULL;
+
+            if( !coalesce_change( batch->coalesced, row ) )
+            {
+                return false;
+            }
+        }
+    }
+
+    for( i = batch->num_committed, kept = batch->num_committed; i < batch->num_changes; i++ )
+    {
+        if( batch->changes[i] != NULL )
+        {
+            batch->changes[kept++] = batch->changes[i];
+        }
+    }
+
+    batch->num_changes = kept;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    if( batch->num_committed == 0 )
+    {
+        batch->started = now;
+    }
+
+    batch->num_committed = batch->num_changes;
+    batch->commit_lsn    = change->lsn;
+    batch->num_transactions++;
+
+    backlog = unread + _queued_bytes( member->socket );
+
+    if(
+            change->lsn > batch->resume_lsn
+         && !coalesce_window_elapsed( batch->coalesced )
+         && !batch_due(
+                &( batch->controller ),
+                batch->coalesced->num_changes + batch->num_committed,
+                ( unsigned long ) ( _microseconds_between( &( batch->started ), &now ) / 1000 ),
+                backlog
+            )
+      )
+    {
+        return true;
+    }
+
+    return _apply_batch( me, member, batch, backlog );
+}
+
+/*
+ * Applies the committed transactions of batch, as their coalesced row changes
+ * followed by the records kept of them, reports its last COMMIT's LSN, and
+ * keeps only the changes of the transaction still in progress.
+ */
+static bool _apply_batch( struct worker * me, struct fanout_member * member, struct member_batch * batch, size_t backlog )
+{
+    struct timespec  started   = {0};
+    struct timespec  finished  = {0};
+    struct change ** net       = NULL;
+    struct change ** changes   = NULL;
+    uint64_t         apply_us  = 0;
+    uint64_t         latency   = 0;
+    unsigned long    num_net   = 0;
+    unsigned long    num_taken = 0;
+    unsigned long    i         = 0;
+    unsigned int     j         = 0;
+    bool             success   = false;
+
+    set_worker_status( me, WORKER_STATUS_UPDATE );
+    clock_gettime( CLOCK_MONOTONIC, &started );
+
+    num_taken = batch->coalesced->num_changes + batch->num_committed;
+
+    if( !coalesce_drain( batch->coalesced, &net, &num_net ) )
+    {
+        return false;
+    }
+
+    // The kept records go last, so that the batch's last COMMIT is too
+    changes = ( struct change ** ) calloc( num_net + batch->num_committed + 1, sizeof( struct change * ) );
+
+    if( changes == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate batch of location %u",
+            member->objects[0]->location
+        );
+
+        goto cleanup;
+    }
+
+    if( num_net > 0 )
+    {
+        memcpy( changes, net, num_net * sizeof( struct change * ) );
+    }
+
+    memcpy( changes + num_net, batch->changes, batch->num_committed * sizeof( struct change * ) );
+
+    if( !apply_dependency_graph( me, batch->graph, changes, num_net + batch->num_committed ) )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to apply %lu transactions ending at " LSN_FORMAT " to location %u",
+            batch->num_transactions,
+            LSN_FORMAT_ARGS( batch->commit_lsn ),
+            member->objects[0]->location
+        );
+
+        goto cleanup;
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &finished );
+    set_worker_status( me, WORKER_STATUS_IDLE );
+
+    apply_us = ( uint64_t ) _microseconds_between( &started, &finished );
+    batch_applied( &( batch->controller ), num_taken, apply_us, backlog );
+
+    metrics_count( METRIC_BATCHES, 1 );
+    metrics_count( METRIC_TRANSACTIONS, batch->num_transactions );
+    metrics_count( METRIC_CHANGES, num_taken );
+    metrics_observe( METRIC_BATCH_CHANGES, num_taken );
+    metrics_observe( METRIC_APPLY_MICROSECONDS, apply_us );
+    metrics_gauge( METRIC_APPLIED_LSN, batch->commit_lsn );
+    metrics_gauge( METRIC_BATCH_ROWS, batch->controller.rows );
+    metrics_gauge( METRIC_FLUSH_MS, batch->controller.flush_ms );
+
+    // Older decoders do not give the COMMIT's time
+    for( i = 0; i < batch->num_committed; i++ )
+    {
+        if( batch->changes[i]->type == CHANGE_TYPE_COMMIT && batch->changes[i]->commit_time != 0 )
+        {
+            latency = latency_since_commit( batch->changes[i]->commit_time );
+
+            metrics_commit_latency( latency );
+            record_latency( &( batch->interval ), latency );
+        }
+    }
+
+    /*
+     * Only the objects the batch changed have had it applied, each as late as
+     * the first of its transactions that changed it, which is not the batch's
+     * first unless that one did
+     */
+    for( j = 0; j < member->num_objects; j++ )
+    {
+        metrics_object_applied( batch->reported[j], member->objects[j]->applied_lsn );
+
+        if( batch->commit_times[j] != 0 && member->objects[j]->applied_lsn == batch->commit_lsn )
+        {
+            metrics_object_latency( batch->reported[j], latency_since_commit( batch->commit_times[j] ) );
+        }
+    }
+
+    memset( batch->commit_times, 0, member->num_objects * sizeof( int64_t ) );
+
+    if( batch->interval.count > 0 && _microseconds_between( &( batch->summarized ), &finished ) >= FANOUT_SUMMARY_MS * 1000L )
+    {
+        _log(
+            LOG_LEVEL_INFO,
+            "Location %u: %lu transactions in %ld s, commit latency p50 %.3f ms, p99 %.3f ms, p999 %.3f ms, max %.3f ms; batches of %lu changes",
+            member->objects[0]->location,
+            batch->interval.count,
+            ( long ) ( finished.tv_sec - batch->summarized.tv_sec ),
+            ( double ) latency_percentile( &( batch->interval ), NULL, 0.5 ) / 1000.0,
+            ( double ) latency_percentile( &( batch->interval ), NULL, 0.99 ) / 1000.0,
+            ( double ) latency_percentile( &( batch->interval ), NULL, 0.999 ) / 1000.0,
+            ( double ) batch->interval.max / 1000.0,
+            batch->controller.rows
+        );
+
+        memset( &( batch->interval ), 0, sizeof( batch->interval ) );
+        batch->summarized = finished;
+    }
+
+    for( i = 0; i < batch->num_committed; i++ )
+    {
+        free_change( batch->changes[i] );
+    }
+
+    memmove(
+        batch->changes,
+        batch->changes + batch->num_committed,
+        ( batch->num_changes - batch->num_committed ) * sizeof( struct change * )
+    );
+
+    batch->num_changes     -= batch->num_committed;
+    batch->num_committed    = 0;
+    batch->num_transactions = 0;
+    member->applied_lsn     = batch->commit_lsn;
+
+    success = _report_applied( me, member, batch, false );
+
+cleanup:
+    for( i = 0; i < num_net; i++ )
+    {
+        free_change( net[i] );
+    }
+
+    free( net );
+    free( changes );
+    return success;
+}
+
+/*
+ * Flushes the member's accumulated deltas that are due, or with force all of
+ * them, and reports how far the parent may confirm the slot for the member,
+ * if that moved: up to member's applied_lsn, but not past deltas that have
+ * not been flushed, so a crash cannot lose them, nor, as their flush records
+ * their progress, apply them twice.
+ */
+static bool _report_applied( struct worker * me, struct fanout_member * member, struct member_batch * batch, bool force )
+{
+    uint64_t lsn = 0;
+
+    if( !flush_dependency_graph( me, batch->graph, force ) )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to flush accumulated deltas to location %u",
+            member->objects[0]->location
+        );
+
+        return false;
+    }
+
+    lsn = dependency_graph_flushed_lsn( batch->graph, member->applied_lsn );
+
+    if( lsn <= batch->reported_lsn )
+    {
+        return true;
+    }
+
+    batch->reported_lsn = lsn;
+    return send( member->socket, &lsn, sizeof( uint64_t ), MSG_NOSIGNAL ) == sizeof( uint64_t );
+}
+
+/*
+ * Waits for the parent to send more changes. While none come, the worker's
+ * spare connections to the location are moved along, so that one is ready
+ * to take over should the target fail over in the meantime, and deltas
+ * accumulated in memory are flushed once due.
+ */
+static bool _wait_for_changes( struct worker * me, struct fanout_member * member, struct member_batch * batch )
+{
+    struct pollfd pending = {0};
+    int           timeout = -1;
+    int           ready   = 0;
+    unsigned int  i       = 0;
+
+    pending.fd     = member->socket;
+    pending.events = POLLIN;
+    timeout        = me->connection_pool != NULL ? FANOUT_IDLE_MS : -1;
+
+    // Deltas accumulated in memory are also due for a flush by time
+    for( i = 0; batch->graph->accumulators != NULL && i < batch->graph->num_objects; i++ )
+    {
+        if( batch->graph->accumulators[i] != NULL )
+        {
+            timeout = FANOUT_IDLE_MS;
+        }
+    }
+
+    while( ( ready = poll( &pending, 1, timeout ) ) <= 0 )
+    {
+        if( ready < 0 && errno != EINTR )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to wait for changes: %s",
+                strerror( errno )
+            );
+
+            return false;
+        }
+
+        if(
+                ready == 0
+             && (
+                    (
+                        me->connection_pool != NULL
+                     && !poll_connection_pool( ( struct connection_pool * ) me->connection_pool, 0 )
+                    )
+                 || !_report_applied( me, member, batch, false )
+                )
+          )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Writes as much of member's queue as its socket will take
+static bool _send_queue( struct fanout_member * member )
+{
+    char *  data   = NULL;
+    size_t  length = 0;
+    ssize_t sent   = 0;
+
+    while( spill_queue_peek( member->queue, &data, &length ) )
+    {
+        sent = send( member->socket, data, length, MSG_NOSIGNAL | MSG_DONTWAIT );
+
+        if( sent < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        spill_queue_consume( member->queue, ( size_t ) sent );
+    }
+
+    return true;
+}
+
+// Reads the LSNs member has reported. Returns false once it has gone away.
+static bool _read_acks( struct fanout_member * member )
+{
+    ssize_t received = 0;
+
+    while( true )
+    {
+        received = recv(
+            member->socket,
+            member->ack + member->ack_length,
+            sizeof( member->ack ) - member->ack_length,
+            MSG_DONTWAIT
+        );
+
+        if( received == 0 )
+        {
+            return false;
+        }
+
+        if( received < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        member->ack_length += ( size_t ) received;
+
+        if( member->ack_length == sizeof( member->ack ) )
+        {
+            memcpy( &( member->applied_lsn ), member->ack, sizeof( uint64_t ) );
+            member->ack_length = 0;
+
+            // A segment that cannot be marked is only read again after a restart
+            spill_queue_confirm( member->queue, member->applied_lsn );
+        }
+    }
+}
+
+/*
+ * Stops feeding location and waiting for it. Its members are ended, as what
+ * they have been sent is of no use without what follows.
+ */
+static void _detach_location( struct fanout_location * location, const char * reason )
+{
+    unsigned int i = 0;
+
+    if( location->detached )
+    {
+        return;
+    }
+
+    location->detached = true;
+
+    for( i = 0; i < location->num_members; i++ )
+    {
+        if( location->members[i].pid > 0 )
+        {
+            close( location->members[i].socket );
+            kill( location->members[i].pid, SIGTERM );
+            location->members[i].socket = -1;
+        }
+
+        _end_member( &( location->members[i] ) );
+        free_spill_queue( location->members[i].queue, true );
+        location->members[i].queue = NULL;
+    }
+
+    _log(
+        LOG_LEVEL_WARNING,
+        "Detached location %u at " LSN_FORMAT " as %s, its %u objects are streamed again from there",
+        location->location,
+        LSN_FORMAT_ARGS( location->applied_lsn ),
+        reason,
+        location->num_objects
+    );
+
+    return;
+}
+
+// Appends value as a quoted conninfo value
+static void _append_conninfo_value( struct string_buffer * buffer, char * value )
+{
+    string_buffer_append( buffer, "'" );
+
+    for( ; value != NULL && *value != '\0'; value++ )
+    {
+        if( *value == '\'' || *value == '\\' )
+        {
+            string_buffer_append( buffer, "\\" );
+        }
+
+        string_buffer_append_bytes( buffer, value, 1 );
+    }
+
+    string_buffer_append( buffer, "'" );
+    return;
+}
+
+static int64_t _microseconds_between( struct timespec * from, struct timespec * to )
+{
+    return ( int64_t ) ( to->tv_sec - from->tv_sec ) * 1000000L + ( to->tv_nsec - from->tv_nsec ) / 1000L;
+}
+
+// Bytes sent on socket not yet read
+static size_t _queued_bytes( int socket )
+{
+    int queued = 0;
+
+    if( ioctl( socket, FIONREAD, &queued ) != 0 || queued < 0 )
+    {
+        return 0;
+    }
+
+    return ( size_t ) queued;
+}
@@ -0,0 +1,190 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include "util.h"
+#include "query.h"
+#include "change.h"
+#include "object.h"
+#include "dependency.h"
+#include "replication.h"
+#include "spill.h"
+#include "metrics.h"
+#include "batch_controller.h"
+#include "coalesce.h"
+#include <stdint.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+
+#define DEFAULT_FANOUT_POOL_SIZE 2
+#define DEFAULT_FANOUT_WORKER_LIMIT 0
+#define DEFAULT_FANOUT_LAG_BUDGET 67108864
+#define DEFAULT_FANOUT_HIGH_WATER 33554432
+
+// What of fanout_high_water a member's queue has to drain to before its location is no longer throttled
+#define FANOUT_LOW_WATER( high_water ) ( ( high_water ) / 2 )
+
+#define FANOUT_READ_BYTES 65536
+
+// Longest name told apart by a fan-out's queues
+#define FANOUT_NAME_LENGTH 64
+
+// Milliseconds an idle member waits for changes between tending its spare connections
+#define FANOUT_IDLE_MS 100
+
+// Milliseconds a member goes with nothing queued for it before it ends, see _tend_members()
+#define FANOUT_RETIRE_MS 10000
+
+// Milliseconds between the commit latency summaries a member logs, while it applies anything
+#define FANOUT_SUMMARY_MS 60000
+
+extern unsigned int fanout_pool_size;
+extern unsigned int fanout_worker_limit;
+extern uint64_t fanout_lag_budget;
+extern uint64_t fanout_high_water;
+
+/*
+ * A process applying the change stream to some of a location's objects,
+ * always all of those of any one component of their dependency graph.
+ * Records are framed onto queue, which spills to disk while the process is
+ * behind or not running, and written to socket as the process takes them;
+ * it reports the LSN of each COMMIT it has applied back over the same
+ * socket, into ack. safe_lsn is how far the slot may be confirmed for it,
+ * see spill_queue_safe_lsn(). pid is 0 while no process is running, which
+ * is started once something is queued, or waiting while there is no room
+ * for it in the pool; retiring is set once it has been told to end, having
+ * had nothing queued since queued, see _tend_members().
+ */
+struct fanout_member {
+    pid_t                        pid;
+    int                          socket;
+    struct spill_queue *         queue;
+    uint64_t                     safe_lsn;
+    struct maintenance_object ** objects;
+    unsigned int                 num_objects;
+    uint64_t                     applied_lsn;
+    char                         ack[sizeof( uint64_t )];
+    size_t                       ack_length;
+    struct timespec              queued;
+    bool                         waiting;
+    bool                         retiring;
+};
+
+/*
+ * What a member has taken off its socket and not yet applied. Transactions
+ * are gathered into a batch, which is applied to the location with one
+ * target transaction per object when controller says so, or once coalesced
+ * is a full window, see coalesce_window_elapsed(). As each transaction
+ * commits, its row changes are coalesced to one net change per relation and
+ * key into coalesced, and only its other records (and rows without a key)
+ * are kept in changes, up to num_committed; the changes past that belong to
+ * a transaction whose COMMIT is yet to come. commit_lsn is that of the
+ * batch's last COMMIT, started when its first was taken. Transactions up to
+ * resume_lsn, which some of the objects have already applied and some may
+ * not have, are applied one at a time, so that every object can tell whether
+ * it has applied a batch as a whole. interval gathers the commit latencies
+ * logged every FANOUT_SUMMARY_MS, since summarized. commit_times, indexed
+ * like the member's objects, is the COMMIT time of the batch's first
+ * transaction that changed each, worked out with changed before the
+ * transaction is coalesced, see _take_change(). reported_lsn is the last
+ * LSN reported to the parent, which is held at the last flush of objects
+ * whose deltas are accumulated in memory while they hold unflushed ones, see
+ * dependency_graph_flushed_lsn().
+ */
+struct member_batch {
+    struct dependency_graph * graph;
+    struct object_metrics **  reported;
+    bool *                    changed;
+    int64_t *                 commit_times;
+    struct coalesce_table *   coalesced;
+    struct change **          changes;
+    unsigned long             num_changes;
+    unsigned long             size;
+    unsigned long             num_committed;
+    unsigned long             num_transactions;
+    uint64_t                  commit_lsn;
+    uint64_t                  resume_lsn;
+    uint64_t                  reported_lsn;
+    struct timespec           started;
+    struct batch_controller   controller;
+    struct latency_histogram  interval;
+    struct timespec           summarized;
+};
+
+/*
+ * A tb_location the stream is applied to, with its own copies of the objects
+ * maintained there and its own pool of members. postgresql targets are
+ * connected to with conninfo, in the location's own database; one that is
+ * remote, not the source database, has its objects' rows evaluated against
+ * the source, connected to with source_conninfo, see struct worker.
+ * applied_lsn and safe_lsn are the least of its members'. A location whose
+ * safe_lsn falls more than fanout_lag_budget bytes of WAL behind, which only
+ * happens once its queues cannot spill, or whose members fail, is detached:
+ * it is no longer fed, and its safe_lsn holds back the slot until the
+ * fan-out is started again, see fanout_detached(). throttled is set once a
+ * member has more than fanout_high_water bytes queued, and cleared once all
+ * of them are down to FANOUT_LOW_WATER, see struct fanout.
+ */
+struct fanout_location {
+    unsigned int                 location;
+    char *                       conninfo;
+    char *                       source_conninfo;
+    bool                         remote;
+    struct maintenance_object ** objects;
+    unsigned int                 num_objects;
+    struct fanout_member *       members;
+    unsigned int                 num_members;
+    uint64_t                     applied_lsn;
+    uint64_t                     safe_lsn;
+    bool                         detached;
+    bool                         throttled;
+};
+
+struct fanout;
+
+/*
+ * Called with the socket of a member a fan-out has started, with the
+ * argument it was given; returning false fails the member's location.
+ */
+typedef bool ( * fanout_watch )( struct fanout *, int, void * );
+
+/*
+ * One decoded change stream applied to every location its objects are
+ * maintained at, concurrently. confirmed_lsn is the least safe_lsn of the
+ * locations, the position the slot may be confirmed to; it is 0 until each
+ * of them has applied or spilled a transaction. start_lsn is that of the
+ * first record queued, the position lag is measured from until then.
+ * name tells apart the queues of the fan-outs of different source databases.
+ * throttled is set while every attached location is, and the source is not
+ * read meanwhile: the stream slows to what the fastest location applies, so
+ * that no location waits on another. A location that is throttled alone
+ * goes on being fed, its queues spilling to disk, and is detached once it
+ * falls more than fanout_lag_budget behind. fanout_high_water is below that
+ * budget, so that a location is throttled well before it can be detached.
+ * open is set while the last record queued is not a COMMIT. watch is
+ * called as members start, see new_fanout().
+ */
+struct fanout {
+    char                     name[FANOUT_NAME_LENGTH + 1];
+    struct fanout_location * locations;
+    unsigned int             num_locations;
+    uint64_t                 start_lsn;
+    uint64_t                 queued_lsn;
+    uint64_t                 confirmed_lsn;
+    bool                     throttled;
+    bool                     open;
+    fanout_watch             watch;
+    void *                   watch_argument;
+};
+
+extern struct fanout * new_fanout( struct worker *, char *, struct maintenance_object **, unsigned int, fanout_watch, void * );
+extern bool fanout_record( struct fanout *, char *, uint64_t, bool );
+extern bool fanout_throttled( struct fanout * );
+extern bool poll_fanout( struct fanout *, int );
+extern bool fanout_socket_ready( struct fanout *, int, bool, bool );
+extern void update_fanout( struct fanout * );
+extern bool fanout_detached( struct fanout * );
+extern void free_fanout( struct fanout * );
+
+#endif // FANOUT_H
@@ -0,0 +1,2144 @@
+#include "ivm.h"
+#include "apply.h"
+#include "statement_cache.h"
+
+/*
+ * The columns of a relation a definition reads, which of them make up its
+ * replica identity, and whether that identity is the whole row - in which
+ * case the old values of every column are decoded for UPDATEs and DELETEs.
+ */
+static const char * relation_query = "\
+    SELECT n.nspname, \
+           c.relname, \
+           c.relreplident = 'f', \
+           a.attname, \
+           pg_catalog.format_type( a.atttypid, a.atttypmod ), \
+           COALESCE( a.attnum = ANY( i.indkey ), FALSE ) \
+      FROM pg_catalog.pg_class c \
+      JOIN pg_catalog.pg_namespace n \
+        ON n.oid = c.relnamespace \
+      JOIN pg_catalog.pg_attribute a \
+        ON a.attrelid = c.oid \
+       AND a.attnum > 0 \
+       AND NOT a.attisdropped \
+ LEFT JOIN pg_catalog.pg_index i \
+        ON i.indrelid = c.oid \
+       AND ( i.indisreplident OR ( c.relreplident = 'd' AND i.indisprimary ) ) \
+     WHERE c.oid = $1::REGCLASS \
+  ORDER BY a.attnum";
+
+static bool _describe_relation( struct worker *, struct ivm_relation *, struct definition_relation * );
+static bool _plan_rows( struct worker *, struct maintenance_object *, struct ivm_plan * );
+static bool _plan_aggregate( struct worker *, struct maintenance_object *, struct ivm_plan * );
+static char * _build_insert( struct maintenance_object *, struct definition *, char * );
+static char * _build_returning( struct maintenance_object *, char * );
+static char * _build_select( struct maintenance_object *, struct definition *, struct ivm_relation *, char * );
+static void _set_driver_keys( struct maintenance_object *, struct ivm_plan * );
+static bool _keyed_by_params( struct maintenance_object *, struct ivm_plan * );
+static char * _substitute_row( struct worker *, struct ivm_plan *, unsigned int );
+static int _resolve_column( struct ivm_plan *, char *, unsigned int * );
+static int _exposing_column( struct ivm_plan *, struct maintenance_object *, unsigned int, unsigned int );
+static int _target_column( struct maintenance_object *, char * );
+static bool _refresh_on_change( struct worker *, struct maintenance_object *, struct ivm_plan *, struct change **, unsigned long );
+static bool _append_deltas( struct maintenance_object *, PGresult *, unsigned short, struct change ***, unsigned long * );
+static bool _append_rows(
+    struct maintenance_object *,
+    struct ivm_relation *,
+    PGresult *,
+    struct change ***,
+    unsigned long *
+);
+static struct tuple * _read_tuple( PGresult *, int, int, unsigned int );
+static bool _collect_requests(
+    struct ivm_plan *,
+    struct change **,
+    unsigned long,
+    struct ivm_request *,
+    unsigned long *
+);
+static bool _reads_table( struct ivm_plan *, unsigned int, struct change * );
+static bool _add_request( struct ivm_plan *, unsigned int, struct change *, bool, struct ivm_request * );
+static char * _change_value( struct change *, char *, bool, int * );
+static int _compare_requests( const void *, const void * );
+static void _free_request( struct ivm_request * );
+static void _free_relation( struct ivm_relation * );
+
+/*
+ * Works out how object's definition can be maintained incrementally. The
+ * definition is classified as a projection and filter of one relation, an
+ * inner join of several, or a grouping of either, and for each relation it
+ * reads a pair of statements is derived that recomputes only the target rows
+ * a change to one of its rows can affect:
+ *
+ *  - For projections and joins, the target rows carrying the changed row's
+ *    key, which the target must therefore include for every relation.
+ *  - For aggregates, the groups the changed row falls into. Where all of the
+ *    grouping columns belong to the changed relation these are read off the
+ *    row, otherwise they are found by evaluating the definition's FROM and
+ *    WHERE over the row in place of its relation, which needs its old values
+ *    in full (REPLICA IDENTITY FULL).
+ *
+ * Any definition that does not fit one of these is planned as
+ * IVM_KIND_UNSUPPORTED. Returns NULL only on errors.
+ *
+ * Targets of drivers other than postgresql are evaluated instead, see
+ * evaluate_changes(), which needs the target rows a change affects to be
+ * identified by its parameters. That rules out joins, whose rows carry the
+ * keys of their other relations too, and aggregates whose groups cannot be
+ * read off the changed row. The columns that identify them become the
+ * object's key columns.
+ */
+struct ivm_plan * plan_maintenance( struct worker * me, struct maintenance_object * object )
+{
+    struct ivm_plan *   plan       = NULL;
+    struct definition * definition = NULL;
+    unsigned int        i          = 0;
+    bool                supported  = false;
+
+    if( me == NULL || object == NULL )
+    {
+        return NULL;
+    }
+
+    if( object->num_columns == 0 && !describe_maintenance_object( me, object ) )
+    {
+        return NULL;
+    }
+
+    plan = ( struct ivm_plan * ) calloc( 1, sizeof( struct ivm_plan ) );
+
+    if( plan == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate maintenance plan for %s",
+            object->qualified_name
+        );
+
+        return NULL;
+    }
+
+    plan->definition = parse_definition( object->definition );
+    definition       = plan->definition;
+
+    if( definition == NULL )
+    {
+        free( plan );
+        return NULL;
+    }
+
+    if( definition->num_relations > 0 )
+    {
+        plan->relations = ( struct ivm_relation * ) calloc(
+            definition->num_relations,
+            sizeof( struct ivm_relation )
+        );
+
+        if( plan->relations == NULL )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to allocate relations of maintenance plan for %s",
+                object->qualified_name
+            );
+
+            free_ivm_plan( plan );
+            return NULL;
+        }
+    }
+
+    for( i = 0; i < definition->num_relations; i++ )
+    {
+        plan->num_relations++;
+
+        if( !_describe_relation( me, &( plan->relations[i] ), &( definition->relations[i] ) ) )
+        {
+            free_ivm_plan( plan );
+            return NULL;
+        }
+    }
+
+    if( !( definition->is_select ) || definition->num_relations == 0 || definition->is_distinct )
+    {
+        _log(
+            LOG_LEVEL_INFO,
+            "Definition of %s is not a SELECT over inner joined relations",
+            object->qualified_name
+        );
+    }
+    else if( definition->has_aggregates || definition->group_by != NULL || definition->having != NULL )
+    {
+        plan->kind = IVM_KIND_AGGREGATE;
+        supported  = _plan_aggregate( me, object, plan );
+    }
+    else
+    {
+        plan->kind = definition->num_relations == 1 ? IVM_KIND_PROJECTION : IVM_KIND_JOIN;
+        supported  = _plan_rows( me, object, plan );
+    }
+
+    for( i = 0; supported && ( object->driver != DRIVER_POSTGRESQL || object->remote ) && i < plan->num_relations; i++ )
+    {
+        supported = plan->kind != IVM_KIND_JOIN && plan->relations[i].select_sql != NULL;
+    }
+
+    // The rows evaluated for a remote target are written by its own key, so they must be found by it
+    if( supported && object->driver == DRIVER_POSTGRESQL && object->remote )
+    {
+        supported = _keyed_by_params( object, plan );
+    }
+
+    if( !supported )
+    {
+        _log(
+            LOG_LEVEL_INFO,
+            "%s cannot be maintained incrementally and will be refreshed on change",
+            object->qualified_name
+        );
+
+        plan->kind = IVM_KIND_UNSUPPORTED;
+    }
+
+    if( object->driver != DRIVER_POSTGRESQL )
+    {
+        _set_driver_keys( object, plan );
+    }
+
+    return plan;
+}
+
+void free_ivm_plan( struct ivm_plan * plan )
+{
+    unsigned int i = 0;
+
+    if( plan == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < plan->num_relations; i++ )
+    {
+        _free_relation( &( plan->relations[i] ) );
+    }
+
+    free_definition( plan->definition );
+    free( plan->relations );
+    free( plan );
+    return;
+}
+
+/*
+ * Brings object's target up to date with changes to the relations its
+ * definition reads; changes to other tables are ignored. Each change is
+ * turned into requests to recompute the target rows its old and new row
+ * contribute to, duplicates are dropped, and the remaining requests are run
+ * as pipelined delete / insert pairs. As with apply_changes(), a transaction
+ * is opened for them if the caller has not done so.
+ *
+ * The delta statements evaluate the definition on the connection the target
+ * is written through, so they see the relations' current contents rather
+ * than those as of the change; a later change to the same rows recomputes
+ * them again, so the target converges on the definition as the stream is
+ * consumed. Objects that cannot be maintained incrementally are refreshed
+ * instead, once per call that includes changes to the tables they read.
+ *
+ * If deltas is given, the target rows the statements removed and added are
+ * appended to it as DELETE and INSERT changes to the target, so that they can
+ * be fed to objects defined over it; num_deltas counts them. A row that is
+ * recomputed unchanged appears as both. Nothing is appended for a refresh.
+ */
+bool maintain_changes(
+    struct worker *             me,
+    struct maintenance_object * object,
+    struct change **            changes,
+    unsigned long               num_changes,
+    struct change ***           deltas,
+    unsigned long *             num_deltas
+)
+{
+    struct ivm_plan *            plan            = NULL;
+    struct ivm_request *         requests        = NULL;
+    struct prepared_statement ** deletes         = NULL;
+    struct prepared_statement ** inserts         = NULL;
+    struct pipeline_statement *  statements      = NULL;
+    struct string_buffer *       columns         = NULL;
+    struct ivm_relation *        relation        = NULL;
+#ifndef LIBPQ_HAS_PIPELINING
+    PGresult *                   result          = NULL;
+#endif
+    unsigned long                num_requests    = 0;
+    unsigned long                num_statements  = 0;
+    unsigned long                failed          = 0;
+    unsigned long                i               = 0;
+    bool                         own_transaction = false;
+    bool                         success         = false;
+
+    if( me == NULL || object == NULL || changes == NULL || ( deltas != NULL && num_deltas == NULL ) )
+    {
+        return false;
+    }
+
+    if( num_changes == 0 )
+    {
+        return true;
+    }
+
+    if( object->ivm == NULL )
+    {
+        object->ivm = plan_maintenance( me, object );
+
+        if( object->ivm == NULL )
+        {
+            return false;
+        }
+    }
+
+    plan = ( struct ivm_plan * ) object->ivm;
+
+    if( plan->kind == IVM_KIND_UNSUPPORTED )
+    {
+        return _refresh_on_change( me, object, plan, changes, num_changes );
+    }
+
+    // Each change can ask for its old and new rows to be recomputed, per relation it is read as
+    requests = ( struct ivm_request * ) calloc(
+        num_changes * plan->num_relations * 2 + 1,
+        sizeof( struct ivm_request )
+    );
+    deletes  = ( struct prepared_statement ** ) calloc(
+        plan->num_relations,
+        sizeof( struct prepared_statement * )
+    );
+    inserts  = ( struct prepared_statement ** ) calloc(
+        plan->num_relations,
+        sizeof( struct prepared_statement * )
+    );
+    columns  = new_string_buffer();
+
+    if( requests == NULL || deletes == NULL || inserts == NULL || columns == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate maintenance requests for %s",
+            object->qualified_name
+        );
+
+        goto cleanup;
+    }
+
+    if( !_collect_requests( plan, changes, num_changes, requests, &num_requests ) )
+    {
+        goto cleanup;
+    }
+
+    if( num_requests == 0 )
+    {
+        success = true;
+        goto cleanup;
+    }
+
+    statements = ( struct pipeline_statement * ) calloc(
+        num_requests * 2,
+        sizeof( struct pipeline_statement )
+    );
+
+    if( statements == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate maintenance statements for %s",
+            object->qualified_name
+        );
+
+        goto cleanup;
+    }
+
+    for( i = 0; i < num_requests; i++ )
+    {
+        if(
+                i > 0
+             && requests[i].key_length == requests[i - 1].key_length
+             && memcmp( requests[i].key, requests[i - 1].key, requests[i].key_length ) == 0
+          )
+        {
+            continue;
+        }
+
+        relation = &( plan->relations[requests[i].relation] );
+
+        if( deletes[requests[i].relation] == NULL )
+        {
+            string_buffer_reset( columns );
+            string_buffer_append( columns, "%s:ivm:%u", object->qualified_name, requests[i].relation );
+
+            deletes[requests[i].relation] = get_prepared_statement(
+                me,
+                object->maintenance_object,
+                deltas != NULL ? IVM_STATEMENT_DELETE_RETURNING : IVM_STATEMENT_DELETE,
+                columns->data,
+                deltas != NULL ? relation->delete_returning_sql : relation->delete_sql,
+                ( int ) relation->num_params,
+                NULL
+            );
+            inserts[requests[i].relation] = get_prepared_statement(
+                me,
+                object->maintenance_object,
+                deltas != NULL ? IVM_STATEMENT_INSERT_RETURNING : IVM_STATEMENT_INSERT,
+                columns->data,
+                deltas != NULL ? relation->insert_returning_sql : relation->insert_sql,
+                ( int ) relation->num_params,
+                NULL
+            );
+
+            if( deletes[requests[i].relation] == NULL || inserts[requests[i].relation] == NULL )
+            {
+                _log(
+                    LOG_LEVEL_ERROR,
+                    "Failed to build maintenance statements for %s",
+                    object->qualified_name
+                );
+
+                goto cleanup;
+            }
+        }
+
+        statements[num_statements].prepared      = deletes[requests[i].relation];
+        statements[num_statements].params        = requests[i].values;
+        statements[num_statements].param_lengths = requests[i].lengths;
+        statements[num_statements].param_formats = requests[i].formats;
+        statements[num_statements].param_count   = relation->num_params;
+        statements[num_statements].keep_result   = deltas != NULL;
+        num_statements++;
+
+        statements[num_statements]          = statements[num_statements - 1];
+        statements[num_statements].prepared = inserts[requests[i].relation];
+        num_statements++;
+    }
+
+    if( !( me->tx_in_progress ) )
+    {
+        if( !_begin_transaction( me ) )
+        {
+            goto cleanup;
+        }
+
+        own_transaction = true;
+    }
+
+    success = true;
+
+#ifdef LIBPQ_HAS_PIPELINING
+    if( !_execute_pipeline( me, statements, num_statements, &failed ) )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to maintain %s, statement %lu of %lu (SQL state %s)",
+            object->qualified_name,
+            failed + 1,
+            num_statements,
+            statements[failed].sql_state
+        );
+
+        success = false;
+    }
+#else
+    for( failed = 0; failed < num_statements && success; failed++ )
+    {
+        result = _execute_prepared(
+            me,
+            statements[failed].prepared,
+            statements[failed].params,
+            statements[failed].param_lengths,
+            statements[failed].param_formats
+        );
+
+        if( result == NULL )
+        {
+            success = false;
+        }
+        else if( statements[failed].keep_result )
+        {
+            statements[failed].result = result;
+            result                    = NULL;
+        }
+
+        PQclear( result );
+    }
+#endif
+
+    // Deletes and inserts alternate
+    for( i = 0; success && deltas != NULL && i < num_statements; i++ )
+    {
+        success = _append_deltas(
+            object,
+            statements[i].result,
+            i % 2 == 0 ? CHANGE_TYPE_DELETE : CHANGE_TYPE_INSERT,
+            deltas,
+            num_deltas
+        );
+    }
+
+    if( own_transaction )
+    {
+        if( success )
+        {
+            success = _commit_transaction( me );
+        }
+        else if( me->tx_in_progress )
+        {
+            _rollback_transaction( me );
+        }
+    }
+
+cleanup:
+    for( i = 0; requests != NULL && i < num_requests; i++ )
+    {
+        _free_request( &( requests[i] ) );
+    }
+
+    for( i = 0; statements != NULL && i < num_statements; i++ )
+    {
+        PQclear( statements[i].result );
+    }
+
+    free( requests );
+    free( deletes );
+    free( inserts );
+    free( statements );
+    free_string_buffer( columns );
+    return success;
+}
+
+/*
+ * Works out the target rows changes affect, for targets of drivers other than
+ * postgresql, which cannot run maintain_changes()' statements. Each change
+ * asks for the rows its old and new row contribute to, as there, and each
+ * distinct request is run as its relation's select_sql, pipelined. The rows
+ * found are appended to rows as INSERTs of the whole target row, and the
+ * requests that found none as DELETEs; both are keyed by the object's key
+ * columns, see plan_maintenance(), ready to be written through its driver.
+ *
+ * The definition is evaluated on me's connection, which must therefore be to
+ * the database the definition reads. Objects that cannot be evaluated this
+ * way are refreshed instead, and are an error here.
+ */
+bool evaluate_changes(
+    struct worker *             me,
+    struct maintenance_object * object,
+    struct change **            changes,
+    unsigned long               num_changes,
+    struct change ***           rows,
+    unsigned long *             num_rows
+)
+{
+    struct ivm_plan *            plan           = NULL;
+    struct ivm_request *         requests       = NULL;
+    struct prepared_statement ** selects        = NULL;
+    struct pipeline_statement *  statements     = NULL;
+    struct ivm_relation **       relations      = NULL;
+    struct string_buffer *       name           = NULL;
+    struct ivm_relation *        relation       = NULL;
+#ifndef LIBPQ_HAS_PIPELINING
+    PGresult *                   result         = NULL;
+#endif
+    unsigned long                num_requests   = 0;
+    unsigned long                num_statements = 0;
+    unsigned long                failed         = 0;
+    unsigned long                i              = 0;
+    bool                         success        = false;
+
+    if( me == NULL || object == NULL || changes == NULL || rows == NULL || num_rows == NULL )
+    {
+        return false;
+    }
+
+    if( num_changes == 0 )
+    {
+        return true;
+    }
+
+    if( object->ivm == NULL )
+    {
+        object->ivm = plan_maintenance( me, object );
+
+        if( object->ivm == NULL )
+        {
+            return false;
+        }
+    }
+
+    plan = ( struct ivm_plan * ) object->ivm;
+
+    if( plan->kind == IVM_KIND_UNSUPPORTED )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "%s cannot be evaluated incrementally",
+            object->qualified_name
+        );
+
+        return false;
+    }
+
+    requests = ( struct ivm_request * ) calloc(
+        num_changes * plan->num_relations * 2 + 1,
+        sizeof( struct ivm_request )
+    );
+    selects  = ( struct prepared_statement ** ) calloc(
+        plan->num_relations,
+        sizeof( struct prepared_statement * )
+    );
+    name     = new_string_buffer();
+
+    if( requests == NULL || selects == NULL || name == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate evaluation requests for %s",
+            object->qualified_name
+        );
+
+        goto cleanup;
+    }
+
+    if( !_collect_requests( plan, changes, num_changes, requests, &num_requests ) )
+    {
+        goto cleanup;
+    }
+
+    if( num_requests == 0 )
+    {
+        success = true;
+        goto cleanup;
+    }
+
+    statements = ( struct pipeline_statement * ) calloc(
+        num_requests,
+        sizeof( struct pipeline_statement )
+    );
+    relations  = ( struct ivm_relation ** ) calloc(
+        num_requests,
+        sizeof( struct ivm_relation * )
+    );
+
+    if( statements == NULL || relations == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate evaluation statements for %s",
+            object->qualified_name
+        );
+
+        goto cleanup;
+    }
+
+    for( i = 0; i < num_requests; i++ )
+    {
+        if(
+                i > 0
+             && requests[i].key_length == requests[i - 1].key_length
+             && memcmp( requests[i].key, requests[i - 1].key, requests[i].key_length ) == 0
+          )
+        {
+            continue;
+        }
+
+        relation = &( plan->relations[requests[i].relation] );
+
+        if( selects[requests[i].relation] == NULL )
+        {
+            string_buffer_reset( name );
+            string_buffer_append( name, "%s:ivm:%u", object->qualified_name, requests[i].relation );
+
+            selects[requests[i].relation] = get_prepared_statement(
+                me,
+                object->maintenance_object,
+                IVM_STATEMENT_SELECT,
+                name->data,
+                relation->select_sql,
+                ( int ) relation->num_params,
+                NULL
+            );
+
+            if( selects[requests[i].relation] == NULL )
+            {
+                _log(
+                    LOG_LEVEL_ERROR,
+                    "Failed to build evaluation statement for %s",
+                    object->qualified_name
+                );
+
+                goto cleanup;
+            }
+        }
+
+        statements[num_statements].prepared      = selects[requests[i].relation];
+        statements[num_statements].params        = requests[i].values;
+        statements[num_statements].param_lengths = requests[i].lengths;
+        statements[num_statements].param_formats = requests[i].formats;
+        statements[num_statements].param_count   = relation->num_params;
+        statements[num_statements].keep_result   = true;
+        relations[num_statements]                = relation;
+        num_statements++;
+    }
+
+    success = true;
+
+#ifdef LIBPQ_HAS_PIPELINING
+    if( !_execute_pipeline( me, statements, num_statements, &failed ) )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to evaluate %s, statement %lu of %lu (SQL state %s)",
+            object->qualified_name,
+            failed + 1,
+            num_statements,
+            statements[failed].sql_state
+        );
+
+        success = false;
+    }
+#else
+    for( failed = 0; failed < num_statements && success; failed++ )
+    {
+        result = _execute_prepared(
+            me,
+            statements[failed].prepared,
+            statements[failed].params,
+            statements[failed].param_lengths,
+            statements[failed].param_formats
+        );
+
+        if( result == NULL )
+        {
+            success = false;
+        }
+
+        statements[failed].result = result;
+    }
+#endif
+
+    for( i = 0; success && i < num_statements; i++ )
+    {
+        success = _append_rows( object, relations[i], statements[i].result, rows, num_rows );
+    }
+
+cleanup:
+    for( i = 0; requests != NULL && i < num_requests; i++ )
+    {
+        _free_request( &( requests[i] ) );
+    }
+
+    for( i = 0; statements != NULL && i < num_statements; i++ )
+    {
+        PQclear( statements[i].result );
+    }
+
+    free( requests );
+    free( selects );
+    free( statements );
+    free( relations );
+    free_string_buffer( name );
+    return success;
+}
+
+// Reads the catalog entry of the relation named in a definition's FROM clause
+static bool _describe_relation(
+    struct worker *              me,
+    struct ivm_relation *        relation,
+    struct definition_relation * definition_relation
+)
+{
+    PGresult *   result    = NULL;
+    char *       params[1] = { NULL };
+    unsigned int num_rows  = 0;
+    unsigned int i         = 0;
+
+    params[0] = definition_relation->relation;
+    result    = _execute_query( me, ( char * ) relation_query, params, 1 );
+
+    if( result == NULL )
+    {
+        return false;
+    }
+
+    num_rows = ( unsigned int ) PQntuples( result );
+
+    if( num_rows == 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Relation %s has no columns",
+            definition_relation->relation
+        );
+
+        PQclear( result );
+        return false;
+    }
+
+    relation->schema_name   = strdup( PQgetvalue( result, 0, 0 ) );
+    relation->table_name    = strdup( PQgetvalue( result, 0, 1 ) );
+    relation->full_identity = strcmp( PQgetvalue( result, 0, 2 ), "t" ) == 0;
+    relation->columns       = ( char ** ) calloc( num_rows + 1, sizeof( char * ) );
+    relation->column_types  = ( char ** ) calloc( num_rows + 1, sizeof( char * ) );
+    relation->is_key        = ( bool * ) calloc( num_rows + 1, sizeof( bool ) );
+    relation->params        = ( unsigned int * ) calloc( num_rows + 1, sizeof( unsigned int ) );
+    relation->param_targets = ( int * ) calloc( num_rows + 1, sizeof( int ) );
+
+    // Column references name the relation by its alias if it has one, otherwise by its table
+    if( definition_relation->alias != NULL )
+    {
+        relation->qualifier = strdup( definition_relation->alias );
+        relation->name      = normalize_identifier( definition_relation->alias, NULL );
+    }
+    else
+    {
+        relation->qualifier = strdup( definition_relation->relation );
+        relation->name      = relation->table_name != NULL ? strdup( relation->table_name ) : NULL;
+    }
+
+    if(
+            relation->schema_name == NULL
+         || relation->table_name == NULL
+         || relation->columns == NULL
+         || relation->column_types == NULL
+         || relation->is_key == NULL
+         || relation->params == NULL
+         || relation->param_targets == NULL
+         || relation->qualifier == NULL
+         || relation->name == NULL
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate description of %s",
+            definition_relation->relation
+        );
+
+        PQclear( result );
+        return false;
+    }
+
+    for( i = 0; i < num_rows; i++ )
+    {
+        relation->columns[i]      = strdup( PQgetvalue( result, i, 3 ) );
+        relation->column_types[i] = strdup( PQgetvalue( result, i, 4 ) );
+        relation->is_key[i]       = strcmp( PQgetvalue( result, i, 5 ), "t" ) == 0;
+        relation->num_columns++;
+
+        if( relation->columns[i] == NULL || relation->column_types[i] == NULL )
+        {
+            PQclear( result );
+            return false;
+        }
+    }
+
+    PQclear( result );
+    return true;
+}
+
+/*
+ * Plans a projection or join: a change to a row of any relation recomputes
+ * the target rows whose copy of the relation's key matches the row's.
+ */
+static bool _plan_rows( struct worker * me, struct maintenance_object * object, struct ivm_plan * plan )
+{
+    struct ivm_relation *  relation  = NULL;
+    struct string_buffer * delete    = NULL;
+    struct string_buffer * predicate = NULL;
+    char *                 column    = NULL;
+    unsigned int           i         = 0;
+    unsigned int           j         = 0;
+    int                    target    = -1;
+    bool                   success   = false;
+
+    delete    = new_string_buffer();
+    predicate = new_string_buffer();
+
+    if( delete == NULL || predicate == NULL )
+    {
+        goto cleanup;
+    }
+
+    for( i = 0; i < plan->num_relations; i++ )
+    {
+        relation = &( plan->relations[i] );
+
+        string_buffer_reset( delete );
+        string_buffer_reset( predicate );
+        string_buffer_append( delete, "DELETE FROM %s WHERE ", object->qualified_name );
+
+        for( j = 0; j < relation->num_columns; j++ )
+        {
+            if( !( relation->is_key[j] ) )
+            {
+                continue;
+            }
+
+            target = _exposing_column( plan, object, i, j );
+
+            if( target < 0 )
+            {
+                _log(
+                    LOG_LEVEL_INFO,
+                    "%s does not include key column %s of %s.%s",
+                    object->qualified_name,
+                    relation->columns[j],
+                    relation->schema_name,
+                    relation->table_name
+                );
+
+                goto cleanup;
+            }
+
+            column = quote_identifier( me, relation->columns[j] );
+
+            if( column == NULL )
+            {
+                goto cleanup;
+            }
+
+            relation->param_targets[relation->num_params] = target;
+            relation->params[relation->num_params++]      = j;
+
+            string_buffer_append(
+                delete,
+                "%s%s = $%u::%s",
+                relation->num_params > 1 ? " AND " : "",
+                object->quoted_columns[target],
+                relation->num_params,
+                relation->column_types[j]
+            );
+            string_buffer_append(
+                predicate,
+                "%s%s.%s = $%u::%s",
+                relation->num_params > 1 ? " AND " : "",
+                relation->qualifier,
+                column,
+                relation->num_params,
+                relation->column_types[j]
+            );
+
+            free( column );
+        }
+
+        if( relation->num_params == 0 )
+        {
+            _log(
+                LOG_LEVEL_INFO,
+                "%s.%s has no replica identity key",
+                relation->schema_name,
+                relation->table_name
+            );
+
+            goto cleanup;
+        }
+
+        relation->delete_sql = strdup( delete->data );
+        relation->insert_sql = _build_insert( object, plan->definition, predicate->data );
+        relation->delete_returning_sql = _build_returning( object, relation->delete_sql );
+        relation->insert_returning_sql = _build_returning( object, relation->insert_sql );
+
+        if(
+                relation->delete_sql == NULL
+             || relation->insert_sql == NULL
+             || relation->delete_returning_sql == NULL
+             || relation->insert_returning_sql == NULL
+          )
+        {
+            goto cleanup;
+        }
+
+        if( object->driver != DRIVER_POSTGRESQL || object->remote )
+        {
+            relation->select_sql = _build_select( object, plan->definition, relation, predicate->data );
+
+            if( relation->select_sql == NULL )
+            {
+                goto cleanup;
+            }
+        }
+    }
+
+    success = true;
+
+cleanup:
+    free_string_buffer( delete );
+    free_string_buffer( predicate );
+    return success;
+}
+
+/*
+ * Plans a grouping: a change to a row of any relation recomputes the groups
+ * it falls into. The target must include every grouping key.
+ */
+static bool _plan_aggregate( struct worker * me, struct maintenance_object * object, struct ivm_plan * plan )
+{
+    struct definition *    definition    = NULL;
+    struct ivm_relation *  relation      = NULL;
+    struct string_buffer * delete        = NULL;
+    struct string_buffer * predicate     = NULL;
+    struct string_buffer * groups        = NULL;
+    struct string_buffer * targets       = NULL;
+    char **                expressions   = NULL;
+    char *                 column        = NULL;
+    char *                 from          = NULL;
+    char *                 end           = NULL;
+    int *                  group_columns = NULL;
+    int *                  group_targets = NULL;
+    unsigned int           owner         = 0;
+    unsigned int           ordinal       = 0;
+    unsigned int           i             = 0;
+    unsigned int           j             = 0;
+    int                    target        = -1;
+    bool                   direct        = false;
+    bool                   success       = false;
+
+    definition    = plan->definition;
+    delete        = new_string_buffer();
+    predicate     = new_string_buffer();
+    groups        = new_string_buffer();
+    targets       = new_string_buffer();
+    expressions   = ( char ** ) calloc( definition->num_group_keys + 1, sizeof( char * ) );
+    group_columns = ( int * ) calloc( definition->num_group_keys + 1, sizeof( int ) );
+    group_targets = ( int * ) calloc( definition->num_group_keys + 1, sizeof( int ) );
+
+    if(
+            delete == NULL
+         || predicate == NULL
+         || groups == NULL
+         || targets == NULL
+         || expressions == NULL
+         || group_columns == NULL
+         || group_targets == NULL
+      )
+    {
+        goto cleanup;
+    }
+
+    // Find each grouping key's column in the target; GROUP BY may name select list entries by position
+    for( i = 0; i < definition->num_group_keys; i++ )
+    {
+        ordinal = ( unsigned int ) strtoul( definition->group_keys[i], &end, 10 );
+        target  = -1;
+
+        for( j = 0; j < definition->num_columns && target < 0; j++ )
+        {
+            if( definition->columns[j].name == NULL )
+            {
+                continue;
+            }
+
+            if(
+                    ( *end == '\0' && ordinal == j + 1 )
+                 || strcmp( definition->columns[j].expression, definition->group_keys[i] ) == 0
+              )
+            {
+                target         = _target_column( object, definition->columns[j].name );
+                expressions[i] = definition->columns[j].expression;
+            }
+        }
+
+        if( target < 0 )
+        {
+            _log(
+                LOG_LEVEL_INFO,
+                "%s does not include grouping key %s",
+                object->qualified_name,
+                definition->group_keys[i]
+            );
+
+            goto cleanup;
+        }
+
+        group_targets[i] = target;
+        string_buffer_append( targets, "%s%s", i > 0 ? ", " : "", object->quoted_columns[target] );
+        string_buffer_append( groups, "%s%s", i > 0 ? ", " : "", expressions[i] );
+    }
+
+    for( i = 0; i < plan->num_relations; i++ )
+    {
+        relation = &( plan->relations[i] );
+        direct   = true;
+
+        /*
+         * If all of the grouping keys are columns of this relation, a row's
+         * groups can be read off it, provided its old values are decoded too.
+         */
+        for( j = 0; j < definition->num_group_keys && direct; j++ )
+        {
+            group_columns[j] = _resolve_column( plan, expressions[j], &owner );
+            direct           = group_columns[j] >= 0
+                            && owner == i
+                            && ( relation->full_identity || relation->is_key[group_columns[j]] );
+        }
+
+        string_buffer_reset( delete );
+        string_buffer_reset( predicate );
+        string_buffer_append( delete, "DELETE FROM %s", object->qualified_name );
+
+        if( direct )
+        {
+            for( j = 0; j < definition->num_group_keys; j++ )
+            {
+                column = quote_identifier( me, relation->columns[group_columns[j]] );
+
+                if( column == NULL )
+                {
+                    goto cleanup;
+                }
+
+                relation->param_targets[relation->num_params] = group_targets[j];
+                relation->params[relation->num_params++]      = ( unsigned int ) group_columns[j];
+
+                string_buffer_append(
+                    delete,
+                    "%s%s = $%u::%s",
+                    j > 0 ? " AND " : " WHERE ",
+                    object->quoted_columns[group_targets[j]],
+                    j + 1,
+                    relation->column_types[group_columns[j]]
+                );
+                string_buffer_append(
+                    predicate,
+                    "%s%s.%s = $%u::%s",
+                    j > 0 ? " AND " : "",
+                    relation->qualifier,
+                    column,
+                    j + 1,
+                    relation->column_types[group_columns[j]]
+                );
+
+                free( column );
+            }
+
+            if( definition->num_group_keys == 0 )
+            {
+                string_buffer_append( predicate, "TRUE" );
+            }
+        }
+        else if( relation->full_identity )
+        {
+            for( j = 0; j < relation->num_columns; j++ )
+            {
+                relation->param_targets[relation->num_params] = -1;
+                relation->params[relation->num_params++]      = j;
+            }
+
+            from = _substitute_row( me, plan, i );
+
+            if( from == NULL )
+            {
+                goto cleanup;
+            }
+
+            string_buffer_append(
+                delete,
+                " WHERE ( %s ) IN ( SELECT %s FROM %s WHERE ( %s ) )",
+                targets->data,
+                groups->data,
+                from,
+                definition->where != NULL ? definition->where : "TRUE"
+            );
+            string_buffer_append(
+                predicate,
+                "( %s ) IN ( SELECT %s FROM %s WHERE ( %s ) )",
+                groups->data,
+                groups->data,
+                from,
+                definition->where != NULL ? definition->where : "TRUE"
+            );
+
+            free( from );
+        }
+        else
+        {
+            _log(
+                LOG_LEVEL_INFO,
+                "The groups of changes to %s.%s cannot be found without REPLICA IDENTITY FULL",
+                relation->schema_name,
+                relation->table_name
+            );
+
+            goto cleanup;
+        }
+
+        relation->delete_sql = strdup( delete->data );
+        relation->insert_sql = _build_insert( object, definition, predicate->data );
+        relation->delete_returning_sql = _build_returning( object, relation->delete_sql );
+        relation->insert_returning_sql = _build_returning( object, relation->insert_sql );
+
+        if(
+                relation->delete_sql == NULL
+             || relation->insert_sql == NULL
+             || relation->delete_returning_sql == NULL
+             || relation->insert_returning_sql == NULL
+          )
+        {
+            goto cleanup;
+        }
+
+        // Groups found by evaluating the definition over the row are not identified by its values
+        if( direct && ( object->driver != DRIVER_POSTGRESQL || object->remote ) )
+        {
+            relation->select_sql = _build_select( object, definition, relation, predicate->data );
+
+            if( relation->select_sql == NULL )
+            {
+                goto cleanup;
+            }
+        }
+    }
+
+    success = true;
+
+cleanup:
+    free_string_buffer( delete );
+    free_string_buffer( predicate );
+    free_string_buffer( groups );
+    free_string_buffer( targets );
+    free( expressions );
+    free( group_columns );
+    free( group_targets );
+    return success;
+}
+
+/*
+ * INSERT ... ON CONFLICT of the definition's rows that also satisfy
+ * predicate, which is ANDed into its WHERE clause.
+ */
+static char * _build_insert( struct maintenance_object * object, struct definition * definition, char * predicate )
+{
+    struct string_buffer * sql    = NULL;
+    char *                 result = NULL;
+    unsigned int           i      = 0;
+
+    sql = new_string_buffer();
+
+    if( sql == NULL )
+    {
+        return NULL;
+    }
+
+    string_buffer_append( sql, "INSERT INTO %s ( ", object->qualified_name );
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        string_buffer_append( sql, "%s%s", i > 0 ? ", " : "", object->quoted_columns[i] );
+    }
+
+    string_buffer_append( sql, " ) SELECT " );
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        string_buffer_append( sql, "%sq.%s", i > 0 ? ", " : "", object->quoted_columns[i] );
+    }
+
+    string_buffer_append(
+        sql,
+        " FROM ( SELECT %s FROM %s WHERE ( %s ) AND ( %s )",
+        definition->select_list,
+        definition->from_clause,
+        definition->where != NULL ? definition->where : "TRUE",
+        predicate
+    );
+
+    if( definition->group_by != NULL )
+    {
+        string_buffer_append( sql, " GROUP BY %s", definition->group_by );
+    }
+
+    if( definition->having != NULL )
+    {
+        string_buffer_append( sql, " HAVING %s", definition->having );
+    }
+
+    string_buffer_append( sql, " ) q " );
+    append_upsert_conflict( sql, object );
+
+    result = strdup( sql->data );
+    free_string_buffer( sql );
+    return result;
+}
+
+// sql, a delete or insert of target rows, returning the rows in the target's column order
+static char * _build_returning( struct maintenance_object * object, char * sql )
+{
+    struct string_buffer * returning = NULL;
+    char *                 result    = NULL;
+    unsigned int           i         = 0;
+
+    if( sql == NULL )
+    {
+        return NULL;
+    }
+
+    returning = new_string_buffer();
+
+    if( returning == NULL )
+    {
+        return NULL;
+    }
+
+    string_buffer_append( returning, "%s RETURNING ", sql );
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        string_buffer_append( returning, "%s%s", i > 0 ? ", " : "", object->quoted_columns[i] );
+    }
+
+    result = strdup( returning->data );
+    free_string_buffer( returning );
+    return result;
+}
+
+/*
+ * The definition's rows that also satisfy predicate, as _build_insert() reads
+ * them, each preceded by relation's parameters under the names of the target
+ * columns they are copied into and followed by IVM_COLUMN_FOUND. If no row
+ * satisfies predicate, a row of the parameters alone is returned instead,
+ * with the rest NULL.
+ */
+static char * _build_select(
+    struct maintenance_object * object,
+    struct definition *         definition,
+    struct ivm_relation *       relation,
+    char *                      predicate
+)
+{
+    struct string_buffer * sql    = NULL;
+    char *                 result = NULL;
+    unsigned int           i      = 0;
+
+    sql = new_string_buffer();
+
+    if( sql == NULL )
+    {
+        return NULL;
+    }
+
+    string_buffer_append( sql, "SELECT " );
+
+    for( i = 0; i < relation->num_params; i++ )
+    {
+        string_buffer_append( sql, "k.%s, ", object->quoted_columns[relation->param_targets[i]] );
+    }
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        string_buffer_append( sql, "q.%s, ", object->quoted_columns[i] );
+    }
+
+    string_buffer_append( sql, "q.%s FROM ( SELECT ", IVM_COLUMN_FOUND );
+
+    for( i = 0; i < relation->num_params; i++ )
+    {
+        string_buffer_append(
+            sql,
+            "%s$%u::%s AS %s",
+            i > 0 ? ", " : "",
+            i + 1,
+            relation->column_types[relation->params[i]],
+            object->quoted_columns[relation->param_targets[i]]
+        );
+    }
+
+    string_buffer_append(
+        sql,
+        " ) k LEFT JOIN LATERAL ( SELECT %s, TRUE AS %s FROM %s WHERE ( %s ) AND ( %s )",
+        definition->select_list,
+        IVM_COLUMN_FOUND,
+        definition->from_clause,
+        definition->where != NULL ? definition->where : "TRUE",
+        predicate
+    );
+
+    if( definition->group_by != NULL )
+    {
+        string_buffer_append( sql, " GROUP BY %s", definition->group_by );
+    }
+
+    if( definition->having != NULL )
+    {
+        string_buffer_append( sql, " HAVING %s", definition->having );
+    }
+
+    string_buffer_append( sql, " ) q ON TRUE" );
+
+    result = strdup( sql->data );
+    free_string_buffer( sql );
+    return result;
+}
+
+/*
+ * Sets the columns a target of another driver than postgresql keys its rows
+ * by: those that identify the rows a change affects, see evaluate_changes(),
+ * or all of them if object cannot be evaluated. Its rows are then only ever
+ * written by refreshes, each under its own entry.
+ */
+static void _set_driver_keys( struct maintenance_object * object, struct ivm_plan * plan )
+{
+    struct ivm_relation * relation = NULL;
+    unsigned int          i        = 0;
+
+    object->num_key_columns = 0;
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        object->is_key[i] = plan->kind == IVM_KIND_UNSUPPORTED;
+
+        if( object->is_key[i] )
+        {
+            object->num_key_columns++;
+        }
+    }
+
+    if( plan->kind == IVM_KIND_UNSUPPORTED || plan->num_relations == 0 )
+    {
+        return;
+    }
+
+    // Only projections and aggregates of one relation are evaluated
+    relation = &( plan->relations[0] );
+
+    for( i = 0; i < relation->num_params; i++ )
+    {
+        if( !object->is_key[relation->param_targets[i]] )
+        {
+            object->is_key[relation->param_targets[i]] = true;
+            object->num_key_columns++;
+        }
+    }
+
+    return;
+}
+
+/*
+ * Whether the key of object's target is exactly the columns the rows of its
+ * only relation are evaluated by, see _build_select(), so that a row that
+ * is no longer found can be deleted from it by key.
+ */
+static bool _keyed_by_params( struct maintenance_object * object, struct ivm_plan * plan )
+{
+    struct ivm_relation * relation = NULL;
+    unsigned int          num_keys = 0;
+    unsigned int          i        = 0;
+    unsigned int          j        = 0;
+
+    if( plan->num_relations != 1 )
+    {
+        return false;
+    }
+
+    relation = &( plan->relations[0] );
+
+    for( i = 0; i < relation->num_params; i++ )
+    {
+        if( relation->param_targets[i] < 0 || !object->is_key[relation->param_targets[i]] )
+        {
+            return false;
+        }
+
+        // A column may be bound to more than one parameter
+        for( j = 0; j < i && relation->param_targets[j] != relation->param_targets[i]; j++ );
+
+        if( j == i )
+        {
+            num_keys++;
+        }
+    }
+
+    return num_keys > 0 && num_keys == object->num_key_columns;
+}
+
+/*
+ * The definition's FROM clause with the relation at index replaced by a
+ * single row of parameters, one per column, under the name the rest of the
+ * definition refers to it by.
+ */
+static char * _substitute_row( struct worker * me, struct ivm_plan * plan, unsigned int index )
+{
+    struct definition_relation * definition_relation = NULL;
+    struct ivm_relation *        relation            = NULL;
+    struct string_buffer *       from                = NULL;
+    char *                       column              = NULL;
+    char *                       result              = NULL;
+    unsigned int                 i                   = 0;
+
+    definition_relation = &( plan->definition->relations[index] );
+    relation            = &( plan->relations[index] );
+    from                = new_string_buffer();
+
+    if( from == NULL )
+    {
+        return NULL;
+    }
+
+    string_buffer_append_bytes( from, plan->definition->from_clause, definition_relation->offset );
+    string_buffer_append( from, "( SELECT " );
+
+    for( i = 0; i < relation->num_columns; i++ )
+    {
+        column = quote_identifier( me, relation->columns[i] );
+
+        if( column == NULL )
+        {
+            free_string_buffer( from );
+            return NULL;
+        }
+
+        string_buffer_append(
+            from,
+            "%s$%u::%s AS %s",
+            i > 0 ? ", " : "",
+            i + 1,
+            relation->column_types[i],
+            column
+        );
+
+        free( column );
+    }
+
+    string_buffer_append( from, " )" );
+
+    if( definition_relation->alias == NULL )
+    {
+        column = quote_identifier( me, relation->table_name );
+
+        if( column == NULL )
+        {
+            free_string_buffer( from );
+            return NULL;
+        }
+
+        string_buffer_append( from, " AS %s", column );
+        free( column );
+    }
+
+    string_buffer_append(
+        from,
+        "%s",
+        plan->definition->from_clause + definition_relation->offset + definition_relation->length
+    );
+
+    result = strdup( from->data );
+    free_string_buffer( from );
+    return result;
+}
+
+/*
+ * If expression is a column reference, returns the column's index in the
+ * relation it resolves to, and sets relation to that relation's index. An
+ * unqualified reference must be to a column of exactly one relation.
+ */
+static int _resolve_column( struct ivm_plan * plan, char * expression, unsigned int * relation )
+{
+    char *       qualifier = NULL;
+    char *       column    = NULL;
+    unsigned int i         = 0;
+    unsigned int j         = 0;
+    int          result    = -1;
+
+    if( !split_column_reference( expression, &qualifier, &column ) )
+    {
+        return -1;
+    }
+
+    for( i = 0; i < plan->num_relations; i++ )
+    {
+        if( qualifier != NULL && strcmp( qualifier, plan->relations[i].name ) != 0 )
+        {
+            continue;
+        }
+
+        for( j = 0; j < plan->relations[i].num_columns; j++ )
+        {
+            if( strcmp( column, plan->relations[i].columns[j] ) != 0 )
+            {
+                continue;
+            }
+
+            if( result >= 0 )
+            {
+                // Ambiguous
+                free( qualifier );
+                free( column );
+                return -1;
+            }
+
+            result    = ( int ) j;
+            *relation = i;
+        }
+    }
+
+    free( qualifier );
+    free( column );
+    return result;
+}
+
+/*
+ * The index of the target column the definition copies column of relation
+ * into, either by naming it in the select list or through a * or relation.*
+ * entry, or -1.
+ */
+static int _exposing_column(
+    struct ivm_plan *           plan,
+    struct maintenance_object * object,
+    unsigned int                relation,
+    unsigned int                column
+)
+{
+    struct definition_column * entry    = NULL;
+    char *                     star     = NULL;
+    char *                     name     = NULL;
+    unsigned int               owner    = 0;
+    unsigned int               i        = 0;
+    bool                       covers   = false;
+
+    for( i = 0; i < plan->definition->num_columns; i++ )
+    {
+        entry = &( plan->definition->columns[i] );
+
+        if( entry->name != NULL )
+        {
+            if( _resolve_column( plan, entry->expression, &owner ) == ( int ) column && owner == relation )
+            {
+                return _target_column( object, entry->name );
+            }
+
+            continue;
+        }
+
+        star = strrchr( entry->expression, '*' );
+
+        if( star == NULL || star[1] != '\0' )
+        {
+            continue;
+        }
+
+        if( star == entry->expression )
+        {
+            covers = true;
+        }
+        else if( star > entry->expression + 1 && star[-1] == '.' )
+        {
+            name   = normalize_identifier( entry->expression, star - 1 );
+            covers = name != NULL && strcmp( name, plan->relations[relation].name ) == 0;
+            free( name );
+        }
+
+        if( covers )
+        {
+            return _target_column( object, plan->relations[relation].columns[column] );
+        }
+    }
+
+    return -1;
+}
+
+static int _target_column( struct maintenance_object * object, char * name )
+{
+    unsigned int i = 0;
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        if( strcmp( object->columns[i], name ) == 0 )
+        {
+            return ( int ) i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Refreshes object if any of changes is to a table its definition reads, or
+ * to any table at all if the definition's relations are not known.
+ */
+static bool _refresh_on_change(
+    struct worker *             me,
+    struct maintenance_object * object,
+    struct ivm_plan *           plan,
+    struct change **            changes,
+    unsigned long               num_changes
+)
+{
+    unsigned long i = 0;
+    unsigned int  j = 0;
+
+    for( i = 0; i < num_changes; i++ )
+    {
+        if( changes[i] == NULL )
+        {
+            continue;
+        }
+
+        if( plan->num_relations == 0 )
+        {
+            return refresh_maintenance_object( me, object, NULL );
+        }
+
+        for( j = 0; j < plan->num_relations; j++ )
+        {
+            if( _reads_table( plan, j, changes[i] ) )
+            {
+                return refresh_maintenance_object( me, object, NULL );
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Appends result's rows to deltas as changes of type to object's target, the
+ * old rows of DELETEs and new rows of INSERTs, with their values as text.
+ */
+static bool _append_deltas(
+    struct maintenance_object * object,
+    PGresult *                  result,
+    unsigned short              type,
+    struct change ***           deltas,
+    unsigned long *             num_deltas
+)
+{
+    struct change ** grown       = NULL;
+    struct change *  change      = NULL;
+    struct tuple *   tuple       = NULL;
+    int              num_rows    = 0;
+    int              num_columns = 0;
+    int              row         = 0;
+    int              column      = 0;
+
+    if( result == NULL || PQntuples( result ) == 0 )
+    {
+        return true;
+    }
+
+    num_rows    = PQntuples( result );
+    num_columns = PQnfields( result );
+    grown       = ( struct change ** ) realloc(
+        *deltas,
+        ( *num_deltas + ( unsigned long ) num_rows ) * sizeof( struct change * )
+    );
+
+    if( grown == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate deltas of %s",
+            object->qualified_name
+        );
+
+        return false;
+    }
+
+    *deltas = grown;
+
+    for( row = 0; row < num_rows; row++ )
+    {
+        change = new_change( type );
+        tuple  = new_tuple( ( unsigned int ) num_columns );
+
+        if( change == NULL || tuple == NULL )
+        {
+            free_change( change );
+            free_tuple( tuple );
+            return false;
+        }
+
+        // Unset entries are NULL, so the tuple can be freed part way through
+        tuple->num_columns = ( unsigned int ) num_columns;
+
+        if( type == CHANGE_TYPE_DELETE )
+        {
+            change->old_tuple = tuple;
+        }
+        else
+        {
+            change->new_tuple = tuple;
+        }
+
+        change->schema_name = strdup( object->namespace );
+        change->table_name  = strdup( object->name );
+
+        if( change->schema_name == NULL || change->table_name == NULL )
+        {
+            free_change( change );
+            return false;
+        }
+
+        for( column = 0; column < num_columns; column++ )
+        {
+            tuple->names[column] = strdup( PQfname( result, column ) );
+
+            if( !PQgetisnull( result, row, column ) )
+            {
+                tuple->values[column] = strdup( PQgetvalue( result, row, column ) );
+            }
+
+            if(
+                    tuple->names[column] == NULL
+                 || ( tuple->values[column] == NULL && !PQgetisnull( result, row, column ) )
+              )
+            {
+                free_change( change );
+                return false;
+            }
+        }
+
+        ( *deltas )[( *num_deltas )++] = change;
+    }
+
+    return true;
+}
+
+/*
+ * Appends the rows relation's select_sql returned to rows, see
+ * evaluate_changes(): INSERTs of the target rows it found, and DELETEs of the
+ * keys it found none for. Both are keyed by the parameters' target columns.
+ */
+static bool _append_rows(
+    struct maintenance_object * object,
+    struct ivm_relation *       relation,
+    PGresult *                  result,
+    struct change ***           rows,
+    unsigned long *             num_rows
+)
+{
+    struct change ** grown    = NULL;
+    struct change *  change   = NULL;
+    int              num_read = 0;
+    int              row      = 0;
+    int              found    = 0;
+
+    if( result == NULL || PQntuples( result ) == 0 )
+    {
+        return true;
+    }
+
+    num_read = PQntuples( result );
+    found    = ( int ) ( relation->num_params + object->num_columns );
+    grown    = ( struct change ** ) realloc(
+        *rows,
+        ( *num_rows + ( unsigned long ) num_read ) * sizeof( struct change * )
+    );
+
+    if( grown == NULL || PQnfields( result ) != found + 1 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to read evaluated rows of %s",
+            object->qualified_name
+        );
+
+        if( grown != NULL )
+        {
+            *rows = grown;
+        }
+
+        return false;
+    }
+
+    *rows = grown;
+
+    for( row = 0; row < num_read; row++ )
+    {
+        change = new_change( PQgetisnull( result, row, found ) ? CHANGE_TYPE_DELETE : CHANGE_TYPE_INSERT );
+
+        if( change == NULL )
+        {
+            return false;
+        }
+
+        change->schema_name = strdup( object->namespace );
+        change->table_name  = strdup( object->name );
+        change->key         = _read_tuple( result, row, 0, relation->num_params );
+
+        if( change->type == CHANGE_TYPE_INSERT )
+        {
+            change->new_tuple = _read_tuple( result, row, ( int ) relation->num_params, object->num_columns );
+        }
+
+        if(
+                change->schema_name == NULL
+             || change->table_name == NULL
+             || change->key == NULL
+             || ( change->type == CHANGE_TYPE_INSERT && change->new_tuple == NULL )
+          )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to allocate evaluated row of %s",
+                object->qualified_name
+            );
+
+            free_change( change );
+            return false;
+        }
+
+        ( *rows )[( *num_rows )++] = change;
+    }
+
+    return true;
+}
+
+// Columns first to first + count of row of result as a tuple, named as in the result
+static struct tuple * _read_tuple( PGresult * result, int row, int first, unsigned int count )
+{
+    struct tuple * tuple  = NULL;
+    unsigned int   i      = 0;
+    int            column = 0;
+
+    tuple = new_tuple( count );
+
+    if( tuple == NULL )
+    {
+        return NULL;
+    }
+
+    // Unset entries are NULL, so the tuple can be freed part way through
+    tuple->num_columns = count;
+
+    for( i = 0; i < count; i++ )
+    {
+        column          = first + ( int ) i;
+        tuple->names[i] = strdup( PQfname( result, column ) );
+
+        if( !PQgetisnull( result, row, column ) )
+        {
+            tuple->values[i] = strdup( PQgetvalue( result, row, column ) );
+        }
+
+        if( tuple->names[i] == NULL || ( tuple->values[i] == NULL && !PQgetisnull( result, row, column ) ) )
+        {
+            free_tuple( tuple );
+            return NULL;
+        }
+    }
+
+    return tuple;
+}
+
+static bool _reads_table( struct ivm_plan * plan, unsigned int relation, struct change * change )
+{
+    return change->schema_name != NULL
+        && change->table_name != NULL
+        && strcmp( change->schema_name, plan->relations[relation].schema_name ) == 0
+        && strcmp( change->table_name, plan->relations[relation].table_name ) == 0;
+}
+
+/*
+ * Adds to requests, which must have room for two per change and relation, a
+ * request for the old and new row of each change to a relation plan reads,
+ * and sorts them so that duplicates are adjacent. num_requests counts those
+ * filled in, including any that failed part way.
+ */
+static bool _collect_requests(
+    struct ivm_plan *    plan,
+    struct change **     changes,
+    unsigned long        num_changes,
+    struct ivm_request * requests,
+    unsigned long *      num_requests
+)
+{
+    unsigned long i = 0;
+    unsigned int  j = 0;
+
+    for( i = 0; i < num_changes; i++ )
+    {
+        for( j = 0; changes[i] != NULL && j < plan->num_relations; j++ )
+        {
+            if( !_reads_table( plan, j, changes[i] ) )
+            {
+                continue;
+            }
+
+            // An UPDATE without an old row left the key, and so these columns, unchanged
+            if(
+                    ( changes[i]->type == CHANGE_TYPE_DELETE || changes[i]->old_tuple != NULL )
+                 && changes[i]->type != CHANGE_TYPE_INSERT
+              )
+            {
+                if( !_add_request( plan, j, changes[i], true, &( requests[( *num_requests )++] ) ) )
+                {
+                    return false;
+                }
+            }
+
+            if( changes[i]->type == CHANGE_TYPE_INSERT || changes[i]->type == CHANGE_TYPE_UPDATE )
+            {
+                if( !_add_request( plan, j, changes[i], false, &( requests[( *num_requests )++] ) ) )
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    qsort( requests, *num_requests, sizeof( struct ivm_request ), _compare_requests );
+    return true;
+}
+
+/*
+ * Fills in request with change's old or new values for the columns that
+ * parameterize relation's statements.
+ */
+static bool _add_request(
+    struct ivm_plan *    plan,
+    unsigned int         relation,
+    struct change *      change,
+    bool                 old,
+    struct ivm_request * request
+)
+{
+    struct ivm_relation *  description = NULL;
+    struct string_buffer * key         = NULL;
+    unsigned int           i           = 0;
+
+    description       = &( plan->relations[relation] );
+    request->relation = relation;
+    request->values   = ( char ** ) calloc( description->num_params + 1, sizeof( char * ) );
+    request->lengths  = ( int * ) calloc( description->num_params + 1, sizeof( int ) );
+    request->formats  = ( int * ) calloc( description->num_params + 1, sizeof( int ) );
+    key               = new_string_buffer();
+
+    if( request->values == NULL || request->lengths == NULL || request->formats == NULL || key == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate maintenance request"
+        );
+
+        free_string_buffer( key );
+        return false;
+    }
+
+    string_buffer_append( key, "%u", relation );
+
+    for( i = 0; i < description->num_params; i++ )
+    {
+        request->values[i] = _change_value(
+            change,
+            description->columns[description->params[i]],
+            old,
+            &( request->lengths[i] )
+        );
+        request->formats[i] = request->lengths[i] >= 0 ? 1 : 0;
+
+        if( request->values[i] == NULL )
+        {
+            string_buffer_append( key, ":N" );
+        }
+        else if( request->lengths[i] >= 0 )
+        {
+            string_buffer_append( key, ":%d:", request->lengths[i] );
+            string_buffer_append_bytes( key, request->values[i], ( size_t ) request->lengths[i] );
+        }
+        else
+        {
+            string_buffer_append( key, ":%zu:%s", strlen( request->values[i] ), request->values[i] );
+        }
+    }
+
+    request->key_length = key->length;
+    request->key        = ( char * ) malloc( key->length + 1 );
+
+    if( request->key == NULL )
+    {
+        free_string_buffer( key );
+        return false;
+    }
+
+    memcpy( request->key, key->data, key->length + 1 );
+    free_string_buffer( key );
+    return true;
+}
+
+/*
+ * The old or new value of column in change. The old row is only decoded in
+ * full under REPLICA IDENTITY FULL, or when the key changed; otherwise the key
+ * is the same before and after, and is used for both.
+ */
+static char * _change_value( struct change * change, char * column, bool old, int * length )
+{
+    struct tuple * tuples[2] = { NULL };
+    unsigned int   i         = 0;
+    int            index     = -1;
+
+    tuples[0] = old ? change->old_tuple : change->new_tuple;
+    tuples[1] = change->key;
+    *length   = -1;
+
+    for( i = 0; i < 2; i++ )
+    {
+        index = find_tuple_column( tuples[i], column );
+
+        if( index < 0 )
+        {
+            continue;
+        }
+
+        if( tuples[i]->lengths != NULL && tuples[i]->values[index] != NULL )
+        {
+            *length = tuples[i]->lengths[index];
+        }
+
+        return tuples[i]->values[index];
+    }
+
+    return NULL;
+}
+
+static int _compare_requests( const void * left, const void * right )
+{
+    const struct ivm_request * a      = ( const struct ivm_request * ) left;
+    const struct ivm_request * b      = ( const struct ivm_request * ) right;
+    int                        result = 0;
+
+    result = memcmp( a->key, b->key, a->key_length < b->key_length ? a->key_length : b->key_length );
+
+    if( result != 0 )
+    {
+        return result;
+    }
+
+    return a->key_length < b->key_length ? -1 : ( a->key_length > b->key_length ? 1 : 0 );
+}
+
+// The values themselves belong to the change they were read from
+static void _free_request( struct ivm_request * request )
+{
+    free( request->values );
+    free( request->lengths );
+    free( request->formats );
+    free( request->key );
+    return;
+}
+
+static void _free_relation( struct ivm_relation * relation )
+{
+    unsigned int i = 0;
+
+    for( i = 0; i < relation->num_columns; i++ )
+    {
+        free( relation->columns[i] );
+        free( relation->column_types[i] );
+    }
+
+    free( relation->schema_name );
+    free( relation->table_name );
+    free( relation->qualifier );
+    free( relation->name );
+    free( relation->columns );
+    free( relation->column_types );
+    free( relation->is_key );
+    free( relation->params );
+    free( relation->param_targets );
+    free( relation->delete_sql );
+    free( relation->insert_sql );
+    free( relation->delete_returning_sql );
+    free( relation->insert_returning_sql );
+    free( relation->select_sql );
+    return;
+}
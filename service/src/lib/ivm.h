@@ -0,0 +1,107 @@
+#ifndef IVM_H
+#define IVM_H
+
+#include "util.h"
+#include "query.h"
+#include "change.h"
+#include "object.h"
+#include "definition.h"
+#include "refresh.h"
+
+#define IVM_KIND_UNSUPPORTED 0
+#define IVM_KIND_PROJECTION 1
+#define IVM_KIND_JOIN 2
+#define IVM_KIND_AGGREGATE 3
+
+// Operations of maintenance statements in the statement cache, clear of the CHANGE_TYPE_*s
+#define IVM_STATEMENT_DELETE 16
+#define IVM_STATEMENT_INSERT 17
+#define IVM_STATEMENT_DELETE_RETURNING 18
+#define IVM_STATEMENT_INSERT_RETURNING 19
+#define IVM_STATEMENT_SELECT 20
+
+// Column select_sql adds to tell the target rows it found from the keys it found none for
+#define IVM_COLUMN_FOUND "__pg_ctblmgr_found"
+
+/*
+ * One relation read by an incrementally maintained definition, and the pair
+ * of statements that brings the target up to date after a change to one of
+ * its rows: delete_sql removes the target rows the row contributes to and
+ * insert_sql evaluates the definition for just those rows again. Both are
+ * parameterized by the row's values for the columns listed in params, which
+ * are its key columns for projections and joins, and its grouping columns
+ * (or all of its columns, where the groups can only be found by evaluating
+ * the definition over the row) for aggregates. The *_returning_sql variants
+ * also return the target rows they remove or add.
+ *
+ * For targets of drivers other than postgresql, which cannot run these,
+ * select_sql instead evaluates the definition for the row, see
+ * evaluate_changes(). It is only planned where each parameter is copied into
+ * a target column, its entry in param_targets (-1 otherwise), so that those
+ * columns identify the target rows a change affects.
+ */
+struct ivm_relation {
+    char *         schema_name;
+    char *         table_name;
+    char *         qualifier;
+    char *         name;
+    unsigned int   num_columns;
+    char **        columns;
+    char **        column_types;
+    bool *         is_key;
+    bool           full_identity;
+    unsigned int * params;
+    unsigned int   num_params;
+    int *          param_targets;
+    char *         delete_sql;
+    char *         insert_sql;
+    char *         delete_returning_sql;
+    char *         insert_returning_sql;
+    char *         select_sql;
+};
+
+/*
+ * How a maintenance_object's target is kept up to date from changes to the
+ * relations its definition reads. Built by plan_maintenance() once per layout
+ * of the target; objects of IVM_KIND_UNSUPPORTED are refreshed instead.
+ */
+struct ivm_plan {
+    unsigned short        kind;
+    struct definition *   definition;
+    struct ivm_relation * relations;
+    unsigned int          num_relations;
+};
+
+/*
+ * The row values one relation's statements are to be run with. key is the
+ * relation and values serialized, so that duplicates are run once.
+ */
+struct ivm_request {
+    unsigned int relation;
+    char **      values;
+    int *        lengths;
+    int *        formats;
+    char *       key;
+    size_t       key_length;
+};
+
+extern struct ivm_plan * plan_maintenance( struct worker *, struct maintenance_object * );
+extern void free_ivm_plan( struct ivm_plan * );
+extern bool maintain_changes(
+    struct worker *,
+    struct maintenance_object *,
+    struct change **,
+    unsigned long,
+    struct change ***,
+    unsigned long *
+);
+extern bool evaluate_changes(
+    struct worker *,
+    struct maintenance_object *,
+    struct change **,
+    unsigned long,
+    struct change ***,
+    unsigned long *
+);
+
+#endif // IVM_H
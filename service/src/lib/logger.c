@@ -0,0 +1,553 @@
+#include "logger.h"
+
+unsigned short log_min_level = LOG_LEVEL_INFO;
+
+static struct log_state * log_state = NULL;
+
+// This process's ring, claimed on its first line, and what it stamps lines with
+static struct log_ring * my_ring    = NULL;
+static bool              ring_full  = false;
+static pid_t             my_pid     = 0;
+static int64_t           stamped_ms = -1;
+static char              stamp[32]  = {0};
+
+static const char * level_names[] = { "UNKNOWN", "DEBUG", "INFO", "WARNING", "ERROR", "FATAL" };
+
+static void _forked( void );
+static const char * _stamp( void );
+static bool _enqueue( unsigned short, const char *, size_t );
+static bool _reserve( size_t, uint64_t * );
+static bool _claim_ring( void );
+static bool _wait_written( uint64_t );
+static void _write_directly( unsigned short, const char *, size_t );
+static int _log_fd( unsigned short );
+static void _run_writer( pid_t );
+static size_t _drain_ring( struct log_ring * );
+static void _write_lines( int, struct iovec *, int );
+
+/*
+ * Sets up the shared log and forks the process that writes it. Lines logged
+ * before, or by processes that find no ring free, are written by whoever
+ * logs them, as they were before.
+ */
+bool start_log_writer( void )
+{
+    pid_t parent_pid = 0;
+    pid_t pid        = 0;
+
+    log_state = ( struct log_state * ) create_shared_memory( sizeof( struct log_state ) );
+
+    if( log_state == NULL )
+    {
+        return false;
+    }
+
+    if( pthread_atfork( NULL, NULL, _forked ) != 0 )
+    {
+        munmap( log_state, sizeof( struct log_state ) );
+        log_state = NULL;
+        return false;
+    }
+
+    parent_pid = getpid();
+    pid        = fork();
+
+    if( pid < 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to fork log writer: %s",
+            strerror( errno )
+        );
+
+        munmap( log_state, sizeof( struct log_state ) );
+        log_state = NULL;
+        return false;
+    }
+
+    if( pid == 0 )
+    {
+        _run_writer( parent_pid );
+    }
+
+    __atomic_store_n( &( log_state->writer ), pid, __ATOMIC_RELEASE );
+    return true;
+}
+
+// Has the writer write every line still waiting and exit, and waits for it
+void stop_log_writer( void )
+{
+    if( log_state == NULL || log_state->writer <= 0 )
+    {
+        return;
+    }
+
+    __atomic_store_n( &( log_state->stopping ), true, __ATOMIC_RELEASE );
+    waitpid( log_state->writer, NULL, 0 );
+    log_state->writer = 0;
+    return;
+}
+
+// Reopens the log file, in this process and the writer, so that it can be rotated
+void reopen_log( void )
+{
+    if( log_file != NULL && freopen( LOG_FILE_NAME, "a", log_file ) == NULL )
+    {
+        log_file = NULL;
+    }
+
+    if( log_state != NULL )
+    {
+        __atomic_store_n( &( log_state->reopen ), true, __ATOMIC_RELEASE );
+    }
+
+    return;
+}
+
+/*
+ * Marks the ring of pid, a child that has exited but is not reaped yet, to
+ * be freed once the writer has written it out. Its pid cannot have been
+ * reused while it is a zombie, so no ring of another process is marked, as
+ * asking the kernel whether the owner is still there would.
+ */
+void log_exited( pid_t pid )
+{
+    unsigned int i = 0;
+
+    if( log_state == NULL || pid <= 0 )
+    {
+        return;
+    }
+
+    for( i = 0; i < LOG_RINGS; i++ )
+    {
+        if( __atomic_load_n( &( log_state->rings[i].owner ), __ATOMIC_ACQUIRE ) == pid )
+        {
+            __atomic_store_n( &( log_state->rings[i].exited ), true, __ATOMIC_RELEASE );
+        }
+    }
+
+    return;
+}
+
+/*
+ * Formats a line and queues it on this process's ring. A FATAL line is only
+ * returned from once it has been written.
+ */
+void write_log( unsigned short log_level, const char * message, va_list args )
+{
+    char   line[LOG_LINE_BYTES];
+    int    prefix = 0;
+    int    length = 0;
+    size_t total  = 0;
+
+    if( my_pid == 0 )
+    {
+        my_pid = getpid();
+    }
+
+    prefix = snprintf(
+        line,
+        sizeof( line ),
+        "%s [%d] %s: ",
+        _stamp(),
+        ( int ) my_pid,
+        level_names[log_level <= LOG_LEVEL_FATAL ? log_level : 0]
+    );
+
+    length = vsnprintf( line + prefix, sizeof( line ) - ( size_t ) prefix - 1, message, args );
+
+    if( length < 0 )
+    {
+        length = 0;
+    }
+
+    total = ( size_t ) prefix + ( size_t ) length;
+
+    if( total > sizeof( line ) - 2 )
+    {
+        total = sizeof( line ) - 2;
+    }
+
+    line[total++] = '\n';
+
+    if( !_enqueue( log_level, line, total ) )
+    {
+        _write_directly( log_level, line, total );
+    }
+    else if( log_level == LOG_LEVEL_FATAL )
+    {
+        _wait_written( my_ring->head );
+    }
+
+    return;
+}
+
+bool parse_log_level( const char * name, unsigned short * log_level )
+{
+    unsigned short i = 0;
+
+    for( i = LOG_LEVEL_DEBUG; i <= LOG_LEVEL_FATAL; i++ )
+    {
+        if( strcasecmp( name, level_names[i] ) == 0 )
+        {
+            *log_level = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// A forked process logs as itself, on a ring of its own
+static void _forked( void )
+{
+    my_ring    = NULL;
+    ring_full  = false;
+    my_pid     = getpid();
+    stamped_ms = -1;
+    return;
+}
+
+/*
+ * The time, to the millisecond, as the log shows it. Only formatted again
+ * once the millisecond has changed, and only in full once the second has.
+ */
+static const char * _stamp( void )
+{
+    struct timeval now = {0};
+    struct tm      utc = {0};
+    int64_t        ms  = 0;
+
+    gettimeofday( &now, NULL );
+    ms = ( int64_t ) now.tv_sec * 1000 + now.tv_usec / 1000;
+
+    if( ms == stamped_ms )
+    {
+        return stamp;
+    }
+
+    if( stamped_ms < 0 || ms / 1000 != stamped_ms / 1000 )
+    {
+        gmtime_r( &now.tv_sec, &utc );
+        strftime( stamp, sizeof( stamp ), "%Y-%m-%d %H:%M:%S.000", &utc );
+    }
+
+    stamped_ms = ms;
+    stamp[20]  = ( char ) ( '0' + ms % 1000 / 100 );
+    stamp[21]  = ( char ) ( '0' + ms % 100 / 10 );
+    stamp[22]  = ( char ) ( '0' + ms % 10 );
+    return stamp;
+}
+
+/*
+ * Copies line onto this process's ring and publishes it. Fails when there
+ * is no writer or no ring, or when the writer does not make room in time.
+ */
+static bool _enqueue( unsigned short log_level, const char * line, size_t length )
+{
+    struct log_record * record = NULL;
+    uint64_t            head   = 0;
+    size_t              needed = 0;
+    size_t              offset = 0;
+
+    if( my_ring == NULL && !_claim_ring() )
+    {
+        return false;
+    }
+
+    // Records start on 8 byte boundaries, so that a header never wraps
+    needed = ( sizeof( struct log_record ) + length + 7 ) & ~( ( size_t ) 7 );
+
+    if( !_reserve( needed, &head ) )
+    {
+        return false;
+    }
+
+    offset         = ( size_t ) ( head % LOG_RING_BYTES );
+    record         = ( struct log_record * ) ( my_ring->data + offset );
+    record->length = ( uint32_t ) length;
+    record->level  = log_level;
+    memcpy( my_ring->data + offset + sizeof( struct log_record ), line, length );
+
+    __atomic_store_n( &( my_ring->head ), head + needed, __ATOMIC_RELEASE );
+    return true;
+}
+
+/*
+ * Makes room for needed contiguous bytes at the head of this process's
+ * ring, padding out its end if they do not fit before it, and sets head to
+ * where they start. A full ring is waited on rather than bypassed, so that
+ * lines stay in order.
+ */
+static bool _reserve( size_t needed, uint64_t * head )
+{
+    struct log_record * record = NULL;
+    size_t              to_end = 0;
+    size_t              pad    = 0;
+
+    *head  = my_ring->head;
+    to_end = LOG_RING_BYTES - ( size_t ) ( *head % LOG_RING_BYTES );
+    pad    = to_end < needed ? to_end : 0;
+
+    if(
+            *head + pad + needed - __atomic_load_n( &( my_ring->tail ), __ATOMIC_ACQUIRE ) > LOG_RING_BYTES
+         && !_wait_written( *head + pad + needed - LOG_RING_BYTES )
+      )
+    {
+        // The writer is stuck or gone, this process writes its own lines from now on
+        my_ring   = NULL;
+        ring_full = true;
+        return false;
+    }
+
+    if( pad > 0 )
+    {
+        record         = ( struct log_record * ) ( my_ring->data + ( *head % LOG_RING_BYTES ) );
+        record->length = ( uint32_t ) ( pad - sizeof( struct log_record ) );
+        record->level  = 0;
+        *head         += pad;
+    }
+
+    return true;
+}
+
+static bool _claim_ring( void )
+{
+    pid_t        free_owner = 0;
+    unsigned int i          = 0;
+
+    if(
+            ring_full
+         || log_state == NULL
+         || __atomic_load_n( &( log_state->writer ), __ATOMIC_ACQUIRE ) <= 0
+         || my_pid == __atomic_load_n( &( log_state->writer ), __ATOMIC_ACQUIRE )
+      )
+    {
+        return false;
+    }
+
+    for( i = 0; i < LOG_RINGS; i++ )
+    {
+        free_owner = 0;
+
+        if(
+                __atomic_compare_exchange_n(
+                    &( log_state->rings[i].owner ),
+                    &free_owner,
+                    my_pid,
+                    false,
+                    __ATOMIC_ACQUIRE,
+                    __ATOMIC_RELAXED
+                )
+          )
+        {
+            my_ring = &( log_state->rings[i] );
+            return true;
+        }
+    }
+
+    // Not looked for again, this process writes its own lines from now on
+    ring_full = true;
+    return false;
+}
+
+// Waits up to LOG_WRITER_WAIT_MS for the writer to have written this process's ring up to position
+static bool _wait_written( uint64_t position )
+{
+    struct timespec wait = { 0, 100000L };
+    unsigned int    i    = 0;
+
+    for( i = 0; i < LOG_WRITER_WAIT_MS * 10; i++ )
+    {
+        if( __atomic_load_n( &( my_ring->tail ), __ATOMIC_ACQUIRE ) >= position )
+        {
+            return true;
+        }
+
+        nanosleep( &wait, NULL );
+    }
+
+    return false;
+}
+
+static void _write_directly( unsigned short log_level, const char * line, size_t length )
+{
+    struct iovec iov = {0};
+
+    iov.iov_base = ( void * ) line;
+    iov.iov_len  = length;
+
+    _write_lines( _log_fd( log_level ), &iov, 1 );
+    return;
+}
+
+// Where lines of log_level go: the log file, or stderr for warnings and worse
+static int _log_fd( unsigned short log_level )
+{
+    if( log_file != NULL )
+    {
+        return fileno( log_file );
+    }
+
+    return log_level >= LOG_LEVEL_WARNING ? STDERR_FILENO : STDOUT_FILENO;
+}
+
+/*
+ * The writer's loop: writes every ring out in turn, and sleeps once they are
+ * all empty. Carries on past signals meant for the service, and exits once
+ * asked to, or once the parent has gone, after writing what is left.
+ */
+static void _run_writer( pid_t parent_pid )
+{
+    struct timespec idle     = {0};
+    size_t          written  = 0;
+    unsigned int    i        = 0;
+    bool            stopping = false;
+
+    signal( SIGINT, SIG_IGN );
+    signal( SIGTERM, SIG_IGN );
+    signal( SIGHUP, SIG_IGN );
+
+    idle.tv_sec  = LOG_WRITER_IDLE_MS / 1000;
+    idle.tv_nsec = ( long ) ( LOG_WRITER_IDLE_MS % 1000 ) * 1000000L;
+
+    while( true )
+    {
+        stopping = __atomic_load_n( &( log_state->stopping ), __ATOMIC_ACQUIRE )
+                || getppid() != parent_pid;
+
+        if(
+                __atomic_exchange_n( &( log_state->reopen ), false, __ATOMIC_ACQ_REL )
+             && log_file != NULL
+             && freopen( LOG_FILE_NAME, "a", log_file ) == NULL
+          )
+        {
+            log_file = NULL;
+        }
+
+        for( i = 0, written = 0; i < LOG_RINGS; i++ )
+        {
+            written += _drain_ring( &( log_state->rings[i] ) );
+        }
+
+        if( written == 0 )
+        {
+            if( stopping )
+            {
+                break;
+            }
+
+            nanosleep( &idle, NULL );
+        }
+    }
+
+    _exit( 0 );
+}
+
+/*
+ * Writes the lines waiting on ring, LOG_WRITER_IOVECS at a time, and frees it
+ * if its owner has been marked exited. Returns the number of lines written.
+ */
+static size_t _drain_ring( struct log_ring * ring )
+{
+    struct iovec        iov[LOG_WRITER_IOVECS];
+    struct log_record * record  = NULL;
+    uint64_t            head    = 0;
+    uint64_t            tail    = 0;
+    pid_t               owner   = 0;
+    size_t              offset  = 0;
+    size_t              lines   = 0;
+    int                 num_iov = 0;
+    int                 fd      = -1;
+    bool                exited  = false;
+
+    owner = __atomic_load_n( &( ring->owner ), __ATOMIC_ACQUIRE );
+
+    if( owner == 0 )
+    {
+        return 0;
+    }
+
+    // Checked first: once it has exited, what is on its ring is all there will be
+    exited = __atomic_load_n( &( ring->exited ), __ATOMIC_ACQUIRE );
+    head   = __atomic_load_n( &( ring->head ), __ATOMIC_ACQUIRE );
+    tail   = ring->tail;
+
+    while( tail < head )
+    {
+        offset = ( size_t ) ( tail % LOG_RING_BYTES );
+        record = ( struct log_record * ) ( ring->data + offset );
+
+        if( record->level != 0 )
+        {
+            if( num_iov == LOG_WRITER_IOVECS || ( num_iov > 0 && _log_fd( record->level ) != fd ) )
+            {
+                _write_lines( fd, iov, num_iov );
+                __atomic_store_n( &( ring->tail ), tail, __ATOMIC_RELEASE );
+                num_iov = 0;
+            }
+
+            fd                     = _log_fd( record->level );
+            iov[num_iov].iov_base  = ring->data + offset + sizeof( struct log_record );
+            iov[num_iov++].iov_len = record->length;
+            lines++;
+        }
+
+        tail += ( sizeof( struct log_record ) + record->length + 7 ) & ~( ( uint64_t ) 7 );
+    }
+
+    if( num_iov > 0 )
+    {
+        _write_lines( fd, iov, num_iov );
+    }
+
+    __atomic_store_n( &( ring->tail ), tail, __ATOMIC_RELEASE );
+
+    if( exited )
+    {
+        ring->head   = 0;
+        ring->tail   = 0;
+        ring->exited = false;
+        __atomic_store_n( &( ring->owner ), 0, __ATOMIC_RELEASE );
+    }
+
+    return lines;
+}
+
+// Writes num_iov lines to fd, in as few writev() calls as it takes
+static void _write_lines( int fd, struct iovec * iov, int num_iov )
+{
+    ssize_t written = 0;
+
+    while( num_iov > 0 )
+    {
+        written = writev( fd, iov, num_iov );
+
+        if( written < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+
+            // There is nowhere left to say so
+            return;
+        }
+
+        while( num_iov > 0 && ( size_t ) written >= iov->iov_len )
+        {
+            written -= ( ssize_t ) iov->iov_len;
+            iov++;
+            num_iov--;
+        }
+
+        if( num_iov > 0 )
+        {
+            iov->iov_base  = ( char * ) iov->iov_base + written;
+            iov->iov_len  -= ( size_t ) written;
+        }
+    }
+
+    return;
+}
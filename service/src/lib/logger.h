@@ -0,0 +1,75 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "util.h"
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+// Rings in the shared log, one per process that logs; past that, processes write their own lines
+#define LOG_RINGS 256
+#define LOG_RING_BYTES 32768
+
+// Longest line logged, longer messages are cut short
+#define LOG_LINE_BYTES 4096
+
+// Lines the writer hands to a single writev(), well under Linux's IOV_MAX of 1024
+#define LOG_WRITER_IOVECS 256
+
+// Milliseconds the writer sleeps once every ring is empty
+#define LOG_WRITER_IDLE_MS 10
+
+/*
+ * Milliseconds a process waits for the writer to make room on its ring, or
+ * to write it out before exiting on FATAL
+ */
+#define LOG_WRITER_WAIT_MS 1000
+
+extern unsigned short log_min_level;
+
+/*
+ * Precedes each line in a ring. A record of level 0 only pads the ring out
+ * to its end, so that no line wraps around it.
+ */
+struct log_record {
+    uint32_t length;
+    uint32_t level;
+};
+
+/*
+ * The lines logged by the process owner, a single producer, for the writer,
+ * the single consumer. head and tail only ever grow, and are taken modulo
+ * LOG_RING_BYTES: lines from tail up to head are waiting to be written. The
+ * owner publishes head once a line is in place, the writer tail once it has
+ * been written, so neither ever waits for the other. exited is set by
+ * whoever reaps the owner, see log_exited(), and the writer then frees the
+ * ring once it is empty.
+ */
+struct log_ring {
+    pid_t    owner;
+    bool     exited;
+    uint64_t head __attribute__ ((aligned (64)));
+    uint64_t tail __attribute__ ((aligned (64)));
+    char     data[LOG_RING_BYTES] __attribute__ ((aligned (64)));
+};
+
+/*
+ * The shared log, set up by the parent before it forks anything else, and
+ * drained by writer. reopen asks the writer to reopen the log file, stopping
+ * to write what is left and exit.
+ */
+struct log_state {
+    pid_t           writer;
+    bool            reopen;
+    bool            stopping;
+    struct log_ring rings[LOG_RINGS];
+};
+
+extern bool start_log_writer( void );
+extern void stop_log_writer( void );
+extern void reopen_log( void );
+extern void log_exited( pid_t );
+extern void write_log( unsigned short, const char *, va_list ) __attribute__ ((format (gnu_printf, 2, 0)));
+extern bool parse_log_level( const char *, unsigned short * );
+
+#endif // LOGGER_H
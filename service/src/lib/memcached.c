@@ -0,0 +1,1174 @@
+#include "memcached.h"
+#include "ivm.h"
+
+unsigned long memcached_timeout_ms = DEFAULT_MEMCACHED_TIMEOUT_MS;
+unsigned int  memcached_expiration = DEFAULT_MEMCACHED_EXPIRATION;
+
+static const char * location_query = "\
+    SELECT hostname, \
+           port \
+      FROM %s.tb_location \
+     WHERE location = $1::INTEGER";
+
+static void * _open_memcached( struct worker *, struct maintenance_object * );
+static bool _begin_memcached_batch( void *, struct worker *, struct maintenance_object * );
+static bool _apply_memcached_batch(
+    void *,
+    struct worker *,
+    struct maintenance_object *,
+    struct change **,
+    unsigned long
+);
+static bool _commit_memcached_batch( void *, struct worker *, struct maintenance_object *, bool );
+static bool _begin_memcached_refresh( void *, struct worker *, struct maintenance_object * );
+static bool _write_memcached_chunk( void *, struct worker *, struct maintenance_object *, char *, size_t );
+static bool _end_memcached_refresh( void *, struct worker *, struct maintenance_object *, bool );
+static void _close_memcached( void * );
+static bool _connect( struct memcached_target * );
+static void _disconnect( struct memcached_target * );
+static bool _exchange( struct memcached_target *, struct maintenance_object *, uint32_t );
+static bool _read_responses( struct memcached_target *, struct maintenance_object *, uint32_t, bool * );
+static void _append_request(
+    struct string_buffer *,
+    unsigned char,
+    uint32_t,
+    struct string_buffer *,
+    struct string_buffer *
+);
+static bool _append_key( struct string_buffer *, struct maintenance_object *, struct tuple * );
+static void _append_row( struct string_buffer *, struct tuple * );
+static struct tuple * _read_copy_row( struct maintenance_object *, char *, size_t );
+static char * _read_copy_value( char *, size_t );
+static void _append_json_string( struct string_buffer *, char *, int );
+static void _append_hex( struct string_buffer *, char *, int );
+static void _write_uint( unsigned char *, uint64_t, unsigned int );
+static uint64_t _read_uint( unsigned char *, unsigned int );
+
+/*
+ * Each row of the definition is cached as its own entry, under the object's
+ * key columns, see plan_maintenance(). A refresh sets the entries of the rows
+ * the definition has; those of rows it no longer has cannot be found to be
+ * deleted, and are left to expire after memcached_expiration seconds.
+ */
+struct target_driver memcached_driver = {
+    TARGET_DRIVER_API_VERSION,
+    "memcached",
+    _open_memcached,
+    _begin_memcached_batch,
+    _apply_memcached_batch,
+    _commit_memcached_batch,
+    _begin_memcached_refresh,
+    _write_memcached_chunk,
+    _end_memcached_refresh,
+    _close_memcached
+};
+
+/*
+ * Looks up the memcached instance object's location names. The connection
+ * itself is opened by the first batch written to it.
+ */
+struct memcached_target * new_memcached_target( struct worker * me, struct maintenance_object * object )
+{
+    struct memcached_target * target    = NULL;
+    struct string_buffer *    query     = NULL;
+    PGresult *                result    = NULL;
+    char *                    schema    = NULL;
+    char *                    params[1] = { NULL };
+    char                      location[16];
+
+    if( me == NULL || object == NULL )
+    {
+        return NULL;
+    }
+
+    schema = get_extension_schema( me );
+    query  = new_string_buffer();
+
+    if( schema == NULL || query == NULL )
+    {
+        free_string_buffer( query );
+        return NULL;
+    }
+
+    snprintf( location, sizeof( location ), "%u", object->location );
+    params[0] = location;
+    string_buffer_append( query, location_query, schema );
+
+    result = _execute_query( me, query->data, params, 1 );
+    free_string_buffer( query );
+
+    if( result == NULL )
+    {
+        return NULL;
+    }
+
+    if( PQntuples( result ) != 1 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Location %u of %s.%s does not exist",
+            object->location,
+            object->namespace,
+            object->name
+        );
+
+        PQclear( result );
+        return NULL;
+    }
+
+    target = ( struct memcached_target * ) calloc( 1, sizeof( struct memcached_target ) );
+
+    if( target == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memcached target for %s.%s",
+            object->namespace,
+            object->name
+        );
+
+        PQclear( result );
+        return NULL;
+    }
+
+    target->socket   = -1;
+    target->hostname = strdup( PQgetvalue( result, 0, 0 ) );
+    target->port     = ( unsigned short ) strtoul( PQgetvalue( result, 0, 1 ), NULL, 10 );
+    target->out      = new_string_buffer();
+
+    PQclear( result );
+
+    if( target->port == 0 )
+    {
+        target->port = DEFAULT_MEMCACHED_PORT;
+    }
+
+    if( target->hostname == NULL || target->out == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memcached target for %s.%s",
+            object->namespace,
+            object->name
+        );
+
+        free_memcached_target( target );
+        return NULL;
+    }
+
+    return target;
+}
+
+void free_memcached_target( struct memcached_target * target )
+{
+    if( target == NULL )
+    {
+        return;
+    }
+
+    _disconnect( target );
+    free( target->hostname );
+    free_string_buffer( target->out );
+    free( target->in );
+    free( target );
+    return;
+}
+
+/*
+ * Maintains object's rows as memcached entries. changes are the target rows
+ * evaluate_changes() found, keyed by the object's key columns. Each row is
+ * stored under the object's qualified name and its key values, joined by
+ * colons (with colons and backslashes in the values escaped by a backslash
+ * and binary values in hex), as a JSON object of its columns' text values.
+ *
+ * changes are first coalesced to one net change per key, then written as one
+ * pipelined batch of quiet binary protocol SETs and DELETEs, to which the
+ * server only responds on errors, followed by a NOOP whose response marks
+ * the end of the batch. Responses are read while the batch is being written,
+ * so that errors cannot back up the connection. DELETEs of keys that are not
+ * cached are not errors.
+ *
+ * On failure the connection is closed, and some of the batch may have been
+ * written; as each entry is set or deleted outright, the batch can be written
+ * again.
+ */
+static bool _apply_memcached_batch(
+    void *                      handle,
+    struct worker *             me,
+    struct maintenance_object * object,
+    struct change **            changes,
+    unsigned long               num_changes
+)
+{
+    struct memcached_target * target  = NULL;
+    struct coalesce_table *   table   = NULL;
+    struct change **          net     = NULL;
+    struct change *           copy    = NULL;
+    struct string_buffer *    key     = NULL;
+    struct string_buffer *    value   = NULL;
+    unsigned long             num_net = 0;
+    unsigned long             i       = 0;
+    bool                      success = false;
+
+    target = ( struct memcached_target * ) handle;
+    table  = new_coalesce_table( DEFAULT_COALESCE_BUCKETS );
+    key    = new_string_buffer();
+    value  = new_string_buffer();
+
+    if( table == NULL || key == NULL || value == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memcached batch for %s.%s",
+            object->namespace,
+            object->name
+        );
+
+        goto cleanup;
+    }
+
+    // A row inserted and deleted within the batch may be cached from an earlier one
+    table->keep_deletes = true;
+
+    for( i = 0; i < num_changes; i++ )
+    {
+        if( changes[i] == NULL )
+        {
+            continue;
+        }
+
+        copy = copy_change( changes[i] );
+
+        if( copy == NULL || !coalesce_change( table, copy ) )
+        {
+            goto cleanup;
+        }
+    }
+
+    if( !coalesce_drain( table, &net, &num_net ) )
+    {
+        goto cleanup;
+    }
+
+    if( num_net == 0 )
+    {
+        success = true;
+        goto cleanup;
+    }
+
+    string_buffer_reset( target->out );
+
+    for( i = 0; i < num_net; i++ )
+    {
+        if( !_append_key( key, object, net[i]->type == CHANGE_TYPE_DELETE ? net[i]->key : net[i]->new_tuple ) )
+        {
+            goto cleanup;
+        }
+
+        if( net[i]->type == CHANGE_TYPE_DELETE )
+        {
+            _append_request( target->out, MEMCACHED_OPCODE_DELETEQ, ( uint32_t ) i, key, NULL );
+        }
+        else
+        {
+            _append_row( value, net[i]->new_tuple );
+            _append_request( target->out, MEMCACHED_OPCODE_SETQ, ( uint32_t ) i, key, value );
+        }
+    }
+
+    _append_request( target->out, MEMCACHED_OPCODE_NOOP, ( uint32_t ) num_net, NULL, NULL );
+
+    if( target->socket < 0 && !_connect( target ) )
+    {
+        goto cleanup;
+    }
+
+    success = _exchange( target, object, ( uint32_t ) num_net );
+
+    if( success )
+    {
+        _log(
+            LOG_LEVEL_DEBUG,
+            "Wrote %lu changes to %s.%s as %lu entries on memcached at %s:%u",
+            num_changes,
+            object->namespace,
+            object->name,
+            num_net,
+            target->hostname,
+            ( unsigned int ) target->port
+        );
+    }
+    else
+    {
+        _disconnect( target );
+    }
+
+cleanup:
+    for( i = 0; net != NULL && i < num_net; i++ )
+    {
+        free_change( net[i] );
+    }
+
+    free( net );
+    free_coalesce_table( table );
+    free_string_buffer( key );
+    free_string_buffer( value );
+    return success;
+}
+
+static void * _open_memcached( struct worker * me, struct maintenance_object * object )
+{
+    return new_memcached_target( me, object );
+}
+
+// Batches are written whole by apply_batch, there is nothing to begin or end
+static bool _begin_memcached_batch( void * target, struct worker * me, struct maintenance_object * object )
+{
+    return true;
+}
+
+static bool _commit_memcached_batch(
+    void *                      target,
+    struct worker *             me,
+    struct maintenance_object * object,
+    bool                        commit
+)
+{
+    return commit;
+}
+
+// The rows are keyed as evaluate_changes() keys them, which the plan decides
+static bool _begin_memcached_refresh( void * target, struct worker * me, struct maintenance_object * object )
+{
+    if( object->ivm == NULL )
+    {
+        object->ivm = plan_maintenance( me, object );
+    }
+
+    return object->ivm != NULL;
+}
+
+/*
+ * Sets an entry for each row in data, which holds whole rows of the
+ * definition in COPY text format, as one pipelined batch like those of
+ * _apply_memcached_batch().
+ */
+static bool _write_memcached_chunk(
+    void *                      handle,
+    struct worker *             me,
+    struct maintenance_object * object,
+    char *                      data,
+    size_t                      length
+)
+{
+    struct memcached_target * target   = NULL;
+    struct string_buffer *    key      = NULL;
+    struct string_buffer *    value    = NULL;
+    struct tuple *            row      = NULL;
+    char *                    line     = NULL;
+    char *                    end      = NULL;
+    uint32_t                  num_rows = 0;
+    bool                      success  = false;
+
+    target = ( struct memcached_target * ) handle;
+    key    = new_string_buffer();
+    value  = new_string_buffer();
+
+    if( key == NULL || value == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memcached refresh of %s.%s",
+            object->namespace,
+            object->name
+        );
+
+        goto cleanup;
+    }
+
+    string_buffer_reset( target->out );
+
+    for( line = data; line < data + length; line = end + 1 )
+    {
+        end = memchr( line, '\n', ( size_t ) ( data + length - line ) );
+
+        if( end == NULL )
+        {
+            end = data + length;
+        }
+
+        row = _read_copy_row( object, line, ( size_t ) ( end - line ) );
+
+        if( row == NULL || !_append_key( key, object, row ) )
+        {
+            free_tuple( row );
+            goto cleanup;
+        }
+
+        _append_row( value, row );
+        _append_request( target->out, MEMCACHED_OPCODE_SETQ, num_rows++, key, value );
+        free_tuple( row );
+    }
+
+    _append_request( target->out, MEMCACHED_OPCODE_NOOP, num_rows, NULL, NULL );
+
+    if( target->socket < 0 && !_connect( target ) )
+    {
+        goto cleanup;
+    }
+
+    success = _exchange( target, object, num_rows );
+
+    if( !success )
+    {
+        _disconnect( target );
+    }
+
+cleanup:
+    free_string_buffer( key );
+    free_string_buffer( value );
+    return success;
+}
+
+// Entries were set outright as the chunks arrived
+static bool _end_memcached_refresh(
+    void *                      target,
+    struct worker *             me,
+    struct maintenance_object * object,
+    bool                        complete
+)
+{
+    return complete;
+}
+
+static void _close_memcached( void * target )
+{
+    free_memcached_target( ( struct memcached_target * ) target );
+    return;
+}
+
+// Opens a non-blocking connection to target, waiting up to memcached_timeout_ms for it
+static bool _connect( struct memcached_target * target )
+{
+    struct addrinfo   hints;
+    struct addrinfo * addresses = NULL;
+    struct addrinfo * address   = NULL;
+    struct pollfd     poller;
+    socklen_t         length    = 0;
+    char              port[8]   = { 0 };
+    int               result    = 0;
+    int               error     = 0;
+    int               flag      = 1;
+
+    memset( &hints, 0, sizeof( struct addrinfo ) );
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf( port, sizeof( port ), "%u", ( unsigned int ) target->port );
+
+    result = getaddrinfo( target->hostname, port, &hints, &addresses );
+
+    if( result != 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to resolve memcached host %s: %s",
+            target->hostname,
+            gai_strerror( result )
+        );
+
+        return false;
+    }
+
+    for( address = addresses; address != NULL; address = address->ai_next )
+    {
+        target->socket = socket(
+            address->ai_family,
+            address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+            address->ai_protocol
+        );
+
+        if( target->socket < 0 )
+        {
+            error = errno;
+            continue;
+        }
+
+        if( connect( target->socket, address->ai_addr, address->ai_addrlen ) == 0 )
+        {
+            break;
+        }
+
+        error = errno;
+
+        if( error == EINPROGRESS )
+        {
+            poller.fd      = target->socket;
+            poller.events  = POLLOUT;
+            poller.revents = 0;
+            length         = sizeof( error );
+            result         = poll( &poller, 1, ( int ) memcached_timeout_ms );
+
+            if( result == 0 )
+            {
+                error = ETIMEDOUT;
+            }
+            else if( result < 0 || getsockopt( target->socket, SOL_SOCKET, SO_ERROR, &error, &length ) != 0 )
+            {
+                error = errno;
+            }
+            else if( error == 0 )
+            {
+                break;
+            }
+        }
+
+        close( target->socket );
+        target->socket = -1;
+    }
+
+    freeaddrinfo( addresses );
+
+    if( target->socket < 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to connect to memcached at %s:%u: %s",
+            target->hostname,
+            ( unsigned int ) target->port,
+            strerror( error )
+        );
+
+        return false;
+    }
+
+    // Batches are written whole, holding back their tail only adds latency
+    setsockopt( target->socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof( flag ) );
+    return true;
+}
+
+static void _disconnect( struct memcached_target * target )
+{
+    if( target->socket >= 0 )
+    {
+        close( target->socket );
+    }
+
+    target->socket    = -1;
+    target->in_length = 0;
+    return;
+}
+
+/*
+ * Writes target's batch and reads responses until that of the NOOP with
+ * opaque last arrives. Returns false on errors writing or reading, after
+ * memcached_timeout_ms, or if any request failed.
+ */
+static bool _exchange( struct memcached_target * target, struct maintenance_object * object, uint32_t last )
+{
+    struct pollfd  poller;
+    struct timeval start;
+    struct timeval now;
+    char *         grown     = NULL;
+    size_t         sent      = 0;
+    ssize_t        result    = 0;
+    long           remaining = 0;
+    bool           done      = false;
+    bool           failed    = false;
+
+    gettimeofday( &start, NULL );
+    target->in_length = 0;
+
+    while( !done )
+    {
+        gettimeofday( &now, NULL );
+        remaining = ( long ) memcached_timeout_ms
+                  - ( ( now.tv_sec - start.tv_sec ) * 1000 + ( now.tv_usec - start.tv_usec ) / 1000 );
+
+        if( remaining <= 0 )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Timed out writing %s.%s to memcached at %s:%u",
+                object->namespace,
+                object->name,
+                target->hostname,
+                ( unsigned int ) target->port
+            );
+
+            return false;
+        }
+
+        poller.fd      = target->socket;
+        poller.events  = POLLIN | ( sent < target->out->length ? POLLOUT : 0 );
+        poller.revents = 0;
+
+        if( poll( &poller, 1, ( int ) remaining ) < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to poll memcached at %s:%u: %s",
+                target->hostname,
+                ( unsigned int ) target->port,
+                strerror( errno )
+            );
+
+            return false;
+        }
+
+        if( poller.revents & POLLOUT )
+        {
+            result = send(
+                target->socket,
+                target->out->data + sent,
+                target->out->length - sent,
+                MSG_NOSIGNAL
+            );
+
+            if( result < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+            {
+                _log(
+                    LOG_LEVEL_ERROR,
+                    "Failed to write to memcached at %s:%u: %s",
+                    target->hostname,
+                    ( unsigned int ) target->port,
+                    strerror( errno )
+                );
+
+                return false;
+            }
+
+            if( result > 0 )
+            {
+                sent += ( size_t ) result;
+            }
+        }
+
+        if( !( poller.revents & ( POLLIN | POLLERR | POLLHUP ) ) )
+        {
+            continue;
+        }
+
+        if( target->in_size - target->in_length < MEMCACHED_HEADER_LENGTH * 64 )
+        {
+            grown = ( char * ) realloc(
+                target->in,
+                target->in_size > 0 ? target->in_size * 2 : MEMCACHED_HEADER_LENGTH * 256
+            );
+
+            if( grown == NULL )
+            {
+                _log(
+                    LOG_LEVEL_ERROR,
+                    "Failed to allocate memcached response buffer"
+                );
+
+                return false;
+            }
+
+            target->in      = grown;
+            target->in_size = target->in_size > 0 ? target->in_size * 2 : MEMCACHED_HEADER_LENGTH * 256;
+        }
+
+        result = recv( target->socket, target->in + target->in_length, target->in_size - target->in_length, 0 );
+
+        if( result == 0 || ( result < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Lost connection to memcached at %s:%u: %s",
+                target->hostname,
+                ( unsigned int ) target->port,
+                result == 0 ? "closed by server" : strerror( errno )
+            );
+
+            return false;
+        }
+
+        if( result > 0 )
+        {
+            target->in_length += ( size_t ) result;
+            done               = _read_responses( target, object, last, &failed );
+        }
+    }
+
+    return !failed;
+}
+
+/*
+ * Consumes the complete responses in target's input, logging those of failed
+ * requests and setting failed. Returns true once the response to the NOOP
+ * with opaque last has been read, or the input cannot be parsed.
+ */
+static bool _read_responses(
+    struct memcached_target *   target,
+    struct maintenance_object * object,
+    uint32_t                    last,
+    bool *                      failed
+)
+{
+    unsigned char * header = NULL;
+    size_t          offset = 0;
+    size_t          length = 0;
+    uint32_t        opaque = 0;
+    unsigned int    status = 0;
+    unsigned int    skip   = 0;
+    bool            done   = false;
+
+    while( !done && target->in_length - offset >= MEMCACHED_HEADER_LENGTH )
+    {
+        header = ( unsigned char * ) target->in + offset;
+
+        if( header[0] != MEMCACHED_RESPONSE_MAGIC )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Unexpected response from memcached at %s:%u",
+                target->hostname,
+                ( unsigned int ) target->port
+            );
+
+            *failed = true;
+            return true;
+        }
+
+        length = MEMCACHED_HEADER_LENGTH + ( size_t ) _read_uint( header + 8, 4 );
+
+        if( target->in_length - offset < length )
+        {
+            break;
+        }
+
+        status = ( unsigned int ) _read_uint( header + 6, 2 );
+        opaque = ( uint32_t ) _read_uint( header + 12, 4 );
+
+        if( header[1] == MEMCACHED_OPCODE_NOOP && opaque == last )
+        {
+            done = true;
+        }
+        else if(
+                    status != MEMCACHED_STATUS_SUCCESS
+                 && !( header[1] == MEMCACHED_OPCODE_DELETEQ && status == MEMCACHED_STATUS_KEY_NOT_FOUND )
+               )
+        {
+            // The error message follows any extras and key
+            skip = ( unsigned int ) header[4] + ( unsigned int ) _read_uint( header + 2, 2 );
+
+            _log(
+                LOG_LEVEL_ERROR,
+                "memcached at %s:%u rejected change %u of a batch to %s.%s: %.*s (status %u)",
+                target->hostname,
+                ( unsigned int ) target->port,
+                opaque,
+                object->namespace,
+                object->name,
+                ( int ) ( length - MEMCACHED_HEADER_LENGTH - skip ),
+                ( char * ) header + MEMCACHED_HEADER_LENGTH + skip,
+                status
+            );
+
+            *failed = true;
+        }
+
+        offset += length;
+    }
+
+    memmove( target->in, target->in + offset, target->in_length - offset );
+    target->in_length -= offset;
+    return done;
+}
+
+/*
+ * Appends a binary protocol request to out. SETs carry 8 bytes of extras:
+ * flags, always 0, and memcached_expiration.
+ */
+static void _append_request(
+    struct string_buffer * out,
+    unsigned char          opcode,
+    uint32_t               opaque,
+    struct string_buffer * key,
+    struct string_buffer * value
+)
+{
+    unsigned char header[MEMCACHED_HEADER_LENGTH + 8];
+    unsigned int  extras       = 0;
+    size_t        key_length   = 0;
+    size_t        value_length = 0;
+
+    memset( header, 0, sizeof( header ) );
+
+    extras       = opcode == MEMCACHED_OPCODE_SETQ ? 8 : 0;
+    key_length   = key != NULL ? key->length : 0;
+    value_length = value != NULL ? value->length : 0;
+
+    header[0] = MEMCACHED_REQUEST_MAGIC;
+    header[1] = opcode;
+    _write_uint( header + 2, key_length, 2 );
+    header[4] = ( unsigned char ) extras;
+    _write_uint( header + 8, extras + key_length + value_length, 4 );
+    _write_uint( header + 12, opaque, 4 );
+
+    if( extras > 0 )
+    {
+        _write_uint( header + MEMCACHED_HEADER_LENGTH + 4, memcached_expiration, 4 );
+    }
+
+    string_buffer_append_bytes( out, ( char * ) header, MEMCACHED_HEADER_LENGTH + extras );
+
+    if( key_length > 0 )
+    {
+        string_buffer_append_bytes( out, key->data, key_length );
+    }
+
+    if( value_length > 0 )
+    {
+        string_buffer_append_bytes( out, value->data, value_length );
+    }
+
+    return;
+}
+
+/*
+ * The entry key of the row tuple holds the key columns of, in the order of
+ * object's columns. NULLs and key columns missing from tuple are empty.
+ */
+static bool _append_key( struct string_buffer * key, struct maintenance_object * object, struct tuple * tuple )
+{
+    unsigned int i     = 0;
+    int          index = -1;
+    char *       value = NULL;
+
+    string_buffer_reset( key );
+    string_buffer_append( key, "%s.%s", object->namespace, object->name );
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        if( !object->is_key[i] )
+        {
+            continue;
+        }
+
+        string_buffer_append_bytes( key, ":", 1 );
+        index = find_tuple_column( tuple, object->columns[i] );
+
+        if( index < 0 || tuple->values[index] == NULL )
+        {
+            continue;
+        }
+
+        if( tuple->lengths != NULL )
+        {
+            _append_hex( key, tuple->values[index], tuple->lengths[index] );
+            continue;
+        }
+
+        for( value = tuple->values[index]; *value != '\0'; value++ )
+        {
+            if( *value == ':' || *value == '\\' )
+            {
+                string_buffer_append_bytes( key, "\\", 1 );
+            }
+
+            string_buffer_append_bytes( key, value, 1 );
+        }
+    }
+
+    if( key->length > MEMCACHED_MAX_KEY_LENGTH )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Key of a row of %s.%s is %zu bytes, over memcached's limit of %d",
+            object->namespace,
+            object->name,
+            key->length,
+            MEMCACHED_MAX_KEY_LENGTH
+        );
+
+        return false;
+    }
+
+    return true;
+}
+
+// The row as a JSON object of text values, binary ones as \x and their bytes in hex
+static void _append_row( struct string_buffer * value, struct tuple * tuple )
+{
+    unsigned int i = 0;
+
+    string_buffer_reset( value );
+    string_buffer_append_bytes( value, "{", 1 );
+
+    for( i = 0; tuple != NULL && i < tuple->num_columns; i++ )
+    {
+        if( i > 0 )
+        {
+            string_buffer_append_bytes( value, ",", 1 );
+        }
+
+        _append_json_string( value, tuple->names[i], -1 );
+        string_buffer_append_bytes( value, ":", 1 );
+
+        if( tuple->values[i] == NULL )
+        {
+            string_buffer_append_bytes( value, "null", 4 );
+        }
+        else
+        {
+            _append_json_string( value, tuple->values[i], tuple->lengths != NULL ? tuple->lengths[i] : -1 );
+        }
+    }
+
+    string_buffer_append_bytes( value, "}", 1 );
+    return;
+}
+
+/*
+ * A row of COPY text format, length bytes at line without its newline, as a
+ * tuple of object's columns. Returns NULL if the row does not have a field
+ * per column.
+ */
+static struct tuple * _read_copy_row( struct maintenance_object * object, char * line, size_t length )
+{
+    struct tuple * tuple = NULL;
+    char *         field = NULL;
+    char *         end   = NULL;
+    unsigned int   i     = 0;
+
+    tuple = new_tuple( object->num_columns );
+
+    if( tuple == NULL )
+    {
+        return NULL;
+    }
+
+    // Unset entries are NULL, so the tuple can be freed part way through
+    tuple->num_columns = object->num_columns;
+
+    for( i = 0, field = line; i < object->num_columns; i++, field = end + 1 )
+    {
+        if( field > line + length )
+        {
+            break;
+        }
+
+        end = memchr( field, '\t', ( size_t ) ( line + length - field ) );
+
+        if( end == NULL )
+        {
+            end = line + length;
+        }
+
+        tuple->names[i] = strdup( object->columns[i] );
+
+        if( tuple->names[i] == NULL )
+        {
+            break;
+        }
+
+        if( end - field == 2 && field[0] == '\\' && field[1] == 'N' )
+        {
+            continue;
+        }
+
+        tuple->values[i] = _read_copy_value( field, ( size_t ) ( end - field ) );
+
+        if( tuple->values[i] == NULL )
+        {
+            break;
+        }
+    }
+
+    if( i < object->num_columns || end != line + length )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to read a row of %s.%s",
+            object->namespace,
+            object->name
+        );
+
+        free_tuple( tuple );
+        return NULL;
+    }
+
+    return tuple;
+}
+
+// A COPY text field of length bytes with its backslash escapes undone
+static char * _read_copy_value( char * field, size_t length )
+{
+    char *       result = NULL;
+    size_t       i      = 0;
+    size_t       j      = 0;
+    size_t       k      = 0;
+    size_t       start  = 0;
+    unsigned int value  = 0;
+    unsigned int base   = 0;
+
+    result = ( char * ) malloc( length + 1 );
+
+    if( result == NULL )
+    {
+        return NULL;
+    }
+
+    for( i = 0; i < length; i++ )
+    {
+        if( field[i] != '\\' || i + 1 == length )
+        {
+            result[j++] = field[i];
+            continue;
+        }
+
+        switch( field[++i] )
+        {
+            case 'b':
+                result[j++] = '\b';
+                break;
+            case 'f':
+                result[j++] = '\f';
+                break;
+            case 'n':
+                result[j++] = '\n';
+                break;
+            case 'r':
+                result[j++] = '\r';
+                break;
+            case 't':
+                result[j++] = '\t';
+                break;
+            case 'v':
+                result[j++] = '\v';
+                break;
+            default:
+                // \ddd in octal or \xhh in hex, otherwise the character itself
+                base  = field[i] == 'x' ? 16 : 8;
+                start = base == 16 ? i + 1 : i;
+                value = 0;
+
+                for( k = start; k < length && k < start + ( base == 16 ? 2 : 3 ); k++ )
+                {
+                    if( base == 8 && field[k] >= '0' && field[k] <= '7' )
+                    {
+                        value = value * 8 + ( unsigned int ) ( field[k] - '0' );
+                    }
+                    else if( base == 16 && isxdigit( ( unsigned char ) field[k] ) )
+                    {
+                        value = value * 16 + ( unsigned int ) (
+                            isdigit( ( unsigned char ) field[k] )
+                          ? field[k] - '0'
+                          : tolower( ( unsigned char ) field[k] ) - 'a' + 10
+                        );
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+
+                if( k == start )
+                {
+                    result[j++] = field[i];
+                    break;
+                }
+
+                result[j++] = ( char ) value;
+                i           = k - 1;
+                break;
+        }
+    }
+
+    result[j] = '\0';
+    return result;
+}
+
+/*
+ * Appends value as a JSON string. A length of -1 means value is NUL
+ * terminated text, otherwise it is length bytes of binary.
+ */
+static void _append_json_string( struct string_buffer * buffer, char * value, int length )
+{
+    char * run = NULL;
+
+    string_buffer_append_bytes( buffer, "\"", 1 );
+
+    if( length >= 0 )
+    {
+        string_buffer_append_bytes( buffer, "\\\\x", 3 );
+        _append_hex( buffer, value, length );
+        string_buffer_append_bytes( buffer, "\"", 1 );
+        return;
+    }
+
+    // Unescaped characters are copied in runs
+    for( run = value; *value != '\0'; value++ )
+    {
+        if( *value != '"' && *value != '\\' && ( unsigned char ) *value >= 0x20 )
+        {
+            continue;
+        }
+
+        string_buffer_append_bytes( buffer, run, ( size_t ) ( value - run ) );
+
+        if( *value == '"' || *value == '\\' )
+        {
+            string_buffer_append( buffer, "\\%c", *value );
+        }
+        else
+        {
+            string_buffer_append( buffer, "\\u%04x", ( unsigned int ) ( unsigned char ) *value );
+        }
+
+        run = value + 1;
+    }
+
+    string_buffer_append_bytes( buffer, run, ( size_t ) ( value - run ) );
+    string_buffer_append_bytes( buffer, "\"", 1 );
+    return;
+}
+
+static void _append_hex( struct string_buffer * buffer, char * value, int length )
+{
+    static const char digits[] = "0123456789abcdef";
+    char              pair[2];
+    int               i = 0;
+
+    for( i = 0; i < length; i++ )
+    {
+        pair[0] = digits[( ( unsigned char ) value[i] ) >> 4];
+        pair[1] = digits[( ( unsigned char ) value[i] ) & 0x0f];
+        string_buffer_append_bytes( buffer, pair, 2 );
+    }
+
+    return;
+}
+
+// Writes the low bytes of value, most significant first
+static void _write_uint( unsigned char * buffer, uint64_t value, unsigned int bytes )
+{
+    unsigned int i = 0;
+
+    for( i = 0; i < bytes; i++ )
+    {
+        buffer[i] = ( unsigned char ) ( value >> ( 8 * ( bytes - 1 - i ) ) );
+    }
+
+    return;
+}
+
+static uint64_t _read_uint( unsigned char * buffer, unsigned int bytes )
+{
+    uint64_t     value = 0;
+    unsigned int i     = 0;
+
+    for( i = 0; i < bytes; i++ )
+    {
+        value = ( value << 8 ) | buffer[i];
+    }
+
+    return value;
+}
@@ -0,0 +1,56 @@
+#ifndef MEMCACHED_H
+#define MEMCACHED_H
+
+#include "util.h"
+#include "query.h"
+#include "change.h"
+#include "object.h"
+#include "coalesce.h"
+#include "driver.h"
+#include <stdint.h>
+#include <poll.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_MEMCACHED_PORT 11211
+#define DEFAULT_MEMCACHED_TIMEOUT_MS 5000
+#define DEFAULT_MEMCACHED_EXPIRATION 0
+
+// Binary protocol framing, see memcached's protocol_binary.h
+#define MEMCACHED_HEADER_LENGTH 24
+#define MEMCACHED_MAX_KEY_LENGTH 250
+#define MEMCACHED_REQUEST_MAGIC 0x80
+#define MEMCACHED_RESPONSE_MAGIC 0x81
+#define MEMCACHED_OPCODE_NOOP 0x0a
+#define MEMCACHED_OPCODE_SETQ 0x11
+#define MEMCACHED_OPCODE_DELETEQ 0x14
+#define MEMCACHED_STATUS_SUCCESS 0x0000
+#define MEMCACHED_STATUS_KEY_NOT_FOUND 0x0001
+
+extern unsigned long memcached_timeout_ms;
+extern unsigned int memcached_expiration;
+
+/*
+ * A connection to the memcached instance at a maintenance_object's location.
+ * Requests of a batch are written to out and responses read into in, over a
+ * non-blocking socket that is reopened on the next batch after an error.
+ */
+struct memcached_target {
+    char *                 hostname;
+    unsigned short         port;
+    int                    socket;
+    struct string_buffer * out;
+    char *                 in;
+    size_t                 in_length;
+    size_t                 in_size;
+};
+
+extern struct memcached_target * new_memcached_target( struct worker *, struct maintenance_object * );
+extern void free_memcached_target( struct memcached_target * );
+extern struct target_driver memcached_driver;
+
+#endif // MEMCACHED_H
@@ -0,0 +1,987 @@
+#include "metrics.h"
+
+unsigned short metrics_port = 0;
+
+static struct metrics_state * metrics_state = NULL;
+
+// This process's slot, once it has claimed one
+static struct worker_metrics * my_metrics = NULL;
+
+static const char * status_names[] = { "dead", "startup", "idle", "update", "refresh" };
+
+// Quantiles of commit latency reported
+static const double latency_quantiles[] = { 0.5, 0.99, 0.999 };
+
+/*
+ * How each counter, gauge and histogram is reported. Values are multiplied
+ * by scale, so that they are reported in base units.
+ */
+struct metric_family {
+    const char * name;
+    const char * help;
+    double       scale;
+};
+
+static const struct metric_family counter_families[METRIC_COUNTERS] = {
+    { "pg_ctblmgr_transactions_applied_total", "Transactions applied", 1.0 },
+    { "pg_ctblmgr_transactions_skipped_total", "Transactions skipped as already applied", 1.0 },
+    { "pg_ctblmgr_changes_applied_total", "Changes in the transactions applied", 1.0 },
+    { "pg_ctblmgr_connection_retries_total", "Connection attempts retried after a back-off", 1.0 },
+    { "pg_ctblmgr_batches_applied_total", "Batches of transactions applied", 1.0 }
+};
+
+static const struct metric_family gauge_families[METRIC_GAUGES] = {
+    { "pg_ctblmgr_received_lsn", "Last LSN received", 1.0 },
+    { "pg_ctblmgr_applied_lsn", "Last COMMIT LSN applied", 1.0 },
+    { "pg_ctblmgr_batch_rows", "Changes a batch is applied at once it holds", 1.0 },
+    { "pg_ctblmgr_batch_flush_milliseconds", "Longest a transaction waits in a batch before it is applied", 1.0 }
+};
+
+static const struct metric_family histogram_families[METRIC_HISTOGRAMS] = {
+    { "pg_ctblmgr_batch_changes", "Changes per batch applied", 1.0 },
+    { "pg_ctblmgr_apply_seconds", "Time taken to apply a batch", 0.000001 }
+};
+
+static void _forked( void );
+static struct worker_metrics * _live_worker( unsigned int );
+static bool _claim_owner( pid_t *, pid_t );
+static void _render_labels( struct string_buffer *, struct worker_metrics * );
+static void _render_latency( struct string_buffer *, const char *, const char *, struct latency_histogram * );
+static void _merge_latency( struct latency_histogram *, struct latency_histogram * );
+static unsigned int _latency_bucket( uint64_t );
+static uint64_t _latency_bound( unsigned int );
+static bool _accept_scrape( struct event_loop *, int, uint32_t, void * );
+static bool _client_ready( struct event_loop *, int, uint32_t, void * );
+static bool _respond( struct metrics_client * );
+static void _close_client( struct metrics_client * );
+
+/*
+ * Sets up the shared metrics, and claims the parent's slot. Processes
+ * forked after it report into slots of their own, once they claim one.
+ */
+bool start_metrics( void )
+{
+    metrics_state = ( struct metrics_state * ) create_shared_memory( sizeof( struct metrics_state ) );
+
+    if( metrics_state == NULL )
+    {
+        return false;
+    }
+
+    if( pthread_atfork( NULL, NULL, _forked ) != 0 )
+    {
+        munmap( metrics_state, sizeof( struct metrics_state ) );
+        metrics_state = NULL;
+        return false;
+    }
+
+    claim_metrics( "receiver", NULL, 0 );
+    return true;
+}
+
+/*
+ * Has this process report as role, applying the changes of source to
+ * location. Nothing is reported if every slot is taken.
+ */
+void claim_metrics( const char * role, const char * source, unsigned int location )
+{
+    struct worker_metrics * slot = NULL;
+    pid_t                   pid  = 0;
+    unsigned int            i    = 0;
+
+    if( metrics_state == NULL || my_metrics != NULL )
+    {
+        return;
+    }
+
+    pid = getpid();
+
+    for( i = 0; i < METRICS_WORKERS; i++ )
+    {
+        slot = &( metrics_state->workers[i] );
+
+        if( _claim_owner( &( slot->owner ), pid ) )
+        {
+            break;
+        }
+    }
+
+    if( i == METRICS_WORKERS )
+    {
+        return;
+    }
+
+    memset( slot->counters, 0, sizeof( slot->counters ) );
+    memset( slot->gauges, 0, sizeof( slot->gauges ) );
+    memset( slot->histograms, 0, sizeof( slot->histograms ) );
+    memset( &( slot->latency ), 0, sizeof( slot->latency ) );
+    snprintf( slot->role, sizeof( slot->role ), "%s", role );
+    snprintf( slot->source, sizeof( slot->source ), "%s", source != NULL ? source : "" );
+    slot->location = location;
+    slot->status   = WORKER_STATUS_STARTUP;
+
+    my_metrics = slot;
+    return;
+}
+
+// Claims a slot to report how far object has been applied at location in
+struct object_metrics * claim_object_metrics( unsigned int object, unsigned int location )
+{
+    struct object_metrics * slot = NULL;
+    pid_t                   pid  = 0;
+    unsigned int            i    = 0;
+
+    if( metrics_state == NULL )
+    {
+        return NULL;
+    }
+
+    pid = getpid();
+
+    for( i = 0; i < METRICS_OBJECTS; i++ )
+    {
+        slot = &( metrics_state->objects[i] );
+
+        if( _claim_owner( &( slot->owner ), pid ) )
+        {
+            slot->object      = object;
+            slot->location    = location;
+            slot->applied_lsn = 0;
+            memset( &( slot->latency ), 0, sizeof( slot->latency ) );
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Frees the slots of pid, a child that has exited but is not reaped yet, so
+ * that they can be claimed again. Its pid cannot have been reused meanwhile.
+ */
+void metrics_exited( pid_t pid )
+{
+    pid_t        owner = 0;
+    unsigned int i     = 0;
+
+    if( metrics_state == NULL || pid <= 0 )
+    {
+        return;
+    }
+
+    for( i = 0; i < METRICS_WORKERS; i++ )
+    {
+        owner = pid;
+        __atomic_compare_exchange_n( &( metrics_state->workers[i].owner ), &owner, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED );
+    }
+
+    for( i = 0; i < METRICS_OBJECTS; i++ )
+    {
+        owner = pid;
+        __atomic_compare_exchange_n( &( metrics_state->objects[i].owner ), &owner, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED );
+    }
+
+    return;
+}
+
+void set_worker_status( struct worker * me, unsigned short status )
+{
+    me->status = status;
+
+    if( my_metrics != NULL )
+    {
+        __atomic_store_n( &( my_metrics->status ), status, __ATOMIC_RELAXED );
+    }
+
+    return;
+}
+
+void metrics_count( unsigned int counter, uint64_t value )
+{
+    if( my_metrics != NULL )
+    {
+        __atomic_fetch_add( &( my_metrics->counters[counter] ), value, __ATOMIC_RELAXED );
+    }
+
+    return;
+}
+
+void metrics_gauge( unsigned int gauge, uint64_t value )
+{
+    if( my_metrics != NULL )
+    {
+        __atomic_store_n( &( my_metrics->gauges[gauge] ), value, __ATOMIC_RELAXED );
+    }
+
+    return;
+}
+
+void metrics_observe( unsigned int histogram, uint64_t value )
+{
+    struct metrics_histogram * target = NULL;
+    unsigned int               bucket = 0;
+
+    if( my_metrics == NULL )
+    {
+        return;
+    }
+
+    target = &( my_metrics->histograms[histogram] );
+    bucket = value <= 1 ? 0 : ( unsigned int ) ( 64 - __builtin_clzll( value - 1 ) );
+
+    if( bucket >= METRICS_BUCKETS )
+    {
+        bucket = METRICS_BUCKETS - 1;
+    }
+
+    __atomic_fetch_add( &( target->buckets[bucket] ), 1, __ATOMIC_RELAXED );
+    __atomic_fetch_add( &( target->sum ), value, __ATOMIC_RELAXED );
+    return;
+}
+
+void metrics_object_applied( struct object_metrics * object, uint64_t lsn )
+{
+    if( object != NULL )
+    {
+        __atomic_store_n( &( object->applied_lsn ), lsn, __ATOMIC_RELAXED );
+    }
+
+    return;
+}
+
+// Records how long after its COMMIT on the source a transaction was committed on the target
+void metrics_commit_latency( uint64_t microseconds )
+{
+    if( my_metrics != NULL )
+    {
+        record_latency( &( my_metrics->latency ), microseconds );
+    }
+
+    return;
+}
+
+// Records the latency of a transaction that changed object
+void metrics_object_latency( struct object_metrics * object, uint64_t microseconds )
+{
+    if( object != NULL )
+    {
+        record_latency( &( object->latency ), microseconds );
+    }
+
+    return;
+}
+
+/*
+ * Microseconds since commit_time, as the decoder gives it. The source's
+ * clock is trusted to agree with ours; a COMMIT that seems to lie ahead
+ * counts as 0.
+ */
+uint64_t latency_since_commit( int64_t commit_time )
+{
+    struct timeval now     = {0};
+    int64_t        elapsed = 0;
+
+    gettimeofday( &now, NULL );
+
+    elapsed = ( ( int64_t ) now.tv_sec - POSTGRES_EPOCH_OFFSET ) * 1000000L + ( int64_t ) now.tv_usec - commit_time;
+    return elapsed > 0 ? ( uint64_t ) elapsed : 0;
+}
+
+void record_latency( struct latency_histogram * histogram, uint64_t microseconds )
+{
+    __atomic_fetch_add( &( histogram->counts[_latency_bucket( microseconds )] ), 1, __ATOMIC_RELAXED );
+    __atomic_fetch_add( &( histogram->count ), 1, __ATOMIC_RELAXED );
+    __atomic_fetch_add( &( histogram->sum ), microseconds, __ATOMIC_RELAXED );
+
+    if( microseconds > __atomic_load_n( &( histogram->max ), __ATOMIC_RELAXED ) )
+    {
+        __atomic_store_n( &( histogram->max ), microseconds, __ATOMIC_RELAXED );
+    }
+
+    return;
+}
+
+/*
+ * The latency below which quantile of those recorded in histogram fall, or
+ * of those recorded since it looked like since, if that is given. As with
+ * HDR histograms this is the highest value of the bucket the quantile falls
+ * in, so it is never understated.
+ */
+uint64_t latency_percentile( struct latency_histogram * histogram, struct latency_histogram * since, double quantile )
+{
+    uint64_t     total      = 0;
+    uint64_t     wanted     = 0;
+    uint64_t     cumulative = 0;
+    uint64_t     bound      = 0;
+    uint64_t     max        = 0;
+    unsigned int i          = 0;
+
+    total = __atomic_load_n( &( histogram->count ), __ATOMIC_RELAXED ) - ( since != NULL ? since->count : 0 );
+
+    if( total == 0 )
+    {
+        return 0;
+    }
+
+    wanted = ( uint64_t ) ceil( quantile * ( double ) total );
+    wanted = wanted == 0 ? 1 : wanted;
+
+    for( i = 0; i < METRICS_LATENCY_BUCKETS; i++ )
+    {
+        cumulative += __atomic_load_n( &( histogram->counts[i] ), __ATOMIC_RELAXED )
+                    - ( since != NULL ? since->counts[i] : 0 );
+
+        if( cumulative >= wanted )
+        {
+            break;
+        }
+    }
+
+    bound = _latency_bound( i < METRICS_LATENCY_BUCKETS ? i : METRICS_LATENCY_BUCKETS - 1 );
+    max   = __atomic_load_n( &( histogram->max ), __ATOMIC_RELAXED );
+
+    // Since max is over the lifetime, it is the interval's only when set during it
+    if( since != NULL && max <= since->max )
+    {
+        return bound;
+    }
+
+    return bound < max ? bound : max;
+}
+
+/*
+ * Appends what every live process and object reports, in Prometheus' text
+ * format. Counters are read as they are written, not as of one instant.
+ */
+void render_metrics( struct string_buffer * buffer )
+{
+    struct worker_metrics *    slot       = NULL;
+    struct worker_metrics *    other      = NULL;
+    struct object_metrics *    object     = NULL;
+    struct metrics_histogram * histogram  = NULL;
+    struct latency_histogram   merged     = {{0}};
+    const char *               name       = NULL;
+    char                       labels[METRICS_NAME_LENGTH + 64];
+    unsigned short             status     = 0;
+    uint64_t                   cumulative = 0;
+    unsigned int               i          = 0;
+    unsigned int               j          = 0;
+    unsigned int               k          = 0;
+
+    if( metrics_state == NULL )
+    {
+        return;
+    }
+
+    string_buffer_append(
+        buffer,
+        "# HELP pg_ctblmgr_worker_status Status of each process, 1 for the one it is in\n"
+        "# TYPE pg_ctblmgr_worker_status gauge\n"
+    );
+
+    for( i = 0; i < METRICS_WORKERS; i++ )
+    {
+        if( ( slot = _live_worker( i ) ) == NULL )
+        {
+            continue;
+        }
+
+        status = __atomic_load_n( &( slot->status ), __ATOMIC_RELAXED );
+
+        for( j = WORKER_STATUS_STARTUP; j <= WORKER_STATUS_REFRESH; j++ )
+        {
+            string_buffer_append( buffer, "pg_ctblmgr_worker_status{" );
+            _render_labels( buffer, slot );
+            string_buffer_append( buffer, ",status=\"%s\"} %d\n", status_names[j], status == j ? 1 : 0 );
+        }
+    }
+
+    for( k = 0; k < METRIC_COUNTERS + METRIC_GAUGES; k++ )
+    {
+        name = k < METRIC_COUNTERS ? counter_families[k].name : gauge_families[k - METRIC_COUNTERS].name;
+
+        string_buffer_append(
+            buffer,
+            "# HELP %s %s\n# TYPE %s %s\n",
+            name,
+            k < METRIC_COUNTERS ? counter_families[k].help : gauge_families[k - METRIC_COUNTERS].help,
+            name,
+            k < METRIC_COUNTERS ? "counter" : "gauge"
+        );
+
+        for( i = 0; i < METRICS_WORKERS; i++ )
+        {
+            if( ( slot = _live_worker( i ) ) == NULL )
+            {
+                continue;
+            }
+
+            string_buffer_append( buffer, "%s{", name );
+            _render_labels( buffer, slot );
+            string_buffer_append(
+                buffer,
+                "} %lu\n",
+                __atomic_load_n(
+                    k < METRIC_COUNTERS ? &( slot->counters[k] ) : &( slot->gauges[k - METRIC_COUNTERS] ),
+                    __ATOMIC_RELAXED
+                )
+            );
+        }
+    }
+
+    for( k = 0; k < METRIC_HISTOGRAMS; k++ )
+    {
+        name = histogram_families[k].name;
+
+        string_buffer_append( buffer, "# HELP %s %s\n# TYPE %s histogram\n", name, histogram_families[k].help, name );
+
+        for( i = 0; i < METRICS_WORKERS; i++ )
+        {
+            if( ( slot = _live_worker( i ) ) == NULL )
+            {
+                continue;
+            }
+
+            histogram  = &( slot->histograms[k] );
+            cumulative = 0;
+
+            for( j = 0; j < METRICS_BUCKETS; j++ )
+            {
+                cumulative += __atomic_load_n( &( histogram->buckets[j] ), __ATOMIC_RELAXED );
+
+                string_buffer_append( buffer, "%s_bucket{", name );
+                _render_labels( buffer, slot );
+
+                if( j == METRICS_BUCKETS - 1 )
+                {
+                    string_buffer_append( buffer, ",le=\"+Inf\"} %lu\n", cumulative );
+                }
+                else
+                {
+                    string_buffer_append(
+                        buffer,
+                        ",le=\"%.9g\"} %lu\n",
+                        ( double ) ( 1UL << j ) * histogram_families[k].scale,
+                        cumulative
+                    );
+                }
+            }
+
+            string_buffer_append( buffer, "%s_sum{", name );
+            _render_labels( buffer, slot );
+            string_buffer_append(
+                buffer,
+                "} %.9g\n",
+                ( double ) __atomic_load_n( &( histogram->sum ), __ATOMIC_RELAXED ) * histogram_families[k].scale
+            );
+
+            string_buffer_append( buffer, "%s_count{", name );
+            _render_labels( buffer, slot );
+            string_buffer_append( buffer, "} %lu\n", cumulative );
+        }
+    }
+
+    string_buffer_append(
+        buffer,
+        "# HELP pg_ctblmgr_object_applied_lsn Last COMMIT LSN applied to each object, at each location\n"
+        "# TYPE pg_ctblmgr_object_applied_lsn gauge\n"
+    );
+
+    for( i = 0; i < METRICS_OBJECTS; i++ )
+    {
+        object = &( metrics_state->objects[i] );
+
+        if( __atomic_load_n( &( object->owner ), __ATOMIC_ACQUIRE ) <= 0 )
+        {
+            continue;
+        }
+
+        string_buffer_append(
+            buffer,
+            "pg_ctblmgr_object_applied_lsn{object=\"%u\",location=\"%u\"} %lu\n",
+            object->object,
+            object->location,
+            __atomic_load_n( &( object->applied_lsn ), __ATOMIC_RELAXED )
+        );
+    }
+
+    string_buffer_append(
+        buffer,
+        "# HELP pg_ctblmgr_location_commit_latency_seconds Time from COMMIT on the source to COMMIT at each location\n"
+        "# TYPE pg_ctblmgr_location_commit_latency_seconds summary\n"
+    );
+
+    // A location's members share its latency, each of them reporting their own part of it
+    for( i = 0; i < METRICS_WORKERS; i++ )
+    {
+        if( ( slot = _live_worker( i ) ) == NULL || strcmp( slot->role, "member" ) != 0 )
+        {
+            continue;
+        }
+
+        for( j = 0; j < i; j++ )
+        {
+            other = _live_worker( j );
+
+            if(
+                    other != NULL
+                 && strcmp( other->role, "member" ) == 0
+                 && strcmp( other->source, slot->source ) == 0
+                 && other->location == slot->location
+              )
+            {
+                break;
+            }
+        }
+
+        // Already reported with an earlier member
+        if( j < i )
+        {
+            continue;
+        }
+
+        memset( &merged, 0, sizeof( merged ) );
+
+        for( j = i; j < METRICS_WORKERS; j++ )
+        {
+            other = _live_worker( j );
+
+            if(
+                    other != NULL
+                 && strcmp( other->role, "member" ) == 0
+                 && strcmp( other->source, slot->source ) == 0
+                 && other->location == slot->location
+              )
+            {
+                _merge_latency( &merged, &( other->latency ) );
+            }
+        }
+
+        snprintf( labels, sizeof( labels ), "source=\"%s\",location=\"%u\"", slot->source, slot->location );
+        _render_latency( buffer, "pg_ctblmgr_location_commit_latency_seconds", labels, &merged );
+    }
+
+    string_buffer_append(
+        buffer,
+        "# HELP pg_ctblmgr_object_commit_latency_seconds Time from COMMIT on the source to COMMIT of the transactions that changed each object\n"
+        "# TYPE pg_ctblmgr_object_commit_latency_seconds summary\n"
+    );
+
+    for( i = 0; i < METRICS_OBJECTS; i++ )
+    {
+        object = &( metrics_state->objects[i] );
+
+        if( __atomic_load_n( &( object->owner ), __ATOMIC_ACQUIRE ) <= 0 )
+        {
+            continue;
+        }
+
+        snprintf( labels, sizeof( labels ), "object=\"%u\",location=\"%u\"", object->object, object->location );
+        _render_latency( buffer, "pg_ctblmgr_object_commit_latency_seconds", labels, &( object->latency ) );
+    }
+
+    return;
+}
+
+/*
+ * Listens for scrapes on port of the loopback interface, answered from
+ * loop. render appends the caller's own series to each.
+ */
+struct metrics_listener * new_metrics_listener(
+    struct event_loop * loop,
+    unsigned short      port,
+    metrics_callback    render,
+    void *              argument
+)
+{
+    struct metrics_listener * listener = NULL;
+    struct sockaddr_in        address  = {0};
+    int                       reuse    = 1;
+
+    listener = ( struct metrics_listener * ) calloc( 1, sizeof( struct metrics_listener ) );
+
+    if( listener == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate metrics listener"
+        );
+
+        return NULL;
+    }
+
+    listener->loop     = loop;
+    listener->render   = render;
+    listener->argument = argument;
+    listener->socket   = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0 );
+
+    address.sin_family      = AF_INET;
+    address.sin_port        = htons( port );
+    address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+    if(
+            listener->socket < 0
+         || setsockopt( listener->socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof( reuse ) ) != 0
+         || bind( listener->socket, ( struct sockaddr * ) &address, sizeof( address ) ) != 0
+         || listen( listener->socket, METRICS_CLIENTS ) != 0
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to listen for metrics scrapes on port %u: %s",
+            port,
+            strerror( errno )
+        );
+
+        free_metrics_listener( listener );
+        return NULL;
+    }
+
+    if( !add_event( loop, listener->socket, EPOLLIN, _accept_scrape, listener ) )
+    {
+        free_metrics_listener( listener );
+        return NULL;
+    }
+
+    _log(
+        LOG_LEVEL_INFO,
+        "Serving metrics on 127.0.0.1:%u",
+        port
+    );
+
+    return listener;
+}
+
+// Closes listener, and the connections of scrapes yet to be answered
+void free_metrics_listener( struct metrics_listener * listener )
+{
+    unsigned int i = 0;
+
+    if( listener == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < METRICS_CLIENTS; i++ )
+    {
+        if( listener->clients[i] != NULL )
+        {
+            _close_client( listener->clients[i] );
+        }
+    }
+
+    if( listener->socket >= 0 )
+    {
+        remove_event( listener->loop, listener->socket );
+        close( listener->socket );
+    }
+
+    free( listener );
+    return;
+}
+
+static void _forked( void )
+{
+    my_metrics = NULL;
+    return;
+}
+
+// Slot i, if a live process owns it
+static struct worker_metrics * _live_worker( unsigned int i )
+{
+    struct worker_metrics * slot = NULL;
+
+    slot = &( metrics_state->workers[i] );
+    return __atomic_load_n( &( slot->owner ), __ATOMIC_ACQUIRE ) > 0 ? slot : NULL;
+}
+
+// Takes owner over for pid if it is free
+static bool _claim_owner( pid_t * owner, pid_t pid )
+{
+    pid_t current = 0;
+
+    return __atomic_compare_exchange_n( owner, &current, pid, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED );
+}
+
+static void _render_labels( struct string_buffer * buffer, struct worker_metrics * slot )
+{
+    string_buffer_append(
+        buffer,
+        "pid=\"%d\",role=\"%s\",source=\"%s\",location=\"%u\"",
+        ( int ) slot->owner,
+        slot->role,
+        slot->source,
+        slot->location
+    );
+
+    return;
+}
+
+static void _render_latency(
+    struct string_buffer *     buffer,
+    const char *               name,
+    const char *               labels,
+    struct latency_histogram * histogram
+)
+{
+    unsigned int i = 0;
+
+    for( i = 0; i < sizeof( latency_quantiles ) / sizeof( double ); i++ )
+    {
+        string_buffer_append(
+            buffer,
+            "%s{%s,quantile=\"%g\"} %.6f\n",
+            name,
+            labels,
+            latency_quantiles[i],
+            ( double ) latency_percentile( histogram, NULL, latency_quantiles[i] ) / 1000000.0
+        );
+    }
+
+    string_buffer_append(
+        buffer,
+        "%s_sum{%s} %.6f\n%s_count{%s} %lu\n",
+        name,
+        labels,
+        ( double ) __atomic_load_n( &( histogram->sum ), __ATOMIC_RELAXED ) / 1000000.0,
+        name,
+        labels,
+        __atomic_load_n( &( histogram->count ), __ATOMIC_RELAXED )
+    );
+
+    return;
+}
+
+static void _merge_latency( struct latency_histogram * into, struct latency_histogram * from )
+{
+    uint64_t     max = 0;
+    unsigned int i   = 0;
+
+    for( i = 0; i < METRICS_LATENCY_BUCKETS; i++ )
+    {
+        into->counts[i] += __atomic_load_n( &( from->counts[i] ), __ATOMIC_RELAXED );
+    }
+
+    into->count += __atomic_load_n( &( from->count ), __ATOMIC_RELAXED );
+    into->sum   += __atomic_load_n( &( from->sum ), __ATOMIC_RELAXED );
+    max          = __atomic_load_n( &( from->max ), __ATOMIC_RELAXED );
+    into->max    = max > into->max ? max : into->max;
+    return;
+}
+
+/*
+ * The bucket a latency falls in: its own below METRICS_LATENCY_SUB_BUCKETS,
+ * past that the METRICS_LATENCY_BITS bits that follow its leading one pick
+ * the bucket within its power of two.
+ */
+static unsigned int _latency_bucket( uint64_t value )
+{
+    unsigned int exponent = 0;
+    unsigned int bucket   = 0;
+
+    if( value < METRICS_LATENCY_SUB_BUCKETS )
+    {
+        return ( unsigned int ) value;
+    }
+
+    exponent = ( unsigned int ) ( 63 - __builtin_clzll( value ) );
+    bucket   = ( exponent - METRICS_LATENCY_BITS + 1 ) * METRICS_LATENCY_SUB_BUCKETS
+             + ( unsigned int ) ( value >> ( exponent - METRICS_LATENCY_BITS ) ) - METRICS_LATENCY_SUB_BUCKETS;
+
+    return bucket < METRICS_LATENCY_BUCKETS ? bucket : METRICS_LATENCY_BUCKETS - 1;
+}
+
+// The highest latency that falls in bucket
+static uint64_t _latency_bound( unsigned int bucket )
+{
+    unsigned int shift = 0;
+
+    if( bucket < METRICS_LATENCY_SUB_BUCKETS )
+    {
+        return bucket;
+    }
+
+    shift = bucket / METRICS_LATENCY_SUB_BUCKETS - 1;
+
+    return ( ( uint64_t ) ( METRICS_LATENCY_SUB_BUCKETS + bucket % METRICS_LATENCY_SUB_BUCKETS + 1 ) << shift ) - 1;
+}
+
+// Takes every pending connection, as long as there is room for it
+static bool _accept_scrape( struct event_loop * loop, int fd, uint32_t events, void * argument )
+{
+    struct metrics_listener * listener = NULL;
+    struct metrics_client *   client   = NULL;
+    int                       socket   = -1;
+    unsigned int              i        = 0;
+
+    listener = ( struct metrics_listener * ) argument;
+
+    while( ( socket = accept( fd, NULL, NULL ) ) >= 0 )
+    {
+        for( i = 0; i < METRICS_CLIENTS && listener->clients[i] != NULL; i++ );
+
+        client = i < METRICS_CLIENTS
+               ? ( struct metrics_client * ) calloc( 1, sizeof( struct metrics_client ) )
+               : NULL;
+
+        if(
+                client == NULL
+             || fcntl( socket, F_SETFL, fcntl( socket, F_GETFL ) | O_NONBLOCK ) != 0
+             || ( client->response = new_string_buffer() ) == NULL
+          )
+        {
+            free( client );
+            close( socket );
+            continue;
+        }
+
+        client->socket       = socket;
+        client->listener     = listener;
+        listener->clients[i] = client;
+
+        if( !add_event( loop, socket, EPOLLIN, _client_ready, client ) )
+        {
+            _close_client( client );
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Reads the request into response until its headers have all arrived, then
+ * renders the response in its place and writes it out.
+ */
+static bool _client_ready( struct event_loop * loop, int fd, uint32_t events, void * argument )
+{
+    struct metrics_client * client   = NULL;
+    char                    chunk[METRICS_REQUEST_BYTES];
+    ssize_t                 received = 0;
+
+    client = ( struct metrics_client * ) argument;
+
+    if( client->rendered )
+    {
+        if( !_respond( client ) )
+        {
+            _close_client( client );
+        }
+
+        return true;
+    }
+
+    while( ( received = recv( fd, chunk, sizeof( chunk ), 0 ) ) > 0 )
+    {
+        if(
+                client->response->length + ( size_t ) received > METRICS_REQUEST_BYTES
+             || !string_buffer_append_bytes( client->response, chunk, ( size_t ) received )
+          )
+        {
+            _close_client( client );
+            return true;
+        }
+    }
+
+    if( received == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) )
+    {
+        _close_client( client );
+        return true;
+    }
+
+    if( client->response->data == NULL || strstr( client->response->data, "\r\n\r\n" ) == NULL )
+    {
+        return true;
+    }
+
+    if( !_respond( client ) || !modify_event( loop, fd, EPOLLOUT ) )
+    {
+        _close_client( client );
+    }
+
+    return true;
+}
+
+/*
+ * Writes as much of the response as the socket takes, rendering it first if
+ * it has not been. Fails once there is nothing left to write.
+ */
+static bool _respond( struct metrics_client * client )
+{
+    struct string_buffer * body   = NULL;
+    bool                   is_get = false;
+    ssize_t                sent   = 0;
+
+    if( !( client->rendered ) )
+    {
+        is_get = strncmp( client->response->data, "GET ", 4 ) == 0;
+        body   = new_string_buffer();
+
+        if( body == NULL )
+        {
+            return false;
+        }
+
+        if( is_get )
+        {
+            render_metrics( body );
+
+            if( client->listener->render != NULL )
+            {
+                client->listener->render( body, client->listener->argument );
+            }
+        }
+
+        string_buffer_reset( client->response );
+        string_buffer_append(
+            client->response,
+            "HTTP/1.0 %s\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %lu\r\n"
+            "Connection: close\r\n\r\n",
+            is_get ? "200 OK" : "405 Method Not Allowed",
+            ( unsigned long ) body->length
+        );
+
+        string_buffer_append_bytes( client->response, body->data != NULL ? body->data : "", body->length );
+        free_string_buffer( body );
+        client->rendered = true;
+    }
+
+    while( client->sent < client->response->length )
+    {
+        sent = send(
+            client->socket,
+            client->response->data + client->sent,
+            client->response->length - client->sent,
+            MSG_NOSIGNAL
+        );
+
+        if( sent < 0 )
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+
+        client->sent += ( size_t ) sent;
+    }
+
+    return false;
+}
+
+static void _close_client( struct metrics_client * client )
+{
+    unsigned int i = 0;
+
+    for( i = 0; i < METRICS_CLIENTS; i++ )
+    {
+        if( client->listener->clients[i] == client )
+        {
+            client->listener->clients[i] = NULL;
+        }
+    }
+
+    remove_event( client->listener->loop, client->socket );
+    close( client->socket );
+    free_string_buffer( client->response );
+    free( client );
+    return;
+}
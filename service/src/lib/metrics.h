@@ -0,0 +1,162 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "util.h"
+#include "event.h"
+#include "replication.h"
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Processes and objects the shared metrics have room for; past that, they go unreported
+#define METRICS_WORKERS 256
+#define METRICS_OBJECTS 4096
+
+// Longest role and source name a process is reported under
+#define METRICS_ROLE_LENGTH 15
+#define METRICS_NAME_LENGTH 64
+
+/*
+ * Buckets of a histogram: bucket i counts values of at most 2^i, the last
+ * one every value
+ */
+#define METRICS_BUCKETS 24
+
+/*
+ * Latencies are kept HDR-style, in microseconds: exactly below
+ * 2^METRICS_LATENCY_BITS, and past that in METRICS_LATENCY_SUB_BUCKETS
+ * buckets per power of two, so that each is known to within
+ * 1/2^METRICS_LATENCY_BITS of its value whatever its magnitude. The last
+ * bucket ends at 2^38 microseconds, about three days.
+ */
+#define METRICS_LATENCY_BITS 3
+#define METRICS_LATENCY_SUB_BUCKETS ( 1 << METRICS_LATENCY_BITS )
+#define METRICS_LATENCY_BUCKETS ( 36 * METRICS_LATENCY_SUB_BUCKETS )
+
+// Scrapes served at once, and the longest request read of each
+#define METRICS_CLIENTS 16
+#define METRICS_REQUEST_BYTES 4096
+
+// Counters each process keeps, see metrics_count()
+#define METRIC_TRANSACTIONS 0
+#define METRIC_TRANSACTIONS_SKIPPED 1
+#define METRIC_CHANGES 2
+#define METRIC_CONNECTION_RETRIES 3
+#define METRIC_BATCHES 4
+#define METRIC_COUNTERS 5
+
+// Gauges each process keeps, see metrics_gauge()
+#define METRIC_RECEIVED_LSN 0
+#define METRIC_APPLIED_LSN 1
+#define METRIC_BATCH_ROWS 2
+#define METRIC_FLUSH_MS 3
+#define METRIC_GAUGES 4
+
+// Histograms each process keeps, see metrics_observe()
+#define METRIC_BATCH_CHANGES 0
+#define METRIC_APPLY_MICROSECONDS 1
+#define METRIC_HISTOGRAMS 2
+
+extern unsigned short metrics_port;
+
+struct metrics_histogram {
+    uint64_t buckets[METRICS_BUCKETS];
+    uint64_t sum;
+};
+
+// Written by one process only, and read by any
+struct latency_histogram {
+    uint64_t counts[METRICS_LATENCY_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+};
+
+/*
+ * What a process reports. Only its owner writes it, with relaxed atomics,
+ * and the parent reads it whenever it is scraped, so that keeping it costs
+ * the hot path no more than an add. A slot is claimed by swapping owner from
+ * 0, and cleared before it is used; owner is set back to 0 as the process is
+ * reaped, see metrics_exited().
+ */
+struct worker_metrics {
+    pid_t                    owner;
+    unsigned short           status;
+    unsigned int             location;
+    char                     role[METRICS_ROLE_LENGTH + 1];
+    char                     source[METRICS_NAME_LENGTH + 1];
+    uint64_t                 counters[METRIC_COUNTERS];
+    uint64_t                 gauges[METRIC_GAUGES];
+    struct metrics_histogram histograms[METRIC_HISTOGRAMS];
+    struct latency_histogram latency;
+} __attribute__ ((aligned (64)));
+
+/*
+ * How far an object has been applied at a location, and how long after
+ * their COMMIT on the source the transactions that changed it were, as
+ * reported by the member maintaining it
+ */
+struct object_metrics {
+    pid_t                    owner;
+    unsigned int             object;
+    unsigned int             location;
+    uint64_t                 applied_lsn;
+    struct latency_histogram latency;
+};
+
+// Set up by the parent before it forks anything but the log writer
+struct metrics_state {
+    struct worker_metrics workers[METRICS_WORKERS];
+    struct object_metrics objects[METRICS_OBJECTS];
+};
+
+// Appends the parent's own series to a scrape
+typedef void ( * metrics_callback )( struct string_buffer *, void * );
+
+/*
+ * A scrape being answered. The response is rendered once the request has
+ * been read, and written as the socket takes it.
+ */
+struct metrics_client {
+    int                       socket;
+    struct string_buffer *    response;
+    size_t                    sent;
+    bool                      rendered;
+    struct metrics_listener * listener;
+};
+
+/*
+ * An HTTP listener on the loopback interface, served from the parent's
+ * event loop. Every request is answered with the metrics, in Prometheus'
+ * text format, and the connection closed.
+ */
+struct metrics_listener {
+    struct event_loop *     loop;
+    int                     socket;
+    metrics_callback        render;
+    void *                  argument;
+    struct metrics_client * clients[METRICS_CLIENTS];
+};
+
+extern bool start_metrics( void );
+extern void claim_metrics( const char *, const char *, unsigned int );
+extern struct object_metrics * claim_object_metrics( unsigned int, unsigned int );
+extern void metrics_exited( pid_t );
+extern void set_worker_status( struct worker *, unsigned short );
+extern void metrics_count( unsigned int, uint64_t );
+extern void metrics_gauge( unsigned int, uint64_t );
+extern void metrics_observe( unsigned int, uint64_t );
+extern void metrics_object_applied( struct object_metrics *, uint64_t );
+extern void metrics_commit_latency( uint64_t );
+extern void metrics_object_latency( struct object_metrics *, uint64_t );
+extern uint64_t latency_since_commit( int64_t );
+extern void record_latency( struct latency_histogram *, uint64_t );
+extern uint64_t latency_percentile( struct latency_histogram *, struct latency_histogram *, double );
+extern void render_metrics( struct string_buffer * );
+extern struct metrics_listener * new_metrics_listener( struct event_loop *, unsigned short, metrics_callback, void * );
+extern void free_metrics_listener( struct metrics_listener * );
+
+#endif // METRICS_H
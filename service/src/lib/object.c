@@ -0,0 +1,554 @@
+#include "object.h"
+#include "statement_cache.h"
+#include "ivm.h"
+#include "driver.h"
+
+static const char * extension_schema_query = "\
+    SELECT n.nspname \
+      FROM pg_catalog.pg_extension e \
+      JOIN pg_catalog.pg_namespace n \
+        ON n.oid = e.extnamespace \
+     WHERE e.extname = 'pg_ctblmgr'";
+
+static const char * object_query = "\
+    SELECT o.maintenance_object, \
+           o.maintenance_group, \
+           o.definition, \
+           o.namespace, \
+           o.name, \
+           o.driver, \
+           o.location, \
+           CEIL( EXTRACT( EPOCH FROM COALESCE( o.freshness_target, g.freshness_target ) ) * 1000 ) \
+      FROM %s.maintenance_object o \
+ LEFT JOIN %s.maintenance_group g \
+        ON g.maintenance_group = o.maintenance_group \
+  ORDER BY o.maintenance_object";
+
+static const char * describe_query = "\
+    SELECT a.attname, \
+           pg_catalog.format_type( a.atttypid, a.atttypmod ), \
+           COALESCE( a.attnum = ANY( i.indkey ), FALSE ), \
+           a.atttypid \
+      FROM pg_catalog.pg_attribute a \
+ LEFT JOIN pg_catalog.pg_index i \
+        ON i.indrelid = a.attrelid \
+       AND i.indisprimary \
+     WHERE a.attrelid = ( pg_catalog.quote_ident( $1 ) || '.' || pg_catalog.quote_ident( $2 ) )::REGCLASS \
+       AND a.attnum > 0 \
+       AND NOT a.attisdropped \
+  ORDER BY a.attnum";
+
+// Types of the columns a definition returns, given PQftype() and PQfmod()
+static const char * describe_types_query = "\
+    SELECT pg_catalog.format_type( t.oid, t.mod ) \
+      FROM pg_catalog.unnest( $1::OID[], $2::INTEGER[] ) WITH ORDINALITY AS t( oid, mod, n ) \
+  ORDER BY t.n";
+
+static char * extension_schema = NULL;
+
+static PGresult * _describe_definition( struct worker *, struct maintenance_object *, PGresult ** );
+static void _free_object_layout( struct maintenance_object * );
+
+/*
+ * Reads the maintenance_object catalog from the database me is connected to.
+ */
+bool load_maintenance_objects(
+    struct worker *               me,
+    struct maintenance_object *** objects,
+    unsigned int *                num_objects
+)
+{
+    PGresult *                  result = NULL;
+    struct maintenance_object * object = NULL;
+    struct string_buffer *      query  = NULL;
+    char *                      schema = NULL;
+    int                         i      = 0;
+
+    if( me == NULL || objects == NULL || num_objects == NULL )
+    {
+        return false;
+    }
+
+    *objects     = NULL;
+    *num_objects = 0;
+
+    schema = get_extension_schema( me );
+    query  = new_string_buffer();
+
+    if( schema == NULL || query == NULL )
+    {
+        free_string_buffer( query );
+        return false;
+    }
+
+    string_buffer_append( query, object_query, schema, schema );
+
+    result = _execute_query( me, query->data, NULL, 0 );
+    free_string_buffer( query );
+
+    if( result == NULL )
+    {
+        return false;
+    }
+
+    *objects = ( struct maintenance_object ** ) calloc(
+        PQntuples( result ) + 1,
+        sizeof( struct maintenance_object * )
+    );
+
+    if( *objects == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for maintenance objects"
+        );
+
+        PQclear( result );
+        return false;
+    }
+
+    for( i = 0; i < PQntuples( result ); i++ )
+    {
+        object = ( struct maintenance_object * ) calloc(
+            1,
+            sizeof( struct maintenance_object )
+        );
+
+        if( object == NULL )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to allocate memory for maintenance object"
+            );
+
+            PQclear( result );
+            return false;
+        }
+
+        object->maintenance_object = ( unsigned int ) strtoul( PQgetvalue( result, i, 0 ), NULL, 10 );
+        object->maintenance_group  = ( unsigned int ) strtoul( PQgetvalue( result, i, 1 ), NULL, 10 );
+        object->definition         = strdup( PQgetvalue( result, i, 2 ) );
+        object->namespace          = strdup( PQgetvalue( result, i, 3 ) );
+        object->name               = strdup( PQgetvalue( result, i, 4 ) );
+        object->driver             = ( unsigned int ) strtoul( PQgetvalue( result, i, 5 ), NULL, 10 );
+        object->location           = ( unsigned int ) strtoul( PQgetvalue( result, i, 6 ), NULL, 10 );
+        object->freshness_ms       = strtoull( PQgetvalue( result, i, 7 ), NULL, 10 );
+
+        ( *objects )[i] = object;
+        ( *num_objects )++;
+    }
+
+    PQclear( result );
+    return true;
+}
+
+/*
+ * Returns the quoted name of the schema the extension's tables live in. The
+ * extension is relocatable, so this is looked up once and then remembered.
+ */
+char * get_extension_schema( struct worker * me )
+{
+    PGresult * result = NULL;
+
+    if( extension_schema != NULL )
+    {
+        return extension_schema;
+    }
+
+    result = _execute_query( me, ( char * ) extension_schema_query, NULL, 0 );
+
+    if( result == NULL )
+    {
+        return NULL;
+    }
+
+    if( PQntuples( result ) != 1 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Extension pg_ctblmgr is not installed in this database"
+        );
+
+        PQclear( result );
+        return NULL;
+    }
+
+    extension_schema = quote_identifier( me, PQgetvalue( result, 0, 0 ) );
+    PQclear( result );
+    return extension_schema;
+}
+
+/*
+ * Reads the columns, types and primary key of object's table on the target me
+ * is connected to. This needs to be redone whenever the target's schema
+ * changes. Targets of drivers other than postgresql have no table to read,
+ * so they take the columns the definition returns, without a key.
+ */
+bool describe_maintenance_object(
+    struct worker *             me,
+    struct maintenance_object * object
+)
+{
+    PGresult *             result         = NULL;
+    PGresult *             output         = NULL;
+    struct string_buffer * qualified_name = NULL;
+    char *                 schema         = NULL;
+    char *                 name           = NULL;
+    char *                 params[2]      = { NULL };
+    unsigned int           i              = 0;
+    unsigned int           num_rows       = 0;
+
+    if( me == NULL || object == NULL )
+    {
+        return false;
+    }
+
+    // Statements built against the previous layout are no longer valid
+    invalidate_object_statements( me, object->maintenance_object );
+
+    if( object->driver == DRIVER_POSTGRESQL )
+    {
+        params[0] = object->namespace;
+        params[1] = object->name;
+
+        result = _execute_query( me, ( char * ) describe_query, params, 2 );
+    }
+    else
+    {
+        result = _describe_definition( me, object, &output );
+    }
+
+    if( result == NULL )
+    {
+        return false;
+    }
+
+    num_rows = ( unsigned int ) PQntuples( result );
+
+    _free_object_layout( object );
+
+    object->columns          = ( char ** ) calloc( num_rows + 1, sizeof( char * ) );
+    object->quoted_columns   = ( char ** ) calloc( num_rows + 1, sizeof( char * ) );
+    object->column_types     = ( char ** ) calloc( num_rows + 1, sizeof( char * ) );
+    object->column_type_oids = ( Oid * ) calloc( num_rows + 1, sizeof( Oid ) );
+    object->is_key           = ( bool * ) calloc( num_rows + 1, sizeof( bool ) );
+    qualified_name           = new_string_buffer();
+    schema                   = quote_identifier( me, object->namespace );
+    name                     = quote_identifier( me, object->name );
+
+    if(
+            object->columns == NULL
+         || object->quoted_columns == NULL
+         || object->column_types == NULL
+         || object->column_type_oids == NULL
+         || object->is_key == NULL
+         || qualified_name == NULL
+         || schema == NULL
+         || name == NULL
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for layout of %s.%s",
+            object->namespace,
+            object->name
+        );
+
+        _free_object_layout( object );
+        free_string_buffer( qualified_name );
+        free( schema );
+        free( name );
+        PQclear( result );
+        PQclear( output );
+        return false;
+    }
+
+    string_buffer_append( qualified_name, "%s.%s", schema, name );
+    object->qualified_name = strdup( qualified_name->data );
+    free_string_buffer( qualified_name );
+    free( schema );
+    free( name );
+
+    for( i = 0; i < num_rows; i++ )
+    {
+        if( output != NULL )
+        {
+            object->columns[i]          = strdup( PQfname( output, ( int ) i ) );
+            object->quoted_columns[i]   = quote_identifier( me, object->columns[i] );
+            object->column_types[i]     = strdup( PQgetvalue( result, i, 0 ) );
+            object->column_type_oids[i] = PQftype( output, ( int ) i );
+            object->num_columns++;
+            continue;
+        }
+
+        object->columns[i]        = strdup( PQgetvalue( result, i, 0 ) );
+        object->quoted_columns[i] = quote_identifier( me, object->columns[i] );
+        object->column_types[i]   = strdup( PQgetvalue( result, i, 1 ) );
+        object->is_key[i]         = strcmp( PQgetvalue( result, i, 2 ), "t" ) == 0;
+
+        object->column_type_oids[i] = ( Oid ) strtoul( PQgetvalue( result, i, 3 ), NULL, 10 );
+
+        if( object->is_key[i] )
+        {
+            object->num_key_columns++;
+        }
+
+        object->num_columns++;
+    }
+
+    PQclear( result );
+
+    if( output != NULL )
+    {
+        PQclear( output );
+        return true;
+    }
+
+    if( object->num_key_columns == 0 )
+    {
+        _log(
+            LOG_LEVEL_WARNING,
+            "%s.%s has no primary key on the target, changes cannot be applied",
+            object->namespace,
+            object->name
+        );
+
+        return false;
+    }
+
+    // The staging table mirrors this layout and needs to be rebuilt
+    object->stage_connection = 0;
+    return true;
+}
+
+/*
+ * Called after a statement against object's target failed. When the
+ * failure was because the layout the statement was built against has
+ * changed, see _is_schema_sql_state(), and left me outside a transaction,
+ * the layout is read again, which drops the statements built from it, and
+ * the object planned again if it was. The caller may then retry, once.
+ */
+bool redescribe_after_failure( struct worker * me, struct maintenance_object * object )
+{
+    bool planned = false;
+
+    if(
+            me == NULL
+         || object == NULL
+         || me->tx_in_progress
+         || !_is_schema_sql_state( me->sql_state )
+      )
+    {
+        return false;
+    }
+
+    _log(
+        LOG_LEVEL_WARNING,
+        "%s changed under its statements (SQL state %s), describing it again",
+        object->qualified_name,
+        me->sql_state
+    );
+
+    me->sql_state[0] = '\0';
+    planned          = object->ivm != NULL;
+
+    if( !describe_maintenance_object( me, object ) )
+    {
+        return false;
+    }
+
+    if( planned && object->ivm == NULL )
+    {
+        // A remote object's definition reads the source, see struct worker
+        object->ivm = plan_maintenance( me->source != NULL ? me->source : me, object );
+    }
+
+    return !planned || object->ivm != NULL;
+}
+
+/*
+ * Returns a copy of object's maintenance_object row, without its layout or
+ * any of the state of its maintenance.
+ */
+struct maintenance_object * copy_maintenance_object( struct maintenance_object * object )
+{
+    struct maintenance_object * copy = NULL;
+
+    if( object == NULL )
+    {
+        return NULL;
+    }
+
+    copy = ( struct maintenance_object * ) calloc( 1, sizeof( struct maintenance_object ) );
+
+    if( copy == NULL )
+    {
+        return NULL;
+    }
+
+    copy->maintenance_object = object->maintenance_object;
+    copy->maintenance_group  = object->maintenance_group;
+    copy->driver             = object->driver;
+    copy->location           = object->location;
+    copy->freshness_ms       = object->freshness_ms;
+    copy->remote             = object->remote;
+    copy->definition         = strdup( object->definition );
+    copy->namespace          = strdup( object->namespace );
+    copy->name               = strdup( object->name );
+
+    if( copy->definition == NULL || copy->namespace == NULL || copy->name == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for copy of %s.%s",
+            object->namespace,
+            object->name
+        );
+
+        free_maintenance_object( copy );
+        return NULL;
+    }
+
+    return copy;
+}
+
+void free_maintenance_object( struct maintenance_object * object )
+{
+    if( object == NULL )
+    {
+        return;
+    }
+
+    _free_object_layout( object );
+    close_target( object );
+    free( object->definition );
+    free( object->namespace );
+    free( object->name );
+    free( object );
+    return;
+}
+
+// Returns a malloc()'d, quoted copy of identifier
+char * quote_identifier( struct worker * me, char * identifier )
+{
+    char * escaped = NULL;
+    char * result  = NULL;
+
+    if( me == NULL || identifier == NULL || !db_connect( me ) )
+    {
+        return NULL;
+    }
+
+    escaped = PQescapeIdentifier( me->conn, identifier, strlen( identifier ) );
+
+    if( escaped == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to quote identifier '%s': %s",
+            identifier,
+            PQerrorMessage( me->conn )
+        );
+
+        return NULL;
+    }
+
+    result = strdup( escaped );
+    PQfreemem( escaped );
+    return result;
+}
+
+/*
+ * Runs object's definition for its row description alone, left in output,
+ * and returns the names of its columns' types, one row per column.
+ */
+static PGresult * _describe_definition(
+    struct worker *             me,
+    struct maintenance_object * object,
+    PGresult **                 output
+)
+{
+    PGresult *             result    = NULL;
+    struct string_buffer * query     = NULL;
+    struct string_buffer * oids      = NULL;
+    struct string_buffer * mods      = NULL;
+    char *                 params[2] = { NULL };
+    int                    i         = 0;
+
+    query = new_string_buffer();
+    oids  = new_string_buffer();
+    mods  = new_string_buffer();
+
+    if( query == NULL || oids == NULL || mods == NULL )
+    {
+        goto cleanup;
+    }
+
+    string_buffer_append( query, "SELECT * FROM ( %s ) q LIMIT 0", object->definition );
+    *output = _execute_query( me, query->data, NULL, 0 );
+
+    if( *output == NULL )
+    {
+        goto cleanup;
+    }
+
+    string_buffer_append( oids, "{" );
+    string_buffer_append( mods, "{" );
+
+    for( i = 0; i < PQnfields( *output ); i++ )
+    {
+        string_buffer_append( oids, "%s%u", i > 0 ? "," : "", PQftype( *output, i ) );
+        string_buffer_append( mods, "%s%d", i > 0 ? "," : "", PQfmod( *output, i ) );
+    }
+
+    string_buffer_append( oids, "}" );
+    string_buffer_append( mods, "}" );
+
+    params[0] = oids->data;
+    params[1] = mods->data;
+
+    result = _execute_query( me, ( char * ) describe_types_query, params, 2 );
+
+    if( result == NULL )
+    {
+        PQclear( *output );
+        *output = NULL;
+    }
+
+cleanup:
+    free_string_buffer( query );
+    free_string_buffer( oids );
+    free_string_buffer( mods );
+    return result;
+}
+
+static void _free_object_layout( struct maintenance_object * object )
+{
+    unsigned int i = 0;
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        free( object->columns[i] );
+        free( object->quoted_columns[i] );
+        free( object->column_types[i] );
+    }
+
+    free( object->qualified_name );
+    free( object->columns );
+    free( object->quoted_columns );
+    free( object->column_types );
+    free( object->column_type_oids );
+    free( object->is_key );
+    free_ivm_plan( ( struct ivm_plan * ) object->ivm );
+
+    object->qualified_name   = NULL;
+    object->columns          = NULL;
+    object->quoted_columns   = NULL;
+    object->column_types     = NULL;
+    object->column_type_oids = NULL;
+    object->is_key           = NULL;
+    object->ivm              = NULL;
+    object->num_columns      = 0;
+    object->num_key_columns  = 0;
+    return;
+}
@@ -0,0 +1,69 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include "util.h"
+#include "query.h"
+#include <stdint.h>
+
+// Rows of tb_driver
+#define DRIVER_POSTGRESQL 1
+#define DRIVER_MEMCACHED 2
+
+/*
+ * A row of maintenance_object, plus the layout of the table it is maintained
+ * into, which is filled in by describe_maintenance_object() against the
+ * target. shadow is the struct shadow_refresh of a rebuild in progress, and
+ * ivm the struct ivm_plan the object is maintained by, which is derived from
+ * that layout. target is the handle target_driver (a struct target_driver)
+ * opened for the object in process target_pid, see open_target(), and
+ * stage_connection the connection_id of the worker connection its staging
+ * table was made on, 0 while it needs making, see _prepare_stage(). For
+ * drivers other than postgresql the layout is that of the definition's rows.
+ * applied_lsn is the COMMIT up to which the target at location is known to
+ * be current, see read_object_progress(). freshness_ms is how far behind
+ * the source it may be applied, its own freshness_target or else its
+ * group's, 0 if neither has one. A remote object's target is a postgresql
+ * table in a database other than the source, so its definition cannot be
+ * evaluated where it is written: its rows are evaluated against the source
+ * and written to it, as for other drivers, see evaluate_changes().
+ */
+struct maintenance_object {
+    unsigned int maintenance_object;
+    unsigned int maintenance_group;
+    char *       definition;
+    char *       namespace;
+    char *       name;
+    unsigned int driver;
+    unsigned int location;
+    uint64_t     freshness_ms;
+    char *       qualified_name;
+    unsigned int num_columns;
+    char **      columns;
+    char **      quoted_columns;
+    char **      column_types;
+    Oid *        column_type_oids;
+    bool *       is_key;
+    unsigned int num_key_columns;
+    uint64_t     stage_connection;
+    void *       shadow;
+    void *       ivm;
+    void *       target;
+    void *       target_driver;
+    pid_t        target_pid;
+    uint64_t     applied_lsn;
+    bool         remote;
+};
+
+extern bool load_maintenance_objects(
+    struct worker *,
+    struct maintenance_object ***,
+    unsigned int *
+);
+extern bool describe_maintenance_object( struct worker *, struct maintenance_object * );
+extern bool redescribe_after_failure( struct worker *, struct maintenance_object * );
+extern struct maintenance_object * copy_maintenance_object( struct maintenance_object * );
+extern void free_maintenance_object( struct maintenance_object * );
+extern char * quote_identifier( struct worker *, char * );
+extern char * get_extension_schema( struct worker * );
+
+#endif // OBJECT_H
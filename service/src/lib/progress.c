@@ -0,0 +1,162 @@
+#include "progress.h"
+
+static const char * progress_query = "\
+    SELECT lsn \
+      FROM %s.maintenance_progress \
+     WHERE maintenance_object = $1::INTEGER \
+       AND location = $2::INTEGER";
+
+static const char * progress_upsert = "\
+    INSERT INTO %s.maintenance_progress \
+                ( \
+                    maintenance_object, \
+                    location, \
+                    lsn \
+                ) \
+         VALUES ( $1::INTEGER, $2::INTEGER, $3::PG_LSN ) \
+    ON CONFLICT ( maintenance_object, location ) \
+      DO UPDATE SET lsn = EXCLUDED.lsn";
+
+/*
+ * Reads the LSN of the last COMMIT object's target at its location is known
+ * to include into object->applied_lsn, through me, which must be connected
+ * to the database the target is kept in. Leaves it at 0 if nothing has been
+ * recorded yet.
+ */
+bool read_object_progress( struct worker * me, struct maintenance_object * object )
+{
+    struct string_buffer * query         = NULL;
+    PGresult *             result        = NULL;
+    char *                 schema        = NULL;
+    char *                 params[2]     = { NULL };
+    char                   object_id[16] = {0};
+    char                   location[16]  = {0};
+    bool                   success       = true;
+
+    if( me == NULL || object == NULL )
+    {
+        return false;
+    }
+
+    schema = get_extension_schema( me );
+    query  = new_string_buffer();
+
+    if( schema == NULL || query == NULL )
+    {
+        free_string_buffer( query );
+        return false;
+    }
+
+    snprintf( object_id, sizeof( object_id ), "%u", object->maintenance_object );
+    snprintf( location, sizeof( location ), "%u", object->location );
+    params[0] = object_id;
+    params[1] = location;
+
+    string_buffer_append( query, progress_query, schema );
+    result = _execute_query( me, query->data, params, 2 );
+    free_string_buffer( query );
+
+    if( result == NULL )
+    {
+        return false;
+    }
+
+    object->applied_lsn = 0;
+
+    if( PQntuples( result ) > 0 )
+    {
+        success = parse_lsn( PQgetvalue( result, 0, 0 ), &( object->applied_lsn ) );
+    }
+
+    PQclear( result );
+    return success;
+}
+
+/*
+ * The upsert of a row of maintenance_progress, taking the object, location
+ * and LSN as text. It is shared by every object, so that recording progress
+ * costs no more than one more statement in the transaction that applied it.
+ */
+struct prepared_statement * get_progress_statement( struct worker * me )
+{
+    struct prepared_statement * statement = NULL;
+    struct string_buffer *      query     = NULL;
+    char *                      schema    = NULL;
+
+    schema = get_extension_schema( me );
+    query  = new_string_buffer();
+
+    if( schema == NULL || query == NULL )
+    {
+        free_string_buffer( query );
+        return NULL;
+    }
+
+    string_buffer_append( query, progress_upsert, schema );
+
+    statement = get_prepared_statement(
+        me,
+        0,
+        PROGRESS_STATEMENT_UPSERT,
+        "progress",
+        query->data,
+        PROGRESS_STATEMENT_PARAMS,
+        NULL
+    );
+
+    free_string_buffer( query );
+    return statement;
+}
+
+/*
+ * Records that object's target includes everything up to the COMMIT at lsn.
+ * To be exact this has to run in the transaction that applied the changes,
+ * which is up to the caller; outside of one, a crash between the two means
+ * the changes are applied again after a restart. object->applied_lsn is
+ * left for the caller to advance once that transaction has committed.
+ */
+bool write_object_progress( struct worker * me, struct maintenance_object * object, uint64_t lsn )
+{
+    struct prepared_statement * statement     = NULL;
+    PGresult *                  result        = NULL;
+    char *                      params[3]     = { NULL };
+    char                        object_id[16] = {0};
+    char                        location[16]  = {0};
+    char                        position[32]  = {0};
+
+    if( me == NULL || object == NULL )
+    {
+        return false;
+    }
+
+    statement = get_progress_statement( me );
+
+    if( statement == NULL )
+    {
+        return false;
+    }
+
+    snprintf( object_id, sizeof( object_id ), "%u", object->maintenance_object );
+    snprintf( location, sizeof( location ), "%u", object->location );
+    snprintf( position, sizeof( position ), LSN_FORMAT, LSN_FORMAT_ARGS( lsn ) );
+    params[0] = object_id;
+    params[1] = location;
+    params[2] = position;
+
+    result = _execute_prepared( me, statement, params, NULL, NULL );
+
+    if( result == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to record progress of %s at location %u",
+            object->qualified_name,
+            object->location
+        );
+
+        return false;
+    }
+
+    PQclear( result );
+    return true;
+}
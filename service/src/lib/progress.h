@@ -0,0 +1,21 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include "util.h"
+#include "query.h"
+#include "object.h"
+#include "statement_cache.h"
+#include "replication.h"
+#include <stdint.h>
+
+// Operation of the progress upsert in the statement cache, clear of those of accumulator.h
+#define PROGRESS_STATEMENT_UPSERT 27
+
+// Number of parameters the progress upsert takes: object, location and LSN
+#define PROGRESS_STATEMENT_PARAMS 3
+
+extern bool read_object_progress( struct worker *, struct maintenance_object * );
+extern struct prepared_statement * get_progress_statement( struct worker * );
+extern bool write_object_progress( struct worker *, struct maintenance_object *, uint64_t );
+
+#endif // PROGRESS_H
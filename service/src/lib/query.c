@@ -1,12 +1,26 @@
 #include "query.h"
 
+// Numbers each connection db_connect() makes, see struct worker
+static uint64_t connections_made = 0;
+
+// Keeps the SQL state result failed with, if any, in me
+static void _save_sql_state( struct worker * me, PGresult * result )
+{
+    char * sql_state = NULL;
+
+    sql_state = result != NULL ? PQresultErrorField( result, PG_DIAG_SQLSTATE ) : NULL;
+
+    snprintf( me->sql_state, sizeof( me->sql_state ), "%s", sql_state != NULL ? sql_state : "" );
+    return;
+}
+
 PGresult * _execute_query( struct worker * me, char * query, char ** params, unsigned int param_count )
 {
     PGresult *   result              = NULL;
     char *       last_sql_state      = NULL;
     char *       temp_last_sql_state = NULL;
     unsigned int retry_counter       = 0;
-    unsigned int last_backoff_time   = 1;
+    unsigned int last_backoff_time   = 0;
 
     if( me == NULL )
     {
@@ -24,64 +38,16 @@ PGresult * _execute_query( struct worker * me, char * query, char ** params, uns
         }
     }
 
-    while(
-            PQstatus( me->conn ) != CONNECTION_OK &&
-            retry_counter < MAX_CONN_RETRIES
-         )
+    if( PQstatus( me->conn ) != CONNECTION_OK && !db_connect( me ) )
     {
-        if( me->tx_in_progress )
-        {
-            me->tx_in_progress = false;
-        }
-
-        _log(
-            LOG_LEVEL_WARNING,
-            "Failed to connect to DB server (%s). Retrying...",
-            PQerrorMessage( me->conn )
-        );
-
-        retry_counter++;
-
-        last_backoff_time = (int) ( 10 * ( ( double ) rand() / ( double ) RAND_MAX ) )
-                          + last_backoff_time;
-
-        if( me->conn != NULL )
-        {
-            PQfinish( me->conn );
-            me->conn = NULL;
-        }
-
-        sleep( last_backoff_time );
-        db_connect( me );
+        _log( LOG_LEVEL_ERROR, "Failed to connect to database" );
+        return NULL;
     }
 
     while(
             (
                 last_sql_state == NULL
-             || strcmp(
-                    last_sql_state,
-                    SQL_STATE_TERMINATED_BY_ADMINISTRATOR
-                ) == 0
-             || strcmp(
-                    last_sql_state,
-                    SQL_STATE_CANCELED_BY_ADMINISTRATOR
-                ) == 0
-             || strcmp(
-                    last_sql_state,
-                    SQL_STATE_CONNECTION_FAILURE
-                ) == 0
-             || strcmp(
-                    last_sql_state,
-                    SQL_STATE_SQLCLIENT_UNABLE_TO_ESTABLISH_SQLCONNECTION
-                ) == 0
-             || strcmp(
-                    last_sql_state,
-                    SQL_STATE_CONNECTION_DOES_NOT_EXIST
-                ) == 0
-             || strcmp(
-                    last_sql_state,
-                    SQL_STATE_CONNECTION_EXCEPTION
-                ) == 0
+             || _is_retryable_sql_state( last_sql_state )
             )
          && retry_counter < MAX_CONN_RETRIES
         )
@@ -94,10 +60,11 @@ PGresult * _execute_query( struct worker * me, char * query, char ** params, uns
                 me->tx_in_progress = false;
             }
 
+            PQfinish( me->conn );
             me->conn = NULL;
             db_connect( me );
 
-            last_backoff_time = 1;
+            last_backoff_time = 0;
             return NULL;
         }
 
@@ -134,6 +101,8 @@ PGresult * _execute_query( struct worker * me, char * query, char ** params, uns
                 PQerrorMessage( me->conn )
             );
 
+            _save_sql_state( me, result );
+
             temp_last_sql_state = PQresultErrorField(
                 result,
                 PG_DIAG_SQLSTATE
@@ -166,9 +135,7 @@ PGresult * _execute_query( struct worker * me, char * query, char ** params, uns
             }
 
             retry_counter++;
-            sleep( last_backoff_time );
-            last_backoff_time = (int) ( 10 * ( ( double ) rand() / ( double ) RAND_MAX ) )
-                              + last_backoff_time;
+            connection_backoff( &last_backoff_time );
         }
         else
         {
@@ -185,51 +152,734 @@ PGresult * _execute_query( struct worker * me, char * query, char ** params, uns
     return NULL;
 }
 
-bool db_connect( struct worker * me )
+/*
+ * Streams length bytes of data to the server through the COPY ... FROM STDIN
+ * statement in query. As COPY is normally issued within an apply transaction,
+ * failures are not retried here; the caller is expected to roll back.
+ */
+bool _copy_in( struct worker * me, char * query, char * data, size_t length )
 {
-    unsigned short retry_counter     = 0;
-    unsigned int   last_backoff_time = 0;
+    PGresult * result  = NULL;
+    bool       success = true;
 
-    if( me->conn != NULL )
+    if( me == NULL || query == NULL )
+    {
+        return false;
+    }
+
+    if( !db_connect( me ) )
+    {
+        return false;
+    }
+
+    result = PQexec( me->conn, query );
+
+    if( PQresultStatus( result ) != PGRES_COPY_IN )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Query '%s' failed: %s",
+            query,
+            PQerrorMessage( me->conn )
+        );
+
+        _save_sql_state( me, result );
+        PQclear( result );
+        return false;
+    }
+
+    PQclear( result );
+
+    if( length > 0 && PQputCopyData( me->conn, data, ( int ) length ) != 1 )
     {
-        if( PQstatus( me->conn ) != CONNECTION_OK )
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to send COPY data: %s",
+            PQerrorMessage( me->conn )
+        );
+
+        PQputCopyEnd( me->conn, "pg_ctblmgr failed to send COPY data" );
+        success = false;
+    }
+    else if( PQputCopyEnd( me->conn, NULL ) != 1 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to end COPY: %s",
+            PQerrorMessage( me->conn )
+        );
+
+        success = false;
+    }
+
+    while( ( result = PQgetResult( me->conn ) ) != NULL )
+    {
+        if( PQresultStatus( result ) != PGRES_COMMAND_OK )
         {
-            me->conn = NULL;
-            me->tx_in_progress = false;
+            if( success )
+            {
+                _log(
+                    LOG_LEVEL_ERROR,
+                    "COPY failed: %s",
+                    PQerrorMessage( me->conn )
+                );
+
+                _save_sql_state( me, result );
+            }
+
+            success = false;
         }
-        else
+
+        PQclear( result );
+    }
+
+    return success;
+}
+
+/*
+ * Pipes the output of the COPY ... TO STDOUT statement copy_out, run on
+ * source, into the COPY ... FROM STDIN statement copy_in on me's connection,
+ * a buffer at a time. Like _copy_in(), failures are left to the caller.
+ */
+bool _copy_stream(
+    PGconn *        source,
+    char *          copy_out,
+    struct worker * me,
+    char *          copy_in,
+    unsigned long * bytes
+)
+{
+    PGresult * result  = NULL;
+    char *     buffer  = NULL;
+    int        length  = 0;
+    bool       success = true;
+
+    if( source == NULL || copy_out == NULL || me == NULL || copy_in == NULL )
+    {
+        return false;
+    }
+
+    if( !db_connect( me ) )
+    {
+        return false;
+    }
+
+    result = PQexec( me->conn, copy_in );
+
+    if( PQresultStatus( result ) != PGRES_COPY_IN )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Query '%s' failed: %s",
+            copy_in,
+            PQerrorMessage( me->conn )
+        );
+
+        PQclear( result );
+        return false;
+    }
+
+    PQclear( result );
+    result = PQexec( source, copy_out );
+
+    if( PQresultStatus( result ) != PGRES_COPY_OUT )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Query '%s' failed: %s",
+            copy_out,
+            PQerrorMessage( source )
+        );
+
+        PQclear( result );
+        PQputCopyEnd( me->conn, "pg_ctblmgr failed to read COPY data" );
+
+        while( ( result = PQgetResult( me->conn ) ) != NULL )
         {
-            return true;
+            PQclear( result );
         }
+
+        return false;
     }
-    else
+
+    PQclear( result );
+
+    while( ( length = PQgetCopyData( source, &buffer, 0 ) ) > 0 )
     {
-        me->tx_in_progress = false;
+        if( success && PQputCopyData( me->conn, buffer, length ) != 1 )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to send COPY data: %s",
+                PQerrorMessage( me->conn )
+            );
+
+            success = false;
+        }
+
+        if( bytes != NULL )
+        {
+            *bytes += ( unsigned long ) length;
+        }
+
+        PQfreemem( buffer );
     }
 
-    me->conn = PQconnectdb( conninfo );
+    if( length == -2 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to read COPY data: %s",
+            PQerrorMessage( source )
+        );
 
-    while(
-              me->conn != NULL
-           && PQstatus( me->conn ) != CONNECTION_OK
-           && retry_counter < MAX_CONN_RETRIES
-         )
+        success = false;
+    }
+
+    while( ( result = PQgetResult( source ) ) != NULL )
     {
-        sleep( last_backoff_time );
-        last_backoff_time = (unsigned int) ( 10 * ( ( double ) rand() / ( double ) RAND_MAX ) )
-                          + last_backoff_time;
+        if( PQresultStatus( result ) != PGRES_COMMAND_OK && success )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "'%s' failed: %s",
+                copy_out,
+                PQerrorMessage( source )
+            );
+
+            success = false;
+        }
+
+        PQclear( result );
+    }
+
+    if( PQputCopyEnd( me->conn, success ? NULL : "pg_ctblmgr failed to copy data" ) != 1 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to end COPY: %s",
+            PQerrorMessage( me->conn )
+        );
+
+        success = false;
+    }
+
+    while( ( result = PQgetResult( me->conn ) ) != NULL )
+    {
+        if( PQresultStatus( result ) != PGRES_COMMAND_OK && success )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "COPY failed: %s",
+                PQerrorMessage( me->conn )
+            );
+
+            success = false;
+        }
+
+        PQclear( result );
+    }
+
+    return success;
+}
+
+/*
+ * Executes a statement from the worker's statement cache. If the connection
+ * fails it is reestablished, and the statement prepared again on it, up to
+ * MAX_CONN_RETRIES times.
+ */
+PGresult * _execute_prepared(
+    struct worker *             me,
+    struct prepared_statement * statement,
+    char **                     params,
+    int *                       param_lengths,
+    int *                       param_formats
+)
+{
+    PGresult *   result            = NULL;
+    char *       sql_state         = NULL;
+    unsigned int retry_counter     = 0;
+    unsigned int last_backoff_time = 0;
+
+    if( me == NULL || statement == NULL )
+    {
+        return NULL;
+    }
+
+    while( retry_counter < MAX_CONN_RETRIES )
+    {
+        if( !prepare_statement( me, statement ) )
+        {
+            return NULL;
+        }
+
+        result = PQexecPrepared(
+            me->conn,
+            statement->name,
+            statement->num_params,
+            ( const char * const * ) params,
+            param_lengths,
+            param_formats,
+            0
+        );
+
+        if(
+                PQresultStatus( result ) == PGRES_COMMAND_OK
+             || PQresultStatus( result ) == PGRES_TUPLES_OK
+          )
+        {
+            return result;
+        }
+
+        _log(
+            LOG_LEVEL_ERROR,
+            "Prepared query '%s' failed: %s",
+            statement->query,
+            PQerrorMessage( me->conn )
+        );
+
+        _save_sql_state( me, result );
+        sql_state = PQresultErrorField( result, PG_DIAG_SQLSTATE );
+
+        if(
+                me->tx_in_progress
+             || ( sql_state != NULL && !_is_retryable_sql_state( sql_state ) )
+          )
+        {
+            PQclear( result );
+            return NULL;
+        }
 
+        PQclear( result );
+        PQfinish( me->conn );
         me->conn = NULL;
-        me->conn = PQconnectdb( conninfo );
         retry_counter++;
+
+        connection_backoff( &last_backoff_time );
     }
 
+    return NULL;
+}
+
+/*
+ * SQL states that indicate the connection, rather than the statement, failed.
+ * Statements failing with these are worth reissuing on a new connection.
+ */
+bool _is_retryable_sql_state( const char * sql_state )
+{
+    if( sql_state == NULL )
+    {
+        return false;
+    }
+
+    return strcmp( sql_state, SQL_STATE_TERMINATED_BY_ADMINISTRATOR ) == 0
+        || strcmp( sql_state, SQL_STATE_CANCELED_BY_ADMINISTRATOR ) == 0
+        || strcmp( sql_state, SQL_STATE_CONNECTION_FAILURE ) == 0
+        || strcmp( sql_state, SQL_STATE_SQLCLIENT_UNABLE_TO_ESTABLISH_SQLCONNECTION ) == 0
+        || strcmp( sql_state, SQL_STATE_CONNECTION_DOES_NOT_EXIST ) == 0
+        || strcmp( sql_state, SQL_STATE_CONNECTION_EXCEPTION ) == 0;
+}
+
+/*
+ * SQL states that indicate a statement was built against a layout that has
+ * since changed: a column or table it names is gone, a type it assumed is
+ * not, or the server's cached plan for it returns a different row type.
+ * Statements failing with these are worth building again, once.
+ */
+bool _is_schema_sql_state( const char * sql_state )
+{
+    if( sql_state == NULL )
+    {
+        return false;
+    }
+
+    return strcmp( sql_state, SQL_STATE_UNDEFINED_COLUMN ) == 0
+        || strcmp( sql_state, SQL_STATE_UNDEFINED_TABLE ) == 0
+        || strcmp( sql_state, SQL_STATE_DATATYPE_MISMATCH ) == 0
+        || strcmp( sql_state, SQL_STATE_FEATURE_NOT_SUPPORTED ) == 0;
+}
+
+#ifdef LIBPQ_HAS_PIPELINING
+/*
+ * Flushes what a nonblocking connection has queued. Whenever the socket
+ * cannot take more, what the server has sent back is read into libpq's
+ * buffer first: a server blocked writing the results of a chunk stops
+ * reading its statements, so a client that only wrote would wait on it
+ * forever once both socket buffers are full.
+ */
+static bool _flush_pipeline( PGconn * conn )
+{
+    struct pollfd descriptor = {0};
+    int           flushed    = 0;
+
+    while( ( flushed = PQflush( conn ) ) == 1 )
+    {
+        descriptor.fd      = PQsocket( conn );
+        descriptor.events  = POLLIN | POLLOUT;
+        descriptor.revents = 0;
+
+        if( poll( &descriptor, 1, -1 ) < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        if( ( descriptor.revents & POLLIN ) && PQconsumeInput( conn ) != 1 )
+        {
+            return false;
+        }
+    }
+
+    return flushed == 0;
+}
+
+/*
+ * Sends statements in chunks of up to MAX_PIPELINE_DEPTH, each chunk
+ * terminated by a sync point, and only then reads their results, so that a
+ * chunk costs one round trip rather than one per statement. The connection
+ * is nonblocking while a chunk is sent, and results that arrive meanwhile are
+ * read as they come, see _flush_pipeline(), so large ones cannot stall it.
+ * Every result up to the chunk's sync point is read before the next chunk is
+ * sent. Outside of a transaction each chunk is its own implicit transaction
+ * and is reissued as a whole when it fails with a retryable SQL state. Inside
+ * of one, any failure aborts the transaction and is left to the caller. On
+ * failure, failed_index is set to the statement that caused it, whose
+ * sql_state is filled in.
+ */
+bool _execute_pipeline(
+    struct worker *             me,
+    struct pipeline_statement * statements,
+    unsigned long               num_statements,
+    unsigned long *             failed_index
+)
+{
+    PGresult *     result            = NULL;
+    unsigned long  offset            = 0;
+    unsigned long  chunk_end         = 0;
+    unsigned long  i                 = 0;
+    unsigned long  failed            = 0;
+    unsigned int   retry_counter     = 0;
+    unsigned int   last_backoff_time = 0;
+    int            sent              = 0;
+    bool           have_failure      = false;
+    bool           send_failed       = false;
+    bool           synced            = false;
+    char *         sql_state         = NULL;
+
+    if( me == NULL || statements == NULL )
+    {
+        return false;
+    }
+
+    while( offset < num_statements )
+    {
+        if( !db_connect( me ) )
+        {
+            return false;
+        }
+
+        chunk_end    = offset + MAX_PIPELINE_DEPTH;
+        have_failure = false;
+        send_failed  = false;
+
+        if( chunk_end > num_statements )
+        {
+            chunk_end = num_statements;
+        }
+
+        // Statements cannot be prepared synchronously inside the pipeline
+        for( i = offset; i < chunk_end; i++ )
+        {
+            if(
+                    statements[i].prepared != NULL
+                 && !prepare_statement( me, statements[i].prepared )
+              )
+            {
+                strcpy( statements[i].sql_state, SQL_STATE_CONNECTION_EXCEPTION );
+
+                if( failed_index != NULL )
+                {
+                    *failed_index = i;
+                }
+
+                return false;
+            }
+        }
+
+        if( PQsetnonblocking( me->conn, 1 ) != 0 || PQenterPipelineMode( me->conn ) != 1 )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to enter pipeline mode: %s",
+                PQerrorMessage( me->conn )
+            );
+
+            PQsetnonblocking( me->conn, 0 );
+            return false;
+        }
+
+        for( i = offset; i < chunk_end; i++ )
+        {
+            statements[i].sql_state[0] = '\0';
+
+            if( statements[i].prepared != NULL )
+            {
+                sent = PQsendQueryPrepared(
+                    me->conn,
+                    statements[i].prepared->name,
+                    statements[i].param_count,
+                    ( const char * const * ) statements[i].params,
+                    statements[i].param_lengths,
+                    statements[i].param_formats,
+                    0
+                );
+            }
+            else
+            {
+                sent = PQsendQueryParams(
+                    me->conn,
+                    statements[i].query,
+                    statements[i].param_count,
+                    NULL,
+                    ( const char * const * ) statements[i].params,
+                    statements[i].param_lengths,
+                    statements[i].param_formats,
+                    0
+                );
+            }
+
+            if( sent != 1 )
+            {
+                chunk_end   = i;
+                send_failed = true;
+                break;
+            }
+
+            // libpq sends as its buffer fills; take in results once that stalls
+            if( PQflush( me->conn ) == 1 && PQconsumeInput( me->conn ) != 1 )
+            {
+                chunk_end   = i + 1;
+                send_failed = true;
+                break;
+            }
+        }
+
+        synced = PQpipelineSync( me->conn ) == 1;
+
+        if( !synced || !_flush_pipeline( me->conn ) )
+        {
+            send_failed = true;
+        }
+
+        // Results are read blocking, as libpq has nothing left to send
+        PQsetnonblocking( me->conn, 0 );
+
+        for( i = offset; i < chunk_end; i++ )
+        {
+            result = PQgetResult( me->conn );
+
+            if( result == NULL )
+            {
+                // Lost the connection part way through the chunk
+                if( !have_failure )
+                {
+                    strcpy( statements[i].sql_state, SQL_STATE_CONNECTION_FAILURE );
+                    failed       = i;
+                    have_failure = true;
+                }
+
+                break;
+            }
+
+            if( PQresultStatus( result ) == PGRES_FATAL_ERROR && !have_failure )
+            {
+                sql_state = PQresultErrorField( result, PG_DIAG_SQLSTATE );
+
+                snprintf(
+                    statements[i].sql_state,
+                    sizeof( statements[i].sql_state ),
+                    "%s",
+                    sql_state != NULL ? sql_state : SQL_STATE_CONNECTION_FAILURE
+                );
+
+                _log(
+                    LOG_LEVEL_ERROR,
+                    "Pipelined query %lu '%s' failed: %s",
+                    i,
+                    statements[i].prepared != NULL
+                        ? statements[i].prepared->query
+                        : statements[i].query,
+                    PQresultErrorMessage( result )
+                );
+
+                failed       = i;
+                have_failure = true;
+            }
+
+            if( statements[i].keep_result && PQresultStatus( result ) == PGRES_TUPLES_OK )
+            {
+                // A retried chunk replaces the rows of the attempt before
+                PQclear( statements[i].result );
+                statements[i].result = result;
+            }
+            else
+            {
+                PQclear( result );
+            }
+
+            // Each statement's results are terminated by a NULL
+            while( ( result = PQgetResult( me->conn ) ) != NULL )
+            {
+                PQclear( result );
+            }
+        }
+
+        /*
+         * Read whatever is left up to the sync point, such as the results of
+         * statements past a lost one, then leave pipeline mode. Each
+         * statement's results end with a NULL, so those do not mean the
+         * sync point is not coming; only a lost connection does.
+         */
+        while( synced && PQstatus( me->conn ) == CONNECTION_OK )
+        {
+            result = PQgetResult( me->conn );
+
+            if( result == NULL )
+            {
+                continue;
+            }
+
+            if( PQresultStatus( result ) == PGRES_PIPELINE_SYNC )
+            {
+                PQclear( result );
+                break;
+            }
+
+            PQclear( result );
+        }
+
+        if( PQexitPipelineMode( me->conn ) != 1 )
+        {
+            // Results are still outstanding, the connection is unusable
+            send_failed = true;
+        }
+
+        if( send_failed && !have_failure )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to send pipelined query: %s",
+                PQerrorMessage( me->conn )
+            );
+
+            if( chunk_end == num_statements )
+            {
+                chunk_end--;
+            }
+
+            strcpy( statements[chunk_end].sql_state, SQL_STATE_CONNECTION_FAILURE );
+            failed       = chunk_end;
+            have_failure = true;
+        }
+
+        if( !have_failure )
+        {
+            offset = chunk_end;
+            continue;
+        }
+
+        if(
+                !( me->tx_in_progress )
+             && _is_retryable_sql_state( statements[failed].sql_state )
+             && retry_counter < MAX_CONN_RETRIES
+          )
+        {
+            _log(
+                LOG_LEVEL_WARNING,
+                "Pipelined query %lu failed with SQL state %s. Retrying...",
+                failed,
+                statements[failed].sql_state
+            );
+
+            PQfinish( me->conn );
+            me->conn = NULL;
+            retry_counter++;
+            connection_backoff( &last_backoff_time );
+            continue;
+        }
+
+        if( send_failed || _is_retryable_sql_state( statements[failed].sql_state ) )
+        {
+            // The transaction, if any, went with the connection
+            PQfinish( me->conn );
+            me->conn           = NULL;
+            me->tx_in_progress = false;
+        }
+
+        if( failed_index != NULL )
+        {
+            *failed_index = failed;
+        }
+
+        memcpy( me->sql_state, statements[failed].sql_state, sizeof( me->sql_state ) );
+        return false;
+    }
+
+    return true;
+}
+#endif // LIBPQ_HAS_PIPELINING
+
+/*
+ * Ensures me has a working connection. A failed one is replaced with a spare
+ * from the worker's pool, which has usually been established already, so
+ * that reconnecting after a failover takes about as long as noticing it.
+ */
+bool db_connect( struct worker * me )
+{
     if( me->conn != NULL && PQstatus( me->conn ) == CONNECTION_OK )
     {
         return true;
     }
 
-    return false;
+    if( me->conn != NULL )
+    {
+        PQfinish( me->conn );
+        me->conn = NULL;
+    }
+
+    me->tx_in_progress = false;
+
+    if( me->connection_pool == NULL )
+    {
+        me->connection_pool = ( void * ) new_connection_pool(
+            me->conninfo != NULL ? me->conninfo : conninfo,
+            connection_spares
+        );
+
+        if( me->connection_pool == NULL )
+        {
+            return false;
+        }
+    }
+
+    me->conn = acquire_connection(
+        ( struct connection_pool * ) me->connection_pool,
+        CONNECTION_TIMEOUT_MS
+    );
+
+    if( me->conn == NULL )
+    {
+        return false;
+    }
+
+    // Nothing prepared on the old session exists on this one
+    reset_statement_cache( me );
+    me->connection_id = ++connections_made;
+    return true;
 }
 
 bool _begin_transaction( struct worker * me )
@@ -3,9 +3,12 @@
 
 #include "libpq-fe.h"
 #include "util.h"
+#include "statement_cache.h"
+#include "connection_pool.h"
 #include <stdbool.h>
 
 #define MAX_CONN_RETRIES 5
+#define MAX_PIPELINE_DEPTH 256
 
 #define SQL_STATE_TERMINATED_BY_ADMINISTRATOR "57P01"
 #define SQL_STATE_CANCELED_BY_ADMINISTRATOR "57014"
@@ -13,9 +16,50 @@
 #define SQL_STATE_SQLCLIENT_UNABLE_TO_ESTABLISH_SQLCONNECTION "08001"
 #define SQL_STATE_CONNECTION_DOES_NOT_EXIST "08003"
 #define SQL_STATE_CONNECTION_EXCEPTION "08000"
+#define SQL_STATE_UNDEFINED_COLUMN "42703"
+#define SQL_STATE_UNDEFINED_TABLE "42P01"
+#define SQL_STATE_DATATYPE_MISMATCH "42804"
+#define SQL_STATE_FEATURE_NOT_SUPPORTED "0A000"
+
+/*
+ * One statement of a pipeline. If prepared is set the statement is executed
+ * by name and query is ignored. param_lengths and param_formats may be NULL
+ * when all parameters are sent as text. If keep_result is set, the rows a
+ * statement returns are left in result for the caller to PQclear().
+ */
+struct pipeline_statement {
+    char *                      query;
+    struct prepared_statement * prepared;
+    char **                     params;
+    int *                       param_lengths;
+    int *                       param_formats;
+    unsigned int                param_count;
+    bool                        keep_result;
+    PGresult *                  result;
+    char                        sql_state[6];
+};
 
 extern PGresult * _execute_query( struct worker *, char *, char **, unsigned int );
+extern PGresult * _execute_prepared(
+    struct worker *,
+    struct prepared_statement *,
+    char **,
+    int *,
+    int *
+);
+extern bool _is_retryable_sql_state( const char * );
+extern bool _is_schema_sql_state( const char * );
+#ifdef LIBPQ_HAS_PIPELINING
+extern bool _execute_pipeline(
+    struct worker *,
+    struct pipeline_statement *,
+    unsigned long,
+    unsigned long *
+);
+#endif
 extern bool db_connect( struct worker * );
+extern bool _copy_in( struct worker *, char *, char *, size_t );
+extern bool _copy_stream( PGconn *, char *, struct worker *, char *, unsigned long * );
 
 extern bool _begin_transaction( struct worker * );
 extern bool _commit_transaction( struct worker * );
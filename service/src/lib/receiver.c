@@ -0,0 +1,915 @@
+#include "receiver.h"
+#include "logger.h"
+#include "metrics.h"
+
+char * source_file = NULL;
+
+static struct receiver * _new_receiver( struct worker *, char *, char * );
+static bool _read_sources( struct receiver ***, unsigned int * );
+static bool _start_receiver( struct receiver * );
+static void _stop_receiver( struct receiver *, bool );
+static bool _restart_receiver( struct receiver * );
+static bool _start_stream( struct receiver * );
+static bool _watch_member( struct fanout *, int, void * );
+static bool _stream_ready( struct event_loop *, int, uint32_t, void * );
+static bool _member_ready( struct event_loop *, int, uint32_t, void * );
+static bool _sync_due( struct event_loop *, int, uint32_t, void * );
+static bool _feedback_due( struct event_loop *, int, uint32_t, void * );
+static bool _restart_due( struct event_loop *, int, uint32_t, void * );
+static bool _signalled( struct event_loop *, int, void * );
+static bool _send_feedback( struct receiver * );
+static bool _watch_stream( struct receiver * );
+static bool _resume_stream( struct receiver * );
+static void _render_sources( struct string_buffer *, void * );
+
+/*
+ * Creates a receiver for every source database of source_file, or for the
+ * one given on the command line, which me is connected to, if there is none.
+ * Returns NULL if none could be created.
+ */
+struct receiver ** new_receivers( struct worker * me, unsigned int * num_receivers )
+{
+    struct receiver ** receivers = NULL;
+
+    *num_receivers = 0;
+
+    if( source_file != NULL )
+    {
+        return _read_sources( &receivers, num_receivers ) ? receivers : NULL;
+    }
+
+    receivers = ( struct receiver ** ) calloc( 2, sizeof( struct receiver * ) );
+
+    if( receivers == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate receivers"
+        );
+
+        return NULL;
+    }
+
+    receivers[0] = _new_receiver( me, NULL, REPLICATION_SLOT_NAME );
+
+    if( receivers[0] == NULL )
+    {
+        free( receivers );
+        return NULL;
+    }
+
+    *num_receivers = 1;
+    return receivers;
+}
+
+/*
+ * Runs the parent until it is told to stop by SIGINT or SIGTERM: starts
+ * every source's members, resumes its slot (creating and populating it
+ * first if it cannot be streamed), then hands every record to the members
+ * as it arrives and confirms the slot as far as they have applied or
+ * durably queued it. A source that fails is started again shortly after,
+ * while the others carry on.
+ */
+bool run_receivers( struct receiver ** receivers, unsigned int num_receivers )
+{
+    struct event_loop *       loop      = NULL;
+    struct metrics_listener * listener  = NULL;
+    struct receiver *         receiver  = NULL;
+    int                       signals[] = { SIGHUP, SIGINT, SIGTERM };
+    unsigned int              i         = 0;
+    bool                      success   = false;
+
+    if( receivers == NULL || num_receivers == 0 )
+    {
+        return false;
+    }
+
+    loop = new_event_loop();
+
+    if(
+            loop == NULL
+         || !add_signals( loop, signals, sizeof( signals ) / sizeof( int ), _signalled, NULL )
+      )
+    {
+        goto cleanup;
+    }
+
+    // Not being able to serve metrics is no reason to stop applying changes
+    if( metrics_port > 0 )
+    {
+        listener = new_metrics_listener( loop, metrics_port, _render_sources, receivers );
+    }
+
+    for( i = 0; i < num_receivers; i++ )
+    {
+        receiver                = receivers[i];
+        receiver->loop          = loop;
+        receiver->restart_timer = add_timer( loop, 0, _restart_due, receiver );
+
+        if(
+                receiver->restart_timer < 0
+             || add_timer( loop, RECEIVER_SYNC_MS, _sync_due, receiver ) < 0
+             || add_timer( loop, RECEIVER_FEEDBACK_MS, _feedback_due, receiver ) < 0
+          )
+        {
+            goto cleanup;
+        }
+
+        if( !_start_receiver( receiver ) && !_restart_receiver( receiver ) )
+        {
+            goto cleanup;
+        }
+    }
+
+    success = run_event_loop( loop );
+
+    // The last feedback is worth waiting for
+    for( i = 0; i < num_receivers; i++ )
+    {
+        receiver = receivers[i];
+
+        if( receiver->stream != NULL && receiver->fanout != NULL )
+        {
+            update_fanout( receiver->fanout );
+            PQsetnonblocking( receiver->stream->conn, 0 );
+            _send_feedback( receiver );
+        }
+    }
+
+cleanup:
+    for( i = 0; i < num_receivers; i++ )
+    {
+        _stop_receiver( receivers[i], true );
+        receivers[i]->loop = NULL;
+    }
+
+    free_metrics_listener( listener );
+    free_event_loop( loop );
+    return success;
+}
+
+/*
+ * Frees receivers, with the workers of those read from source_file. That
+ * of the command line's database is the caller's.
+ */
+void free_receivers( struct receiver ** receivers, unsigned int num_receivers )
+{
+    unsigned int i = 0;
+
+    if( receivers == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < num_receivers; i++ )
+    {
+        if( receivers[i] == NULL )
+        {
+            continue;
+        }
+
+        if( receivers[i]->name != NULL && receivers[i]->me != NULL )
+        {
+            free( receivers[i]->me->conninfo );
+            receivers[i]->me->conninfo = NULL;
+            free_worker( receivers[i]->me );
+        }
+
+        free( receivers[i]->name );
+        free( receivers[i]->slot_name );
+        free( receivers[i] );
+    }
+
+    free( receivers );
+    return;
+}
+
+static struct receiver * _new_receiver( struct worker * me, char * name, char * slot_name )
+{
+    struct receiver * receiver = NULL;
+
+    receiver = ( struct receiver * ) calloc( 1, sizeof( struct receiver ) );
+
+    if( receiver == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate receiver"
+        );
+
+        return NULL;
+    }
+
+    receiver->me            = me;
+    receiver->name          = name != NULL ? strdup( name ) : NULL;
+    receiver->slot_name     = strdup( slot_name );
+    receiver->stream_socket = -1;
+    receiver->restart_timer = -1;
+
+    if( ( name != NULL && receiver->name == NULL ) || receiver->slot_name == NULL )
+    {
+        free( receiver->name );
+        free( receiver->slot_name );
+        free( receiver );
+        return NULL;
+    }
+
+    return receiver;
+}
+
+/*
+ * Reads source_file: a source database per line, a name of lowercase
+ * letters, digits and underscores followed by the conninfo to connect to it
+ * with, which overrides what was given on the command line. Blank lines
+ * and lines starting with # are skipped. Each source gets a worker of its
+ * own.
+ */
+static bool _read_sources( struct receiver *** receivers, unsigned int * num_receivers )
+{
+    struct string_buffer * buffer   = NULL;
+    struct receiver **     temp     = NULL;
+    struct worker *        me       = NULL;
+    FILE *                 file     = NULL;
+    char *                 line     = NULL;
+    char *                 name     = NULL;
+    char *                 info     = NULL;
+    size_t                 capacity = 0;
+    size_t                 length   = 0;
+    unsigned int           line_no  = 0;
+    unsigned int           i        = 0;
+    bool                   success  = false;
+
+    file   = fopen( source_file, "r" );
+    buffer = new_string_buffer();
+
+    if( file == NULL || buffer == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to read source databases from %s: %s",
+            source_file,
+            file == NULL ? strerror( errno ) : "out of memory"
+        );
+
+        goto cleanup;
+    }
+
+    while( getline( &line, &capacity, file ) >= 0 )
+    {
+        line_no++;
+
+        for( name = line; isspace( ( unsigned char ) *name ); name++ );
+
+        if( *name == '\0' || *name == '#' )
+        {
+            continue;
+        }
+
+        for( info = name; *info != '\0' && !isspace( ( unsigned char ) *info ); info++ );
+        length = ( size_t ) ( info - name );
+
+        for( ; isspace( ( unsigned char ) *info ); info++ );
+        info[strcspn( info, "\r\n" )] = '\0';
+
+        if( length > SOURCE_NAME_LENGTH || strspn( name, "abcdefghijklmnopqrstuvwxyz0123456789_" ) != length )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "%s:%u: source names are up to %d lowercase letters, digits and underscores",
+                source_file,
+                line_no,
+                SOURCE_NAME_LENGTH
+            );
+
+            goto cleanup;
+        }
+
+        name[length] = '\0';
+
+        for( i = 0; i < *num_receivers; i++ )
+        {
+            if( strcmp( ( *receivers )[i]->name, name ) == 0 )
+            {
+                _log(
+                    LOG_LEVEL_ERROR,
+                    "%s:%u: source %s is listed twice",
+                    source_file,
+                    line_no,
+                    name
+                );
+
+                goto cleanup;
+            }
+        }
+
+        temp = ( struct receiver ** ) realloc( *receivers, sizeof( struct receiver * ) * ( *num_receivers + 2 ) );
+
+        if( temp == NULL )
+        {
+            goto cleanup;
+        }
+
+        *receivers = temp;
+        ( *receivers )[*num_receivers] = NULL;
+
+        me = new_worker( WORKER_TYPE_PARENT, 0, NULL, NULL );
+
+        if( me == NULL )
+        {
+            goto cleanup;
+        }
+
+        me->type   = WORKER_TYPE_PARENT;
+        me->status = WORKER_STATUS_STARTUP;
+        me->pid    = getpid();
+
+        string_buffer_reset( buffer );
+        string_buffer_append( buffer, "%s %s", conninfo, info );
+        me->conninfo = strdup( buffer->data );
+
+        string_buffer_reset( buffer );
+        string_buffer_append( buffer, "%s_%s", REPLICATION_SLOT_NAME, name );
+
+        if( me->conninfo != NULL )
+        {
+            ( *receivers )[*num_receivers] = _new_receiver( me, name, buffer->data );
+        }
+
+        if( ( *receivers )[*num_receivers] == NULL )
+        {
+            free( me->conninfo );
+            free_worker( me );
+            goto cleanup;
+        }
+
+        ( *receivers )[++( *num_receivers )] = NULL;
+    }
+
+    if( *num_receivers == 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "No source databases in %s",
+            source_file
+        );
+
+        goto cleanup;
+    }
+
+    success = true;
+
+cleanup:
+    if( !success )
+    {
+        free_receivers( *receivers, *num_receivers );
+        *receivers     = NULL;
+        *num_receivers = 0;
+    }
+
+    if( file != NULL )
+    {
+        fclose( file );
+    }
+
+    free( line );
+    free_string_buffer( buffer );
+    return success;
+}
+
+/*
+ * Starts what of receiver is not running: loads its objects and starts its
+ * members, then starts its stream. Members that fail to start are stopped
+ * again; a stream that fails to start leaves them running.
+ */
+static bool _start_receiver( struct receiver * receiver )
+{
+    if( receiver->fanout == NULL )
+    {
+        if( !load_maintenance_objects( receiver->me, &( receiver->objects ), &( receiver->num_objects ) ) )
+        {
+            _stop_receiver( receiver, true );
+            return false;
+        }
+
+        receiver->fanout = new_fanout(
+            receiver->me,
+            receiver->name,
+            receiver->objects,
+            receiver->num_objects,
+            _watch_member,
+            receiver
+        );
+
+        if( receiver->fanout == NULL )
+        {
+            _stop_receiver( receiver, true );
+            return false;
+        }
+    }
+
+    if(
+            !_start_stream( receiver )
+         || !add_event( receiver->loop, receiver->stream_socket, EPOLLIN, _stream_ready, receiver )
+      )
+    {
+        _stop_receiver( receiver, false );
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Closes receiver's stream, and, with members, stops its members once they
+ * have applied what they have taken and frees its objects.
+ */
+static void _stop_receiver( struct receiver * receiver, bool members )
+{
+    struct fanout_location * location = NULL;
+    unsigned int             i        = 0;
+    unsigned int             j        = 0;
+
+    if( receiver->stream_socket >= 0 )
+    {
+        remove_event( receiver->loop, receiver->stream_socket );
+        receiver->stream_socket = -1;
+    }
+
+    free_replication_stream( receiver->stream );
+    receiver->stream  = NULL;
+    receiver->writing = false;
+    receiver->paused  = false;
+
+    if( !members )
+    {
+        return;
+    }
+
+    for( i = 0; receiver->fanout != NULL && i < receiver->fanout->num_locations; i++ )
+    {
+        location = &( receiver->fanout->locations[i] );
+
+        for( j = 0; j < location->num_members; j++ )
+        {
+            if( location->members[j].socket >= 0 )
+            {
+                remove_event( receiver->loop, location->members[j].socket );
+            }
+        }
+    }
+
+    free_fanout( receiver->fanout );
+    receiver->fanout = NULL;
+
+    for( i = 0; i < receiver->num_objects; i++ )
+    {
+        free_maintenance_object( receiver->objects[i] );
+    }
+
+    free( receiver->objects );
+    receiver->objects     = NULL;
+    receiver->num_objects = 0;
+    return;
+}
+
+// Has receiver started again once RECEIVER_RESTART_MS have passed
+static bool _restart_receiver( struct receiver * receiver )
+{
+    _stop_receiver( receiver, false );
+
+    _log(
+        LOG_LEVEL_WARNING,
+        "Restarting slot %s in %d ms",
+        receiver->slot_name,
+        RECEIVER_RESTART_MS
+    );
+
+    return arm_timer( receiver->loop, receiver->restart_timer, RECEIVER_RESTART_MS, 0 );
+}
+
+/*
+ * Resumes the slot where it was last confirmed, or creates it and populates
+ * the objects if it cannot be. The connection is made non-blocking, so that
+ * feedback never waits for the socket.
+ */
+static bool _start_stream( struct receiver * receiver )
+{
+    receiver->stream = open_replication_stream( receiver->me->conninfo, receiver->slot_name );
+
+    if( receiver->stream != NULL && !start_replication( receiver->stream, 0 ) )
+    {
+        free_replication_stream( receiver->stream );
+        receiver->stream = NULL;
+
+        _log(
+            LOG_LEVEL_INFO,
+            "Slot %s cannot be streamed, creating it",
+            receiver->slot_name
+        );
+
+        if(
+                !populate_maintenance_objects(
+                    receiver->me,
+                    receiver->objects,
+                    receiver->num_objects,
+                    receiver->slot_name,
+                    &( receiver->stream )
+                )
+          )
+        {
+            return false;
+        }
+    }
+
+    if( receiver->stream == NULL )
+    {
+        return false;
+    }
+
+    if( PQsocket( receiver->stream->conn ) < 0 || PQsetnonblocking( receiver->stream->conn, 1 ) != 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to make replication connection non-blocking: %s",
+            PQerrorMessage( receiver->stream->conn )
+        );
+
+        return false;
+    }
+
+    receiver->stream_socket = PQsocket( receiver->stream->conn );
+    return true;
+}
+
+/*
+ * Watches the socket of a member the fan-out has started. It is
+ * edge-triggered: what the member will take is sent as records arrive,
+ * until it will take no more, and the loop only has to say when it will
+ * take more again.
+ */
+static bool _watch_member( struct fanout * fanout, int socket, void * argument )
+{
+    struct receiver * receiver = NULL;
+
+    receiver = ( struct receiver * ) argument;
+
+    return add_event( receiver->loop, socket, EPOLLIN | EPOLLOUT | EPOLLET, _member_ready, receiver );
+}
+
+/*
+ * Reads every record libpq has, or can read without blocking, and queues
+ * each for the members, until the fan-out is throttled. The stream has to
+ * be drained: what libpq has buffered no longer shows on the socket, which
+ * is why reading resumes here rather than by watching it again.
+ */
+static bool _stream_ready( struct event_loop * loop, int fd, uint32_t events, void * argument )
+{
+    struct receiver * receiver = NULL;
+    char *            record   = NULL;
+    uint64_t          lsn      = 0;
+    int               status   = 0;
+
+    receiver = ( struct receiver * ) argument;
+
+    if( ( events & EPOLLOUT ) && !flush_replication_stream( receiver->stream ) )
+    {
+        return _restart_receiver( receiver );
+    }
+
+    // A paused stream is still read once it has failed, to find out how
+    while(
+            ( !( receiver->fanout->throttled ) || ( events & ( EPOLLHUP | EPOLLERR ) ) )
+         && ( status = read_replication_message( receiver->stream, &record, &lsn ) ) > 0
+         )
+    {
+        fanout_record( receiver->fanout, record, lsn, is_commit_record( record ) );
+        free( record );
+    }
+
+    if( status < 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Replication stream of slot %s ended at " LSN_FORMAT,
+            receiver->slot_name,
+            LSN_FORMAT_ARGS( receiver->stream->received_lsn )
+        );
+
+        return _restart_receiver( receiver );
+    }
+
+    // Keepalives are answered while reading
+    return _watch_stream( receiver ) || _restart_receiver( receiver );
+}
+
+static bool _member_ready( struct event_loop * loop, int fd, uint32_t events, void * argument )
+{
+    struct receiver * receiver = NULL;
+
+    receiver = ( struct receiver * ) argument;
+
+    // Sockets of detached locations and ended members are closed, and drop out of the epoll set by themselves
+    if(
+            !fanout_socket_ready(
+                receiver->fanout,
+                fd,
+                ( events & ( EPOLLIN | EPOLLHUP | EPOLLERR ) ) != 0,
+                ( events & EPOLLOUT ) != 0
+            )
+      )
+    {
+        remove_event( loop, fd );
+    }
+
+    return _resume_stream( receiver );
+}
+
+// Confirms the slot as soon as the members' progress allows
+static bool _sync_due( struct event_loop * loop, int fd, uint32_t events, void * argument )
+{
+    struct receiver * receiver = NULL;
+
+    receiver = ( struct receiver * ) argument;
+
+    if( receiver->fanout == NULL )
+    {
+        return true;
+    }
+
+    update_fanout( receiver->fanout );
+
+    // The slot has been held where a detached location left off, so a new fan-out resumes it from there
+    if( fanout_detached( receiver->fanout ) )
+    {
+        _stop_receiver( receiver, true );
+        return _restart_receiver( receiver );
+    }
+
+    if(
+            receiver->stream != NULL
+         && receiver->fanout->confirmed_lsn > receiver->stream->flushed_lsn
+         && !_send_feedback( receiver )
+      )
+    {
+        return _restart_receiver( receiver );
+    }
+
+    // Members that have taken enough of their queues let a paused stream be read again
+    return _resume_stream( receiver );
+}
+
+static bool _feedback_due( struct event_loop * loop, int fd, uint32_t events, void * argument )
+{
+    struct receiver * receiver = NULL;
+
+    receiver = ( struct receiver * ) argument;
+
+    return _send_feedback( receiver ) || _restart_receiver( receiver );
+}
+
+static bool _restart_due( struct event_loop * loop, int fd, uint32_t events, void * argument )
+{
+    struct receiver * receiver = NULL;
+
+    receiver = ( struct receiver * ) argument;
+
+    return _start_receiver( receiver ) || _restart_receiver( receiver );
+}
+
+// SIGHUP reopens the log file, so that it can be rotated
+static bool _signalled( struct event_loop * loop, int signal, void * argument )
+{
+    if( signal == SIGHUP )
+    {
+        reopen_log();
+        return true;
+    }
+
+    _log(
+        LOG_LEVEL_INFO,
+        "Received signal %d, stopping",
+        signal
+    );
+
+    stop_event_loop( loop );
+    return true;
+}
+
+static bool _send_feedback( struct receiver * receiver )
+{
+    if( receiver->stream == NULL || !( receiver->stream->streaming ) )
+    {
+        return true;
+    }
+
+    if( receiver->fanout->confirmed_lsn > receiver->stream->flushed_lsn )
+    {
+        receiver->stream->flushed_lsn = receiver->fanout->confirmed_lsn;
+    }
+
+    return send_replication_feedback( receiver->stream, false ) && _watch_stream( receiver );
+}
+
+/*
+ * Watches the stream's socket for room to write while feedback is pending,
+ * and for reading unless the fan-out is throttled
+ */
+static bool _watch_stream( struct receiver * receiver )
+{
+    if(
+            receiver->stream->flush_pending == receiver->writing
+         && receiver->fanout->throttled == receiver->paused
+      )
+    {
+        return true;
+    }
+
+    receiver->writing = receiver->stream->flush_pending;
+    receiver->paused  = receiver->fanout->throttled;
+
+    return modify_event(
+        receiver->loop,
+        receiver->stream_socket,
+        ( receiver->paused ? 0 : EPOLLIN ) | ( receiver->writing ? EPOLLOUT : 0 )
+    );
+}
+
+// Reads the stream again once a paused receiver's members have taken enough of their queues
+static bool _resume_stream( struct receiver * receiver )
+{
+    if( !( receiver->paused ) || receiver->stream == NULL || fanout_throttled( receiver->fanout ) )
+    {
+        return true;
+    }
+
+    return _stream_ready( receiver->loop, receiver->stream_socket, EPOLLIN, receiver );
+}
+
+/*
+ * Appends what the parent knows of every source to a scrape: how far it has
+ * been received and confirmed, how far each location has applied it and
+ * how far behind that is, and how much is queued for each member.
+ */
+static void _render_sources( struct string_buffer * buffer, void * argument )
+{
+    struct receiver **       receivers = NULL;
+    struct receiver *        receiver  = NULL;
+    struct fanout_location * location  = NULL;
+    const char *             source    = NULL;
+    uint64_t                 from      = 0;
+    unsigned int             i         = 0;
+    unsigned int             j         = 0;
+    unsigned int             k         = 0;
+    unsigned int             family    = 0;
+
+    receivers = ( struct receiver ** ) argument;
+
+    string_buffer_append(
+        buffer,
+        "# HELP pg_ctblmgr_source_streaming Whether each source database is being streamed\n"
+        "# TYPE pg_ctblmgr_source_streaming gauge\n"
+    );
+
+    for( i = 0; receivers[i] != NULL; i++ )
+    {
+        receiver = receivers[i];
+
+        string_buffer_append(
+            buffer,
+            "pg_ctblmgr_source_streaming{source=\"%s\"} %d\n",
+            receiver->name != NULL ? receiver->name : "",
+            receiver->stream != NULL && receiver->stream->streaming ? 1 : 0
+        );
+    }
+
+    string_buffer_append(
+        buffer,
+        "# HELP pg_ctblmgr_source_paused Whether each source database is not being read, while its workers catch up\n"
+        "# TYPE pg_ctblmgr_source_paused gauge\n"
+    );
+
+    for( i = 0; receivers[i] != NULL; i++ )
+    {
+        receiver = receivers[i];
+
+        string_buffer_append(
+            buffer,
+            "pg_ctblmgr_source_paused{source=\"%s\"} %d\n",
+            receiver->name != NULL ? receiver->name : "",
+            receiver->paused ? 1 : 0
+        );
+    }
+
+    string_buffer_append(
+        buffer,
+        "# HELP pg_ctblmgr_source_received_lsn Last LSN received from each source database\n"
+        "# TYPE pg_ctblmgr_source_received_lsn gauge\n"
+    );
+
+    for( i = 0; receivers[i] != NULL; i++ )
+    {
+        receiver = receivers[i];
+
+        if( receiver->stream != NULL )
+        {
+            string_buffer_append(
+                buffer,
+                "pg_ctblmgr_source_received_lsn{source=\"%s\"} %lu\n",
+                receiver->name != NULL ? receiver->name : "",
+                receiver->stream->received_lsn
+            );
+        }
+    }
+
+    string_buffer_append(
+        buffer,
+        "# HELP pg_ctblmgr_source_confirmed_lsn LSN each source's slot may be confirmed to\n"
+        "# TYPE pg_ctblmgr_source_confirmed_lsn gauge\n"
+    );
+
+    for( i = 0; receivers[i] != NULL; i++ )
+    {
+        receiver = receivers[i];
+
+        if( receiver->fanout != NULL )
+        {
+            string_buffer_append(
+                buffer,
+                "pg_ctblmgr_source_confirmed_lsn{source=\"%s\"} %lu\n",
+                receiver->name != NULL ? receiver->name : "",
+                receiver->fanout->confirmed_lsn
+            );
+        }
+    }
+
+    // One family of each location at a time, as the format requires
+    for( family = 0; family < 3; family++ )
+    {
+        string_buffer_append(
+            buffer,
+            family == 0
+          ? "# HELP pg_ctblmgr_location_applied_lsn Last COMMIT LSN every member of each location has applied\n"
+            "# TYPE pg_ctblmgr_location_applied_lsn gauge\n"
+          : family == 1
+          ? "# HELP pg_ctblmgr_location_lag_bytes Bytes of WAL each location is behind what has been received\n"
+            "# TYPE pg_ctblmgr_location_lag_bytes gauge\n"
+          : "# HELP pg_ctblmgr_location_detached Whether each location has been detached for falling behind or failing\n"
+            "# TYPE pg_ctblmgr_location_detached gauge\n"
+        );
+
+        for( i = 0; receivers[i] != NULL; i++ )
+        {
+            receiver = receivers[i];
+            source   = receiver->name != NULL ? receiver->name : "";
+
+            for( j = 0; receiver->fanout != NULL && j < receiver->fanout->num_locations; j++ )
+            {
+                location = &( receiver->fanout->locations[j] );
+                from     = location->applied_lsn > 0 ? location->applied_lsn : receiver->fanout->start_lsn;
+
+                string_buffer_append(
+                    buffer,
+                    "%s{source=\"%s\",location=\"%u\"} %lu\n",
+                    family == 0 ? "pg_ctblmgr_location_applied_lsn"
+                  : family == 1 ? "pg_ctblmgr_location_lag_bytes"
+                  : "pg_ctblmgr_location_detached",
+                    source,
+                    location->location,
+                    family == 0 ? location->applied_lsn
+                  : family == 1 ? ( receiver->fanout->queued_lsn > from ? receiver->fanout->queued_lsn - from : 0 )
+                  : ( uint64_t ) location->detached
+                );
+            }
+        }
+    }
+
+    string_buffer_append(
+        buffer,
+        "# HELP pg_ctblmgr_queue_bytes Bytes queued for each member and not yet sent, in memory and spilled\n"
+        "# TYPE pg_ctblmgr_queue_bytes gauge\n"
+    );
+
+    for( i = 0; receivers[i] != NULL; i++ )
+    {
+        receiver = receivers[i];
+
+        for( j = 0; receiver->fanout != NULL && j < receiver->fanout->num_locations; j++ )
+        {
+            location = &( receiver->fanout->locations[j] );
+
+            for( k = 0; k < location->num_members && !( location->detached ); k++ )
+            {
+                string_buffer_append(
+                    buffer,
+                    "pg_ctblmgr_queue_bytes{source=\"%s\",location=\"%u\",member=\"%u\"} %lu\n",
+                    receiver->name != NULL ? receiver->name : "",
+                    location->location,
+                    k,
+                    spill_queue_length( location->members[k].queue )
+                );
+            }
+        }
+    }
+
+    return;
+}
@@ -0,0 +1,66 @@
+#ifndef RECEIVER_H
+#define RECEIVER_H
+
+#include "util.h"
+#include "query.h"
+#include "change.h"
+#include "object.h"
+#include "replication.h"
+#include "refresh.h"
+#include "fanout.h"
+#include "event.h"
+
+// Milliseconds between syncs of the fan-out queues, which confirm what has been applied
+#define RECEIVER_SYNC_MS 1000
+
+// Milliseconds between standby status updates sent regardless of progress
+#define RECEIVER_FEEDBACK_MS 10000
+
+// Milliseconds before a source that failed to start, or whose stream failed, is started again
+#define RECEIVER_RESTART_MS 5000
+
+// Longest name of a source database, which its slot is named after
+#define SOURCE_NAME_LENGTH 48
+
+extern char * source_file;
+
+/*
+ * A source database the parent streams into fanout. Every source is driven
+ * from the same event loop, which also watches the members' sockets,
+ * signals, and the sync and feedback timers, so that nothing it does waits
+ * on any one of them. Sources share that process, and the pool of
+ * fanout_worker_limit members between them: each source's fan-out forks up
+ * to fanout_pool_size members per location as changes arrive for them,
+ * which end once they have had nothing to apply for a while, see
+ * _tend_members(), and so make room for those of busier sources. An idle
+ * source costs only its catalog connection, with its connection_spares
+ * spares, and its replication connection; a busy one up to locations *
+ * fanout_pool_size members, each with a connection to its location and
+ * connection_spares spares. The database given on the command line has no
+ * name and streams REPLICATION_SLOT_NAME; those of source_file stream a
+ * slot named after them. A source that fails is stopped, and started again
+ * by restart_timer. writing is set while the stream's socket is watched
+ * for room to write pending feedback, and paused while it is not watched
+ * for reading, as the fan-out is throttled; feedback is still sent on time
+ * meanwhile.
+ */
+struct receiver {
+    struct worker *              me;
+    char *                       name;
+    char *                       slot_name;
+    struct maintenance_object ** objects;
+    unsigned int                 num_objects;
+    struct replication_stream *  stream;
+    struct fanout *              fanout;
+    struct event_loop *          loop;
+    int                          stream_socket;
+    int                          restart_timer;
+    bool                         writing;
+    bool                         paused;
+};
+
+extern struct receiver ** new_receivers( struct worker *, unsigned int * );
+extern bool run_receivers( struct receiver **, unsigned int );
+extern void free_receivers( struct receiver **, unsigned int );
+
+#endif // RECEIVER_H
@@ -0,0 +1,1978 @@
+#include "refresh.h"
+#include "apply.h"
+#include "driver.h"
+#include "event.h"
+#include "metrics.h"
+
+unsigned int   refresh_workers = DEFAULT_REFRESH_WORKERS;
+unsigned short refresh_mode    = REFRESH_MODE_TRUNCATE;
+
+static const char * relation_pages_query = "\
+    SELECT pg_catalog.pg_relation_size( $1::REGCLASS ) \
+         / pg_catalog.current_setting( 'block_size' )::BIGINT";
+
+static const char * export_snapshot_query = "SELECT pg_catalog.pg_export_snapshot()";
+
+/*
+ * The live table's indexes as statements that build them on the shadow table,
+ * named after the shadow table and the original index's OID. Constraints
+ * backed by an index are attached to it once it is built.
+ */
+static const char * shadow_indexes_query = "\
+    SELECT ic.relname, \
+           $3 || '_' || i.indexrelid::TEXT, \
+           pg_catalog.replace( \
+               pg_catalog.replace( \
+                   pg_catalog.pg_get_indexdef( i.indexrelid ), \
+                   ' INDEX ' || pg_catalog.quote_ident( ic.relname ) || ' ON ', \
+                   ' INDEX ' || pg_catalog.quote_ident( $3 || '_' || i.indexrelid::TEXT ) || ' ON ' \
+               ), \
+               ' ON ' || pg_catalog.quote_ident( n.nspname ) || '.' || pg_catalog.quote_ident( c.relname ) || ' USING ', \
+               ' ON ' || $2 || ' USING ' \
+           ), \
+           COALESCE( con.contype::TEXT, '' ) \
+      FROM pg_catalog.pg_index i \
+      JOIN pg_catalog.pg_class ic \
+        ON ic.oid = i.indexrelid \
+      JOIN pg_catalog.pg_class c \
+        ON c.oid = i.indrelid \
+      JOIN pg_catalog.pg_namespace n \
+        ON n.oid = c.relnamespace \
+ LEFT JOIN pg_catalog.pg_constraint con \
+        ON con.conindid = i.indexrelid \
+       AND con.conrelid = i.indrelid \
+       AND con.contype IN ( 'p', 'u' ) \
+     WHERE i.indrelid = $1::REGCLASS \
+  ORDER BY i.indisprimary DESC, i.indexrelid";
+
+/*
+ * The first thing that dropping the live table in favour of its shadow would
+ * take with it, or fail on: a view or rule over it, a foreign key to or from
+ * it, a check or exclusion constraint, a trigger or a row level security
+ * policy. The shadow only has the live table's columns, defaults and
+ * indexes.
+ */
+static const char * swap_blockers_query = "\
+    SELECT 'view ' || r.ev_class::REGCLASS::TEXT \
+      FROM pg_catalog.pg_depend d \
+      JOIN pg_catalog.pg_rewrite r \
+        ON r.oid = d.objid \
+     WHERE d.classid = 'pg_catalog.pg_rewrite'::REGCLASS \
+       AND d.refclassid = 'pg_catalog.pg_class'::REGCLASS \
+       AND d.refobjid = $1::REGCLASS \
+       AND r.ev_class <> $1::REGCLASS \
+ UNION ALL \
+    SELECT 'constraint ' || con.conname \
+      FROM pg_catalog.pg_constraint con \
+     WHERE ( con.conrelid = $1::REGCLASS AND con.contype IN ( 'c', 'f', 'x' ) ) \
+        OR con.confrelid = $1::REGCLASS \
+ UNION ALL \
+    SELECT 'trigger ' || t.tgname \
+      FROM pg_catalog.pg_trigger t \
+     WHERE t.tgrelid = $1::REGCLASS \
+       AND NOT t.tgisinternal \
+ UNION ALL \
+    SELECT 'policy ' || p.polname \
+      FROM pg_catalog.pg_policy p \
+     WHERE p.polrelid = $1::REGCLASS \
+     LIMIT 1";
+
+/*
+ * Statements that give whichever table is named $2 the grants, comments,
+ * row level security and owner of the live table $1, in that order, as the
+ * owner is the one who can grant the rest.
+ */
+static const char * table_settings_query = "\
+    SELECT s.statement \
+      FROM ( \
+            SELECT 1 AS step, \
+                   pg_catalog.format( \
+                       'GRANT %s%s ON %s TO %s%s', \
+                       a.privilege_type, \
+                       CASE WHEN g.attnum > 0 THEN pg_catalog.format( ' ( %I )', g.attname ) ELSE '' END, \
+                       $2::TEXT, \
+                       CASE WHEN a.grantee = 0 \
+                            THEN 'PUBLIC' \
+                            ELSE pg_catalog.quote_ident( pg_catalog.pg_get_userbyid( a.grantee ) ) \
+                       END, \
+                       CASE WHEN a.is_grantable THEN ' WITH GRANT OPTION' ELSE '' END \
+                   ) AS statement \
+              FROM ( \
+                    SELECT 0 AS attnum, NULL::NAME AS attname, c.relacl AS acl \
+                      FROM pg_catalog.pg_class c \
+                     WHERE c.oid = $1::REGCLASS \
+                 UNION ALL \
+                    SELECT att.attnum, att.attname, att.attacl \
+                      FROM pg_catalog.pg_attribute att \
+                     WHERE att.attrelid = $1::REGCLASS \
+                       AND att.attnum > 0 \
+                       AND NOT att.attisdropped \
+                   ) g, \
+                   pg_catalog.aclexplode( g.acl ) a \
+         UNION ALL \
+            SELECT 2, \
+                   CASE WHEN d.objsubid = 0 \
+                        THEN pg_catalog.format( 'COMMENT ON TABLE %s IS %L', $2::TEXT, d.description ) \
+                        ELSE pg_catalog.format( 'COMMENT ON COLUMN %s.%I IS %L', $2::TEXT, att.attname, d.description ) \
+                   END \
+              FROM pg_catalog.pg_description d \
+         LEFT JOIN pg_catalog.pg_attribute att \
+                ON att.attrelid = d.objoid \
+               AND att.attnum = d.objsubid \
+             WHERE d.objoid = $1::REGCLASS \
+               AND d.classoid = 'pg_catalog.pg_class'::REGCLASS \
+               AND ( d.objsubid = 0 OR att.attname IS NOT NULL ) \
+         UNION ALL \
+            SELECT 3, pg_catalog.format( 'ALTER TABLE %s ENABLE ROW LEVEL SECURITY', $2::TEXT ) \
+              FROM pg_catalog.pg_class c \
+             WHERE c.oid = $1::REGCLASS \
+               AND c.relrowsecurity \
+         UNION ALL \
+            SELECT 4, pg_catalog.format( 'ALTER TABLE %s FORCE ROW LEVEL SECURITY', $2::TEXT ) \
+              FROM pg_catalog.pg_class c \
+             WHERE c.oid = $1::REGCLASS \
+               AND c.relforcerowsecurity \
+         UNION ALL \
+            SELECT 5, pg_catalog.format( 'ALTER TABLE %s OWNER TO %I', $2::TEXT, pg_catalog.pg_get_userbyid( c.relowner ) ) \
+              FROM pg_catalog.pg_class c \
+             WHERE c.oid = $1::REGCLASS \
+               AND c.relowner <> ( SELECT r.oid FROM pg_catalog.pg_roles r WHERE r.rolname = CURRENT_USER ) \
+           ) s \
+  ORDER BY s.step";
+
+/*
+ * A refresh through a driver other than postgresql: the children read plan's
+ * chunks and hand them to driver for object, each through its own handle.
+ */
+struct driver_refresh {
+    struct refresh_plan *       plan;
+    struct maintenance_object * object;
+    struct target_driver *      driver;
+};
+
+static bool _refresh_through_driver( struct worker *, struct maintenance_object *, char * );
+static bool _find_swap_blocker( struct worker *, struct maintenance_object *, char ** );
+static bool _read_chunks( struct worker *, unsigned int, unsigned int, void * );
+static PGconn * _source_connect( struct worker *, char * );
+static bool _source_command( PGconn *, char * );
+static PGconn * _open_snapshot( struct worker *, char *, char ** );
+static bool _copy_chunks( struct worker *, unsigned int, unsigned int, void * );
+static bool _build_indexes( struct worker *, unsigned int, unsigned int, void * );
+static bool _plan_ctid_chunks( PGconn *, struct maintenance_object *, struct definition *, struct refresh_plan * );
+static bool _plan_hash_chunks( struct maintenance_object *, struct definition *, struct refresh_plan * );
+static void _append_projection( struct string_buffer *, struct maintenance_object * );
+static bool _execute_command( struct worker *, char * );
+static bool _index_shadow_table( struct worker *, struct maintenance_object *, struct shadow_refresh * );
+static bool _swap_shadow_table( struct worker *, struct maintenance_object *, struct shadow_refresh * );
+static void _free_shadow_refresh( struct worker *, struct shadow_refresh *, bool );
+
+/*
+ * Replaces the contents of object's target table with the rows of its
+ * definition as of snapshot. The definition is split into chunks which are
+ * copied by up to refresh_workers child processes in parallel, each reading
+ * under the same imported snapshot. If snapshot is NULL one is exported for
+ * the refresh; changes streamed after it was taken will be applied on top of
+ * the refreshed rows again, which the apply path tolerates.
+ *
+ * In REFRESH_MODE_TRUNCATE the target is emptied and loaded in place. In
+ * REFRESH_MODE_SHADOW it is rebuilt into a shadow table and swapped, see
+ * begin_shadow_refresh(), unless something depends on the live table that
+ * the swap would drop, see _find_swap_blocker(), in which case it is
+ * refreshed in place instead. Targets of other drivers are refreshed
+ * through the driver's refresh hooks.
+ */
+bool refresh_maintenance_object(
+    struct worker *             me,
+    struct maintenance_object * object,
+    char *                      snapshot
+)
+{
+    struct refresh_plan *  plan         = NULL;
+    struct string_buffer * sql          = NULL;
+    struct worker **       children     = NULL;
+    PGconn *               source       = NULL;
+    PGresult *             result       = NULL;
+    char *                 exported     = NULL;
+    char *                 blocker      = NULL;
+    unsigned int           num_children = 0;
+    bool                   success      = false;
+
+    if( me == NULL || object == NULL )
+    {
+        return false;
+    }
+
+    if( !open_target( me, object ) )
+    {
+        return false;
+    }
+
+    if( object->target_driver != ( void * ) &postgresql_driver )
+    {
+        return _refresh_through_driver( me, object, snapshot );
+    }
+
+    if( refresh_mode == REFRESH_MODE_SHADOW )
+    {
+        if( !_find_swap_blocker( me, object, &blocker ) )
+        {
+            return false;
+        }
+
+        if( blocker == NULL )
+        {
+            if( !begin_shadow_refresh( me, object, snapshot ) )
+            {
+                return false;
+            }
+
+            return finish_shadow_refresh( me, object, true ) > 0;
+        }
+
+        _log(
+            LOG_LEVEL_INFO,
+            "Refreshing %s in place, as swapping in a rebuilt table would drop its %s",
+            object->qualified_name,
+            blocker
+        );
+
+        free( blocker );
+    }
+
+    // The children would wait on the TRUNCATE's lock, and we on them
+    if( me->tx_in_progress )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Cannot refresh %s.%s within an open transaction",
+            object->namespace,
+            object->name
+        );
+
+        return false;
+    }
+
+    if( object->num_columns == 0 && !describe_maintenance_object( me, object ) )
+    {
+        return false;
+    }
+
+    source = _open_snapshot( me, snapshot, &exported );
+
+    if( source == NULL )
+    {
+        return false;
+    }
+
+    plan = plan_refresh( source, object, object->qualified_name );
+    sql  = new_string_buffer();
+
+    if( plan == NULL || sql == NULL )
+    {
+        goto cleanup;
+    }
+
+    plan->snapshot = exported;
+    exported       = NULL;
+    set_worker_status( me, WORKER_STATUS_REFRESH );
+
+    _log(
+        LOG_LEVEL_INFO,
+        "Refreshing %s in %u chunks with snapshot %s",
+        object->qualified_name,
+        plan->num_chunks,
+        plan->snapshot
+    );
+
+    // The children load into an empty table, each in its own transaction
+    string_buffer_append( sql, "TRUNCATE %s", object->qualified_name );
+    result = _execute_query( me, sql->data, NULL, 0 );
+
+    if( result == NULL )
+    {
+        goto cleanup;
+    }
+
+    PQclear( result );
+    children = _start_children( me, plan->num_chunks, _copy_chunks, plan, &num_children );
+
+    if( children == NULL )
+    {
+        goto cleanup;
+    }
+
+    success = _wait_children( children, num_children, true ) > 0;
+    _free_children( children, num_children );
+
+    if( success )
+    {
+        _log(
+            LOG_LEVEL_INFO,
+            "Refreshed %s",
+            object->qualified_name
+        );
+    }
+    else
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Refresh of %s failed",
+            object->qualified_name
+        );
+    }
+
+cleanup:
+    set_worker_status( me, WORKER_STATUS_IDLE );
+    free_refresh_plan( plan );
+    free_string_buffer( sql );
+    free( exported );
+    PQfinish( source );
+    return success;
+}
+
+/*
+ * Like the TRUNCATE mode refresh, with refresh_begin in place of the TRUNCATE
+ * and the children reading their chunks into refresh_chunk rather than
+ * copying them into a table. The driver is told in refresh_end whether every
+ * chunk was delivered.
+ */
+static bool _refresh_through_driver(
+    struct worker *             me,
+    struct maintenance_object * object,
+    char *                      snapshot
+)
+{
+    struct driver_refresh  task;
+    struct worker **       children     = NULL;
+    PGconn *               source       = NULL;
+    char *                 exported     = NULL;
+    unsigned int           num_children = 0;
+    bool                   success      = false;
+
+    memset( &task, 0, sizeof( struct driver_refresh ) );
+    task.object = object;
+    task.driver = ( struct target_driver * ) object->target_driver;
+
+    if( task.driver->refresh_begin == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Driver %s cannot refresh %s.%s",
+            task.driver->name,
+            object->namespace,
+            object->name
+        );
+
+        return false;
+    }
+
+    if( object->num_columns == 0 && !describe_maintenance_object( me, object ) )
+    {
+        return false;
+    }
+
+    source = _open_snapshot( me, snapshot, &exported );
+
+    if( source == NULL )
+    {
+        return false;
+    }
+
+    task.plan = plan_refresh( source, object, object->qualified_name );
+
+    if( task.plan == NULL )
+    {
+        goto cleanup;
+    }
+
+    task.plan->snapshot = exported;
+    exported            = NULL;
+
+    if( !task.driver->refresh_begin( object->target, me, object ) )
+    {
+        goto cleanup;
+    }
+
+    set_worker_status( me, WORKER_STATUS_REFRESH );
+
+    _log(
+        LOG_LEVEL_INFO,
+        "Refreshing %s through driver %s in %u chunks with snapshot %s",
+        object->qualified_name,
+        task.driver->name,
+        task.plan->num_chunks,
+        task.plan->snapshot
+    );
+
+    children = _start_children( me, task.plan->num_chunks, _read_chunks, &task, &num_children );
+
+    if( children != NULL )
+    {
+        success = _wait_children( children, num_children, true ) > 0;
+        _free_children( children, num_children );
+    }
+
+    if( !task.driver->refresh_end( object->target, me, object, success ) )
+    {
+        success = false;
+    }
+
+    _log(
+        success ? LOG_LEVEL_INFO : LOG_LEVEL_ERROR,
+        success ? "Refreshed %s" : "Refresh of %s failed",
+        object->qualified_name
+    );
+
+cleanup:
+    set_worker_status( me, WORKER_STATUS_IDLE );
+    free_refresh_plan( task.plan );
+    free( exported );
+    PQfinish( source );
+    return success;
+}
+
+/*
+ * Initial population: creates slot_name, refreshes every object
+ * under the snapshot exported with it, then starts streaming at the slot's
+ * consistent point. On success stream is set to the running stream.
+ */
+bool populate_maintenance_objects(
+    struct worker *              me,
+    struct maintenance_object ** objects,
+    unsigned int                 num_objects,
+    char *                       slot_name,
+    struct replication_stream ** stream
+)
+{
+    struct replication_stream * slot = NULL;
+    unsigned int                i    = 0;
+
+    if( me == NULL || slot_name == NULL || stream == NULL || ( objects == NULL && num_objects > 0 ) )
+    {
+        return false;
+    }
+
+    slot = create_replication_slot( me->conninfo, slot_name );
+
+    if( slot == NULL )
+    {
+        return false;
+    }
+
+    for( i = 0; i < num_objects; i++ )
+    {
+        if( !refresh_maintenance_object( me, objects[i], slot->snapshot ) )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Initial population of %s.%s failed, dropping slot %s",
+                objects[i]->namespace,
+                objects[i]->name,
+                slot->slot_name
+            );
+
+            drop_replication_slot( slot );
+            free_replication_stream( slot );
+            return false;
+        }
+    }
+
+    if( !start_replication( slot, slot->consistent_lsn ) )
+    {
+        free_replication_stream( slot );
+        return false;
+    }
+
+    *stream = slot;
+    return true;
+}
+
+/*
+ * Sets blocker to a description of the first thing that swapping a rebuilt
+ * table in for object's would drop, see swap_blockers_query, or to NULL if
+ * there is none. Returns false if that could not be found out.
+ */
+static bool _find_swap_blocker( struct worker * me, struct maintenance_object * object, char ** blocker )
+{
+    PGresult * result    = NULL;
+    char *     params[1] = { NULL };
+
+    *blocker = NULL;
+
+    if( object->num_columns == 0 && !describe_maintenance_object( me, object ) )
+    {
+        return false;
+    }
+
+    params[0] = object->qualified_name;
+    result    = _execute_query( me, ( char * ) swap_blockers_query, params, 1 );
+
+    if( result == NULL )
+    {
+        return false;
+    }
+
+    if( PQntuples( result ) > 0 )
+    {
+        *blocker = strdup( PQgetvalue( result, 0, 0 ) );
+
+        if( *blocker == NULL )
+        {
+            PQclear( result );
+            return false;
+        }
+    }
+
+    PQclear( result );
+    return true;
+}
+
+/*
+ * Starts rebuilding object into an unlogged shadow table, without holding
+ * any lock on the live table. The copy runs in child processes; the caller
+ * keeps applying changes to the live table, which buffers them for the
+ * rebuild, and polls finish_shadow_refresh() until it completes.
+ */
+bool begin_shadow_refresh(
+    struct worker *             me,
+    struct maintenance_object * object,
+    char *                      snapshot
+)
+{
+    struct shadow_refresh * shadow   = NULL;
+    struct string_buffer *  sql      = NULL;
+    char *                  schema   = NULL;
+    char *                  relation = NULL;
+    char *                  exported = NULL;
+    bool                    success  = false;
+
+    if( me == NULL || object == NULL )
+    {
+        return false;
+    }
+
+    if( object->shadow != NULL || me->tx_in_progress )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Cannot rebuild %s.%s while %s",
+            object->namespace,
+            object->name,
+            object->shadow != NULL ? "a rebuild is in progress" : "a transaction is open"
+        );
+
+        return false;
+    }
+
+    if( object->num_columns == 0 && !describe_maintenance_object( me, object ) )
+    {
+        return false;
+    }
+
+    shadow = ( struct shadow_refresh * ) calloc( 1, sizeof( struct shadow_refresh ) );
+    sql    = new_string_buffer();
+
+    if( shadow == NULL || sql == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate rebuild of %s",
+            object->qualified_name
+        );
+
+        free( shadow );
+        free_string_buffer( sql );
+        return false;
+    }
+
+    string_buffer_append( sql, SHADOW_TABLE_PREFIX "%u", object->maintenance_object );
+    shadow->relation = strdup( sql->data );
+    schema           = quote_identifier( me, object->namespace );
+    relation         = quote_identifier( me, shadow->relation );
+
+    if( shadow->relation == NULL || schema == NULL || relation == NULL )
+    {
+        goto cleanup;
+    }
+
+    string_buffer_reset( sql );
+    string_buffer_append( sql, "%s.%s", schema, relation );
+    shadow->qualified_name = strdup( sql->data );
+
+    if( shadow->qualified_name == NULL )
+    {
+        goto cleanup;
+    }
+
+    // A shadow table left behind by an earlier, interrupted rebuild is discarded
+    string_buffer_reset( sql );
+    string_buffer_append( sql, "DROP TABLE IF EXISTS %s", shadow->qualified_name );
+
+    if( !_execute_command( me, sql->data ) )
+    {
+        goto cleanup;
+    }
+
+    string_buffer_reset( sql );
+    string_buffer_append(
+        sql,
+        "CREATE UNLOGGED TABLE %s ( LIKE %s INCLUDING DEFAULTS )",
+        shadow->qualified_name,
+        object->qualified_name
+    );
+
+    if( !_execute_command( me, sql->data ) )
+    {
+        goto cleanup;
+    }
+
+    shadow->source = _open_snapshot( me, snapshot, &exported );
+
+    if( shadow->source == NULL )
+    {
+        goto cleanup;
+    }
+
+    shadow->plan   = plan_refresh( shadow->source, object, shadow->qualified_name );
+    shadow->buffer = new_coalesce_table( DEFAULT_COALESCE_BUCKETS );
+
+    if( shadow->plan == NULL || shadow->buffer == NULL )
+    {
+        goto cleanup;
+    }
+
+    shadow->plan->snapshot       = exported;
+    shadow->buffer->keep_deletes = true;
+    exported                     = NULL;
+
+    shadow->children = _start_children(
+        me,
+        shadow->plan->num_chunks,
+        _copy_chunks,
+        shadow->plan,
+        &( shadow->num_children )
+    );
+
+    if( shadow->children == NULL )
+    {
+        goto cleanup;
+    }
+
+    _log(
+        LOG_LEVEL_INFO,
+        "Rebuilding %s into %s in %u chunks with snapshot %s",
+        object->qualified_name,
+        shadow->qualified_name,
+        shadow->plan->num_chunks,
+        shadow->plan->snapshot
+    );
+
+    object->shadow = shadow;
+    success        = true;
+    set_worker_status( me, WORKER_STATUS_REFRESH );
+
+cleanup:
+    if( !success )
+    {
+        _free_shadow_refresh( me, shadow, true );
+    }
+
+    free_string_buffer( sql );
+    free( schema );
+    free( relation );
+    free( exported );
+    return success;
+}
+
+/*
+ * Completes a rebuild once its copy has finished: the shadow table is made
+ * logged, its indexes are built in parallel, and in a single transaction the
+ * buffered changes are replayed onto it and it replaces the live table.
+ * Returns 1 once the swap is done, 0 if the copy is still running (only when
+ * wait is false), or -1 if the rebuild failed and was abandoned, in which
+ * case the live table is untouched.
+ */
+int finish_shadow_refresh( struct worker * me, struct maintenance_object * object, bool wait )
+{
+    struct shadow_refresh * shadow = NULL;
+    struct string_buffer *  sql    = NULL;
+    int                     state  = 0;
+
+    if( me == NULL || object == NULL || object->shadow == NULL )
+    {
+        return -1;
+    }
+
+    shadow = ( struct shadow_refresh * ) object->shadow;
+    state  = _wait_children( shadow->children, shadow->num_children, wait );
+
+    if( state == 0 )
+    {
+        return 0;
+    }
+
+    _free_children( shadow->children, shadow->num_children );
+    shadow->children     = NULL;
+    shadow->num_children = 0;
+
+    // Every child has imported the snapshot by now
+    PQfinish( shadow->source );
+    shadow->source = NULL;
+
+    if( state < 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Copy into %s failed, abandoning rebuild of %s",
+            shadow->qualified_name,
+            object->qualified_name
+        );
+
+        abort_shadow_refresh( me, object );
+        return -1;
+    }
+
+    sql = new_string_buffer();
+
+    if( sql == NULL )
+    {
+        abort_shadow_refresh( me, object );
+        return -1;
+    }
+
+    string_buffer_append( sql, "ALTER TABLE %s SET LOGGED", shadow->qualified_name );
+
+    if(
+            !_execute_command( me, sql->data )
+         || !_index_shadow_table( me, object, shadow )
+         || !_swap_shadow_table( me, object, shadow )
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to swap %s in for %s, abandoning rebuild",
+            shadow->qualified_name,
+            object->qualified_name
+        );
+
+        free_string_buffer( sql );
+        abort_shadow_refresh( me, object );
+        return -1;
+    }
+
+    free_string_buffer( sql );
+
+    _log(
+        LOG_LEVEL_INFO,
+        "Rebuilt %s",
+        object->qualified_name
+    );
+
+    // The live table is a new relation, with the same layout
+    invalidate_object_statements( me, object->maintenance_object );
+    _free_shadow_refresh( me, shadow, false );
+    object->shadow = NULL;
+    set_worker_status( me, WORKER_STATUS_IDLE );
+    return 1;
+}
+
+// Stops a rebuild in progress and drops its shadow table
+void abort_shadow_refresh( struct worker * me, struct maintenance_object * object )
+{
+    struct shadow_refresh * shadow = NULL;
+    unsigned int            i      = 0;
+
+    if( me == NULL || object == NULL || object->shadow == NULL )
+    {
+        return;
+    }
+
+    shadow = ( struct shadow_refresh * ) object->shadow;
+
+    for( i = 0; shadow->children != NULL && i < shadow->num_children; i++ )
+    {
+        if( shadow->children[i] != NULL && shadow->children[i]->pid > 0 )
+        {
+            kill( shadow->children[i]->pid, SIGTERM );
+        }
+    }
+
+    if( shadow->children != NULL )
+    {
+        _wait_children( shadow->children, shadow->num_children, true );
+        _free_children( shadow->children, shadow->num_children );
+        shadow->children = NULL;
+    }
+
+    if( me->tx_in_progress )
+    {
+        _rollback_transaction( me );
+    }
+
+    _free_shadow_refresh( me, shadow, true );
+    object->shadow = NULL;
+    set_worker_status( me, WORKER_STATUS_IDLE );
+    return;
+}
+
+/*
+ * Collects copies of changes applied to the live table during a rebuild.
+ * They are coalesced as they arrive, so the buffer grows with the number of
+ * rows touched rather than the number of changes.
+ */
+bool buffer_shadow_changes(
+    struct maintenance_object * object,
+    struct change **            changes,
+    unsigned long               num_changes
+)
+{
+    struct shadow_refresh * shadow = NULL;
+    struct change *         copy   = NULL;
+    unsigned long           i      = 0;
+
+    if( object == NULL || object->shadow == NULL )
+    {
+        return true;
+    }
+
+    shadow = ( struct shadow_refresh * ) object->shadow;
+
+    for( i = 0; i < num_changes; i++ )
+    {
+        if( changes[i] == NULL )
+        {
+            continue;
+        }
+
+        copy = copy_change( changes[i] );
+
+        if( copy == NULL || !coalesce_change( shadow->buffer, copy ) )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to buffer change for rebuild of %s",
+                object->qualified_name
+            );
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Splits object's definition into chunks read with COPY ... TO STDOUT, and
+ * builds the COPY ... FROM STDIN that loads them into target. Definitions
+ * over a single relation are split into ranges of its heap pages, so each
+ * chunk only reads its own part of the table. Anything else is split on a
+ * hash of the target's key; every chunk then evaluates the whole definition,
+ * but the transfer and the load are still spread across the workers.
+ */
+struct refresh_plan * plan_refresh(
+    PGconn *                    source,
+    struct maintenance_object * object,
+    char *                      target
+)
+{
+    struct refresh_plan *  plan       = NULL;
+    struct definition *    definition = NULL;
+    struct string_buffer * sql        = NULL;
+    unsigned int           i          = 0;
+    bool                   success    = false;
+
+    if( source == NULL || object == NULL || target == NULL )
+    {
+        return NULL;
+    }
+
+    plan       = ( struct refresh_plan * ) calloc( 1, sizeof( struct refresh_plan ) );
+    definition = parse_definition( object->definition );
+    sql        = new_string_buffer();
+
+    if( plan == NULL || definition == NULL || sql == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate refresh plan for %s",
+            object->qualified_name
+        );
+
+        goto cleanup;
+    }
+
+    string_buffer_append( sql, "COPY %s ( ", target );
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        string_buffer_append( sql, "%s%s", i > 0 ? ", " : "", object->quoted_columns[i] );
+    }
+
+    string_buffer_append( sql, " ) FROM STDIN" );
+    plan->copy_in = strdup( sql->data );
+
+    if( plan->copy_in == NULL )
+    {
+        goto cleanup;
+    }
+
+    if( definition->is_simple )
+    {
+        success = _plan_ctid_chunks( source, object, definition, plan );
+    }
+    else
+    {
+        success = _plan_hash_chunks( object, definition, plan );
+    }
+
+cleanup:
+    free_definition( definition );
+    free_string_buffer( sql );
+
+    if( !success )
+    {
+        free_refresh_plan( plan );
+        return NULL;
+    }
+
+    return plan;
+}
+
+void free_refresh_plan( struct refresh_plan * plan )
+{
+    unsigned int i = 0;
+
+    if( plan == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < plan->num_chunks; i++ )
+    {
+        free( plan->chunks[i] );
+    }
+
+    free( plan->chunks );
+    free( plan->copy_in );
+    free( plan->snapshot );
+    free( plan );
+    return;
+}
+
+static bool _plan_ctid_chunks(
+    PGconn *                    source,
+    struct maintenance_object * object,
+    struct definition *         definition,
+    struct refresh_plan *       plan
+)
+{
+    struct string_buffer * sql       = NULL;
+    PGresult *             result    = NULL;
+    const char *           params[1] = {NULL};
+    char *                 qualifier = NULL;
+    unsigned long          pages     = 0;
+    unsigned long          first     = 0;
+    unsigned long          last      = 0;
+    unsigned int           i         = 0;
+
+    params[0] = definition->relation;
+    result    = PQexecParams( source, relation_pages_query, 1, NULL, params, NULL, NULL, 0 );
+
+    if( PQresultStatus( result ) != PGRES_TUPLES_OK || PQntuples( result ) != 1 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to size %s: %s",
+            definition->relation,
+            PQerrorMessage( source )
+        );
+
+        PQclear( result );
+        return false;
+    }
+
+    pages = strtoul( PQgetvalue( result, 0, 0 ), NULL, 10 );
+    PQclear( result );
+
+    plan->num_chunks = refresh_workers * REFRESH_CHUNKS_PER_WORKER;
+
+    if( pages / MIN_REFRESH_CHUNK_PAGES < plan->num_chunks )
+    {
+        plan->num_chunks = ( unsigned int ) ( pages / MIN_REFRESH_CHUNK_PAGES );
+    }
+
+    if( plan->num_chunks == 0 )
+    {
+        plan->num_chunks = 1;
+    }
+
+    plan->chunks = ( char ** ) calloc( plan->num_chunks + 1, sizeof( char * ) );
+    sql          = new_string_buffer();
+
+    if( plan->chunks == NULL || sql == NULL )
+    {
+        free_string_buffer( sql );
+        plan->num_chunks = 0;
+        return false;
+    }
+
+    qualifier = definition->alias != NULL ? definition->alias : definition->relation;
+
+    /*
+     * The first and last chunks are open ended, so rows on pages added after
+     * the table was sized are still copied if the snapshot can see them.
+     */
+    for( i = 0; i < plan->num_chunks; i++ )
+    {
+        first = pages * i / plan->num_chunks;
+        last  = pages * ( i + 1 ) / plan->num_chunks;
+
+        string_buffer_reset( sql );
+        string_buffer_append( sql, "COPY ( SELECT " );
+        _append_projection( sql, object );
+        string_buffer_append(
+            sql,
+            " FROM ( SELECT %s FROM %s WHERE ( %s )",
+            definition->select_list,
+            definition->from_clause,
+            definition->where != NULL ? definition->where : "TRUE"
+        );
+
+        if( i > 0 )
+        {
+            string_buffer_append( sql, " AND %s.ctid >= '(%lu,0)'::TID", qualifier, first );
+        }
+
+        if( i < plan->num_chunks - 1 )
+        {
+            string_buffer_append( sql, " AND %s.ctid < '(%lu,0)'::TID", qualifier, last );
+        }
+
+        string_buffer_append( sql, " ) q ) TO STDOUT" );
+        plan->chunks[i] = strdup( sql->data );
+
+        if( plan->chunks[i] == NULL )
+        {
+            free_string_buffer( sql );
+            return false;
+        }
+    }
+
+    free_string_buffer( sql );
+    return true;
+}
+
+static bool _plan_hash_chunks(
+    struct maintenance_object * object,
+    struct definition *         definition,
+    struct refresh_plan *       plan
+)
+{
+    struct string_buffer * sql   = NULL;
+    unsigned int           i     = 0;
+    unsigned int           j     = 0;
+    unsigned int           count = 0;
+
+    plan->num_chunks = refresh_workers > 0 ? refresh_workers : 1;
+    plan->chunks     = ( char ** ) calloc( plan->num_chunks + 1, sizeof( char * ) );
+    sql              = new_string_buffer();
+
+    if( plan->chunks == NULL || sql == NULL )
+    {
+        free_string_buffer( sql );
+        plan->num_chunks = 0;
+        return false;
+    }
+
+    for( i = 0; i < plan->num_chunks; i++ )
+    {
+        string_buffer_reset( sql );
+        string_buffer_append( sql, "COPY ( SELECT " );
+        _append_projection( sql, object );
+        string_buffer_append( sql, " FROM ( %s ) q", definition->text );
+
+        if( plan->num_chunks > 1 )
+        {
+            string_buffer_append( sql, " WHERE ( pg_catalog.hashtext( ( " );
+
+            // Without a key, rows are spread by all of their values
+            for( j = 0, count = 0; j < object->num_columns; j++ )
+            {
+                if( object->is_key[j] || object->num_key_columns == 0 )
+                {
+                    string_buffer_append( sql, "%sq.%s", count++ > 0 ? ", " : "", object->quoted_columns[j] );
+                }
+            }
+
+            string_buffer_append(
+                sql,
+                " )::TEXT ) & 2147483647 ) %% %u = %u",
+                plan->num_chunks,
+                i
+            );
+        }
+
+        string_buffer_append( sql, " ) TO STDOUT" );
+        plan->chunks[i] = strdup( sql->data );
+
+        if( plan->chunks[i] == NULL )
+        {
+            free_string_buffer( sql );
+            return false;
+        }
+    }
+
+    free_string_buffer( sql );
+    return true;
+}
+
+// The target's columns, by name, from the definition's output q
+static void _append_projection( struct string_buffer * sql, struct maintenance_object * object )
+{
+    unsigned int i = 0;
+
+    for( i = 0; i < object->num_columns; i++ )
+    {
+        string_buffer_append( sql, "%sq.%s", i > 0 ? ", " : "", object->quoted_columns[i] );
+    }
+
+    return;
+}
+
+/*
+ * Forks min( refresh_workers, num_tasks ) children. The nth runs task over
+ * tasks n, n + children, n + 2 * children, ... with its own worker slot,
+ * connecting to the same database as me, and exits with its result. On failure, any children already started are
+ * stopped and NULL is returned.
+ */
+struct worker ** _start_children(
+    struct worker * me,
+    unsigned int num_tasks,
+    bool ( * task )( struct worker *, unsigned int, unsigned int, void * ),
+    void *       argument,
+    unsigned int * num_children
+)
+{
+    struct worker ** children    = NULL;
+    unsigned int     num_workers = 0;
+    unsigned int     started     = 0;
+    unsigned int     i           = 0;
+    pid_t            pid         = 0;
+    bool             success     = false;
+
+    num_workers = refresh_workers > 0 ? refresh_workers : 1;
+
+    if( num_workers > num_tasks )
+    {
+        num_workers = num_tasks;
+    }
+
+    children = ( struct worker ** ) calloc( num_workers + 1, sizeof( struct worker * ) );
+
+    if( children == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate refresh workers"
+        );
+
+        return NULL;
+    }
+
+    for( i = 0; i < num_workers; i++ )
+    {
+        children[i] = new_worker( WORKER_TYPE_CHILD, 0, NULL, NULL );
+
+        if( children[i] == NULL )
+        {
+            break;
+        }
+
+        children[i]->type     = WORKER_TYPE_CHILD;
+        children[i]->status   = WORKER_STATUS_STARTUP;
+        children[i]->conninfo = me->conninfo;
+        children[i]->source   = me->source;
+
+        pid = fork();
+
+        if( pid < 0 )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to fork refresh worker: %s",
+                strerror( errno )
+            );
+
+            break;
+        }
+
+        if( pid == 0 )
+        {
+            reset_signals();
+
+            // The parent's connections are inherited but not ours to use
+            children[i]->pid = getpid();
+            claim_metrics( "refresh", NULL, 0 );
+            set_worker_status( children[i], WORKER_STATUS_REFRESH );
+
+            success = task( children[i], i, num_workers, argument );
+
+            if( children[i]->conn != NULL )
+            {
+                PQfinish( children[i]->conn );
+                children[i]->conn = NULL;
+            }
+
+            free_connection_pool( ( struct connection_pool * ) children[i]->connection_pool );
+            free_statement_cache( ( struct statement_cache * ) children[i]->statement_cache );
+            children[i]->connection_pool = NULL;
+            children[i]->statement_cache = NULL;
+            children[i]->status          = WORKER_STATUS_DEAD;
+            exit( success ? 0 : 1 );
+        }
+
+        children[i]->pid = pid;
+    }
+
+    *num_children = num_workers;
+
+    if( i < num_workers )
+    {
+        // i is the slot that could not be started, the ones before it were
+        for( started = 0; started < i; started++ )
+        {
+            kill( children[started]->pid, SIGTERM );
+        }
+
+        _wait_children( children, num_workers, true );
+        _free_children( children, num_workers );
+        return NULL;
+    }
+
+    return children;
+}
+
+/*
+ * Reaps children. A reaped child's pid is set to 0 if it succeeded and -1 if
+ * it failed. Returns 0 if any are still running, otherwise 1 if all of them
+ * succeeded and -1 if not. Unless block is set this does not wait.
+ */
+int _wait_children( struct worker ** children, unsigned int num_children, bool block )
+{
+    unsigned int i       = 0;
+    int          status  = 0;
+    pid_t        result  = 0;
+    bool         running = false;
+    bool         failed  = false;
+
+    for( i = 0; i < num_children; i++ )
+    {
+        if( children[i] == NULL )
+        {
+            continue;
+        }
+
+        if( children[i]->pid > 0 )
+        {
+            result = reap_child( children[i]->pid, &status, block ? 0 : WNOHANG );
+
+            if( result == 0 )
+            {
+                running = true;
+                continue;
+            }
+
+            if( result < 0 || !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+            {
+                _log(
+                    LOG_LEVEL_ERROR,
+                    "Refresh worker %d failed",
+                    ( int ) children[i]->pid
+                );
+
+                children[i]->pid = -1;
+            }
+            else
+            {
+                children[i]->pid = 0;
+            }
+        }
+
+        if( children[i]->pid < 0 )
+        {
+            failed = true;
+        }
+    }
+
+    if( running )
+    {
+        return 0;
+    }
+
+    return failed ? -1 : 1;
+}
+
+void _free_children( struct worker ** children, unsigned int num_children )
+{
+    unsigned int i = 0;
+
+    if( children == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < num_children; i++ )
+    {
+        if( children[i] == NULL )
+        {
+            continue;
+        }
+
+        // Both pointed into the child's address space
+        children[i]->conn            = NULL;
+        children[i]->statement_cache = NULL;
+        free_worker( children[i] );
+    }
+
+    free( children );
+    return;
+}
+
+/*
+ * Runs in a refresh worker: imports the plan's snapshot on its own source
+ * connection and copies chunks first, first + step, ... into the target,
+ * committing each separately.
+ */
+static bool _copy_chunks(
+    struct worker * me,
+    unsigned int    first,
+    unsigned int    step,
+    void *          argument
+)
+{
+    struct refresh_plan * plan    = NULL;
+    PGconn *              source  = NULL;
+    unsigned int          i       = 0;
+    unsigned long         bytes   = 0;
+    bool                  success = true;
+
+    plan   = ( struct refresh_plan * ) argument;
+    source = _source_connect( me, plan->snapshot );
+
+    if( source == NULL )
+    {
+        return false;
+    }
+
+    for( i = first; i < plan->num_chunks && success; i += step )
+    {
+        bytes = 0;
+
+        if( !_begin_transaction( me ) )
+        {
+            success = false;
+            break;
+        }
+
+        if( !_copy_stream( source, plan->chunks[i], me, plan->copy_in, &bytes ) )
+        {
+            _rollback_transaction( me );
+            success = false;
+            break;
+        }
+
+        success = _commit_transaction( me );
+
+        _log(
+            LOG_LEVEL_DEBUG,
+            "Refresh chunk %u/%u copied %lu bytes",
+            i + 1,
+            plan->num_chunks,
+            bytes
+        );
+    }
+
+    PQfinish( source );
+    return success;
+}
+
+// Runs in a refresh worker: executes every step'th CREATE INDEX from first
+static bool _build_indexes(
+    struct worker * me,
+    unsigned int    first,
+    unsigned int    step,
+    void *          argument
+)
+{
+    char **      statements = NULL;
+    unsigned int i          = 0;
+
+    statements = ( char ** ) argument;
+
+    for( i = 0; statements[i] != NULL; i++ )
+    {
+        if( i % step == first && !_execute_command( me, statements[i] ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Builds the live table's indexes on the shadow table in parallel, then
+ * attaches the primary key and unique constraints to the ones that back
+ * them.
+ */
+static bool _index_shadow_table(
+    struct worker *             me,
+    struct maintenance_object * object,
+    struct shadow_refresh *     shadow
+)
+{
+    struct string_buffer * sql          = NULL;
+    struct worker **       children     = NULL;
+    PGresult *             result       = NULL;
+    char **                statements   = NULL;
+    char *                 params[3]    = {NULL};
+    char *                 index        = NULL;
+    char *                 type         = NULL;
+    unsigned int           num_children = 0;
+    unsigned int           num_rows     = 0;
+    unsigned int           i            = 0;
+    bool                   success      = false;
+
+    params[0] = object->qualified_name;
+    params[1] = shadow->qualified_name;
+    params[2] = shadow->relation;
+
+    result = _execute_query( me, ( char * ) shadow_indexes_query, params, 3 );
+
+    if( result == NULL )
+    {
+        return false;
+    }
+
+    num_rows = ( unsigned int ) PQntuples( result );
+
+    if( num_rows == 0 )
+    {
+        PQclear( result );
+        return true;
+    }
+
+    statements                 = ( char ** ) calloc( num_rows + 1, sizeof( char * ) );
+    shadow->index_names        = ( char ** ) calloc( num_rows + 1, sizeof( char * ) );
+    shadow->shadow_index_names = ( char ** ) calloc( num_rows + 1, sizeof( char * ) );
+    sql                        = new_string_buffer();
+
+    if(
+            statements == NULL
+         || shadow->index_names == NULL
+         || shadow->shadow_index_names == NULL
+         || sql == NULL
+      )
+    {
+        goto cleanup;
+    }
+
+    for( i = 0; i < num_rows; i++ )
+    {
+        shadow->index_names[i]        = strdup( PQgetvalue( result, i, 0 ) );
+        shadow->shadow_index_names[i] = strdup( PQgetvalue( result, i, 1 ) );
+        statements[i]                 = strdup( PQgetvalue( result, i, 2 ) );
+        shadow->num_indexes++;
+
+        if(
+                shadow->index_names[i] == NULL
+             || shadow->shadow_index_names[i] == NULL
+             || statements[i] == NULL
+          )
+        {
+            goto cleanup;
+        }
+    }
+
+    children = _start_children( me, num_rows, _build_indexes, statements, &num_children );
+
+    if( children == NULL )
+    {
+        goto cleanup;
+    }
+
+    success = _wait_children( children, num_children, true ) > 0;
+    _free_children( children, num_children );
+
+    for( i = 0; i < num_rows && success; i++ )
+    {
+        type = PQgetvalue( result, i, 3 );
+
+        if( type[0] == '\0' )
+        {
+            continue;
+        }
+
+        index = quote_identifier( me, shadow->shadow_index_names[i] );
+
+        if( index == NULL )
+        {
+            success = false;
+            break;
+        }
+
+        string_buffer_reset( sql );
+        string_buffer_append(
+            sql,
+            "ALTER TABLE %s ADD CONSTRAINT %s %s USING INDEX %s",
+            shadow->qualified_name,
+            index,
+            type[0] == 'p' ? "PRIMARY KEY" : "UNIQUE",
+            index
+        );
+
+        free( index );
+        success = _execute_command( me, sql->data );
+    }
+
+cleanup:
+    for( i = 0; statements != NULL && i < num_rows; i++ )
+    {
+        free( statements[i] );
+    }
+
+    free( statements );
+    free_string_buffer( sql );
+    PQclear( result );
+    return success;
+}
+
+/*
+ * In one transaction: locks the live table, replays the changes buffered
+ * during the rebuild onto the shadow table, drops the live table and renames
+ * the shadow table and its indexes into its place, then gives it the live
+ * table's grants, comments and owner, see table_settings_query. Readers see
+ * either the old table or the new one, never a partly loaded table. The
+ * DROP is not cascaded: anything else that depends on the live table makes
+ * the swap fail rather than be dropped with it.
+ */
+static bool _swap_shadow_table(
+    struct worker *             me,
+    struct maintenance_object * object,
+    struct shadow_refresh *     shadow
+)
+{
+    struct maintenance_object shadow_object = {0};
+    struct string_buffer *    sql           = NULL;
+    struct change **          changes       = NULL;
+    PGresult *                settings      = NULL;
+    char *                    schema        = NULL;
+    char *                    name          = NULL;
+    char *                    index         = NULL;
+    char *                    params[2]     = { NULL };
+    unsigned long             num_changes   = 0;
+    unsigned long             j             = 0;
+    unsigned int              i             = 0;
+    bool                      success       = false;
+
+    sql    = new_string_buffer();
+    schema = quote_identifier( me, object->namespace );
+    name   = quote_identifier( me, object->name );
+
+    if( sql == NULL || schema == NULL || name == NULL || !_begin_transaction( me ) )
+    {
+        goto cleanup;
+    }
+
+    string_buffer_append( sql, "LOCK TABLE %s IN ACCESS EXCLUSIVE MODE", object->qualified_name );
+
+    if( !_execute_command( me, sql->data ) )
+    {
+        goto cleanup;
+    }
+
+    if( !coalesce_drain( shadow->buffer, &changes, &num_changes ) )
+    {
+        goto cleanup;
+    }
+
+    // The shadow table has the live table's layout under another name
+    shadow_object                = *object;
+    shadow_object.qualified_name = shadow->qualified_name;
+    shadow_object.shadow         = NULL;
+
+    if( num_changes > 0 && !apply_changes( me, &shadow_object, changes, num_changes ) )
+    {
+        goto cleanup;
+    }
+
+    // Read off the live table while it exists, for whichever table has its name by the end
+    params[0] = object->qualified_name;
+    params[1] = object->qualified_name;
+    settings  = _execute_query( me, ( char * ) table_settings_query, params, 2 );
+
+    if( settings == NULL )
+    {
+        goto cleanup;
+    }
+
+    string_buffer_reset( sql );
+    string_buffer_append( sql, "DROP TABLE %s", object->qualified_name );
+
+    if( !_execute_command( me, sql->data ) )
+    {
+        goto cleanup;
+    }
+
+    string_buffer_reset( sql );
+    string_buffer_append( sql, "ALTER TABLE %s RENAME TO %s", shadow->qualified_name, name );
+
+    if( !_execute_command( me, sql->data ) )
+    {
+        goto cleanup;
+    }
+
+    for( i = 0; i < shadow->num_indexes; i++ )
+    {
+        free( index );
+        free( name );
+        index = quote_identifier( me, shadow->shadow_index_names[i] );
+        name  = quote_identifier( me, shadow->index_names[i] );
+
+        if( index == NULL || name == NULL )
+        {
+            goto cleanup;
+        }
+
+        string_buffer_reset( sql );
+        string_buffer_append( sql, "ALTER INDEX %s.%s RENAME TO %s", schema, index, name );
+
+        if( !_execute_command( me, sql->data ) )
+        {
+            goto cleanup;
+        }
+    }
+
+    for( j = 0; j < ( unsigned long ) PQntuples( settings ); j++ )
+    {
+        if( !_execute_command( me, PQgetvalue( settings, ( int ) j, 0 ) ) )
+        {
+            goto cleanup;
+        }
+    }
+
+    success = _commit_transaction( me );
+
+cleanup:
+    if( !success && me->tx_in_progress )
+    {
+        _rollback_transaction( me );
+    }
+
+    for( j = 0; j < num_changes; j++ )
+    {
+        free_change( changes[j] );
+    }
+
+    free( changes );
+    PQclear( settings );
+    free_string_buffer( sql );
+    free( schema );
+    free( name );
+    free( index );
+    return success;
+}
+
+static void _free_shadow_refresh( struct worker * me, struct shadow_refresh * shadow, bool drop )
+{
+    struct string_buffer * sql = NULL;
+    unsigned int           i   = 0;
+
+    if( shadow == NULL )
+    {
+        return;
+    }
+
+    if( drop && shadow->qualified_name != NULL )
+    {
+        sql = new_string_buffer();
+
+        if( sql != NULL )
+        {
+            string_buffer_append( sql, "DROP TABLE IF EXISTS %s", shadow->qualified_name );
+            _execute_command( me, sql->data );
+            free_string_buffer( sql );
+        }
+    }
+
+    for( i = 0; i < shadow->num_indexes; i++ )
+    {
+        free( shadow->index_names[i] );
+        free( shadow->shadow_index_names[i] );
+    }
+
+    PQfinish( shadow->source );
+    free_refresh_plan( shadow->plan );
+    free_coalesce_table( shadow->buffer );
+    free( shadow->index_names );
+    free( shadow->shadow_index_names );
+    free( shadow->relation );
+    free( shadow->qualified_name );
+    free( shadow );
+    return;
+}
+
+static bool _execute_command( struct worker * me, char * sql )
+{
+    PGresult * result = NULL;
+
+    result = _execute_query( me, sql, NULL, 0 );
+
+    if( result == NULL )
+    {
+        return false;
+    }
+
+    PQclear( result );
+    return true;
+}
+
+/*
+ * Connects to the source for planning. If snapshot is NULL, a snapshot is
+ * exported from a transaction held open on the returned connection, which
+ * must stay open until every child has imported it. The name of the
+ * snapshot to use is returned in name, malloc()'d.
+ */
+static PGconn * _open_snapshot( struct worker * me, char * snapshot, char ** name )
+{
+    PGconn *   source = NULL;
+    PGresult * result = NULL;
+
+    *name  = NULL;
+    source = _source_connect( me, NULL );
+
+    if( source == NULL )
+    {
+        return NULL;
+    }
+
+    if( snapshot != NULL )
+    {
+        *name = strdup( snapshot );
+        return source;
+    }
+
+    if( !_source_command( source, "BEGIN ISOLATION LEVEL REPEATABLE READ READ ONLY" ) )
+    {
+        PQfinish( source );
+        return NULL;
+    }
+
+    result = PQexec( source, export_snapshot_query );
+
+    if( PQresultStatus( result ) != PGRES_TUPLES_OK || PQntuples( result ) != 1 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to export snapshot: %s",
+            PQerrorMessage( source )
+        );
+
+        PQclear( result );
+        PQfinish( source );
+        return NULL;
+    }
+
+    *name = strdup( PQgetvalue( result, 0, 0 ) );
+    PQclear( result );
+    return source;
+}
+
+/*
+ * Reads chunks first, first + step, ... of a driver refresh, passing their
+ * rows on in runs of about DRIVER_REFRESH_BUFFER_BYTES.
+ */
+static bool _read_chunks(
+    struct worker * me,
+    unsigned int    first,
+    unsigned int    step,
+    void *          argument
+)
+{
+    struct driver_refresh * task    = NULL;
+    struct string_buffer *  buffer  = NULL;
+    PGconn *                source  = NULL;
+    PGresult *              result  = NULL;
+    void *                  target  = NULL;
+    char *                  data    = NULL;
+    unsigned int            i       = 0;
+    int                     length  = 0;
+    bool                    success = true;
+
+    task   = ( struct driver_refresh * ) argument;
+    source = _source_connect( me, task->plan->snapshot );
+    buffer = new_string_buffer();
+
+    // The parent's handle is not ours to use
+    if( source != NULL && buffer != NULL )
+    {
+        target = task->driver->open( me, task->object );
+    }
+
+    if( target == NULL )
+    {
+        free_string_buffer( buffer );
+        PQfinish( source );
+        return false;
+    }
+
+    for( i = first; i < task->plan->num_chunks && success; i += step )
+    {
+        result = PQexec( source, task->plan->chunks[i] );
+
+        if( PQresultStatus( result ) != PGRES_COPY_OUT )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Query '%s' failed: %s",
+                task->plan->chunks[i],
+                PQerrorMessage( source )
+            );
+
+            PQclear( result );
+            success = false;
+            break;
+        }
+
+        PQclear( result );
+
+        // The rest of the chunk is still read after a failure, to leave COPY mode
+        while( ( length = PQgetCopyData( source, &data, 0 ) ) > 0 )
+        {
+            string_buffer_append_bytes( buffer, data, ( size_t ) length );
+            PQfreemem( data );
+
+            if( success && buffer->length >= DRIVER_REFRESH_BUFFER_BYTES )
+            {
+                success = task->driver->refresh_chunk( target, me, task->object, buffer->data, buffer->length );
+                string_buffer_reset( buffer );
+            }
+        }
+
+        if( length == -2 )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to read COPY data: %s",
+                PQerrorMessage( source )
+            );
+
+            success = false;
+        }
+
+        while( ( result = PQgetResult( source ) ) != NULL )
+        {
+            if( PQresultStatus( result ) != PGRES_COMMAND_OK )
+            {
+                success = false;
+            }
+
+            PQclear( result );
+        }
+
+        if( success && buffer->length > 0 )
+        {
+            success = task->driver->refresh_chunk( target, me, task->object, buffer->data, buffer->length );
+        }
+
+        string_buffer_reset( buffer );
+    }
+
+    task->driver->close( target );
+    free_string_buffer( buffer );
+    PQfinish( source );
+    return success;
+}
+
+/*
+ * Opens a connection to the source, which is me's own database unless me
+ * writes to a target elsewhere, see struct worker. If snapshot is set, a
+ * read only repeatable read transaction is opened on it with that snapshot
+ * imported.
+ */
+static PGconn * _source_connect( struct worker * me, char * snapshot )
+{
+    struct string_buffer * sql     = NULL;
+    PGconn *               source  = NULL;
+    char *                 literal = NULL;
+    bool                   success = false;
+
+    if( me->source != NULL )
+    {
+        me = me->source;
+    }
+
+    source = PQconnectdb( me->conninfo != NULL ? me->conninfo : conninfo );
+
+    if( source == NULL || PQstatus( source ) != CONNECTION_OK )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to connect to source: %s",
+            source == NULL ? "out of memory" : PQerrorMessage( source )
+        );
+
+        PQfinish( source );
+        return NULL;
+    }
+
+    if( snapshot == NULL )
+    {
+        return source;
+    }
+
+    sql     = new_string_buffer();
+    literal = PQescapeLiteral( source, snapshot, strlen( snapshot ) );
+
+    if( sql != NULL && literal != NULL )
+    {
+        string_buffer_append( sql, "SET TRANSACTION SNAPSHOT %s", literal );
+
+        success = _source_command( source, "BEGIN ISOLATION LEVEL REPEATABLE READ READ ONLY" )
+               && _source_command( source, sql->data );
+    }
+
+    free_string_buffer( sql );
+    PQfreemem( literal );
+
+    if( !success )
+    {
+        PQfinish( source );
+        return NULL;
+    }
+
+    return source;
+}
+
+static bool _source_command( PGconn * source, char * command )
+{
+    PGresult * result = NULL;
+
+    result = PQexec( source, command );
+
+    if( PQresultStatus( result ) != PGRES_COMMAND_OK )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "'%s' failed on source: %s",
+            command,
+            PQerrorMessage( source )
+        );
+
+        PQclear( result );
+        return false;
+    }
+
+    PQclear( result );
+    return true;
+}
@@ -0,0 +1,84 @@
+#ifndef REFRESH_H
+#define REFRESH_H
+
+#include "util.h"
+#include "query.h"
+#include "object.h"
+#include "coalesce.h"
+#include "definition.h"
+#include "replication.h"
+
+#define DEFAULT_REFRESH_WORKERS 4
+#define REFRESH_CHUNKS_PER_WORKER 4
+#define MIN_REFRESH_CHUNK_PAGES 1024
+#define DRIVER_REFRESH_BUFFER_BYTES 1048576
+
+#define REFRESH_MODE_TRUNCATE 1
+#define REFRESH_MODE_SHADOW 2
+
+#define SHADOW_TABLE_PREFIX "__pg_ctblmgr_shadow_"
+
+extern unsigned int refresh_workers;
+extern unsigned short refresh_mode;
+
+/*
+ * How a maintenance_object's definition is split for a full refresh. Each
+ * chunk is a COPY ... TO STDOUT statement for one disjoint part of the
+ * definition's rows, to be read under snapshot; copy_in loads any of them
+ * into the table being refreshed.
+ */
+struct refresh_plan {
+    char **      chunks;
+    unsigned int num_chunks;
+    char *       copy_in;
+    char *       snapshot;
+};
+
+/*
+ * A rebuild of a maintenance_object into a shadow table. While the children
+ * load it, the live table keeps receiving changes, which are also collected
+ * in buffer to be replayed onto the shadow table before it is swapped in.
+ * The live table's indexes are rebuilt on the shadow table under temporary
+ * names, and given their original names back by the swap.
+ */
+struct shadow_refresh {
+    char *                  relation;
+    char *                  qualified_name;
+    struct refresh_plan *   plan;
+    PGconn *                source;
+    struct worker **        children;
+    unsigned int            num_children;
+    struct coalesce_table * buffer;
+    char **                 index_names;
+    char **                 shadow_index_names;
+    unsigned int            num_indexes;
+};
+
+extern bool refresh_maintenance_object( struct worker *, struct maintenance_object *, char * );
+extern bool populate_maintenance_objects(
+    struct worker *,
+    struct maintenance_object **,
+    unsigned int,
+    char *,
+    struct replication_stream **
+);
+
+extern bool begin_shadow_refresh( struct worker *, struct maintenance_object *, char * );
+extern int finish_shadow_refresh( struct worker *, struct maintenance_object *, bool );
+extern void abort_shadow_refresh( struct worker *, struct maintenance_object * );
+extern bool buffer_shadow_changes( struct maintenance_object *, struct change **, unsigned long );
+
+extern struct worker ** _start_children(
+    struct worker *,
+    unsigned int,
+    bool ( * )( struct worker *, unsigned int, unsigned int, void * ),
+    void *,
+    unsigned int *
+);
+extern int _wait_children( struct worker **, unsigned int, bool );
+extern void _free_children( struct worker **, unsigned int );
+
+extern struct refresh_plan * plan_refresh( PGconn *, struct maintenance_object *, char * );
+extern void free_refresh_plan( struct refresh_plan * );
+
+#endif // REFRESH_H
@@ -0,0 +1,557 @@
+#include "replication.h"
+#include "change.h"
+
+static const char * create_slot_command = "CREATE_REPLICATION_SLOT %s LOGICAL " REPLICATION_PLUGIN;
+static const char * drop_slot_command = "DROP_REPLICATION_SLOT %s";
+static const char * start_replication_command = "START_REPLICATION SLOT %s LOGICAL " LSN_FORMAT "%s";
+
+static PGconn * _replication_connect( char * );
+static struct replication_stream * _new_replication_stream( char *, char * );
+static uint64_t _read_uint64( const char * );
+static void _write_uint64( char *, uint64_t );
+static int64_t _current_timestamp( void );
+
+/*
+ * Creates a logical slot for pg_ctblmgr_decoder on a new walsender
+ * connection to the database described by info, or by the global conninfo
+ * when NULL. The returned stream's snapshot sees exactly the data the slot
+ * will not stream, so a copy taken under it followed by streaming from
+ * consistent_lsn neither misses nor repeats a change.
+ */
+struct replication_stream * create_replication_slot( char * info, char * slot_name )
+{
+    struct replication_stream * stream  = NULL;
+    struct string_buffer *      command = NULL;
+    PGresult *                  result  = NULL;
+    char *                      name    = NULL;
+
+    stream = _new_replication_stream( info, slot_name );
+
+    if( stream == NULL )
+    {
+        return NULL;
+    }
+
+    command = new_string_buffer();
+    name    = PQescapeIdentifier( stream->conn, slot_name, strlen( slot_name ) );
+
+    if( command == NULL || name == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to build command to create slot %s",
+            slot_name
+        );
+
+        free_string_buffer( command );
+        PQfreemem( name );
+        free_replication_stream( stream );
+        return NULL;
+    }
+
+    string_buffer_append( command, create_slot_command, name );
+    PQfreemem( name );
+
+    result = PQexec( stream->conn, command->data );
+    free_string_buffer( command );
+
+    if( PQresultStatus( result ) != PGRES_TUPLES_OK || PQntuples( result ) != 1 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to create replication slot %s: %s",
+            slot_name,
+            PQerrorMessage( stream->conn )
+        );
+
+        PQclear( result );
+        free_replication_stream( stream );
+        return NULL;
+    }
+
+    // slot_name, consistent_point, snapshot_name, output_plugin
+    if(
+            !parse_lsn( PQgetvalue( result, 0, 1 ), &( stream->consistent_lsn ) )
+         || PQgetisnull( result, 0, 2 )
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Replication slot %s was created without a consistent point or snapshot",
+            slot_name
+        );
+
+        PQclear( result );
+        free_replication_stream( stream );
+        return NULL;
+    }
+
+    stream->snapshot     = strdup( PQgetvalue( result, 0, 2 ) );
+    stream->received_lsn = stream->consistent_lsn;
+    stream->flushed_lsn  = stream->consistent_lsn;
+    PQclear( result );
+
+    _log(
+        LOG_LEVEL_INFO,
+        "Created replication slot %s, consistent at " LSN_FORMAT " with snapshot %s",
+        slot_name,
+        LSN_FORMAT_ARGS( stream->consistent_lsn ),
+        stream->snapshot
+    );
+
+    return stream;
+}
+
+// Opens a walsender connection for a slot that already exists, as above
+struct replication_stream * open_replication_stream( char * info, char * slot_name )
+{
+    return _new_replication_stream( info, slot_name );
+}
+
+/*
+ * Starts streaming from the slot at lsn. An lsn of 0 resumes from the slot's
+ * confirmed flush position.
+ */
+bool start_replication( struct replication_stream * stream, uint64_t lsn )
+{
+    struct string_buffer * command = NULL;
+    PGresult *             result  = NULL;
+    char *                 name    = NULL;
+
+    if( stream == NULL || stream->conn == NULL || stream->streaming )
+    {
+        return false;
+    }
+
+    command = new_string_buffer();
+    name    = PQescapeIdentifier( stream->conn, stream->slot_name, strlen( stream->slot_name ) );
+
+    if( command == NULL || name == NULL )
+    {
+        free_string_buffer( command );
+        PQfreemem( name );
+        return false;
+    }
+
+    string_buffer_append(
+        command,
+        start_replication_command,
+        name,
+        LSN_FORMAT_ARGS( lsn ),
+        binary_values ? " ( \"binary_values\" 'on' )" : ""
+    );
+
+    PQfreemem( name );
+
+    result = PQexec( stream->conn, command->data );
+
+    if( PQresultStatus( result ) != PGRES_COPY_BOTH )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "'%s' failed: %s",
+            command->data,
+            PQerrorMessage( stream->conn )
+        );
+
+        free_string_buffer( command );
+        PQclear( result );
+        return false;
+    }
+
+    free_string_buffer( command );
+    PQclear( result );
+
+    // The snapshot does not survive the command
+    free( stream->snapshot );
+    stream->snapshot = NULL;
+
+    if( lsn > stream->received_lsn )
+    {
+        stream->received_lsn = lsn;
+    }
+
+    if( lsn > stream->flushed_lsn )
+    {
+        stream->flushed_lsn = lsn;
+    }
+
+    stream->streaming = true;
+
+    _log(
+        LOG_LEVEL_INFO,
+        "Streaming slot %s from " LSN_FORMAT,
+        stream->slot_name,
+        LSN_FORMAT_ARGS( lsn )
+    );
+
+    return true;
+}
+
+/*
+ * Reads the next message from the stream without blocking. Returns 1 and sets
+ * data to a malloc()'d, NUL terminated copy of a decoded record and lsn to
+ * its position, 0 if no record is available, or -1 if the stream has ended
+ * or failed. Keepalives are answered here.
+ */
+int read_replication_message( struct replication_stream * stream, char ** data, uint64_t * lsn )
+{
+    PGresult * result = NULL;
+    char *     buffer = NULL;
+    int        length = 0;
+    uint64_t   start  = 0;
+
+    if( stream == NULL || !( stream->streaming ) || data == NULL )
+    {
+        return -1;
+    }
+
+    *data = NULL;
+
+    while( true )
+    {
+        length = PQgetCopyData( stream->conn, &buffer, 1 );
+
+        if( length == 0 )
+        {
+            if( PQconsumeInput( stream->conn ) == 0 )
+            {
+                _log(
+                    LOG_LEVEL_ERROR,
+                    "Failed to read from replication stream: %s",
+                    PQerrorMessage( stream->conn )
+                );
+
+                return -1;
+            }
+
+            length = PQgetCopyData( stream->conn, &buffer, 1 );
+
+            if( length == 0 )
+            {
+                return 0;
+            }
+        }
+
+        if( length < 0 )
+        {
+            if( length == -2 )
+            {
+                _log(
+                    LOG_LEVEL_ERROR,
+                    "Replication stream failed: %s",
+                    PQerrorMessage( stream->conn )
+                );
+            }
+
+            while( ( result = PQgetResult( stream->conn ) ) != NULL )
+            {
+                PQclear( result );
+            }
+
+            stream->streaming = false;
+            return -1;
+        }
+
+        // Primary keepalive: 'k', walEnd, sendTime, replyRequested
+        if( buffer[0] == 'k' && length >= 18 )
+        {
+            if( buffer[17] )
+            {
+                send_replication_feedback( stream, false );
+            }
+
+            PQfreemem( buffer );
+            continue;
+        }
+
+        // XLogData: 'w', dataStart, walEnd, sendTime, data
+        if( buffer[0] == 'w' && length >= 25 )
+        {
+            start = _read_uint64( buffer + 1 );
+
+            *data = ( char * ) calloc( ( size_t ) length - 25 + 1, sizeof( char ) );
+
+            if( *data == NULL )
+            {
+                _log(
+                    LOG_LEVEL_ERROR,
+                    "Failed to allocate %d byte replication message",
+                    length - 25
+                );
+
+                PQfreemem( buffer );
+                return -1;
+            }
+
+            memcpy( *data, buffer + 25, ( size_t ) length - 25 );
+            PQfreemem( buffer );
+
+            if( start > stream->received_lsn )
+            {
+                stream->received_lsn = start;
+            }
+
+            if( lsn != NULL )
+            {
+                *lsn = start;
+            }
+
+            return 1;
+        }
+
+        _log(
+            LOG_LEVEL_WARNING,
+            "Ignoring unknown replication message type '%c'",
+            buffer[0]
+        );
+
+        PQfreemem( buffer );
+    }
+}
+
+/*
+ * Sends a standby status update. The server may remove WAL, and will not
+ * resend changes, up to flushed_lsn, so callers only advance it once the
+ * changes before it are durable on every target.
+ */
+bool send_replication_feedback( struct replication_stream * stream, bool reply_requested )
+{
+    char message[34] = {0};
+    int  flushed     = 0;
+
+    if( stream == NULL || !( stream->streaming ) )
+    {
+        return false;
+    }
+
+    message[0] = 'r';
+    _write_uint64( message + 1, stream->received_lsn );
+    _write_uint64( message + 9, stream->flushed_lsn );
+    _write_uint64( message + 17, stream->flushed_lsn );
+    _write_uint64( message + 25, ( uint64_t ) _current_timestamp() );
+    message[33] = reply_requested ? 1 : 0;
+
+    if(
+            PQputCopyData( stream->conn, message, sizeof( message ) ) != 1
+         || ( flushed = PQflush( stream->conn ) ) < 0
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to send replication feedback: %s",
+            PQerrorMessage( stream->conn )
+        );
+
+        return false;
+    }
+
+    stream->flush_pending = flushed > 0;
+    return true;
+}
+
+/*
+ * Writes what a non-blocking connection left of earlier feedback, once its
+ * socket is writable again.
+ */
+bool flush_replication_stream( struct replication_stream * stream )
+{
+    int flushed = 0;
+
+    if( stream == NULL || stream->conn == NULL )
+    {
+        return false;
+    }
+
+    flushed = PQflush( stream->conn );
+
+    if( flushed < 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to send replication feedback: %s",
+            PQerrorMessage( stream->conn )
+        );
+
+        return false;
+    }
+
+    stream->flush_pending = flushed > 0;
+    return true;
+}
+
+/*
+ * Drops the stream's slot, so that a slot whose initial copy failed does not
+ * hold back WAL. The stream must not be streaming.
+ */
+bool drop_replication_slot( struct replication_stream * stream )
+{
+    struct string_buffer * command = NULL;
+    PGresult *             result  = NULL;
+    char *                 name    = NULL;
+    bool                   success = false;
+
+    if( stream == NULL || stream->conn == NULL || stream->streaming )
+    {
+        return false;
+    }
+
+    command = new_string_buffer();
+    name    = PQescapeIdentifier( stream->conn, stream->slot_name, strlen( stream->slot_name ) );
+
+    if( command != NULL && name != NULL )
+    {
+        string_buffer_append( command, drop_slot_command, name );
+        result  = PQexec( stream->conn, command->data );
+        success = PQresultStatus( result ) == PGRES_COMMAND_OK;
+
+        if( !success )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to drop replication slot %s: %s",
+                stream->slot_name,
+                PQerrorMessage( stream->conn )
+            );
+        }
+
+        PQclear( result );
+    }
+
+    free_string_buffer( command );
+    PQfreemem( name );
+    return success;
+}
+
+void free_replication_stream( struct replication_stream * stream )
+{
+    if( stream == NULL )
+    {
+        return;
+    }
+
+    if( stream->conn != NULL )
+    {
+        PQfinish( stream->conn );
+    }
+
+    free( stream->slot_name );
+    free( stream->snapshot );
+    free( stream );
+    return;
+}
+
+// Parses an LSN in its text form, X/X
+bool parse_lsn( const char * text, uint64_t * lsn )
+{
+    unsigned int high = 0;
+    unsigned int low  = 0;
+
+    if( text == NULL || lsn == NULL || sscanf( text, "%X/%X", &high, &low ) != 2 )
+    {
+        return false;
+    }
+
+    *lsn = ( ( uint64_t ) high << 32 ) | low;
+    return true;
+}
+
+static PGconn * _replication_connect( char * info )
+{
+    struct string_buffer * replication_conninfo = NULL;
+    PGconn *               conn                 = NULL;
+
+    replication_conninfo = new_string_buffer();
+
+    if( replication_conninfo == NULL )
+    {
+        return NULL;
+    }
+
+    string_buffer_append( replication_conninfo, "%s replication=database", info != NULL ? info : conninfo );
+    conn = PQconnectdb( replication_conninfo->data );
+    free_string_buffer( replication_conninfo );
+
+    if( conn == NULL || PQstatus( conn ) != CONNECTION_OK )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to open replication connection: %s",
+            conn == NULL ? "out of memory" : PQerrorMessage( conn )
+        );
+
+        PQfinish( conn );
+        return NULL;
+    }
+
+    return conn;
+}
+
+static struct replication_stream * _new_replication_stream( char * info, char * slot_name )
+{
+    struct replication_stream * stream = NULL;
+
+    if( slot_name == NULL )
+    {
+        return NULL;
+    }
+
+    stream = ( struct replication_stream * ) calloc( 1, sizeof( struct replication_stream ) );
+
+    if( stream == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate replication stream"
+        );
+
+        return NULL;
+    }
+
+    stream->slot_name = strdup( slot_name );
+    stream->conn      = _replication_connect( info );
+
+    if( stream->slot_name == NULL || stream->conn == NULL )
+    {
+        free_replication_stream( stream );
+        return NULL;
+    }
+
+    return stream;
+}
+
+static uint64_t _read_uint64( const char * buffer )
+{
+    uint64_t     value = 0;
+    unsigned int i     = 0;
+
+    for( i = 0; i < 8; i++ )
+    {
+        value = ( value << 8 ) | ( unsigned char ) buffer[i];
+    }
+
+    return value;
+}
+
+static void _write_uint64( char * buffer, uint64_t value )
+{
+    unsigned int i = 0;
+
+    for( i = 0; i < 8; i++ )
+    {
+        buffer[i] = ( char ) ( ( value >> ( 8 * ( 7 - i ) ) ) & 0xFF );
+    }
+
+    return;
+}
+
+// Microseconds since 2000-01-01, as the replication protocol expects
+static int64_t _current_timestamp( void )
+{
+    struct timeval tv = {0};
+
+    gettimeofday( &tv, NULL );
+
+    return ( ( int64_t ) tv.tv_sec - POSTGRES_EPOCH_OFFSET ) * 1000000L
+         + ( int64_t ) tv.tv_usec;
+}
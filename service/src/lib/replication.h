@@ -0,0 +1,46 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include "util.h"
+#include <stdint.h>
+
+#define REPLICATION_SLOT_NAME "pg_ctblmgr"
+#define REPLICATION_PLUGIN "pg_ctblmgr_decoder"
+
+#define LSN_FORMAT "%X/%X"
+#define LSN_FORMAT_ARGS( lsn ) ( unsigned int ) ( ( lsn ) >> 32 ), ( unsigned int ) ( lsn )
+
+// Seconds between 1970-01-01 and 2000-01-01, the epoch of the protocol's timestamps
+#define POSTGRES_EPOCH_OFFSET 946684800L
+
+/*
+ * A walsender connection and the position of the stream on it. snapshot is
+ * the name of the snapshot exported when the slot was created; it remains
+ * importable until the next command is sent on conn, so the slot's initial
+ * copy must be taken before start_replication() is called. On a non-blocking
+ * conn, flush_pending is set while feedback is still waiting to be written,
+ * see flush_replication_stream().
+ */
+struct replication_stream {
+    PGconn * conn;
+    char *   slot_name;
+    char *   snapshot;
+    uint64_t consistent_lsn;
+    uint64_t received_lsn;
+    uint64_t flushed_lsn;
+    bool     streaming;
+    bool     flush_pending;
+};
+
+extern struct replication_stream * create_replication_slot( char *, char * );
+extern struct replication_stream * open_replication_stream( char *, char * );
+extern bool start_replication( struct replication_stream *, uint64_t );
+extern int read_replication_message( struct replication_stream *, char **, uint64_t * );
+extern bool send_replication_feedback( struct replication_stream *, bool );
+extern bool flush_replication_stream( struct replication_stream * );
+extern bool drop_replication_slot( struct replication_stream * );
+extern void free_replication_stream( struct replication_stream * );
+
+extern bool parse_lsn( const char *, uint64_t * );
+
+#endif // REPLICATION_H
@@ -0,0 +1,973 @@
+#include "spill.h"
+
+uint64_t spill_memory_limit = DEFAULT_SPILL_MEMORY_LIMIT;
+char *   spill_directory    = DEFAULT_SPILL_DIRECTORY;
+
+static bool _recover_segments( struct spill_queue * );
+static struct spill_segment * _open_segment( struct spill_queue *, unsigned long, size_t );
+static bool _map_segment( struct spill_segment * );
+static bool _sync_segment( struct spill_queue *, struct spill_segment * );
+static void _free_segment( struct spill_segment *, bool );
+static bool _add_commit( struct spill_queue *, uint64_t, struct spill_segment *, size_t );
+static bool _write_confirmed( struct spill_segment *, uint64_t );
+static void _read_ahead( struct spill_queue * );
+static void _compact_memory( struct spill_queue * );
+static char * _segment_path( struct spill_queue *, unsigned long );
+static int _compare_sequence( const void *, const void * );
+
+/*
+ * Returns an empty queue, or one holding the unconfirmed frames of segments
+ * a queue of the same name left behind, from the first one not confirmed.
+ * Any frames after the last synced with them are lost, so the stream needs
+ * to be resumed from durable_lsn.
+ */
+struct spill_queue * new_spill_queue( char * name )
+{
+    struct spill_queue * queue = NULL;
+
+    if( name == NULL )
+    {
+        return NULL;
+    }
+
+    queue = ( struct spill_queue * ) calloc( 1, sizeof( struct spill_queue ) );
+
+    if( queue == NULL )
+    {
+        return NULL;
+    }
+
+    queue->name   = strdup( name );
+    queue->memory = new_string_buffer();
+
+    if( queue->name == NULL || queue->memory == NULL || !_recover_segments( queue ) )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to create queue %s",
+            name
+        );
+
+        free_spill_queue( queue, false );
+        return NULL;
+    }
+
+    return queue;
+}
+
+/*
+ * Appends the frame of data at lsn. is_commit marks a COMMIT, which the
+ * frames up to are confirmed and made durable at.
+ */
+bool spill_queue_push(
+    struct spill_queue * queue,
+    uint64_t             lsn,
+    char *               data,
+    uint32_t             length,
+    bool                 is_commit
+)
+{
+    struct spill_segment * segment = NULL;
+    size_t                 frame   = 0;
+
+    if( queue == NULL || data == NULL )
+    {
+        return false;
+    }
+
+    frame = SPILL_FRAME_HEADER_LENGTH + length;
+
+    // The COMMIT ending the last transaction started in memory
+    if( is_commit && queue->memory_open )
+    {
+        queue->memory_lsn  = lsn;
+        queue->memory_open = false;
+    }
+
+    if( queue->head == NULL && queue->memory->length - queue->memory_read + frame <= spill_memory_limit )
+    {
+        _compact_memory( queue );
+
+        if(
+                !string_buffer_append_bytes( queue->memory, ( char * ) &lsn, sizeof( uint64_t ) )
+             || !string_buffer_append_bytes( queue->memory, ( char * ) &length, sizeof( uint32_t ) )
+             || !string_buffer_append_bytes( queue->memory, data, length )
+          )
+        {
+            return false;
+        }
+
+        if( !is_commit )
+        {
+            queue->memory_open = true;
+        }
+
+        return true;
+    }
+
+    segment = queue->tail;
+
+    if( segment == NULL || segment->length + frame > segment->size )
+    {
+        // What precedes the new segment has to be on disk before it
+        if( segment != NULL && !_sync_segment( queue, segment ) )
+        {
+            return false;
+        }
+
+        segment = _open_segment(
+            queue,
+            queue->next_segment,
+            frame + sizeof( struct spill_segment_header ) > SPILL_SEGMENT_BYTES
+                ? frame + sizeof( struct spill_segment_header )
+                : SPILL_SEGMENT_BYTES
+        );
+
+        if( segment == NULL )
+        {
+            return false;
+        }
+
+        queue->next_segment++;
+
+        if( queue->tail == NULL )
+        {
+            queue->head = segment;
+        }
+        else
+        {
+            queue->tail->next = segment;
+        }
+
+        queue->tail = segment;
+
+        if( queue->reading == NULL )
+        {
+            queue->reading = segment;
+            queue->read    = segment->length;
+        }
+    }
+
+    if( segment->map == NULL && !_map_segment( segment ) )
+    {
+        return false;
+    }
+
+    memcpy( segment->map + segment->length, &lsn, sizeof( uint64_t ) );
+    memcpy( segment->map + segment->length + sizeof( uint64_t ), &length, sizeof( uint32_t ) );
+    memcpy( segment->map + segment->length + SPILL_FRAME_HEADER_LENGTH, data, length );
+    segment->length += frame;
+
+    if( is_commit )
+    {
+        segment->commit_lsn = lsn;
+        return _add_commit( queue, lsn, segment, segment->length );
+    }
+
+    return true;
+}
+
+/*
+ * Points data at the next unread frames, length bytes of them, which run to
+ * the end of what is in memory or in one segment. Returns false when all of
+ * the queue has been read.
+ */
+bool spill_queue_peek( struct spill_queue * queue, char ** data, size_t * length )
+{
+    struct spill_segment * segment = NULL;
+
+    if( queue == NULL || data == NULL || length == NULL )
+    {
+        return false;
+    }
+
+    if( queue->memory_read < queue->memory->length )
+    {
+        *data   = queue->memory->data + queue->memory_read;
+        *length = queue->memory->length - queue->memory_read;
+        return true;
+    }
+
+    while( queue->reading != NULL )
+    {
+        segment = queue->reading;
+
+        if( queue->read < segment->length )
+        {
+            if( segment->map == NULL && !_map_segment( segment ) )
+            {
+                return false;
+            }
+
+            _read_ahead( queue );
+
+            *data   = segment->map + queue->read;
+            *length = segment->length - queue->read;
+            return true;
+        }
+
+        if( segment->next == NULL )
+        {
+            break;
+        }
+
+        // Read through; it is only kept until it is confirmed
+        if( segment->map != NULL )
+        {
+            munmap( segment->map, segment->size );
+            segment->map = NULL;
+        }
+
+        queue->reading = segment->next;
+        queue->read    = queue->reading->confirmed;
+    }
+
+    return false;
+}
+
+// Bytes of frames queued and not yet read, in memory and on disk
+uint64_t spill_queue_length( struct spill_queue * queue )
+{
+    struct spill_segment * segment = NULL;
+    uint64_t               length  = 0;
+
+    if( queue == NULL )
+    {
+        return 0;
+    }
+
+    length = queue->memory->length - queue->memory_read;
+
+    for( segment = queue->reading; segment != NULL; segment = segment->next )
+    {
+        length += segment->length - ( segment == queue->reading ? queue->read : segment->confirmed );
+    }
+
+    return length;
+}
+
+// Marks length bytes of what spill_queue_peek() returned as read
+void spill_queue_consume( struct spill_queue * queue, size_t length )
+{
+    if( queue == NULL )
+    {
+        return;
+    }
+
+    if( queue->memory_read < queue->memory->length )
+    {
+        queue->memory_read += length;
+        _compact_memory( queue );
+        return;
+    }
+
+    queue->read += length;
+    return;
+}
+
+/*
+ * Drops what has been read off the front of the queue's memory, once it is
+ * all of it, or at least SPILL_COMPACT_BYTES and more than is left unread,
+ * which is moved to the front. spill_memory_limit only counts unread bytes,
+ * so without this a queue that is never read to the end would grow without
+ * bound; with it, memory holds at most twice that limit, and each byte is
+ * moved less often than it is read.
+ */
+static void _compact_memory( struct spill_queue * queue )
+{
+    size_t unread = 0;
+
+    unread = queue->memory->length - queue->memory_read;
+
+    if( unread == 0 )
+    {
+        string_buffer_reset( queue->memory );
+        queue->memory_read = 0;
+        return;
+    }
+
+    if( queue->memory_read < SPILL_COMPACT_BYTES || queue->memory_read <= unread )
+    {
+        return;
+    }
+
+    memmove( queue->memory->data, queue->memory->data + queue->memory_read, unread );
+    queue->memory->length       = unread;
+    queue->memory->data[unread] = '\0';
+    queue->memory_read          = 0;
+    return;
+}
+
+/*
+ * Records that transactions up to the COMMIT at lsn have been applied, and
+ * deletes segments all of whose frames have been read and applied. Once the
+ * last of them is gone, frames are kept in memory again.
+ */
+bool spill_queue_confirm( struct spill_queue * queue, uint64_t lsn )
+{
+    struct spill_commit *  commit  = NULL;
+    struct spill_segment * segment = NULL;
+    bool                   success = true;
+
+    if( queue == NULL )
+    {
+        return false;
+    }
+
+    if( lsn > queue->confirmed_lsn )
+    {
+        queue->confirmed_lsn = lsn;
+    }
+
+    while( queue->num_commits > 0 )
+    {
+        commit = &( queue->commits[queue->first_commit] );
+
+        if( commit->lsn > lsn )
+        {
+            break;
+        }
+
+        // Segments before the COMMIT's only hold frames leading up to it
+        for( segment = queue->head; segment != commit->segment; segment = segment->next )
+        {
+            segment->confirmed = segment->length;
+        }
+
+        commit->segment->confirmed = commit->offset;
+        success = _write_confirmed( commit->segment, commit->lsn ) && success;
+
+        queue->first_commit = ( queue->first_commit + 1 ) % queue->commits_size;
+        queue->num_commits--;
+    }
+
+    while(
+            queue->head != NULL
+         && queue->head->confirmed >= queue->head->length
+         && ( queue->head != queue->reading || queue->read >= queue->head->length )
+         )
+    {
+        segment     = queue->head;
+        queue->head = segment->next;
+
+        if( queue->reading == segment )
+        {
+            queue->reading = segment->next;
+            queue->read    = segment->next != NULL ? segment->next->confirmed : 0;
+        }
+
+        if( queue->tail == segment )
+        {
+            queue->tail = NULL;
+        }
+
+        _free_segment( segment, true );
+    }
+
+    return success;
+}
+
+/*
+ * Writes what has been appended to the last segment through to the disk,
+ * which lets the slot be confirmed past it.
+ */
+bool spill_queue_sync( struct spill_queue * queue )
+{
+    if( queue == NULL )
+    {
+        return false;
+    }
+
+    if( queue->tail == NULL || queue->tail->synced == queue->tail->length )
+    {
+        return true;
+    }
+
+    return _sync_segment( queue, queue->tail );
+}
+
+/*
+ * The position up to which every transaction the queue has been given has
+ * either been applied or is on disk, and need not be streamed again.
+ */
+uint64_t spill_queue_safe_lsn( struct spill_queue * queue )
+{
+    if( queue == NULL )
+    {
+        return 0;
+    }
+
+    if(
+            queue->head == NULL
+         || queue->memory_open
+         || queue->memory_lsn > queue->confirmed_lsn
+         || queue->durable_lsn < queue->confirmed_lsn
+      )
+    {
+        return queue->confirmed_lsn;
+    }
+
+    return queue->durable_lsn;
+}
+
+/*
+ * Frees queue. Its segments are left for the next queue of the same name,
+ * unless discard is set.
+ */
+void free_spill_queue( struct spill_queue * queue, bool discard )
+{
+    struct spill_segment * segment = NULL;
+
+    if( queue == NULL )
+    {
+        return;
+    }
+
+    while( queue->head != NULL )
+    {
+        segment     = queue->head;
+        queue->head = segment->next;
+
+        if( !discard )
+        {
+            _sync_segment( queue, segment );
+        }
+
+        _free_segment( segment, discard );
+    }
+
+    free_string_buffer( queue->memory );
+    free( queue->commits );
+    free( queue->name );
+    free( queue );
+    return;
+}
+
+/*
+ * Picks up the segments of queue's name in spill_directory, in the order
+ * they were written. Segments that were entirely confirmed are deleted.
+ */
+static bool _recover_segments( struct spill_queue * queue )
+{
+    DIR *                         dir         = NULL;
+    struct dirent *               entry       = NULL;
+    struct spill_segment *        segment     = NULL;
+    struct spill_segment_header * header      = NULL;
+    struct string_buffer *        prefix      = NULL;
+    unsigned long *               sequences   = NULL;
+    unsigned long *               temp        = NULL;
+    unsigned long                 num_found   = 0;
+    unsigned long                 size        = 0;
+    unsigned long                 i           = 0;
+    char *                        end         = NULL;
+    bool                          success     = false;
+
+    prefix = new_string_buffer();
+    dir    = opendir( spill_directory );
+
+    if( prefix == NULL || dir == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to open spill directory %s: %s",
+            spill_directory,
+            dir == NULL ? strerror( errno ) : "out of memory"
+        );
+
+        goto cleanup;
+    }
+
+    string_buffer_append( prefix, "%s%s.", SPILL_FILE_PREFIX, queue->name );
+
+    while( ( entry = readdir( dir ) ) != NULL )
+    {
+        if( strncmp( entry->d_name, prefix->data, prefix->length ) != 0 )
+        {
+            continue;
+        }
+
+        if( num_found == size )
+        {
+            size = size == 0 ? 16 : size * 2;
+            temp = ( unsigned long * ) realloc( sequences, sizeof( unsigned long ) * size );
+
+            if( temp == NULL )
+            {
+                goto cleanup;
+            }
+
+            sequences = temp;
+        }
+
+        sequences[num_found] = strtoul( entry->d_name + prefix->length, &end, 10 );
+
+        if( *end == '\0' )
+        {
+            num_found++;
+        }
+    }
+
+    qsort( sequences, num_found, sizeof( unsigned long ), _compare_sequence );
+
+    for( i = 0; i < num_found; i++ )
+    {
+        segment = _open_segment( queue, sequences[i], 0 );
+
+        if( segment == NULL )
+        {
+            goto cleanup;
+        }
+
+        header = ( struct spill_segment_header * ) segment->map;
+
+        if(
+                segment->size < sizeof( struct spill_segment_header )
+             || header->magic != SPILL_SEGMENT_MAGIC
+             || header->length > segment->size
+             || header->confirmed_offset > header->length
+          )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "%s is not a valid queue segment",
+                segment->path
+            );
+
+            _free_segment( segment, false );
+            goto cleanup;
+        }
+
+        segment->length     = ( size_t ) header->length;
+        segment->synced     = segment->length;
+        segment->confirmed  = ( size_t ) header->confirmed_offset;
+        segment->commit_lsn = header->commit_lsn;
+
+        if( header->confirmed_lsn > queue->confirmed_lsn )
+        {
+            queue->confirmed_lsn = header->confirmed_lsn;
+        }
+
+        if( header->commit_lsn > queue->durable_lsn )
+        {
+            queue->durable_lsn = header->commit_lsn;
+        }
+
+        queue->next_segment = sequences[i] + 1;
+
+        if( segment->confirmed >= segment->length )
+        {
+            _free_segment( segment, true );
+            continue;
+        }
+
+        if( segment->commit_lsn > 0 && !_add_commit( queue, segment->commit_lsn, segment, segment->length ) )
+        {
+            _free_segment( segment, false );
+            goto cleanup;
+        }
+
+        if( queue->tail == NULL )
+        {
+            queue->head    = segment;
+            queue->reading = segment;
+            queue->read    = segment->confirmed;
+        }
+        else
+        {
+            queue->tail->next = segment;
+        }
+
+        queue->tail = segment;
+
+        _log(
+            LOG_LEVEL_INFO,
+            "Recovered %zu bytes of changes up to " LSN_FORMAT " from %s",
+            segment->length - segment->confirmed,
+            LSN_FORMAT_ARGS( segment->commit_lsn ),
+            segment->path
+        );
+    }
+
+    success = true;
+
+cleanup:
+    if( dir != NULL )
+    {
+        closedir( dir );
+    }
+
+    free_string_buffer( prefix );
+    free( sequences );
+    return success;
+}
+
+/*
+ * Opens segment sequence of queue. With a size it is created that large,
+ * otherwise the existing one is opened.
+ */
+static struct spill_segment * _open_segment(
+    struct spill_queue * queue,
+    unsigned long        sequence,
+    size_t               size
+)
+{
+    struct spill_segment *      segment = NULL;
+    struct spill_segment_header header;
+    struct stat                 status;
+    int                         dir     = -1;
+
+    segment = ( struct spill_segment * ) calloc( 1, sizeof( struct spill_segment ) );
+
+    if( segment == NULL )
+    {
+        return NULL;
+    }
+
+    segment->fd   = -1;
+    segment->path = _segment_path( queue, sequence );
+
+    if( segment->path == NULL )
+    {
+        _free_segment( segment, false );
+        return NULL;
+    }
+
+    if( size > 0 )
+    {
+        segment->fd = open( segment->path, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR );
+    }
+    else
+    {
+        segment->fd = open( segment->path, O_RDWR );
+    }
+
+    if(
+            segment->fd < 0
+         || ( size > 0 && ftruncate( segment->fd, ( off_t ) size ) != 0 )
+         || fstat( segment->fd, &status ) != 0
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to open queue segment %s: %s",
+            segment->path,
+            strerror( errno )
+        );
+
+        _free_segment( segment, size > 0 && segment->fd >= 0 );
+        return NULL;
+    }
+
+    segment->size = ( size_t ) status.st_size;
+
+    if( size > 0 )
+    {
+        memset( &header, 0, sizeof( struct spill_segment_header ) );
+        header.magic            = SPILL_SEGMENT_MAGIC;
+        header.length           = sizeof( struct spill_segment_header );
+        header.confirmed_offset = sizeof( struct spill_segment_header );
+
+        segment->length    = sizeof( struct spill_segment_header );
+        segment->synced    = segment->length;
+        segment->confirmed = segment->length;
+
+        // The header and the file's directory entry must be there to recover it
+        dir = open( spill_directory, O_RDONLY | O_DIRECTORY );
+
+        if(
+                pwrite( segment->fd, &header, sizeof( header ), 0 ) != sizeof( header )
+             || fsync( segment->fd ) != 0
+             || dir < 0
+             || fsync( dir ) != 0
+          )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to create queue segment %s: %s",
+                segment->path,
+                strerror( errno )
+            );
+
+            if( dir >= 0 )
+            {
+                close( dir );
+            }
+
+            _free_segment( segment, true );
+            return NULL;
+        }
+
+        close( dir );
+    }
+
+    if( segment->size >= sizeof( struct spill_segment_header ) && !_map_segment( segment ) )
+    {
+        _free_segment( segment, size > 0 );
+        return NULL;
+    }
+
+    return segment;
+}
+
+static bool _map_segment( struct spill_segment * segment )
+{
+    void * map = NULL;
+
+    map = mmap( NULL, segment->size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0 );
+
+    if( map == MAP_FAILED )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to map queue segment %s: %s",
+            segment->path,
+            strerror( errno )
+        );
+
+        return false;
+    }
+
+    // Segments are written once and read once, front to back
+    madvise( map, segment->size, MADV_SEQUENTIAL );
+
+    segment->map        = ( char * ) map;
+    segment->read_ahead = 0;
+    return true;
+}
+
+/*
+ * Flushes segment's unsynced frames, then its header, so the header never
+ * covers frames that did not make it to disk.
+ */
+static bool _sync_segment( struct spill_queue * queue, struct spill_segment * segment )
+{
+    struct spill_segment_header * header = NULL;
+    size_t                        page   = 0;
+    size_t                        start  = 0;
+
+    if( segment->map == NULL || segment->synced == segment->length )
+    {
+        return true;
+    }
+
+    page  = ( size_t ) sysconf( _SC_PAGESIZE );
+    start = segment->synced - segment->synced % page;
+
+    if( msync( segment->map + start, segment->length - start, MS_SYNC ) != 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to sync queue segment %s: %s",
+            segment->path,
+            strerror( errno )
+        );
+
+        return false;
+    }
+
+    header             = ( struct spill_segment_header * ) segment->map;
+    header->length     = segment->length;
+    header->commit_lsn = segment->commit_lsn;
+
+    if( msync( segment->map, sizeof( struct spill_segment_header ), MS_SYNC ) != 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to sync queue segment %s: %s",
+            segment->path,
+            strerror( errno )
+        );
+
+        return false;
+    }
+
+    segment->synced = segment->length;
+
+    if( segment->commit_lsn > queue->durable_lsn )
+    {
+        queue->durable_lsn = segment->commit_lsn;
+    }
+
+    return true;
+}
+
+static void _free_segment( struct spill_segment * segment, bool remove )
+{
+    if( segment->map != NULL )
+    {
+        munmap( segment->map, segment->size );
+    }
+
+    if( segment->fd >= 0 )
+    {
+        close( segment->fd );
+    }
+
+    if( remove && segment->path != NULL && unlink( segment->path ) != 0 )
+    {
+        _log(
+            LOG_LEVEL_WARNING,
+            "Failed to remove queue segment %s: %s",
+            segment->path,
+            strerror( errno )
+        );
+    }
+
+    free( segment->path );
+    free( segment );
+    return;
+}
+
+// Remembers a COMMIT written to segment, in a ring that grows as needed
+static bool _add_commit(
+    struct spill_queue *   queue,
+    uint64_t               lsn,
+    struct spill_segment * segment,
+    size_t                 offset
+)
+{
+    struct spill_commit * commits = NULL;
+    struct spill_commit * entry   = NULL;
+    unsigned long         size    = 0;
+    unsigned long         i       = 0;
+
+    if( queue->num_commits == queue->commits_size )
+    {
+        size    = queue->commits_size == 0 ? 1024 : queue->commits_size * 2;
+        commits = ( struct spill_commit * ) calloc( size, sizeof( struct spill_commit ) );
+
+        if( commits == NULL )
+        {
+            return false;
+        }
+
+        for( i = 0; i < queue->num_commits; i++ )
+        {
+            commits[i] = queue->commits[( queue->first_commit + i ) % queue->commits_size];
+        }
+
+        free( queue->commits );
+        queue->commits      = commits;
+        queue->commits_size = size;
+        queue->first_commit = 0;
+    }
+
+    entry          = &( queue->commits[( queue->first_commit + queue->num_commits ) % queue->commits_size] );
+    entry->lsn     = lsn;
+    entry->segment = segment;
+    entry->offset  = offset;
+    queue->num_commits++;
+    return true;
+}
+
+/*
+ * Records segment's confirmed frames in its header. This is not synced:
+ * losing it only means that frames which were applied are read again.
+ */
+static bool _write_confirmed( struct spill_segment * segment, uint64_t lsn )
+{
+    uint64_t offset = 0;
+
+    offset = segment->confirmed;
+
+    if(
+            pwrite(
+                segment->fd,
+                &offset,
+                sizeof( uint64_t ),
+                offsetof( struct spill_segment_header, confirmed_offset )
+            ) != sizeof( uint64_t )
+         || pwrite(
+                segment->fd,
+                &lsn,
+                sizeof( uint64_t ),
+                offsetof( struct spill_segment_header, confirmed_lsn )
+            ) != sizeof( uint64_t )
+      )
+    {
+        _log(
+            LOG_LEVEL_WARNING,
+            "Failed to update queue segment %s: %s",
+            segment->path,
+            strerror( errno )
+        );
+
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Asks for the next SPILL_READAHEAD_BYTES of the segment being read to be
+ * read in once half of the last range has been, and lets go of the pages
+ * already read.
+ */
+static void _read_ahead( struct spill_queue * queue )
+{
+    struct spill_segment * segment = NULL;
+    size_t                 page    = 0;
+    size_t                 start   = 0;
+    size_t                 end     = 0;
+
+    segment = queue->reading;
+
+    if( queue->read + SPILL_READAHEAD_BYTES / 2 < segment->read_ahead )
+    {
+        return;
+    }
+
+    page  = ( size_t ) sysconf( _SC_PAGESIZE );
+    start = queue->read - queue->read % page;
+    end   = start + SPILL_READAHEAD_BYTES;
+
+    if( end > segment->length )
+    {
+        end = segment->length;
+    }
+
+    madvise( segment->map + start, end - start, MADV_WILLNEED );
+
+    // Those below the header's page are never needed again
+    if( segment != queue->tail && start > page )
+    {
+        madvise( segment->map + page, start - page, MADV_DONTNEED );
+    }
+
+    segment->read_ahead = end;
+    return;
+}
+
+static char * _segment_path( struct spill_queue * queue, unsigned long sequence )
+{
+    struct string_buffer * path   = NULL;
+    char *                 result = NULL;
+
+    path = new_string_buffer();
+
+    if( path == NULL )
+    {
+        return NULL;
+    }
+
+    string_buffer_append(
+        path,
+        "%s/%s%s.%08lu",
+        spill_directory,
+        SPILL_FILE_PREFIX,
+        queue->name,
+        sequence
+    );
+
+    result = strdup( path->data );
+    free_string_buffer( path );
+    return result;
+}
+
+static int _compare_sequence( const void * left, const void * right )
+{
+    unsigned long a = *( ( const unsigned long * ) left );
+    unsigned long b = *( ( const unsigned long * ) right );
+
+    return ( a > b ) - ( a < b );
+}
@@ -0,0 +1,110 @@
+#ifndef SPILL_H
+#define SPILL_H
+
+#include "util.h"
+#include "replication.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+
+#define DEFAULT_SPILL_MEMORY_LIMIT 16777216
+#define DEFAULT_SPILL_DIRECTORY "/var/tmp"
+#define SPILL_SEGMENT_BYTES 67108864
+#define SPILL_READAHEAD_BYTES 4194304
+// Bytes read off the front of a queue's memory before they may be dropped from it
+#define SPILL_COMPACT_BYTES 65536
+#define SPILL_SEGMENT_MAGIC 0x314c5053 // "SPL1"
+#define SPILL_FILE_PREFIX "pg_ctblmgr."
+
+// A frame is its LSN, the length of its data and the data
+#define SPILL_FRAME_HEADER_LENGTH ( sizeof( uint64_t ) + sizeof( uint32_t ) )
+
+extern uint64_t spill_memory_limit;
+extern char * spill_directory;
+
+/*
+ * The start of a segment file, followed by frames up to length. commit_lsn
+ * is that of the last COMMIT among them; both are only updated once the
+ * frames are synced. Frames before confirmed_offset have been applied, up
+ * to the COMMIT at confirmed_lsn.
+ */
+struct spill_segment_header {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t length;
+    uint64_t commit_lsn;
+    uint64_t confirmed_offset;
+    uint64_t confirmed_lsn;
+};
+
+/*
+ * A segment file mapped at map, size bytes long. Frames are appended at
+ * length, of which synced have reached the disk. read_ahead is the end of
+ * the range last advised to be read in.
+ */
+struct spill_segment {
+    char *                 path;
+    int                    fd;
+    char *                 map;
+    size_t                 size;
+    size_t                 length;
+    size_t                 synced;
+    size_t                 read_ahead;
+    size_t                 confirmed;
+    uint64_t               commit_lsn;
+    struct spill_segment * next;
+};
+
+// A COMMIT written to segment, ending at offset, and not yet confirmed
+struct spill_commit {
+    uint64_t               lsn;
+    struct spill_segment * segment;
+    size_t                 offset;
+};
+
+/*
+ * A FIFO of frames, held in memory up to spill_memory_limit unread bytes and
+ * appended to segment files in spill_directory beyond that. Once anything
+ * has spilled, later frames follow it to disk until every segment has been
+ * read and confirmed, so frames in memory are always older than those on
+ * disk. Frames are read from memory, then from the segments from head on,
+ * reading being the one read from at offset read.
+ *
+ * A segment is deleted once the frames in it are confirmed, that is, the
+ * COMMITs they lead up to have been applied. Until then segments outlive the
+ * process: a queue of the same name picks them up again, see
+ * new_spill_queue(). The slot can therefore be confirmed to durable_lsn, the
+ * last COMMIT synced to a segment, once every frame kept in memory (which
+ * would be lost) has been confirmed; memory_lsn is the COMMIT that ends the
+ * last of those, unless that COMMIT is yet to come.
+ */
+struct spill_queue {
+    char *                 name;
+    struct string_buffer * memory;
+    size_t                 memory_read;
+    uint64_t               memory_lsn;
+    bool                   memory_open;
+    struct spill_segment * head;
+    struct spill_segment * tail;
+    struct spill_segment * reading;
+    size_t                 read;
+    struct spill_commit *  commits;
+    unsigned long          first_commit;
+    unsigned long          num_commits;
+    unsigned long          commits_size;
+    unsigned long          next_segment;
+    uint64_t               confirmed_lsn;
+    uint64_t               durable_lsn;
+};
+
+extern struct spill_queue * new_spill_queue( char * );
+extern bool spill_queue_push( struct spill_queue *, uint64_t, char *, uint32_t, bool );
+extern bool spill_queue_peek( struct spill_queue *, char **, size_t * );
+extern void spill_queue_consume( struct spill_queue *, size_t );
+extern uint64_t spill_queue_length( struct spill_queue * );
+extern bool spill_queue_confirm( struct spill_queue *, uint64_t );
+extern bool spill_queue_sync( struct spill_queue * );
+extern uint64_t spill_queue_safe_lsn( struct spill_queue * );
+extern void free_spill_queue( struct spill_queue *, bool );
+
+#endif // SPILL_H
@@ -0,0 +1,352 @@
+#include "statement_cache.h"
+#include "query.h"
+
+static unsigned long _hash_statement( unsigned int, unsigned short, char * );
+static struct statement_cache * _get_cache( struct worker * );
+static void _free_statement( struct prepared_statement * );
+
+struct statement_cache * new_statement_cache( void )
+{
+    struct statement_cache * cache = NULL;
+
+    cache = ( struct statement_cache * ) calloc(
+        1,
+        sizeof( struct statement_cache )
+    );
+
+    if( cache == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate statement cache"
+        );
+    }
+
+    return cache;
+}
+
+void free_statement_cache( struct statement_cache * cache )
+{
+    struct prepared_statement * statement = NULL;
+    struct prepared_statement * next      = NULL;
+    unsigned int                i         = 0;
+
+    if( cache == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < STATEMENT_CACHE_BUCKETS; i++ )
+    {
+        for( statement = cache->buckets[i]; statement != NULL; statement = next )
+        {
+            next = statement->next;
+            _free_statement( statement );
+        }
+    }
+
+    free( cache );
+    return;
+}
+
+/*
+ * Looks up the statement for (object, operation, columns) in me's cache,
+ * adding it if it is not there yet. columns is any string that uniquely
+ * identifies the column set the statement covers, query is the statement's
+ * text and is only used when the entry is created. The statement is prepared
+ * on me's connection if it has not been already.
+ */
+struct prepared_statement * get_prepared_statement(
+    struct worker * me,
+    unsigned int    maintenance_object,
+    unsigned short  operation,
+    char *          columns,
+    char *          query,
+    int             num_params,
+    Oid *           param_types
+)
+{
+    struct statement_cache *    cache     = NULL;
+    struct prepared_statement * statement = NULL;
+    unsigned long               hash      = 0;
+    unsigned int                bucket    = 0;
+
+    if( me == NULL || columns == NULL || query == NULL )
+    {
+        return NULL;
+    }
+
+    cache = _get_cache( me );
+
+    if( cache == NULL )
+    {
+        return NULL;
+    }
+
+    hash   = _hash_statement( maintenance_object, operation, columns );
+    bucket = ( unsigned int ) ( hash % STATEMENT_CACHE_BUCKETS );
+
+    for( statement = cache->buckets[bucket]; statement != NULL; statement = statement->next )
+    {
+        if(
+                statement->hash == hash
+             && statement->maintenance_object == maintenance_object
+             && statement->operation == operation
+             && strcmp( statement->columns, columns ) == 0
+          )
+        {
+            break;
+        }
+    }
+
+    if( statement == NULL )
+    {
+        statement = ( struct prepared_statement * ) calloc(
+            1,
+            sizeof( struct prepared_statement )
+        );
+
+        if( statement == NULL )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to allocate prepared statement"
+            );
+
+            return NULL;
+        }
+
+        statement->maintenance_object = maintenance_object;
+        statement->operation          = operation;
+        statement->hash               = hash;
+        statement->num_params         = num_params;
+        statement->columns            = strdup( columns );
+        statement->query              = strdup( query );
+
+        if( param_types != NULL )
+        {
+            statement->param_types = ( Oid * ) calloc( num_params + 1, sizeof( Oid ) );
+
+            if( statement->param_types != NULL )
+            {
+                memcpy( statement->param_types, param_types, sizeof( Oid ) * num_params );
+            }
+        }
+
+        snprintf(
+            statement->name,
+            sizeof( statement->name ),
+            STATEMENT_NAME_PREFIX "%u_%hu_%lu",
+            maintenance_object,
+            operation,
+            cache->next_id++
+        );
+
+        if(
+                statement->columns == NULL
+             || statement->query == NULL
+             || ( param_types != NULL && statement->param_types == NULL )
+          )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to allocate prepared statement"
+            );
+
+            _free_statement( statement );
+            return NULL;
+        }
+
+        statement->next        = cache->buckets[bucket];
+        cache->buckets[bucket] = statement;
+        cache->num_entries++;
+    }
+
+    if( !prepare_statement( me, statement ) )
+    {
+        return NULL;
+    }
+
+    return statement;
+}
+
+// Prepares statement on me's connection, unless that has already been done
+bool prepare_statement( struct worker * me, struct prepared_statement * statement )
+{
+    PGresult * result = NULL;
+
+    if( me == NULL || statement == NULL )
+    {
+        return false;
+    }
+
+    if( !db_connect( me ) )
+    {
+        return false;
+    }
+
+    if( statement->is_prepared )
+    {
+        return true;
+    }
+
+    result = PQprepare(
+        me->conn,
+        statement->name,
+        statement->query,
+        statement->num_params,
+        statement->param_types
+    );
+
+    if( PQresultStatus( result ) != PGRES_COMMAND_OK )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to prepare '%s': %s",
+            statement->query,
+            PQerrorMessage( me->conn )
+        );
+
+        PQclear( result );
+        return false;
+    }
+
+    PQclear( result );
+
+    _log(
+        LOG_LEVEL_DEBUG,
+        "Prepared statement %s",
+        statement->name
+    );
+
+    statement->is_prepared = true;
+    return true;
+}
+
+/*
+ * Called when me's connection has been replaced. Prepared statements do not
+ * outlive the session they were created in, so every entry must be prepared
+ * again before its next use.
+ */
+void reset_statement_cache( struct worker * me )
+{
+    struct statement_cache *    cache     = NULL;
+    struct prepared_statement * statement = NULL;
+    unsigned int                i         = 0;
+
+    if( me == NULL || me->statement_cache == NULL )
+    {
+        return;
+    }
+
+    cache = ( struct statement_cache * ) me->statement_cache;
+
+    for( i = 0; i < STATEMENT_CACHE_BUCKETS; i++ )
+    {
+        for( statement = cache->buckets[i]; statement != NULL; statement = statement->next )
+        {
+            statement->is_prepared = false;
+        }
+    }
+
+    return;
+}
+
+/*
+ * Drops the statements for a maintenance object whose target layout has
+ * changed, deallocating them on the server if they are still prepared there.
+ */
+void invalidate_object_statements( struct worker * me, unsigned int maintenance_object )
+{
+    struct statement_cache *     cache     = NULL;
+    struct prepared_statement *  statement = NULL;
+    struct prepared_statement ** previous  = NULL;
+    struct string_buffer *       sql       = NULL;
+    PGresult *                   result    = NULL;
+    unsigned int                 i         = 0;
+
+    if( me == NULL || me->statement_cache == NULL )
+    {
+        return;
+    }
+
+    cache = ( struct statement_cache * ) me->statement_cache;
+    sql   = new_string_buffer();
+
+    for( i = 0; i < STATEMENT_CACHE_BUCKETS; i++ )
+    {
+        previous = &( cache->buckets[i] );
+
+        while( *previous != NULL )
+        {
+            statement = *previous;
+
+            if( statement->maintenance_object != maintenance_object )
+            {
+                previous = &( statement->next );
+                continue;
+            }
+
+            *previous = statement->next;
+
+            if(
+                    statement->is_prepared
+                 && sql != NULL
+                 && me->conn != NULL
+                 && PQstatus( me->conn ) == CONNECTION_OK
+              )
+            {
+                string_buffer_reset( sql );
+                string_buffer_append( sql, "DEALLOCATE %s", statement->name );
+                result = PQexec( me->conn, sql->data );
+                PQclear( result );
+            }
+
+            _free_statement( statement );
+            cache->num_entries--;
+        }
+    }
+
+    free_string_buffer( sql );
+    return;
+}
+
+static unsigned long _hash_statement(
+    unsigned int   maintenance_object,
+    unsigned short operation,
+    char *         columns
+)
+{
+    unsigned long hash      = 14695981039346656037UL;
+    char *        character = NULL;
+
+    hash = ( hash ^ maintenance_object ) * 1099511628211UL;
+    hash = ( hash ^ operation ) * 1099511628211UL;
+
+    for( character = columns; *character; character++ )
+    {
+        hash ^= ( unsigned char ) *character;
+        hash *= 1099511628211UL;
+    }
+
+    return hash;
+}
+
+static struct statement_cache * _get_cache( struct worker * me )
+{
+    if( me->statement_cache == NULL )
+    {
+        me->statement_cache = new_statement_cache();
+    }
+
+    return ( struct statement_cache * ) me->statement_cache;
+}
+
+static void _free_statement( struct prepared_statement * statement )
+{
+    free( statement->columns );
+    free( statement->query );
+    free( statement->param_types );
+    free( statement );
+    return;
+}
@@ -0,0 +1,49 @@
+#ifndef STATEMENT_CACHE_H
+#define STATEMENT_CACHE_H
+
+#include "util.h"
+
+#define STATEMENT_CACHE_BUCKETS 256
+#define STATEMENT_NAME_PREFIX "pg_ctblmgr_"
+
+/*
+ * A named statement prepared on a worker's connection. Entries survive
+ * reconnects: is_prepared is cleared when the connection is replaced and the
+ * statement is prepared again on first use.
+ */
+struct prepared_statement {
+    unsigned int                maintenance_object;
+    unsigned short              operation;
+    unsigned long               hash;
+    char *                      columns;
+    char *                      query;
+    char                        name[64];
+    int                         num_params;
+    Oid *                       param_types;
+    bool                        is_prepared;
+    struct prepared_statement * next;
+};
+
+struct statement_cache {
+    struct prepared_statement * buckets[STATEMENT_CACHE_BUCKETS];
+    unsigned long               num_entries;
+    unsigned long               next_id;
+};
+
+extern struct statement_cache * new_statement_cache( void );
+extern void free_statement_cache( struct statement_cache * );
+
+extern struct prepared_statement * get_prepared_statement(
+    struct worker *,
+    unsigned int,
+    unsigned short,
+    char *,
+    char *,
+    int,
+    Oid *
+);
+extern bool prepare_statement( struct worker *, struct prepared_statement * );
+extern void reset_statement_cache( struct worker * );
+extern void invalidate_object_statements( struct worker *, unsigned int );
+
+#endif // STATEMENT_CACHE_H
@@ -1,5 +1,18 @@
 
 #include "util.h"
+#include "coalesce.h"
+#include "apply.h"
+#include "statement_cache.h"
+#include "refresh.h"
+#include "accumulator.h"
+#include "driver.h"
+#include "fanout.h"
+#include "spill.h"
+#include "connection_pool.h"
+#include "receiver.h"
+#include "metrics.h"
+#include "logger.h"
+#include "batch_controller.h"
 
 #define VERSION "0.1"
 
@@ -12,17 +25,34 @@ FILE *           log_file      = NULL;
 unsigned int     max_argv_size = 0;
 bool             daemonize     = false;
 
-sig_atomic_t got_sighup  = false;
-sig_atomic_t got_sigint  = false;
-sig_atomic_t got_sigterm = false;
-
 static const char * usage_string = "\
 Usage: pg_ctblmgr\n \
     -U DB user (default: postgres)\n \
     -p DB port (default: 5432)\n \
     -h DB host (default: localhost)\n \
     -d DB name (default: <DB user>)\n \
-  [ -D daemonize\n \
+  [ -b coalesce window, in changes (default: 4096)\n \
+    -w coalesce window, in milliseconds (default: 250)\n \
+    -a rows at which changes are applied as a batch (default: 64)\n \
+    -x decode values in their binary send/recv format\n \
+    -r parallel workers per full refresh (default: 4)\n \
+    -S rebuild into a shadow table and swap it in on full refresh\n \
+    -n changes accumulated per aggregate flush (default: 65536)\n \
+    -f aggregate flush interval, in milliseconds (default: 1000)\n \
+    -R rows of accumulated changes whose deltas are computed column by column, 0 for one at a time (default: 1024)\n \
+    -l directory target drivers are loaded from\n \
+    -c workers per target location (default: 2)\n \
+    -m bytes of WAL a location may fall behind before it is detached (default: 67108864)\n \
+    -q bytes queued in memory per location worker before spilling to disk (default: 16777216)\n \
+    -Q directory queues spill to (default: /var/tmp)\n \
+    -k spare connections kept established per location (default: 1)\n \
+    -P location workers running at once across every source, 0 for no limit (default: 0)\n \
+    -F file of source databases, each line a name and conninfo overriding -U, -p, -h and -d\n \
+    -L lowest level logged: debug, info, warning or error (default: info)\n \
+    -M port metrics are served on, on 127.0.0.1 (default: none)\n \
+    -T milliseconds a batch of transactions should take to apply, 0 to apply each on its own (default: 100)\n \
+    -W bytes queued for a location worker before it is behind, until half are taken; the source stops being read while every location is, 0 for no limit (default: 33554432)\n \
+    -D daemonize\n \
     -v VERSION\n \
     -? HELP ]\n";
 
@@ -36,7 +66,7 @@ void _parse_args( int argc, char ** argv )
 
     opterr = 0;
 
-    while( ( c = getopt( argc, argv, "U:p:d:h:Dv?" ) ) != -1 )
+    while( ( c = getopt( argc, argv, "U:p:d:h:b:w:a:xr:Sn:f:R:l:c:m:q:Q:k:P:F:L:M:T:W:Dv?" ) ) != -1 )
     {
         switch( c )
         {
@@ -52,6 +82,73 @@ void _parse_args( int argc, char ** argv )
             case 'd':
                 dbname = optarg;
                 break;
+            case 'b':
+                coalesce_window_changes = strtoul( optarg, NULL, 10 );
+                break;
+            case 'w':
+                coalesce_window_ms = strtoul( optarg, NULL, 10 );
+                break;
+            case 'a':
+                batch_apply_threshold = strtoul( optarg, NULL, 10 );
+                break;
+            case 'x':
+                binary_values = true;
+                break;
+            case 'r':
+                refresh_workers = ( unsigned int ) strtoul( optarg, NULL, 10 );
+                break;
+            case 'S':
+                refresh_mode = REFRESH_MODE_SHADOW;
+                break;
+            case 'n':
+                accumulator_flush_changes = strtoul( optarg, NULL, 10 );
+                break;
+            case 'f':
+                accumulator_flush_ms = strtoul( optarg, NULL, 10 );
+                break;
+            case 'R':
+                accumulator_batch_rows = strtoul( optarg, NULL, 10 );
+                break;
+            case 'l':
+                driver_directory = optarg;
+                break;
+            case 'c':
+                fanout_pool_size = ( unsigned int ) strtoul( optarg, NULL, 10 );
+                break;
+            case 'm':
+                fanout_lag_budget = strtoull( optarg, NULL, 10 );
+                break;
+            case 'q':
+                spill_memory_limit = strtoull( optarg, NULL, 10 );
+                break;
+            case 'Q':
+                spill_directory = optarg;
+                break;
+            case 'k':
+                connection_spares = ( unsigned int ) strtoul( optarg, NULL, 10 );
+                break;
+            case 'P':
+                fanout_worker_limit = ( unsigned int ) strtoul( optarg, NULL, 10 );
+                break;
+            case 'F':
+                source_file = optarg;
+                break;
+            case 'L':
+                if( !parse_log_level( optarg, &log_min_level ) )
+                {
+                    _usage( "Invalid log level" );
+                }
+
+                break;
+            case 'M':
+                metrics_port = ( unsigned short ) strtoul( optarg, NULL, 10 );
+                break;
+            case 'T':
+                batch_target_ms = strtoul( optarg, NULL, 10 );
+                break;
+            case 'W':
+                fanout_high_water = strtoull( optarg, NULL, 10 );
+                break;
             case '?':
                 _usage( NULL );
             case 'v':
@@ -127,97 +224,23 @@ void _usage( char * message )
     exit(1);
 }
 
+/*
+ * Logs message at log_level, if log_min_level lets it through, and exits
+ * once a FATAL one has been written. Lines are queued for the log writer,
+ * see write_log().
+ */
 void _log( unsigned short log_level, char * message, ... )
 {
-    va_list args          = {{0}};
-    FILE *  output_handle = NULL;
-    struct  timeval tv    = {0};
-    char    buff_time[28] = {0};
-    char *  log_prefix    = NULL;
+    va_list args = {{0}};
 
-    if( message == NULL )
+    if( message == NULL || log_level < log_min_level )
     {
         return;
     }
 
-    if(      log_level == LOG_LEVEL_DEBUG   ) { log_prefix = "DEBUG";   }
-    else if( log_level == LOG_LEVEL_INFO    ) { log_prefix = "INFO";    }
-    else if( log_level == LOG_LEVEL_WARNING ) { log_prefix = "WARNING"; }
-    else if( log_level == LOG_LEVEL_ERROR   ) { log_prefix = "ERROR";   }
-    else if( log_level == LOG_LEVEL_FATAL   ) { log_prefix = "FATAL";   }
-    else                                      { log_prefix = "UNKNOWN"; }
-
-    gettimeofday( &tv, NULL );
-    strftime(
-        buff_time,
-        sizeof( buff_time ) / sizeof( *buff_time ),
-        "%Y-%m-%d %H:%M:%S",
-        gmtime( &tv.tv_sec )
-    );
-
-    // If we have a logfile, set that as the output handle
-    if( log_file != NULL )
-    {
-        output_handle = log_file;
-    }
-
-    if(
-            output_handle == NULL
-         && (
-                log_level == LOG_LEVEL_WARNING
-             || log_level == LOG_LEVEL_ERROR
-             || log_level == LOG_LEVEL_FATAL
-            )
-      )
-    {
-        output_handle = stderr;
-    }
-    else if( output_handle == NULL )
-    {
-        output_handle = stdout;
-    }
-
     va_start( args, message );
-
-#ifndef DEBUG
-    if( log_level == LOG_LEVEL_DEBUG )
-    {
-#endif
-        fprintf(
-            output_handle,
-            "%s.%03d ",
-            buff_time,
-            ( int ) ( tv.tv_usec / 1000 )
-        );
-
-        fprintf(
-            output_handle,
-            "[%d] ",
-            getpid()
-        );
-
-        fprintf(
-            output_handle,
-            "%s: ",
-            log_prefix
-        );
-
-        vfprintf(
-            output_handle,
-            message,
-            args
-        );
-
-        fprintf(
-            output_handle,
-            "\n"
-        );
-#ifndef DEBUG
-    }
-#endif
-
+    write_log( log_level, message, args );
     va_end( args );
-    fflush( output_handle );
 
     if( log_level == LOG_LEVEL_FATAL )
     {
@@ -262,9 +285,13 @@ struct worker * new_worker(
     result->tx_in_progress = false;
     result->pid            = 0;
     result->conn           = NULL;
+    result->conninfo       = NULL;
     result->my_argc        = 0;
     result->my_argv        = NULL;
     result->change_buffer  = NULL;
+    result->statement_cache = NULL;
+    result->connection_pool = NULL;
+    result->source          = NULL;
 
     return result;
 }
@@ -301,6 +328,23 @@ bool parent_init( int argc, char ** argv )
         return false;
     }
 
+    // Forked before anything else, the writer holds on to nothing but the log
+    if( !start_log_writer() )
+    {
+        _log(
+            LOG_LEVEL_WARNING,
+            "Failed to start log writer, processes write their own lines"
+        );
+    }
+
+    if( !start_metrics() )
+    {
+        _log(
+            LOG_LEVEL_WARNING,
+            "Failed to set up shared metrics, none are reported"
+        );
+    }
+
     return true;
 }
 
@@ -487,15 +531,63 @@ void free_worker( struct worker * worker )
             worker->tx_in_progress = false;
         }
 
+    }
+
+    if( worker->conn != NULL )
+    {
         PQfinish( worker->conn );
         worker->conn = NULL;
     }
 
+    free_connection_pool( ( struct connection_pool * ) worker->connection_pool );
+    worker->connection_pool = NULL;
+
+    free_statement_cache( ( struct statement_cache * ) worker->statement_cache );
+    worker->statement_cache = NULL;
+
     munmap( worker, sizeof( struct worker ) );
     worker = NULL;
     return;
 }
 
+/*
+ * Closes every socket a forked process inherited but keep. Connections of
+ * the parent's stay open for as long as any process holds them, even once
+ * the parent has closed them.
+ */
+void close_inherited_sockets( int keep )
+{
+    struct dirent * entry = NULL;
+    struct stat     info  = {0};
+    DIR *           dir   = NULL;
+    int             fd    = 0;
+
+    dir = opendir( "/proc/self/fd" );
+
+    if( dir == NULL )
+    {
+        return;
+    }
+
+    while( ( entry = readdir( dir ) ) != NULL )
+    {
+        fd = atoi( entry->d_name );
+
+        if( fd <= STDERR_FILENO || fd == keep || fd == dirfd( dir ) )
+        {
+            continue;
+        }
+
+        if( fstat( fd, &info ) == 0 && S_ISSOCK( info.st_mode ) )
+        {
+            close( fd );
+        }
+    }
+
+    closedir( dir );
+    return;
+}
+
 void * create_shared_memory( size_t size )
 {
     void * ptr        = NULL;
@@ -520,6 +612,31 @@ void * create_shared_memory( size_t size )
     return ptr;
 }
 
+/*
+ * waitpid() for the child pid, only once its log ring and metrics slots have
+ * been freed, while it is a zombie and its pid cannot have been reused.
+ * options may be WNOHANG.
+ */
+pid_t reap_child( pid_t pid, int * status, int options )
+{
+    siginfo_t info = {0};
+
+    if( waitid( P_PID, ( id_t ) pid, &info, WEXITED | WNOWAIT | ( options & WNOHANG ) ) != 0 )
+    {
+        return -1;
+    }
+
+    // Still running, under WNOHANG
+    if( info.si_pid != pid )
+    {
+        return 0;
+    }
+
+    log_exited( pid );
+    metrics_exited( pid );
+    return waitpid( pid, status, 0 );
+}
+
 void _set_process_title(
     char **        argv,
     int            argc,
@@ -707,3 +824,130 @@ bool resize_change_buffer( struct change_buffer * cb, long int num_entries )
 
     return true;
 }
+
+struct string_buffer * new_string_buffer( void )
+{
+    struct string_buffer * sb = NULL;
+
+    sb = ( struct string_buffer * ) calloc( 1, sizeof( struct string_buffer ) );
+
+    if( sb == NULL )
+    {
+        return NULL;
+    }
+
+    sb->size = 256;
+    sb->data = ( char * ) calloc( sizeof( char ), sb->size );
+
+    if( sb->data == NULL )
+    {
+        free( sb );
+        return NULL;
+    }
+
+    return sb;
+}
+
+void free_string_buffer( struct string_buffer * sb )
+{
+    if( sb == NULL )
+    {
+        return;
+    }
+
+    free( sb->data );
+    free( sb );
+    return;
+}
+
+void string_buffer_reset( struct string_buffer * sb )
+{
+    if( sb == NULL )
+    {
+        return;
+    }
+
+    sb->length  = 0;
+    sb->data[0] = '\0';
+    return;
+}
+
+static bool _string_buffer_reserve( struct string_buffer * sb, size_t needed )
+{
+    char * temp = NULL;
+    size_t size = 0;
+
+    if( sb->length + needed + 1 <= sb->size )
+    {
+        return true;
+    }
+
+    size = sb->size;
+
+    while( sb->length + needed + 1 > size )
+    {
+        size *= 2;
+    }
+
+    temp = ( char * ) realloc( sb->data, size );
+
+    if( temp == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to grow string buffer to %lu bytes",
+            ( unsigned long ) size
+        );
+
+        return false;
+    }
+
+    sb->data = temp;
+    sb->size = size;
+    return true;
+}
+
+bool string_buffer_append_bytes( struct string_buffer * sb, const char * data, size_t length )
+{
+    if( sb == NULL || data == NULL )
+    {
+        return false;
+    }
+
+    if( !_string_buffer_reserve( sb, length ) )
+    {
+        return false;
+    }
+
+    memcpy( sb->data + sb->length, data, length );
+    sb->length += length;
+    sb->data[sb->length] = '\0';
+    return true;
+}
+
+bool string_buffer_append( struct string_buffer * sb, const char * format, ... )
+{
+    va_list args   = {{0}};
+    int     needed = 0;
+
+    if( sb == NULL || format == NULL )
+    {
+        return false;
+    }
+
+    va_start( args, format );
+    needed = vsnprintf( NULL, 0, format, args );
+    va_end( args );
+
+    if( needed < 0 || !_string_buffer_reserve( sb, ( size_t ) needed ) )
+    {
+        return false;
+    }
+
+    va_start( args, format );
+    vsnprintf( sb->data + sb->length, ( size_t ) needed + 1, format, args );
+    va_end( args );
+
+    sb->length += ( size_t ) needed;
+    return true;
+}
@@ -2,7 +2,9 @@
 #define UTIL_H
 
 #include <math.h>
+#include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -50,10 +52,6 @@ bool daemonize;
 char * conninfo;
 FILE * log_file;
 
-sig_atomic_t got_sighup;
-sig_atomic_t got_sigint;
-sig_atomic_t got_sigterm;
-
 struct change_buffer {
     unsigned long  size;
     unsigned long  num_entries;
@@ -61,16 +59,28 @@ struct change_buffer {
     bool           _locked;
 };
 
+struct string_buffer {
+    char * data;
+    size_t length;
+    size_t size;
+};
+
 struct worker {
-    unsigned short type;
-    unsigned short status;
-    PGconn *       conn;
-    pid_t          pid;
-    bool           tx_in_progress;
-    int            my_argc;
-    char **        my_argv;
-    char *         pidfile;  // used by parent to remove pid file on term
-    void *         change_buffer;
+    unsigned short  type;
+    unsigned short  status;
+    PGconn *        conn;
+    pid_t           pid;
+    bool            tx_in_progress;
+    int             my_argc;
+    char **         my_argv;
+    char *          pidfile;  // used by parent to remove pid file on term
+    char *          conninfo; // connects with the global conninfo when NULL
+    void *          change_buffer;
+    void *          statement_cache;
+    void *          connection_pool; // spares to replace conn with, per process
+    uint64_t        connection_id;   // unique in the process to each conn, see db_connect()
+    char            sql_state[6];    // of the last statement query.c saw fail
+    struct worker * source;          // connected to the source, when conn is to a target elsewhere
 };
 
 struct worker ** workers;
@@ -91,12 +101,9 @@ bool parent_init( int, char ** );
 void free_worker( struct worker * );
 bool create_pid_file( void );
 
-void __sigterm( int ) __attribute__ ((noreturn));
-void __sigint( int ) __attribute__ ((noreturn));
-void __sighup( int );
-void __term( void ) __attribute__ ((noreturn));
-
+void close_inherited_sockets( int );
 void * create_shared_memory( size_t );
+pid_t reap_child( pid_t, int *, int );
 void _set_process_title( char **, int, char *, unsigned int * );
 
 bool _wait_and_set_mutex( bool * );
@@ -105,4 +112,10 @@ bool __test_and_set( bool * );
 struct change_buffer * new_change_buffer( void );
 bool resize_change_buffer( struct change_buffer *, long int );
 
+struct string_buffer * new_string_buffer( void );
+void free_string_buffer( struct string_buffer * );
+bool string_buffer_append( struct string_buffer *, const char *, ... ) __attribute__ ((format (gnu_printf, 2, 3)));
+bool string_buffer_append_bytes( struct string_buffer *, const char *, size_t );
+void string_buffer_reset( struct string_buffer * );
+
 #endif // UTIL_H
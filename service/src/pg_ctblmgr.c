@@ -2,9 +2,13 @@
 
 int main( int argc, char ** argv )
 {
+    struct receiver ** receivers     = NULL;
+    unsigned int       num_receivers = 0;
+    bool               success       = false;
+
     _parse_args( argc, argv );
 
-    if( !_parent_init( argc, argv ) )
+    if( !parent_init( argc, argv ) )
     {
         _log(
             LOG_LEVEL_FATAL,
@@ -12,13 +16,25 @@ int main( int argc, char ** argv )
         );
     }
 
-    if( !db_connect( parent ) )
+    receivers = new_receivers( parent, &num_receivers );
+
+    if( receivers == NULL )
     {
         _log(
             LOG_LEVEL_FATAL,
-            "Failed to connect to database"
+            "Failed to set up source databases"
         );
     }
 
-    return 0;
+    // Signals are handled in the receivers' event loop, which returns here to stop
+    success = run_receivers( receivers, num_receivers );
+    free_receivers( receivers, num_receivers );
+
+    if( parent->pidfile != NULL )
+    {
+        remove( parent->pidfile );
+    }
+
+    stop_log_writer();
+    return success ? 0 : 1;
 }
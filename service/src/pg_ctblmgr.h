@@ -2,6 +2,26 @@
 #define PG_CTBLMGR_H
 
 #include "lib/util.h"
+#include "lib/logger.h"
 #include "lib/query.h"
+#include "lib/connection_pool.h"
+#include "lib/change.h"
+#include "lib/coalesce.h"
+#include "lib/object.h"
+#include "lib/apply.h"
+#include "lib/definition.h"
+#include "lib/replication.h"
+#include "lib/refresh.h"
+#include "lib/ivm.h"
+#include "lib/batch.h"
+#include "lib/accumulator.h"
+#include "lib/progress.h"
+#include "lib/dependency.h"
+#include "lib/memcached.h"
+#include "lib/driver.h"
+#include "lib/spill.h"
+#include "lib/fanout.h"
+#include "lib/event.h"
+#include "lib/receiver.h"
 
 #endif // PG_CTBLMGR_H
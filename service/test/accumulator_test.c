@@ -0,0 +1,290 @@
+#include "test/test.h"
+
+/*
+ * Checks the deltas an accumulator gathers for
+ *
+ *   SELECT region, sum( qty ), count(*) FROM public.sales WHERE qty > 1 GROUP BY region
+ *
+ * a row at a time and a batch at a time, with values in text and in their
+ * send format: UPDATEs move rows between groups, deltas only reach pending
+ * at COMMIT, transactions replayed up to flushed_lsn are dropped, and the
+ * groups of binary keys carry their type.
+ */
+
+#define TEXT_TEST_OID 25
+#define INT4_TEST_OID 23
+
+static char * relation_columns[] = { "id", "region", "qty" };
+static char * relation_types[]   = { "integer", "text", "integer" };
+
+static struct tuple * _make_row( long, char *, long );
+static struct change * _make_change( unsigned short, struct tuple *, struct tuple * );
+static struct change * _make_commit( uint64_t );
+static struct aggregate_accumulator * _make_accumulator( struct maintenance_object *, struct ivm_relation * );
+static struct accumulator_group * _find_group( struct accumulator_table *, char * );
+static void _check_group( struct accumulator_table *, char *, int64_t, int64_t );
+static void _accumulate( struct aggregate_accumulator *, struct change * );
+static void _test_accumulator( struct maintenance_object *, struct ivm_relation * );
+
+int main( int argc, char ** argv )
+{
+    struct maintenance_object object   = {0};
+    struct ivm_relation       relation = {0};
+    unsigned int              mode     = 0;
+
+    log_min_level = LOG_LEVEL_FATAL;
+
+    object.qualified_name = "public.sales_by_region";
+    relation.schema_name  = "public";
+    relation.table_name   = "sales";
+    relation.name         = "sales";
+    relation.num_columns  = 3;
+    relation.columns      = relation_columns;
+    relation.column_types = relation_types;
+
+    // A row at a time and a batch at a time, in text then in binary
+    for( mode = 0; mode < 4; mode++ )
+    {
+        accumulator_batch_rows = mode % 2 == 0 ? 0 : DEFAULT_BATCH_ROWS;
+        binary_values          = mode >= 2;
+
+        _test_accumulator( &object, &relation );
+    }
+
+    return TEST_RESULT( "accumulator" );
+}
+
+// A row of public.sales, in text or, with binary_values, in send format
+static struct tuple * _make_row( long id, char * region, long qty )
+{
+    struct tuple * tuple = NULL;
+    long           numbers[2];
+    unsigned int   i     = 0;
+    int            j     = 0;
+
+    numbers[0] = id;
+    numbers[1] = qty;
+
+    tuple              = new_tuple( 3 );
+    tuple->num_columns = 3;
+
+    for( i = 0; i < 3; i++ )
+    {
+        tuple->names[i] = strdup( relation_columns[i] );
+    }
+
+    if( !binary_values )
+    {
+        tuple->values[0] = ( char * ) malloc( 32 );
+        tuple->values[2] = ( char * ) malloc( 32 );
+        tuple->values[1] = strdup( region );
+        snprintf( tuple->values[0], 32, "%ld", id );
+        snprintf( tuple->values[2], 32, "%ld", qty );
+        return tuple;
+    }
+
+    tuple->lengths = ( int * ) calloc( 3, sizeof( int ) );
+    tuple->types   = ( Oid * ) calloc( 3, sizeof( Oid ) );
+
+    for( i = 0; i < 2; i++ )
+    {
+        tuple->values[i * 2]  = ( char * ) malloc( 4 );
+        tuple->lengths[i * 2] = 4;
+        tuple->types[i * 2]   = INT4_TEST_OID;
+
+        for( j = 0; j < 4; j++ )
+        {
+            tuple->values[i * 2][j] = ( char ) ( ( numbers[i] >> ( ( 3 - j ) * 8 ) ) & 0xff );
+        }
+    }
+
+    tuple->values[1]  = strdup( region );
+    tuple->lengths[1] = ( int ) strlen( region );
+    tuple->types[1]   = TEXT_TEST_OID;
+    return tuple;
+}
+
+static struct change * _make_change( unsigned short type, struct tuple * old_tuple, struct tuple * new_tuple )
+{
+    struct change * change = NULL;
+
+    change              = new_change( type );
+    change->schema_name = strdup( "public" );
+    change->table_name  = strdup( "sales" );
+    change->old_tuple   = old_tuple;
+    change->new_tuple   = new_tuple;
+    return change;
+}
+
+static struct change * _make_commit( uint64_t lsn )
+{
+    struct change * change = NULL;
+
+    change      = new_change( CHANGE_TYPE_COMMIT );
+    change->lsn = lsn;
+    return change;
+}
+
+// As the bench builds its accumulator, without a database to plan it against
+static struct aggregate_accumulator * _make_accumulator(
+    struct maintenance_object * object,
+    struct ivm_relation *       relation
+)
+{
+    struct aggregate_accumulator * accumulator = NULL;
+
+    accumulator = ( struct aggregate_accumulator * ) calloc( 1, sizeof( struct aggregate_accumulator ) );
+
+    if( accumulator == NULL )
+    {
+        return NULL;
+    }
+
+    accumulator->object          = object;
+    accumulator->relation        = relation;
+    accumulator->num_keys        = 1;
+    accumulator->key_columns     = ( unsigned int * ) calloc( 1, sizeof( unsigned int ) );
+    accumulator->key_targets     = ( unsigned int * ) calloc( 1, sizeof( unsigned int ) );
+    accumulator->num_aggregates  = 2;
+    accumulator->kinds           = ( unsigned short * ) calloc( 2, sizeof( unsigned short ) );
+    accumulator->arguments       = ( int * ) calloc( 2, sizeof( int ) );
+    accumulator->targets         = ( unsigned int * ) calloc( 2, sizeof( unsigned int ) );
+    accumulator->is_real         = ( bool * ) calloc( 2, sizeof( bool ) );
+    accumulator->count_aggregate = 1;
+    accumulator->filters         = ( struct accumulator_filter * ) calloc( 1, sizeof( struct accumulator_filter ) );
+    accumulator->num_filters     = 1;
+    accumulator->scratch         = new_string_buffer();
+
+    if(
+            accumulator->key_columns == NULL
+         || accumulator->key_targets == NULL
+         || accumulator->kinds == NULL
+         || accumulator->arguments == NULL
+         || accumulator->targets == NULL
+         || accumulator->is_real == NULL
+         || accumulator->filters == NULL
+         || accumulator->scratch == NULL
+      )
+    {
+        free_aggregate_accumulator( accumulator );
+        return NULL;
+    }
+
+    accumulator->key_columns[0]       = 1;
+    accumulator->kinds[0]             = AGGREGATE_SUM;
+    accumulator->kinds[1]             = AGGREGATE_COUNT;
+    accumulator->arguments[0]         = 2;
+    accumulator->arguments[1]         = -1;
+    accumulator->filters[0].column    = 2;
+    accumulator->filters[0].operation = BATCH_FILTER_GT;
+    accumulator->filters[0].integer   = 1;
+    return accumulator;
+}
+
+static struct accumulator_group * _find_group( struct accumulator_table * table, char * region )
+{
+    struct accumulator_group * group  = NULL;
+    unsigned long              i      = 0;
+    size_t                     length = 0;
+
+    for( i = 0; i < table->num_groups; i++ )
+    {
+        group  = &( table->slots[table->used[i]] );
+        length = group->lengths[0] >= 0 ? ( size_t ) group->lengths[0] : strlen( group->values[0] );
+
+        if( length == strlen( region ) && memcmp( group->values[0], region, length ) == 0 )
+        {
+            return group;
+        }
+    }
+
+    return NULL;
+}
+
+static void _check_group( struct accumulator_table * table, char * region, int64_t sum, int64_t rows )
+{
+    struct accumulator_group * group = NULL;
+
+    group = _find_group( table, region );
+    CHECK( group != NULL );
+
+    if( group == NULL )
+    {
+        return;
+    }
+
+    CHECK( group->deltas[0].integer_sum == sum );
+    CHECK( group->deltas[1].rows == rows );
+
+    // The type a binary key was sent in is what it is flushed as
+    CHECK( group->types[0] == ( binary_values ? TEXT_TEST_OID : InvalidOid ) );
+    CHECK( ( group->lengths[0] < 0 ) == !binary_values );
+    return;
+}
+
+// Takes change, and frees it
+static void _accumulate( struct aggregate_accumulator * accumulator, struct change * change )
+{
+    CHECK( accumulate_changes( accumulator, &change, 1 ) );
+    free_change( change );
+    return;
+}
+
+static void _test_accumulator( struct maintenance_object * object, struct ivm_relation * relation )
+{
+    struct aggregate_accumulator * accumulator = NULL;
+    struct change *                change      = NULL;
+
+    accumulator = _make_accumulator( object, relation );
+    CHECK( accumulator != NULL );
+
+    if( accumulator == NULL )
+    {
+        return;
+    }
+
+    _accumulate( accumulator, _make_change( CHANGE_TYPE_INSERT, NULL, _make_row( 1, "east", 5 ) ) );
+    _accumulate( accumulator, _make_change( CHANGE_TYPE_INSERT, NULL, _make_row( 2, "east", 3 ) ) );
+    _accumulate( accumulator, _make_change( CHANGE_TYPE_INSERT, NULL, _make_row( 3, "west", 4 ) ) );
+
+    // Filtered out by qty > 1
+    _accumulate( accumulator, _make_change( CHANGE_TYPE_INSERT, NULL, _make_row( 4, "north", 1 ) ) );
+
+    // Nothing is pending until COMMIT
+    CHECK( accumulator->pending.num_groups == 0 );
+    _accumulate( accumulator, _make_commit( 10 ) );
+
+    CHECK( accumulator->pending_lsn == 10 );
+    CHECK( accumulator->pending.num_groups == 2 );
+    CHECK( _find_group( &( accumulator->pending ), "north" ) == NULL );
+    _check_group( &( accumulator->pending ), "east", 8, 2 );
+    _check_group( &( accumulator->pending ), "west", 4, 1 );
+
+    // Moves a row from east to west, and empties east
+    _accumulate(
+        accumulator,
+        _make_change( CHANGE_TYPE_UPDATE, _make_row( 1, "east", 5 ), _make_row( 1, "west", 7 ) )
+    );
+    _accumulate( accumulator, _make_change( CHANGE_TYPE_DELETE, _make_row( 2, "east", 3 ), NULL ) );
+    _check_group( &( accumulator->pending ), "east", 8, 2 );
+    _accumulate( accumulator, _make_commit( 20 ) );
+
+    _check_group( &( accumulator->pending ), "east", 0, 0 );
+    _check_group( &( accumulator->pending ), "west", 11, 2 );
+
+    // A transaction replayed after a restart that flushed it is dropped
+    accumulator->flushed_lsn = 30;
+    _accumulate( accumulator, _make_change( CHANGE_TYPE_INSERT, NULL, _make_row( 5, "west", 9 ) ) );
+    _accumulate( accumulator, _make_commit( 30 ) );
+
+    _check_group( &( accumulator->pending ), "west", 11, 2 );
+    CHECK( accumulator->pending_lsn == 20 );
+
+    // An UPDATE or DELETE without its old row cannot be accumulated
+    change = _make_change( CHANGE_TYPE_DELETE, NULL, NULL );
+    CHECK( !accumulate_changes( accumulator, &change, 1 ) );
+    free_change( change );
+
+    free_aggregate_accumulator( accumulator );
+    return;
+}
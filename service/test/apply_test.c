@@ -0,0 +1,96 @@
+#include "test/test.h"
+
+/*
+ * Checks that change_moves_key() tells the UPDATEs that move a row to
+ * another key, which batched apply splits into a DELETE of the old key and
+ * an upsert of the new one, from those that leave the key as it was.
+ */
+
+static char * columns[] = { "id", "v" };
+static bool   is_key[]  = { true, false };
+
+static struct tuple * _make_tuple( long, long );
+static struct tuple * _make_key( long );
+static struct change * _make_update( long, long, long, long, bool );
+
+int main( int argc, char ** argv )
+{
+    struct maintenance_object object = {0};
+    struct change *           change = NULL;
+
+    log_min_level = LOG_LEVEL_FATAL;
+
+    object.qualified_name  = "public.t_copy";
+    object.num_columns     = 2;
+    object.columns         = columns;
+    object.is_key          = is_key;
+    object.num_key_columns = 1;
+
+    // The key is that of the new tuple, so only the old tuple tells the key moved
+    change = _make_update( 1, 10, 2, 10, true );
+    CHECK( change_moves_key( &object, change ) );
+    free_change( change );
+
+    // Only a value changed
+    change = _make_update( 1, 10, 1, 11, true );
+    CHECK( !change_moves_key( &object, change ) );
+    free_change( change );
+
+    // Without an old tuple the key cannot have moved
+    change = _make_update( 0, 0, 1, 11, false );
+    CHECK( !change_moves_key( &object, change ) );
+    free_change( change );
+
+    change       = _make_update( 1, 10, 2, 10, true );
+    change->type = CHANGE_TYPE_INSERT;
+    CHECK( !change_moves_key( &object, change ) );
+    free_change( change );
+
+    return TEST_RESULT( "apply" );
+}
+
+static struct tuple * _make_tuple( long id, long v )
+{
+    struct tuple * tuple = NULL;
+    char           text[32];
+
+    tuple              = new_tuple( 2 );
+    tuple->num_columns = 2;
+    tuple->names[0]    = strdup( "id" );
+    tuple->names[1]    = strdup( "v" );
+
+    snprintf( text, sizeof( text ), "%ld", id );
+    tuple->values[0] = strdup( text );
+    snprintf( text, sizeof( text ), "%ld", v );
+    tuple->values[1] = strdup( text );
+    return tuple;
+}
+
+// The replica identity columns of a row, as the decoder gives them
+static struct tuple * _make_key( long id )
+{
+    struct tuple * tuple = NULL;
+    char           text[32];
+
+    snprintf( text, sizeof( text ), "%ld", id );
+
+    tuple              = new_tuple( 1 );
+    tuple->num_columns = 1;
+    tuple->names[0]    = strdup( "id" );
+    tuple->values[0]   = strdup( text );
+    return tuple;
+}
+
+// An UPDATE of public.t from ( old_id, old_v ), if has_old, to ( id, v )
+static struct change * _make_update( long old_id, long old_v, long id, long v, bool has_old )
+{
+    struct change * change = NULL;
+
+    change              = new_change( CHANGE_TYPE_UPDATE );
+    change->schema_name = strdup( "public" );
+    change->table_name  = strdup( "t" );
+    change->new_tuple   = _make_tuple( id, v );
+    change->key         = _make_key( id );
+    change->old_tuple   = has_old ? _make_tuple( old_id, old_v ) : NULL;
+    return change;
+}
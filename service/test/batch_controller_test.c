@@ -0,0 +1,123 @@
+#include "test/test.h"
+
+/*
+ * Checks how batches are paced: the target follows the tightest freshness
+ * of the objects applied to, a batch is due once nothing is queued behind
+ * it, it is full, or it has waited what the target leaves after applying,
+ * and its size is grown additively while it keeps up with a backlog and
+ * halved when it misses the target, within its bounds.
+ */
+
+static void _test_target( void );
+static void _test_due( void );
+static void _test_sizing( void );
+
+int main( int argc, char ** argv )
+{
+    log_min_level = LOG_LEVEL_FATAL;
+
+    _test_target();
+    _test_due();
+    _test_sizing();
+
+    return TEST_RESULT( "batch_controller" );
+}
+
+static void _test_target( void )
+{
+    struct batch_controller controller = {0};
+
+    batch_target_ms = 100;
+
+    reset_batch_controller( &controller, 0 );
+    CHECK( controller.target_ms == 100 && controller.flush_ms == 100 );
+    CHECK( controller.rows == BATCH_CONTROLLER_START_ROWS && controller.apply_ms == 0.0 );
+
+    reset_batch_controller( &controller, 40 );
+    CHECK( controller.target_ms == 40 && controller.flush_ms == 40 );
+
+    reset_batch_controller( &controller, 500 );
+    CHECK( controller.target_ms == 100 );
+
+    // Without a target each transaction is applied on its own, whatever the objects' freshness
+    batch_target_ms = 0;
+    reset_batch_controller( &controller, 40 );
+    CHECK( controller.target_ms == 0 );
+    CHECK( batch_due( &controller, 1, 0, 1000 ) );
+    batch_applied( &controller, 1, 1000000, 1000 );
+    CHECK( controller.rows == BATCH_CONTROLLER_START_ROWS && controller.apply_ms == 0.0 );
+
+    batch_target_ms = DEFAULT_BATCH_TARGET_MS;
+    return;
+}
+
+static void _test_due( void )
+{
+    struct batch_controller controller = {0};
+
+    batch_target_ms = 100;
+    reset_batch_controller( &controller, 0 );
+
+    // A member that keeps up applies each transaction as it arrives
+    CHECK( batch_due( &controller, 1, 0, 0 ) );
+
+    CHECK( !batch_due( &controller, controller.rows - 1, 99, 1000 ) );
+    CHECK( batch_due( &controller, controller.rows, 0, 1000 ) );
+    CHECK( batch_due( &controller, 1, 100, 1000 ) );
+
+    // 40ms to apply leaves 60ms to wait
+    batch_applied( &controller, 1, 40000, 0 );
+    CHECK( controller.apply_ms == 40.0 && controller.flush_ms == 60 );
+    CHECK( !batch_due( &controller, 1, 59, 1000 ) );
+    CHECK( batch_due( &controller, 1, 60, 1000 ) );
+
+    // Smoothed, one slow batch moves the average a quarter of the way
+    batch_applied( &controller, 1, 80000, 0 );
+    CHECK( controller.apply_ms == 50.0 && controller.flush_ms == 50 );
+
+    // Nothing is left to wait once applying takes the whole target
+    controller.apply_ms = 0.0;
+    batch_applied( &controller, 1, 150000, 0 );
+    CHECK( controller.flush_ms == 0 );
+    CHECK( batch_due( &controller, 1, 0, 1000 ) );
+
+    batch_target_ms = DEFAULT_BATCH_TARGET_MS;
+    return;
+}
+
+static void _test_sizing( void )
+{
+    struct batch_controller controller = {0};
+    unsigned int            i          = 0;
+
+    batch_target_ms = 100;
+    reset_batch_controller( &controller, 0 );
+
+    // Grown only when a batch filled up in time with more queued behind it
+    batch_applied( &controller, controller.rows, 10000, 1000 );
+    CHECK( controller.rows == BATCH_CONTROLLER_START_ROWS + BATCH_CONTROLLER_ROWS_STEP );
+    batch_applied( &controller, controller.rows - 1, 10000, 1000 );
+    batch_applied( &controller, controller.rows, 10000, 0 );
+    CHECK( controller.rows == BATCH_CONTROLLER_START_ROWS + BATCH_CONTROLLER_ROWS_STEP );
+
+    // Halved on missing the target, however full
+    batch_applied( &controller, 1, 200000, 1000 );
+    CHECK( controller.rows == ( BATCH_CONTROLLER_START_ROWS + BATCH_CONTROLLER_ROWS_STEP ) / 2 );
+
+    for( i = 0; i < 32; i++ )
+    {
+        batch_applied( &controller, controller.rows, 200000, 1000 );
+    }
+
+    CHECK( controller.rows == BATCH_CONTROLLER_MIN_ROWS );
+
+    for( i = 0; i < BATCH_CONTROLLER_MAX_ROWS / BATCH_CONTROLLER_ROWS_STEP + 1; i++ )
+    {
+        batch_applied( &controller, controller.rows, 1000, 1000 );
+    }
+
+    CHECK( controller.rows == BATCH_CONTROLLER_MAX_ROWS );
+
+    batch_target_ms = DEFAULT_BATCH_TARGET_MS;
+    return;
+}
@@ -0,0 +1,225 @@
+#include "test/test.h"
+
+/*
+ * Checks the column-at-a-time kernels against the row-at-a-time meaning of
+ * each: filters as a WHERE clause compares, NULLs never passing, deltas as
+ * each row's sign times its value, and key hashes as hash_value() combined
+ * over the key's columns. TEST_ROWS is not a multiple of the vector width,
+ * so that the rows the AVX2 kernels leave to the scalar loops are covered
+ * where the CPU has AVX2.
+ */
+
+#define TEST_ROWS 1003
+
+static char * columns[] = { "region", "qty", "amount" };
+
+static struct tuple * _make_row( unsigned long );
+static bool _compare( unsigned short, double, double );
+static void _test_filters( struct change_batch *, struct tuple ** );
+static void _test_deltas( struct change_batch *, struct tuple ** );
+static void _test_hashes( struct change_batch *, struct tuple ** );
+
+int main( int argc, char ** argv )
+{
+    struct change_batch * batch = NULL;
+    struct tuple *        rows[TEST_ROWS];
+    unsigned long         row   = 0;
+
+    log_min_level = LOG_LEVEL_FATAL;
+
+    batch = new_change_batch( 3, TEST_ROWS );
+    CHECK( batch != NULL );
+
+    if( batch == NULL )
+    {
+        return TEST_RESULT( "batch" );
+    }
+
+    CHECK( set_batch_column( batch, 0, columns[0], BATCH_COLUMN_VALUE ) );
+    CHECK( set_batch_column( batch, 1, columns[1], BATCH_COLUMN_INTEGER ) );
+    CHECK( set_batch_column( batch, 2, columns[2], BATCH_COLUMN_REAL ) );
+
+    for( row = 0; row < TEST_ROWS; row++ )
+    {
+        rows[row] = _make_row( row );
+        CHECK( batch_append_tuple( batch, rows[row], row % 3 == 0 ? -1 : 1 ) );
+    }
+
+    CHECK( batch->num_rows == TEST_ROWS );
+    CHECK( !batch_append_tuple( batch, rows[0], 1 ) );
+
+    _test_filters( batch, rows );
+    _test_deltas( batch, rows );
+    _test_hashes( batch, rows );
+
+    for( row = 0; row < TEST_ROWS; row++ )
+    {
+        free_tuple( rows[row] );
+    }
+
+    free_change_batch( batch );
+    return TEST_RESULT( "batch" );
+}
+
+// Small positive and negative numbers, repeating keys, and some NULLs
+static struct tuple * _make_row( unsigned long row )
+{
+    struct tuple * tuple = NULL;
+    char           text[32];
+    unsigned int   i     = 0;
+
+    tuple              = new_tuple( 3 );
+    tuple->num_columns = 3;
+
+    for( i = 0; i < 3; i++ )
+    {
+        tuple->names[i] = strdup( columns[i] );
+    }
+
+    snprintf( text, sizeof( text ), "r%lu", row % 7 );
+    tuple->values[0] = strdup( text );
+
+    if( row % 11 != 0 )
+    {
+        snprintf( text, sizeof( text ), "%ld", ( long ) ( row * 7919 % 201 ) - 100 );
+        tuple->values[1] = strdup( text );
+    }
+
+    if( row % 13 != 0 )
+    {
+        snprintf( text, sizeof( text ), "%.1f", ( double ) ( row * 31 % 97 ) - 48.5 );
+        tuple->values[2] = strdup( text );
+    }
+
+    return tuple;
+}
+
+static bool _compare( unsigned short operation, double value, double constant )
+{
+    switch( operation )
+    {
+        case BATCH_FILTER_EQ:
+            return value == constant;
+        case BATCH_FILTER_NE:
+            return value != constant;
+        case BATCH_FILTER_LT:
+            return value < constant;
+        case BATCH_FILTER_LE:
+            return value <= constant;
+        case BATCH_FILTER_GT:
+            return value > constant;
+        default:
+            return value >= constant;
+    }
+}
+
+static void _test_filters( struct change_batch * batch, struct tuple ** rows )
+{
+    unsigned short operation = 0;
+    unsigned long  row       = 0;
+    unsigned long  wrong     = 0;
+    unsigned int   column    = 0;
+    double         constant  = 0;
+    char *         value     = NULL;
+
+    for( column = 1; column <= 2; column++ )
+    {
+        constant = column == 1 ? 3 : 1.5;
+
+        for( operation = BATCH_FILTER_EQ; operation <= BATCH_FILTER_GE; operation++ )
+        {
+            memset( batch->selected, 1, TEST_ROWS );
+            batch_filter( batch, column, operation, ( int64_t ) constant, constant );
+
+            for( row = 0, wrong = 0; row < TEST_ROWS; row++ )
+            {
+                value  = rows[row]->values[column];
+                wrong += batch->selected[row] != ( value != NULL && _compare( operation, atof( value ), constant ) );
+            }
+
+            CHECK( wrong == 0 );
+        }
+    }
+
+    memset( batch->selected, 1, TEST_ROWS );
+    return;
+}
+
+static void _test_deltas( struct change_batch * batch, struct tuple ** rows )
+{
+    unsigned long row      = 0;
+    unsigned long wrong    = 0;
+    int64_t       sign     = 0;
+    int64_t       selected = 0;
+    char *        value    = NULL;
+
+    // Only rows with a positive qty count
+    memset( batch->selected, 1, TEST_ROWS );
+    batch_filter( batch, 1, BATCH_FILTER_GT, 0, 0 );
+
+    batch_deltas( batch, 1 );
+
+    for( row = 0; row < TEST_ROWS; row++ )
+    {
+        value    = rows[row]->values[1];
+        sign     = batch->signs[row];
+        selected = value != NULL && atol( value ) > 0;
+
+        wrong += batch->delta_rows[row] != sign * selected;
+        wrong += batch->delta_integers[row] != ( selected ? sign * atol( value ) : 0 );
+    }
+
+    CHECK( wrong == 0 );
+
+    // A NULL amount is left out of sum( amount ) but not of COUNT(*)
+    batch_deltas( batch, 2 );
+
+    for( row = 0, wrong = 0; row < TEST_ROWS; row++ )
+    {
+        value    = rows[row]->values[2];
+        sign     = batch->signs[row];
+        selected = value != NULL && batch->selected[row];
+
+        wrong += batch->delta_rows[row] != sign * selected;
+        wrong += batch->delta_reals[row] != ( selected ? ( double ) sign * atof( value ) : 0.0 );
+    }
+
+    CHECK( wrong == 0 );
+
+    batch_deltas( batch, -1 );
+
+    for( row = 0, wrong = 0; row < TEST_ROWS; row++ )
+    {
+        wrong += batch->delta_rows[row] != batch->signs[row] * batch->selected[row];
+    }
+
+    CHECK( wrong == 0 );
+    return;
+}
+
+static void _test_hashes( struct change_batch * batch, struct tuple ** rows )
+{
+    unsigned int  keys[2] = { 0, 1 };
+    unsigned long row     = 0;
+    unsigned long wrong   = 0;
+    uint64_t      hash    = 0;
+    char *        value   = NULL;
+
+    batch_hash_keys( batch, keys, 2 );
+
+    for( row = 0; row < TEST_ROWS; row++ )
+    {
+        value = rows[row]->values[1];
+        hash  = ( BATCH_HASH_SEED ^ hash_value( rows[row]->values[0], ( int ) strlen( rows[row]->values[0] ) ) ) * BATCH_HASH_PRIME;
+        hash  = ( hash ^ hash_value( value, value != NULL ? ( int ) strlen( value ) : -1 ) ) * BATCH_HASH_PRIME;
+
+        wrong += batch->hashes[row] != hash;
+    }
+
+    CHECK( wrong == 0 );
+
+    // NULL is a value of its own
+    CHECK( hash_value( NULL, -1 ) == BATCH_HASH_NULL );
+    CHECK( hash_value( "", 0 ) != BATCH_HASH_NULL );
+    return;
+}
@@ -0,0 +1,90 @@
+#include "test/test.h"
+
+/*
+ * Checks that decoder records carrying values in their send format are
+ * decoded to the bytes sent, NUL bytes and all, typed by the record's types
+ * object, and read as numbers the same as values in text.
+ */
+
+#define INT4_TEST_OID 23
+#define FLOAT8_TEST_OID 701
+#define BYTEA_TEST_OID 17
+
+static char binary_record[] =
+    "{\"type\":\"UPDATE\",\"xid\":\"7\",\"schema_name\":\"public\",\"table_name\":\"t\","
+    "\"types\":{\"id\":\"23\",\"amount\":\"701\",\"note\":\"17\"},"
+    "\"key\":{\"id\":\"0000002a\"},"
+    "\"data\":{\"new\":{\"id\":\"0000002a\",\"amount\":\"4004000000000000\",\"note\":\"610062\"},"
+    "\"old\":{\"id\":\"0000002a\",\"amount\":\"4004000000000000\",\"note\":\"610063\"}}}";
+
+static char text_record[] =
+    "{\"type\":\"INSERT\",\"xid\":\"8\",\"schema_name\":\"public\",\"table_name\":\"t\","
+    "\"key\":{\"id\":\"-17\"},"
+    "\"data\":{\"new\":{\"id\":\"-17\",\"amount\":\"1e3\",\"note\":null}}}";
+
+// A value of odd length cannot be hex
+static char broken_record[] =
+    "{\"type\":\"INSERT\",\"types\":{\"id\":\"23\"},\"key\":{\"id\":\"0002a\"},"
+    "\"data\":{\"new\":{\"id\":\"0002a\"}}}";
+
+int main( int argc, char ** argv )
+{
+    struct change * change = NULL;
+    struct tuple *  row    = NULL;
+    int64_t         number = 0;
+    double          real   = 0;
+    int             index  = 0;
+
+    log_min_level = LOG_LEVEL_FATAL;
+
+    change = parse_change( binary_record, 100 );
+    CHECK( change != NULL );
+
+    if( change != NULL )
+    {
+        row = change->new_tuple;
+
+        CHECK( change->type == CHANGE_TYPE_UPDATE && change->xid == 7 && change->lsn == 100 );
+        CHECK( row != NULL && row->lengths != NULL && row->types != NULL );
+        CHECK( change->key->lengths != NULL && change->key->lengths[0] == 4 );
+
+        index = find_tuple_column( row, "id" );
+        CHECK( index >= 0 && row->types[index] == INT4_TEST_OID && row->lengths[index] == 4 );
+        CHECK( read_tuple_number( row, ( unsigned int ) index, false, &number, &real ) && number == 42 );
+
+        index = find_tuple_column( row, "amount" );
+        CHECK( index >= 0 && row->types[index] == FLOAT8_TEST_OID );
+        CHECK( read_tuple_number( row, ( unsigned int ) index, true, &number, &real ) && real == 2.5 );
+
+        // Compared by length, the NUL does not end either value
+        index = find_tuple_column( row, "note" );
+        CHECK( index >= 0 && row->types[index] == BYTEA_TEST_OID && row->lengths[index] == 3 );
+        CHECK( memcmp( row->values[index], "a\0b", 3 ) == 0 );
+        CHECK( !tuple_value_equals( row, ( unsigned int ) index, change->old_tuple, ( unsigned int ) index ) );
+        CHECK( tuple_value_equals( change->key, 0, row, 0 ) );
+
+        // A bytea is not a number
+        CHECK( !read_tuple_number( row, ( unsigned int ) index, false, &number, &real ) );
+    }
+
+    free_change( change );
+
+    change = parse_change( text_record, 101 );
+    CHECK( change != NULL );
+
+    if( change != NULL )
+    {
+        row = change->new_tuple;
+
+        CHECK( row->lengths == NULL );
+        CHECK( read_tuple_number( row, ( unsigned int ) find_tuple_column( row, "id" ), false, &number, &real ) && number == -17 );
+        CHECK( read_tuple_number( row, ( unsigned int ) find_tuple_column( row, "amount" ), true, &number, &real ) && real == 1000.0 );
+        CHECK( row->values[find_tuple_column( row, "note" )] == NULL );
+    }
+
+    free_change( change );
+
+    CHECK( parse_change( broken_record, 102 ) == NULL );
+
+    return TEST_RESULT( "change" );
+}
@@ -0,0 +1,245 @@
+#include "test/test.h"
+
+/*
+ * Checks that coalesce_change() keeps the net effect of the changes to each
+ * row, splits UPDATEs of the key into two rows, drains rows in the order
+ * they were first changed, and keeps finding rows in constant time as the
+ * table outgrows its buckets.
+ */
+
+#define TEST_ROWS 20000
+
+static struct tuple * _make_tuple( char *, long );
+static struct change * _make_change( unsigned short, long, long );
+static struct change ** _drain( struct coalesce_table *, unsigned long * );
+static void _free_changes( struct change **, unsigned long );
+static long _value( struct tuple * );
+static void _test_net_effect( void );
+static void _test_key_change( void );
+static void _test_growth( void );
+
+int main( int argc, char ** argv )
+{
+    log_min_level = LOG_LEVEL_FATAL;
+
+    _test_net_effect();
+    _test_key_change();
+    _test_growth();
+
+    return TEST_RESULT( "coalesce" );
+}
+
+// One column, name, holding value
+static struct tuple * _make_tuple( char * name, long value )
+{
+    struct tuple * tuple = NULL;
+    char           text[32];
+
+    snprintf( text, sizeof( text ), "%ld", value );
+
+    tuple              = new_tuple( 1 );
+    tuple->num_columns = 1;
+    tuple->names[0]    = strdup( name );
+    tuple->values[0]   = strdup( text );
+    return tuple;
+}
+
+/*
+ * A change to the row of public.t keyed by id. old is the id the old tuple
+ * of an UPDATE or DELETE has, or -1 where the decoder leaves it out.
+ */
+static struct change * _make_change( unsigned short type, long id, long old )
+{
+    struct change * change = NULL;
+
+    change              = new_change( type );
+    change->schema_name = strdup( "public" );
+    change->table_name  = strdup( "t" );
+    change->key         = _make_tuple( "id", id );
+
+    if( type != CHANGE_TYPE_DELETE )
+    {
+        change->new_tuple = _make_tuple( "id", id );
+    }
+
+    if( old >= 0 )
+    {
+        change->old_tuple = _make_tuple( "id", old );
+    }
+
+    return change;
+}
+
+static struct change ** _drain( struct coalesce_table * table, unsigned long * num_changes )
+{
+    struct change ** changes = NULL;
+
+    CHECK( coalesce_drain( table, &changes, num_changes ) );
+    return changes;
+}
+
+static void _free_changes( struct change ** changes, unsigned long num_changes )
+{
+    unsigned long i = 0;
+
+    for( i = 0; i < num_changes; i++ )
+    {
+        free_change( changes[i] );
+    }
+
+    free( changes );
+    return;
+}
+
+static long _value( struct tuple * tuple )
+{
+    return tuple != NULL && tuple->values[0] != NULL ? atol( tuple->values[0] ) : -1;
+}
+
+static void _test_net_effect( void )
+{
+    struct coalesce_table * table       = NULL;
+    struct change **        changes     = NULL;
+    unsigned long           num_changes = 0;
+
+    table = new_coalesce_table( DEFAULT_COALESCE_BUCKETS );
+    CHECK( table != NULL );
+
+    // INSERT + UPDATE: an INSERT of the newest tuple
+    CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_INSERT, 1, -1 ) ) );
+    CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_UPDATE, 1, -1 ) ) );
+
+    // INSERT + DELETE: nothing
+    CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_INSERT, 2, -1 ) ) );
+    CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_DELETE, 2, -1 ) ) );
+
+    // UPDATE + UPDATE: one UPDATE, UPDATE + DELETE: a DELETE
+    CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_UPDATE, 3, -1 ) ) );
+    CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_UPDATE, 3, -1 ) ) );
+    CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_UPDATE, 4, -1 ) ) );
+    CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_DELETE, 4, -1 ) ) );
+
+    // DELETE + INSERT: an UPDATE
+    CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_DELETE, 5, -1 ) ) );
+    CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_INSERT, 5, -1 ) ) );
+
+    // Transaction boundaries are dropped
+    CHECK( coalesce_change( table, new_change( CHANGE_TYPE_COMMIT ) ) );
+    CHECK( table->num_changes == 10 );
+
+    changes = _drain( table, &num_changes );
+    CHECK( num_changes == 4 );
+
+    if( num_changes == 4 )
+    {
+        CHECK( changes[0]->type == CHANGE_TYPE_INSERT && _value( changes[0]->key ) == 1 );
+        CHECK( changes[1]->type == CHANGE_TYPE_UPDATE && _value( changes[1]->key ) == 3 );
+        CHECK( changes[2]->type == CHANGE_TYPE_DELETE && _value( changes[2]->key ) == 4 );
+        CHECK( changes[2]->new_tuple == NULL );
+        CHECK( changes[3]->type == CHANGE_TYPE_UPDATE && _value( changes[3]->new_tuple ) == 5 );
+    }
+
+    _free_changes( changes, num_changes );
+
+    // Where the copy may already hold a row inserted in the window, INSERT + DELETE stays a DELETE
+    table->keep_deletes = true;
+    CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_INSERT, 6, -1 ) ) );
+    CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_DELETE, 6, -1 ) ) );
+
+    changes = _drain( table, &num_changes );
+    CHECK( num_changes == 1 && changes[0]->type == CHANGE_TYPE_DELETE );
+    _free_changes( changes, num_changes );
+
+    free_coalesce_table( table );
+    return;
+}
+
+// An UPDATE of the key is a DELETE of the old row and an INSERT of the new one
+static void _test_key_change( void )
+{
+    struct coalesce_table * table       = NULL;
+    struct change **        changes     = NULL;
+    unsigned long           num_changes = 0;
+
+    table = new_coalesce_table( DEFAULT_COALESCE_BUCKETS );
+
+    CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_UPDATE, 8, 7 ) ) );
+
+    // A later change to the new key merges into the INSERT, not the DELETE
+    CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_UPDATE, 8, -1 ) ) );
+
+    // An UPDATE whose old tuple has the same key is not split
+    CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_UPDATE, 9, 9 ) ) );
+
+    changes = _drain( table, &num_changes );
+    CHECK( num_changes == 3 );
+
+    if( num_changes == 3 )
+    {
+        CHECK( changes[0]->type == CHANGE_TYPE_DELETE && _value( changes[0]->key ) == 7 );
+        CHECK( changes[1]->type == CHANGE_TYPE_INSERT && _value( changes[1]->key ) == 8 );
+        CHECK( changes[1]->old_tuple == NULL );
+        CHECK( changes[2]->type == CHANGE_TYPE_UPDATE && _value( changes[2]->key ) == 9 );
+    }
+
+    _free_changes( changes, num_changes );
+    free_coalesce_table( table );
+    return;
+}
+
+/*
+ * A transaction touching many rows grows the buckets, so that chains stay
+ * short, and draining it goes back to the buckets the table started with
+ */
+static void _test_growth( void )
+{
+    struct coalesce_table * table       = NULL;
+    struct coalesce_entry * entry       = NULL;
+    struct change **        changes     = NULL;
+    unsigned long           num_changes = 0;
+    unsigned long           chain       = 0;
+    unsigned long           longest     = 0;
+    unsigned long           i           = 0;
+    long                    id          = 0;
+
+    table = new_coalesce_table( DEFAULT_COALESCE_BUCKETS );
+
+    for( id = 0; id < TEST_ROWS; id++ )
+    {
+        CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_INSERT, id, -1 ) ) );
+    }
+
+    for( id = 0; id < TEST_ROWS; id += 2 )
+    {
+        CHECK( coalesce_change( table, _make_change( CHANGE_TYPE_DELETE, id, -1 ) ) );
+    }
+
+    CHECK( table->num_entries == TEST_ROWS );
+    CHECK( table->num_entries * 4 <= table->num_buckets * 3 );
+
+    for( i = 0; i < table->num_buckets; i++ )
+    {
+        for( chain = 0, entry = table->buckets[i]; entry != NULL; entry = entry->next )
+        {
+            chain++;
+        }
+
+        longest = chain > longest ? chain : longest;
+    }
+
+    CHECK( longest < 16 );
+
+    changes = _drain( table, &num_changes );
+    CHECK( num_changes == TEST_ROWS / 2 );
+
+    for( i = 0; i < num_changes; i++ )
+    {
+        CHECK( _value( changes[i]->key ) == ( long ) ( i * 2 + 1 ) );
+    }
+
+    _free_changes( changes, num_changes );
+    CHECK( table->num_buckets == DEFAULT_COALESCE_BUCKETS );
+
+    free_coalesce_table( table );
+    return;
+}
@@ -0,0 +1,309 @@
+#include "test/test.h"
+
+/*
+ * Checks a connection pool against a server forked to answer the start of
+ * each session as PostgreSQL would for a trusted user, and nothing more: a
+ * spare is established in the background, handed over and replaced, a
+ * spare the server has since closed is dropped for a new one, and waiting
+ * for a server that does not answer, or refuses connections, gives up once
+ * the timeout passes, backing off between failed attempts.
+ */
+
+#define TEST_CLIENTS 8
+
+static pid_t _start_server( int );
+static void _serve( int );
+static bool _answer_startup( int );
+static char * _conninfo( int );
+static int64_t _elapsed_ms( struct timeval * );
+static void _test_spares( void );
+static void _test_timeouts( void );
+static void _test_backoff( void );
+
+int main( int argc, char ** argv )
+{
+    log_min_level = LOG_LEVEL_FATAL;
+
+    _test_spares();
+    _test_timeouts();
+    _test_backoff();
+
+    return TEST_RESULT( "connection_pool" );
+}
+
+static pid_t _start_server( int listener )
+{
+    pid_t pid = 0;
+
+    pid = fork();
+
+    if( pid == 0 )
+    {
+        _serve( listener );
+    }
+
+    return pid;
+}
+
+/*
+ * Accepts connections on listener and answers each session's startup
+ * message, keeping them open until the client closes them or the server is
+ * killed
+ */
+static void _serve( int listener )
+{
+    struct pollfd fds[TEST_CLIENTS + 1];
+    bool          started[TEST_CLIENTS + 1];
+    char          data[256];
+    unsigned int  num_fds = 1;
+    unsigned int  i       = 0;
+    int           client  = -1;
+
+    memset( started, 0, sizeof( started ) );
+    fds[0].fd     = listener;
+    fds[0].events = POLLIN;
+
+    while( poll( fds, num_fds, -1 ) > 0 )
+    {
+        for( i = num_fds - 1; i > 0; i-- )
+        {
+            if( fds[i].revents == 0 )
+            {
+                continue;
+            }
+
+            if( started[i] ? read( fds[i].fd, data, sizeof( data ) ) > 0 : _answer_startup( fds[i].fd ) )
+            {
+                started[i] = true;
+                continue;
+            }
+
+            close( fds[i].fd );
+            fds[i]     = fds[--num_fds];
+            started[i] = started[num_fds];
+        }
+
+        if( ( fds[0].revents & POLLIN ) != 0 && num_fds <= TEST_CLIENTS )
+        {
+            client = accept( listener, NULL, NULL );
+
+            if( client >= 0 )
+            {
+                fds[num_fds].fd      = client;
+                fds[num_fds].events  = POLLIN;
+                fds[num_fds].revents = 0;
+                started[num_fds++]   = false;
+            }
+        }
+    }
+
+    _exit( 0 );
+}
+
+/*
+ * Reads a startup message and answers AuthenticationOk and ReadyForQuery,
+ * refusing encryption if that is asked for first. Returns false once the
+ * client has gone.
+ */
+static bool _answer_startup( int fd )
+{
+    unsigned char header[8];
+    unsigned char ready[] = { 'R', 0, 0, 0, 8, 0, 0, 0, 0, 'Z', 0, 0, 0, 5, 'I' };
+    char          body[1024];
+    uint32_t      length  = 0;
+    uint32_t      code    = 0;
+
+    while( true )
+    {
+        if( recv( fd, header, sizeof( header ), MSG_WAITALL ) != ( ssize_t ) sizeof( header ) )
+        {
+            return false;
+        }
+
+        length = ( ( uint32_t ) header[0] << 24 ) | ( ( uint32_t ) header[1] << 16 ) | ( ( uint32_t ) header[2] << 8 ) | header[3];
+        code   = ( ( uint32_t ) header[4] << 24 ) | ( ( uint32_t ) header[5] << 16 ) | ( ( uint32_t ) header[6] << 8 ) | header[7];
+
+        // SSLRequest and GSSENCRequest
+        if( code == 80877103 || code == 80877104 )
+        {
+            if( write( fd, "N", 1 ) != 1 )
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        if(
+                length < sizeof( header )
+             || length - sizeof( header ) > sizeof( body )
+             || recv( fd, body, length - sizeof( header ), MSG_WAITALL ) != ( ssize_t ) ( length - sizeof( header ) )
+          )
+        {
+            return false;
+        }
+
+        return write( fd, ready, sizeof( ready ) ) == ( ssize_t ) sizeof( ready );
+    }
+}
+
+static char * _conninfo( int port )
+{
+    static char conninfo[128];
+
+    snprintf(
+        conninfo,
+        sizeof( conninfo ),
+        "host=127.0.0.1 port=%d user=test dbname=test sslmode=disable gssencmode=disable connect_timeout=10",
+        port
+    );
+
+    return conninfo;
+}
+
+static int64_t _elapsed_ms( struct timeval * since )
+{
+    struct timeval now = {0};
+
+    gettimeofday( &now, NULL );
+
+    return ( int64_t ) ( now.tv_sec - since->tv_sec ) * 1000 + ( now.tv_usec - since->tv_usec ) / 1000;
+}
+
+static void _test_spares( void )
+{
+    struct connection_pool * pool     = NULL;
+    struct sockaddr_in       address  = {0};
+    socklen_t                length   = sizeof( address );
+    PGconn *                 conns[2] = { NULL, NULL };
+    pid_t                    server   = 0;
+    unsigned int             i        = 0;
+    int                      listener = -1;
+
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    listener                = socket( AF_INET, SOCK_STREAM, 0 );
+
+    CHECK(
+            listener >= 0
+         && bind( listener, ( struct sockaddr * ) &address, sizeof( address ) ) == 0
+         && listen( listener, TEST_CLIENTS ) == 0
+         && getsockname( listener, ( struct sockaddr * ) &address, &length ) == 0
+    );
+
+    server = _start_server( listener );
+    pool   = new_connection_pool( _conninfo( ntohs( address.sin_port ) ), 1 );
+    CHECK( server > 0 && pool != NULL );
+
+    if( pool == NULL )
+    {
+        kill( server, SIGKILL );
+        waitpid( server, NULL, 0 );
+        close( listener );
+        return;
+    }
+
+    // The spare is started at once, and comes up without anyone waiting on it
+    CHECK( pool->slots[0].state == POOL_SLOT_CONNECTING );
+
+    for( i = 0; i < 100 && pool->slots[0].state != POOL_SLOT_READY; i++ )
+    {
+        CHECK( poll_connection_pool( pool, 50 ) );
+    }
+
+    CHECK( pool->slots[0].state == POOL_SLOT_READY );
+
+    // Handed over, and replaced
+    conns[0] = acquire_connection( pool, 5000 );
+    CHECK( conns[0] != NULL && PQstatus( conns[0] ) == CONNECTION_OK );
+    CHECK( pool->slots[0].state == POOL_SLOT_CONNECTING );
+
+    for( i = 0; i < 100 && pool->slots[0].state != POOL_SLOT_READY; i++ )
+    {
+        CHECK( poll_connection_pool( pool, 50 ) );
+    }
+
+    CHECK( pool->slots[0].state == POOL_SLOT_READY );
+
+    // The server goes away and another takes its place, as in a failover
+    kill( server, SIGKILL );
+    waitpid( server, NULL, 0 );
+    server = _start_server( listener );
+
+    // Not the spare the first server closed, which would have been read to its end
+    conns[1] = acquire_connection( pool, 5000 );
+    CHECK( conns[1] != NULL && PQstatus( conns[1] ) == CONNECTION_OK && PQconsumeInput( conns[1] ) != 0 );
+    CHECK( pool->retry_ms == CONNECTION_RETRY_MIN_MS );
+
+    PQfinish( conns[0] );
+    PQfinish( conns[1] );
+    free_connection_pool( pool );
+
+    kill( server, SIGKILL );
+    waitpid( server, NULL, 0 );
+    close( listener );
+    return;
+}
+
+static void _test_timeouts( void )
+{
+    struct connection_pool * pool     = NULL;
+    struct sockaddr_in       address  = {0};
+    struct timeval           started  = {0};
+    socklen_t                length   = sizeof( address );
+    int64_t                  elapsed  = 0;
+    int                      listener = -1;
+
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    listener                = socket( AF_INET, SOCK_STREAM, 0 );
+
+    CHECK(
+            listener >= 0
+         && bind( listener, ( struct sockaddr * ) &address, sizeof( address ) ) == 0
+         && listen( listener, TEST_CLIENTS ) == 0
+         && getsockname( listener, ( struct sockaddr * ) &address, &length ) == 0
+    );
+
+    // Without spares, nothing is connected until it is asked for
+    pool = new_connection_pool( _conninfo( ntohs( address.sin_port ) ), 0 );
+    CHECK( pool != NULL && pool->num_slots == 1 && pool->slots[0].state == POOL_SLOT_EMPTY );
+
+    // Then connected, but never answered
+
+    gettimeofday( &started, NULL );
+    CHECK( acquire_connection( pool, 200 ) == NULL );
+    elapsed = _elapsed_ms( &started );
+    CHECK( elapsed >= 150 && elapsed < 2000 );
+
+    free_connection_pool( pool );
+    close( listener );
+
+    // Refused outright, each attempt backing off further
+    pool = new_connection_pool( _conninfo( ntohs( address.sin_port ) ), 1 );
+    CHECK( pool != NULL );
+
+    gettimeofday( &started, NULL );
+    CHECK( acquire_connection( pool, 300 ) == NULL );
+    elapsed = _elapsed_ms( &started );
+    CHECK( elapsed >= 250 && elapsed < 2000 );
+    CHECK( pool != NULL && pool->retry_ms > CONNECTION_RETRY_MIN_MS * 2 && pool->retry_ms <= CONNECTION_RETRY_MAX_MS );
+
+    free_connection_pool( pool );
+
+    CHECK( new_connection_pool( "host='unterminated", 1 ) == NULL );
+    return;
+}
+
+static void _test_backoff( void )
+{
+    unsigned int delay = 0;
+
+    connection_backoff( &delay );
+    CHECK( delay == CONNECTION_RETRY_MIN_MS * 2 );
+
+    delay = CONNECTION_RETRY_MAX_MS / 2 + 1;
+    connection_backoff( &delay );
+    CHECK( delay == CONNECTION_RETRY_MAX_MS );
+    return;
+}
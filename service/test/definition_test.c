@@ -0,0 +1,153 @@
+#include "test/test.h"
+
+/*
+ * Checks how definitions are taken apart for incremental maintenance: the
+ * relations of inner joins and where their names are, aggregate calls and
+ * their arguments, grouping keys, and the top-level conjuncts of a filter,
+ * leaving alone whatever is nested or quoted.
+ */
+
+static void _test_simple( void );
+static void _test_join_aggregate( void );
+static void _test_unsupported( void );
+static void _test_conjuncts( void );
+
+int main( int argc, char ** argv )
+{
+    log_min_level = LOG_LEVEL_FATAL;
+
+    _test_simple();
+    _test_join_aggregate();
+    _test_unsupported();
+    _test_conjuncts();
+
+    return TEST_RESULT( "definition" );
+}
+
+// A projection and filter over one relation, which can be refreshed in ctid ranges
+static void _test_simple( void )
+{
+    struct definition * definition = NULL;
+
+    definition = parse_definition( "SELECT id, name FROM public.users WHERE active" );
+    CHECK( definition != NULL );
+
+    if( definition == NULL )
+    {
+        return;
+    }
+
+    CHECK( definition->is_select && definition->is_simple && !definition->has_aggregates );
+    CHECK( definition->relation != NULL && strcmp( definition->relation, "public.users" ) == 0 );
+    CHECK( definition->where != NULL && strcmp( definition->where, "active" ) == 0 );
+    CHECK( definition->num_columns == 2 );
+    CHECK( definition->num_relations == 1 );
+
+    free_definition( definition );
+    return;
+}
+
+static void _test_join_aggregate( void )
+{
+    struct definition * definition = NULL;
+    char *              text       = NULL;
+
+    text = "SELECT o.region, sum( o.qty ) AS qty, count(*) "
+           "FROM public.orders o JOIN public.stores s ON s.id = o.store "
+           "WHERE o.qty > 0 GROUP BY o.region HAVING count(*) > 1";
+
+    definition = parse_definition( text );
+    CHECK( definition != NULL );
+
+    if( definition == NULL )
+    {
+        return;
+    }
+
+    CHECK( definition->is_select && !definition->is_simple && definition->has_aggregates );
+    CHECK( definition->num_relations == 2 );
+
+    if( definition->num_relations == 2 )
+    {
+        CHECK( strcmp( definition->relations[0].relation, "public.orders" ) == 0 );
+        CHECK( strcmp( definition->relations[0].alias, "o" ) == 0 );
+        CHECK( strcmp( definition->relations[1].relation, "public.stores" ) == 0 );
+
+        // Names are found where they are, to be replaced by another row source
+        CHECK(
+            strncmp(
+                definition->from_clause + definition->relations[1].offset,
+                "public.stores",
+                definition->relations[1].length
+            ) == 0
+        );
+    }
+
+    CHECK( definition->num_columns == 3 );
+
+    if( definition->num_columns == 3 )
+    {
+        CHECK( definition->columns[0].aggregate == AGGREGATE_NONE );
+        CHECK( strcmp( definition->columns[0].name, "region" ) == 0 );
+        CHECK( definition->columns[1].aggregate == AGGREGATE_SUM );
+        CHECK( strcmp( definition->columns[1].argument, "o.qty" ) == 0 );
+        CHECK( strcmp( definition->columns[1].name, "qty" ) == 0 );
+        CHECK( definition->columns[2].aggregate == AGGREGATE_COUNT );
+        CHECK( strcmp( definition->columns[2].argument, "*" ) == 0 );
+    }
+
+    CHECK( definition->num_group_keys == 1 && strcmp( definition->group_keys[0], "o.region" ) == 0 );
+    CHECK( definition->having != NULL && strcmp( definition->having, "count(*) > 1" ) == 0 );
+
+    free_definition( definition );
+    return;
+}
+
+// Outer joins and subqueries are not taken apart into relations
+static void _test_unsupported( void )
+{
+    struct definition * definition = NULL;
+
+    definition = parse_definition( "SELECT a.x FROM a LEFT JOIN b ON a.id = b.id" );
+    CHECK( definition != NULL && definition->num_relations == 0 && !definition->is_simple );
+    free_definition( definition );
+
+    // A keyword inside a string literal is not a clause
+    definition = parse_definition( "SELECT x FROM ( SELECT 'FROM' AS x FROM t ) q" );
+    CHECK( definition != NULL && definition->num_relations == 0 && !definition->is_simple );
+    free_definition( definition );
+    return;
+}
+
+static void _test_conjuncts( void )
+{
+    char **      conjuncts     = NULL;
+    char *       relation      = NULL;
+    char *       column        = NULL;
+    unsigned int num_conjuncts = 0;
+    unsigned int i             = 0;
+
+    CHECK( split_conjuncts( "a = 1 AND ( b = 2 OR c = 3 ) AND d = 'x AND y'", &conjuncts, &num_conjuncts ) );
+    CHECK( num_conjuncts == 3 );
+
+    if( num_conjuncts == 3 )
+    {
+        CHECK( strcmp( conjuncts[0], "a = 1" ) == 0 );
+        CHECK( strcmp( conjuncts[1], "( b = 2 OR c = 3 )" ) == 0 );
+        CHECK( strcmp( conjuncts[2], "d = 'x AND y'" ) == 0 );
+    }
+
+    for( i = 0; i < num_conjuncts; i++ )
+    {
+        free( conjuncts[i] );
+    }
+
+    free( conjuncts );
+
+    CHECK( split_column_reference( "o.qty", &relation, &column ) );
+    CHECK( relation != NULL && strcmp( relation, "o" ) == 0 );
+    CHECK( column != NULL && strcmp( column, "qty" ) == 0 );
+    free( relation );
+    free( column );
+    return;
+}
@@ -0,0 +1,226 @@
+#include "test/test.h"
+
+/*
+ * Checks the graph of objects defined over the targets of others, built
+ * from plans given in place of those planned against a database: objects
+ * are ordered after what they read, a target read twice is one edge,
+ * objects that share no edges are in separate components with their own
+ * freshness, changes reach the objects downstream of the tables they touch,
+ * definitions that read each other are refused, and components are applied
+ * earliest deadline first.
+ */
+
+#define TEST_OBJECTS 4
+
+static void _set_object( struct maintenance_object *, struct ivm_plan *, char *, char ** );
+static unsigned int _position( struct dependency_graph *, unsigned int );
+static struct change * _make_change( char *, char * );
+static void _test_graph( struct worker * );
+static void _test_cycle( struct worker * );
+static void _test_schedule( void );
+
+int main( int argc, char ** argv )
+{
+    struct worker me = {0};
+
+    log_min_level = LOG_LEVEL_FATAL;
+
+    _test_graph( &me );
+    _test_cycle( &me );
+    _test_schedule();
+
+    return TEST_RESULT( "dependency" );
+}
+
+// An object public.name reading each of relations, as schema.table, up to a NULL
+static void _set_object(
+    struct maintenance_object * object,
+    struct ivm_plan *           plan,
+    char *                      name,
+    char **                     relations
+)
+{
+    unsigned int i = 0;
+
+    object->namespace      = "public";
+    object->name           = name;
+    object->qualified_name = name;
+    object->ivm            = plan;
+
+    for( i = 0; relations[i] != NULL; i++ );
+
+    plan->relations     = ( struct ivm_relation * ) calloc( i + 1, sizeof( struct ivm_relation ) );
+    plan->num_relations = i;
+
+    for( i = 0; relations[i] != NULL; i++ )
+    {
+        split_column_reference( relations[i], &( plan->relations[i].schema_name ), &( plan->relations[i].table_name ) );
+    }
+
+    return;
+}
+
+static unsigned int _position( struct dependency_graph * graph, unsigned int object )
+{
+    unsigned int i = 0;
+
+    for( i = 0; i < graph->num_objects && graph->order[i] != object; i++ );
+
+    return i;
+}
+
+static struct change * _make_change( char * schema_name, char * table_name )
+{
+    struct change * change = NULL;
+
+    change              = new_change( CHANGE_TYPE_INSERT );
+    change->schema_name = strdup( schema_name );
+    change->table_name  = strdup( table_name );
+    return change;
+}
+
+static void _test_graph( struct worker * me )
+{
+    struct maintenance_object   objects[TEST_OBJECTS] = {{0}};
+    struct maintenance_object * pointers[TEST_OBJECTS];
+    struct ivm_plan             plans[TEST_OBJECTS]   = {{0}};
+    struct dependency_graph *   graph                 = NULL;
+    struct change *             changes[2];
+    bool                        changed[TEST_OBJECTS];
+    char *                      reads_c[]             = { "public.a", "public.b", "public.a", NULL };
+    char *                      reads_b[]             = { "public.a", NULL };
+    char *                      reads_a[]             = { "base.t1", NULL };
+    char *                      reads_d[]             = { "base.t2", NULL };
+    unsigned int                i                     = 0;
+    unsigned int                j                     = 0;
+
+    // Listed in no useful order; c reads a twice, as a self join would
+    _set_object( &( objects[0] ), &( plans[0] ), "c", reads_c );
+    _set_object( &( objects[1] ), &( plans[1] ), "b", reads_b );
+    _set_object( &( objects[2] ), &( plans[2] ), "a", reads_a );
+    _set_object( &( objects[3] ), &( plans[3] ), "d", reads_d );
+
+    objects[0].freshness_ms = 500;
+    objects[1].freshness_ms = 200;
+
+    for( i = 0; i < TEST_OBJECTS; i++ )
+    {
+        pointers[i] = &( objects[i] );
+    }
+
+    graph = build_dependency_graph( me, pointers, TEST_OBJECTS );
+    CHECK( graph != NULL );
+
+    if( graph != NULL )
+    {
+        CHECK( _position( graph, 2 ) < _position( graph, 1 ) );
+        CHECK( _position( graph, 1 ) < _position( graph, 0 ) );
+        CHECK( graph->levels[2] == 0 && graph->levels[1] == 1 && graph->levels[0] == 2 );
+        CHECK( graph->levels[3] == 0 );
+
+        CHECK( graph->num_dependencies[0] == 2 );
+        CHECK( graph->num_dependents[2] == 2 );
+        CHECK( graph->num_dependents[0] == 0 && graph->num_dependencies[3] == 0 );
+
+        CHECK( graph->num_components == 2 );
+        CHECK( graph->components[0] == graph->components[1] && graph->components[1] == graph->components[2] );
+        CHECK( graph->components[3] != graph->components[0] );
+        CHECK( graph->freshness[graph->components[0]] == 200 );
+        CHECK( graph->freshness[graph->components[3]] == 0 );
+
+        CHECK( is_derived_relation( graph, "public", "a" ) );
+        CHECK( !is_derived_relation( graph, "base", "t1" ) );
+
+        // A change to t1 reaches everything that reads a, directly or not
+        changes[0] = _make_change( "base", "t1" );
+        find_changed_objects( graph, changes, 1, changed );
+        CHECK( changed[0] && changed[1] && changed[2] && !changed[3] );
+
+        // Changes to targets are the maintenance of them, not changes to apply
+        changes[1] = _make_change( "public", "a" );
+        find_changed_objects( graph, changes + 1, 1, changed );
+
+        for( i = 0, j = 0; i < TEST_OBJECTS; i++ )
+        {
+            j += changed[i];
+        }
+
+        CHECK( j == 0 );
+
+        free_change( changes[0] );
+        free_change( changes[1] );
+        free_dependency_graph( graph );
+    }
+
+    for( i = 0; i < TEST_OBJECTS; i++ )
+    {
+        for( j = 0; j < plans[i].num_relations; j++ )
+        {
+            free( plans[i].relations[j].schema_name );
+            free( plans[i].relations[j].table_name );
+        }
+
+        free( plans[i].relations );
+    }
+
+    return;
+}
+
+static void _test_cycle( struct worker * me )
+{
+    struct maintenance_object   objects[2] = {{0}};
+    struct maintenance_object * pointers[2];
+    struct ivm_plan             plans[2]   = {{0}};
+    char *                      reads_x[]  = { "public.y", NULL };
+    char *                      reads_y[]  = { "public.x", NULL };
+    unsigned int                i          = 0;
+
+    _set_object( &( objects[0] ), &( plans[0] ), "x", reads_x );
+    _set_object( &( objects[1] ), &( plans[1] ), "y", reads_y );
+
+    pointers[0] = &( objects[0] );
+    pointers[1] = &( objects[1] );
+
+    CHECK( build_dependency_graph( me, pointers, 2 ) == NULL );
+
+    for( i = 0; i < 2; i++ )
+    {
+        free( plans[i].relations[0].schema_name );
+        free( plans[i].relations[0].table_name );
+        free( plans[i].relations );
+    }
+
+    return;
+}
+
+// Tightest freshness first, those without one last, ties in the order given
+static void _test_schedule( void )
+{
+    struct dependency_graph graph        = {0};
+    uint64_t                freshness[]  = { 0, 1000, 200, 0, 200 };
+    unsigned int            components[] = { 0, 1, 2, 3, 4 };
+    unsigned int            reversed[]   = { 4, 3, 2, 1, 0 };
+    unsigned int            expected[]   = { 2, 4, 1, 0, 3 };
+    unsigned int            backwards[]  = { 4, 2, 1, 3, 0 };
+    unsigned int            i            = 0;
+    unsigned int            wrong        = 0;
+
+    graph.freshness      = freshness;
+    graph.num_components = 5;
+
+    schedule_components( &graph, components, 5 );
+    schedule_components( &graph, reversed, 5 );
+
+    for( i = 0; i < 5; i++ )
+    {
+        wrong += components[i] != expected[i];
+        wrong += reversed[i] != backwards[i];
+    }
+
+    CHECK( wrong == 0 );
+
+    // Nothing to order
+    schedule_components( &graph, components, 1 );
+    CHECK( components[0] == 2 );
+    return;
+}
@@ -0,0 +1,131 @@
+#include "test/test.h"
+
+/*
+ * Checks which drivers the registry takes: each must have a name of its
+ * own, be built against this TARGET_DRIVER_API_VERSION, provide every
+ * required callback and either all of the refresh hooks or none, and no
+ * more than MAX_TARGET_DRIVERS are kept. Also checks that a directory of
+ * drivers that cannot be read, or holds a file that is not one, fails to
+ * load.
+ */
+
+static void _test_register( void );
+static void _test_load( void );
+
+int main( int argc, char ** argv )
+{
+    log_min_level = LOG_LEVEL_FATAL;
+
+    _test_register();
+    _test_load();
+
+    return TEST_RESULT( "driver" );
+}
+
+static void _test_register( void )
+{
+    static struct target_driver extra[MAX_TARGET_DRIVERS];
+    static char                 names[MAX_TARGET_DRIVERS][32];
+    struct target_driver        driver     = {0};
+    struct target_driver        duplicate  = {0};
+    struct target_driver        broken     = {0};
+    unsigned int                registered = 1;
+    unsigned int                i          = 0;
+
+    driver      = memcached_driver;
+    driver.name = "test_driver";
+    duplicate   = driver;
+
+    CHECK( !register_target_driver( NULL ) );
+
+    broken      = driver;
+    broken.name = NULL;
+    CHECK( !register_target_driver( &broken ) );
+
+    broken             = driver;
+    broken.api_version = TARGET_DRIVER_API_VERSION + 1;
+    CHECK( !register_target_driver( &broken ) );
+
+    broken             = driver;
+    broken.apply_batch = NULL;
+    CHECK( !register_target_driver( &broken ) );
+
+    broken       = driver;
+    broken.close = NULL;
+    CHECK( !register_target_driver( &broken ) );
+
+    // Some of the refresh hooks, but not all
+    broken               = driver;
+    broken.refresh_chunk = NULL;
+    CHECK( !register_target_driver( &broken ) );
+
+    CHECK( register_target_driver( &driver ) );
+    CHECK( !register_target_driver( &duplicate ) );
+
+    // None of them, refreshing by the changes of a full scan instead
+    broken               = driver;
+    broken.name          = "test_no_refresh";
+    broken.refresh_begin = NULL;
+    broken.refresh_chunk = NULL;
+    broken.refresh_end   = NULL;
+    CHECK( register_target_driver( &broken ) );
+    registered++;
+
+    for( i = 0; i < MAX_TARGET_DRIVERS; i++ )
+    {
+        snprintf( names[i], sizeof( names[i] ), "test_extra_%u", i );
+        extra[i]      = driver;
+        extra[i].name = names[i];
+
+        if( register_target_driver( &extra[i] ) )
+        {
+            registered++;
+        }
+    }
+
+    CHECK( registered == MAX_TARGET_DRIVERS );
+    return;
+}
+
+static void _test_load( void )
+{
+    char   directory[] = "/tmp/driver_test.XXXXXX";
+    char   path[64];
+    FILE * file        = NULL;
+
+    CHECK( !load_target_drivers( NULL ) );
+    CHECK( !load_target_drivers( "/nonexistent/driver_test" ) );
+
+    CHECK( mkdtemp( directory ) != NULL );
+
+    // Only files with the suffix are loaded
+    snprintf( path, sizeof( path ), "%s/README", directory );
+    file = fopen( path, "w" );
+    CHECK( file != NULL );
+
+    if( file == NULL )
+    {
+        rmdir( directory );
+        return;
+    }
+
+    fclose( file );
+    CHECK( load_target_drivers( directory ) );
+
+    snprintf( path, sizeof( path ), "%s/bad%s", directory, TARGET_DRIVER_SUFFIX );
+    file = fopen( path, "w" );
+    CHECK( file != NULL && fputs( "not a library", file ) >= 0 );
+
+    if( file != NULL )
+    {
+        fclose( file );
+    }
+
+    CHECK( !load_target_drivers( directory ) );
+
+    unlink( path );
+    snprintf( path, sizeof( path ), "%s/README", directory );
+    unlink( path );
+    rmdir( directory );
+    return;
+}
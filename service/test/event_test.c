@@ -0,0 +1,199 @@
+#include "test/test.h"
+
+/*
+ * Checks the parent's event loop: descriptors are dispatched as they become
+ * ready, timers fire with their expirations already read, a handler removed
+ * by another in the same round is not called, signals are read from the
+ * loop rather than delivered, and a failing callback fails the loop.
+ */
+
+// What the callbacks of one test count
+struct event_test {
+    int          pipe[2];
+    int          other[2];
+    int          timer;
+    unsigned int ticks;
+    unsigned int bytes;
+    unsigned int calls;
+    int          signal;
+};
+
+static bool _tick( struct event_loop *, int, uint32_t, void * );
+static bool _read_byte( struct event_loop *, int, uint32_t, void * );
+static bool _remove_other( struct event_loop *, int, uint32_t, void * );
+static bool _stop( struct event_loop *, int, uint32_t, void * );
+static bool _fail( struct event_loop *, int, uint32_t, void * );
+static bool _on_signal( struct event_loop *, int, void * );
+static void _test_pipe_timer( void );
+static void _test_removal( void );
+static void _test_signals( void );
+
+int main( int argc, char ** argv )
+{
+    log_min_level = LOG_LEVEL_FATAL;
+
+    _test_pipe_timer();
+    _test_removal();
+    _test_signals();
+
+    return TEST_RESULT( "event" );
+}
+
+// Writes a byte to the pipe each time the timer fires
+static bool _tick( struct event_loop * loop, int fd, uint32_t events, void * argument )
+{
+    struct event_test * test = NULL;
+
+    test         = ( struct event_test * ) argument;
+    test->ticks += events;
+
+    return write( test->pipe[1], "x", 1 ) == 1;
+}
+
+// Reads what the timer wrote, and stops once it has written three bytes
+static bool _read_byte( struct event_loop * loop, int fd, uint32_t events, void * argument )
+{
+    struct event_test * test = NULL;
+    char                byte = '\0';
+
+    test = ( struct event_test * ) argument;
+
+    while( read( fd, &byte, 1 ) == 1 )
+    {
+        test->bytes++;
+    }
+
+    if( test->bytes >= 3 )
+    {
+        remove_event( loop, test->timer );
+        stop_event_loop( loop );
+    }
+
+    return true;
+}
+
+// Whichever of two ready pipes is dispatched first removes the other
+static bool _remove_other( struct event_loop * loop, int fd, uint32_t events, void * argument )
+{
+    struct event_test * test = NULL;
+
+    test = ( struct event_test * ) argument;
+    test->calls++;
+
+    remove_event( loop, fd == test->pipe[0] ? test->other[0] : test->pipe[0] );
+    remove_event( loop, fd );
+    return true;
+}
+
+static bool _stop( struct event_loop * loop, int fd, uint32_t events, void * argument )
+{
+    stop_event_loop( loop );
+    return true;
+}
+
+static bool _fail( struct event_loop * loop, int fd, uint32_t events, void * argument )
+{
+    return false;
+}
+
+static bool _on_signal( struct event_loop * loop, int signal, void * argument )
+{
+    ( ( struct event_test * ) argument )->signal = signal;
+    stop_event_loop( loop );
+    return true;
+}
+
+static void _test_pipe_timer( void )
+{
+    struct event_loop * loop = NULL;
+    struct event_test   test = {{0}};
+
+    loop = new_event_loop();
+    CHECK( loop != NULL && pipe( test.pipe ) == 0 );
+
+    if( loop == NULL )
+    {
+        return;
+    }
+
+    fcntl( test.pipe[0], F_SETFL, O_NONBLOCK );
+
+    test.timer = add_timer( loop, 5, _tick, &test );
+    CHECK( test.timer >= 0 );
+    CHECK( add_event( loop, test.pipe[0], EPOLLIN, _read_byte, &test ) );
+
+    // A timer added without an interval waits to be armed
+    CHECK( add_timer( loop, 0, _fail, NULL ) >= 0 );
+
+    CHECK( run_event_loop( loop ) );
+    CHECK( test.bytes == 3 && test.ticks >= 3 );
+
+    // A callback that fails ends the loop with it
+    CHECK( write( test.pipe[1], "x", 1 ) == 1 );
+    remove_event( loop, test.pipe[0] );
+    CHECK( add_event( loop, test.pipe[0], EPOLLIN, _fail, NULL ) );
+    CHECK( !run_event_loop( loop ) );
+
+    free_event_loop( loop );
+    close( test.pipe[0] );
+    close( test.pipe[1] );
+    return;
+}
+
+static void _test_removal( void )
+{
+    struct event_loop * loop = NULL;
+    struct event_test   test = {{0}};
+
+    loop = new_event_loop();
+    CHECK( loop != NULL && pipe( test.pipe ) == 0 && pipe( test.other ) == 0 );
+
+    if( loop == NULL )
+    {
+        return;
+    }
+
+    CHECK( write( test.pipe[1], "x", 1 ) == 1 && write( test.other[1], "x", 1 ) == 1 );
+    CHECK( add_event( loop, test.pipe[0], EPOLLIN, _remove_other, &test ) );
+    CHECK( add_event( loop, test.other[0], EPOLLIN, _remove_other, &test ) );
+    CHECK( add_timer( loop, 20, _stop, NULL ) >= 0 );
+
+    CHECK( run_event_loop( loop ) );
+    CHECK( test.calls == 1 );
+
+    free_event_loop( loop );
+    close( test.pipe[0] );
+    close( test.pipe[1] );
+    close( test.other[0] );
+    close( test.other[1] );
+    return;
+}
+
+static void _test_signals( void )
+{
+    struct event_loop * loop      = NULL;
+    struct event_test   test      = {{0}};
+    int                 signals[] = { SIGUSR1 };
+    sigset_t            blocked;
+
+    loop = new_event_loop();
+    CHECK( loop != NULL );
+
+    if( loop == NULL )
+    {
+        return;
+    }
+
+    CHECK( add_signals( loop, signals, 1, _on_signal, &test ) );
+
+    // Blocked, so it waits for the loop rather than ending the process
+    CHECK( raise( SIGUSR1 ) == 0 );
+    CHECK( run_event_loop( loop ) );
+    CHECK( test.signal == SIGUSR1 );
+
+    free_event_loop( loop );
+
+    sigprocmask( SIG_SETMASK, NULL, &blocked );
+    CHECK( !sigismember( &blocked, SIGUSR1 ) );
+    return;
+}
@@ -0,0 +1,310 @@
+#include "test/test.h"
+
+/*
+ * Checks a fan-out with members that are never started, so that their
+ * queues only grow as records are queued and only shrink as the test reads
+ * them. The slot is confirmed to the least position any location has
+ * applied, and a location that falls more than fanout_lag_budget behind is
+ * detached and holds it there. A location is throttled once a member's
+ * queue is past fanout_high_water and until each is down to
+ * FANOUT_LOW_WATER, and the stream is paused only while every attached
+ * location is throttled, resuming as soon as one catches up. Also checks,
+ * with members that are started, that the fan-outs of two sources share
+ * fanout_worker_limit members, one waiting while the other has the only
+ * place, and that an idle member ends for a waiting one to start.
+ */
+
+#define TEST_HIGH_WATER 1000
+#define TEST_BEGIN "{\"type\":\"BEGIN\",\"xid\":\"1\"}"
+
+static void _drain( struct fanout_member *, uint64_t );
+static void _queue( struct fanout *, char *, unsigned int, struct fanout_member * );
+static void _test_confirm( void );
+static void _test_throttle( void );
+static struct fanout * _new_source( char * );
+static void _test_pool( void );
+
+int main( int argc, char ** argv )
+{
+    char directory[] = "/tmp/fanout_test.XXXXXX";
+
+    log_min_level = LOG_LEVEL_FATAL;
+
+    spill_directory = mkdtemp( directory );
+    CHECK( spill_directory != NULL );
+
+    if( spill_directory == NULL )
+    {
+        return TEST_RESULT( "fanout" );
+    }
+
+    _test_confirm();
+    _test_throttle();
+    _test_pool();
+
+    CHECK( rmdir( directory ) == 0 );
+
+    return TEST_RESULT( "fanout" );
+}
+
+/*
+ * Two locations, the first with two members, whose queues are read and
+ * confirmed as the members would once they applied what they took
+ */
+static void _test_confirm( void )
+{
+    struct fanout          fanout  = {{0}};
+    struct fanout_location locations[2];
+    struct fanout_member   members[3];
+    unsigned int           i       = 0;
+
+    memset( locations, 0, sizeof( locations ) );
+    memset( members, 0, sizeof( members ) );
+
+    for( i = 0; i < 3; i++ )
+    {
+        members[i].socket = -1;
+        members[i].queue  = new_spill_queue( i == 0 ? "fanout_test_0" : i == 1 ? "fanout_test_1" : "fanout_test_2" );
+        CHECK( members[i].queue != NULL );
+    }
+
+    locations[0].location    = 1;
+    locations[0].members     = &( members[0] );
+    locations[0].num_members = 2;
+    locations[1].location    = 2;
+    locations[1].members     = &( members[2] );
+    locations[1].num_members = 1;
+    fanout.locations         = locations;
+    fanout.num_locations     = 2;
+    fanout.start_lsn         = 10;
+    fanout.queued_lsn        = 50;
+    fanout_lag_budget        = 100;
+
+    // Nothing is confirmed until every location has applied something
+    CHECK( spill_queue_confirm( members[0].queue, 30 ) && spill_queue_confirm( members[2].queue, 40 ) );
+    update_fanout( &fanout );
+    CHECK( fanout.confirmed_lsn == 0 && !fanout_detached( &fanout ) );
+
+    // A location is as far as its slowest member
+    CHECK( spill_queue_confirm( members[1].queue, 20 ) );
+    update_fanout( &fanout );
+    CHECK( locations[0].safe_lsn == 20 && locations[1].safe_lsn == 40 );
+    CHECK( fanout.confirmed_lsn == 20 );
+
+    CHECK( spill_queue_confirm( members[1].queue, 40 ) );
+    update_fanout( &fanout );
+    CHECK( fanout.confirmed_lsn == 30 );
+
+    // The first location falls too far behind the second
+    fanout.queued_lsn = 200;
+    CHECK( spill_queue_confirm( members[2].queue, 200 ) );
+    update_fanout( &fanout );
+    CHECK( locations[0].detached && !( locations[1].detached ) && fanout_detached( &fanout ) );
+    CHECK( members[0].queue == NULL && members[1].queue == NULL );
+
+    // What it has not applied is held for when it is streamed to again
+    CHECK( fanout.confirmed_lsn == 30 );
+
+    free_spill_queue( members[2].queue, true );
+    fanout_lag_budget = DEFAULT_FANOUT_LAG_BUDGET;
+    return;
+}
+
+/*
+ * Two locations of a member each, the records queued to which are only
+ * read as the test says
+ */
+static void _test_throttle( void )
+{
+    struct fanout          fanout    = {{0}};
+    struct fanout_location locations[2];
+    struct fanout_member   members[2];
+    char                   record[200];
+    unsigned int           i         = 0;
+
+    fanout_high_water = TEST_HIGH_WATER;
+
+    memset( locations, 0, sizeof( locations ) );
+    memset( members, 0, sizeof( members ) );
+    memset( record, 'x', sizeof( record ) - 1 );
+    record[sizeof( record ) - 1] = '\0';
+
+    for( i = 0; i < 2; i++ )
+    {
+        members[i].socket        = -1;
+        members[i].waiting       = true;
+        members[i].queue         = new_spill_queue( i == 0 ? "fanout_test_0" : "fanout_test_1" );
+        locations[i].location    = i + 1;
+        locations[i].members     = &( members[i] );
+        locations[i].num_members = 1;
+        CHECK( members[i].queue != NULL );
+    }
+
+    fanout.locations     = locations;
+    fanout.num_locations = 2;
+
+    // Only the second location falls behind, so the first is not held back
+    _queue( &fanout, record, 10, &( members[0] ) );
+    CHECK( !locations[0].throttled && locations[1].throttled );
+    CHECK( !fanout.throttled && !fanout_throttled( &fanout ) );
+
+    // Until both are
+    _queue( &fanout, record, 10, NULL );
+    CHECK( locations[0].throttled && fanout.throttled );
+    CHECK( fanout_throttled( &fanout ) );
+
+    // Past the low water mark is not caught up
+    _drain( &( members[0] ), FANOUT_LOW_WATER( TEST_HIGH_WATER ) + 1 );
+    CHECK( fanout_throttled( &fanout ) && locations[0].throttled );
+
+    _drain( &( members[0] ), FANOUT_LOW_WATER( TEST_HIGH_WATER ) );
+    CHECK( !fanout_throttled( &fanout ) && !fanout.throttled );
+    CHECK( !locations[0].throttled && locations[1].throttled );
+
+    // A detached location does not count, however far behind
+    locations[1].detached = true;
+    _queue( &fanout, record, 10, NULL );
+    CHECK( locations[0].throttled && fanout.throttled );
+    CHECK( fanout_throttled( &fanout ) );
+
+    // Nor is the stream paused once no location is attached
+    locations[0].detached = true;
+    CHECK( !fanout_throttled( &fanout ) );
+
+    for( i = 0; i < 2; i++ )
+    {
+        free_spill_queue( members[i].queue, true );
+    }
+
+    fanout_high_water = DEFAULT_FANOUT_HIGH_WATER;
+    return;
+}
+
+// Reads member's queue down to keep bytes
+static void _drain( struct fanout_member * member, uint64_t keep )
+{
+    uint64_t length = 0;
+
+    length = spill_queue_length( member->queue );
+
+    if( length > keep )
+    {
+        spill_queue_consume( member->queue, ( size_t ) ( length - keep ) );
+    }
+
+    return;
+}
+
+/*
+ * Queues count transactions of a record each, with reader, if given, taking
+ * all of its own as they are queued
+ */
+static void _queue( struct fanout * fanout, char * record, unsigned int count, struct fanout_member * reader )
+{
+    unsigned int i = 0;
+
+    for( i = 0; i < count; i++ )
+    {
+        fanout->queued_lsn++;
+        CHECK( fanout_record( fanout, record, fanout->queued_lsn, true ) );
+
+        if( reader != NULL )
+        {
+            _drain( reader, 0 );
+        }
+    }
+
+    return;
+}
+
+// A fan-out of one location with one member, and nothing for it to maintain
+static struct fanout * _new_source( char * name )
+{
+    struct fanout * fanout = NULL;
+
+    fanout = ( struct fanout * ) calloc( 1, sizeof( struct fanout ) );
+
+    if( fanout == NULL )
+    {
+        return NULL;
+    }
+
+    fanout->locations = ( struct fanout_location * ) calloc( 1, sizeof( struct fanout_location ) );
+
+    if( fanout->locations == NULL )
+    {
+        free( fanout );
+        return NULL;
+    }
+
+    fanout->locations[0].members = ( struct fanout_member * ) calloc( 1, sizeof( struct fanout_member ) );
+
+    if( fanout->locations[0].members == NULL )
+    {
+        free_fanout( fanout );
+        return NULL;
+    }
+
+    strncpy( fanout->name, name, FANOUT_NAME_LENGTH );
+    fanout->num_locations                  = 1;
+    fanout->locations[0].location          = 1;
+    fanout->locations[0].num_members       = 1;
+    fanout->locations[0].members[0].socket = -1;
+    fanout->locations[0].members[0].queue  = new_spill_queue( name );
+
+    return fanout;
+}
+
+static void _test_pool( void )
+{
+    struct fanout *        sources[2] = { NULL, NULL };
+    struct fanout_member * first      = NULL;
+    struct fanout_member * second     = NULL;
+    unsigned int           i          = 0;
+
+    fanout_worker_limit = 1;
+    sources[0]          = _new_source( "fanout_test_source_0" );
+    sources[1]          = _new_source( "fanout_test_source_1" );
+    CHECK( sources[0] != NULL && sources[1] != NULL );
+
+    if( sources[0] == NULL || sources[1] == NULL )
+    {
+        free_fanout( sources[0] );
+        free_fanout( sources[1] );
+        return;
+    }
+
+    first  = &( sources[0]->locations[0].members[0] );
+    second = &( sources[1]->locations[0].members[0] );
+
+    // Started only once something is queued for it
+    update_fanout( sources[0] );
+    CHECK( first->pid == 0 );
+
+    // Queued as a whole transaction, though its member only sees it begin
+    CHECK( fanout_record( sources[0], TEST_BEGIN, 1, true ) );
+    CHECK( first->pid > 0 && first->socket >= 0 && !( first->waiting ) );
+
+    CHECK( fanout_record( sources[1], TEST_BEGIN, 1, true ) );
+    CHECK( second->pid == 0 && second->waiting );
+    update_fanout( sources[1] );
+    CHECK( second->pid == 0 && second->waiting );
+
+    // Idle past FANOUT_IDLE_MS while another waits, the first ends and makes room
+    usleep( ( FANOUT_IDLE_MS + 50 ) * 1000 );
+
+    for( i = 0; i < 50 && first->pid > 0; i++ )
+    {
+        CHECK( poll_fanout( sources[0], 100 ) );
+    }
+
+    CHECK( first->pid == 0 && !fanout_detached( sources[0] ) );
+
+    update_fanout( sources[1] );
+    CHECK( second->pid > 0 && !( second->waiting ) );
+
+    free_fanout( sources[0] );
+    free_fanout( sources[1] );
+    fanout_worker_limit = DEFAULT_FANOUT_WORKER_LIMIT;
+    return;
+}
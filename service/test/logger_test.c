@@ -0,0 +1,155 @@
+#include "test/test.h"
+
+/*
+ * Checks the shared log end to end, into a file of its own: lines logged by
+ * far more processes than there are rings, one after another as each is
+ * reaped, all reach the file whole and in the order each process logged
+ * them, as do lines logged faster than the writer drains a ring. Also
+ * checks that reap_child() leaves a child that is still running.
+ */
+
+#define TEST_CHILDREN ( LOG_RINGS + 64 )
+#define TEST_BURST 2000
+
+static pid_t _start_child( unsigned int, unsigned int );
+static bool _check_lines( FILE *, unsigned int, unsigned int );
+
+int main( int argc, char ** argv )
+{
+    char         path[] = "/tmp/logger_test.XXXXXX";
+    pid_t        child  = 0;
+    int          hold[2];
+    int          fd     = -1;
+    int          status = 0;
+    unsigned int i      = 0;
+    unsigned int failed = 0;
+
+    log_min_level = LOG_LEVEL_INFO;
+
+    fd = mkstemp( path );
+    CHECK( fd >= 0 );
+
+    if( fd < 0 )
+    {
+        return TEST_RESULT( "logger" );
+    }
+
+    log_file = fdopen( fd, "w+" );
+    CHECK( log_file != NULL && start_log_writer() );
+
+    // Waiting on a pipe, not exited yet
+    CHECK( pipe( hold ) == 0 );
+    child = fork();
+
+    if( child == 0 )
+    {
+        close( hold[1] );
+        while( read( hold[0], &status, 1 ) > 0 );
+        _exit( 0 );
+    }
+
+    CHECK( reap_child( child, &status, WNOHANG ) == 0 );
+    close( hold[0] );
+    close( hold[1] );
+    CHECK( reap_child( child, &status, 0 ) == child && WIFEXITED( status ) );
+
+    for( i = 0; i < TEST_CHILDREN; i++ )
+    {
+        child = _start_child( i, 3 );
+        failed += child <= 0 || reap_child( child, &status, 0 ) != child || !WIFEXITED( status );
+    }
+
+    child = _start_child( TEST_CHILDREN, TEST_BURST );
+    failed += child <= 0 || reap_child( child, &status, 0 ) != child;
+
+    CHECK( failed == 0 );
+
+    stop_log_writer();
+    fflush( log_file );
+
+    rewind( log_file );
+    CHECK( _check_lines( log_file, TEST_CHILDREN, TEST_BURST ) );
+
+    fclose( log_file );
+    log_file = NULL;
+    unlink( path );
+
+    log_min_level = LOG_LEVEL_FATAL;
+    return TEST_RESULT( "logger" );
+}
+
+// Forks a child that logs lines numbered from 0, tagged with child, and exits
+static pid_t _start_child( unsigned int child, unsigned int lines )
+{
+    pid_t        pid = 0;
+    unsigned int i   = 0;
+
+    pid = fork();
+
+    if( pid != 0 )
+    {
+        return pid;
+    }
+
+    for( i = 0; i < lines; i++ )
+    {
+        _log( LOG_LEVEL_INFO, "child %u line %u", child, i );
+    }
+
+    _exit( 0 );
+}
+
+/*
+ * Whether every child's lines are in file in order, 3 of each but the last,
+ * which logged burst
+ */
+static bool _check_lines( FILE * file, unsigned int children, unsigned int burst )
+{
+    unsigned int * next    = NULL;
+    char           line[LOG_LINE_BYTES];
+    char *         text    = NULL;
+    unsigned int   child   = 0;
+    unsigned int   number  = 0;
+    unsigned int   i       = 0;
+    bool           success = true;
+
+    next = ( unsigned int * ) calloc( children + 1, sizeof( unsigned int ) );
+
+    if( next == NULL )
+    {
+        return false;
+    }
+
+    while( fgets( line, sizeof( line ), file ) != NULL )
+    {
+        text = strstr( line, "INFO: child " );
+
+        if( text == NULL )
+        {
+            continue;
+        }
+
+        if(
+                sscanf( text, "INFO: child %u line %u", &child, &number ) != 2
+             || child > children
+             || number != next[child]
+             || line[strlen( line ) - 1] != '\n'
+          )
+        {
+            success = false;
+            break;
+        }
+
+        next[child]++;
+    }
+
+    for( i = 0; i < children && success; i++ )
+    {
+        success = next[i] == 3;
+    }
+
+    success = success && next[children] == burst;
+
+    free( next );
+    return success;
+}
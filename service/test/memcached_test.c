@@ -0,0 +1,301 @@
+#include "test/test.h"
+
+/*
+ * Checks what the memcached driver writes, against a server forked to read
+ * the binary protocol and report each request: a batch is coalesced to one
+ * quiet SET or DELETE per key, with keys escaped and rows as JSON, and ended
+ * by a NOOP; DELETEs of keys not cached are not errors, a rejected SET fails
+ * its batch and drops the connection, the next batch connects again, and a
+ * refresh sets a row per line of COPY text.
+ */
+
+static char * columns[] = { "id", "v" };
+static bool   is_key[]  = { true, false };
+
+static struct tuple * _make_tuple( char *, char * );
+static struct change * _make_change( unsigned short, char *, char * );
+static bool _apply( struct memcached_target *, struct maintenance_object *, struct change **, unsigned long );
+static bool _read_all( int, char *, size_t );
+static void _respond( int, unsigned char *, unsigned int, char * );
+static void _serve( int, int );
+static void _expect( FILE *, char * );
+
+int main( int argc, char ** argv )
+{
+    struct maintenance_object object   = {0};
+    struct memcached_target * target   = NULL;
+    struct sockaddr_in        address  = {0};
+    struct change *           changes[6];
+    socklen_t                 length   = sizeof( address );
+    FILE *                    reported = NULL;
+    char                      rows[]   = "6\tp\n7\tq";
+    int                       report[2];
+    int                       listener = -1;
+    pid_t                     server   = 0;
+
+    log_min_level = LOG_LEVEL_FATAL;
+
+    object.namespace      = "public";
+    object.name           = "cache";
+    object.qualified_name = "public.cache";
+    object.num_columns    = 2;
+    object.columns        = columns;
+    object.is_key         = is_key;
+
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    listener                = socket( AF_INET, SOCK_STREAM, 0 );
+
+    CHECK(
+            listener >= 0
+         && bind( listener, ( struct sockaddr * ) &address, sizeof( address ) ) == 0
+         && listen( listener, 4 ) == 0
+         && getsockname( listener, ( struct sockaddr * ) &address, &length ) == 0
+         && pipe( report ) == 0
+    );
+
+    server = fork();
+
+    if( server == 0 )
+    {
+        close( report[0] );
+        _serve( listener, report[1] );
+    }
+
+    close( listener );
+    close( report[1] );
+    reported = fdopen( report[0], "r" );
+
+    target           = ( struct memcached_target * ) calloc( 1, sizeof( struct memcached_target ) );
+    target->socket   = -1;
+    target->hostname = strdup( "127.0.0.1" );
+    target->port     = ntohs( address.sin_port );
+    target->out      = new_string_buffer();
+
+    // Row 2 may have been cached by an earlier batch; row 3 was not
+    changes[0] = _make_change( CHANGE_TYPE_INSERT, "1", "a" );
+    changes[1] = _make_change( CHANGE_TYPE_UPDATE, "1", "b" );
+    changes[2] = _make_change( CHANGE_TYPE_INSERT, "2", "x" );
+    changes[3] = _make_change( CHANGE_TYPE_DELETE, "2", NULL );
+    changes[4] = _make_change( CHANGE_TYPE_DELETE, "3", NULL );
+    changes[5] = _make_change( CHANGE_TYPE_INSERT, "a:b\\c", "y" );
+
+    CHECK( _apply( target, &object, changes, 6 ) );
+    _expect( reported, "SET public.cache:1 {\"id\":\"1\",\"v\":\"b\"}\n" );
+    _expect( reported, "DELETE public.cache:2 \n" );
+    _expect( reported, "DELETE public.cache:3 \n" );
+    _expect( reported, "SET public.cache:a\\:b\\\\c {\"id\":\"a:b\\\\c\",\"v\":\"y\"}\n" );
+    _expect( reported, "NOOP  \n" );
+
+    // The server has the whole batch before it rejects it
+    changes[0] = _make_change( CHANGE_TYPE_INSERT, "4", "reject" );
+    CHECK( !_apply( target, &object, changes, 1 ) );
+    CHECK( target->socket < 0 );
+    _expect( reported, "SET public.cache:4 {\"id\":\"4\",\"v\":\"reject\"}\n" );
+    _expect( reported, "NOOP  \n" );
+
+    changes[0] = _make_change( CHANGE_TYPE_INSERT, "5", "z" );
+    CHECK( _apply( target, &object, changes, 1 ) );
+    _expect( reported, "SET public.cache:5 {\"id\":\"5\",\"v\":\"z\"}\n" );
+    _expect( reported, "NOOP  \n" );
+
+    CHECK( memcached_driver.refresh_chunk( target, NULL, &object, rows, strlen( rows ) ) );
+    _expect( reported, "SET public.cache:6 {\"id\":\"6\",\"v\":\"p\"}\n" );
+    _expect( reported, "SET public.cache:7 {\"id\":\"7\",\"v\":\"q\"}\n" );
+    _expect( reported, "NOOP  \n" );
+
+    memcached_driver.close( target );
+
+    kill( server, SIGTERM );
+    waitpid( server, NULL, 0 );
+    fclose( reported );
+
+    return TEST_RESULT( "memcached" );
+}
+
+static struct tuple * _make_tuple( char * id, char * v )
+{
+    struct tuple * tuple = NULL;
+
+    tuple              = new_tuple( 2 );
+    tuple->num_columns = v != NULL ? 2 : 1;
+    tuple->names[0]    = strdup( "id" );
+    tuple->values[0]   = strdup( id );
+
+    if( v != NULL )
+    {
+        tuple->names[1]  = strdup( "v" );
+        tuple->values[1] = strdup( v );
+    }
+
+    return tuple;
+}
+
+// A change to the row of the object keyed by id, as evaluate_changes() gives it
+static struct change * _make_change( unsigned short type, char * id, char * v )
+{
+    struct change * change = NULL;
+
+    change              = new_change( type );
+    change->schema_name = strdup( "public" );
+    change->table_name  = strdup( "cache" );
+    change->key         = _make_tuple( id, NULL );
+
+    if( type != CHANGE_TYPE_DELETE )
+    {
+        change->new_tuple = _make_tuple( id, v );
+    }
+
+    if( type != CHANGE_TYPE_INSERT )
+    {
+        change->old_tuple = _make_tuple( id, NULL );
+    }
+
+    return change;
+}
+
+// Applies changes as a batch, and frees them
+static bool _apply(
+    struct memcached_target *   target,
+    struct maintenance_object * object,
+    struct change **            changes,
+    unsigned long               num_changes
+)
+{
+    unsigned long i       = 0;
+    bool          success = false;
+
+    success = memcached_driver.apply_batch( target, NULL, object, changes, num_changes );
+
+    for( i = 0; i < num_changes; i++ )
+    {
+        free_change( changes[i] );
+    }
+
+    return success;
+}
+
+static bool _read_all( int fd, char * data, size_t length )
+{
+    ssize_t result = 0;
+
+    while( length > 0 )
+    {
+        result = read( fd, data, length );
+
+        if( result <= 0 )
+        {
+            return false;
+        }
+
+        data   += result;
+        length -= ( size_t ) result;
+    }
+
+    return true;
+}
+
+// Answers the request header with status, and message as its body
+static void _respond( int fd, unsigned char * header, unsigned int status, char * message )
+{
+    unsigned char response[MEMCACHED_HEADER_LENGTH + 64] = {0};
+    size_t        length                                 = 0;
+
+    length = strlen( message );
+
+    response[0]  = MEMCACHED_RESPONSE_MAGIC;
+    response[1]  = header[1];
+    response[6]  = ( unsigned char ) ( status >> 8 );
+    response[7]  = ( unsigned char ) status;
+    response[11] = ( unsigned char ) length;
+    memcpy( response + 12, header + 12, 4 );
+    memcpy( response + MEMCACHED_HEADER_LENGTH, message, length );
+
+    if( write( fd, response, MEMCACHED_HEADER_LENGTH + length ) < 0 )
+    {
+        _exit( 1 );
+    }
+
+    return;
+}
+
+/*
+ * Reports each request as its operation, key and value on a line, one
+ * connection after another. Only DELETEs of row 3, rejected SETs and the
+ * NOOP are answered.
+ */
+static void _serve( int listener, int report )
+{
+    unsigned char header[MEMCACHED_HEADER_LENGTH];
+    char          body[1024];
+    char          line[1100];
+    unsigned int  key_length = 0;
+    unsigned int  extras     = 0;
+    unsigned int  length     = 0;
+    int           client     = -1;
+    char *        key        = NULL;
+    char *        value      = NULL;
+    char *        operation  = NULL;
+
+    while( ( client = accept( listener, NULL, NULL ) ) >= 0 )
+    {
+        while( _read_all( client, ( char * ) header, MEMCACHED_HEADER_LENGTH ) )
+        {
+            key_length = ( ( unsigned int ) header[2] << 8 ) | header[3];
+            extras     = header[4];
+            length     = ( ( unsigned int ) header[10] << 8 ) | header[11];
+
+            if( header[0] != MEMCACHED_REQUEST_MAGIC || length >= sizeof( body ) || !_read_all( client, body, length ) )
+            {
+                break;
+            }
+
+            key       = body + extras;
+            value     = key + key_length;
+            operation = header[1] == MEMCACHED_OPCODE_SETQ ? "SET"
+                      : header[1] == MEMCACHED_OPCODE_DELETEQ ? "DELETE"
+                      : "NOOP";
+
+            snprintf(
+                line,
+                sizeof( line ),
+                "%s %.*s %.*s\n",
+                operation,
+                ( int ) key_length,
+                key,
+                ( int ) ( length - extras - key_length ),
+                value
+            );
+
+            if( write( report, line, strlen( line ) ) < 0 )
+            {
+                _exit( 1 );
+            }
+
+            if( header[1] == MEMCACHED_OPCODE_NOOP )
+            {
+                _respond( client, header, MEMCACHED_STATUS_SUCCESS, "" );
+            }
+            else if( header[1] == MEMCACHED_OPCODE_DELETEQ && strstr( line, ":3 " ) != NULL )
+            {
+                _respond( client, header, MEMCACHED_STATUS_KEY_NOT_FOUND, "Not found" );
+            }
+            else if( strstr( line, "reject" ) != NULL )
+            {
+                _respond( client, header, 0x0005, "Not stored" );
+            }
+        }
+
+        close( client );
+    }
+
+    _exit( 0 );
+}
+
+static void _expect( FILE * reported, char * expected )
+{
+    char line[1100];
+
+    CHECK( fgets( line, sizeof( line ), reported ) != NULL && strcmp( line, expected ) == 0 );
+    return;
+}
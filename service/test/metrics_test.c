@@ -0,0 +1,296 @@
+#include "test/test.h"
+
+/*
+ * Checks the latency histograms: small latencies are counted exactly,
+ * larger ones within 1/2^METRICS_LATENCY_BITS of their value and never
+ * understated, percentiles are read over a histogram's lifetime or over
+ * what was recorded since a copy of it, and latencies past the last bucket
+ * are kept in it. Also checks what a scrape renders of the slots claimed by
+ * other processes, with the latency of members of one location merged,
+ * and that the slots of a process are freed for others as it is reaped.
+ */
+
+static void _test_precision( void );
+static void _test_percentiles( void );
+static pid_t _start_member( int, int *, uint64_t, bool );
+static unsigned int _count_lines( char *, char * );
+static void _test_render( void );
+static void _test_reaped( void );
+
+int main( int argc, char ** argv )
+{
+    log_min_level = LOG_LEVEL_FATAL;
+
+    _test_precision();
+    _test_percentiles();
+    _test_render();
+    _test_reaped();
+
+    return TEST_RESULT( "metrics" );
+}
+
+// Each latency alone below one far larger, so the bound of its bucket is read
+static void _test_precision( void )
+{
+    struct latency_histogram histogram = {0};
+    uint64_t                 latency   = 0;
+    uint64_t                 bound     = 0;
+    unsigned long            wrong     = 0;
+
+    for( latency = 0; latency < 10000000000ULL; latency = latency + 1 + latency / 7 )
+    {
+        memset( &histogram, 0, sizeof( histogram ) );
+        record_latency( &histogram, latency );
+        record_latency( &histogram, 1ULL << 40 );
+
+        bound  = latency_percentile( &histogram, NULL, 0.5 );
+        wrong += bound < latency;
+        wrong += bound - latency > latency / METRICS_LATENCY_SUB_BUCKETS;
+        wrong += latency < METRICS_LATENCY_SUB_BUCKETS && bound != latency;
+    }
+
+    CHECK( wrong == 0 );
+
+    // The largest latency is not overstated past what was recorded
+    memset( &histogram, 0, sizeof( histogram ) );
+    record_latency( &histogram, 1000 );
+    CHECK( latency_percentile( &histogram, NULL, 1.0 ) == 1000 );
+
+    // Nor lost past the last bucket
+    record_latency( &histogram, UINT64_MAX / 2 );
+    CHECK( latency_percentile( &histogram, NULL, 1.0 ) >= 1ULL << 35 );
+    CHECK( histogram.count == 2 && histogram.max == UINT64_MAX / 2 );
+    return;
+}
+
+static void _test_percentiles( void )
+{
+    struct latency_histogram histogram = {0};
+    struct latency_histogram since     = {0};
+    uint64_t                 latency   = 0;
+    uint64_t                 bound     = 0;
+
+    CHECK( latency_percentile( &histogram, NULL, 0.99 ) == 0 );
+
+    for( latency = 1; latency <= 1000; latency++ )
+    {
+        record_latency( &histogram, latency );
+    }
+
+    CHECK( histogram.count == 1000 && histogram.sum == 500500 && histogram.max == 1000 );
+
+    bound = latency_percentile( &histogram, NULL, 0.5 );
+    CHECK( bound >= 500 && bound <= 500 + 500 / METRICS_LATENCY_SUB_BUCKETS );
+
+    bound = latency_percentile( &histogram, NULL, 0.99 );
+    CHECK( bound >= 990 && bound <= 1000 );
+
+    // Only what was recorded since the copy counts
+    since = histogram;
+    CHECK( latency_percentile( &histogram, &since, 0.5 ) == 0 );
+
+    for( latency = 0; latency < 100; latency++ )
+    {
+        record_latency( &histogram, 5000 );
+    }
+
+    CHECK( latency_percentile( &histogram, &since, 0.5 ) == 5000 );
+
+    // The lifetime max is not the interval's when it was set before it
+    since = histogram;
+    record_latency( &histogram, 3000 );
+    bound = latency_percentile( &histogram, &since, 1.0 );
+    CHECK( bound >= 3000 && bound <= 3000 + 3000 / METRICS_LATENCY_SUB_BUCKETS );
+    return;
+}
+
+/*
+ * Forks a member of source "src" at location 1 that reports a batch, a
+ * commit latency and, with object, object 7, then tells ready and waits for
+ * the pipe hold to be closed
+ */
+static pid_t _start_member( int ready, int * hold, uint64_t latency, bool object )
+{
+    struct object_metrics * slot = NULL;
+    pid_t                   pid  = 0;
+    char                    byte = '\0';
+
+    pid = fork();
+
+    if( pid != 0 )
+    {
+        return pid;
+    }
+
+    close( hold[1] );
+    claim_metrics( "member", "src", 1 );
+    metrics_count( METRIC_CHANGES, 5 );
+    metrics_observe( METRIC_BATCH_CHANGES, 3 );
+    metrics_commit_latency( latency );
+
+    if( object )
+    {
+        slot = claim_object_metrics( 7, 1 );
+        metrics_object_applied( slot, 256 );
+        metrics_object_latency( slot, latency );
+    }
+
+    if( write( ready, "x", 1 ) != 1 )
+    {
+        _exit( 1 );
+    }
+
+    while( read( hold[0], &byte, 1 ) > 0 );
+
+    _exit( 0 );
+}
+
+static unsigned int _count_lines( char * text, char * line )
+{
+    unsigned int count = 0;
+
+    for( text = strstr( text, line ); text != NULL; text = strstr( text + 1, line ) )
+    {
+        count++;
+    }
+
+    return count;
+}
+
+static void _test_render( void )
+{
+    struct string_buffer * buffer = NULL;
+    char                   line[256];
+    int                    ready[2];
+    int                    hold[2];
+    pid_t                  members[2];
+    char                   byte   = '\0';
+    unsigned int           i      = 0;
+
+    CHECK( start_metrics() );
+    CHECK( pipe( ready ) == 0 && pipe( hold ) == 0 );
+
+    buffer = new_string_buffer();
+
+    if( buffer == NULL )
+    {
+        CHECK( buffer != NULL );
+        return;
+    }
+
+    metrics_count( METRIC_CHANGES, 2 );
+
+    members[0] = _start_member( ready[1], hold, 1000, true );
+    members[1] = _start_member( ready[1], hold, 3000, false );
+    CHECK( members[0] > 0 && members[1] > 0 );
+
+    for( i = 0; i < 2; i++ )
+    {
+        CHECK( read( ready[0], &byte, 1 ) == 1 );
+    }
+
+    render_metrics( buffer );
+
+    CHECK( _count_lines( buffer->data, "role=\"receiver\",source=\"\",location=\"0\"} 2\n" ) == 1 );
+
+    for( i = 0; i < 2; i++ )
+    {
+        snprintf(
+            line,
+            sizeof( line ),
+            "pg_ctblmgr_changes_applied_total{pid=\"%d\",role=\"member\",source=\"src\",location=\"1\"} 5\n",
+            ( int ) members[i]
+        );
+        CHECK( _count_lines( buffer->data, line ) == 1 );
+
+        // 3 falls in the bucket up to 4, buckets counting all below them
+        snprintf(
+            line,
+            sizeof( line ),
+            "pg_ctblmgr_batch_changes_bucket{pid=\"%d\",role=\"member\",source=\"src\",location=\"1\",le=\"4\"} 1\n",
+            ( int ) members[i]
+        );
+        CHECK( _count_lines( buffer->data, line ) == 1 );
+    }
+
+    // Both members of the location are reported together
+    CHECK( _count_lines( buffer->data, "pg_ctblmgr_location_commit_latency_seconds_count{" ) == 1 );
+    CHECK( _count_lines( buffer->data, "pg_ctblmgr_location_commit_latency_seconds_count{source=\"src\",location=\"1\"} 2\n" ) == 1 );
+    CHECK( _count_lines( buffer->data, "pg_ctblmgr_location_commit_latency_seconds_sum{source=\"src\",location=\"1\"} 0.004000\n" ) == 1 );
+    CHECK( _count_lines( buffer->data, "pg_ctblmgr_object_applied_lsn{object=\"7\",location=\"1\"} 256\n" ) == 1 );
+    CHECK( _count_lines( buffer->data, "pg_ctblmgr_object_commit_latency_seconds_count{object=\"7\",location=\"1\"} 1\n" ) == 1 );
+
+    close( hold[1] );
+
+    for( i = 0; i < 2; i++ )
+    {
+        CHECK( reap_child( members[i], NULL, 0 ) == members[i] );
+    }
+
+    close( hold[0] );
+    close( ready[0] );
+    close( ready[1] );
+    free_string_buffer( buffer );
+    return;
+}
+
+// Far more members than there are slots come and go, one at a time
+static void _test_reaped( void )
+{
+    struct string_buffer * buffer  = NULL;
+    char                   line[256];
+    int                    ready[2];
+    int                    hold[2];
+    pid_t                  member  = 0;
+    char                   byte    = '\0';
+    unsigned int           i       = 0;
+    unsigned int           missing = 0;
+
+    buffer = new_string_buffer();
+    CHECK( buffer != NULL && pipe( ready ) == 0 );
+
+    if( buffer == NULL )
+    {
+        return;
+    }
+
+    for( i = 0; i < METRICS_WORKERS * 2; i++ )
+    {
+        if( pipe( hold ) != 0 )
+        {
+            CHECK( false );
+            break;
+        }
+
+        member = _start_member( ready[1], hold, 1000, true );
+        close( hold[0] );
+        CHECK( member > 0 && read( ready[0], &byte, 1 ) == 1 );
+
+        snprintf(
+            line,
+            sizeof( line ),
+            "pg_ctblmgr_changes_applied_total{pid=\"%d\",role=\"member\",source=\"src\",location=\"1\"} 5\n",
+            ( int ) member
+        );
+
+        string_buffer_reset( buffer );
+        render_metrics( buffer );
+        missing += _count_lines( buffer->data, line ) != 1;
+
+        close( hold[1] );
+        CHECK( reap_child( member, NULL, 0 ) == member );
+    }
+
+    CHECK( missing == 0 );
+
+    // Nothing is left of the last one
+    string_buffer_reset( buffer );
+    render_metrics( buffer );
+    CHECK( _count_lines( buffer->data, line ) == 0 );
+    CHECK( _count_lines( buffer->data, "pg_ctblmgr_object_applied_lsn{" ) == 0 );
+
+    close( ready[0] );
+    close( ready[1] );
+    free_string_buffer( buffer );
+    return;
+}
@@ -0,0 +1,379 @@
+#include "test/test.h"
+
+/*
+ * Checks that the progress of an object is recorded and read back per
+ * location, against a server forked to answer the start of a session and
+ * to keep the rows of maintenance_progress it is sent in memory: nothing
+ * recorded reads as 0, the upsert replaces what was recorded before and is
+ * prepared once for every object, and recording leaves the object's
+ * applied_lsn for the caller to advance.
+ */
+
+// Long enough for every check, so that a server that never answers fails the test rather than hangs it
+#define TEST_TIMEOUT_S 30
+#define TEST_MAX_ROWS 8
+#define TEST_MAX_PREPARED 4
+
+static void _serve( int );
+static bool _answer_startup( int );
+static bool _answer( int );
+static bool _send( int, char, char *, uint32_t );
+static bool _send_row( int, char * );
+static bool _bind( char *, uint32_t );
+static bool _execute( int );
+
+// The rows of maintenance_progress, as object, location and LSN
+static char rows[TEST_MAX_ROWS][3][32];
+
+// What the server has been asked to prepare, and the query and parameters the unnamed portal is bound to
+static char         prepared_names[TEST_MAX_PREPARED][64];
+static char         prepared_queries[TEST_MAX_PREPARED][512];
+static char         portal[512];
+static char         bound[3][32];
+static unsigned int num_rows = 0;
+
+// One column of text
+static unsigned char row_description[] = {
+    0, 1, 'v', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 25, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 0
+};
+
+int main( int argc, char ** argv )
+{
+    struct worker               me        = {0};
+    struct maintenance_object   object    = {0};
+    struct maintenance_object   elsewhere = {0};
+    struct prepared_statement * statement = NULL;
+    struct sockaddr_in          address   = {0};
+    socklen_t                   length    = sizeof( address );
+    char                        conninfo[128];
+    int                         listener  = -1;
+    pid_t                       server    = 0;
+
+    log_min_level = LOG_LEVEL_FATAL;
+    alarm( TEST_TIMEOUT_S );
+
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    listener                = socket( AF_INET, SOCK_STREAM, 0 );
+
+    CHECK(
+            listener >= 0
+         && bind( listener, ( struct sockaddr * ) &address, sizeof( address ) ) == 0
+         && listen( listener, 4 ) == 0
+         && getsockname( listener, ( struct sockaddr * ) &address, &length ) == 0
+    );
+
+    server = fork();
+
+    if( server == 0 )
+    {
+        _serve( listener );
+    }
+
+    close( listener );
+
+    snprintf(
+        conninfo,
+        sizeof( conninfo ),
+        "host=127.0.0.1 port=%d user=test dbname=test sslmode=disable gssencmode=disable",
+        ntohs( address.sin_port )
+    );
+
+    connection_spares = 0;
+    me.conninfo       = conninfo;
+
+    object.qualified_name        = "public.counts";
+    object.maintenance_object    = 3;
+    object.location              = 2;
+    object.applied_lsn           = 99;
+    elsewhere.qualified_name     = "public.counts";
+    elsewhere.maintenance_object = 3;
+    elsewhere.location           = 1;
+
+    CHECK( !read_object_progress( NULL, &object ) && !read_object_progress( &me, NULL ) );
+    CHECK( !write_object_progress( &me, NULL, 1 ) );
+
+    // Nothing recorded yet
+    CHECK( read_object_progress( &me, &object ) && object.applied_lsn == 0 );
+
+    // Recorded, but only advanced once the caller's transaction has committed
+    CHECK( write_object_progress( &me, &object, 0x10000002AULL ) && object.applied_lsn == 0 );
+    CHECK( read_object_progress( &me, &object ) && object.applied_lsn == 0x10000002AULL );
+
+    // The same object at another location is kept apart
+    CHECK( read_object_progress( &me, &elsewhere ) && elsewhere.applied_lsn == 0 );
+    CHECK( write_object_progress( &me, &elsewhere, 0x10ULL ) );
+
+    // Replaced, through the one statement every object shares
+    statement = get_progress_statement( &me );
+    CHECK( statement != NULL && statement == get_progress_statement( &me ) );
+    CHECK( write_object_progress( &me, &object, 0x200000000ULL ) );
+    CHECK( read_object_progress( &me, &object ) && object.applied_lsn == 0x200000000ULL );
+    CHECK( read_object_progress( &me, &elsewhere ) && elsewhere.applied_lsn == 0x10ULL );
+
+    PQfinish( me.conn );
+    free_connection_pool( ( struct connection_pool * ) me.connection_pool );
+    free_statement_cache( ( struct statement_cache * ) me.statement_cache );
+
+    kill( server, SIGTERM );
+    waitpid( server, NULL, 0 );
+
+    connection_spares = DEFAULT_CONNECTION_SPARES;
+    return TEST_RESULT( "progress" );
+}
+
+// Answers one connection after another
+static void _serve( int listener )
+{
+    int client = -1;
+
+    alarm( TEST_TIMEOUT_S );
+
+    while( ( client = accept( listener, NULL, NULL ) ) >= 0 )
+    {
+        memset( prepared_names, 0, sizeof( prepared_names ) );
+
+        if( _answer_startup( client ) )
+        {
+            while( _answer( client ) );
+        }
+
+        close( client );
+    }
+
+    _exit( 0 );
+}
+
+/*
+ * Reads a startup message and answers AuthenticationOk and ReadyForQuery,
+ * refusing encryption if that is asked for first
+ */
+static bool _answer_startup( int fd )
+{
+    unsigned char header[8];
+    unsigned char ready[] = { 'R', 0, 0, 0, 8, 0, 0, 0, 0, 'Z', 0, 0, 0, 5, 'I' };
+    char          body[1024];
+    uint32_t      length  = 0;
+    uint32_t      code    = 0;
+
+    while( true )
+    {
+        if( recv( fd, header, sizeof( header ), MSG_WAITALL ) != ( ssize_t ) sizeof( header ) )
+        {
+            return false;
+        }
+
+        length = ( ( uint32_t ) header[0] << 24 ) | ( ( uint32_t ) header[1] << 16 ) | ( ( uint32_t ) header[2] << 8 ) | header[3];
+        code   = ( ( uint32_t ) header[4] << 24 ) | ( ( uint32_t ) header[5] << 16 ) | ( ( uint32_t ) header[6] << 8 ) | header[7];
+
+        // SSLRequest and GSSENCRequest
+        if( code == 80877103 || code == 80877104 )
+        {
+            if( write( fd, "N", 1 ) != 1 )
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        if(
+                length < sizeof( header )
+             || length - sizeof( header ) > sizeof( body )
+             || recv( fd, body, length - sizeof( header ), MSG_WAITALL ) != ( ssize_t ) ( length - sizeof( header ) )
+          )
+        {
+            return false;
+        }
+
+        return write( fd, ready, sizeof( ready ) ) == ( ssize_t ) sizeof( ready );
+    }
+}
+
+/*
+ * Reads one message and answers it as a server would, taking the only
+ * simple query to be the one for the extension's schema. Returns false once
+ * the client has gone.
+ */
+static bool _answer( int fd )
+{
+    unsigned char header[5];
+    char          body[1024];
+    char *        statement = NULL;
+    uint32_t      length    = 0;
+    unsigned int  i         = 0;
+
+    if( recv( fd, header, sizeof( header ), MSG_WAITALL ) != ( ssize_t ) sizeof( header ) )
+    {
+        return false;
+    }
+
+    length = ( ( uint32_t ) header[1] << 24 ) | ( ( uint32_t ) header[2] << 16 ) | ( ( uint32_t ) header[3] << 8 ) | header[4];
+
+    if(
+            length < 4
+         || length - 4 >= sizeof( body )
+         || ( length > 4 && recv( fd, body, length - 4, MSG_WAITALL ) != ( ssize_t ) ( length - 4 ) )
+      )
+    {
+        return false;
+    }
+
+    body[length - 4] = '\0';
+
+    switch( header[0] )
+    {
+        case 'Q':
+            return _send( fd, 'T', ( char * ) row_description, sizeof( row_description ) )
+                && _send_row( fd, "ctblmgr" )
+                && _send( fd, 'C', "SELECT 1", 9 )
+                && _send( fd, 'Z', "I", 1 );
+        case 'P':
+            // An unnamed statement is only ever bound right after it is parsed
+            snprintf( portal, sizeof( portal ), "%s", body + strlen( body ) + 1 );
+
+            for( i = 0; body[0] != '\0' && i < TEST_MAX_PREPARED; i++ )
+            {
+                if( prepared_names[i][0] == '\0' )
+                {
+                    snprintf( prepared_names[i], sizeof( prepared_names[i] ), "%s", body );
+                    snprintf( prepared_queries[i], sizeof( prepared_queries[i] ), "%s", portal );
+                    break;
+                }
+            }
+
+            return _send( fd, '1', NULL, 0 );
+        case 'B':
+            statement = body + strlen( body ) + 1;
+
+            for( i = 0; statement[0] != '\0' && i < TEST_MAX_PREPARED; i++ )
+            {
+                if( strcmp( prepared_names[i], statement ) == 0 )
+                {
+                    snprintf( portal, sizeof( portal ), "%s", prepared_queries[i] );
+                }
+            }
+
+            return _bind( body, length - 4 ) && _send( fd, '2', NULL, 0 );
+        case 'D':
+            if( strstr( portal, "SELECT lsn" ) != NULL )
+            {
+                return _send( fd, 'T', ( char * ) row_description, sizeof( row_description ) );
+            }
+
+            return _send( fd, 'n', NULL, 0 );
+        case 'E':
+            return _execute( fd );
+        case 'S':
+            return _send( fd, 'Z', "I", 1 );
+        case 'X':
+            return false;
+        default:
+            return true;
+    }
+}
+
+// Sends a message of type with length bytes of body
+static bool _send( int fd, char type, char * body, uint32_t length )
+{
+    unsigned char header[5];
+
+    header[0] = ( unsigned char ) type;
+    header[1] = ( unsigned char ) ( ( length + 4 ) >> 24 );
+    header[2] = ( unsigned char ) ( ( length + 4 ) >> 16 );
+    header[3] = ( unsigned char ) ( ( length + 4 ) >> 8 );
+    header[4] = ( unsigned char ) ( length + 4 );
+
+    return write( fd, header, sizeof( header ) ) == ( ssize_t ) sizeof( header )
+        && ( length == 0 || write( fd, body, length ) == ( ssize_t ) length );
+}
+
+// Sends a row of one column of text
+static bool _send_row( int fd, char * value )
+{
+    char     row[64];
+    uint32_t length = 0;
+
+    length = ( uint32_t ) strlen( value );
+    row[0] = 0;
+    row[1] = 1;
+    row[2] = ( char ) ( length >> 24 );
+    row[3] = ( char ) ( length >> 16 );
+    row[4] = ( char ) ( length >> 8 );
+    row[5] = ( char ) length;
+    memcpy( row + 6, value, length );
+
+    return _send( fd, 'D', row, length + 6 );
+}
+
+// Takes the first three parameters of a Bind of size bytes, all as text
+static bool _bind( char * body, uint32_t size )
+{
+    unsigned char * next       = NULL;
+    unsigned int    num_params = 0;
+    unsigned int    i          = 0;
+    uint32_t        length     = 0;
+
+    memset( bound, 0, sizeof( bound ) );
+
+    // Past the portal and statement names, and the formats of the parameters
+    next = ( unsigned char * ) body + strlen( body ) + 1;
+    next = next + strlen( ( char * ) next ) + 1;
+    next = next + 2 + 2 * ( ( next[0] << 8 ) | next[1] );
+
+    num_params = ( next[0] << 8 ) | next[1];
+    next       = next + 2;
+
+    for( i = 0; i < num_params && i < 3; i++ )
+    {
+        length = ( ( uint32_t ) next[0] << 24 ) | ( ( uint32_t ) next[1] << 16 ) | ( ( uint32_t ) next[2] << 8 ) | next[3];
+        next   = next + 4;
+
+        if( length >= sizeof( bound[i] ) || next + length > ( unsigned char * ) body + size )
+        {
+            return false;
+        }
+
+        memcpy( bound[i], next, length );
+        next = next + length;
+    }
+
+    return true;
+}
+
+// Executes the read or the upsert of a row of maintenance_progress
+static bool _execute( int fd )
+{
+    unsigned int i = 0;
+
+    for( i = 0; i < num_rows; i++ )
+    {
+        if( strcmp( rows[i][0], bound[0] ) == 0 && strcmp( rows[i][1], bound[1] ) == 0 )
+        {
+            break;
+        }
+    }
+
+    if( strstr( portal, "SELECT lsn" ) != NULL )
+    {
+        if( i == num_rows )
+        {
+            return _send( fd, 'C', "SELECT 0", 9 );
+        }
+
+        return _send_row( fd, rows[i][2] ) && _send( fd, 'C', "SELECT 1", 9 );
+    }
+
+    if( strstr( portal, "ON CONFLICT" ) == NULL || i == TEST_MAX_ROWS )
+    {
+        return false;
+    }
+
+    if( i == num_rows )
+    {
+        num_rows++;
+    }
+
+    memcpy( rows[i], bound, sizeof( bound ) );
+    return _send( fd, 'C', "INSERT 0 1", 11 );
+}
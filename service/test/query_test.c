@@ -0,0 +1,452 @@
+#include "test/test.h"
+
+/*
+ * Checks pipelines against a server forked to answer the start of a
+ * session and the extended query protocol, reporting each statement it
+ * executes and each sync point: statements are sent in chunks of up to
+ * MAX_PIPELINE_DEPTH, each ending in a sync point, prepared statements are
+ * executed by name, and the rows of those that keep them are handed back.
+ * A statement that fails is the one reported, the server skipping the rest
+ * of its chunk, and a chunk failing with a retryable SQL state is reissued
+ * on a new connection outside of a transaction, but not inside of one.
+ */
+
+// Long enough for every check, so that a line that is never reported fails the test rather than hangs it
+#define TEST_TIMEOUT_S 30
+#define TEST_STATEMENTS ( MAX_PIPELINE_DEPTH + 44 )
+#define TEST_MAX_PREPARED 8
+
+static void _serve( int, int );
+static bool _answer_startup( int );
+static bool _answer( int, int );
+static bool _send( int, char, char *, uint32_t );
+static bool _execute( int, int, char * );
+static unsigned int _count_executed( FILE * );
+static void _test_chunks( struct worker *, FILE * );
+static void _test_failure( struct worker *, FILE * );
+static void _test_retry( struct worker *, FILE * );
+
+// What the server has been asked to prepare, and the query the unnamed portal is bound to
+static char         prepared_names[TEST_MAX_PREPARED][64];
+static char         prepared_queries[TEST_MAX_PREPARED][128];
+static char         portal[128];
+static bool         aborted      = false;
+static unsigned int retries      = 0;
+static Oid          param_type[] = { 25 };
+
+// One column of text
+static unsigned char row_description[] = {
+    0, 1, 'v', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 25, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 0
+};
+
+int main( int argc, char ** argv )
+{
+    struct worker      me       = {0};
+    struct sockaddr_in address  = {0};
+    socklen_t          length   = sizeof( address );
+    FILE *             reported = NULL;
+    char               conninfo[128];
+    int                report[2];
+    int                listener = -1;
+    pid_t              server   = 0;
+
+    log_min_level = LOG_LEVEL_FATAL;
+    alarm( TEST_TIMEOUT_S );
+
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    listener                = socket( AF_INET, SOCK_STREAM, 0 );
+
+    CHECK(
+            listener >= 0
+         && bind( listener, ( struct sockaddr * ) &address, sizeof( address ) ) == 0
+         && listen( listener, 4 ) == 0
+         && getsockname( listener, ( struct sockaddr * ) &address, &length ) == 0
+         && pipe( report ) == 0
+    );
+
+    server = fork();
+
+    if( server == 0 )
+    {
+        close( report[0] );
+        _serve( listener, report[1] );
+    }
+
+    close( listener );
+    close( report[1] );
+    reported = fdopen( report[0], "r" );
+
+    snprintf(
+        conninfo,
+        sizeof( conninfo ),
+        "host=127.0.0.1 port=%d user=test dbname=test sslmode=disable gssencmode=disable",
+        ntohs( address.sin_port )
+    );
+
+    connection_spares = 0;
+    me.conninfo       = conninfo;
+
+    _test_chunks( &me, reported );
+    _test_failure( &me, reported );
+    _test_retry( &me, reported );
+
+    PQfinish( me.conn );
+    free_connection_pool( ( struct connection_pool * ) me.connection_pool );
+    free_statement_cache( ( struct statement_cache * ) me.statement_cache );
+
+    kill( server, SIGTERM );
+    waitpid( server, NULL, 0 );
+    fclose( reported );
+
+    connection_spares = DEFAULT_CONNECTION_SPARES;
+    return TEST_RESULT( "query" );
+}
+
+static void _test_chunks( struct worker * me, FILE * reported )
+{
+    struct pipeline_statement   statements[TEST_STATEMENTS];
+    struct prepared_statement * insert = NULL;
+    char *                      params[1];
+    unsigned long               failed = 0;
+    unsigned long               i      = 0;
+
+    memset( statements, 0, sizeof( statements ) );
+    params[0] = "value";
+
+    // Prepared up front, on its own
+    insert = get_prepared_statement( me, 1, 1, "v", "INSERT $1", 1, param_type );
+    CHECK( insert != NULL && insert->is_prepared );
+    CHECK( _count_executed( reported ) == 0 );
+
+    for( i = 0; i < TEST_STATEMENTS; i++ )
+    {
+        statements[i].prepared    = insert;
+        statements[i].params      = params;
+        statements[i].param_count = 1;
+    }
+
+    statements[MAX_PIPELINE_DEPTH + 1].prepared    = NULL;
+    statements[MAX_PIPELINE_DEPTH + 1].query       = "SELECT kept";
+    statements[MAX_PIPELINE_DEPTH + 1].keep_result = true;
+    statements[MAX_PIPELINE_DEPTH + 2].prepared    = NULL;
+    statements[MAX_PIPELINE_DEPTH + 2].query       = "SELECT dropped";
+
+    CHECK( _execute_pipeline( me, statements, TEST_STATEMENTS, &failed ) );
+
+    // One sync point per chunk
+    CHECK( _count_executed( reported ) == MAX_PIPELINE_DEPTH );
+    CHECK( _count_executed( reported ) == TEST_STATEMENTS - MAX_PIPELINE_DEPTH );
+
+    CHECK(
+            statements[MAX_PIPELINE_DEPTH + 1].result != NULL
+         && PQntuples( statements[MAX_PIPELINE_DEPTH + 1].result ) == 1
+         && strcmp( PQgetvalue( statements[MAX_PIPELINE_DEPTH + 1].result, 0, 0 ), "kept" ) == 0
+    );
+    CHECK( statements[MAX_PIPELINE_DEPTH + 2].result == NULL && statements[0].result == NULL );
+
+    PQclear( statements[MAX_PIPELINE_DEPTH + 1].result );
+    return;
+}
+
+static void _test_failure( struct worker * me, FILE * reported )
+{
+    struct pipeline_statement statements[6];
+    PGconn *                  conn   = NULL;
+    unsigned long             failed = 0;
+    unsigned long             i      = 0;
+
+    memset( statements, 0, sizeof( statements ) );
+
+    for( i = 0; i < 6; i++ )
+    {
+        statements[i].query = i == 3 ? "FAIL " SQL_STATE_DATATYPE_MISMATCH : "INSERT";
+    }
+
+    conn = me->conn;
+    CHECK( !_execute_pipeline( me, statements, 6, &failed ) );
+    CHECK( failed == 3 && strcmp( statements[3].sql_state, SQL_STATE_DATATYPE_MISMATCH ) == 0 );
+    CHECK( strcmp( me->sql_state, SQL_STATE_DATATYPE_MISMATCH ) == 0 );
+    CHECK( statements[2].sql_state[0] == '\0' );
+
+    // The server skips the rest of the chunk, and the session is kept for the next
+    CHECK( _count_executed( reported ) == 4 );
+    CHECK( me->conn == conn && PQstatus( me->conn ) == CONNECTION_OK );
+
+    statements[3].query = "INSERT";
+    CHECK( _execute_pipeline( me, statements, 6, &failed ) );
+    CHECK( _count_executed( reported ) == 6 && me->conn == conn );
+    return;
+}
+
+static void _test_retry( struct worker * me, FILE * reported )
+{
+    struct pipeline_statement statements[3];
+    uint64_t                  connection = 0;
+    unsigned long             failed     = 0;
+    unsigned long             i          = 0;
+
+    memset( statements, 0, sizeof( statements ) );
+
+    for( i = 0; i < 3; i++ )
+    {
+        statements[i].query = i == 1 ? "RETRY " SQL_STATE_TERMINATED_BY_ADMINISTRATOR : "INSERT";
+    }
+
+    // Reissued as a whole on a new connection
+    connection = me->connection_id;
+    CHECK( _execute_pipeline( me, statements, 3, &failed ) );
+    CHECK( _count_executed( reported ) == 2 );
+    CHECK( _count_executed( reported ) == 3 );
+    CHECK( me->conn != NULL && me->connection_id != connection );
+
+    // Inside of a transaction, the caller has to start it again
+    me->tx_in_progress = true;
+    CHECK( !_execute_pipeline( me, statements, 3, &failed ) );
+    CHECK( failed == 1 && strcmp( me->sql_state, SQL_STATE_TERMINATED_BY_ADMINISTRATOR ) == 0 );
+    CHECK( _count_executed( reported ) == 2 );
+    CHECK( me->conn == NULL && !( me->tx_in_progress ) );
+    return;
+}
+
+// Answers one connection after another, reporting what each executes
+static void _serve( int listener, int report )
+{
+    int client = -1;
+
+    alarm( TEST_TIMEOUT_S );
+
+    while( ( client = accept( listener, NULL, NULL ) ) >= 0 )
+    {
+        memset( prepared_names, 0, sizeof( prepared_names ) );
+        aborted = false;
+
+        if( _answer_startup( client ) )
+        {
+            while( _answer( client, report ) );
+        }
+
+        close( client );
+    }
+
+    _exit( 0 );
+}
+
+/*
+ * Reads a startup message and answers AuthenticationOk and ReadyForQuery,
+ * refusing encryption if that is asked for first
+ */
+static bool _answer_startup( int fd )
+{
+    unsigned char header[8];
+    unsigned char ready[] = { 'R', 0, 0, 0, 8, 0, 0, 0, 0, 'Z', 0, 0, 0, 5, 'I' };
+    char          body[1024];
+    uint32_t      length  = 0;
+    uint32_t      code    = 0;
+
+    while( true )
+    {
+        if( recv( fd, header, sizeof( header ), MSG_WAITALL ) != ( ssize_t ) sizeof( header ) )
+        {
+            return false;
+        }
+
+        length = ( ( uint32_t ) header[0] << 24 ) | ( ( uint32_t ) header[1] << 16 ) | ( ( uint32_t ) header[2] << 8 ) | header[3];
+        code   = ( ( uint32_t ) header[4] << 24 ) | ( ( uint32_t ) header[5] << 16 ) | ( ( uint32_t ) header[6] << 8 ) | header[7];
+
+        // SSLRequest and GSSENCRequest
+        if( code == 80877103 || code == 80877104 )
+        {
+            if( write( fd, "N", 1 ) != 1 )
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        if(
+                length < sizeof( header )
+             || length - sizeof( header ) > sizeof( body )
+             || recv( fd, body, length - sizeof( header ), MSG_WAITALL ) != ( ssize_t ) ( length - sizeof( header ) )
+          )
+        {
+            return false;
+        }
+
+        return write( fd, ready, sizeof( ready ) ) == ( ssize_t ) sizeof( ready );
+    }
+}
+
+/*
+ * Reads one message of the extended query protocol and answers it as a
+ * server would, skipping everything up to the next Sync once a statement
+ * has failed. Returns false once the client has gone.
+ */
+static bool _answer( int fd, int report )
+{
+    unsigned char header[5];
+    char          body[1024];
+    char *        statement = NULL;
+    uint32_t      length    = 0;
+    unsigned int  i         = 0;
+
+    if( recv( fd, header, sizeof( header ), MSG_WAITALL ) != ( ssize_t ) sizeof( header ) )
+    {
+        return false;
+    }
+
+    length = ( ( uint32_t ) header[1] << 24 ) | ( ( uint32_t ) header[2] << 16 ) | ( ( uint32_t ) header[3] << 8 ) | header[4];
+
+    if(
+            length < 4
+         || length - 4 >= sizeof( body )
+         || ( length > 4 && recv( fd, body, length - 4, MSG_WAITALL ) != ( ssize_t ) ( length - 4 ) )
+      )
+    {
+        return false;
+    }
+
+    body[length - 4] = '\0';
+
+    if( header[0] == 'X' )
+    {
+        return false;
+    }
+
+    if( header[0] == 'S' )
+    {
+        aborted = false;
+        return write( report, "S\n", 2 ) == 2 && _send( fd, 'Z', "I", 1 );
+    }
+
+    if( aborted )
+    {
+        return true;
+    }
+
+    switch( header[0] )
+    {
+        case 'P':
+            // An unnamed statement is only ever bound right after it is parsed
+            snprintf( portal, sizeof( portal ), "%s", body + strlen( body ) + 1 );
+
+            for( i = 0; body[0] != '\0' && i < TEST_MAX_PREPARED; i++ )
+            {
+                if( prepared_names[i][0] == '\0' )
+                {
+                    snprintf( prepared_names[i], sizeof( prepared_names[i] ), "%s", body );
+                    snprintf( prepared_queries[i], sizeof( prepared_queries[i] ), "%s", portal );
+                    break;
+                }
+            }
+
+            return _send( fd, '1', NULL, 0 );
+        case 'B':
+            statement = body + strlen( body ) + 1;
+
+            for( i = 0; statement[0] != '\0' && i < TEST_MAX_PREPARED; i++ )
+            {
+                if( strcmp( prepared_names[i], statement ) == 0 )
+                {
+                    snprintf( portal, sizeof( portal ), "%s", prepared_queries[i] );
+                }
+            }
+
+            return _send( fd, '2', NULL, 0 );
+        case 'D':
+            if( strncmp( portal, "SELECT ", 7 ) == 0 )
+            {
+                return _send( fd, 'T', ( char * ) row_description, sizeof( row_description ) );
+            }
+
+            return _send( fd, 'n', NULL, 0 );
+        case 'E':
+            return _execute( fd, report, portal );
+        default:
+            return true;
+    }
+}
+
+// Sends a message of type with length bytes of body
+static bool _send( int fd, char type, char * body, uint32_t length )
+{
+    unsigned char header[5];
+
+    header[0] = ( unsigned char ) type;
+    header[1] = ( unsigned char ) ( ( length + 4 ) >> 24 );
+    header[2] = ( unsigned char ) ( ( length + 4 ) >> 16 );
+    header[3] = ( unsigned char ) ( ( length + 4 ) >> 8 );
+    header[4] = ( unsigned char ) ( length + 4 );
+
+    return write( fd, header, sizeof( header ) ) == ( ssize_t ) sizeof( header )
+        && ( length == 0 || write( fd, body, length ) == ( ssize_t ) length );
+}
+
+/*
+ * Executes query, reporting it: "SELECT value" returns value, "FAIL state"
+ * fails with that SQL state, as does "RETRY state" every other time it is
+ * executed, and anything else returns nothing
+ */
+static bool _execute( int fd, int report, char * query )
+{
+    char     line[160];
+    char     message[160];
+    uint32_t length = 0;
+
+    snprintf( line, sizeof( line ), "E %s\n", query );
+
+    if( write( report, line, strlen( line ) ) <= 0 )
+    {
+        return false;
+    }
+
+    if( strncmp( query, "FAIL ", 5 ) == 0 || ( strncmp( query, "RETRY ", 6 ) == 0 && retries++ % 2 == 0 ) )
+    {
+        aborted = true;
+        length  = ( uint32_t ) snprintf(
+            message,
+            sizeof( message ),
+            "SERROR%cC%s%cMtest failure%c",
+            0,
+            strchr( query, ' ' ) + 1,
+            0,
+            0
+        ) + 1;
+
+        return _send( fd, 'E', message, length );
+    }
+
+    if( strncmp( query, "SELECT ", 7 ) == 0 )
+    {
+        length     = ( uint32_t ) strlen( query + 7 );
+        message[0] = 0;
+        message[1] = 1;
+        message[2] = ( char ) ( length >> 24 );
+        message[3] = ( char ) ( length >> 16 );
+        message[4] = ( char ) ( length >> 8 );
+        message[5] = ( char ) length;
+        memcpy( message + 6, query + 7, length );
+
+        return _send( fd, 'D', message, length + 6 ) && _send( fd, 'C', "SELECT 1", 9 );
+    }
+
+    return _send( fd, 'C', "INSERT 0 1", 11 );
+}
+
+// How many statements the server reports executing up to its next sync point
+static unsigned int _count_executed( FILE * reported )
+{
+    char         line[256];
+    unsigned int count = 0;
+
+    while( fgets( line, sizeof( line ), reported ) != NULL && strcmp( line, "S\n" ) != 0 )
+    {
+        if( line[0] == 'E' )
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,176 @@
+#include "test/test.h"
+
+/*
+ * Checks how a full refresh of a definition that cannot be split by pages
+ * is planned: into one COPY per refresh worker, each taking the rows whose
+ * key hashes to its own remainder, or those of all of their values without
+ * a key, and into a single COPY of everything with one worker, each
+ * projecting the target's columns for a COPY into the table refreshed.
+ * Also checks that the changes applied to a table while it is rebuilt into
+ * a shadow table are buffered as copies, coalesced to their net effect.
+ */
+
+#define TEST_DEFINITION "SELECT a.id, b.name, count(*) AS n FROM a JOIN b ON b.a = a.id GROUP BY a.id, b.name"
+
+static char * columns[]        = { "id", "name", "n" };
+static char * quoted_columns[] = { "id", "\"name\"", "n" };
+
+static struct change * _make_change( unsigned short, char *, char * );
+static void _test_hash_chunks( PGconn * );
+static void _test_shadow_buffer( void );
+
+int main( int argc, char ** argv )
+{
+    PGconn * source = NULL;
+
+    log_min_level = LOG_LEVEL_FATAL;
+
+    // Never connected, as nothing needs to be asked of the source to split a definition by hash
+    source = PQconnectStart( "host=127.0.0.1 port=1" );
+    CHECK( source != NULL );
+
+    _test_hash_chunks( source );
+    _test_shadow_buffer();
+
+    PQfinish( source );
+    return TEST_RESULT( "refresh" );
+}
+
+static void _test_hash_chunks( PGconn * source )
+{
+    struct maintenance_object object   = {0};
+    struct refresh_plan *     plan     = NULL;
+    bool                      is_key[] = { true, true, false };
+    char                      filter[128];
+    unsigned int              i        = 0;
+
+    object.qualified_name  = "public.counts";
+    object.definition      = TEST_DEFINITION;
+    object.num_columns     = 3;
+    object.columns         = columns;
+    object.quoted_columns  = quoted_columns;
+    object.is_key          = is_key;
+    object.num_key_columns = 2;
+
+    refresh_workers = 3;
+    plan            = plan_refresh( source, &object, "public.counts" );
+    CHECK( plan != NULL );
+
+    if( plan == NULL )
+    {
+        refresh_workers = DEFAULT_REFRESH_WORKERS;
+        return;
+    }
+
+    CHECK( strcmp( plan->copy_in, "COPY public.counts ( id, \"name\", n ) FROM STDIN" ) == 0 );
+    CHECK( plan->num_chunks == 3 && plan->chunks[3] == NULL );
+
+    // Every row is in exactly one chunk, by its key
+    for( i = 0; i < plan->num_chunks; i++ )
+    {
+        snprintf(
+            filter,
+            sizeof( filter ),
+            " WHERE ( pg_catalog.hashtext( ( q.id, q.\"name\" )::TEXT ) & 2147483647 ) %% 3 = %u ) TO STDOUT",
+            i
+        );
+
+        CHECK( strstr( plan->chunks[i], "COPY ( SELECT q.id, q.\"name\", q.n FROM ( " TEST_DEFINITION " ) q WHERE" ) == plan->chunks[i] );
+        CHECK( strstr( plan->chunks[i], filter ) != NULL );
+    }
+
+    free_refresh_plan( plan );
+
+    // Without a key, by all of its values
+    object.num_key_columns = 0;
+    is_key[0]              = false;
+    is_key[1]              = false;
+    plan                   = plan_refresh( source, &object, "public.counts" );
+    CHECK( plan != NULL && plan->num_chunks == 3 );
+    CHECK( plan != NULL && strstr( plan->chunks[1], "hashtext( ( q.id, q.\"name\", q.n )::TEXT ) & 2147483647 ) % 3 = 1 )" ) != NULL );
+    free_refresh_plan( plan );
+
+    // One worker reads it all in one
+    refresh_workers = 1;
+    plan            = plan_refresh( source, &object, "public.counts" );
+    CHECK( plan != NULL && plan->num_chunks == 1 );
+    CHECK( plan != NULL && strstr( plan->chunks[0], " ) q ) TO STDOUT" ) != NULL && strstr( plan->chunks[0], "hashtext" ) == NULL );
+    free_refresh_plan( plan );
+
+    refresh_workers = DEFAULT_REFRESH_WORKERS;
+    return;
+}
+
+// A change to the row of public.t keyed by id, with v as its value unless it is a DELETE
+static struct change * _make_change( unsigned short type, char * id, char * v )
+{
+    struct change * change = NULL;
+
+    change                   = new_change( type );
+    change->schema_name      = strdup( "public" );
+    change->table_name       = strdup( "t" );
+    change->key              = new_tuple( 1 );
+    change->key->num_columns = 1;
+    change->key->names[0]    = strdup( "id" );
+    change->key->values[0]   = strdup( id );
+
+    if( type != CHANGE_TYPE_DELETE )
+    {
+        change->new_tuple              = new_tuple( 2 );
+        change->new_tuple->num_columns = 2;
+        change->new_tuple->names[0]    = strdup( "id" );
+        change->new_tuple->values[0]   = strdup( id );
+        change->new_tuple->names[1]    = strdup( "v" );
+        change->new_tuple->values[1]   = strdup( v );
+    }
+
+    return change;
+}
+
+static void _test_shadow_buffer( void )
+{
+    struct maintenance_object object      = {0};
+    struct shadow_refresh     shadow      = {0};
+    struct change *           changes[5];
+    struct change **          buffered    = NULL;
+    unsigned long             num_changes = 0;
+    unsigned long             i           = 0;
+
+    object.qualified_name = "public.t";
+
+    changes[0] = _make_change( CHANGE_TYPE_INSERT, "1", "a" );
+    changes[1] = _make_change( CHANGE_TYPE_UPDATE, "1", "b" );
+    changes[2] = NULL;
+    changes[3] = _make_change( CHANGE_TYPE_INSERT, "2", "c" );
+    changes[4] = _make_change( CHANGE_TYPE_DELETE, "2", NULL );
+
+    // Nothing to do while the table is not being rebuilt
+    CHECK( buffer_shadow_changes( &object, changes, 5 ) );
+
+    shadow.buffer = new_coalesce_table( DEFAULT_COALESCE_BUCKETS );
+    object.shadow = &shadow;
+    CHECK( shadow.buffer != NULL && buffer_shadow_changes( &object, changes, 5 ) );
+
+    // The live table's apply goes on to free its own
+    for( i = 0; i < 5; i++ )
+    {
+        free_change( changes[i] );
+    }
+
+    CHECK( shadow.buffer != NULL && coalesce_drain( shadow.buffer, &buffered, &num_changes ) );
+    CHECK( num_changes == 1 && buffered != NULL );
+    CHECK(
+            num_changes == 1
+         && buffered[0]->type == CHANGE_TYPE_INSERT
+         && strcmp( buffered[0]->new_tuple->values[1], "b" ) == 0
+    );
+
+    for( i = 0; i < num_changes; i++ )
+    {
+        free_change( buffered[i] );
+    }
+
+    free( buffered );
+    free_coalesce_table( shadow.buffer );
+    return;
+}
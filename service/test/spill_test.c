@@ -0,0 +1,188 @@
+#include "test/test.h"
+
+/*
+ * Checks a spill queue in a directory of its own: frames beyond the memory
+ * limit go to a segment, the slot may be confirmed past them once what was
+ * only in memory is applied, a queue of the same name picks up the frames
+ * after the last confirmed COMMIT, and segments are deleted once read and
+ * confirmed. Also checks that a queue whose memory is never read to the end
+ * does not grow past its limit.
+ */
+
+#define TEST_QUEUE "spill_test"
+
+static void _push( struct spill_queue *, uint64_t, char *, bool );
+static bool _read_frame( struct spill_queue *, uint64_t *, char *, size_t );
+static void _test_recovery( void );
+static void _test_growth( void );
+
+int main( int argc, char ** argv )
+{
+    char directory[] = "/tmp/spill_test.XXXXXX";
+
+    log_min_level = LOG_LEVEL_FATAL;
+
+    spill_directory = mkdtemp( directory );
+    CHECK( spill_directory != NULL );
+
+    if( spill_directory == NULL )
+    {
+        return TEST_RESULT( "spill" );
+    }
+
+    _test_recovery();
+    _test_growth();
+
+    // Every segment was deleted
+    CHECK( rmdir( directory ) == 0 );
+
+    return TEST_RESULT( "spill" );
+}
+
+static void _push( struct spill_queue * queue, uint64_t lsn, char * data, bool is_commit )
+{
+    CHECK( spill_queue_push( queue, lsn, data, ( uint32_t ) strlen( data ), is_commit ) );
+    return;
+}
+
+// Reads the next frame's LSN and data, as a string in data, and consumes it
+static bool _read_frame( struct spill_queue * queue, uint64_t * lsn, char * data, size_t size )
+{
+    char *   frame  = NULL;
+    size_t   length = 0;
+    uint32_t bytes  = 0;
+
+    if( !spill_queue_peek( queue, &frame, &length ) || length < SPILL_FRAME_HEADER_LENGTH )
+    {
+        return false;
+    }
+
+    memcpy( lsn, frame, sizeof( uint64_t ) );
+    memcpy( &bytes, frame + sizeof( uint64_t ), sizeof( uint32_t ) );
+
+    if( bytes >= size || SPILL_FRAME_HEADER_LENGTH + bytes > length )
+    {
+        return false;
+    }
+
+    memcpy( data, frame + SPILL_FRAME_HEADER_LENGTH, bytes );
+    data[bytes] = '\0';
+
+    spill_queue_consume( queue, SPILL_FRAME_HEADER_LENGTH + bytes );
+    return true;
+}
+
+static void _test_recovery( void )
+{
+    struct spill_queue * queue = NULL;
+    uint64_t             lsn   = 0;
+    char                 data[64];
+
+    spill_memory_limit = 64;
+
+    queue = new_spill_queue( TEST_QUEUE );
+    CHECK( queue != NULL );
+
+    if( queue == NULL )
+    {
+        return;
+    }
+
+    // The first transaction fits in memory, the rest follow the first frame that does not
+    _push( queue, 10, "begin", false );
+    _push( queue, 11, "commit", true );
+    _push( queue, 20, "a row too long to be kept in memory", false );
+    _push( queue, 21, "commit", true );
+    _push( queue, 30, "another row", false );
+    _push( queue, 31, "commit", true );
+
+    CHECK( queue->head != NULL );
+    CHECK( spill_queue_sync( queue ) );
+
+    // What is only in memory has to be applied before the slot passes it
+    CHECK( spill_queue_safe_lsn( queue ) == 0 );
+    CHECK( _read_frame( queue, &lsn, data, sizeof( data ) ) && lsn == 10 );
+    CHECK( _read_frame( queue, &lsn, data, sizeof( data ) ) && lsn == 11 );
+    CHECK( spill_queue_confirm( queue, 11 ) );
+    CHECK( spill_queue_safe_lsn( queue ) == 31 );
+
+    CHECK( _read_frame( queue, &lsn, data, sizeof( data ) ) && lsn == 20 );
+    CHECK( strcmp( data, "a row too long to be kept in memory" ) == 0 );
+    CHECK( _read_frame( queue, &lsn, data, sizeof( data ) ) && lsn == 21 );
+    CHECK( spill_queue_confirm( queue, 21 ) );
+    free_spill_queue( queue, false );
+
+    // Picked up after the last COMMIT confirmed
+    queue = new_spill_queue( TEST_QUEUE );
+    CHECK( queue != NULL );
+
+    if( queue == NULL )
+    {
+        return;
+    }
+
+    CHECK( queue->confirmed_lsn == 21 && queue->durable_lsn == 31 );
+    CHECK( spill_queue_length( queue ) == 2 * SPILL_FRAME_HEADER_LENGTH + strlen( "another row" ) + strlen( "commit" ) );
+    CHECK( _read_frame( queue, &lsn, data, sizeof( data ) ) && lsn == 30 );
+    CHECK( strcmp( data, "another row" ) == 0 );
+    CHECK( _read_frame( queue, &lsn, data, sizeof( data ) ) && lsn == 31 );
+    CHECK( !_read_frame( queue, &lsn, data, sizeof( data ) ) );
+
+    // Read and confirmed, the segment goes, and frames are kept in memory again
+    CHECK( spill_queue_confirm( queue, 31 ) );
+    CHECK( queue->head == NULL );
+    _push( queue, 40, "in memory", true );
+    CHECK( queue->head == NULL );
+    free_spill_queue( queue, false );
+
+    queue = new_spill_queue( TEST_QUEUE );
+    CHECK( queue != NULL && queue->head == NULL && spill_queue_length( queue ) == 0 );
+    free_spill_queue( queue, true );
+    return;
+}
+
+// Reads a little less than is pushed, so memory is never read to the end
+static void _test_growth( void )
+{
+    struct spill_queue * queue  = NULL;
+    char *               data   = NULL;
+    char                 frame[1000];
+    size_t               length = 0;
+    uint64_t             lsn    = 0;
+    size_t               most   = 0;
+
+    spill_memory_limit = 1048576;
+    memset( frame, 'x', sizeof( frame ) );
+
+    queue = new_spill_queue( TEST_QUEUE );
+    CHECK( queue != NULL );
+
+    if( queue == NULL )
+    {
+        return;
+    }
+
+    CHECK( spill_queue_push( queue, 0, frame, sizeof( frame ), true ) );
+
+    for( lsn = 1; lsn <= 20000; lsn++ )
+    {
+        CHECK( spill_queue_push( queue, lsn, frame, sizeof( frame ), true ) );
+
+        if( spill_queue_peek( queue, &data, &length ) )
+        {
+            spill_queue_consume( queue, length > SPILL_FRAME_HEADER_LENGTH + sizeof( frame ) ? 1000 : length );
+        }
+
+        if( queue->memory->length > most )
+        {
+            most = queue->memory->length;
+        }
+    }
+
+    CHECK( queue->head == NULL );
+    CHECK( most <= 2 * spill_memory_limit + SPILL_COMPACT_BYTES );
+    CHECK( queue->memory->size <= 4 * spill_memory_limit );
+
+    free_spill_queue( queue, true );
+    return;
+}
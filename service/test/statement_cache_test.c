@@ -0,0 +1,303 @@
+#include "test/test.h"
+
+/*
+ * Checks a worker's statement cache against a server forked to answer the
+ * start of a session, Parse and simple queries, and to report the
+ * statements it is asked to prepare and the queries it runs: a statement is
+ * prepared once per object, operation and column set and reused after, is
+ * prepared again under its name once the connection has been replaced, and
+ * the statements of an object whose layout changed are deallocated and
+ * dropped, leaving those of other objects.
+ */
+
+// Long enough for every check, so that a line that is never reported fails the test rather than hangs it
+#define TEST_TIMEOUT_S 30
+
+static Oid param_types[] = { 23, 25 };
+
+static void _serve( int, int );
+static bool _answer_startup( int );
+static bool _answer( int, int );
+static void _expect( FILE *, char * );
+
+int main( int argc, char ** argv )
+{
+    struct worker               me       = {0};
+    struct statement_cache *    cache    = NULL;
+    struct prepared_statement * insert   = NULL;
+    struct prepared_statement * update   = NULL;
+    struct prepared_statement * other    = NULL;
+    struct prepared_statement * found    = NULL;
+    struct sockaddr_in          address  = {0};
+    socklen_t                   length   = sizeof( address );
+    FILE *                      reported = NULL;
+    char                        conninfo[128];
+    char                        line[256];
+    char                        name[64];
+    int                         report[2];
+    int                         listener = -1;
+    pid_t                       server   = 0;
+
+    log_min_level = LOG_LEVEL_FATAL;
+    alarm( TEST_TIMEOUT_S );
+
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    listener                = socket( AF_INET, SOCK_STREAM, 0 );
+
+    CHECK(
+            listener >= 0
+         && bind( listener, ( struct sockaddr * ) &address, sizeof( address ) ) == 0
+         && listen( listener, 4 ) == 0
+         && getsockname( listener, ( struct sockaddr * ) &address, &length ) == 0
+         && pipe( report ) == 0
+    );
+
+    server = fork();
+
+    if( server == 0 )
+    {
+        close( report[0] );
+        _serve( listener, report[1] );
+    }
+
+    close( listener );
+    close( report[1] );
+    reported = fdopen( report[0], "r" );
+
+    snprintf(
+        conninfo,
+        sizeof( conninfo ),
+        "host=127.0.0.1 port=%d user=test dbname=test sslmode=disable gssencmode=disable",
+        ntohs( address.sin_port )
+    );
+
+    connection_spares = 0;
+    me.conninfo       = conninfo;
+
+    insert = get_prepared_statement( &me, 7, 1, "a,b", "INSERT 1", 2, param_types );
+    CHECK( insert != NULL && insert->is_prepared );
+    CHECK( insert != NULL && strncmp( insert->name, STATEMENT_NAME_PREFIX "7_1_", strlen( STATEMENT_NAME_PREFIX "7_1_" ) ) == 0 );
+
+    if( insert == NULL )
+    {
+        kill( server, SIGTERM );
+        waitpid( server, NULL, 0 );
+        return TEST_RESULT( "statement_cache" );
+    }
+
+    snprintf( line, sizeof( line ), "P %s INSERT 1\n", insert->name );
+    _expect( reported, line );
+
+    // Found again, with the text it was created with
+    found = get_prepared_statement( &me, 7, 1, "a,b", "INSERT 2", 2, param_types );
+    CHECK( found == insert && strcmp( found->query, "INSERT 1" ) == 0 );
+
+    update = get_prepared_statement( &me, 7, 2, "a,b", "UPDATE 1", 2, param_types );
+    other  = get_prepared_statement( &me, 8, 1, "a,b", "INSERT 3", 2, param_types );
+    found  = get_prepared_statement( &me, 7, 1, "a", "INSERT 4", 1, param_types );
+    CHECK( update != NULL && other != NULL && found != NULL );
+    CHECK( update != insert && other != insert && found != insert && strcmp( update->name, other->name ) != 0 );
+
+    // Each prepared once, the first not again
+    _expect( reported, "P %s UPDATE 1\n" );
+    _expect( reported, "P %s INSERT 3\n" );
+    _expect( reported, "P %s INSERT 4\n" );
+
+    cache = ( struct statement_cache * ) me.statement_cache;
+    CHECK( cache != NULL && cache->num_entries == 4 );
+
+    // A new session has none of them
+    reset_statement_cache( &me );
+    CHECK( !( insert->is_prepared ) && !( other->is_prepared ) );
+    CHECK( get_prepared_statement( &me, 7, 1, "a,b", "INSERT 1", 2, param_types ) == insert );
+    snprintf( line, sizeof( line ), "P %s INSERT 1\n", insert->name );
+    _expect( reported, line );
+
+    // Only the prepared statement of object 7 is deallocated, and all of them dropped
+    snprintf( name, sizeof( name ), "%s", insert->name );
+    snprintf( line, sizeof( line ), "Q DEALLOCATE %s\n", name );
+
+    invalidate_object_statements( &me, 7 );
+    CHECK( cache != NULL && cache->num_entries == 1 );
+    _expect( reported, line );
+
+    CHECK( get_prepared_statement( &me, 8, 1, "a,b", "INSERT 3", 2, param_types ) == other );
+    _expect( reported, "P %s INSERT 3\n" );
+
+    // Object 7 gets a statement of a new name
+    found = get_prepared_statement( &me, 7, 1, "a,b", "INSERT 5", 2, param_types );
+    CHECK( found != NULL && strcmp( found->name, name ) != 0 );
+    _expect( reported, "P %s INSERT 5\n" );
+
+    PQfinish( me.conn );
+    free_connection_pool( ( struct connection_pool * ) me.connection_pool );
+    free_statement_cache( cache );
+
+    kill( server, SIGTERM );
+    waitpid( server, NULL, 0 );
+    fclose( reported );
+
+    connection_spares = DEFAULT_CONNECTION_SPARES;
+    return TEST_RESULT( "statement_cache" );
+}
+
+// Answers one connection after another, reporting what each prepares and runs
+static void _serve( int listener, int report )
+{
+    int client = -1;
+
+    alarm( TEST_TIMEOUT_S );
+
+    while( ( client = accept( listener, NULL, NULL ) ) >= 0 )
+    {
+        if( _answer_startup( client ) )
+        {
+            while( _answer( client, report ) );
+        }
+
+        close( client );
+    }
+
+    _exit( 0 );
+}
+
+/*
+ * Reads a startup message and answers AuthenticationOk and ReadyForQuery,
+ * refusing encryption if that is asked for first
+ */
+static bool _answer_startup( int fd )
+{
+    unsigned char header[8];
+    unsigned char ready[] = { 'R', 0, 0, 0, 8, 0, 0, 0, 0, 'Z', 0, 0, 0, 5, 'I' };
+    char          body[1024];
+    uint32_t      length  = 0;
+    uint32_t      code    = 0;
+
+    while( true )
+    {
+        if( recv( fd, header, sizeof( header ), MSG_WAITALL ) != ( ssize_t ) sizeof( header ) )
+        {
+            return false;
+        }
+
+        length = ( ( uint32_t ) header[0] << 24 ) | ( ( uint32_t ) header[1] << 16 ) | ( ( uint32_t ) header[2] << 8 ) | header[3];
+        code   = ( ( uint32_t ) header[4] << 24 ) | ( ( uint32_t ) header[5] << 16 ) | ( ( uint32_t ) header[6] << 8 ) | header[7];
+
+        // SSLRequest and GSSENCRequest
+        if( code == 80877103 || code == 80877104 )
+        {
+            if( write( fd, "N", 1 ) != 1 )
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        if(
+                length < sizeof( header )
+             || length - sizeof( header ) > sizeof( body )
+             || recv( fd, body, length - sizeof( header ), MSG_WAITALL ) != ( ssize_t ) ( length - sizeof( header ) )
+          )
+        {
+            return false;
+        }
+
+        return write( fd, ready, sizeof( ready ) ) == ( ssize_t ) sizeof( ready );
+    }
+}
+
+/*
+ * Reads one message, reporting a Parse as "P name query" and a Query as
+ * "Q query", and answers it as a server would. Returns false once the
+ * client has gone.
+ */
+static bool _answer( int fd, int report )
+{
+    unsigned char header[5];
+    unsigned char parsed[]    = { '1', 0, 0, 0, 4 };
+    unsigned char ready[]     = { 'Z', 0, 0, 0, 5, 'I' };
+    unsigned char completed[] = { 'C', 0, 0, 0, 15, 'D', 'E', 'A', 'L', 'L', 'O', 'C', 'A', 'T', 'E', 0 };
+    char          body[1024];
+    char          line[1100];
+    uint32_t      length      = 0;
+    bool          success     = true;
+
+    if( recv( fd, header, sizeof( header ), MSG_WAITALL ) != ( ssize_t ) sizeof( header ) )
+    {
+        return false;
+    }
+
+    length = ( ( uint32_t ) header[1] << 24 ) | ( ( uint32_t ) header[2] << 16 ) | ( ( uint32_t ) header[3] << 8 ) | header[4];
+
+    if(
+            length < 4
+         || length - 4 >= sizeof( body )
+         || ( length > 4 && recv( fd, body, length - 4, MSG_WAITALL ) != ( ssize_t ) ( length - 4 ) )
+      )
+    {
+        return false;
+    }
+
+    body[length - 4] = '\0';
+
+    switch( header[0] )
+    {
+        case 'P':
+            snprintf( line, sizeof( line ), "P %s %s\n", body, body + strlen( body ) + 1 );
+            success = write( report, line, strlen( line ) ) > 0
+                   && write( fd, parsed, sizeof( parsed ) ) == ( ssize_t ) sizeof( parsed );
+            break;
+        case 'Q':
+            snprintf( line, sizeof( line ), "Q %s\n", body );
+            success = write( report, line, strlen( line ) ) > 0
+                   && write( fd, completed, sizeof( completed ) ) == ( ssize_t ) sizeof( completed )
+                   && write( fd, ready, sizeof( ready ) ) == ( ssize_t ) sizeof( ready );
+            break;
+        case 'S':
+            success = write( fd, ready, sizeof( ready ) ) == ( ssize_t ) sizeof( ready );
+            break;
+        case 'X':
+            success = false;
+            break;
+        default:
+            break;
+    }
+
+    return success;
+}
+
+// Whether the next line reported is expected, with %s matching any name
+static void _expect( FILE * reported, char * expected )
+{
+    char         line[256];
+    char         name[128];
+    char *       rest = NULL;
+    unsigned int skip = 0;
+
+    if( fgets( line, sizeof( line ), reported ) == NULL )
+    {
+        CHECK( false );
+        return;
+    }
+
+    rest = strstr( expected, "%s" );
+
+    if( rest == NULL )
+    {
+        CHECK( strcmp( line, expected ) == 0 );
+        return;
+    }
+
+    skip = ( unsigned int ) ( rest - expected );
+
+    CHECK(
+            strncmp( line, expected, skip ) == 0
+         && sscanf( line + skip, "%127s", name ) == 1
+         && strncmp( name, STATEMENT_NAME_PREFIX, strlen( STATEMENT_NAME_PREFIX ) ) == 0
+         && strcmp( line + skip + strlen( name ), rest + 2 ) == 0
+    );
+
+    return;
+}
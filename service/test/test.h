@@ -0,0 +1,30 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include "src/pg_ctblmgr.h"
+
+/*
+ * What the programs under test/ share. Each checks one part of the service
+ * that needs no database, and exits with 1 once any of its checks failed,
+ * see make test.
+ */
+
+static unsigned int test_failures = 0;
+
+#define CHECK( condition ) \
+    do \
+    { \
+        if( !( condition ) ) \
+        { \
+            fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition ); \
+            test_failures++; \
+        } \
+    } while( 0 )
+
+#define TEST_RESULT( name ) \
+    ( \
+        printf( "%s: %s\n", name, test_failures == 0 ? "ok" : "FAILED" ), \
+        test_failures == 0 ? 0 : 1 \
+    )
+
+#endif // TEST_H